@@ -393,6 +393,8 @@ typedef struct {
 #define HAM_KEY_ERASED_IN_TXN        (-32)
 /** Database cannot be closed because it is modified in a Transaction */
 #define HAM_TXN_STILL_OPEN           (-33)
+/** A page or a record does not match its checksum; the file is corrupt */
+#define HAM_CHECKSUM_MISMATCH        (-34)
 /** Cursor does not point to a valid item */
 #define HAM_CURSOR_IS_NIL           (-100)
 /** Database not found */
@@ -576,6 +578,11 @@ ham_env_create(ham_env_t *env, const char *filename,
  *            be NULL. Do <b>NOT</b> use in combination with
  *            @ref HAM_CACHE_STRICT and do <b>NOT</b> specify @a cachesize
  *            other than 0.
+ *       <li>@ref HAM_IN_MEMORY_ARENA</li> Allocates the pages of an
+ *            In-Memory Environment from large arenas, and resolves page
+ *            addresses without a cache lookup. All pages are released
+ *            in bulk when the Environment is closed. Requires
+ *            @ref HAM_IN_MEMORY_DB.
  *       <li>@ref HAM_DISABLE_MMAP</li> Do not use memory mapped files for I/O.
  *            By default, hamsterdb checks if it can use mmap,
  *            since mmap is faster than read/write. For performance
@@ -603,6 +610,8 @@ ham_env_create(ham_env_t *env, const char *filename,
  *            but with certain limitations. Please read the README file
  *            for details.<br>
  *            This flag implies @ref HAM_ENABLE_RECOVERY.
+ *       <li>@ref HAM_ENABLE_METRICS </li> Collects per-operation latency
+ *            histograms and I/O counters; see @ref ham_env_get_metrics.
  *      </ul>
  *
  * @param mode File access rights for the new file. This is the @a mode
@@ -623,6 +632,9 @@ ham_env_create(ham_env_t *env, const char *filename,
  *        <li>@ref HAM_PARAM_LOG_DIRECTORY</li> The path of the log file
  *            and the journal files; default is the same path as the database
  *            file
+ *        <li>@ref HAM_PARAM_MAX_WRITE_SIZE</li> The maximum size of a
+ *            single write, in bytes, when dirty pages are flushed. Adjacent
+ *            pages are written together; the default is 1 MB
  *        </ul>
  *
  * @return @ref HAM_SUCCESS upon success
@@ -726,6 +738,8 @@ ham_env_open(ham_env_t *env, const char *filename, ham_u32_t flags);
  *            version). Please read the README file and the Release Notes
  *            for details.<br>
  *            This flag imples @ref HAM_ENABLE_RECOVERY.
+ *       <li>@ref HAM_ENABLE_METRICS </li> Collects per-operation latency
+ *            histograms and I/O counters; see @ref ham_env_get_metrics.
  *      </ul>
  * @param param An array of ham_parameter_t structures. The following
  *          parameters are available:
@@ -746,6 +760,9 @@ ham_env_open(ham_env_t *env, const char *filename, ham_u32_t flags);
  *        <li>@ref HAM_PARAM_LOG_DIRECTORY</li> The path of the log file
  *            and the journal files; default is the same path as the database
  *            file
+ *        <li>@ref HAM_PARAM_MAX_WRITE_SIZE</li> The maximum size of a
+ *            single write, in bytes, when dirty pages are flushed. Adjacent
+ *            pages are written together; the default is 1 MB
  *      </ul>
  *
  * @return @ref HAM_SUCCESS upon success.
@@ -786,6 +803,8 @@ ham_env_open_ex(ham_env_t *env, const char *filename,
  *              ham_u64_t variable)
  *        <li>@ref HAM_PARAM_LOG_DIRECTORY</li> The path of the log file
  *              and the journal files
+ *        <li>@ref HAM_PARAM_MAX_WRITE_SIZE</li> The maximum size of a
+ *              single write when dirty pages are flushed
  *      </ul>
  *
  * @param env A valid Environment handle
@@ -826,6 +845,15 @@ ham_env_get_parameters(ham_env_t *env, ham_parameter_t *param);
  *            Currently enabled by default, but future releases
  *            of hamsterdb will offer additional index structures,
  *            like hash tables.
+ *       <li>@ref HAM_USE_HASH </li> Use a hash table for the index
+ *            structure. Lookups, inserts and erases only access the
+ *            pages of a single bucket, but cursors can only move with
+ *            @ref HAM_CURSOR_FIRST and @ref HAM_CURSOR_NEXT, and visit
+ *            the keys in no particular order. Keys are compared byte-wise.
+ *            Not allowed in combination with @ref HAM_USE_BTREE,
+ *            @ref HAM_ENABLE_DUPLICATES, @ref HAM_RECORD_NUMBER and
+ *            @ref HAM_ENABLE_TRANSACTIONS. Approximate matching is not
+ *            supported.
  *       <li>@ref HAM_DISABLE_VAR_KEYLEN </li> Do not allow the use of variable
  *            length keys. Inserting a key, which is larger than the
  *            B+Tree index key size, returns @ref HAM_INV_KEYSIZE.
@@ -851,6 +879,20 @@ ham_env_get_parameters(ham_env_t *env, ham_parameter_t *param);
  *      <ul>
  *        <li>@ref HAM_PARAM_KEYSIZE </li> The size of the keys in the B+Tree
  *            index. The default size is 21 bytes.
+ *        <li>@ref HAM_PARAM_KEY_TYPE </li> The type of the keys; one of
+ *            @ref HAM_TYPE_BINARY (the default), @ref HAM_TYPE_BINARY_FIXED,
+ *            @ref HAM_TYPE_UINT32, @ref HAM_TYPE_UINT64, @ref HAM_TYPE_INT64
+ *            or @ref HAM_TYPE_REAL64. Keys of numeric types are compared
+ *            directly, without a compare function; their key size is the
+ *            size of the type. All keys must have this size, otherwise
+ *            @ref HAM_INV_KEYSIZE is returned. Not allowed in combination
+ *            with @ref HAM_RECORD_NUMBER.
+ *        <li>@ref HAM_PARAM_RECORD_INLINE_SIZE </li> Records up to this
+ *            size are stored in the B+Tree leaf, next to their key, and
+ *            not in a separate blob. The size is rounded up to a multiple
+ *            of 8 and must not exceed 248 bytes. Every key in the B+Tree
+ *            reserves this space. The default is 0 (records of more
+ *            than 8 bytes are always stored in blobs).
  *        <li>@ref HAM_PARAM_DATA_ACCESS_MODE </li> Gives a hint regarding data
  *            access patterns. The default setting optimizes hamsterdb
  *            for random read/write access (@ref HAM_DAM_RANDOM_WRITE).
@@ -1019,6 +1061,14 @@ ham_env_flush(ham_env_t *env, ham_u32_t flags);
  *
  * Log files and the header page of the Database are not encrypted.
  *
+ * By default, every 16 byte block of a page is encrypted with the same
+ * key (ECB mode), which is compatible with files created by earlier
+ * versions. With @ref HAM_ENCRYPTION_XTS, the pages are encrypted in
+ * XTS mode (IEEE 1619) with a tweak derived from the page address;
+ * equal blocks at different positions no longer produce the same
+ * ciphertext. If the CPU supports the AES-NI instructions then they are
+ * used. The mode has to be the same whenever the Environment is opened.
+ *
  * The encryption will be active till @ref ham_env_close is called. If the
  * Environment handle is reused after calling @ref ham_env_close, the
  * encryption is no longer active. @ref ham_env_enable_encryption should
@@ -1027,10 +1077,15 @@ ham_env_flush(ham_env_t *env, ham_u32_t flags);
  *
  * @param env A valid Environment handle
  * @param key A 128bit AES key
- * @param flags Optional flags for encrypting; unused, set to 0
+ * @param flags Optional flags for encrypting, combined with bitwise OR.
+ *        Possible flags are:
+ *      <ul>
+ *       <li>@ref HAM_ENCRYPTION_XTS</li> Encrypts the pages in XTS mode
+ *      </ul>
  *
  * @return @ref HAM_SUCCESS upon success
  * @return @ref HAM_INV_PARAMETER if one of the parameters is NULL
+ * @return @ref HAM_INV_PARAMETER if @a flags contains an unknown flag
  * @return @ref HAM_ALREADY_INITIALIZED if this function was called AFTER
  *              @ref ham_env_open_db or @ref ham_env_create_db
  * @return @ref HAM_NOT_IMPLEMENTED if hamsterdb was compiled without support
@@ -1042,6 +1097,9 @@ ham_env_flush(ham_env_t *env, ham_u32_t flags);
 HAM_EXPORT ham_status_t HAM_CALLCONV
 ham_env_enable_encryption(ham_env_t *env, ham_u8_t key[16], ham_u32_t flags);
 
+/** Flag for @ref ham_env_enable_encryption: encrypt in XTS mode */
+#define HAM_ENCRYPTION_XTS          0x0001
+
 /**
  * Returns the names of all Databases in an Environment
  *
@@ -1295,6 +1353,15 @@ ham_create(ham_db_t *db, const char *filename,
  *            Currently enabled by default, but future releases
  *            of hamsterdb will offer additional index structures,
  *            i.e. hash tables.
+ *       <li>@ref HAM_USE_HASH </li> Use a hash table for the index
+ *            structure. Lookups, inserts and erases only access the
+ *            pages of a single bucket, but cursors can only move with
+ *            @ref HAM_CURSOR_FIRST and @ref HAM_CURSOR_NEXT, and visit
+ *            the keys in no particular order. Keys are compared byte-wise.
+ *            Not allowed in combination with @ref HAM_USE_BTREE,
+ *            @ref HAM_ENABLE_DUPLICATES, @ref HAM_RECORD_NUMBER and
+ *            @ref HAM_ENABLE_TRANSACTIONS. Approximate matching is not
+ *            supported.
  *       <li>@ref HAM_DISABLE_VAR_KEYLEN </li> Do not allow the use of variable
  *            length keys. Inserting a key, which is larger than the
  *            B+Tree index key size, returns @ref HAM_INV_KEYSIZE.
@@ -1304,6 +1371,9 @@ ham_create(ham_db_t *db, const char *filename,
  *            be NULL. Do <b>NOT</b> use in combination with
  *            @ref HAM_CACHE_STRICT and do <b>NOT</b> specify @a cachesize
  *            other than 0.
+ *       <li>@ref HAM_IN_MEMORY_ARENA </li> Allocates the pages of an
+ *            In-Memory Database from large arenas; see
+ *            @ref ham_env_create_ex. Requires @ref HAM_IN_MEMORY_DB.
  *       <li>@ref HAM_RECORD_NUMBER </li> Creates an "auto-increment" Database.
  *            Keys in Record Number Databases are automatically assigned an
  *            incrementing 64bit value. If key->data is not NULL
@@ -1347,6 +1417,8 @@ ham_create(ham_db_t *db, const char *filename,
  *            version). Please read the README file and the Release Notes
  *            for details.<br>
  *            This flag imples @ref HAM_ENABLE_RECOVERY.
+ *       <li>@ref HAM_ENABLE_METRICS </li> Collects per-operation latency
+ *            histograms and I/O counters; see @ref ham_env_get_metrics.
  *      </ul>
  *
  * @param mode File access rights for the new file. This is the @a mode
@@ -1363,6 +1435,20 @@ ham_create(ham_db_t *db, const char *filename,
  *            Page sizes must be 1024 or a multiple of 2048.
  *        <li>@ref HAM_PARAM_KEYSIZE </li> The size of the keys in the B+Tree
  *            index. The default size is 21 bytes.
+ *        <li>@ref HAM_PARAM_KEY_TYPE </li> The type of the keys; one of
+ *            @ref HAM_TYPE_BINARY (the default), @ref HAM_TYPE_BINARY_FIXED,
+ *            @ref HAM_TYPE_UINT32, @ref HAM_TYPE_UINT64, @ref HAM_TYPE_INT64
+ *            or @ref HAM_TYPE_REAL64. Keys of numeric types are compared
+ *            directly, without a compare function; their key size is the
+ *            size of the type. All keys must have this size, otherwise
+ *            @ref HAM_INV_KEYSIZE is returned. Not allowed in combination
+ *            with @ref HAM_RECORD_NUMBER.
+ *        <li>@ref HAM_PARAM_RECORD_INLINE_SIZE </li> Records up to this
+ *            size are stored in the B+Tree leaf, next to their key, and
+ *            not in a separate blob. The size is rounded up to a multiple
+ *            of 8 and must not exceed 248 bytes. Every key in the B+Tree
+ *            reserves this space. The default is 0 (records of more
+ *            than 8 bytes are always stored in blobs).
  *        <li>@ref HAM_PARAM_DATA_ACCESS_MODE </li> Gives a hint regarding data
  *            access patterns. The default setting optimizes hamsterdb
  *            for random read/write access (@ref HAM_DAM_RANDOM_WRITE).
@@ -1465,6 +1551,8 @@ ham_open(ham_db_t *db, const char *filename, ham_u32_t flags);
  *            but with certain limitations. Please read the README file
  *            for details.<br>
  *            This flag imples @ref HAM_ENABLE_RECOVERY.
+ *       <li>@ref HAM_ENABLE_METRICS </li> Collects per-operation latency
+ *            histograms and I/O counters; see @ref ham_env_get_metrics.
  *       <li>@ref HAM_SORT_DUPLICATES </li> Sort duplicate keys for this
  *            Database. Only allowed if the Database was created with the flag
  *            @ref HAM_ENABLE_DUPLICATES. A compare function can be set with
@@ -1518,7 +1606,9 @@ ham_open_ex(ham_db_t *db, const char *filename,
  * This flag is non persistent. */
 #define HAM_READ_ONLY                0x00000004
 
-/* unused                            0x00000008 */
+/** Flag for @ref ham_create_ex, @ref ham_env_create_db.
+ * This flag is persisted in the Database. */
+#define HAM_USE_HASH                 0x00000008
 
 /** Flag for @ref ham_create, @ref ham_create_ex.
  * This flag is persisted in the Database. */
@@ -1593,6 +1683,86 @@ ham_open_ex(ham_db_t *db, const char *filename,
 
 /* reserved: DB_DISABLE_AUTO_FLUSH (not persistent)  0x00400000 */
 
+/** Flag for @ref ham_create_ex, @ref ham_open_ex, @ref ham_env_create_ex,
+ * @ref ham_env_open_ex.
+ * This flag is non persistent. */
+#define HAM_ENABLE_METRICS           0x00800000
+
+/** Flag for @ref ham_create_ex, @ref ham_env_create_ex; requires
+ * @ref HAM_IN_MEMORY_DB.
+ * This flag is non persistent. */
+#define HAM_IN_MEMORY_ARENA          0x01000000
+
+/* reserved: DB_KEY_TYPE_MASK (persisted in the Database) 0x0e000000 */
+
+/**
+ * Flag for @ref ham_create_ex, @ref ham_open_ex, @ref ham_env_create_ex,
+ * @ref ham_env_open_ex.
+ *
+ * Stores a CRC32C checksum in the header of every page and in every
+ * record blob when it is written. Checksums are always verified when
+ * a page or a complete record is read from the file, even if this flag
+ * is not set; a mismatch is reported as @ref HAM_CHECKSUM_MISMATCH.
+ * Pages which are written without this flag lose their checksum.
+ * The header page and the Duplicate tables are not checksummed.
+ * This flag is non persistent.
+ */
+#define HAM_ENABLE_CRC32             0x10000000
+
+/**
+ * Flag for @ref ham_create_ex, @ref ham_open_ex, @ref ham_env_create_ex,
+ * @ref ham_env_open_ex. Not allowed in combination with
+ * @ref HAM_IN_MEMORY_DB or @ref HAM_READ_ONLY.
+ *
+ * Manages the free space of the file as a map of free extents instead
+ * of freelist bitmaps. The extents are kept in memory; allocating and
+ * freeing space is logarithmic in the number of free extents, and
+ * freed neighbouring areas are coalesced. The extents are only written
+ * to the file when the Environment is closed; if the Environment is
+ * not closed properly then its free space is not re-used.
+ *
+ * When opening a file with a bitmap freelist, the bitmaps are converted
+ * to extents. The format is stored in the file, therefore a file with
+ * an extent freelist always uses it, even if this flag is not set.
+ * Older versions of hamsterdb must not open such a file.
+ */
+#define HAM_ENABLE_FREELIST_EXTENTS  0x20000000
+
+/**
+ * Flag for @ref ham_create_ex, @ref ham_open_ex, @ref ham_env_create_ex,
+ * @ref ham_env_open_ex. Not allowed in combination with
+ * @ref HAM_IN_MEMORY_DB.
+ *
+ * Stores small records (up to 254 bytes) in the slots of dedicated
+ * pages instead of allocating a blob for each record. The pages are
+ * divided into slots of a fixed size; records of similar size share a
+ * page, and only the pages are allocated from the freelist. Pages with
+ * free slots are tracked in memory, therefore the free slots of
+ * existing pages are only re-used after one of their records was
+ * erased or overwritten.
+ *
+ * Files with such records can be opened without this flag, but not
+ * by older versions of hamsterdb.
+ * This flag is non persistent.
+ */
+#define HAM_ENABLE_SLAB_RECORDS      0x40000000
+
+/**
+ * Flag for @ref ham_create_ex, @ref ham_open_ex, @ref ham_env_create_ex,
+ * @ref ham_env_open_ex.
+ *
+ * Converts a duplicate table to a duplicate tree when it grows beyond
+ * 255 entries. A duplicate tree is a B+tree of small nodes which is
+ * ordered by the position of the duplicates; inserting or erasing a
+ * duplicate only rewrites a few nodes instead of the whole table.
+ *
+ * Existing duplicate trees are also read and modified if this flag is
+ * not set, but files with duplicate trees cannot be opened by older
+ * versions of hamsterdb.
+ * This flag is non persistent.
+ */
+#define HAM_ENABLE_DUPLICATE_TREES   0x80000000
+
 /**
  * Returns the last error code
  *
@@ -1747,20 +1917,43 @@ ham_set_duplicate_compare_func(ham_db_t *db, ham_duplicate_compare_func_t foo);
  * with user-allocated records and the flag @ref HAM_RECORD_USER_ALLOC. In this
  * case, the query-function will return @ref HAM_INV_PARAMETER.
  *
+ * If @ref HAM_COMPRESS_PAGES is specified then the index pages of the
+ * Database are compressed instead of the records; call this function
+ * twice to compress both. A compressed page is stored at the beginning
+ * of its page in the file, and the unused rest of the page is released
+ * to the file system (if the file system supports this, i.e. on Linux).
+ * Pages are only stored compressed if this saves at least 4 kb. The
+ * freelist pages of the Environment are compressed as well while page
+ * compression is enabled for one of its Databases. Compressed pages are
+ * always decompressed when they are read, even if page compression is
+ * not enabled. Pages are not compressed if the Environment has file
+ * filters other than the XTS encryption (@ref HAM_ENCRYPTION_XTS). The
+ * compression ratio is reported in the @ref ham_env_metrics_t structure.
+ *
  * @param db A valid Database handle
  * @param level The compression level. 0 for the zlib default, 1 for
- *      best speed and 9 for minimum size
- * @param flags Optional flags for the compression; unused, set to 0
+ *      best speed and 9 for minimum size. With @ref HAM_COMPRESS_PAGES,
+ *      0 selects the best speed
+ * @param flags Optional flags for the compression:
+ *      <ul>
+ *       <li>@ref HAM_COMPRESS_PAGES</li> Compresses the index pages
+ *            instead of the records. Not allowed for In-Memory
+ *            Databases.
+ *      </ul>
  *
  * @return @ref HAM_SUCCESS upon success
  * @return @ref HAM_INV_PARAMETER if @a db is NULL or @a level is not between
- *      0 and 9
+ *      0 and 9, or if @ref HAM_COMPRESS_PAGES is used with an In-Memory
+ *      Database
  * @return @ref HAM_NOT_IMPLEMENTED if hamsterdb was compiled without support
  *      for compression
  */
 HAM_EXPORT ham_status_t HAM_CALLCONV
 ham_enable_compression(ham_db_t *db, ham_u32_t level, ham_u32_t flags);
 
+/** Flag for @ref ham_enable_compression */
+#define HAM_COMPRESS_PAGES              0x0001
+
 /**
  * Searches an item in the Database
  *
@@ -2070,6 +2263,40 @@ ham_insert(ham_db_t *db, ham_txn_t *txn, ham_key_t *key,
 HAM_EXPORT ham_status_t HAM_CALLCONV
 ham_erase(ham_db_t *db, ham_txn_t *txn, ham_key_t *key, ham_u32_t flags);
 
+/**
+ * Erases a range of Database items
+ *
+ * This function erases all keys which are greater than or equal to
+ * @a begin and less than @a end, including all their duplicates.
+ * If @a begin is NULL, the range starts at the first key of the Database;
+ * if @a end is NULL, the range ends at the last key of the Database.
+ * It is not an error if the range is empty.
+ *
+ * If Transactions are disabled, the btree pages which are fully covered
+ * by the range are removed as a whole, and only the pages at the
+ * boundaries of the range are modified. This is much faster than erasing
+ * the keys one by one. If Transactions are enabled, the keys are erased
+ * in the Transaction (or in a temporary Transaction if @a txn is NULL),
+ * one by one.
+ *
+ * @param db A valid Database handle
+ * @param txn A Transaction handle, or NULL
+ * @param begin The first key of the range (inclusive), or NULL
+ * @param end The end of the range (exclusive), or NULL
+ * @param flags Optional flags for erasing; unused, set to 0
+ *
+ * @return @ref HAM_SUCCESS upon success
+ * @return @ref HAM_INV_PARAMETER if @a db is NULL
+ * @return @ref HAM_DB_READ_ONLY if you tried to erase keys from a read-only
+ *              Database
+ * @return @ref HAM_NOT_IMPLEMENTED if the Database is a remote Database
+ * @return @ref HAM_TXN_CONFLICT if one of the keys was inserted in another
+ *              Transaction which was not yet committed or aborted
+ */
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_erase_range(ham_db_t *db, ham_txn_t *txn, ham_key_t *begin,
+            ham_key_t *end, ham_u32_t flags);
+
 /* internal flag for ham_erase() - do not use */
 #define HAM_ERASE_ALL_DUPLICATES                1
 
@@ -2132,6 +2359,9 @@ ham_get_key_count(ham_db_t *db, ham_txn_t *txn, ham_u32_t flags,
  *        <li>HAM_PARAM_CACHESIZE</li> returns the cache size
  *        <li>HAM_PARAM_PAGESIZE</li> returns the page size
  *        <li>HAM_PARAM_KEYSIZE</li> returns the key size
+ *        <li>HAM_PARAM_KEY_TYPE</li> returns the key type
+ *        <li>HAM_PARAM_RECORD_INLINE_SIZE</li> returns the size of the
+ *              records which are stored in the B+Tree leaves
  *        <li>HAM_PARAM_MAX_ENV_DATABASES</li> returns the max. number of
  *              Databases of this Database's Environment
  *        <li>@ref HAM_PARAM_LOG_DIRECTORY</li> The path of the log file
@@ -2183,6 +2413,44 @@ ham_get_parameters(ham_db_t *db, ham_parameter_t *param);
  * @ref ham_open_ex, @ref ham_create_ex; sets the path of the log files */
 #define HAM_PARAM_LOG_DIRECTORY      0x00000105
 
+/** Parameter name for @ref ham_create_ex, @ref ham_env_create_db; sets the
+ * type of the keys (one of the HAM_TYPE_* constants). Can also be
+ * retrieved with @ref ham_get_parameters */
+#define HAM_PARAM_KEY_TYPE           0x00000106
+
+/** Parameter name for @ref ham_create_ex, @ref ham_env_create_db; sets the
+ * maximum size of the records which are stored in the B+Tree leaves. Can
+ * also be retrieved with @ref ham_get_parameters */
+#define HAM_PARAM_RECORD_INLINE_SIZE 0x00000107
+
+/** Parameter name for @ref ham_env_open_ex, @ref ham_env_create_ex,
+ * @ref ham_open_ex, @ref ham_create_ex; sets the maximum size of a single
+ * write (in bytes) when dirty pages are flushed. Dirty pages are written
+ * in the order of their addresses, and adjacent pages are combined into
+ * one write of up to this size. Can also be retrieved with
+ * @ref ham_env_get_parameters */
+#define HAM_PARAM_MAX_WRITE_SIZE     0x00000108
+
+/** Key type: binary keys of variable length; this is the default */
+#define HAM_TYPE_BINARY              0
+
+/** Key type: binary keys which always have the size of the key size
+ * (@ref HAM_PARAM_KEYSIZE); keys are compared with memcmp */
+#define HAM_TYPE_BINARY_FIXED        1
+
+/** Key type: unsigned 32bit integers in host byte order */
+#define HAM_TYPE_UINT32              2
+
+/** Key type: unsigned 64bit integers in host byte order */
+#define HAM_TYPE_UINT64              3
+
+/** Key type: signed 64bit integers in host byte order */
+#define HAM_TYPE_INT64               4
+
+/** Key type: 64bit floating point numbers (double); NaN is not
+ * supported */
+#define HAM_TYPE_REAL64              5
+
 /**
  * Retrieve the Database/Environment flags as were specified at the time of
  * @ref ham_create/@ref ham_env_create/@ref ham_open/@ref ham_env_open
@@ -2545,6 +2813,58 @@ ham_cursor_move(ham_cursor_t *cursor, ham_key_t *key,
 /** Flag for @ref ham_cursor_move */
 #define HAM_ONLY_DUPLICATES         0x0020
 
+/**
+ * Moves the Cursor over many items and returns their keys and records
+ *
+ * This function is identical to calling @ref ham_cursor_move up to
+ * @a *count times, but the Environment is locked only once and the
+ * arguments are only verified once. Without Transactions, the items are
+ * read directly from the current leaf page of the Database. This makes
+ * the function well suited for scanning large parts of a Database.
+ *
+ * The first item is retrieved with the direction in @a flags; the
+ * following items are retrieved with @ref HAM_CURSOR_NEXT (if @a flags
+ * contains @ref HAM_CURSOR_FIRST or @ref HAM_CURSOR_NEXT) or
+ * @ref HAM_CURSOR_PREVIOUS (if @a flags contains @ref HAM_CURSOR_LAST or
+ * @ref HAM_CURSOR_PREVIOUS). The function stops at the first or last item
+ * of the Database; then @a *count is smaller than the requested number
+ * of items.
+ *
+ * The data of the returned keys and records is stored in a buffer of
+ * the Cursor, and remains valid until the Cursor is used in the next
+ * call of @ref ham_cursor_move_many or closed. Keys with
+ * @ref HAM_KEY_USER_ALLOC and records with @ref HAM_RECORD_USER_ALLOC
+ * are copied to the buffers of the caller instead.
+ *
+ * @param cursor A valid Cursor handle
+ * @param keys An optional array of at least @a *count @ref ham_key_t
+ *      structures; if this pointer is not NULL, the keys of the items
+ *      are returned
+ * @param records An optional array of at least @a *count @ref ham_record_t
+ *      structures; if this pointer is not NULL, the records of the items
+ *      are returned
+ * @param count Contains the maximum number of items when the function
+ *      is called, and returns the number of retrieved items
+ * @param flags The flags for this operation; exactly one of
+ *      @ref HAM_CURSOR_FIRST, @ref HAM_CURSOR_LAST, @ref HAM_CURSOR_NEXT
+ *      or @ref HAM_CURSOR_PREVIOUS is required. Optionally combined with
+ *      @ref HAM_SKIP_DUPLICATES, @ref HAM_ONLY_DUPLICATES or
+ *      @ref HAM_DIRECT_ACCESS (see @ref ham_cursor_move).
+ *
+ * @return @ref HAM_SUCCESS if at least one item was retrieved
+ * @return @ref HAM_INV_PARAMETER if @a cursor or @a count is NULL, if
+ *              @a *count is 0 or if an invalid combination of flags was
+ *              specified
+ * @return @ref HAM_INV_PARAMETER if @ref HAM_PARTIAL was specified
+ * @return @ref HAM_KEY_NOT_FOUND if no item was retrieved because
+ *              @a cursor points to the last (or first) item
+ *
+ * @sa ham_cursor_move
+ */
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_cursor_move_many(ham_cursor_t *cursor, ham_key_t *keys,
+        ham_record_t *records, ham_u32_t *count, ham_u32_t flags);
+
 /**
  * Overwrites the current record
  *
@@ -3141,6 +3461,125 @@ ham_cursor_get_record_size(ham_cursor_t *cursor, ham_offset_t *size);
 HAM_EXPORT ham_status_t HAM_CALLCONV
 ham_cursor_close(ham_cursor_t *cursor);
 
+/**
+ * A handle for reading and writing a record in pieces
+ *
+ * This structure is allocated with @ref ham_record_stream_open and
+ * deleted with @ref ham_record_stream_close.
+ */
+struct ham_record_stream_t;
+typedef struct ham_record_stream_t ham_record_stream_t;
+
+/**
+ * Opens a stream for the record of the current key
+ *
+ * A stream reads and writes the record of the item to which the Cursor
+ * currently refers, without loading the whole record into memory. Every
+ * read and write directly accesses the requested part of the record in
+ * the file; large reads are done with few, sequential read operations.
+ *
+ * The stream has a position, which is advanced by @ref
+ * ham_record_stream_read and @ref ham_record_stream_write. It starts at
+ * the beginning of the record, or at its end if @ref
+ * HAM_RECORD_STREAM_APPEND is specified. Writes overwrite the record
+ * at the current position and grow the record if they exceed its end.
+ *
+ * Appending to a record does not rewrite it, unless the space which was
+ * allocated for the record is exhausted; then the record is moved and
+ * additional space is reserved for further appends.
+ *
+ * Records which were written through a stream are not protected by
+ * a checksum (see @ref HAM_ENABLE_CRC32).
+ *
+ * The stream always accesses the record of the item to which the Cursor
+ * currently refers; the Cursor should not be moved while the stream is
+ * open. If the Cursor is closed then the stream can only be closed.
+ * Streams are not supported for keys with duplicates, in Databases with
+ * Transactions, record filters or @ref HAM_USE_HASH, and in remote
+ * Databases.
+ *
+ * @param cursor A valid Cursor handle
+ * @param flags Optional flags for opening the stream, combined with
+ *        bitwise OR. Possible flags are:
+ *      <ul>
+ *       <li>@ref HAM_RECORD_STREAM_APPEND </li> The position of the
+ *            stream is the end of the record.
+ *      </ul>
+ * @param stream Returns the stream handle
+ *
+ * @return @ref HAM_SUCCESS upon success
+ * @return @ref HAM_CURSOR_IS_NIL if the Cursor does not point to an item
+ * @return @ref HAM_INV_PARAMETER if @a cursor or @a stream is NULL, if
+ *              an invalid flag was specified, if the key has duplicates
+ *              or if the Database does not support streams
+ * @return @ref HAM_NOT_IMPLEMENTED if the Database is remote
+ * @return @ref HAM_OUT_OF_MEMORY if memory could not be allocated
+ */
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_record_stream_open(ham_cursor_t *cursor, ham_u32_t flags,
+        ham_record_stream_t **stream);
+
+/**
+ * Flag for @ref ham_record_stream_open: the position of the stream is
+ * the end of the record
+ */
+#define HAM_RECORD_STREAM_APPEND        0x0001
+
+/**
+ * Reads from a record stream
+ *
+ * Reads up to @a size bytes at the current position of the stream and
+ * advances the position. Fewer bytes are read if the end of the record
+ * is reached; at the end of the record, @a bytes_read is 0.
+ *
+ * @param stream A valid stream handle
+ * @param data The buffer for the data
+ * @param size The size of the buffer
+ * @param bytes_read Returns the number of bytes which were read
+ *
+ * @return @ref HAM_SUCCESS upon success
+ * @return @ref HAM_INV_PARAMETER if @a stream, @a data or @a bytes_read
+ *              is NULL
+ * @return @ref HAM_CURSOR_IS_NIL if the Cursor of the stream was closed
+ */
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_record_stream_read(ham_record_stream_t *stream, void *data,
+        ham_size_t size, ham_size_t *bytes_read);
+
+/**
+ * Writes to a record stream
+ *
+ * Writes @a size bytes at the current position of the stream and
+ * advances the position. The record grows if the data exceeds its end.
+ *
+ * @param stream A valid stream handle
+ * @param data The data
+ * @param size The size of the data
+ *
+ * @return @ref HAM_SUCCESS upon success
+ * @return @ref HAM_INV_PARAMETER if @a stream or @a data is NULL
+ * @return @ref HAM_CURSOR_IS_NIL if the Cursor of the stream was closed
+ * @return @ref HAM_DB_READ_ONLY if the Database was opened read-only
+ * @return @ref HAM_LIMITS_REACHED if the record would exceed 4 GB
+ */
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_record_stream_write(ham_record_stream_t *stream, const void *data,
+        ham_size_t size);
+
+/**
+ * Closes a record stream
+ *
+ * All data was already written by @ref ham_record_stream_write; closing
+ * the stream only releases its memory.
+ *
+ * @param stream A valid stream handle
+ *
+ * @return @ref HAM_SUCCESS upon success
+ * @return @ref HAM_INV_PARAMETER if @a stream is NULL
+ */
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_record_stream_close(ham_record_stream_t *stream);
+
 /**
  * @}
  */
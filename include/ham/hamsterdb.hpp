@@ -419,6 +419,16 @@ public:
             throw error(st);
     }
 
+    /** Erases all keys in the range [begin, end). */
+    void erase_range(txn *t, key *begin, key *end, ham_u32_t flags=0) {
+        ham_status_t st=ham_erase_range(m_db,
+                t ? t->get_handle() : 0,
+                begin ? begin->get_handle() : 0,
+                end ? end->get_handle() : 0, flags);
+        if (st)
+            throw error(st);
+    }
+
     /** Flushes the Database to disk. */
     void flush(ham_u32_t flags=0) {
         ham_status_t st=ham_flush(m_db, flags);
@@ -86,6 +86,17 @@ extern "C" {
  *
  * This function is only interesting if you want to debug hamsterdb.
  *
+ * For file-based Databases, the modified pages are flushed to disk and
+ * the file is then verified with large sequential reads on a pool of
+ * worker threads, without holding the Environment lock; other threads
+ * can continue to use the Environment in the meantime. Besides the
+ * btree nodes, the freelist is cross-checked against the pages and
+ * blobs which are in use. If a verification fails while the file was
+ * modified concurrently, it is repeated while holding the lock.
+ *
+ * Encrypted or compressed files and In-Memory Databases are verified
+ * while holding the lock.
+ *
  * @param db A valid Database handle
  * @param txn A Transaction handle, or NULL
  *
@@ -95,6 +106,416 @@ extern "C" {
 HAM_EXPORT ham_status_t HAM_CALLCONV
 ham_check_integrity(ham_db_t *db, ham_txn_t *txn);
 
+/**
+ * @defgroup ham_metrics hamsterdb Runtime Metrics
+ * @{
+ */
+
+/** Operation index for @ref ham_find and @ref ham_cursor_find(_ex) */
+#define HAM_METRICS_OP_FIND             0
+/** Operation index for @ref ham_insert and @ref ham_cursor_insert */
+#define HAM_METRICS_OP_INSERT           1
+/** Operation index for @ref ham_erase and @ref ham_cursor_erase */
+#define HAM_METRICS_OP_ERASE            2
+/** Operation index for @ref ham_cursor_move */
+#define HAM_METRICS_OP_CURSOR_MOVE      3
+/** Operation index for @ref ham_txn_commit */
+#define HAM_METRICS_OP_TXN_COMMIT       4
+/** The number of instrumented operations */
+#define HAM_METRICS_OP_MAX              5
+
+/**
+ * The number of buckets of a latency histogram.
+ *
+ * The histogram is log-linear: every power of two (in nanoseconds) is
+ * split into 4 sub-buckets, therefore the relative error of a
+ * reported percentile is at most 25%.
+ */
+#define HAM_METRICS_HISTOGRAM_BUCKETS   256
+
+/**
+ * A latency histogram of a single operation type; all times are
+ * in nanoseconds
+ */
+typedef struct
+{
+    /** number of recorded operations */
+    ham_u64_t count;
+
+    /** sum of all recorded latencies */
+    ham_u64_t total_ns;
+
+    /** the smallest recorded latency */
+    ham_u64_t min_ns;
+
+    /** the largest recorded latency */
+    ham_u64_t max_ns;
+
+    /** the histogram buckets */
+    ham_u64_t buckets[HAM_METRICS_HISTOGRAM_BUCKETS];
+
+} ham_latency_histogram_t;
+
+/**
+ * The runtime metrics of an Environment
+ *
+ * Metrics are only collected if the Environment was created or opened
+ * with @ref HAM_ENABLE_METRICS, and if hamsterdb was not built with
+ * HAM_DISABLE_METRICS (configure --disable-metrics).
+ */
+typedef struct
+{
+    /** latency histograms, indexed by the HAM_METRICS_OP_* constants */
+    ham_latency_histogram_t operations[HAM_METRICS_OP_MAX];
+
+    /** number of pages which were found in the cache */
+    ham_u64_t cache_hits;
+
+    /** number of pages which were not found in the cache */
+    ham_u64_t cache_misses;
+
+    /** number of pages read from the device */
+    ham_u64_t pages_read;
+
+    /** number of pages written to the device */
+    ham_u64_t pages_written;
+
+    /** number of write calls for these pages; adjacent pages are
+     * written with a single call */
+    ham_u64_t page_writes;
+
+    /** number of bytes read from the database file */
+    ham_u64_t bytes_read;
+
+    /** number of bytes written to the database file */
+    ham_u64_t bytes_written;
+
+    /** number of fsync/fdatasync calls (database file, log and journal) */
+    ham_u64_t fsyncs;
+
+    /** number of bytes appended to the log */
+    ham_u64_t log_bytes;
+
+    /** number of bytes appended to the journal */
+    ham_u64_t journal_bytes;
+
+    /** number of times an operation had to wait for the Environment lock */
+    ham_u64_t lock_waits;
+
+    /** total time spent waiting for the Environment lock */
+    ham_u64_t lock_wait_ns;
+
+    /** number of pages and records which did not match their checksum */
+    ham_u64_t checksum_failures;
+
+    /** number of pages which were passed to the page compression
+     * (see @ref HAM_COMPRESS_PAGES) */
+    ham_u64_t compressed_pages;
+
+    /** the uncompressed size of these pages */
+    ham_u64_t compression_bytes_in;
+
+    /** the number of bytes which were written for these pages; the
+     * compression ratio is compression_bytes_in/compression_bytes_out */
+    ham_u64_t compression_bytes_out;
+
+} ham_env_metrics_t;
+
+/**
+ * Retrieves the runtime metrics of an Environment
+ *
+ * @param env A valid Environment handle
+ * @param metrics A pointer to a structure which receives a copy of the
+ *          current metrics
+ * @param flags Optional flags; if @ref HAM_METRICS_RESET is specified then
+ *          the metrics are reset after they were copied
+ *
+ * @return @ref HAM_SUCCESS upon success
+ * @return @ref HAM_INV_PARAMETER if @a env or @a metrics is NULL, or if
+ *          the Environment was not created/opened with
+ *          @ref HAM_ENABLE_METRICS
+ * @return @ref HAM_NOT_IMPLEMENTED if hamsterdb was built without
+ *          support for metrics
+ */
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_env_get_metrics(ham_env_t *env, ham_env_metrics_t *metrics,
+            ham_u32_t flags);
+
+/** Flag for @ref ham_env_get_metrics */
+#define HAM_METRICS_RESET               1
+
+/**
+ * Calculates a percentile of a latency histogram
+ *
+ * @param histogram A latency histogram
+ * @param percentile The percentile, i.e. 50.0 for the median or 99.9
+ *
+ * @return The (upper bound of the) latency in nanoseconds, or 0 if the
+ *          histogram is empty
+ */
+HAM_EXPORT ham_u64_t HAM_CALLCONV
+ham_latency_histogram_get_percentile(const ham_latency_histogram_t *histogram,
+            double percentile);
+
+/**
+ * @}
+ */
+
+/**
+ * @defgroup ham_trace hamsterdb Operation Tracing
+ * @{
+ */
+
+/**
+ * Starts recording all operations of an Environment to a trace file
+ *
+ * The trace file contains one entry per operation (Database create/open/
+ * close, Transaction begin/commit/abort, insert, find, erase, all Cursor
+ * operations and flush) with its flags, return value, a timestamp, the
+ * Transaction and Cursor ids, the id of the calling thread and a hash of
+ * the key. It can be replayed with the ham_replay tool.
+ *
+ * Tracing has no overhead if it is not enabled.
+ *
+ * @param env A valid Environment handle
+ * @param filename The path of the trace file; an existing file is
+ *          overwritten
+ * @param flags Optional flags; if @ref HAM_TRACE_FULL_DATA is specified
+ *          then the key data and the inserted records are stored in the
+ *          trace, otherwise only their sizes and a hash of the key
+ *
+ * @return @ref HAM_SUCCESS upon success
+ * @return @ref HAM_INV_PARAMETER if @a env or @a filename is NULL
+ * @return @ref HAM_ALREADY_INITIALIZED if tracing is already enabled
+ * @return @ref HAM_NOT_INITIALIZED if the Environment was not yet
+ *          created or opened
+ * @return @ref HAM_IO_ERROR if the file could not be created
+ */
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_env_enable_tracing(ham_env_t *env, const char *filename, ham_u32_t flags);
+
+/** Flag for @ref ham_env_enable_tracing */
+#define HAM_TRACE_FULL_DATA             1
+
+/**
+ * Stops recording operations and closes the trace file
+ *
+ * Tracing is also stopped when the Environment is closed.
+ *
+ * @param env A valid Environment handle
+ *
+ * @return @ref HAM_SUCCESS upon success
+ * @return @ref HAM_INV_PARAMETER if @a env is NULL or if tracing is not
+ *          enabled
+ * @return @ref HAM_IO_ERROR (or another error) if writing the trace
+ *          file failed
+ */
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_env_disable_tracing(ham_env_t *env);
+
+/**
+ * @}
+ */
+
+/**
+ * @defgroup ham_compact hamsterdb Online Compaction
+ * @{
+ */
+
+/**
+ * The progress of the online compaction, returned by @ref ham_env_compact
+ *
+ * All counters are accumulated since the Environment was opened.
+ */
+typedef struct {
+    /** the current size of the file, in bytes */
+    ham_u64_t filesize;
+
+    /** the number of bytes which are used by pages and blobs */
+    ham_u64_t live_size;
+
+    /** the number of btree and freelist pages which were moved */
+    ham_u64_t pages_moved;
+
+    /** the number of blobs (records, duplicate tables and extended
+     * keys) which were moved */
+    ham_u64_t blobs_moved;
+
+    /** the number of bytes which were truncated from the file */
+    ham_u64_t bytes_truncated;
+
+    /** true if the file cannot be shrunk any further */
+    ham_bool_t done;
+
+} ham_compact_progress_t;
+
+/**
+ * Runs a single step of the online compaction
+ *
+ * The compaction moves the pages and blobs at the end of the file to
+ * free space in the lower part of the file, updates all references
+ * and then truncates the file. All Databases of the Environment are
+ * compacted; Databases which are not open are opened temporarily.
+ *
+ * Each call moves at most @a max_moves pages or blobs while holding the
+ * Environment lock; afterwards the lock is released, and other threads
+ * can continue working with the Environment. Call this function
+ * repeatedly till @a progress->done is true. The compaction can be
+ * interrupted at any time.
+ *
+ * Before the first step, and whenever the file was modified by another
+ * operation, the compaction has to scan all Databases.
+ *
+ * @param env A valid Environment handle
+ * @param max_moves The maximum number of pages or blobs which are moved
+ *          in this step; must not be 0
+ * @param progress An optional pointer to a @ref ham_compact_progress_t
+ *          structure which receives the progress
+ *
+ * @return @ref HAM_SUCCESS upon success
+ * @return @ref HAM_INV_PARAMETER if @a env is NULL or @a max_moves is 0
+ * @return @ref HAM_NOT_INITIALIZED if the Environment was not yet
+ *          created or opened
+ * @return @ref HAM_NOT_IMPLEMENTED if the Environment is an In-Memory
+ *          Environment or a remote Environment
+ * @return @ref HAM_DB_READ_ONLY if the Environment was opened with
+ *          @ref HAM_READ_ONLY
+ */
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_env_compact(ham_env_t *env, ham_u32_t max_moves,
+            ham_compact_progress_t *progress);
+
+/**
+ * @}
+ */
+
+/**
+ * @defgroup ham_backup hamsterdb Hot Backup
+ * @{
+ */
+
+/**
+ * Flag for @ref ham_env_backup: only copies the pages which were modified
+ * since the previous backup
+ */
+#define HAM_BACKUP_INCREMENTAL                       1
+
+/**
+ * Copies the Database file of an Environment while it is in use
+ *
+ * The Environment is flushed, and the copy contains the state of the
+ * file at this moment. Then the file is copied in large sequential chunks;
+ * other threads can continue to modify the Environment in the meantime.
+ * Before a page is overwritten for the first time, its previous contents
+ * are written to the copy.
+ *
+ * With @ref HAM_BACKUP_INCREMENTAL, only the pages which were modified
+ * since the previous backup are written to the existing copy. This
+ * requires that the previous backup of this Environment handle was
+ * written to the same @a path, and that the copy was not modified;
+ * otherwise a full backup is made. The modified pages are tracked in
+ * memory as soon as the first backup was started, and the tracking is
+ * lost when the Environment is closed.
+ *
+ * The log files and journal files are not copied. Transactions which
+ * were not yet flushed to the Database file are not part of the copy.
+ *
+ * The Environment must not be closed while this function is running.
+ *
+ * @param env A valid Environment handle
+ * @param path The path of the copy; an existing file is overwritten
+ * @param flags Optional flags for the backup; possible flags are:
+ *      <ul>
+ *        <li>@ref HAM_BACKUP_INCREMENTAL</li> Only copies the pages which
+ *          were modified since the previous backup
+ *      </ul>
+ *
+ * @return @ref HAM_SUCCESS upon success
+ * @return @ref HAM_INV_PARAMETER if @a env or @a path is NULL, or if
+ *          @a path is the path of the Database file
+ * @return @ref HAM_NOT_INITIALIZED if the Environment was not yet
+ *          created or opened
+ * @return @ref HAM_NOT_IMPLEMENTED if the Environment is an In-Memory
+ *          Environment or a remote Environment
+ * @return @ref HAM_WOULD_BLOCK if another backup of this Environment is
+ *          running
+ * @return @ref HAM_IO_ERROR if the copy could not be written
+ */
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_env_backup(ham_env_t *env, const char *path, ham_u32_t flags);
+
+/**
+ * @}
+ */
+
+/**
+ * @defgroup ham_bloom hamsterdb Bloom Filters
+ * @{
+ */
+
+/**
+ * Enables the bloom filter of a Database
+ *
+ * The bloom filter answers most lookups of keys which do not exist
+ * without reading a single page of the Database. It is consulted by
+ * @ref ham_find if neither @ref HAM_FIND_LT_MATCH nor
+ * @ref HAM_FIND_GT_MATCH is specified, and if the Database uses the
+ * default compare function.
+ *
+ * The filter is built immediately from the existing keys. Afterwards,
+ * every inserted key is added to the filter; erased keys remain in the
+ * filter until it is rebuilt. The filter is rebuilt during a lookup if
+ * more than half of its keys were erased, or if it became too small;
+ * the rebuild is postponed while Transactions are active.
+ *
+ * The filter is stored in the Database file when the Database is closed,
+ * and loaded when the Database is opened. If the Database was not closed
+ * properly, the filter is lost and has to be enabled again. Calling this
+ * function for a Database with a loaded filter of the same configuration
+ * has no effect.
+ *
+ * @param db A valid Database handle
+ * @param false_positive_rate The desired probability that the filter
+ *          does not reject a key which does not exist, i.e. 0.01;
+ *          must be between 0 and 1
+ * @param max_size The maximum size of the filter in bytes, or 0 if the
+ *          size is unlimited; if the limit is reached, the actual false
+ *          positive rate is higher than @a false_positive_rate
+ *
+ * @return @ref HAM_SUCCESS upon success
+ * @return @ref HAM_INV_PARAMETER if @a db is NULL or if
+ *          @a false_positive_rate or @a max_size are invalid
+ * @return @ref HAM_NOT_INITIALIZED if the Database was not yet created
+ *          or opened
+ * @return @ref HAM_NOT_IMPLEMENTED if the Database is a Record Number
+ *          Database or a remote Database
+ * @return @ref HAM_TXN_STILL_OPEN if a Transaction is active
+ */
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_enable_bloom_filter(ham_db_t *db, double false_positive_rate,
+            ham_size_t max_size);
+
+/**
+ * Disables the bloom filter of a Database
+ *
+ * The filter is removed from memory and from the Database file.
+ *
+ * @param db A valid Database handle
+ *
+ * @return @ref HAM_SUCCESS upon success
+ * @return @ref HAM_INV_PARAMETER if @a db is NULL
+ * @return @ref HAM_NOT_INITIALIZED if the Database was not yet created
+ *          or opened
+ * @return @ref HAM_DB_READ_ONLY if the Database was opened with
+ *          @ref HAM_READ_ONLY
+ */
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_disable_bloom_filter(ham_db_t *db);
+
+/**
+ * @}
+ */
+
 /**
  * Estimates the number of keys stored per page in the Database
  *
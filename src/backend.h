@@ -78,8 +78,9 @@ class Backend
 {
   public:
     Backend(Database *db, ham_u32_t flags)
-      : m_db(db), m_keysize(0), m_recno(0), m_is_dirty(false), 
-        m_is_active(false), m_flags(flags) {
+      : m_db(db), m_keysize(0), m_inline_size(0), m_recno(0),
+        m_bloom_filter(0),
+        m_is_dirty(false), m_is_active(false), m_flags(flags) {
     }
 
     /**
@@ -138,6 +139,13 @@ class Backend
     virtual ham_status_t erase(Transaction *txn, ham_key_t *key, 
                     ham_u32_t flags) = 0;
 
+    /**
+     * erase all keys in the range [begin, end) from the index; if
+     * @a begin or @a end is NULL then the range is unbounded
+     */
+    virtual ham_status_t erase_range(Transaction *txn, ham_key_t *begin,
+                    ham_key_t *end, ham_u32_t flags) = 0;
+
     /**
      * iterate the whole tree and enumerate every item
      */
@@ -188,6 +196,19 @@ class Backend
         m_keysize=keysize;
     }
 
+    /**
+     * get the maximum size of the records which are stored next to the
+     * key (see @ref HAM_PARAM_RECORD_INLINE_SIZE)
+     */
+    ham_u16_t get_inline_size() {
+        return m_inline_size;
+    }
+
+    /** set the maximum size of the inline records */
+    void set_inline_size(ham_u16_t size) {
+        m_inline_size=size;
+    }
+
     /** get the flags */
     ham_u32_t get_flags() {
         return m_flags;
@@ -208,6 +229,16 @@ class Backend
         m_recno=recno;
     }
 
+    /** get the address of the persistent bloom filter */
+    ham_offset_t get_bloom_filter() {
+        return m_bloom_filter;
+    }
+
+    /** set the address of the persistent bloom filter */
+    void set_bloom_filter(ham_offset_t address) {
+        m_bloom_filter=address;
+    }
+
     /** get the dirty-flag */
     bool is_dirty() {
         return m_is_dirty;
@@ -235,9 +266,15 @@ class Backend
     /** the keysize of this backend index */
     ham_u16_t m_keysize;
 
+    /** the maximum size of the inline records */
+    ham_u16_t m_inline_size;
+
     /** the last used record number */
     ham_offset_t m_recno;
 
+    /** the address of the persistent bloom filter */
+    ham_offset_t m_bloom_filter;
+
     /** flag if this backend has to be written to disk */
     bool m_is_dirty;
 
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief implementation of the hot backup
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <ham/hamsterdb_int.h>
+
+#include "backup.h"
+#include "device.h"
+#include "env.h"
+#include "error.h"
+#include "os.h"
+
+Backup::Backup(Environment *env)
+  : m_env(env), m_pagesize(env->get_pagesize()), m_running(false),
+    m_fd(HAM_INVALID_FD), m_filesize(0), m_error(0), m_pages_copied(0)
+{
+}
+
+Backup::~Backup()
+{
+    if (m_fd!=HAM_INVALID_FD)
+        (void)os_close(m_fd, 0);
+}
+
+bool
+Backup::is_supported(Environment *env)
+{
+    if (env->get_flags()&(HAM_IN_MEMORY_DB|DB_IS_REMOTE))
+        return (false);
+    return (true);
+}
+
+ham_status_t
+Backup::prepare(const char *path, ham_u32_t flags)
+{
+    ham_status_t st;
+    Device *device=m_env->get_device();
+
+    /* the copy reflects the file after all modified pages were written */
+    st=m_env->_fun_flush(m_env, 0);
+    if (st)
+        return (st);
+    st=device->get_filesize(&m_filesize);
+    if (st)
+        return (st);
+
+    /* an incremental backup needs the copy of the previous backup */
+    bool incremental=(flags&HAM_BACKUP_INCREMENTAL)
+            && !m_path.empty() && m_path==path;
+    m_path.clear();
+
+    if (incremental) {
+        st=os_open(path, 0, &m_fd);
+        if (st==HAM_FILE_NOT_FOUND)
+            incremental=false;
+        else if (st)
+            return (st);
+    }
+    if (!incremental) {
+        st=os_create(path, 0, 0644, &m_fd);
+        if (st)
+            return (st);
+    }
+    st=os_truncate(m_fd, m_filesize);
+    if (st) {
+        (void)os_close(m_fd, 0);
+        m_fd=HAM_INVALID_FD;
+        return (st);
+    }
+
+    ham_size_t pages=(ham_size_t)((m_filesize+m_pagesize-1)/m_pagesize);
+    if (incremental) {
+        m_pending=m_changed;
+        m_pending.resize(pages, false);
+    }
+    else
+        m_pending.assign(pages, true);
+    m_changed.clear();
+
+    m_target=path;
+    m_error=0;
+    m_pages_copied=0;
+    m_running=true;
+    return (0);
+}
+
+ham_status_t
+Backup::run()
+{
+    ham_status_t st;
+    ham_size_t pages=(ham_size_t)m_pending.size();
+    ham_size_t chunk=READ_SIZE/m_pagesize;
+    if (!chunk)
+        chunk=1;
+    std::vector<ham_u8_t> buffer(chunk*m_pagesize);
+    std::vector<bool> copy(chunk);
+
+    for (ham_size_t page=0; page<pages; page+=chunk) {
+        ham_size_t count=chunk;
+        if (page+count>pages)
+            count=pages-page;
+
+        /*
+         * the pages are read while holding the lock; the pages which
+         * were already copied (because they were modified in the
+         * meantime) are skipped
+         */
+        ScopedLock lock(m_env->get_mutex());
+        ham_size_t first=count, last=0;
+        for (ham_size_t i=0; i<count; i++) {
+            copy[i]=m_pending[page+i];
+            if (copy[i]) {
+                if (first==count)
+                    first=i;
+                last=i;
+                m_pending[page+i]=false;
+                m_pages_copied++;
+            }
+        }
+        if (first==count)
+            continue;
+
+        ham_offset_t address=(ham_offset_t)(page+first)*m_pagesize;
+        ham_offset_t size=(ham_offset_t)(last-first+1)*m_pagesize;
+        if (address+size>m_filesize)
+            size=m_filesize-address;
+        st=m_env->get_device()->read_raw(address, &buffer[0], size);
+        if (st)
+            return (st);
+        lock.unlock();
+
+        /* write the runs of copied pages */
+        for (ham_size_t i=first; i<=last; ) {
+            if (!copy[i]) {
+                i++;
+                continue;
+            }
+            ham_size_t end=i;
+            while (end<=last && copy[end])
+                end++;
+            ham_offset_t offset=(ham_offset_t)(i-first)*m_pagesize;
+            ham_offset_t length=(ham_offset_t)(end-i)*m_pagesize;
+            if (offset+length>size)
+                length=size-offset;
+            st=write(address+offset, &buffer[(size_t)offset],
+                    (ham_size_t)length);
+            if (st)
+                return (st);
+            i=end;
+        }
+    }
+
+    return (0);
+}
+
+ham_status_t
+Backup::finish(ham_status_t st)
+{
+    m_running=false;
+    m_pending.clear();
+
+    if (!st)
+        st=m_error;
+    if (!st)
+        st=os_flush(m_fd);
+
+    ham_status_t st2=os_close(m_fd, 0);
+    m_fd=HAM_INVALID_FD;
+    if (!st)
+        st=st2;
+
+    /* the next incremental backup needs a successful backup */
+    if (!st)
+        m_path=m_target;
+    m_target.clear();
+    return (st);
+}
+
+void
+Backup::before_write(ham_offset_t offset, ham_offset_t size)
+{
+    if (!size)
+        return;
+
+    ham_offset_t first=offset/m_pagesize;
+    ham_offset_t last=(offset+size-1)/m_pagesize;
+
+    for (ham_offset_t page=first; page<=last; page++) {
+        if (m_running && page<m_pending.size() && m_pending[(size_t)page]) {
+            ham_status_t st=save(page);
+            if (st && !m_error)
+                m_error=st;
+            m_pending[(size_t)page]=false;
+        }
+        if (page>=m_changed.size())
+            m_changed.resize((size_t)page+1, false);
+        m_changed[(size_t)page]=true;
+    }
+}
+
+void
+Backup::before_truncate(ham_offset_t newsize)
+{
+    ham_offset_t filesize;
+    if (m_env->get_device()->get_filesize(&filesize) || newsize>=filesize)
+        return;
+
+    /* the truncated pages are saved, and they are modified if the file
+     * grows again */
+    before_write(newsize, filesize-newsize);
+}
+
+ham_status_t
+Backup::save(ham_offset_t page)
+{
+    ham_status_t st;
+    ham_offset_t address=page*m_pagesize;
+    ham_size_t size=m_pagesize;
+    if (address+size>m_filesize)
+        size=(ham_size_t)(m_filesize-address);
+
+    std::vector<ham_u8_t> buffer(size);
+    st=m_env->get_device()->read_raw(address, &buffer[0], size);
+    if (st)
+        return (st);
+    st=write(address, &buffer[0], size);
+    if (st)
+        return (st);
+    m_pages_copied++;
+    return (0);
+}
+
+ham_status_t
+Backup::write(ham_offset_t address, const void *buffer, ham_size_t size)
+{
+    ScopedLock lock(m_mutex);
+    return (os_pwrite(m_fd, address, buffer, size));
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief the hot backup
+ *
+ * A backup takes a snapshot of the file size after the Environment was
+ * flushed, then copies the file in large chunks. The Device calls
+ * before_write() and before_truncate() before the file is modified;
+ * if the modified page is part of the snapshot and was not yet copied,
+ * its current contents are written to the copy first. Therefore the copy
+ * always reflects the state of the file when the snapshot was taken.
+ *
+ * As soon as the first backup was started, the Device also records all
+ * modified pages; an incremental backup only copies those pages.
+ *
+ * prepare(), finish() and the callbacks of the Device require the
+ * Environment mutex; run() acquires the mutex for each chunk.
+ */
+
+#ifndef HAM_BACKUP_H__
+#define HAM_BACKUP_H__
+
+#include "internal_fwd_decl.h"
+
+#include <string>
+#include <vector>
+
+#include <ham/hamsterdb.h>
+
+class Backup
+{
+  public:
+    /** the size of a single read */
+    enum {
+        READ_SIZE=1024*1024
+    };
+
+    /** constructor */
+    Backup(Environment *env);
+
+    /** destructor; closes the copy */
+    ~Backup();
+
+    /**
+     * returns true if the Environment can be copied; in-memory
+     * and remote Environments are not supported
+     */
+    static bool is_supported(Environment *env);
+
+    /** returns true if a backup is running */
+    bool is_running() {
+        return (m_running);
+    }
+
+    /** flushes the Environment, takes the snapshot and opens the copy */
+    ham_status_t prepare(const char *path, ham_u32_t flags);
+
+    /** copies the snapshot */
+    ham_status_t run();
+
+    /** closes the copy; @a st is the status of run() */
+    ham_status_t finish(ham_status_t st);
+
+    /** called by the Device before the file is written */
+    void before_write(ham_offset_t offset, ham_offset_t size);
+
+    /** called by the Device before the file is truncated */
+    void before_truncate(ham_offset_t newsize);
+
+    /** returns the number of pages which were copied by the last
+     * backup */
+    ham_u64_t get_pages_copied() {
+        return (m_pages_copied);
+    }
+
+  private:
+    /** writes the current contents of a page to the copy */
+    ham_status_t save(ham_offset_t page);
+
+    /** writes to the copy */
+    ham_status_t write(ham_offset_t address, const void *buffer,
+                ham_size_t size);
+
+    /** the Environment */
+    Environment *m_env;
+
+    /** the pagesize */
+    ham_size_t m_pagesize;
+
+    /** true while a backup is running */
+    bool m_running;
+
+    /** the path of the running backup */
+    std::string m_target;
+
+    /** the path of the last successful backup */
+    std::string m_path;
+
+    /** the file descriptor of the copy */
+    ham_fd_t m_fd;
+
+    /** the size of the file when the snapshot was taken */
+    ham_offset_t m_filesize;
+
+    /** the pages of the snapshot which were not yet copied */
+    std::vector<bool> m_pending;
+
+    /** the pages which were modified since the snapshot was taken */
+    std::vector<bool> m_changed;
+
+    /** the first error of a callback */
+    ham_status_t m_error;
+
+    /** the number of copied pages */
+    ham_u64_t m_pages_copied;
+
+    /** serializes the writes to the copy */
+    Mutex m_mutex;
+};
+
+#endif /* HAM_BACKUP_H__ */
@@ -15,6 +15,7 @@
 #include <string.h>
 
 #include "blob.h"
+#include "checksum.h"
 #include "db.h"
 #include "device.h"
 #include "env.h"
@@ -23,6 +24,7 @@
 #include "log.h"
 #include "mem.h"
 #include "page.h"
+#include "slab.h"
 #include "txn.h"
 #include "btree.h"
 #include "btree_key.h"
@@ -153,7 +155,8 @@ __write_chunks(Environment *env, Page *page, ham_offset_t addr,
 
                 st=env_fetch_page(&page, env, pageid,
                         cacheonly ? DB_ONLY_FROM_CACHE :
-                        at_blob_edge ? 0 : 0/*DB_NEW_PAGE_DOES_THRASH_CACHE*/);
+                        at_blob_edge ? DB_NO_HEADER
+                            : DB_NO_HEADER/*DB_NEW_PAGE_DOES_THRASH_CACHE*/);
                 ham_assert(st ? !page : 1, (0));
                 /* blob pages don't have a page header */
                 if (page)
@@ -226,10 +229,12 @@ __read_chunk(Environment *env, Page *page, Page **fpage,
         if (!page) {
             if (db)
                 st=db_fetch_page(&page, db, pageid,
-                    __blob_from_cache(env, size) ? 0 : DB_ONLY_FROM_CACHE);
+                    __blob_from_cache(env, size)
+                        ? DB_NO_HEADER : DB_ONLY_FROM_CACHE);
             else
                 st=env_fetch_page(&page, env, pageid,
-                    __blob_from_cache(env, size) ? 0 : DB_ONLY_FROM_CACHE);
+                    __blob_from_cache(env, size)
+                        ? DB_NO_HEADER : DB_ONLY_FROM_CACHE);
             ham_assert(st ? !page : 1, (0));
             /* blob pages don't have a page header */
             if (page)
@@ -276,6 +281,24 @@ __read_chunk(Environment *env, Page *page, Page **fpage,
     return (0);
 }
 
+/**
+ * returns the checksum which is stored in the header of a new blob,
+ * or 0 if the blob is not checksummed
+ */
+static ham_u32_t
+__get_blob_checksum(Environment *env, ham_record_t *record, ham_u32_t flags)
+{
+    ham_u32_t crc;
+
+    if (!(env->get_flags()&HAM_ENABLE_CRC32)
+            || (flags&(HAM_PARTIAL|BLOB_NO_CHECKSUM)))
+        return (0);
+
+    /* 0 means "no checksum" */
+    crc=crc32c(0, record->data, record->size);
+    return (crc ? crc : 0xffffffff);
+}
+
 static ham_status_t
 __get_duplicate_table(dupe_table_t **table_ref, Page **page,
                     Environment *env, ham_u64_t table_id)
@@ -336,6 +359,93 @@ __get_duplicate_table(dupe_table_t **table_ref, Page **page,
     return HAM_SUCCESS;
 }
 
+/**
+ * allocates @a alloc_size bytes for a blob, either from the freelist or
+ * at the end of the file; stores the allocated size in @a hdr. If the
+ * space was allocated through the cache then the page is returned in
+ * @a page; @a freshly_created is true if the space was appended to
+ * the file
+ */
+static ham_status_t
+__alloc_space(Environment *env, Database *db, ham_size_t alloc_size,
+        blob_t *hdr, Page **page, ham_offset_t *paddr,
+        ham_bool_t *freshly_created)
+{
+    ham_status_t st;
+    ham_offset_t addr;
+    Device *device=env->get_device();
+
+    *page=0;
+    *freshly_created=HAM_FALSE;
+
+    /*
+     * check if we have space in the freelist
+     */
+    st = freel_alloc_area(&addr, env, db, alloc_size);
+    if (!addr)
+    {
+        if (st)
+            return st;
+
+        /*
+         * if the blob is small AND if logging is disabled: load the page
+         * through the cache
+         */
+        if (__blob_from_cache(env, alloc_size)) {
+            st = db_alloc_page(page, db, Page::TYPE_BLOB,
+                        PAGE_IGNORE_FREELIST);
+            ham_assert(st ? *page == NULL : 1, (0));
+            ham_assert(!st ? *page  != NULL : 1, (0));
+            if (st)
+                return st;
+            /* blob pages don't have a page header */
+            (*page)->set_flags((*page)->get_flags()|Page::NPERS_NO_HEADER);
+            addr=(*page)->get_self();
+            /* move the remaining space to the freelist */
+            (void)freel_mark_free(env, db, addr+alloc_size,
+                    env->get_pagesize()-alloc_size, HAM_FALSE);
+            blob_set_alloc_size(hdr, alloc_size);
+        }
+        else {
+            /*
+             * otherwise use direct IO to allocate the space
+             */
+            ham_size_t aligned=alloc_size;
+            aligned += env->get_pagesize() - 1;
+            aligned -= aligned % env->get_pagesize();
+
+            st=device->alloc(aligned, &addr);
+            if (st)
+                return (st);
+
+            /* if aligned!=size, and the remaining chunk is large enough:
+             * move it to the freelist */
+            {
+                ham_size_t diff=aligned-alloc_size;
+                if (diff > SMALLEST_CHUNK_SIZE) {
+                    (void)freel_mark_free(env, db, addr+alloc_size,
+                            diff, HAM_FALSE);
+                    blob_set_alloc_size(hdr, aligned-diff);
+                }
+                else {
+                    blob_set_alloc_size(hdr, aligned);
+                }
+            }
+            *freshly_created = HAM_TRUE;
+        }
+
+        ham_assert(HAM_SUCCESS == freel_check_area_is_allocated(env, db,
+                    addr, alloc_size), (0));
+    }
+    else {
+        ham_assert(!st, (0));
+        blob_set_alloc_size(hdr, alloc_size);
+    }
+
+    *paddr=addr;
+    return (0);
+}
+
 /**
  * Allocate space in storage for and write the content references by 'data'
  * (and length 'size') to storage.
@@ -358,7 +468,6 @@ blob_allocate(Environment *env, Database *db, ham_record_t *record,
     ham_u8_t *chunk_data[2];
     ham_size_t alloc_size;
     ham_size_t chunk_size[2];
-    Device *device=env->get_device();
     ham_bool_t freshly_created = HAM_FALSE;
    
     *blobid=0;
@@ -376,6 +485,13 @@ blob_allocate(Environment *env, Database *db, ham_record_t *record,
             flags&=~HAM_PARTIAL;
     }
 
+    /*
+     * small records are stored in the slots of a slab page
+     */
+    if (SlabAllocator::is_supported(env, record->size, flags))
+        return (env->get_slab_allocator().alloc(env, db, record->data,
+                    record->size, blobid));
+
     /*
      * in-memory-database: the blobid is actually a pointer to the memory
      * buffer, in which the blob (with the blob-header) is stored
@@ -423,72 +539,14 @@ blob_allocate(Environment *env, Database *db, ham_record_t *record,
     alloc_size += DB_CHUNKSIZE - 1;
     alloc_size -= alloc_size % DB_CHUNKSIZE;
 
-    /*
-     * check if we have space in the freelist
-     */
-    st = freel_alloc_area(&addr, env, db, alloc_size);
-    if (!addr)
-    {
-        if (st)
-            return st;
-
-        /*
-         * if the blob is small AND if logging is disabled: load the page
-         * through the cache
-         */
-        if (__blob_from_cache(env, alloc_size)) {
-            st = db_alloc_page(&page, db, Page::TYPE_BLOB,
-                        PAGE_IGNORE_FREELIST);
-            ham_assert(st ? page == NULL : 1, (0));
-            ham_assert(!st ? page  != NULL : 1, (0));
-            if (st)
-                return st;
-            /* blob pages don't have a page header */
-            page->set_flags(page->get_flags()|Page::NPERS_NO_HEADER);
-            addr=page->get_self();
-            /* move the remaining space to the freelist */
-            (void)freel_mark_free(env, db, addr+alloc_size,
-                    env->get_pagesize()-alloc_size, HAM_FALSE);
-            blob_set_alloc_size(&hdr, alloc_size);
-        }
-        else {
-            /*
-             * otherwise use direct IO to allocate the space
-             */
-            ham_size_t aligned=alloc_size;
-            aligned += env->get_pagesize() - 1;
-            aligned -= aligned % env->get_pagesize();
-
-            st=device->alloc(aligned, &addr);
-            if (st)
-                return (st);
-
-            /* if aligned!=size, and the remaining chunk is large enough:
-             * move it to the freelist */
-            {
-                ham_size_t diff=aligned-alloc_size;
-                if (diff > SMALLEST_CHUNK_SIZE) {
-                    (void)freel_mark_free(env, db, addr+alloc_size,
-                            diff, HAM_FALSE);
-                    blob_set_alloc_size(&hdr, aligned-diff);
-                }
-                else {
-                    blob_set_alloc_size(&hdr, aligned);
-                }
-            }
-            freshly_created = HAM_TRUE;
-        }
-
-        ham_assert(HAM_SUCCESS == freel_check_area_is_allocated(env, db,
-                    addr, alloc_size), (0));
-    }
-    else {
-        ham_assert(!st, (0));
-        blob_set_alloc_size(&hdr, alloc_size);
-    }
+    st=__alloc_space(env, db, alloc_size, &hdr, &page, &addr,
+                &freshly_created);
+    if (st)
+        return (st);
 
     blob_set_size(&hdr, record->size);
     blob_set_self(&hdr, addr);
+    blob_set_checksum(&hdr, __get_blob_checksum(env, record, flags));
 
     /*
      * PARTIAL WRITE
@@ -709,6 +767,45 @@ blob_read(Database *db, Transaction *txn, ham_offset_t blobid,
         return (0);
     }
 
+    /*
+     * the record is stored in the slot of a slab page
+     */
+    if (SlabAllocator::is_slab_rid(blobid)) {
+        const ham_u8_t *data;
+        Environment *env=db->get_env();
+
+        st=env->get_slab_allocator().read(env, db, blobid, &data, &blobsize);
+        if (st)
+            return (st);
+
+        if (flags&HAM_PARTIAL) {
+            if (record->partial_offset>blobsize) {
+                ham_trace(("partial offset is greater than the total "
+                            "record size"));
+                return (HAM_INV_PARAMETER);
+            }
+            data+=record->partial_offset;
+            if (record->partial_offset+record->partial_size>blobsize)
+                blobsize=blobsize-record->partial_offset;
+            else
+                blobsize=record->partial_size;
+        }
+
+        if (!blobsize) {
+            record->data = 0;
+            record->size = 0;
+            return (0);
+        }
+
+        if (!(record->flags&HAM_RECORD_USER_ALLOC)) {
+            arena->resize(blobsize);
+            record->data=arena->get_ptr();
+        }
+        memcpy(record->data, data, blobsize);
+        record->size=blobsize;
+        return (0);
+    }
+
     ham_assert(blobid%DB_CHUNKSIZE==0, ("blobid is %llu", blobid));
 
     /* first step: read the blob header */
@@ -761,6 +858,18 @@ blob_read(Database *db, Transaction *txn, ham_offset_t blobid,
 
     record->size=blobsize;
 
+    /* verify the checksum if the whole blob was read */
+    if (blob_get_checksum(&hdr) && !(flags&HAM_PARTIAL)) {
+        ham_u32_t crc=crc32c(0, record->data, blobsize);
+        if ((crc ? crc : 0xffffffff)!=blob_get_checksum(&hdr)) {
+            ham_log(("checksum mismatch in blob %llu",
+                        (unsigned long long)blobid));
+            if (Metrics *metrics=db->get_env()->get_metrics())
+                metrics->inc_checksum_failures();
+            return (HAM_CHECKSUM_MISMATCH);
+        }
+    }
+
     return (0);
 }
 
@@ -781,6 +890,18 @@ blob_get_datasize(Database *db, ham_offset_t blobid, ham_offset_t *size)
         return (0);
     }
 
+    if (SlabAllocator::is_slab_rid(blobid)) {
+        const ham_u8_t *data;
+        ham_size_t slotsize;
+        Environment *env=db->get_env();
+
+        st=env->get_slab_allocator().read(env, db, blobid, &data, &slotsize);
+        if (st)
+            return (st);
+        *size=slotsize;
+        return (0);
+    }
+
     ham_assert(blobid%DB_CHUNKSIZE==0, ("blobid is %llu", blobid));
 
     /* read the blob header */
@@ -796,6 +917,59 @@ blob_get_datasize(Database *db, ham_offset_t blobid, ham_offset_t *size)
     return (0);
 }
 
+/**
+ * overwrites a record which is stored in the slot of a slab page
+ */
+static ham_status_t
+__slab_overwrite(Environment *env, Database *db, ham_offset_t old_blobid,
+        ham_record_t *record, ham_u32_t flags, ham_offset_t *new_blobid)
+{
+    ham_status_t st;
+    SlabAllocator &slabs=env->get_slab_allocator();
+    ham_record_t full=*record;
+    ham_u8_t *buffer=0;
+
+    /*
+     * PARTIAL WRITE
+     *
+     * merge the old record and the partial data; the gaps are filled
+     * with zeroes
+     */
+    if (flags&HAM_PARTIAL) {
+        const ham_u8_t *data;
+        ham_size_t size;
+
+        st=slabs.read(env, db, old_blobid, &data, &size);
+        if (st)
+            return (st);
+        buffer=(ham_u8_t *)env->get_allocator()->calloc(record->size);
+        if (!buffer)
+            return (HAM_OUT_OF_MEMORY);
+        memcpy(buffer, data, size<record->size ? size : record->size);
+        memcpy(buffer+record->partial_offset, record->data,
+                record->partial_size);
+        full.data=buffer;
+        full.partial_offset=0;
+        full.partial_size=0;
+        flags&=~HAM_PARTIAL;
+    }
+
+    st=HAM_LIMITS_REACHED;
+    if (full.size<=SlabAllocator::MAX_RECORD_SIZE)
+        st=slabs.overwrite(env, db, old_blobid, full.data, full.size);
+    if (!st)
+        *new_blobid=old_blobid;
+    else if (st==HAM_LIMITS_REACHED) {
+        st=blob_allocate(env, db, &full, flags, new_blobid);
+        if (!st)
+            st=slabs.free(env, db, old_blobid);
+    }
+
+    if (buffer)
+        env->get_allocator()->free(buffer);
+    return (st);
+}
+
 ham_status_t
 blob_overwrite(Environment *env, Database *db, ham_offset_t old_blobid,
         ham_record_t *record, ham_u32_t flags, ham_offset_t *new_blobid)
@@ -826,7 +1000,7 @@ blob_overwrite(Environment *env, Database *db, ham_offset_t old_blobid,
      */
     if (env->get_flags()&HAM_IN_MEMORY_DB)
     {
-        blob_t *nhdr, *phdr=(blob_t *)U64_TO_PTR(old_blobid);
+        blob_t *phdr=(blob_t *)U64_TO_PTR(old_blobid);
 
         if (blob_get_size(phdr)==record->size) {
             ham_u8_t *p=(ham_u8_t *)phdr;
@@ -843,15 +1017,20 @@ blob_overwrite(Environment *env, Database *db, ham_offset_t old_blobid,
             st=blob_allocate(env, db, record, flags, new_blobid);
             if (st)
                 return (st);
-            nhdr=(blob_t *)U64_TO_PTR(*new_blobid);
-            blob_set_flags(nhdr, blob_get_flags(phdr));
-
             env->get_allocator()->free(phdr);
         }
 
         return (HAM_SUCCESS);
     }
 
+    /*
+     * the old record is stored in the slot of a slab page: overwrite the
+     * slot if the new record fits, otherwise move the record
+     */
+    if (SlabAllocator::is_slab_rid(old_blobid))
+        return (__slab_overwrite(env, db, old_blobid, record, flags,
+                    new_blobid));
+
     ham_assert(old_blobid%DB_CHUNKSIZE==0, (0));
 
     /*
@@ -896,7 +1075,7 @@ blob_overwrite(Environment *env, Database *db, ham_offset_t old_blobid,
          */
         blob_set_self(&new_hdr, blob_get_self(&old_hdr));
         blob_set_size(&new_hdr, record->size);
-        blob_set_flags(&new_hdr, blob_get_flags(&old_hdr));
+        blob_set_checksum(&new_hdr, __get_blob_checksum(env, record, flags));
         if (blob_get_alloc_size(&old_hdr)-alloc_size>SMALLEST_CHUNK_SIZE)
             blob_set_alloc_size(&new_hdr, alloc_size);
         else
@@ -989,6 +1168,9 @@ blob_free(Environment *env, Database *db, ham_offset_t blobid, ham_u32_t flags)
         return (0);
     }
 
+    if (SlabAllocator::is_slab_rid(blobid))
+        return (env->get_slab_allocator().free(env, db, blobid));
+
     ham_assert(blobid%DB_CHUNKSIZE==0, (0));
 
     /*
@@ -1018,97 +1200,1153 @@ blob_free(Environment *env, Database *db, ham_offset_t blobid, ham_u32_t flags)
     return st;
 }
 
-static ham_size_t
-__get_sorted_position(Database *db, Transaction *txn, dupe_table_t *table, 
-                ham_record_t *record, ham_u32_t flags)
+ham_status_t
+blob_get_allocated_size(Environment *env, ham_offset_t blobid,
+        ham_offset_t *size)
 {
-    ham_duplicate_compare_func_t foo = db->get_duplicate_compare_func();
-    ham_size_t l, r, m;
-    int cmp;
-    dupe_entry_t *e;
-    ham_record_t item_record;
-    ham_u16_t dam;
-    ham_status_t st=0;
+    ham_status_t st;
+    blob_t hdr;
 
-    /*
-     * Use a slightly adapted form of binary search: as we already have our
-     * initial position (as was stored in the cursor), we take that as our
-     * first 'median' value and go from there.
-     */
-    l = 0;
-    r = dupe_table_get_count(table) - 1; /* get_count() is 1 too many! */
+    ham_assert(!(env->get_flags()&HAM_IN_MEMORY_DB), (0));
+    ham_assert(blobid%DB_CHUNKSIZE==0, ("blobid is %llu", blobid));
 
-    /*
-     * Maybe Wrong Idea: sequential access/insert doesn't mean the RECORD
-     * values are sequential too! They MAY be, but don't have to!
-     *
-     * For now, we assume they are also sequential when you're storing records
-     * in duplicate-key tables (probably a secondary index table for another
-     * table, this one).
-     */
-    dam = db->get_data_access_mode();
-    if (dam & HAM_DAM_SEQUENTIAL_INSERT) {
-        /* assume the insertion point sits at the end of the dupe table */
-        m = r;
-    }
-    else {
-        m = (l + r) / 2;
-    }
-    ham_assert(m <= r, (0));
-        
-    while (l <= r) {
-        ham_assert(m<dupe_table_get_count(table), (""));
+    st=__read_chunk(env, 0, 0, blobid, 0, (ham_u8_t *)&hdr, sizeof(hdr));
+    if (st)
+        return (st);
 
-        e = dupe_table_get_entry(table, m);
+    if (blob_get_self(&hdr)!=blobid)
+        return (HAM_BLOB_NOT_FOUND);
 
-        memset(&item_record, 0, sizeof(item_record));
-        item_record._rid=dupe_entry_get_rid(e);
-        item_record._intflags = dupe_entry_get_flags(e)&(KEY_BLOB_SIZE_SMALL
-                                                         |KEY_BLOB_SIZE_TINY
-                                                         |KEY_BLOB_SIZE_EMPTY);
-        st=btree_read_record(db, txn, &item_record, 
-                    (ham_u64_t *)&dupe_entry_get_ridptr(e), flags);
-        if (st)
-            return (st);
+    *size=blob_get_alloc_size(&hdr);
+    return (0);
+}
 
-        cmp = foo((ham_db_t *)db, (ham_u8_t *)record->data, record->size,
+ham_status_t
+blob_move(Environment *env, ham_offset_t old_blobid, ham_offset_t new_blobid)
+{
+    ham_status_t st;
+    blob_t hdr;
+    ham_u8_t *buffer, *chunk_data[1];
+    ham_size_t chunk_size[1];
+    ham_offset_t size, offset=0;
+    ham_size_t bufsize=env->get_pagesize()*16;
+
+    ham_assert(!(env->get_flags()&HAM_IN_MEMORY_DB), (0));
+    ham_assert(new_blobid%DB_CHUNKSIZE==0, ("blobid is %llu", new_blobid));
+
+    st=__read_chunk(env, 0, 0, old_blobid, 0, (ham_u8_t *)&hdr, sizeof(hdr));
+    if (st)
+        return (st);
+    if (blob_get_self(&hdr)!=old_blobid)
+        return (HAM_BLOB_NOT_FOUND);
+
+    size=blob_get_alloc_size(&hdr);
+    if (bufsize>size)
+        bufsize=(ham_size_t)size;
+    buffer=(ham_u8_t *)env->get_allocator()->alloc(bufsize);
+    if (!buffer)
+        return (HAM_OUT_OF_MEMORY);
+
+    /*
+     * copy the blob in pieces; the new space was freshly allocated, and
+     * its previous content does not have to be logged
+     */
+    while (offset<size) {
+        ham_size_t s=bufsize;
+        if (s>size-offset)
+            s=(ham_size_t)(size-offset);
+
+        st=__read_chunk(env, 0, 0, old_blobid+offset, 0, buffer, s);
+        if (st)
+            break;
+        if (offset==0)
+            blob_set_self((blob_t *)buffer, new_blobid);
+
+        chunk_data[0]=buffer;
+        chunk_size[0]=s;
+        st=__write_chunks(env, 0, new_blobid+offset, HAM_TRUE, HAM_TRUE,
+                chunk_data, chunk_size, 1);
+        if (st)
+            break;
+        offset+=s;
+    }
+
+    env->get_allocator()->free(buffer);
+    return (st);
+}
+
+/** reads the header of a blob and checks the blob ID */
+static ham_status_t
+__read_header(Environment *env, Database *db, ham_offset_t blobid,
+        blob_t *hdr)
+{
+    ham_status_t st;
+
+    if (env->get_flags()&HAM_IN_MEMORY_DB) {
+        memcpy(hdr, (ham_u8_t *)U64_TO_PTR(blobid), sizeof(*hdr));
+        return (0);
+    }
+
+    ham_assert(blobid%DB_CHUNKSIZE==0, ("blobid is %llu", blobid));
+
+    st=__read_chunk(env, 0, 0, blobid, db, (ham_u8_t *)hdr, sizeof(*hdr));
+    if (st)
+        return (st);
+    if (blob_get_self(hdr)!=blobid)
+        return (HAM_BLOB_NOT_FOUND);
+    return (0);
+}
+
+ham_status_t
+blob_get_capacity(Environment *env, Database *db, ham_offset_t blobid,
+        ham_offset_t *size, ham_offset_t *capacity)
+{
+    ham_status_t st;
+    blob_t hdr;
+
+    ham_assert(!SlabAllocator::is_slab_rid(blobid), (0));
+
+    st=__read_header(env, db, blobid, &hdr);
+    if (st)
+        return (st);
+
+    *size=blob_get_size(&hdr);
+    *capacity=blob_get_alloc_size(&hdr)-sizeof(blob_t);
+    return (0);
+}
+
+ham_status_t
+blob_set_datasize(Environment *env, Database *db, ham_offset_t blobid,
+        ham_offset_t size)
+{
+    ham_status_t st;
+    blob_t hdr;
+    ham_u8_t *chunk_data[1];
+    ham_size_t chunk_size[1];
+
+    if (env->get_flags()&HAM_IN_MEMORY_DB) {
+        blob_t *phdr=(blob_t *)U64_TO_PTR(blobid);
+        blob_set_size(phdr, size);
+        blob_set_checksum(phdr, 0);
+        return (0);
+    }
+
+    st=__read_header(env, db, blobid, &hdr);
+    if (st)
+        return (st);
+
+    ham_assert(size+sizeof(blob_t)<=blob_get_alloc_size(&hdr), (0));
+    blob_set_size(&hdr, size);
+    blob_set_checksum(&hdr, 0);
+
+    chunk_data[0]=(ham_u8_t *)&hdr;
+    chunk_size[0]=sizeof(hdr);
+    return (__write_chunks(env, 0, blobid, HAM_FALSE, HAM_FALSE,
+                chunk_data, chunk_size, 1));
+}
+
+ham_status_t
+blob_read_range(Environment *env, Database *db, ham_offset_t blobid,
+        ham_offset_t offset, void *data, ham_size_t size)
+{
+    ham_status_t st;
+    Device *device=env->get_device();
+    ham_size_t pagesize=env->get_pagesize();
+    ham_offset_t addr=blobid+sizeof(blob_t)+offset;
+    ham_u8_t *p=(ham_u8_t *)data;
+    ham_offset_t run_addr=0;
+    ham_u8_t *run_data=0;
+    ham_size_t run_size=0;
+
+    if (env->get_flags()&HAM_IN_MEMORY_DB) {
+        memcpy(data, (ham_u8_t *)U64_TO_PTR(blobid)+sizeof(blob_t)+offset,
+                size);
+        return (0);
+    }
+
+    if (__blob_from_cache(env, size))
+        return (__read_chunk(env, 0, 0, addr, db, p, size));
+
+    /*
+     * large ranges: copy the cached pages, and read all neighbouring
+     * pages which are not cached with a single read
+     */
+    while (size) {
+        Page *page;
+        ham_offset_t pageid=addr-(addr%pagesize);
+        ham_size_t s=(ham_size_t)(pageid+pagesize-addr);
+        if (s>size)
+            s=size;
+
+        st=db_fetch_page_impl(&page, env, db, pageid, DB_ONLY_FROM_CACHE);
+        if (st)
+            return (st);
+
+        if (page) {
+            if (run_size) {
+                st=device->read(run_addr, run_data, run_size);
+                if (st)
+                    return (st);
+                run_size=0;
+            }
+            memcpy(p, page->get_raw_payload()+(addr-pageid), s);
+        }
+        else {
+            if (!run_size) {
+                run_addr=addr;
+                run_data=p;
+            }
+            run_size+=s;
+        }
+
+        addr+=s;
+        p+=s;
+        size-=s;
+    }
+
+    if (run_size)
+        return (device->read(run_addr, run_data, run_size));
+    return (0);
+}
+
+ham_status_t
+blob_write_range(Environment *env, Database *db, ham_offset_t blobid,
+        ham_offset_t offset, const void *data, ham_size_t size)
+{
+    ham_u8_t *chunk_data[1];
+    ham_size_t chunk_size[1];
+
+    (void)db;
+
+    if (env->get_flags()&HAM_IN_MEMORY_DB) {
+        memcpy((ham_u8_t *)U64_TO_PTR(blobid)+sizeof(blob_t)+offset,
+                data, size);
+        return (0);
+    }
+
+    chunk_data[0]=(ham_u8_t *)data;
+    chunk_size[0]=size;
+    return (__write_chunks(env, 0, blobid+sizeof(blob_t)+offset,
+                HAM_FALSE, HAM_FALSE, chunk_data, chunk_size, 1));
+}
+
+ham_status_t
+blob_reserve(Environment *env, Database *db, ham_offset_t old_blobid,
+        ham_size_t capacity, ham_offset_t *new_blobid)
+{
+    ham_status_t st;
+    blob_t old_hdr, hdr;
+    Page *page;
+    ham_offset_t addr, size=0, offset=0;
+    ham_size_t alloc_size;
+    ham_bool_t freshly_created;
+    ham_u8_t *buffer, *chunk_data[1];
+    ham_size_t chunk_size[1];
+    ham_size_t bufsize=env->get_pagesize()*16;
+
+    *new_blobid=0;
+
+    if (old_blobid) {
+        st=__read_header(env, db, old_blobid, &old_hdr);
+        if (st)
+            return (st);
+        size=blob_get_size(&old_hdr);
+        ham_assert(size<=capacity, (0));
+    }
+
+    /*
+     * in-memory-database: allocate a new buffer and copy the data
+     */
+    if (env->get_flags()&HAM_IN_MEMORY_DB) {
+        ham_u8_t *p=(ham_u8_t *)env->get_allocator()->alloc(
+                                    capacity+sizeof(blob_t));
+        if (!p)
+            return (HAM_OUT_OF_MEMORY);
+
+        memset(&hdr, 0, sizeof(hdr));
+        blob_set_self(&hdr, (ham_offset_t)PTR_TO_U64(p));
+        blob_set_alloc_size(&hdr, capacity+sizeof(blob_t));
+        blob_set_size(&hdr, size);
+        memcpy(p, &hdr, sizeof(hdr));
+        if (size)
+            memcpy(p+sizeof(blob_t),
+                    (ham_u8_t *)U64_TO_PTR(old_blobid)+sizeof(blob_t),
+                    (ham_size_t)size);
+        if (old_blobid)
+            env->get_allocator()->free((void *)U64_TO_PTR(old_blobid));
+
+        *new_blobid=(ham_offset_t)PTR_TO_U64(p);
+        return (0);
+    }
+
+    /*
+     * blobs are CHUNKSIZE-allocated
+     */
+    alloc_size=sizeof(blob_t)+capacity;
+    alloc_size += DB_CHUNKSIZE - 1;
+    alloc_size -= alloc_size % DB_CHUNKSIZE;
+
+    memset(&hdr, 0, sizeof(hdr));
+    st=__alloc_space(env, db, alloc_size, &hdr, &page, &addr,
+                &freshly_created);
+    if (st)
+        return (st);
+
+    blob_set_self(&hdr, addr);
+    blob_set_size(&hdr, size);
+
+    chunk_data[0]=(ham_u8_t *)&hdr;
+    chunk_size[0]=sizeof(hdr);
+    st=__write_chunks(env, page, addr, HAM_TRUE, freshly_created,
+                    chunk_data, chunk_size, 1);
+    if (st)
+        return (st);
+
+    /*
+     * copy the data in pieces, then move the old blob to the freelist
+     */
+    if (size) {
+        if (bufsize>size)
+            bufsize=(ham_size_t)size;
+        buffer=(ham_u8_t *)env->get_allocator()->alloc(bufsize);
+        if (!buffer)
+            return (HAM_OUT_OF_MEMORY);
+
+        while (offset<size) {
+            ham_size_t s=bufsize;
+            if (s>size-offset)
+                s=(ham_size_t)(size-offset);
+
+            st=blob_read_range(env, db, old_blobid, offset, buffer, s);
+            if (st)
+                break;
+
+            chunk_data[0]=buffer;
+            chunk_size[0]=s;
+            st=__write_chunks(env, 0, addr+sizeof(blob_t)+offset, HAM_TRUE,
+                    freshly_created, chunk_data, chunk_size, 1);
+            if (st)
+                break;
+            offset+=s;
+        }
+
+        env->get_allocator()->free(buffer);
+        if (st)
+            return (st);
+    }
+
+    if (old_blobid) {
+        st=freel_mark_free(env, db, old_blobid,
+                (ham_size_t)blob_get_alloc_size(&old_hdr), HAM_FALSE);
+        if (st)
+            return (st);
+    }
+
+    *new_blobid=addr;
+    return (0);
+}
+
+static ham_size_t
+__get_sorted_position(Database *db, Transaction *txn, dupe_table_t *table, 
+                ham_record_t *record, ham_u32_t flags)
+{
+    ham_duplicate_compare_func_t foo = db->get_duplicate_compare_func();
+    ham_size_t l, r, m;
+    int cmp;
+    dupe_entry_t *e;
+    ham_record_t item_record;
+    ham_u16_t dam;
+    ham_status_t st=0;
+
+    /*
+     * Use a slightly adapted form of binary search: as we already have our
+     * initial position (as was stored in the cursor), we take that as our
+     * first 'median' value and go from there.
+     */
+    l = 0;
+    r = dupe_table_get_count(table) - 1; /* get_count() is 1 too many! */
+
+    /*
+     * Maybe Wrong Idea: sequential access/insert doesn't mean the RECORD
+     * values are sequential too! They MAY be, but don't have to!
+     *
+     * For now, we assume they are also sequential when you're storing records
+     * in duplicate-key tables (probably a secondary index table for another
+     * table, this one).
+     */
+    dam = db->get_data_access_mode();
+    if (dam & HAM_DAM_SEQUENTIAL_INSERT) {
+        /* assume the insertion point sits at the end of the dupe table */
+        m = r;
+    }
+    else {
+        m = (l + r) / 2;
+    }
+    ham_assert(m <= r, (0));
+        
+    while (l <= r) {
+        ham_assert(m<dupe_table_get_count(table), (""));
+
+        e = dupe_table_get_entry(table, m);
+
+        memset(&item_record, 0, sizeof(item_record));
+        item_record._rid=dupe_entry_get_rid(e);
+        item_record._intflags = dupe_entry_get_flags(e)&(KEY_BLOB_SIZE_SMALL
+                                                         |KEY_BLOB_SIZE_TINY
+                                                         |KEY_BLOB_SIZE_EMPTY);
+        st=btree_read_record(db, txn, &item_record, 
+                    (ham_u64_t *)&dupe_entry_get_ridptr(e), flags);
+        if (st)
+            return (st);
+
+        cmp = foo((ham_db_t *)db, (ham_u8_t *)record->data, record->size,
                         (ham_u8_t *)item_record.data, item_record.size);
         /* item is lower than the left-most item of our range */
         if (m == l) {
             if (cmp < 0)
                 break;
         }
-        if (l == r) {
-            if (cmp >= 0) {
-                /* write GEQ record value in NEXT slot */
-                m++;
-            }
-            else /* if (cmp < 0) */ {
-                ham_assert(m == r, (0));
-            }
-            break;
+        if (l == r) {
+            if (cmp >= 0) {
+                /* write GEQ record value in NEXT slot */
+                m++;
+            }
+            else /* if (cmp < 0) */ {
+                ham_assert(m == r, (0));
+            }
+            break;
+        }
+        else if (cmp == 0) {
+            /* write equal record value in NEXT slot */
+            m++;
+            break;
+        }
+        else if (cmp < 0) {
+            if (m == 0) /* new item will be smallest item in the list */
+                break;
+            r = m - 1;
+        }
+        else {
+            /* write GE record value in NEXT slot, when we have nothing
+             * left to search */
+            m++;
+            l = m;
+        }
+        m = (l + r) / 2;
+    }
+
+    /* now 'm' points at the insertion point in the table */
+    return (m);
+}
+
+/**
+ * reads @a size bytes at @a offset of the duplicate tree node @a node_id
+ * (@a offset is relative to the dupe_node_t header)
+ */
+static ham_status_t
+__dupe_node_read(Environment *env, ham_offset_t node_id, ham_size_t offset,
+                void *data, ham_size_t size)
+{
+    if (env->get_flags()&HAM_IN_MEMORY_DB) {
+        ham_u8_t *p=(ham_u8_t *)U64_TO_PTR(node_id);
+        memcpy(data, p+sizeof(blob_t)+offset, size);
+        return (0);
+    }
+
+    return (__read_chunk(env, 0, 0, node_id+sizeof(blob_t)+offset, 0,
+                (ham_u8_t *)data, size));
+}
+
+/**
+ * writes @a size bytes at @a offset of the duplicate tree node @a node_id;
+ * the modification goes through the cache
+ */
+static ham_status_t
+__dupe_node_write(Environment *env, ham_offset_t node_id, ham_size_t offset,
+                void *data, ham_size_t size)
+{
+    ham_u8_t *chunk_data[1];
+    ham_size_t chunk_size[1];
+
+    if (env->get_flags()&HAM_IN_MEMORY_DB) {
+        ham_u8_t *p=(ham_u8_t *)U64_TO_PTR(node_id);
+        memcpy(p+sizeof(blob_t)+offset, data, size);
+        return (0);
+    }
+
+    chunk_data[0]=(ham_u8_t *)data;
+    chunk_size[0]=size;
+    return (__write_chunks(env, 0, node_id+sizeof(blob_t)+offset,
+                HAM_TRUE, HAM_FALSE, chunk_data, chunk_size, 1));
+}
+
+/**
+ * writes the header of a node and its entries (or children), starting
+ * with the entry at @a start
+ */
+static ham_status_t
+__dupe_node_flush(Environment *env, ham_offset_t node_id, dupe_node_t *node,
+                ham_size_t start)
+{
+    ham_status_t st;
+    ham_size_t used=dupe_node_get_used(node);
+
+    if (start==0)
+        return (__dupe_node_write(env, node_id, 0, node,
+                    DUPE_NODE_HEADER_SIZE+used*sizeof(dupe_entry_t)));
+
+    st=__dupe_node_write(env, node_id, 0, node, DUPE_NODE_HEADER_SIZE);
+    if (st || start>=used)
+        return (st);
+    return (__dupe_node_write(env, node_id,
+                DUPE_NODE_HEADER_SIZE+start*sizeof(dupe_entry_t),
+                dupe_node_get_entry(node, start),
+                (used-start)*sizeof(dupe_entry_t)));
+}
+
+/** allocates a blob for a new node and writes the node */
+static ham_status_t
+__dupe_node_alloc(Database *db, dupe_node_t *node, ham_offset_t *node_id)
+{
+    ham_record_t rec={0};
+    rec.data=node;
+    rec.size=sizeof(*node);
+    return (blob_allocate(db->get_env(), db, &rec, BLOB_NO_CHECKSUM,
+                node_id));
+}
+
+/**
+ * adds @a delta to the number of duplicates of a node and of its
+ * child at @a slot
+ */
+static ham_status_t
+__dupe_node_add_count(Environment *env, ham_offset_t node_id,
+                ham_size_t slot, int delta)
+{
+    ham_status_t st;
+    dupe_node_t hdr;
+    dupe_child_t child;
+    ham_size_t offset=DUPE_NODE_HEADER_SIZE+slot*sizeof(child);
+
+    st=__dupe_node_read(env, node_id, 0, &hdr, DUPE_NODE_HEADER_SIZE);
+    if (!st)
+        st=__dupe_node_read(env, node_id, offset, &child, sizeof(child));
+    if (st)
+        return (st);
+
+    dupe_node_set_count(&hdr, dupe_node_get_count(&hdr)+delta);
+    dupe_child_set_count(&child, dupe_child_get_count(&child)+delta);
+
+    st=__dupe_node_write(env, node_id, 0, &hdr, DUPE_NODE_HEADER_SIZE);
+    if (!st)
+        st=__dupe_node_write(env, node_id, offset, &child, sizeof(child));
+    return (st);
+}
+
+/** returns the number of duplicates in the subtree of a node */
+static ham_size_t
+__dupe_node_sum(dupe_node_t *node)
+{
+    ham_size_t i, sum=0;
+
+    if (dupe_node_get_level(node)==0)
+        return (dupe_node_get_used(node));
+    for (i=0; i<dupe_node_get_used(node); i++)
+        sum+=dupe_child_get_count(dupe_node_get_child(node, i));
+    return (sum);
+}
+
+/**
+ * inserts a 16 byte item (a dupe_entry_t or a dupe_child_t) at @a slot
+ * of a node which is not full
+ */
+static void
+__dupe_node_insert_slot(dupe_node_t *node, ham_size_t slot, void *item)
+{
+    ham_size_t used=dupe_node_get_used(node);
+
+    ham_assert(used<DUPE_NODE_CAPACITY, (""));
+    memmove(dupe_node_get_entry(node, slot+1),
+            dupe_node_get_entry(node, slot),
+            (used-slot)*sizeof(dupe_entry_t));
+    memcpy(dupe_node_get_entry(node, slot), item, sizeof(dupe_entry_t));
+    dupe_node_set_used(node, used+1);
+}
+
+/**
+ * inserts a 16 byte item (a dupe_entry_t or a dupe_child_t) at @a slot;
+ * if the node is full then the upper half is moved to @a sibling, and
+ * true is returned
+ */
+static bool
+__dupe_node_insert_item(dupe_node_t *node, dupe_node_t *sibling,
+                ham_size_t slot, void *item)
+{
+    ham_size_t used=dupe_node_get_used(node);
+    ham_size_t left=(DUPE_NODE_CAPACITY+1)/2;
+
+    if (used<DUPE_NODE_CAPACITY) {
+        __dupe_node_insert_slot(node, slot, item);
+        return (false);
+    }
+
+    memset(sibling, 0, sizeof(*sibling));
+    dupe_node_set_level(sibling, dupe_node_get_level(node));
+
+    if (slot<left) {
+        /* the item is inserted in the left half */
+        memcpy(dupe_node_get_entry(sibling, 0),
+                dupe_node_get_entry(node, left-1),
+                (used-left+1)*sizeof(dupe_entry_t));
+        dupe_node_set_used(sibling, used-left+1);
+        dupe_node_set_used(node, left-1);
+        __dupe_node_insert_slot(node, slot, item);
+    }
+    else {
+        memcpy(dupe_node_get_entry(sibling, 0),
+                dupe_node_get_entry(node, left),
+                (used-left)*sizeof(dupe_entry_t));
+        dupe_node_set_used(sibling, used-left);
+        dupe_node_set_used(node, left);
+        __dupe_node_insert_slot(sibling, slot-left, item);
+    }
+
+    dupe_node_set_count(node, __dupe_node_sum(node));
+    dupe_node_set_count(sibling, __dupe_node_sum(sibling));
+    return (true);
+}
+
+/** a step of the path from the root of a duplicate tree to a leaf */
+typedef struct
+{
+    /** the blob id of the node */
+    ham_offset_t id;
+
+    /** the entry (or child) in this node */
+    ham_size_t slot;
+
+} dupe_tree_path_t;
+
+/**
+ * descends from the root to the leaf which stores the duplicate at
+ * @a position; fills @a path and returns the height of the tree in
+ * @a height. If @a position is the number of duplicates then the path
+ * leads to the end of the last leaf
+ */
+static ham_status_t
+__dupe_tree_descend(Environment *env, ham_offset_t root, ham_size_t position,
+                dupe_tree_path_t *path, ham_size_t *height)
+{
+    ham_status_t st;
+    dupe_node_t node;
+    ham_offset_t id=root;
+    ham_size_t h, i, used;
+
+    for (h=0; h<DUPE_TREE_MAX_HEIGHT; h++) {
+        st=__dupe_node_read(env, id, 0, &node, DUPE_NODE_HEADER_SIZE);
+        if (st)
+            return (st);
+        used=dupe_node_get_used(&node);
+        path[h].id=id;
+
+        if (dupe_node_get_level(&node)==0) {
+            if (position>used)
+                break;
+            path[h].slot=position;
+            *height=h+1;
+            return (0);
+        }
+
+        if (used==0 || used>DUPE_NODE_CAPACITY)
+            break;
+        st=__dupe_node_read(env, id, DUPE_NODE_HEADER_SIZE,
+                    dupe_node_get_child(&node, 0), used*sizeof(dupe_child_t));
+        if (st)
+            return (st);
+        for (i=0; i<used; i++) {
+            dupe_child_t *c=dupe_node_get_child(&node, i);
+            if (position<dupe_child_get_count(c) || i+1==used)
+                break;
+            position-=dupe_child_get_count(c);
+        }
+        path[h].slot=i;
+        id=dupe_child_get_id(dupe_node_get_child(&node, i));
+    }
+
+    ham_log(("corrupt duplicate tree at 0x%llx", (unsigned long long)root));
+    return (HAM_INTEGRITY_VIOLATED);
+}
+
+/** reads the duplicate at @a position */
+static ham_status_t
+__dupe_tree_get(Environment *env, ham_offset_t root, ham_size_t position,
+                dupe_entry_t *entry)
+{
+    ham_status_t st;
+    dupe_tree_path_t path[DUPE_TREE_MAX_HEIGHT];
+    ham_size_t height;
+
+    st=__dupe_tree_descend(env, root, position, path, &height);
+    if (st)
+        return (st);
+    return (__dupe_node_read(env, path[height-1].id,
+                DUPE_NODE_HEADER_SIZE+path[height-1].slot*sizeof(*entry),
+                entry, sizeof(*entry)));
+}
+
+/**
+ * inserts a duplicate at @a position; full nodes are split, and the
+ * counters of all other nodes on the path are incremented. Returns the
+ * (new) root in @a new_root
+ */
+static ham_status_t
+__dupe_tree_insert(Database *db, ham_offset_t root, ham_size_t position,
+                dupe_entry_t *entry, ham_offset_t *new_root)
+{
+    ham_status_t st;
+    Environment *env=db->get_env();
+    dupe_tree_path_t path[DUPE_TREE_MAX_HEIGHT];
+    ham_size_t height, h;
+    dupe_node_t *node, *sibling;
+    dupe_child_t item;
+    ham_offset_t id;
+    ham_size_t left_count=0;
+    bool split=false;
+
+    *new_root=root;
+
+    st=__dupe_tree_descend(env, root, position, path, &height);
+    if (st)
+        return (st);
+
+    node=(dupe_node_t *)env->get_allocator()->alloc(2*sizeof(dupe_node_t));
+    if (!node)
+        return (HAM_OUT_OF_MEMORY);
+    sibling=node+1;
+
+    for (h=height; h>0; h--) {
+        dupe_tree_path_t *p=&path[h-1];
+
+        /* the parents of an unsplit node only update their counters */
+        if (h<height && !split) {
+            st=__dupe_node_add_count(env, p->id, p->slot, 1);
+            if (st)
+                goto bail;
+            continue;
+        }
+
+        st=__dupe_node_read(env, p->id, 0, node, sizeof(*node));
+        if (st)
+            goto bail;
+
+        if (h==height) {
+            split=__dupe_node_insert_item(node, sibling, p->slot, entry);
+        }
+        else {
+            /* the child at the slot was split; insert the new sibling */
+            dupe_child_set_count(dupe_node_get_child(node, p->slot),
+                        left_count);
+            split=__dupe_node_insert_item(node, sibling, p->slot+1, &item);
+        }
+
+        if (!split) {
+            dupe_node_set_count(node, dupe_node_get_count(node)+1);
+            st=__dupe_node_flush(env, p->id, node, p->slot);
+            if (st)
+                goto bail;
+            continue;
+        }
+
+        /* write both halves; the sibling is inserted in the parent */
+        st=__dupe_node_flush(env, p->id, node, 0);
+        if (st)
+            goto bail;
+        st=__dupe_node_alloc(db, sibling, &id);
+        if (st)
+            goto bail;
+        memset(&item, 0, sizeof(item));
+        dupe_child_set_id(&item, id);
+        dupe_child_set_count(&item, dupe_node_get_count(sibling));
+        left_count=dupe_node_get_count(node);
+    }
+
+    /* the root was split: the tree grows by one level */
+    if (split) {
+        ham_u16_t level=dupe_node_get_level(node);
+        memset(node, 0, sizeof(*node));
+        dupe_node_set_level(node, level+1);
+        dupe_node_set_used(node, 2);
+        dupe_child_set_id(dupe_node_get_child(node, 0), root);
+        dupe_child_set_count(dupe_node_get_child(node, 0), left_count);
+        memcpy(dupe_node_get_child(node, 1), &item, sizeof(item));
+        dupe_node_set_count(node, __dupe_node_sum(node));
+        st=__dupe_node_alloc(db, node, new_root);
+    }
+
+bail:
+    env->get_allocator()->free(node);
+    return (st);
+}
+
+/** frees a record which is referenced by a duplicate entry */
+static ham_status_t
+__dupe_entry_free(Database *db, dupe_entry_t *e)
+{
+    if (dupe_entry_get_flags(e)&(KEY_BLOB_SIZE_SMALL
+                                |KEY_BLOB_SIZE_TINY
+                                |KEY_BLOB_SIZE_EMPTY))
+        return (0);
+    return (blob_free(db->get_env(), db, dupe_entry_get_rid(e), 0));
+}
+
+/**
+ * erases the duplicate at @a position; empty nodes are removed, and a
+ * root with a single child is replaced by the child. Returns the (new)
+ * root in @a new_root, or 0 if the tree is empty
+ */
+static ham_status_t
+__dupe_tree_erase(Database *db, ham_offset_t root, ham_size_t position,
+                ham_offset_t *new_root)
+{
+    ham_status_t st;
+    Environment *env=db->get_env();
+    dupe_tree_path_t path[DUPE_TREE_MAX_HEIGHT];
+    ham_size_t height, h, used;
+    dupe_node_t *node;
+    bool removed=false;
+
+    *new_root=root;
+
+    st=__dupe_tree_descend(env, root, position, path, &height);
+    if (st)
+        return (st);
+
+    node=(dupe_node_t *)env->get_allocator()->alloc(sizeof(dupe_node_t));
+    if (!node)
+        return (HAM_OUT_OF_MEMORY);
+
+    for (h=height; h>0; h--) {
+        dupe_tree_path_t *p=&path[h-1];
+
+        if (h<height && !removed) {
+            st=__dupe_node_add_count(env, p->id, p->slot, -1);
+            if (st)
+                goto bail;
+            continue;
+        }
+
+        st=__dupe_node_read(env, p->id, 0, node, sizeof(*node));
+        if (st)
+            goto bail;
+        used=dupe_node_get_used(node);
+        if (p->slot>=used) {
+            st=HAM_KEY_NOT_FOUND;
+            goto bail;
         }
-        else if (cmp == 0) {
-            /* write equal record value in NEXT slot */
-            m++;
-            break;
+
+        if (h==height) {
+            st=__dupe_entry_free(db, dupe_node_get_entry(node, p->slot));
+            if (st)
+                goto bail;
         }
-        else if (cmp < 0) {
-            if (m == 0) /* new item will be smallest item in the list */
-                break;
-            r = m - 1;
+
+        memmove(dupe_node_get_entry(node, p->slot),
+                dupe_node_get_entry(node, p->slot+1),
+                (used-p->slot-1)*sizeof(dupe_entry_t));
+        dupe_node_set_used(node, used-1);
+        dupe_node_set_count(node, __dupe_node_sum(node));
+
+        /* an empty node is removed from its parent; an empty root
+         * means that the tree is empty */
+        if (used==1) {
+            st=blob_free(env, db, p->id, 0);
+            if (st)
+                goto bail;
+            removed=true;
+            if (h==1)
+                *new_root=0;
+            continue;
         }
+
+        removed=false;
+        st=__dupe_node_flush(env, p->id, node, p->slot);
+        if (st)
+            goto bail;
+    }
+
+    /* a root with a single child is replaced by the child */
+    while (*new_root) {
+        st=__dupe_node_read(env, *new_root, 0, node, DUPE_NODE_HEADER_SIZE
+                    +sizeof(dupe_child_t));
+        if (st)
+            goto bail;
+        if (dupe_node_get_level(node)==0 || dupe_node_get_used(node)!=1)
+            break;
+        st=blob_free(env, db, *new_root, 0);
+        if (st)
+            goto bail;
+        *new_root=dupe_child_get_id(dupe_node_get_child(node, 0));
+    }
+
+bail:
+    env->get_allocator()->free(node);
+    return (st);
+}
+
+/** frees a subtree of a duplicate tree and all its records */
+static ham_status_t
+__dupe_tree_free(Database *db, ham_offset_t node_id)
+{
+    ham_status_t st;
+    Environment *env=db->get_env();
+    dupe_node_t *node;
+    ham_size_t i;
+
+    node=(dupe_node_t *)env->get_allocator()->alloc(sizeof(dupe_node_t));
+    if (!node)
+        return (HAM_OUT_OF_MEMORY);
+
+    st=__dupe_node_read(env, node_id, 0, node, sizeof(*node));
+    for (i=0; !st && i<dupe_node_get_used(node); i++) {
+        if (dupe_node_get_level(node)==0)
+            st=__dupe_entry_free(db, dupe_node_get_entry(node, i));
+        else
+            st=__dupe_tree_free(db,
+                    dupe_child_get_id(dupe_node_get_child(node, i)));
+    }
+
+    env->get_allocator()->free(node);
+    if (st)
+        return (st);
+    return (blob_free(env, db, node_id, 0));
+}
+
+/** appends all duplicates of a subtree to @a table */
+static ham_status_t
+__dupe_tree_copy(Environment *env, ham_offset_t node_id, dupe_table_t *table)
+{
+    ham_status_t st;
+    dupe_node_t *node;
+    ham_size_t i, count=dupe_table_get_count(table);
+
+    node=(dupe_node_t *)env->get_allocator()->alloc(sizeof(dupe_node_t));
+    if (!node)
+        return (HAM_OUT_OF_MEMORY);
+
+    st=__dupe_node_read(env, node_id, 0, node, sizeof(*node));
+    if (!st && dupe_node_get_level(node)==0) {
+        if (count+dupe_node_get_used(node)>dupe_table_get_capacity(table))
+            st=HAM_INTEGRITY_VIOLATED;
         else {
-            /* write GE record value in NEXT slot, when we have nothing
-             * left to search */
-            m++;
-            l = m;
+            memcpy(dupe_table_get_entry(table, count),
+                    dupe_node_get_entry(node, 0),
+                    dupe_node_get_used(node)*sizeof(dupe_entry_t));
+            dupe_table_set_count(table, count+dupe_node_get_used(node));
         }
-        m = (l + r) / 2;
+    }
+    else {
+        for (i=0; !st && i<dupe_node_get_used(node); i++)
+            st=__dupe_tree_copy(env,
+                    dupe_child_get_id(dupe_node_get_child(node, i)), table);
     }
 
-    /* now 'm' points at the insertion point in the table */
-    return (m);
+    env->get_allocator()->free(node);
+    return (st);
+}
+
+/**
+ * converts a duplicate table to a duplicate tree; the nodes are filled
+ * up to 3/4, and the root is returned in @a root
+ */
+static ham_status_t
+__dupe_tree_create(Database *db, dupe_table_t *table, ham_offset_t *root)
+{
+    ham_status_t st=0;
+    Environment *env=db->get_env();
+    const ham_size_t fill=DUPE_NODE_CAPACITY*3/4;
+    ham_size_t count=dupe_table_get_count(table);
+    ham_size_t n=(count+fill-1)/fill;
+    ham_size_t i, j, next;
+    ham_u16_t level=0;
+    ham_offset_t id;
+    dupe_child_t *children;
+    dupe_node_t *node;
+
+    node=(dupe_node_t *)env->get_allocator()->alloc(sizeof(dupe_node_t)
+                +n*sizeof(dupe_child_t));
+    if (!node)
+        return (HAM_OUT_OF_MEMORY);
+    children=(dupe_child_t *)(node+1);
+
+    /* the leaves */
+    for (i=0, j=0; i<count; i+=fill, j++) {
+        ham_size_t used=count-i<fill ? count-i : fill;
+        memset(node, 0, sizeof(*node));
+        dupe_node_set_used(node, used);
+        dupe_node_set_count(node, used);
+        memcpy(dupe_node_get_entry(node, 0), dupe_table_get_entry(table, i),
+                used*sizeof(dupe_entry_t));
+        st=__dupe_node_alloc(db, node, &id);
+        if (st)
+            goto bail;
+        memset(&children[j], 0, sizeof(children[j]));
+        dupe_child_set_id(&children[j], id);
+        dupe_child_set_count(&children[j], used);
+    }
+
+    /* the internal levels; the children of the next level replace
+     * the current children */
+    while (n>1) {
+        level++;
+        for (i=0, next=0; i<n; i+=fill, next++) {
+            ham_size_t used=n-i<fill ? n-i : fill;
+            memset(node, 0, sizeof(*node));
+            dupe_node_set_level(node, level);
+            dupe_node_set_used(node, used);
+            memcpy(dupe_node_get_child(node, 0), &children[i],
+                    used*sizeof(dupe_child_t));
+            dupe_node_set_count(node, __dupe_node_sum(node));
+            st=__dupe_node_alloc(db, node, &id);
+            if (st)
+                goto bail;
+            dupe_child_set_id(&children[next], id);
+            dupe_child_set_count(&children[next], dupe_node_get_count(node));
+        }
+        n=next;
+    }
+
+    *root=dupe_child_get_id(&children[0]);
+
+bail:
+    env->get_allocator()->free(node);
+    return (st);
+}
+
+/**
+ * returns the position of a new duplicate in a sorted duplicate tree;
+ * equal duplicates are inserted after the existing ones
+ */
+static ham_status_t
+__get_sorted_tree_position(Database *db, Transaction *txn, ham_offset_t root,
+                ham_size_t count, ham_record_t *record, ham_u32_t flags,
+                ham_size_t *position)
+{
+    ham_duplicate_compare_func_t foo=db->get_duplicate_compare_func();
+    ham_status_t st;
+    ham_size_t l=0, r=count, m;
+    dupe_entry_t e;
+    ham_record_t item_record;
+
+    /* sequential inserts: try the end of the tree first */
+    if (db->get_data_access_mode()&HAM_DAM_SEQUENTIAL_INSERT)
+        m=count-1;
+    else
+        m=count/2;
+
+    while (l<r) {
+        st=__dupe_tree_get(db->get_env(), root, m, &e);
+        if (st)
+            return (st);
+
+        memset(&item_record, 0, sizeof(item_record));
+        item_record._rid=dupe_entry_get_rid(&e);
+        item_record._intflags=dupe_entry_get_flags(&e)&(KEY_BLOB_SIZE_SMALL
+                                                     |KEY_BLOB_SIZE_TINY
+                                                     |KEY_BLOB_SIZE_EMPTY);
+        st=btree_read_record(db, txn, &item_record,
+                    (ham_u64_t *)&dupe_entry_get_ridptr(&e), flags);
+        if (st)
+            return (st);
+
+        if (foo((ham_db_t *)db, (ham_u8_t *)record->data, record->size,
+                    (ham_u8_t *)item_record.data, item_record.size)<0)
+            r=m;
+        else
+            l=m+1;
+        m=(l+r)/2;
+    }
+
+    *position=l;
+    return (0);
+}
+
+/** blob_duplicate_insert for a duplicate tree */
+static ham_status_t
+__dupe_tree_insert_entry(Database *db, Transaction *txn, ham_offset_t root,
+        ham_size_t count, ham_record_t *record, ham_size_t position,
+        ham_u32_t flags, dupe_entry_t *entry, ham_offset_t *rid,
+        ham_size_t *new_position)
+{
+    ham_status_t st;
+    Environment *env=db->get_env();
+    dupe_tree_path_t path[DUPE_TREE_MAX_HEIGHT];
+    ham_size_t height;
+
+    /* overwrite the entry at the requested position */
+    if (flags&HAM_OVERWRITE) {
+        dupe_entry_t old;
+        if (position>=count)
+            return (HAM_KEY_NOT_FOUND);
+        st=__dupe_tree_descend(env, root, position, path, &height);
+        if (st)
+            return (st);
+        ham_size_t offset=DUPE_NODE_HEADER_SIZE
+                    +path[height-1].slot*sizeof(dupe_entry_t);
+        st=__dupe_node_read(env, path[height-1].id, offset, &old, sizeof(old));
+        if (st)
+            return (st);
+        st=__dupe_entry_free(db, &old);
+        if (st)
+            return (st);
+        st=__dupe_node_write(env, path[height-1].id, offset, entry,
+                    sizeof(*entry));
+        if (st)
+            return (st);
+        *rid=root;
+        if (new_position)
+            *new_position=position;
+        return (0);
+    }
+
+    if (db->get_rt_flags()&HAM_SORT_DUPLICATES) {
+        st=__get_sorted_tree_position(db, txn, root, count, record, flags,
+                    &position);
+        if (st)
+            return (st);
+    }
+    else if (flags&HAM_DUPLICATE_INSERT_BEFORE) {
+        /* do nothing, insert at the current position */
+    }
+    else if (flags&HAM_DUPLICATE_INSERT_AFTER) {
+        position++;
+        if (position>count)
+            position=count;
+    }
+    else if (flags&HAM_DUPLICATE_INSERT_FIRST) {
+        position=0;
+    }
+    else {
+        position=count;
+    }
+    if (position>count)
+        position=count;
+
+    st=__dupe_tree_insert(db, root, position, entry, rid);
+    if (st)
+        return (st);
+
+    if (new_position)
+        *new_position=position;
+    return (0);
+}
+
+/** reads the header of a duplicate table (or of a duplicate tree) */
+static ham_status_t
+__get_duplicate_header(Environment *env, ham_offset_t table_id,
+                dupe_table_t *hdr)
+{
+    return (__dupe_node_read(env, table_id, 0, hdr,
+                2*sizeof(ham_u32_t)));
 }
 
 ham_status_t
@@ -1146,6 +2384,17 @@ blob_duplicate_insert(Database *db, Transaction *txn, ham_offset_t table_id,
         alloc_table=1;
     }
     else {
+        dupe_table_t hdr;
+
+        /* a large duplicate table is stored in a duplicate tree */
+        st=__get_duplicate_header(env, table_id, &hdr);
+        if (st)
+            return (st);
+        if (dupe_table_is_tree(&hdr))
+            return (__dupe_tree_insert_entry(db, txn, table_id,
+                        dupe_table_get_count(&hdr), record, position, flags,
+                        &entries[0], rid, new_position));
+
         /*
          * otherwise load the existing table
          */
@@ -1168,6 +2417,33 @@ blob_duplicate_insert(Database *db, Transaction *txn, ham_offset_t table_id,
         dupe_table_t *old=table;
         ham_size_t new_cap=dupe_table_get_capacity(table);
 
+        /* instead of growing a large table, convert it to a tree */
+        if (table_id && new_cap>=DUPE_TREE_THRESHOLD
+                && (env->get_flags()&HAM_ENABLE_DUPLICATE_TREES)) {
+            ham_offset_t root;
+            ham_size_t count=dupe_table_get_count(table);
+            /* the page with the table can be purged while the nodes
+             * are allocated */
+            if (!alloc_table) {
+                table=(dupe_table_t *)env->get_allocator()->alloc(
+                            sizeof(dupe_table_t)+count*sizeof(dupe_entry_t));
+                if (!table)
+                    return (HAM_OUT_OF_MEMORY);
+                memcpy(table, old, sizeof(dupe_table_t)
+                            +(count-1)*sizeof(dupe_entry_t));
+                alloc_table=1;
+            }
+            st=__dupe_tree_create(db, table, &root);
+            if (alloc_table)
+                env->get_allocator()->free(table);
+            if (!st)
+                st=blob_free(env, db, table_id, 0);
+            if (st)
+                return (st);
+            return (__dupe_tree_insert_entry(db, txn, root, count, record,
+                        position, flags, &entries[0], rid, new_position));
+        }
+
         if (new_cap < 3*8)
             new_cap += 8;
         else
@@ -1245,14 +2521,14 @@ blob_duplicate_insert(Database *db, Transaction *txn, ham_offset_t table_id,
         rec.data=(ham_u8_t *)table;
         rec.size=sizeof(dupe_table_t)
                     +(dupe_table_get_capacity(table)-1)*sizeof(dupe_entry_t);
-        st=blob_overwrite(env, db, table_id, &rec, 0, rid);
+        st=blob_overwrite(env, db, table_id, &rec, BLOB_NO_CHECKSUM, rid);
     }
     else if (!table_id) {
         ham_record_t rec={0};
         rec.data=(ham_u8_t *)table;
         rec.size=sizeof(dupe_table_t)
                     +(dupe_table_get_capacity(table)-1)*sizeof(dupe_entry_t);
-        st=blob_allocate(env, db, &rec, 0, rid);
+        st=blob_allocate(env, db, &rec, BLOB_NO_CHECKSUM, rid);
     }
     else if (table_id && page) {
         page->set_dirty(true);
@@ -1277,7 +2553,7 @@ blob_duplicate_erase(Database *db, Transaction *txn, ham_offset_t table_id,
     ham_status_t st;
     ham_record_t rec;
     ham_size_t i;
-    dupe_table_t *table;
+    dupe_table_t *table, hdr;
     ham_offset_t rid;
     Environment *env = db->get_env();
 
@@ -1299,6 +2575,22 @@ blob_duplicate_erase(Database *db, Transaction *txn, ham_offset_t table_id,
     if (new_table_id)
         *new_table_id=table_id;
 
+    /* a duplicate tree is modified in place */
+    st=__get_duplicate_header(env, table_id, &hdr);
+    if (st)
+        return (st);
+    if (dupe_table_is_tree(&hdr)) {
+        if (flags&HAM_ERASE_ALL_DUPLICATES) {
+            st=__dupe_tree_free(db, table_id);
+            rid=0;
+        }
+        else
+            st=__dupe_tree_erase(db, table_id, position, &rid);
+        if (!st && new_table_id)
+            *new_table_id=rid;
+        return (st);
+    }
+
     st=blob_read(db, txn, table_id, &rec, 0);
     if (st)
         return (st);
@@ -1358,7 +2650,7 @@ blob_duplicate_erase(Database *db, Transaction *txn, ham_offset_t table_id,
         rec.data=(ham_u8_t *)table;
         rec.size=sizeof(dupe_table_t)
                     +(dupe_table_get_capacity(table)-1)*sizeof(dupe_entry_t);
-        st=blob_overwrite(env, db, table_id, &rec, 0, &rid);
+        st=blob_overwrite(env, db, table_id, &rec, BLOB_NO_CHECKSUM, &rid);
         if (st) {
             env->get_allocator()->free(table);
             return (st);
@@ -1383,9 +2675,20 @@ blob_duplicate_get_count(Environment *env, ham_offset_t table_id,
         ham_size_t *count, dupe_entry_t *entry)
 {
     ham_status_t st;
-    dupe_table_t *table;
+    dupe_table_t *table, hdr;
     Page *page=0;
 
+    /* the root of a duplicate tree stores the number of duplicates */
+    st=__get_duplicate_header(env, table_id, &hdr);
+    if (st)
+        return (st);
+    if (dupe_table_is_tree(&hdr)) {
+        *count=dupe_table_get_count(&hdr);
+        if (entry)
+            return (__dupe_tree_get(env, table_id, (*count)-1, entry));
+        return (0);
+    }
+
     st=__get_duplicate_table(&table, &page, env, table_id);
     ham_assert(st ? table == NULL : 1, (0));
     ham_assert(st ? page == NULL : 1, (0));
@@ -1408,9 +2711,18 @@ blob_duplicate_get(Environment *env, ham_offset_t table_id,
         ham_size_t position, dupe_entry_t *entry)
 {
     ham_status_t st;
-    dupe_table_t *table;
+    dupe_table_t *table, hdr;
     Page *page=0;
 
+    st=__get_duplicate_header(env, table_id, &hdr);
+    if (st)
+        return (st);
+    if (dupe_table_is_tree(&hdr)) {
+        if (position>=dupe_table_get_count(&hdr))
+            return (HAM_KEY_NOT_FOUND);
+        return (__dupe_tree_get(env, table_id, position, entry));
+    }
+
     st = __get_duplicate_table(&table, &page, env, table_id);
     ham_assert(st ? table == NULL : 1, (0));
     ham_assert(st ? page == NULL : 1, (0));
@@ -1439,6 +2751,29 @@ blob_duplicate_get_table(Environment *env, ham_offset_t table_id,
 {
     ham_status_t st;
     Page *page=0;
+    dupe_table_t hdr;
+
+    /* a duplicate tree is copied to a temporary table */
+    st=__get_duplicate_header(env, table_id, &hdr);
+    if (st)
+        return (st);
+    if (dupe_table_is_tree(&hdr)) {
+        ham_size_t count=dupe_table_get_count(&hdr);
+        dupe_table_t *table=(dupe_table_t *)env->get_allocator()->alloc(
+                    sizeof(dupe_table_t)+count*sizeof(dupe_entry_t));
+        if (!table)
+            return (HAM_OUT_OF_MEMORY);
+        dupe_table_set_count(table, 0);
+        dupe_table_set_capacity(table, count);
+        st=__dupe_tree_copy(env, table_id, table);
+        if (st) {
+            env->get_allocator()->free(table);
+            return (st);
+        }
+        *ptable=table;
+        *needs_free=1;
+        return (0);
+    }
 
     st=__get_duplicate_table(ptable, &page, env, table_id);
     if (st)
@@ -1450,3 +2785,131 @@ blob_duplicate_get_table(Environment *env, ham_offset_t table_id,
 
     return (0);
 }
+
+ham_status_t
+blob_duplicate_replace_rid(Environment *env, ham_offset_t table_id,
+        ham_offset_t old_rid, ham_offset_t new_rid)
+{
+    ham_status_t st;
+    dupe_table_t *table;
+    dupe_node_t hdr;
+    dupe_entry_t entry;
+    Page *page=0;
+    ham_u8_t *chunk_data[1];
+    ham_size_t chunk_size[1];
+
+    ham_assert(!(env->get_flags()&HAM_IN_MEMORY_DB), (0));
+
+    /* a node of a duplicate tree refers to its entries or children */
+    st=__dupe_node_read(env, table_id, 0, &hdr, DUPE_NODE_HEADER_SIZE);
+    if (st)
+        return (st);
+    if (dupe_table_is_tree((dupe_table_t *)&hdr)) {
+        for (ham_size_t i=0; i<dupe_node_get_used(&hdr); i++) {
+            ham_size_t offset=DUPE_NODE_HEADER_SIZE+i*sizeof(entry);
+            st=__dupe_node_read(env, table_id, offset, &entry, sizeof(entry));
+            if (st)
+                return (st);
+            if (dupe_node_get_level(&hdr)) {
+                dupe_child_t *c=(dupe_child_t *)&entry;
+                if (dupe_child_get_id(c)!=old_rid)
+                    continue;
+                dupe_child_set_id(c, new_rid);
+            }
+            else {
+                if ((dupe_entry_get_flags(&entry)&(KEY_BLOB_SIZE_SMALL
+                                    |KEY_BLOB_SIZE_TINY
+                                    |KEY_BLOB_SIZE_EMPTY))
+                        || dupe_entry_get_rid(&entry)!=old_rid)
+                    continue;
+                dupe_entry_set_rid(&entry, new_rid);
+            }
+            return (__dupe_node_write(env, table_id, offset, &entry,
+                        sizeof(entry)));
+        }
+        return (HAM_KEY_NOT_FOUND);
+    }
+
+    st=__get_duplicate_table(&table, &page, env, table_id);
+    if (st)
+        return (st);
+
+    st=HAM_KEY_NOT_FOUND;
+    for (ham_size_t i=0; i<dupe_table_get_count(table); i++) {
+        dupe_entry_t *e=dupe_table_get_entry(table, i);
+        if (dupe_entry_get_flags(e)&(KEY_BLOB_SIZE_SMALL
+                                    |KEY_BLOB_SIZE_TINY
+                                    |KEY_BLOB_SIZE_EMPTY))
+            continue;
+        if (dupe_entry_get_rid(e)!=old_rid)
+            continue;
+
+        /* write the modified entry; this goes through the page if the
+         * table is cached, and logs the modification */
+        entry=*e;
+        dupe_entry_set_rid(&entry, new_rid);
+        chunk_data[0]=(ham_u8_t *)&entry;
+        chunk_size[0]=sizeof(entry);
+        st=__write_chunks(env, page, table_id+sizeof(blob_t)
+                    +((ham_u8_t *)e-(ham_u8_t *)table),
+                HAM_TRUE, HAM_FALSE, chunk_data, chunk_size, 1);
+        break;
+    }
+
+    if (!page)
+        env->get_allocator()->free(table);
+
+    return (st);
+}
+
+ham_status_t
+blob_duplicate_get_references(Environment *env, ham_offset_t table_id,
+        std::vector<ham_offset_t> &nodes, std::vector<ham_offset_t> &rids)
+{
+    ham_status_t st;
+    dupe_table_t *table;
+    dupe_node_t *node;
+    ham_bool_t needs_free=HAM_FALSE;
+
+    node=(dupe_node_t *)env->get_allocator()->alloc(sizeof(dupe_node_t));
+    if (!node)
+        return (HAM_OUT_OF_MEMORY);
+
+    st=__dupe_node_read(env, table_id, 0, node, DUPE_NODE_HEADER_SIZE);
+    if (st || !dupe_table_is_tree((dupe_table_t *)node)) {
+        env->get_allocator()->free(node);
+        if (st)
+            return (st);
+
+        /* a duplicate table only refers to records */
+        st=blob_duplicate_get_table(env, table_id, &table, &needs_free);
+        if (st)
+            return (st);
+        for (ham_size_t i=0; i<dupe_table_get_count(table); i++) {
+            dupe_entry_t *e=dupe_table_get_entry(table, i);
+            if (!(dupe_entry_get_flags(e)&(KEY_BLOB_SIZE_TINY
+                                |KEY_BLOB_SIZE_SMALL|KEY_BLOB_SIZE_EMPTY))
+                    && dupe_entry_get_rid(e))
+                rids.push_back(dupe_entry_get_rid(e));
+        }
+        if (needs_free)
+            env->get_allocator()->free(table);
+        return (0);
+    }
+
+    st=__dupe_node_read(env, table_id, 0, node, sizeof(*node));
+    for (ham_size_t i=0; !st && i<dupe_node_get_used(node); i++) {
+        if (dupe_node_get_level(node)) {
+            nodes.push_back(dupe_child_get_id(dupe_node_get_child(node, i)));
+            continue;
+        }
+        dupe_entry_t *e=dupe_node_get_entry(node, i);
+        if (!(dupe_entry_get_flags(e)&(KEY_BLOB_SIZE_TINY
+                            |KEY_BLOB_SIZE_SMALL|KEY_BLOB_SIZE_EMPTY))
+                && dupe_entry_get_rid(e))
+            rids.push_back(dupe_entry_get_rid(e));
+    }
+
+    env->get_allocator()->free(node);
+    return (st);
+}
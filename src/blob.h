@@ -18,6 +18,8 @@
 #ifndef HAM_BLOB_H__
 #define HAM_BLOB_H__
 
+#include <vector>
+
 #include "internal_fwd_decl.h"
 #include "endianswap.h"
 
@@ -46,8 +48,11 @@ typedef HAM_PACK_0 struct HAM_PACK_1 blob_t
     /** the size of the blob */
     ham_u64_t _size;
 
-    /** additional flags */
-    ham_u32_t _flags;
+    /**
+     * the CRC32C of the blob data, or 0 if the blob has no checksum
+     * (see @ref HAM_ENABLE_CRC32)
+     */
+    ham_u32_t _checksum;
 
 } HAM_PACK_2 blob_t;
 
@@ -71,11 +76,24 @@ typedef HAM_PACK_0 struct HAM_PACK_1 blob_t
 /** get the size of a blob_t */
 #define blob_set_size(b, s)            (b)->_size=ham_h2db64(s)
 
-/** get flags of a blob_t */
-#define blob_get_flags(b)              (ham_db2h32((b)->_flags))
+/** get the checksum of a blob_t */
+#define blob_get_checksum(b)           (ham_db2h32((b)->_checksum))
+
+/** set the checksum of a blob_t */
+#define blob_set_checksum(b, c)        (b)->_checksum=ham_h2db32(c)
+
+/**
+ * a flag for @ref blob_allocate and @ref blob_overwrite: don't store a
+ * checksum, because the blob is later modified in place (i.e. it's a
+ * duplicate table)
+ */
+#define BLOB_NO_CHECKSUM               0x0100
 
-/** set flags of a blob_t */
-#define blob_set_flags(b, f)           (b)->_flags=ham_h2db32(f)
+/**
+ * a flag for @ref blob_allocate and @ref blob_overwrite: the blob is a
+ * record, which can be stored in a slab page (see slab.h)
+ */
+#define BLOB_RECORD                    0x0200
 
 
 #include "packstart.h"
@@ -171,6 +189,115 @@ typedef HAM_PACK_0 struct HAM_PACK_1 dupe_table_t
 /** get a pointer to a duplicate entry @a i */
 #define dupe_table_get_entry(t, i)      (&(t)->_entries[i])
 
+/** returns true if the table is the root node of a duplicate tree */
+#define dupe_table_is_tree(t)           (dupe_table_get_capacity(t)==0)
+
+/** the maximum number of entries (or children) of a duplicate tree node */
+#define DUPE_NODE_CAPACITY              255
+
+/**
+ * a duplicate table is converted to a duplicate tree when it grows
+ * beyond this number of entries (if HAM_ENABLE_DUPLICATE_TREES is set)
+ */
+#define DUPE_TREE_THRESHOLD             DUPE_NODE_CAPACITY
+
+/** the maximum height of a duplicate tree */
+#define DUPE_TREE_MAX_HEIGHT            8
+
+#include "packstart.h"
+
+/**
+ * a child of an internal node of a duplicate tree
+ */
+typedef HAM_PACK_0 struct HAM_PACK_1 dupe_child_t
+{
+    /** the blob id of the child node */
+    ham_u64_t _id;
+
+    /** the number of duplicates in the subtree of the child */
+    ham_u32_t _count;
+
+    /** reserved, for padding */
+    ham_u32_t _reserved;
+
+} HAM_PACK_2 dupe_child_t;
+
+/**
+ * a node of a duplicate tree (dupe_node_t)
+ *
+ * a large duplicate table is replaced by a B+tree which is indexed by
+ * the position of the duplicates; every node is a blob of a fixed size.
+ * The leaves store the dupe_entry_t's, the internal nodes store the
+ * blob ids of their children and the number of duplicates in each
+ * subtree. The header is compatible to the dupe_table_t header, but
+ * the capacity is always 0.
+ */
+typedef HAM_PACK_0 struct HAM_PACK_1 dupe_node_t
+{
+    /** the number of duplicates in this subtree */
+    ham_u32_t _count;
+
+    /** always 0 - this is not a dupe_table_t */
+    ham_u32_t _capacity;
+
+    /** the level of the node; leaves have level 0 */
+    ham_u16_t _level;
+
+    /** the number of used entries (or children) */
+    ham_u16_t _used;
+
+    /** reserved, for padding */
+    ham_u32_t _reserved;
+
+    /** the duplicate entries (of a leaf) or the children */
+    union {
+        dupe_entry_t _entries[DUPE_NODE_CAPACITY];
+        dupe_child_t _children[DUPE_NODE_CAPACITY];
+    } _u;
+
+} HAM_PACK_2 dupe_node_t;
+
+#include "packstop.h"
+
+/** the size of the dupe_node_t header */
+#define DUPE_NODE_HEADER_SIZE           16
+
+/** get the number of duplicates in the subtree of a node */
+#define dupe_node_get_count(n)          (ham_db2h32((n)->_count))
+
+/** set the number of duplicates in the subtree of a node */
+#define dupe_node_set_count(n, c)       (n)->_count=ham_h2db32(c)
+
+/** get the level of a node */
+#define dupe_node_get_level(n)          (ham_db2h16((n)->_level))
+
+/** set the level of a node */
+#define dupe_node_set_level(n, l)       (n)->_level=ham_h2db16(l)
+
+/** get the number of used entries of a node */
+#define dupe_node_get_used(n)           (ham_db2h16((n)->_used))
+
+/** set the number of used entries of a node */
+#define dupe_node_set_used(n, u)        (n)->_used=ham_h2db16(u)
+
+/** get a pointer to the duplicate entry @a i of a leaf */
+#define dupe_node_get_entry(n, i)       (&(n)->_u._entries[i])
+
+/** get a pointer to the child @a i of an internal node */
+#define dupe_node_get_child(n, i)       (&(n)->_u._children[i])
+
+/** get the blob id of a child */
+#define dupe_child_get_id(c)            (ham_db2h_offset((c)->_id))
+
+/** set the blob id of a child */
+#define dupe_child_set_id(c, id)        (c)->_id=ham_h2db_offset(id)
+
+/** get the number of duplicates in the subtree of a child */
+#define dupe_child_get_count(c)         (ham_db2h32((c)->_count))
+
+/** set the number of duplicates in the subtree of a child */
+#define dupe_child_set_count(c, n)      (c)->_count=ham_h2db32(n)
+
 /**
  * allocate/create a blob
  *
@@ -215,6 +342,69 @@ blob_overwrite(Environment *env, Database *db, ham_offset_t old_blobid,
 extern ham_status_t
 blob_free(Environment *env, Database *db, ham_offset_t blobid, ham_u32_t flags);
 
+/**
+ * retrieves the number of bytes which are allocated for a blob, including
+ * the blob header; @a blobid must not be a slot of a slab page
+ *
+ * stores the size in @a size
+ */
+extern ham_status_t
+blob_get_allocated_size(Environment *env, ham_offset_t blobid,
+        ham_offset_t *size);
+
+/**
+ * copy a blob to a new address
+ *
+ * the space at @a new_blobid must already be allocated; the old space
+ * is not moved to the freelist. this is used by the Compactor.
+ */
+extern ham_status_t
+blob_move(Environment *env, ham_offset_t old_blobid, ham_offset_t new_blobid);
+
+/**
+ * retrieves the size of a blob and the number of bytes which can be
+ * stored without moving the blob; @a blobid must not be a slot of a
+ * slab page
+ */
+extern ham_status_t
+blob_get_capacity(Environment *env, Database *db, ham_offset_t blobid,
+        ham_offset_t *size, ham_offset_t *capacity);
+
+/**
+ * sets the size of a blob; the size must not exceed the capacity. The
+ * checksum of the blob is removed
+ */
+extern ham_status_t
+blob_set_datasize(Environment *env, Database *db, ham_offset_t blobid,
+        ham_offset_t size);
+
+/**
+ * reads a range of the data of a blob, without verifying the checksum;
+ * the uncached pages of a large range are read from the device with a
+ * single read
+ */
+extern ham_status_t
+blob_read_range(Environment *env, Database *db, ham_offset_t blobid,
+        ham_offset_t offset, void *data, ham_size_t size);
+
+/**
+ * writes a range of the data of a blob; the range must not exceed the
+ * capacity. The size of the blob is not modified (see
+ * @ref blob_set_datasize)
+ */
+extern ham_status_t
+blob_write_range(Environment *env, Database *db, ham_offset_t blobid,
+        ham_offset_t offset, const void *data, ham_size_t size);
+
+/**
+ * allocates a blob with a capacity of (at least) @a capacity bytes and
+ * moves the data of @a old_blobid (if not 0) to the new blob; the old
+ * blob is freed. The new blob has no checksum
+ */
+extern ham_status_t
+blob_reserve(Environment *env, Database *db, ham_offset_t old_blobid,
+        ham_size_t capacity, ham_offset_t *new_blobid);
+
 /**
  * create a duplicate table and insert all entries in the duplicate
  * (max. two entries are allowed; first entry will be at the first position,
@@ -256,7 +446,8 @@ blob_duplicate_get(Environment *env, ham_offset_t table_id,
         ham_size_t position, dupe_entry_t *entry);
 
 /**
- * retrieve the whole table of duplicates
+ * retrieve the whole table of duplicates; a duplicate tree is copied
+ * to a temporary table
  *
  * @warning will return garbage if the key has no dupes!!
  * @warning memory has to be freed by the caller IF needs_free is true!
@@ -266,4 +457,25 @@ blob_duplicate_get_table(Environment *env, ham_offset_t table_id,
                     dupe_table_t **ptable, ham_bool_t *needs_free);
 
 
+/**
+ * returns the blobs which are referenced by a duplicate table or by a
+ * node of a duplicate tree: the child nodes are stored in @a nodes,
+ * the records in @a rids
+ */
+extern ham_status_t
+blob_duplicate_get_references(Environment *env, ham_offset_t table_id,
+        std::vector<ham_offset_t> &nodes, std::vector<ham_offset_t> &rids);
+
+/**
+ * replace the record id of a duplicate, i.e. after the record's blob
+ * was moved with @ref blob_move; if @a table_id is an internal node of
+ * a duplicate tree then the blob id of a child node is replaced
+ *
+ * returns HAM_KEY_NOT_FOUND if no duplicate refers to @a old_rid
+ */
+extern ham_status_t
+blob_duplicate_replace_rid(Environment *env, ham_offset_t table_id,
+        ham_offset_t old_rid, ham_offset_t new_rid);
+
+
 #endif /* HAM_BLOB_H__ */
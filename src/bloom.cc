@@ -0,0 +1,460 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief implementation of the bloom filter
+ *
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "backend.h"
+#include "blob.h"
+#include "bloom.h"
+#include "cursor.h"
+#include "db.h"
+#include "endianswap.h"
+#include "env.h"
+#include "error.h"
+#include "page.h"
+#include "txn.h"
+
+#define DUMMY_LSN       1
+
+BloomFilter::BloomFilter(ham_u64_t capacity, double fp_rate,
+                ham_size_t max_size)
+  : m_hashes(1), m_capacity(0), m_count(0), m_erased(0), m_fp_rate(fp_rate),
+    m_max_size(max_size), m_blobid(0)
+{
+    resize(capacity);
+}
+
+bool
+BloomFilter::is_supported(Database *db)
+{
+    if (db->get_rt_flags()&(HAM_RECORD_NUMBER|DB_IS_REMOTE))
+        return (false);
+    return (true);
+}
+
+bool
+BloomFilter::can_lookup(Database *db, ham_u32_t flags)
+{
+    if (flags&(HAM_FIND_LT_MATCH|HAM_FIND_GT_MATCH))
+        return (false);
+    /* the integer and fixed binary key types compare all bytes; but
+     * -0.0 and 0.0 are equal real64 keys */
+    if (db->has_typed_compare())
+        return (db->get_key_type()!=HAM_TYPE_REAL64);
+    /* a custom compare function could treat different keys as equal */
+    return (db->get_compare_func()==db_default_compare);
+}
+
+void
+BloomFilter::resize(ham_u64_t capacity)
+{
+    if (capacity<MIN_CAPACITY)
+        capacity=MIN_CAPACITY;
+
+    /* m = -n * ln(p) / ln(2)^2 */
+    double bits=-(double)capacity*log(m_fp_rate)/(log(2.0)*log(2.0));
+    double bytes=ceil(bits/8);
+    if (m_max_size && bytes>m_max_size)
+        bytes=m_max_size;
+    ham_size_t blocks=(ham_size_t)(bytes/BLOCK_SIZE);
+    if (!blocks)
+        blocks=1;
+    m_bits.assign(blocks*BLOCK_SIZE, 0);
+
+    /* k = m / n * ln(2) */
+    double k=(double)m_bits.size()*8/capacity*log(2.0);
+    m_hashes=(ham_u32_t)(k+0.5);
+    if (m_hashes<1)
+        m_hashes=1;
+    if (m_hashes>MAX_HASHES)
+        m_hashes=MAX_HASHES;
+
+    m_capacity=capacity;
+    m_count=0;
+    m_erased=0;
+}
+
+ham_u64_t
+BloomFilter::hash(const ham_key_t *key)
+{
+    /* FNV-1a, followed by a final mix to spread the bits */
+    const ham_u8_t *p=(const ham_u8_t *)key->data;
+    ham_u64_t h=0xcbf29ce484222325ull;
+    for (ham_size_t i=0; i<key->size; i++) {
+        h^=p[i];
+        h*=0x100000001b3ull;
+    }
+    h^=h>>33;
+    h*=0xff51afd7ed558ccdull;
+    h^=h>>33;
+    h*=0xc4ceb9fe1a85ec53ull;
+    h^=h>>33;
+    return (h);
+}
+
+void
+BloomFilter::insert(const ham_key_t *key)
+{
+    ham_u64_t h=hash(key);
+    ham_u8_t *block=&m_bits[(size_t)(h%(m_bits.size()/BLOCK_SIZE))
+                            *BLOCK_SIZE];
+    ham_u32_t a=(ham_u32_t)(h>>32);
+    ham_u32_t b=((ham_u32_t)h>>16)|1;
+
+    for (ham_u32_t i=0; i<m_hashes; i++, a+=b) {
+        ham_u32_t bit=a%(BLOCK_SIZE*8);
+        block[bit/8]|=(ham_u8_t)(1<<(bit%8));
+    }
+    m_count++;
+}
+
+bool
+BloomFilter::may_contain(const ham_key_t *key) const
+{
+    ham_u64_t h=hash(key);
+    const ham_u8_t *block=&m_bits[(size_t)(h%(m_bits.size()/BLOCK_SIZE))
+                            *BLOCK_SIZE];
+    ham_u32_t a=(ham_u32_t)(h>>32);
+    ham_u32_t b=((ham_u32_t)h>>16)|1;
+
+    for (ham_u32_t i=0; i<m_hashes; i++, a+=b) {
+        ham_u32_t bit=a%(BLOCK_SIZE*8);
+        if (!(block[bit/8]&(1<<(bit%8))))
+            return (false);
+    }
+    return (true);
+}
+
+bool
+BloomFilter::needs_rebuild() const
+{
+    /* more than half of the keys were erased */
+    if (m_erased>=MIN_CAPACITY/4 && m_erased>m_count/2)
+        return (true);
+
+    /* the filter is overfull, and the memory budget allows a larger
+     * filter */
+    if (m_count>m_capacity*2
+            && (!m_max_size || m_bits.size()+BLOCK_SIZE<=m_max_size))
+        return (true);
+    return (false);
+}
+
+ham_u32_t
+BloomFilter::checksum() const
+{
+    ham_u32_t h=2166136261u;
+    for (size_t i=0; i<m_bits.size(); i++) {
+        h^=m_bits[i];
+        h*=16777619u;
+    }
+    return (h);
+}
+
+void
+BloomFilter::serialize(std::vector<ham_u8_t> &buffer) const
+{
+    header_t hdr;
+    hdr.magic=ham_h2db32(MAGIC);
+    hdr.hashes=ham_h2db32(m_hashes);
+    hdr.size=ham_h2db32((ham_u32_t)m_bits.size());
+    hdr.max_size=ham_h2db32(m_max_size);
+    hdr.capacity=ham_h2db64(m_capacity);
+    hdr.count=ham_h2db64(m_count);
+    hdr.erased=ham_h2db64(m_erased);
+    hdr.fp_rate=ham_h2db32((ham_u32_t)(m_fp_rate*1000000000.0+0.5));
+    hdr.checksum=ham_h2db32(checksum());
+
+    buffer.resize(sizeof(hdr)+m_bits.size());
+    memcpy(&buffer[0], &hdr, sizeof(hdr));
+    memcpy(&buffer[sizeof(hdr)], &m_bits[0], m_bits.size());
+}
+
+BloomFilter *
+BloomFilter::deserialize(const ham_u8_t *data, ham_size_t size)
+{
+    header_t hdr;
+    if (size<sizeof(hdr))
+        return (0);
+    memcpy(&hdr, data, sizeof(hdr));
+
+    ham_u32_t bytes=ham_db2h32(hdr.size);
+    ham_u32_t hashes=ham_db2h32(hdr.hashes);
+    ham_u32_t fp_rate=ham_db2h32(hdr.fp_rate);
+    if (ham_db2h32(hdr.magic)!=MAGIC
+            || size!=sizeof(hdr)+bytes
+            || !bytes || bytes%BLOCK_SIZE
+            || !hashes || hashes>MAX_HASHES
+            || !fp_rate || fp_rate>=1000000000u)
+        return (0);
+
+    BloomFilter *filter=new BloomFilter();
+    filter->m_bits.assign(data+sizeof(hdr), data+size);
+    filter->m_hashes=hashes;
+    filter->m_capacity=ham_db2h64(hdr.capacity);
+    filter->m_count=ham_db2h64(hdr.count);
+    filter->m_erased=ham_db2h64(hdr.erased);
+    filter->m_fp_rate=fp_rate/1000000000.0;
+    filter->m_max_size=ham_db2h32(hdr.max_size);
+    filter->m_blobid=0;
+
+    if (filter->checksum()!=ham_db2h32(hdr.checksum)) {
+        delete filter;
+        return (0);
+    }
+    return (filter);
+}
+
+ham_status_t
+BloomFilter::build(Database *db)
+{
+    ham_status_t st;
+    ham_key_t key;
+    ham_u64_t count=0;
+
+    Cursor *cursor;
+    st=ham_cursor_create((ham_db_t *)db, 0, HAM_DONT_LOCK,
+                (ham_cursor_t **)&cursor);
+    if (st)
+        return (st);
+
+    memset(&key, 0, sizeof(key));
+    st=(*db)()->cursor_move(cursor, &key, 0, HAM_CURSOR_FIRST);
+    while (!st) {
+        insert(&key);
+        count++;
+        memset(&key, 0, sizeof(key));
+        st=(*db)()->cursor_move(cursor, &key, 0,
+                    HAM_CURSOR_NEXT|HAM_SKIP_DUPLICATES);
+    }
+    db->close_cursor(cursor);
+
+    if (st!=HAM_KEY_NOT_FOUND)
+        return (st);
+    m_count=count;
+    m_erased=0;
+    return (0);
+}
+
+/* writes the Database header, and the pages of the changeset */
+static ham_status_t
+__flush_header(Database *db)
+{
+    ham_status_t st;
+    Environment *env=db->get_env();
+    Backend *be=db->get_backend();
+
+    be->set_dirty(true);
+    st=be->flush();
+    if (st)
+        return (st);
+    env->set_dirty(true);
+
+    if (env->get_flags()&HAM_ENABLE_RECOVERY) {
+        ham_u64_t lsn=DUMMY_LSN;
+        env->get_changeset().add_page(env->get_header_page());
+        if (env->get_flags()&HAM_ENABLE_TRANSACTIONS) {
+            st=env_get_incremented_lsn(env, &lsn);
+            if (st)
+                return (st);
+        }
+        return (env->get_changeset().flush(lsn));
+    }
+    return (env->get_header_page()->flush());
+}
+
+bool
+BloomFilter::has_active_txns(Environment *env)
+{
+    for (Transaction *txn=env->get_oldest_txn(); txn;
+            txn=txn_get_newer(txn)) {
+        if (!(txn_get_flags(txn)&(TXN_STATE_COMMITTED|TXN_STATE_ABORTED)))
+            return (true);
+    }
+    return (false);
+}
+
+ham_status_t
+BloomFilter::enable(Database *db, double fp_rate, ham_size_t max_size)
+{
+    ham_status_t st;
+    BloomFilter *old=db->get_bloom_filter();
+
+    if (has_active_txns(db->get_env())) {
+        ham_trace(("the bloom filter cannot be built while Transactions "
+                    "are active"));
+        return (HAM_TXN_STILL_OPEN);
+    }
+
+    /* a loaded filter with the same configuration is reused */
+    if (old && old->m_fp_rate==fp_rate && old->m_max_size==max_size
+            && !old->needs_rebuild())
+        return (0);
+
+    ham_u64_t capacity=0;
+    st=(*db)()->get_key_count(0, HAM_SKIP_DUPLICATES, &capacity);
+    if (st)
+        return (st);
+
+    BloomFilter *filter=new BloomFilter(capacity+capacity/2, fp_rate,
+                max_size);
+    st=filter->build(db);
+    if (st) {
+        delete filter;
+        return (st);
+    }
+
+    /* the blob of the previous filter is overwritten on close */
+    if (old) {
+        filter->m_blobid=old->m_blobid;
+        delete old;
+    }
+    db->set_bloom_filter(filter);
+    return (0);
+}
+
+ham_status_t
+BloomFilter::disable(Database *db)
+{
+    ham_status_t st=0;
+    Environment *env=db->get_env();
+    BloomFilter *filter=db->get_bloom_filter();
+
+    if (!filter)
+        return (0);
+    db->set_bloom_filter(0);
+
+    if (filter->m_blobid && !(env->get_flags()&HAM_IN_MEMORY_DB)) {
+        st=blob_free(env, db, filter->m_blobid, 0);
+        if (!st && (env->get_flags()&HAM_ENABLE_RECOVERY))
+            st=__flush_header(db);
+    }
+    delete filter;
+    return (st);
+}
+
+ham_status_t
+BloomFilter::check(Database *db)
+{
+    BloomFilter *filter=db->get_bloom_filter();
+    if (!filter || !filter->needs_rebuild())
+        return (0);
+
+    /* the keys of the active Transactions are not visible */
+    if (has_active_txns(db->get_env()))
+        return (0);
+
+    ham_u64_t capacity=filter->m_count>filter->m_erased
+                ? filter->m_count-filter->m_erased
+                : 0;
+    filter->resize(capacity+capacity/2);
+    ham_status_t st=filter->build(db);
+    if (st) {
+        /* an incomplete filter must not be used */
+        (void)disable(db);
+        return (st);
+    }
+    return (0);
+}
+
+ham_status_t
+BloomFilter::open(Database *db)
+{
+    ham_status_t st;
+    Environment *env=db->get_env();
+    Backend *be=db->get_backend();
+    ham_offset_t blobid=be->get_bloom_filter();
+    ham_record_t record;
+
+    if (!blobid || (env->get_flags()&HAM_IN_MEMORY_DB))
+        return (0);
+
+    /* an invalid filter is ignored and can be rebuilt */
+    memset(&record, 0, sizeof(record));
+    st=blob_read(db, 0, blobid, &record, 0);
+    BloomFilter *filter=0;
+    if (!st)
+        filter=deserialize((const ham_u8_t *)record.data, record.size);
+    else if (st==HAM_BLOB_NOT_FOUND)
+        st=0;
+    else
+        return (st);
+
+    if (db->get_rt_flags()&HAM_READ_ONLY) {
+        db->set_bloom_filter(filter);
+        return (0);
+    }
+
+    /*
+     * the filter is no longer referenced by the header, because it
+     * would be outdated if the Database is modified and not closed
+     * properly; the blob is overwritten when the Database is closed
+     */
+    if (filter)
+        filter->m_blobid=blobid;
+    else if (record.size)
+        st=blob_free(env, db, blobid, 0);
+    be->set_bloom_filter(0);
+    if (!st)
+        st=__flush_header(db);
+    if (st) {
+        delete filter;
+        return (st);
+    }
+    db->set_bloom_filter(filter);
+    return (0);
+}
+
+ham_status_t
+BloomFilter::close(Database *db)
+{
+    ham_status_t st;
+    Environment *env=db->get_env();
+    Backend *be=db->get_backend();
+    BloomFilter *filter=db->get_bloom_filter();
+    std::vector<ham_u8_t> buffer;
+    ham_record_t record;
+    ham_offset_t blobid;
+
+    if (!filter)
+        return (0);
+    db->set_bloom_filter(0);
+
+    if ((env->get_flags()&HAM_IN_MEMORY_DB)
+            || (db->get_rt_flags()&HAM_READ_ONLY)
+            || !be || !be->is_active()) {
+        delete filter;
+        return (0);
+    }
+
+    filter->serialize(buffer);
+    memset(&record, 0, sizeof(record));
+    record.data=&buffer[0];
+    record.size=(ham_size_t)buffer.size();
+    if (filter->m_blobid)
+        st=blob_overwrite(env, db, filter->m_blobid, &record, 0, &blobid);
+    else
+        st=blob_allocate(env, db, &record, 0, &blobid);
+    delete filter;
+    if (st)
+        return (st);
+
+    be->set_bloom_filter(blobid);
+    return (__flush_header(db));
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief the bloom filter of a Database
+ *
+ * The filter is a blocked bloom filter: the hash of a key selects a
+ * block of 64 bytes (a cache line), and all bits of the key are set in
+ * this block. Therefore a lookup touches a single cache line.
+ *
+ * Every inserted key is added to the filter; erased keys are only
+ * counted, and the filter is rebuilt from the btree as soon as too many
+ * keys were erased, or if more keys were inserted than the filter was
+ * sized for.
+ *
+ * The filter is stored in a blob when the Database is closed; the
+ * address of the blob is stored in the Database header. When the
+ * Database is opened, the filter is loaded and the address is removed
+ * from the header, so that a filter which is outdated after a crash is
+ * never loaded. The blob stays allocated while the Database is open,
+ * and is overwritten when the Database is closed.
+ */
+
+#ifndef HAM_BLOOM_H__
+#define HAM_BLOOM_H__
+
+#include "internal_fwd_decl.h"
+
+#include <vector>
+
+#include <ham/hamsterdb.h>
+
+class BloomFilter
+{
+  public:
+    enum {
+        /** the size of a block, in bytes */
+        BLOCK_SIZE=64,
+
+        /** the maximum number of bits per key */
+        MAX_HASHES=16,
+
+        /** the minimum capacity of a new filter */
+        MIN_CAPACITY=1024,
+
+        /** the magic of the persistent filter */
+        MAGIC=0x424c4f4f
+    };
+
+    /**
+     * constructor; sizes the filter for @a capacity keys, but uses at
+     * most @a max_size bytes
+     */
+    BloomFilter(ham_u64_t capacity, double fp_rate, ham_size_t max_size);
+
+    /**
+     * returns true if the Database can use a bloom filter; record number
+     * Databases and remote Databases are not supported
+     */
+    static bool is_supported(Database *db);
+
+    /**
+     * returns true if the filter can be used for a lookup with the
+     * flags @a flags; the filter only answers exact matches with the
+     * default compare function
+     */
+    static bool can_lookup(Database *db, ham_u32_t flags);
+
+    /** creates (or rebuilds) the filter of a Database; fails while
+     * Transactions are active */
+    static ham_status_t enable(Database *db, double fp_rate,
+                ham_size_t max_size);
+
+    /** removes the filter of a Database, and frees the blob */
+    static ham_status_t disable(Database *db);
+
+    /** loads the filter after the Database was opened */
+    static ham_status_t open(Database *db);
+
+    /** stores and deletes the filter before the Database is closed */
+    static ham_status_t close(Database *db);
+
+    /** rebuilds the filter if required; this is skipped while
+     * Transactions are active */
+    static ham_status_t check(Database *db);
+
+    /** adds a key */
+    void insert(const ham_key_t *key);
+
+    /** returns false if the key was never inserted */
+    bool may_contain(const ham_key_t *key) const;
+
+    /** counts an erased key */
+    void erase() {
+        m_erased++;
+    }
+
+    /** marks the filter as outdated, i.e. after a range was erased */
+    void set_stale() {
+        m_erased=m_count;
+    }
+
+    /** returns true if the filter should be rebuilt */
+    bool needs_rebuild() const;
+
+    /** returns the size of the bit array, in bytes */
+    ham_size_t get_size() const {
+        return ((ham_size_t)m_bits.size());
+    }
+
+    /** returns the number of bits per key */
+    ham_u32_t get_hashes() const {
+        return (m_hashes);
+    }
+
+    /** returns the configured false positive rate */
+    double get_fp_rate() const {
+        return (m_fp_rate);
+    }
+
+    /** returns the configured maximum size */
+    ham_size_t get_max_size() const {
+        return (m_max_size);
+    }
+
+    /** returns the address of the blob, or 0 */
+    ham_offset_t get_blobid() const {
+        return (m_blobid);
+    }
+
+    /** sets the address of the blob */
+    void set_blobid(ham_offset_t blobid) {
+        m_blobid=blobid;
+    }
+
+  private:
+    /** the persistent header; all integers are stored in little endian */
+    struct header_t {
+        ham_u32_t magic;
+        ham_u32_t hashes;
+        ham_u32_t size;
+        ham_u32_t max_size;
+        ham_u64_t capacity;
+        ham_u64_t count;
+        ham_u64_t erased;
+        ham_u32_t fp_rate;   /* in units of 1/1000000000 */
+        ham_u32_t checksum;
+    };
+
+    /** private constructor for the deserialization */
+    BloomFilter() { }
+
+    /** calculates the size and the number of bits per key */
+    void resize(ham_u64_t capacity);
+
+    /** serializes the filter */
+    void serialize(std::vector<ham_u8_t> &buffer) const;
+
+    /** deserializes a filter; returns 0 if the data is invalid */
+    static BloomFilter *deserialize(const ham_u8_t *data, ham_size_t size);
+
+    /** returns true if a Transaction is neither committed nor aborted */
+    static bool has_active_txns(Environment *env);
+
+    /** fills the filter with the keys of the Database */
+    ham_status_t build(Database *db);
+
+    /** returns the hash of a key */
+    static ham_u64_t hash(const ham_key_t *key);
+
+    /** returns the checksum of the bit array */
+    ham_u32_t checksum() const;
+
+    /** the bit array */
+    std::vector<ham_u8_t> m_bits;
+
+    /** the number of bits per key */
+    ham_u32_t m_hashes;
+
+    /** the number of keys the filter was sized for */
+    ham_u64_t m_capacity;
+
+    /** the number of inserted keys */
+    ham_u64_t m_count;
+
+    /** the number of erased keys */
+    ham_u64_t m_erased;
+
+    /** the configured false positive rate */
+    double m_fp_rate;
+
+    /** the configured maximum size, in bytes */
+    ham_size_t m_max_size;
+
+    /** the address of the blob */
+    ham_offset_t m_blobid;
+};
+
+#endif /* HAM_BLOOM_H__ */
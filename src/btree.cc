@@ -28,14 +28,42 @@
 #include "page.h"
 #include "txn.h"
 #include "cursor.h"
+#include "keytype.h"
 
 
+/** compares a key against a btree key with @ref btree_compare_keys */
+struct GenericSlotCompare
+{
+    static int compare(Database *db, Page *page, ham_key_t *key,
+                    ham_u16_t slot) {
+        return (btree_compare_keys(db, page, key, slot));
+    }
+};
+
+/**
+ * compares a key of a typed Database against a btree key; typed keys
+ * are never extended, therefore the comparator is inlined and called
+ * directly
+ */
+template<class Compare>
+struct TypedSlotCompare
+{
+    static int compare(Database *db, Page *page, ham_key_t *key,
+                    ham_u16_t slot) {
+        btree_key_t *bte=btree_node_get_key(db,
+                    page_get_btree_node(page), slot);
+        return (Compare::compare(key->data, key->size,
+                    key_get_key(bte), key_get_size(bte)));
+    }
+};
+
 /**
  * perform a binary search for the *smallest* element, which is >= the
  * key
  */
-ham_status_t
-btree_get_slot(Database *db, Page *page,
+template<class SlotCompare>
+static ham_status_t
+__get_slot(Database *db, Page *page,
                 ham_key_t *key, ham_s32_t *slot, int *pcmp)
 {
     int cmp = -1;
@@ -49,7 +77,7 @@ btree_get_slot(Database *db, Page *page,
 
     /* only one element in this node?  */
     if (r==0) {
-        cmp=btree_compare_keys(db, page, key, 0);
+        cmp=SlotCompare::compare(db, page, key, 0);
         if (cmp < -1)
             return (ham_status_t)cmp;
         *slot=cmp<0 ? -1 : 0;
@@ -70,7 +98,7 @@ btree_get_slot(Database *db, Page *page,
         }
         
         /* compare it against the key */
-        cmp=btree_compare_keys(db, page, key, (ham_u16_t)i);
+        cmp=SlotCompare::compare(db, page, key, (ham_u16_t)i);
         if (cmp < -1)
             return (ham_status_t)cmp;
 
@@ -102,8 +130,110 @@ bail:
     return (0);
 }
 
+/** returns the record number of a btree key in host endian */
+static ham_u64_t
+__get_recno(Database *db, btree_node_t *node, ham_s32_t slot)
+{
+    ham_u64_t recno;
+    memcpy(&recno, key_get_key(btree_node_get_key(db, node, slot)),
+            sizeof(recno));
+    return (ham_db2h64(recno));
+}
+
+/**
+ * the slot search for record number Databases
+ *
+ * the record numbers in a node are unique and sorted, therefore the key
+ * in slot i is at least first+i and at most last-(count-1-i). This
+ * limits the binary search to a small range; if the node has no gaps
+ * (no record was erased) then the slot is computed without comparing
+ * any key
+ */
+static ham_status_t
+__get_recno_slot(Database *db, Page *page,
+                ham_key_t *key, ham_s32_t *slot, int *pcmp)
+{
+    int cmp;
+    btree_node_t *node=page_get_btree_node(page);
+    ham_s32_t count=btree_node_get_count(node);
+    ham_u64_t recno, first, last;
+    ham_s32_t l, r;
+
+    ham_assert(count>0, ("node is empty"));
+
+    memcpy(&recno, key->data, sizeof(recno));
+    recno=ham_db2h64(recno);
+    first=__get_recno(db, node, 0);
+    last=__get_recno(db, node, count-1);
+
+    if (recno<first) {
+        *slot=-1;
+        cmp=-1;
+    }
+    else if (recno>=last) {
+        *slot=count-1;
+        cmp=(recno==last) ? 0 : 1;
+    }
+    else {
+        /* search the right-most slot with a key <= recno */
+        r=(recno-first<(ham_u64_t)count-1)
+            ? (ham_s32_t)(recno-first)
+            : count-1;
+        l=(last-recno<(ham_u64_t)count-1)
+            ? (ham_s32_t)(count-1-(last-recno))
+            : 0;
+        while (l<r) {
+            ham_s32_t i=(l+r+1)/2;
+            if (__get_recno(db, node, i)<=recno)
+                l=i;
+            else
+                r=i-1;
+        }
+        *slot=l;
+        cmp=(__get_recno(db, node, l)==recno) ? 0 : 1;
+    }
+
+    if (pcmp)
+        *pcmp=cmp;
+    return (0);
+}
+
+ham_status_t
+btree_get_slot(Database *db, Page *page,
+                ham_key_t *key, ham_s32_t *slot, int *pcmp)
+{
+    if ((db->get_rt_flags()&HAM_RECORD_NUMBER)
+            && db->get_compare_func()==db_default_recno_compare
+            && key->size==sizeof(ham_u64_t))
+        return (__get_recno_slot(db, page, key, slot, pcmp));
+
+    if (!db->has_typed_compare())
+        return (__get_slot<GenericSlotCompare>(db, page, key, slot, pcmp));
+
+    db->set_error(0);
+
+    switch (db->get_key_type()) {
+      case HAM_TYPE_UINT32:
+        return (__get_slot<TypedSlotCompare<NumericKeyCompare<ham_u32_t> > >
+                    (db, page, key, slot, pcmp));
+      case HAM_TYPE_UINT64:
+        return (__get_slot<TypedSlotCompare<NumericKeyCompare<ham_u64_t> > >
+                    (db, page, key, slot, pcmp));
+      case HAM_TYPE_INT64:
+        return (__get_slot<TypedSlotCompare<NumericKeyCompare<ham_s64_t> > >
+                    (db, page, key, slot, pcmp));
+      case HAM_TYPE_REAL64:
+        return (__get_slot<TypedSlotCompare<NumericKeyCompare<double> > >
+                    (db, page, key, slot, pcmp));
+      default:
+        return (__get_slot<TypedSlotCompare<FixedBinaryKeyCompare> >
+                    (db, page, key, slot, pcmp));
+    }
+}
+
 ham_size_t
-btree_calc_maxkeys(ham_size_t pagesize, ham_u16_t keysize)
+btree_calc_maxkeys(ham_size_t pagesize, ham_u16_t keysize,
+                ham_u16_t inline_size)
 {
     ham_size_t p, k, max;
 
@@ -119,8 +249,8 @@ btree_calc_maxkeys(ham_size_t pagesize, ham_u16_t keysize)
     /* every page has a header where we can't store entries */
     p-=Page::sizeof_persistent_header;
 
-    /* compute the size of a key, k.  */
-    k=keysize+db_get_int_key_header_size();
+    /* compute the size of a key, k, including the inline record.  */
+    k=keysize+inline_size+db_get_int_key_header_size();
 
     /*
      * make sure that MAX is an even number, otherwise we can't calculate
@@ -143,7 +273,8 @@ BtreeBackend::calc_keycount_per_page(ham_size_t *maxkeys, ham_u16_t keysize)
     }
     else {
         /* prevent overflow - maxkeys only has 16 bit! */
-        *maxkeys=btree_calc_maxkeys(db->get_env()->get_pagesize(), keysize);
+        *maxkeys=btree_calc_maxkeys(db->get_env()->get_pagesize(), keysize,
+                get_inline_size());
         if (*maxkeys>MAX_KEYS_PER_NODE) {
             ham_trace(("keysize/pagesize ratio too high"));
             return (HAM_INV_KEYSIZE);
@@ -180,8 +311,13 @@ BtreeBackend::create(ham_u16_t keysize, ham_u32_t flags)
         return (HAM_ALREADY_INITIALIZED);
     }
 
+    /* the size of the inline records is stored in the persistent flags */
+    set_inline_size((ham_u16_t)(((flags&DB_INLINE_SIZE_MASK)
+                    >>DB_INLINE_SIZE_SHIFT)*DB_INLINE_SIZE_UNIT));
+
     /* prevent overflow - maxkeys only has 16 bit! */
-    maxkeys=btree_calc_maxkeys(db->get_env()->get_pagesize(), keysize);
+    maxkeys=btree_calc_maxkeys(db->get_env()->get_pagesize(), keysize,
+                get_inline_size());
     if (maxkeys>MAX_KEYS_PER_NODE) {
         ham_trace(("keysize/pagesize ratio too high"));
         return (HAM_INV_KEYSIZE);
@@ -212,13 +348,12 @@ BtreeBackend::create(ham_u16_t keysize, ham_u32_t flags)
 
     set_rootpage(root->get_self());
 
-    index_clear_reserved(indexdata);
     index_set_max_keys(indexdata, (ham_u16_t)maxkeys);
     index_set_keysize(indexdata, keysize);
     index_set_self(indexdata, root->get_self());
     index_set_flags(indexdata, flags);
     index_set_recno(indexdata, 0);
-    index_clear_reserved(indexdata);
+    index_set_bloom_filter(indexdata, 0);
 
     db->get_env()->set_dirty(true);
     set_active(true);
@@ -237,6 +372,7 @@ BtreeBackend::open(ham_u32_t flags)
 {
     ham_offset_t rootadd;
     ham_offset_t recno;
+    ham_offset_t bloom;
     ham_u16_t maxkeys;
     ham_u16_t keysize;
     Database *db=get_db();
@@ -252,12 +388,16 @@ BtreeBackend::open(ham_u32_t flags)
     rootadd = index_get_self(indexdata);
     flags = index_get_flags(indexdata);
     recno = index_get_recno(indexdata);
+    bloom = index_get_bloom_filter(indexdata);
 
     set_rootpage(rootadd);
     set_maxkeys(maxkeys);
     set_keysize(keysize);
     set_flags(flags);
+    set_inline_size((ham_u16_t)(((flags&DB_INLINE_SIZE_MASK)
+                    >>DB_INLINE_SIZE_SHIFT)*DB_INLINE_SIZE_UNIT));
     set_recno(recno);
+    set_bloom_filter(bloom);
 
     set_active(true);
 
@@ -285,7 +425,7 @@ BtreeBackend::flush()
     index_set_self(indexdata, get_rootpage());
     index_set_flags(indexdata, get_flags());
     index_set_recno(indexdata, get_recno());
-    index_clear_reserved(indexdata);
+    index_set_bloom_filter(indexdata, get_bloom_filter());
 
     db->get_env()->set_dirty(true);
     set_dirty(false);
@@ -898,6 +1038,28 @@ btree_read_record(Database *db, Transaction *txn, ham_record_t *record,
         blobsize=0;
         noblob=HAM_TRUE;
     }
+    else if (record->_intflags&KEY_BLOB_SIZE_INLINE) {
+        /* the record is stored behind the key; the record ID is the size */
+        btree_key_t *key=(btree_key_t *)((ham_u8_t *)ridptr
+                        -OFFSETOF(btree_key_t, _ptr));
+        ham_u8_t *data=key_get_inline_record(db, key);
+        blobsize=(ham_size_t)record->_rid;
+        if (flags&HAM_PARTIAL) {
+            if (record->partial_offset>blobsize) {
+                ham_trace(("partial offset is greater than the total "
+                            "record size"));
+                return (HAM_INV_PARAMETER);
+            }
+            data+=record->partial_offset;
+            if (record->partial_offset+record->partial_size>blobsize)
+                blobsize=blobsize-record->partial_offset;
+            else
+                blobsize=record->partial_size;
+            flags&=~HAM_PARTIAL;
+        }
+        ridptr=(ham_u64_t *)data;
+        noblob=HAM_TRUE;
+    }
     else {
         /* set to a dummy value, so the third if-branch is executed */
         blobsize=0xffffffff;
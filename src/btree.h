@@ -73,6 +73,10 @@ class BtreeBackend : public Backend
     virtual ham_status_t erase(Transaction *txn, ham_key_t *key, 
                     ham_u32_t flags);
 
+    /** erase a range of keys in the index */
+    virtual ham_status_t erase_range(Transaction *txn, ham_key_t *begin,
+                    ham_key_t *end, ham_u32_t flags);
+
     /** iterate the whole tree and enumerate every item */
     virtual ham_status_t enumerate(ham_enumerate_cb_t cb, void *context);
 
@@ -306,12 +310,21 @@ extern ham_s32_t
 btree_node_search_by_key(Database *db, Page *page, ham_key_t *key,
                 ham_u32_t flags);
 
+/**
+ * get the size of an entry of a btree node: the key header, the key and
+ * the space for an inline record (see @ref HAM_PARAM_RECORD_INLINE_SIZE);
+ * the inline space is also reserved in internal nodes
+ */
+#define btree_get_slot_size(db)                                         \
+    (db_get_int_key_header_size()+db_get_keysize(db)                    \
+            +db_get_inline_size(db))
+
 /**
  * get entry @a i of a btree node
  */
 #define btree_node_get_key(db, node, i)                                 \
     ((btree_key_t *)&((const char *)(node)->_entries)                   \
-            [(db_get_keysize(db)+db_get_int_key_header_size())*(i)])
+            [btree_get_slot_size(db)*(i)])
 
 /**
  * get offset of entry @a i - add this to page->get_self() for
@@ -321,12 +334,15 @@ btree_node_search_by_key(Database *db, Page *page, ham_key_t *key,
      ((page)->get_self()+Page::sizeof_persistent_header+                \
      OFFSETOF(btree_node_t, _entries)                                   \
      /* ^^^ sizeof(btree_key_t) WITHOUT THE -1 !!! */ +                 \
-     (db_get_int_key_header_size()+db_get_keysize((page)->get_db()))*(i))
+     btree_get_slot_size((page)->get_db())*(i))
 
 /**
  * get the slot of an element in the page
  * also returns the comparison value in cmp; if *cmp == 0 then the keys are
  * equal
+ *
+ * in record number Databases the slot is computed from the record
+ * numbers of the first and the last key of the page
  */
 extern ham_status_t
 btree_get_slot(Database *db, Page *page,
@@ -336,7 +352,8 @@ btree_get_slot(Database *db, Page *page,
  * calculate the "maxkeys" values
  */
 extern ham_size_t
-btree_calc_maxkeys(ham_size_t pagesize, ham_u16_t keysize);
+btree_calc_maxkeys(ham_size_t pagesize, ham_u16_t keysize,
+                ham_u16_t inline_size);
 
 /**
  * close all cursors in this Database
@@ -400,7 +417,8 @@ btree_read_key(Database *db, Transaction *txn, btree_key_t *source,
  *
  * @param rid same as record->_rid, if key is not TINY/SMALL. Otherwise,
  * and if HAM_DIRECT_ACCESS is set, we use the rid-pointer to the
- * original record ID
+ * original record ID. If the record is INLINE, the rid-pointer points
+ * to the original record ID of the btree key.
  *
  * flags: either 0 or HAM_DIRECT_ACCESS
  */
@@ -505,6 +505,30 @@ btree_cursor_clone(btree_cursor_t *src, btree_cursor_t *dest,
     return (0);
 }
 
+ham_status_t
+btree_cursor_get_entry(btree_cursor_t *c, Page **page, btree_key_t **entry)
+{
+    ham_status_t st;
+    Database *db=btree_cursor_get_db(c);
+
+    /*
+     * uncoupled cursor: couple it
+     */
+    if (btree_cursor_is_uncoupled(c)) {
+        st=btree_cursor_couple(c);
+        if (st)
+            return (st);
+    }
+    else if (!btree_cursor_is_coupled(c))
+        return (HAM_CURSOR_IS_NIL);
+
+    Page *p=btree_cursor_get_coupled_page(c);
+    *page=p;
+    *entry=btree_node_get_key(db, page_get_btree_node(p),
+                btree_cursor_get_coupled_index(c));
+    return (0);
+}
+
 void
 btree_cursor_close(btree_cursor_t *c)
 {
@@ -993,6 +1017,10 @@ btree_cursor_get_record_size(btree_cursor_t *c, ham_offset_t *size)
         /* record size is 0 */
         *size=0;
     }
+    else if (keyflags&KEY_BLOB_SIZE_INLINE) {
+        /* the record is stored in the key; the record ID is the size */
+        *size=rid;
+    }
     else {
         st=blob_get_datasize(db, rid, size);
         if (st)
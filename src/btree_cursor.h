@@ -272,6 +272,13 @@ btree_cursor_get_duplicate_table(btree_cursor_t *c, dupe_table_t **ptable,
 extern ham_status_t
 btree_cursor_get_record_size(btree_cursor_t *c, ham_offset_t *size);
 
+/**
+ * retrieves the page and the btree key of the current item; an
+ * uncoupled cursor is coupled
+ */
+extern ham_status_t
+btree_cursor_get_entry(btree_cursor_t *c, Page **page, btree_key_t **entry);
+
 /**
  * Closes an existing cursor
  */
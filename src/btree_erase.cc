@@ -18,6 +18,8 @@
 
 #include <string.h>
 
+#include <vector>
+
 #include "blob.h"
 #include "btree.h"
 #include "cache.h"
@@ -34,6 +36,7 @@
 #include "txn.h"
 #include "util.h"
 #include "cursor.h"
+#include "freelist.h"
 
 
 /*
@@ -575,7 +578,7 @@ my_merge_pages(Page **newpage_ref, Page *page, Page *sibpage,
 {
     ham_status_t st;
     ham_s32_t slot;
-    ham_size_t c, keysize;
+    ham_size_t c, slotsize;
     Database *db=page->get_db();
     Page *ancpage;
     btree_node_t *node, *sibnode, *ancnode;
@@ -583,7 +586,7 @@ my_merge_pages(Page **newpage_ref, Page *page, Page *sibpage,
 
     ham_assert(db, (0));
 
-    keysize=db_get_keysize(db);
+    slotsize=btree_get_slot_size(db);
     node   =page_get_btree_node(page);
     sibnode=page_get_btree_node(sibpage);
 
@@ -652,9 +655,8 @@ my_merge_pages(Page **newpage_ref, Page *page, Page *sibpage,
     /*
      * shift items from the sibling to this page
      */
-    hints->cost += btree_stats_memmove_cost((db_get_int_key_header_size()+
-                        keysize)*c);
-    memcpy(bte_lhs, bte_rhs, (db_get_int_key_header_size()+keysize)*c);
+    hints->cost += btree_stats_memmove_cost(slotsize*c);
+    memcpy(bte_lhs, bte_rhs, slotsize*c);
             
     /*
      * as sibnode is merged into node, we will also need to ensure that our
@@ -741,7 +743,7 @@ my_shift_pages(Page **newpage_ref, Page *page, Page *sibpage, ham_offset_t ancho
     ham_bool_t intern;
     ham_size_t s;
     ham_size_t c;
-    ham_size_t keysize;
+    ham_size_t slotsize;
     Database *db=page->get_db();
     Page *ancpage;
     btree_node_t *node, *sibnode, *ancnode;
@@ -749,7 +751,7 @@ my_shift_pages(Page **newpage_ref, Page *page, Page *sibpage, ham_offset_t ancho
 
     node   =page_get_btree_node(page);
     sibnode=page_get_btree_node(sibpage);
-    keysize=db_get_keysize(db);
+    slotsize=btree_get_slot_size(db);
     intern =!btree_node_is_leaf(node);
     st=db_fetch_page(&ancpage, db, anchor, 0);
     if (!ancpage)
@@ -827,11 +829,11 @@ my_shift_pages(Page **newpage_ref, Page *page, Page *sibpage, ham_offset_t ancho
             /*
              * shift the remainder of sibling to the left
              */
-            hints->cost += btree_stats_memmove_cost((db_get_int_key_header_size()
-                        + keysize) * (btree_node_get_count(sibnode)-1));
+            hints->cost += btree_stats_memmove_cost(
+                    slotsize * (btree_node_get_count(sibnode)-1));
             bte_lhs=btree_node_get_key(db, sibnode, 0);
             bte_rhs=btree_node_get_key(db, sibnode, 1);
-            memmove(bte_lhs, bte_rhs, (db_get_int_key_header_size()+keysize)
+            memmove(bte_lhs, bte_rhs, slotsize
                     * (btree_node_get_count(sibnode)-1));
 
             /*
@@ -872,18 +874,18 @@ my_shift_pages(Page **newpage_ref, Page *page, Page *sibpage, ham_offset_t ancho
          * shift items from the sibling to this page, then
          * delete the shifted items
          */
-        hints->cost += btree_stats_memmove_cost((db_get_int_key_header_size()
-                + keysize)*(btree_node_get_count(sibnode) + c));
+        hints->cost += btree_stats_memmove_cost(
+                slotsize*(btree_node_get_count(sibnode) + c));
 
         bte_lhs=btree_node_get_key(db, node,
                 btree_node_get_count(node));
         bte_rhs=btree_node_get_key(db, sibnode, 0);
 
-        memmove(bte_lhs, bte_rhs, (db_get_int_key_header_size()+keysize)*c);
+        memmove(bte_lhs, bte_rhs, slotsize*c);
 
         bte_lhs=btree_node_get_key(db, sibnode, 0);
         bte_rhs=btree_node_get_key(db, sibnode, c);
-        memmove(bte_lhs, bte_rhs, (db_get_int_key_header_size()+keysize)*
+        memmove(bte_lhs, bte_rhs, slotsize*
                 (btree_node_get_count(sibnode)-c));
 
         /*
@@ -916,11 +918,11 @@ my_shift_pages(Page **newpage_ref, Page *page, Page *sibpage, ham_offset_t ancho
             /*
              * shift once more
              */
-            hints->cost += btree_stats_memmove_cost((db_get_int_key_header_size()
-                    + keysize)*(btree_node_get_count(sibnode)-1));
+            hints->cost += btree_stats_memmove_cost(
+                    slotsize*(btree_node_get_count(sibnode)-1));
             bte_lhs=btree_node_get_key(db, sibnode, 0);
             bte_rhs=btree_node_get_key(db, sibnode, 1);
-            memmove(bte_lhs, bte_rhs, (db_get_int_key_header_size()+keysize)*
+            memmove(bte_lhs, bte_rhs, slotsize*
                     (btree_node_get_count(sibnode)-1));
         }
         else
@@ -986,11 +988,11 @@ my_shift_pages(Page **newpage_ref, Page *page, Page *sibpage, ham_offset_t ancho
             /*
              * shift entire sibling by 1 to the right
              */
-            hints->cost += btree_stats_memmove_cost((db_get_int_key_header_size()
-                    + keysize) * (btree_node_get_count(sibnode)));
+            hints->cost += btree_stats_memmove_cost(
+                    slotsize * (btree_node_get_count(sibnode)));
             bte_lhs=btree_node_get_key(db, sibnode, 1);
             bte_rhs=btree_node_get_key(db, sibnode, 0);
-            memmove(bte_lhs, bte_rhs, (db_get_int_key_header_size()+keysize)
+            memmove(bte_lhs, bte_rhs, slotsize
                     * (btree_node_get_count(sibnode)));
 
             /*
@@ -1047,11 +1049,11 @@ my_shift_pages(Page **newpage_ref, Page *page, Page *sibpage, ham_offset_t ancho
             /*
              * shift entire sibling by 1 to the right
              */
-            hints->cost += btree_stats_memmove_cost((db_get_int_key_header_size()
-                    + keysize) * (btree_node_get_count(sibnode)));
+            hints->cost += btree_stats_memmove_cost(
+                    slotsize * (btree_node_get_count(sibnode)));
             bte_lhs=btree_node_get_key(db, sibnode, 1);
             bte_rhs=btree_node_get_key(db, sibnode, 0);
-            memmove(bte_lhs, bte_rhs, (db_get_int_key_header_size()+keysize)
+            memmove(bte_lhs, bte_rhs, slotsize
                     * (btree_node_get_count(sibnode)));
 
             bte_lhs=btree_node_get_key(db, sibnode, 0);
@@ -1078,16 +1080,16 @@ my_shift_pages(Page **newpage_ref, Page *page, Page *sibpage, ham_offset_t ancho
          * shift items from this page to the sibling, then delete the
          * items from this page
          */
-        hints->cost += btree_stats_memmove_cost((db_get_int_key_header_size()
-                + keysize)*(btree_node_get_count(sibnode)+c));
+        hints->cost += btree_stats_memmove_cost(
+                slotsize*(btree_node_get_count(sibnode)+c));
         bte_lhs=btree_node_get_key(db, sibnode, c);
         bte_rhs=btree_node_get_key(db, sibnode, 0);
-        memmove(bte_lhs, bte_rhs, (db_get_int_key_header_size()+keysize)*
+        memmove(bte_lhs, bte_rhs, slotsize*
                 btree_node_get_count(sibnode));
 
         bte_lhs=btree_node_get_key(db, sibnode, 0);
         bte_rhs=btree_node_get_key(db, node, s+1);
-        memmove(bte_lhs, bte_rhs, (db_get_int_key_header_size()+keysize)*c);
+        memmove(bte_lhs, bte_rhs, slotsize*c);
 
         ham_assert(btree_node_get_count(node)-c <= 0xFFFF, (0));
         ham_assert(btree_node_get_count(sibnode)+c <= 0xFFFF, (0));
@@ -1165,7 +1167,7 @@ cleanup:
 static ham_status_t
 my_copy_key(Database *db, Transaction *txn, btree_key_t *lhs, btree_key_t *rhs)
 {
-    memcpy(lhs, rhs, db_get_int_key_header_size()+db_get_keysize(db));
+    memcpy(lhs, rhs, btree_get_slot_size(db));
 
     /*
      * if the key is extended, we copy the extended blob; otherwise, we'd
@@ -1237,6 +1239,7 @@ my_replace_key(Page *page, ham_s32_t slot, btree_key_t *rhs,
                 ~(KEY_BLOB_SIZE_TINY
                     |KEY_BLOB_SIZE_SMALL
                     |KEY_BLOB_SIZE_EMPTY
+                    |KEY_BLOB_SIZE_INLINE
                     |KEY_HAS_DUPLICATES));
 
     /*
@@ -1276,13 +1279,13 @@ my_remove_entry(Page *page, ham_s32_t slot,
     ham_status_t st;
     btree_key_t *bte_lhs, *bte_rhs, *bte;
     btree_node_t *node;
-    ham_size_t keysize;
+    ham_size_t slotsize;
     Database *db;
     btree_cursor_t *btc=0;
 
     db=page->get_db();
     node=page_get_btree_node(page);
-    keysize=db_get_keysize(db);
+    slotsize=btree_get_slot_size(db);
     bte=btree_node_get_key(db, node, slot);
 
     if (hints)
@@ -1398,6 +1401,14 @@ free_all:
         }
     }
 
+    /*
+     * btree_cursor_points_to() couples uncoupled cursors; uncouple them
+     * again, otherwise they would point to the wrong slot after the
+     * keys were shifted
+     */
+    if ((st=btree_uncouple_all_cursors(page, 0)))
+        return st;
+
     /*
      * get rid of the extended key (if there is one)
      *
@@ -1418,11 +1429,11 @@ free_all:
      */
     if (slot != btree_node_get_count(node)-1) {
         if (hints)
-            hints->cost += btree_stats_memmove_cost((db_get_int_key_header_size()
-                + keysize)*(btree_node_get_count(node)-slot-1));
+            hints->cost += btree_stats_memmove_cost(
+                    slotsize*(btree_node_get_count(node)-slot-1));
         bte_lhs=btree_node_get_key(db, node, slot);
         bte_rhs=btree_node_get_key(db, node, slot+1);
-        memmove(bte_lhs, bte_rhs, ((db_get_int_key_header_size()+keysize))*
+        memmove(bte_lhs, bte_rhs, slotsize*
                 (btree_node_get_count(node)-slot-1));
     }
 
@@ -1471,3 +1482,614 @@ btree_cursor_erase_fasttrack(BtreeBackend *be, Transaction *txn,
                 btree_cursor_get_coupled_index(cursor),
                 &scratchpad, 0));
 }
+
+/*
+ * the state of a range erase
+ */
+typedef struct erase_range_t
+{
+    /* the backend pointer */
+    BtreeBackend *be;
+
+    /* the current transaction */
+    Transaction *txn;
+
+    /* the range [begin, end); NULL pointers are unbounded */
+    ham_key_t *begin;
+    ham_key_t *end;
+
+    /*
+     * the removed nodes of each level form a single run in the linked
+     * list of this level; for each level, we store the left neighbour of
+     * the first removed node and the right neighbour of the last
+     * removed node
+     */
+    std::vector<bool> removed;
+    std::vector<ham_offset_t> left;
+    std::vector<ham_offset_t> right;
+
+} erase_range_t;
+
+/*
+ * get rid of the record (for leaf nodes) and the extended key of an entry
+ */
+static ham_status_t
+my_range_free_entry(erase_range_t *er, btree_key_t *bte, bool leaf)
+{
+    ham_status_t st;
+    Database *db=er->be->get_db();
+
+    if (leaf) {
+        st=key_erase_record(db, er->txn, bte, 0, HAM_ERASE_ALL_DUPLICATES);
+        if (st)
+            return (st);
+    }
+
+    if (key_get_flags(bte)&KEY_IS_EXTENDED) {
+        ham_offset_t blobid=key_get_extended_rid(db, bte);
+        ham_assert(blobid, (""));
+
+        st=extkey_remove(db, blobid);
+        if (st)
+            return (st);
+    }
+
+    return (0);
+}
+
+/*
+ * move a node which is no longer part of the tree to the freelist
+ */
+static ham_status_t
+my_range_release_page(Database *db, Page *page)
+{
+    ham_status_t st;
+    Environment *env=db->get_env();
+
+    btree_stats_page_is_nuked(db, page, HAM_FALSE);
+
+    /*
+     * if recovery is enabled then the page is part of the changeset and
+     * must not be deleted before the changeset is flushed; it's enough to
+     * move it to the freelist
+     */
+    if (!(env->get_flags()&HAM_ENABLE_RECOVERY))
+        return (db_free_page(page, DB_MOVE_TO_FREELIST));
+
+    st=page->uncouple_all_cursors();
+    if (st)
+        return (st);
+    return (freel_mark_free(env, db, page->get_self(),
+                env->get_pagesize(), HAM_TRUE));
+}
+
+/*
+ * free a removed node and remember its neighbours
+ */
+static ham_status_t
+my_range_free_page(erase_range_t *er, Page *page, ham_size_t depth)
+{
+    btree_node_t *node=page_get_btree_node(page);
+
+    if (depth>=er->removed.size()) {
+        er->removed.resize(depth+1, false);
+        er->left.resize(depth+1, 0);
+        er->right.resize(depth+1, 0);
+    }
+    if (!er->removed[depth]) {
+        er->removed[depth]=true;
+        er->left[depth]=btree_node_get_left(node);
+    }
+    er->right[depth]=btree_node_get_right(node);
+
+    return (my_range_release_page(er->be->get_db(), page));
+}
+
+/*
+ * free a subtree which is fully covered by the range
+ */
+static ham_status_t
+my_range_free_subtree(erase_range_t *er, ham_offset_t address,
+        ham_size_t depth)
+{
+    ham_status_t st;
+    Page *page;
+    Database *db=er->be->get_db();
+
+    st=db_fetch_page(&page, db, address, 0);
+    if (st)
+        return (st);
+
+    btree_node_t *node=page_get_btree_node(page);
+    bool leaf=btree_node_is_leaf(node) ? true : false;
+
+    if (!leaf) {
+        st=my_range_free_subtree(er, btree_node_get_ptr_left(node), depth+1);
+        if (st)
+            return (st);
+    }
+
+    for (ham_size_t i=0; i<btree_node_get_count(node); i++) {
+        btree_key_t *bte=btree_node_get_key(db, node, i);
+        if (!leaf) {
+            st=my_range_free_subtree(er, key_get_ptr(bte), depth+1);
+            if (st)
+                return (st);
+        }
+        st=my_range_free_entry(er, bte, leaf);
+        if (st)
+            return (st);
+    }
+
+    return (my_range_free_page(er, page, depth));
+}
+
+/*
+ * returns the index of the first key in a node which is >= @a key, and
+ * whether this key is equal to @a key
+ */
+static ham_status_t
+my_range_lower_bound(Database *db, Page *page, ham_key_t *key,
+        ham_s32_t *index, bool *equal)
+{
+    ham_status_t st;
+    ham_s32_t slot;
+    int cmp;
+
+    *index=0;
+    *equal=false;
+    if (!btree_node_get_count(page_get_btree_node(page)))
+        return (0);
+
+    st=btree_get_slot(db, page, key, &slot, &cmp);
+    if (st)
+        return (st);
+
+    if (slot>=0 && cmp==0) {
+        *index=slot;
+        *equal=true;
+    }
+    else
+        *index=slot+1;
+    return (0);
+}
+
+/*
+ * erase the range from a node which overlaps with the range, but is not
+ * fully covered by it; nodes which become empty are freed
+ *
+ * @a lower_in and @a upper_in are true if the lower (upper) bound of
+ * the node is inside of the range
+ */
+static ham_status_t
+my_erase_range_recursive(erase_range_t *er, Page *page, ham_size_t depth,
+        bool lower_in, bool upper_in, bool *is_empty)
+{
+    ham_status_t st;
+    Database *db=er->be->get_db();
+    btree_node_t *node=page_get_btree_node(page);
+    ham_size_t entrysize=btree_get_slot_size(db);
+    ham_s32_t count=btree_node_get_count(node);
+    ham_s32_t ib=0, ie=count;
+    bool eqb=false, eqe=false;
+
+    *is_empty=false;
+
+    /* ib is the first key >= begin, ie is the first key >= end */
+    if (er->begin && !lower_in) {
+        st=my_range_lower_bound(db, page, er->begin, &ib, &eqb);
+        if (st)
+            return (st);
+    }
+    if (er->end && !upper_in) {
+        st=my_range_lower_bound(db, page, er->end, &ie, &eqe);
+        if (st)
+            return (st);
+    }
+
+    st=btree_uncouple_all_cursors(page, 0);
+    if (st)
+        return (st);
+
+    /* leaf node: erase the keys [ib, ie) */
+    if (btree_node_is_leaf(node)) {
+        if (ib>=ie)
+            return (0);
+        for (ham_s32_t i=ib; i<ie; i++) {
+            st=my_range_free_entry(er, btree_node_get_key(db, node, i), true);
+            if (st)
+                return (st);
+        }
+        if (ie<count)
+            memmove(btree_node_get_key(db, node, ib),
+                    btree_node_get_key(db, node, ie), entrysize*(count-ie));
+        btree_node_set_count(node, count-(ie-ib));
+        page->set_dirty(true);
+        *is_empty=(count-(ie-ib)==0);
+        return (0);
+    }
+
+    /*
+     * internal node: child c (-1 is ptr_left) covers the keys
+     * [key[c], key[c+1]); a child is fully covered if its lower bound is
+     * >= begin and its upper bound is <= end. Fully covered children are
+     * freed, partially covered children are processed recursively
+     */
+    std::vector<bool> removed(count+1, false);
+    for (ham_s32_t c=-1; c<count; c++) {
+        bool lo_lt_end =c<0 || c<ie;
+        bool hi_gt_begin=c+1>=count || c+1>=ib+(eqb ? 1 : 0);
+        if (!lo_lt_end || !hi_gt_begin)
+            continue;
+
+        bool lo_ge_begin=c<0 ? lower_in : c>=ib;
+        bool hi_le_end=c+1>=count ? upper_in : c+1<ie+(eqe ? 1 : 0);
+        ham_offset_t child=c<0
+                ? btree_node_get_ptr_left(node)
+                : key_get_ptr(btree_node_get_key(db, node, c));
+
+        if (lo_ge_begin && hi_le_end) {
+            st=my_range_free_subtree(er, child, depth+1);
+            if (st)
+                return (st);
+            removed[c+1]=true;
+        }
+        else {
+            Page *childpage;
+            bool child_is_empty;
+            st=db_fetch_page(&childpage, db, child, 0);
+            if (st)
+                return (st);
+            st=my_erase_range_recursive(er, childpage, depth+1,
+                        lo_ge_begin, hi_le_end, &child_is_empty);
+            if (st)
+                return (st);
+            if (child_is_empty) {
+                st=my_range_free_page(er, childpage, depth+1);
+                if (st)
+                    return (st);
+                removed[c+1]=true;
+            }
+        }
+    }
+
+    /*
+     * compact the node; the first remaining child becomes the new
+     * ptr_left, and its key is dropped
+     */
+    ham_s32_t newcount=0;
+    bool have_first=false;
+    for (ham_s32_t c=-1; c<count; c++) {
+        btree_key_t *bte=c<0 ? 0 : btree_node_get_key(db, node, c);
+        if (!removed[c+1] && !have_first) {
+            have_first=true;
+            if (!bte)
+                continue;
+            btree_node_set_ptr_left(node, key_get_ptr(bte));
+        }
+        else if (!removed[c+1]) {
+            if (newcount!=c)
+                memmove(btree_node_get_key(db, node, newcount), bte,
+                        entrysize);
+            newcount++;
+            continue;
+        }
+        if (bte) {
+            st=my_range_free_entry(er, bte, false);
+            if (st)
+                return (st);
+        }
+    }
+
+    btree_node_set_count(node, newcount);
+    if (!have_first) {
+        /* all children were removed */
+        btree_node_set_ptr_left(node, 0);
+        *is_empty=true;
+    }
+    page->set_dirty(true);
+    return (0);
+}
+
+/*
+ * remove a node from the linked list of its level
+ */
+static ham_status_t
+my_range_unlink(Database *db, ham_offset_t left, ham_offset_t right)
+{
+    ham_status_t st;
+    Page *page;
+
+    if (left) {
+        st=db_fetch_page(&page, db, left, 0);
+        if (st)
+            return (st);
+        btree_node_set_right(page_get_btree_node(page), right);
+        page->set_dirty(true);
+    }
+    if (right) {
+        st=db_fetch_page(&page, db, right, 0);
+        if (st)
+            return (st);
+        btree_node_set_left(page_get_btree_node(page), left);
+        page->set_dirty(true);
+    }
+    return (0);
+}
+
+/*
+ * an internal node was left with a single child (its ptr_left); merge it
+ * with a sibling, or borrow a child from the sibling if the sibling is
+ * full. @a slot is the index of the node in its parent (-1 is ptr_left).
+ * The parent always has at least one key.
+ */
+static ham_status_t
+my_range_fix_node(erase_range_t *er, Page *parent, ham_s32_t slot,
+        Page *page)
+{
+    ham_status_t st;
+    Page *sibpage;
+    Database *db=er->be->get_db();
+    ham_size_t entrysize=btree_get_slot_size(db);
+    ham_size_t maxkeys=er->be->get_maxkeys();
+    btree_node_t *pnode=page_get_btree_node(parent);
+    btree_node_t *node=page_get_btree_node(page);
+    btree_node_t *sibnode;
+    btree_key_t *sep, *bte;
+
+    ham_assert(btree_node_get_count(pnode)>0, (""));
+    ham_assert(btree_node_get_count(node)==0, (""));
+
+    st=btree_uncouple_all_cursors(parent, 0);
+    if (!st)
+        st=btree_uncouple_all_cursors(page, 0);
+    if (st)
+        return (st);
+
+    if (slot>=0) {
+        /* the left sibling is in the same parent */
+        sep=btree_node_get_key(db, pnode, slot);
+        st=db_fetch_page(&sibpage, db, slot==0
+                    ? btree_node_get_ptr_left(pnode)
+                    : key_get_ptr(btree_node_get_key(db, pnode, slot-1)), 0);
+        if (st)
+            return (st);
+        sibnode=page_get_btree_node(sibpage);
+        ham_size_t sibcount=btree_node_get_count(sibnode);
+        st=btree_uncouple_all_cursors(sibpage, 0);
+        if (st)
+            return (st);
+
+        if (sibcount<maxkeys) {
+            /* append the separator and the child to the sibling */
+            bte=btree_node_get_key(db, sibnode, sibcount);
+            memcpy(bte, sep, entrysize);
+            key_set_ptr(bte, btree_node_get_ptr_left(node));
+            btree_node_set_count(sibnode, sibcount+1);
+
+            ham_size_t pcount=btree_node_get_count(pnode);
+            if ((ham_size_t)slot<pcount-1)
+                memmove(sep, btree_node_get_key(db, pnode, slot+1),
+                        entrysize*(pcount-slot-1));
+            btree_node_set_count(pnode, pcount-1);
+
+            st=my_range_unlink(db, btree_node_get_left(node),
+                        btree_node_get_right(node));
+            if (st)
+                return (st);
+            st=my_range_release_page(db, page);
+            if (st)
+                return (st);
+        }
+        else {
+            /* move the last child of the sibling to this node */
+            btree_key_t *last=btree_node_get_key(db, sibnode, sibcount-1);
+            bte=btree_node_get_key(db, node, 0);
+            memcpy(bte, sep, entrysize);
+            key_set_ptr(bte, btree_node_get_ptr_left(node));
+            btree_node_set_ptr_left(node, key_get_ptr(last));
+            btree_node_set_count(node, 1);
+            memcpy(sep, last, entrysize);
+            key_set_ptr(sep, page->get_self());
+            btree_node_set_count(sibnode, sibcount-1);
+            page->set_dirty(true);
+        }
+    }
+    else {
+        /* the node is the ptr_left of its parent; use the right sibling */
+        sep=btree_node_get_key(db, pnode, 0);
+        st=db_fetch_page(&sibpage, db, key_get_ptr(sep), 0);
+        if (st)
+            return (st);
+        sibnode=page_get_btree_node(sibpage);
+        ham_size_t sibcount=btree_node_get_count(sibnode);
+        st=btree_uncouple_all_cursors(sibpage, 0);
+        if (st)
+            return (st);
+
+        if (sibcount<maxkeys) {
+            /* prepend the child and the separator to the sibling */
+            memmove(btree_node_get_key(db, sibnode, 1),
+                    btree_node_get_key(db, sibnode, 0), entrysize*sibcount);
+            bte=btree_node_get_key(db, sibnode, 0);
+            memcpy(bte, sep, entrysize);
+            key_set_ptr(bte, btree_node_get_ptr_left(sibnode));
+            btree_node_set_ptr_left(sibnode, btree_node_get_ptr_left(node));
+            btree_node_set_count(sibnode, sibcount+1);
+
+            ham_size_t pcount=btree_node_get_count(pnode);
+            btree_node_set_ptr_left(pnode, sibpage->get_self());
+            memmove(sep, btree_node_get_key(db, pnode, 1),
+                    entrysize*(pcount-1));
+            btree_node_set_count(pnode, pcount-1);
+
+            st=my_range_unlink(db, btree_node_get_left(node),
+                        btree_node_get_right(node));
+            if (st)
+                return (st);
+            st=my_range_release_page(db, page);
+            if (st)
+                return (st);
+        }
+        else {
+            /* move the first child of the sibling to this node */
+            btree_key_t *first=btree_node_get_key(db, sibnode, 0);
+            bte=btree_node_get_key(db, node, 0);
+            memcpy(bte, sep, entrysize);
+            key_set_ptr(bte, btree_node_get_ptr_left(sibnode));
+            btree_node_set_count(node, 1);
+            btree_node_set_ptr_left(sibnode, key_get_ptr(first));
+            memcpy(sep, first, entrysize);
+            key_set_ptr(sep, sibpage->get_self());
+            memmove(first, btree_node_get_key(db, sibnode, 1),
+                    entrysize*(sibcount-1));
+            btree_node_set_count(sibnode, sibcount-1);
+            page->set_dirty(true);
+        }
+    }
+
+    sibpage->set_dirty(true);
+    parent->set_dirty(true);
+    return (0);
+}
+
+/*
+ * after the subtrees were removed, the nodes on the boundary path of
+ * @a key can be left with a single child; descend along the path and
+ * repair them, and collapse the root as long as it has a single child
+ */
+static ham_status_t
+my_range_repair_path(erase_range_t *er, ham_key_t *key)
+{
+    ham_status_t st;
+    Page *page, *child;
+    BtreeBackend *be=er->be;
+    Database *db=be->get_db();
+
+    for (;;) {
+        st=db_fetch_page(&page, db, be->get_rootpage(), 0);
+        if (st)
+            return (st);
+        btree_node_t *node=page_get_btree_node(page);
+
+        if (!btree_node_is_leaf(node) && btree_node_get_count(node)==0) {
+            erase_scratchpad_t scratchpad;
+            memset(&scratchpad, 0, sizeof(scratchpad));
+            scratchpad.be=be;
+            scratchpad.txn=er->txn;
+
+            st=db_fetch_page(&child, db, btree_node_get_ptr_left(node), 0);
+            if (st)
+                return (st);
+            st=btree_uncouple_all_cursors(page, 0);
+            if (st)
+                return (st);
+            st=__collapse_root(child, &scratchpad);
+            if (st)
+                return (st);
+            st=my_range_release_page(db, page);
+            if (st)
+                return (st);
+            continue;
+        }
+
+        if (!key)
+            return (0);
+
+        bool repaired=false;
+        while (!btree_node_is_leaf(node)) {
+            ham_s32_t slot;
+            int cmp;
+            st=btree_get_slot(db, page, key, &slot, &cmp);
+            if (st)
+                return (st);
+            st=db_fetch_page(&child, db, slot<0
+                        ? btree_node_get_ptr_left(node)
+                        : key_get_ptr(btree_node_get_key(db, node, slot)), 0);
+            if (st)
+                return (st);
+            btree_node_t *childnode=page_get_btree_node(child);
+            if (!btree_node_is_leaf(childnode)
+                    && btree_node_get_count(childnode)==0) {
+                st=my_range_fix_node(er, page, slot, child);
+                if (st)
+                    return (st);
+                repaired=true;
+                break;
+            }
+            page=child;
+            node=childnode;
+        }
+
+        if (!repaired)
+            return (0);
+    }
+}
+
+ham_status_t
+BtreeBackend::erase_range(Transaction *txn, ham_key_t *begin,
+        ham_key_t *end, ham_u32_t flags)
+{
+    ham_status_t st;
+    Page *root;
+    bool is_empty;
+    Database *db=get_db();
+    erase_range_t er;
+
+    (void)flags;
+
+    if (!get_rootpage())
+        return (0);
+
+    /* nothing to do if the range is empty */
+    if (begin && end && db->compare_keys(begin, end)>=0)
+        return (0);
+
+    er.be=this;
+    er.txn=txn;
+    er.begin=begin;
+    er.end=end;
+
+    st=db_fetch_page(&root, db, get_rootpage(), 0);
+    if (st)
+        return (st);
+
+    /* remove all covered subtrees and shrink the boundary nodes */
+    st=my_erase_range_recursive(&er, root, 0, begin==0, end==0, &is_empty);
+    if (st)
+        return (st);
+
+    /* link the neighbours of the removed nodes on each level */
+    for (ham_size_t d=0; d<er.removed.size(); d++) {
+        if (!er.removed[d])
+            continue;
+        st=my_range_unlink(db, er.left[d], er.right[d]);
+        if (st)
+            return (st);
+    }
+
+    /* repair the boundary paths */
+    st=my_range_repair_path(&er, begin);
+    if (!st)
+        st=my_range_repair_path(&er, end);
+    if (st)
+        return (st);
+
+    /* all cursors were uncoupled; set those to nil which pointed into
+     * the range */
+    for (Cursor *c=db->get_cursors(); c; c=c->get_next()) {
+        btree_cursor_t *btc=c->get_btree_cursor();
+        if (!btree_cursor_is_uncoupled(btc))
+            continue;
+        ham_key_t *key=btree_cursor_get_uncoupled_key(btc);
+        if (begin && db->compare_keys(key, begin)<0)
+            continue;
+        if (end && db->compare_keys(key, end)>=0)
+            continue;
+        st=btree_cursor_set_to_nil(btc);
+        if (st)
+            return (st);
+    }
+
+    return (0);
+}
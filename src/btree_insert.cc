@@ -579,7 +579,7 @@ __insert_nosplit(Page *page, Transaction *txn, ham_key_t *key,
 {
     ham_status_t st;
     ham_u16_t count;
-    ham_size_t keysize;
+    ham_size_t slotsize;
     ham_size_t new_dupe_id = 0;
     btree_key_t *bte = 0;
     btree_node_t *node;
@@ -591,7 +591,7 @@ __insert_nosplit(Page *page, Transaction *txn, ham_key_t *key,
 
     node=page_get_btree_node(page);
     count=btree_node_get_count(node);
-    keysize=db_get_keysize(db);
+    slotsize=btree_get_slot_size(db);
 
     if (btree_node_get_count(node)==0)
     {
@@ -672,15 +672,15 @@ __insert_nosplit(Page *page, Transaction *txn, ham_key_t *key,
             if (st)
                 return (st);
 
-            hints->cost += btree_stats_memmove_cost((db_get_int_key_header_size()+keysize)*(count-slot));
-            memmove(((char *)bte)+db_get_int_key_header_size()+keysize, bte,
-                    (db_get_int_key_header_size()+keysize)*(count-slot));
+            hints->cost += btree_stats_memmove_cost(slotsize*(count-slot));
+            memmove(((char *)bte)+slotsize, bte,
+                    slotsize*(count-slot));
         }
 
         /*
          * if a new key is created or inserted: initialize it with zeroes
          */
-        memset(bte, 0, db_get_int_key_header_size()+keysize);
+        memset(bte, 0, slotsize);
     }
 
     /*
@@ -787,7 +787,7 @@ __insert_split(Page *page, ham_key_t *key,
     Page *newpage, *oldsib;
     btree_key_t *nbte, *obte;
     btree_node_t *nbtp, *obtp, *sbtp;
-    ham_size_t count, keysize;
+    ham_size_t count, slotsize;
     Database *db=page->get_db();
     Environment *env = db->get_env();
     ham_key_t pivotkey, oldkey;
@@ -799,7 +799,7 @@ __insert_split(Page *page, ham_key_t *key,
 
     ham_assert(hints->force_append == HAM_FALSE, (0));
 
-    keysize=db_get_keysize(db);
+    slotsize=btree_get_slot_size(db);
 
     /*
      * allocate a new page
@@ -869,16 +869,16 @@ __insert_split(Page *page, ham_key_t *key,
      * it to the parent node only.
      */
     if (btree_node_is_leaf(obtp)) {
-        hints->cost += btree_stats_memmove_cost((db_get_int_key_header_size()+keysize)*(count-pivot));
+        hints->cost += btree_stats_memmove_cost(slotsize*(count-pivot));
         memcpy((char *)nbte,
-               ((char *)obte)+(db_get_int_key_header_size()+keysize)*pivot,
-               (db_get_int_key_header_size()+keysize)*(count-pivot));
+               ((char *)obte)+slotsize*pivot,
+               slotsize*(count-pivot));
     }
     else {
-        hints->cost += btree_stats_memmove_cost((db_get_int_key_header_size()+keysize)*(count-pivot-1));
+        hints->cost += btree_stats_memmove_cost(slotsize*(count-pivot-1));
         memcpy((char *)nbte,
-               ((char *)obte)+(db_get_int_key_header_size()+keysize)*(pivot+1),
-               (db_get_int_key_header_size()+keysize)*(count-pivot-1));
+               ((char *)obte)+slotsize*(pivot+1),
+               slotsize*(count-pivot-1));
     }
     
     /*
@@ -52,6 +52,64 @@ key_insert_extended(ham_offset_t *rid_ref, Database *db, Page *page,
     return HAM_SUCCESS;
 }
 
+/**
+ * stores a record behind the key (see @ref KEY_BLOB_SIZE_INLINE); if the
+ * record is written partially, the current inline record of @a oldsize
+ * bytes is merged with the new data
+ */
+static void
+__set_inline_record(Database *db, btree_key_t *key, ham_record_t *record,
+        ham_size_t oldsize, ham_u32_t flags)
+{
+    ham_u8_t *p=key_get_inline_record(db, key);
+
+    if (flags&HAM_PARTIAL) {
+        if (record->size>oldsize)
+            memset(p+oldsize, 0, record->size-oldsize);
+        memcpy(p+record->partial_offset, record->data, record->partial_size);
+    }
+    else
+        memcpy(p, record->data, record->size);
+
+    key_set_flags(key, key_get_flags(key)|KEY_BLOB_SIZE_INLINE);
+    key_set_ptr(key, record->size);
+}
+
+/**
+ * moves an inline record of @a oldsize bytes to a blob, i.e. because
+ * the new record no longer fits into the key; if the record is written
+ * partially, the inline record is merged with the new data
+ */
+static ham_status_t
+__move_inline_record(Database *db, btree_key_t *key, ham_record_t *record,
+        ham_size_t oldsize, ham_u32_t flags, ham_offset_t *rid)
+{
+    ham_status_t st;
+    Environment *env=db->get_env();
+    ham_record_t full=*record;
+    ham_u8_t *buffer=0;
+
+    if (flags&HAM_PARTIAL) {
+        buffer=(ham_u8_t *)env->get_allocator()->calloc(record->size);
+        if (!buffer)
+            return (HAM_OUT_OF_MEMORY);
+        memcpy(buffer, key_get_inline_record(db, key),
+                oldsize<record->size ? oldsize : record->size);
+        memcpy(buffer+record->partial_offset, record->data,
+                record->partial_size);
+        full.data=buffer;
+        full.partial_offset=0;
+        full.partial_size=0;
+        flags&=~HAM_PARTIAL;
+    }
+
+    st=blob_allocate(env, db, &full, flags|BLOB_RECORD, rid);
+
+    if (buffer)
+        env->get_allocator()->free(buffer);
+    return (st);
+}
+
 ham_status_t
 key_set_record(Database *db, Transaction *txn, btree_key_t *key, 
         ham_record_t *record, ham_size_t position, ham_u32_t flags, 
@@ -63,10 +121,13 @@ key_set_record(Database *db, Transaction *txn, btree_key_t *key,
     ham_offset_t ptr = key_get_ptr(key);
     ham_u8_t oldflags = key_get_flags(key);
 
+    ham_size_t inline_size=db_get_inline_size(db);
+
     key_set_flags(key,
             oldflags&~(KEY_BLOB_SIZE_SMALL
                 |KEY_BLOB_SIZE_TINY
-                |KEY_BLOB_SIZE_EMPTY));
+                |KEY_BLOB_SIZE_EMPTY
+                |KEY_BLOB_SIZE_INLINE));
 
     /*
      * no existing key, just create a new key (but not a duplicate)?
@@ -74,7 +135,8 @@ key_set_record(Database *db, Transaction *txn, btree_key_t *key,
     if (!ptr
             && !(oldflags&(KEY_BLOB_SIZE_SMALL
                     |KEY_BLOB_SIZE_TINY
-                    |KEY_BLOB_SIZE_EMPTY)))
+                    |KEY_BLOB_SIZE_EMPTY
+                    |KEY_BLOB_SIZE_INLINE)))
     {
         if (record->size<=sizeof(ham_offset_t)) {
             if (record->data)
@@ -90,8 +152,11 @@ key_set_record(Database *db, Transaction *txn, btree_key_t *key,
                 key_set_flags(key, key_get_flags(key)|KEY_BLOB_SIZE_SMALL);
             key_set_ptr(key, rid);
         }
+        else if (record->size<=inline_size) {
+            __set_inline_record(db, key, record, 0, flags);
+        }
         else {
-            st=blob_allocate(env, db, record, flags, &rid);
+            st=blob_allocate(env, db, record, flags|BLOB_RECORD, &rid);
             if (st)
                 return (st);
             key_set_ptr(key, rid);
@@ -111,19 +176,46 @@ key_set_record(Database *db, Transaction *txn, btree_key_t *key,
          SMALL (size = 8, but content = 00000000 --> !ptr) are caught here
          and in the next branch, as they should.
          */
-        if (oldflags&(KEY_BLOB_SIZE_SMALL
+        if (oldflags&KEY_BLOB_SIZE_INLINE) {
+            if (record->size<=inline_size)
+                __set_inline_record(db, key, record, (ham_size_t)ptr, flags);
+            else {
+                st=__move_inline_record(db, key, record, (ham_size_t)ptr,
+                        flags, &rid);
+                if (st) {
+                    key_set_flags(key, oldflags);
+                    return (st);
+                }
+                key_set_ptr(key, rid);
+            }
+        }
+        else if (record->size<=inline_size
+                && (oldflags&(KEY_BLOB_SIZE_SMALL
+                    |KEY_BLOB_SIZE_TINY
+                    |KEY_BLOB_SIZE_EMPTY)))
+        {
+            __set_inline_record(db, key, record, 0, flags);
+        }
+        else if (oldflags&(KEY_BLOB_SIZE_SMALL
                     |KEY_BLOB_SIZE_TINY
                     |KEY_BLOB_SIZE_EMPTY))
         {
             rid=0;
-            st=blob_allocate(env, db, record, flags, &rid);
+            st=blob_allocate(env, db, record, flags|BLOB_RECORD, &rid);
             if (st)
                 return (st);
             if (rid)
                 key_set_ptr(key, rid);
         }
+        else if (record->size<=inline_size && !(flags&HAM_PARTIAL)) {
+            /* the record shrinks and is now stored in the key */
+            st=blob_free(env, db, ptr, 0);
+            if (st)
+                return (st);
+            __set_inline_record(db, key, record, 0, flags);
+        }
         else {
-            st=blob_overwrite(env, db, ptr, record, flags, &rid);
+            st=blob_overwrite(env, db, ptr, record, flags|BLOB_RECORD, &rid);
             if (st)
                 return (st);
             key_set_ptr(key, rid);
@@ -141,7 +233,8 @@ key_set_record(Database *db, Transaction *txn, btree_key_t *key,
          */
         if (!(oldflags&(KEY_BLOB_SIZE_SMALL
                         |KEY_BLOB_SIZE_TINY
-                        |KEY_BLOB_SIZE_EMPTY)))
+                        |KEY_BLOB_SIZE_EMPTY
+                        |KEY_BLOB_SIZE_INLINE)))
         {
             st=blob_free(env, db, ptr, 0);
             if (st)
@@ -171,6 +264,7 @@ key_set_record(Database *db, Transaction *txn, btree_key_t *key,
          * create a duplicate list, if it does not yet exist
          */
         dupe_entry_t entries[2];
+        ham_offset_t moved_rid=0;
         int i=0;
         ham_assert((flags&(HAM_DUPLICATE
                         |HAM_DUPLICATE_INSERT_BEFORE
@@ -186,6 +280,19 @@ key_set_record(Database *db, Transaction *txn, btree_key_t *key,
                             |HAM_DUPLICATE_INSERT_AFTER
                             |HAM_DUPLICATE_INSERT_FIRST
                             |HAM_DUPLICATE_INSERT_LAST)), (""));
+            /* duplicates are never stored inline; move the inline
+             * record of the first duplicate to a blob */
+            if (oldflags&KEY_BLOB_SIZE_INLINE) {
+                ham_record_t oldrec={0};
+                oldrec.data=key_get_inline_record(db, key);
+                oldrec.size=(ham_size_t)ptr;
+                st=blob_allocate(env, db, &oldrec, BLOB_RECORD, &moved_rid);
+                if (st) {
+                    key_set_flags(key, oldflags);
+                    return (st);
+                }
+                ptr=moved_rid;
+            }
             dupe_entry_set_flags(&entries[i],
                     oldflags&(KEY_BLOB_SIZE_SMALL
                         |KEY_BLOB_SIZE_TINY
@@ -210,7 +317,7 @@ key_set_record(Database *db, Transaction *txn, btree_key_t *key,
         }
         else
         {
-            st=blob_allocate(env, db, record, flags, &rid);
+            st=blob_allocate(env, db, record, flags|BLOB_RECORD, &rid);
             if (st)
                 return (st);
             dupe_entry_set_flags(&entries[i], 0);
@@ -234,6 +341,10 @@ key_set_record(Database *db, Transaction *txn, btree_key_t *key,
             {
                 (void)blob_free(env, db, dupe_entry_get_rid(&entries[i-1]), 0);
             }
+            if (moved_rid) {
+                (void)blob_free(env, db, moved_rid, 0);
+                key_set_flags(key, oldflags);
+            }
             return st;
         }
 
@@ -254,7 +365,8 @@ key_erase_record(Database *db, Transaction *txn, btree_key_t *key,
 
     if (!(key_get_flags(key)&(KEY_BLOB_SIZE_SMALL
                     |KEY_BLOB_SIZE_TINY
-                    |KEY_BLOB_SIZE_EMPTY))) {
+                    |KEY_BLOB_SIZE_EMPTY
+                    |KEY_BLOB_SIZE_INLINE))) {
         if (key_get_flags(key)&KEY_HAS_DUPLICATES) {
             /* delete one (or all) duplicates */
             st=blob_duplicate_erase(db, txn, key_get_ptr(key), dupe_id, flags,
@@ -283,6 +395,7 @@ key_erase_record(Database *db, Transaction *txn, btree_key_t *key,
         key_set_flags(key, key_get_flags(key)&~(KEY_BLOB_SIZE_SMALL
                     | KEY_BLOB_SIZE_TINY
                     | KEY_BLOB_SIZE_EMPTY
+                    | KEY_BLOB_SIZE_INLINE
                     | KEY_HAS_DUPLICATES));
         key_set_ptr(key, 0);
     }
@@ -66,6 +66,16 @@ HAM_PACK_0 struct HAM_PACK_1 btree_key_t
 /** same as above, but without endian conversion */
 #define key_get_rawptr(k)           (k)->_ptr
 
+/**
+ * the address of the pointer of an btree-entry, as it is passed to
+ * btree_read_record()
+ *
+ * the address is computed from the offset of the member because taking
+ * the address of a member of a packed structure yields an unaligned pointer
+ */
+#define key_get_rawptr_address(k)   ((ham_u64_t *)((ham_u8_t *)(k)            \
+                                        +OFFSETOF(btree_key_t, _ptr)))
+
 /**
  * set the pointer of an btree-entry
  *
@@ -122,6 +132,9 @@ key_set_extended_rid(Database *db, btree_key_t *key, ham_offset_t rid);
 #define KEY_IS_EXTENDED              0x08
 #define KEY_HAS_DUPLICATES           0x10
 #define KEY_IS_ALLOCATED             0x20  /* memory allocated in hamsterdb */
+#define KEY_BLOB_SIZE_INLINE         0x40  /* 8 < size <= inline size; stored
+                                            * behind the key, size in
+                                            * key->ptr */
 
 /** get a pointer to the key */
 #define key_get_key(bte)                (bte->_key)
@@ -129,6 +142,12 @@ key_set_extended_rid(Database *db, btree_key_t *key, ham_offset_t rid);
 /** set the key data */
 #define key_set_key(bte, ptr, len)      memcpy(bte->_key, ptr, len)
 
+/**
+ * get a pointer to the inline record, which is stored behind the key
+ * (see @ref KEY_BLOB_SIZE_INLINE)
+ */
+#define key_get_inline_record(db, bte)  ((bte)->_key+db_get_keysize(db))
+
 /*
  * flags used with the ham_key_t INTERNAL USE field _flags.
  *
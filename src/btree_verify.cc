@@ -0,0 +1,837 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief implementation of the parallel btree verifier
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <set>
+
+#include <boost/bind.hpp>
+
+#include "blob.h"
+#include "btree.h"
+#include "btree_verify.h"
+#include "cache.h"
+#include "compressor.h"
+#include "db.h"
+#include "device.h"
+#include "env.h"
+#include "error.h"
+#include "freelist.h"
+#include "freelist_extents.h"
+#include "page.h"
+#include "slab.h"
+
+/** the maximum number of worker threads */
+#define VERIFY_MAX_THREADS      8
+
+/**
+ * the summary of a single btree node
+ */
+struct BtreeVerifier::node_t
+{
+    node_t(ham_offset_t a)
+      : address(a), status(0), error(0), item(0), is_leaf(false), count(0),
+        left(0), right(0), ptr_left(0), visited(false) {
+    }
+
+    /** the address of the page */
+    ham_offset_t address;
+
+    /** the result of the page-local checks */
+    ham_status_t status;
+
+    /** a description of the error, if status is not 0 */
+    const char *error;
+
+    /** the item which caused the error */
+    ham_size_t item;
+
+    /** true if this is a leaf node */
+    bool is_leaf;
+
+    /** the number of items */
+    ham_u16_t count;
+
+    /** the siblings and the smallest child */
+    ham_offset_t left;
+    ham_offset_t right;
+    ham_offset_t ptr_left;
+
+    /** for leaf nodes: the smallest and the largest key; for internal
+     * nodes: all keys */
+    std::vector<std::vector<ham_u8_t> > keys;
+
+    /** for internal nodes: the child pointers of all keys */
+    std::vector<ham_offset_t> children;
+
+    /** the blobs which are referenced by this node */
+    std::vector<ham_offset_t> blobs;
+
+    /** true if the node was reached while linking the tree */
+    bool visited;
+};
+
+/**
+ * a buffer for a sequential read
+ */
+struct BtreeVerifier::chunk_t
+{
+    /** the file address of the buffer */
+    ham_offset_t address;
+
+    /** the number of valid bytes */
+    ham_size_t size;
+
+    /** the data */
+    std::vector<ham_u8_t> data;
+};
+
+BtreeVerifier::BtreeVerifier(Database *db)
+  : m_db(db), m_device(0), m_compare(0), m_filesize(0),
+    m_rootpage(0), m_pagesize(0), m_keysize(0), m_inline_size(0),
+    m_maxkeys(0),
+    m_is_legacy(false), m_has_extents(false), m_freelist_offset(0),
+    m_modification_count(0),
+    m_threads(0), m_done(false)
+{
+}
+
+BtreeVerifier::~BtreeVerifier()
+{
+    std::map<ham_offset_t, node_t *>::iterator it;
+    for (it=m_nodes.begin(); it!=m_nodes.end(); it++)
+        delete it->second;
+}
+
+bool
+BtreeVerifier::is_supported(Database *db)
+{
+    Environment *env=db->get_env();
+
+    if (!env || !db->get_backend() || !db->get_backend()->is_active())
+        return (false);
+    if (env->get_flags()&(HAM_IN_MEMORY_DB|DB_IS_REMOTE))
+        return (false);
+    /* hash Databases have no btree */
+    if (db->get_rt_flags()&HAM_USE_HASH)
+        return (false);
+    /* filtered (i.e. encrypted) pages cannot be read without the
+     * Environment */
+    if (env->get_file_filter())
+        return (false);
+    return (true);
+}
+
+ham_status_t
+BtreeVerifier::prepare()
+{
+    ham_status_t st;
+    Environment *env=m_db->get_env();
+    Device *device=env->get_device();
+    BtreeBackend *be=(BtreeBackend *)m_db->get_backend();
+
+    /* check the cache integrity */
+    st=env->get_cache()->check_integrity();
+    if (st)
+        return (st);
+
+    /* write all modified pages to disk */
+    if (!(env->get_flags()&HAM_READ_ONLY)) {
+        st=env->_fun_flush(env, 0);
+        if (st)
+            return (st);
+    }
+
+    st=device->get_filesize(&m_filesize);
+    if (st)
+        return (st);
+
+    m_rootpage=be->get_rootpage();
+    m_maxkeys=be->get_maxkeys();
+    m_keysize=db_get_keysize(m_db);
+    m_inline_size=db_get_inline_size(m_db);
+    m_pagesize=env->get_pagesize();
+    m_is_legacy=env->is_legacy();
+    m_has_extents=env->get_freelist_format()==FREELIST_FORMAT_EXTENTS;
+    m_extents.clear();
+    if (m_has_extents && device->get_freelist_cache()) {
+        m_extents=freel_cache_get_extents(device->get_freelist_cache())
+                ->get_extents();
+    }
+    m_compare=m_db->get_compare_func();
+    m_freelist_offset=(ham_size_t)((ham_u8_t *)env->get_freelist()
+                - (ham_u8_t *)env->get_header_page()->get_pers());
+    m_modification_count=device->get_modification_count();
+    m_device=device;
+
+    /* user-supplied compare functions are not necessarily reentrant,
+     * therefore they are only called from the current thread */
+    m_threads=0;
+    if (m_filesize>READ_SIZE
+            && (m_compare==db_default_compare
+                || m_compare==db_default_recno_compare)) {
+        m_threads=Thread::hardware_concurrency();
+        if (m_threads>VERIFY_MAX_THREADS)
+            m_threads=VERIFY_MAX_THREADS;
+    }
+
+    return (0);
+}
+
+bool
+BtreeVerifier::is_stale()
+{
+    Device *device=m_db->get_env()->get_device();
+    return (device->get_modification_count()!=m_modification_count);
+}
+
+ham_status_t
+BtreeVerifier::run()
+{
+    ham_status_t st=0;
+    std::vector<Thread *> threads;
+    std::vector<node_t *> nodes;
+
+    std::map<ham_offset_t, node_t *>::iterator it;
+    for (it=m_nodes.begin(); it!=m_nodes.end(); it++)
+        delete it->second;
+    m_nodes.clear();
+    m_free.clear();
+    m_header.clear();
+    m_done=false;
+
+    /* two buffers per thread: one is processed while the next one
+     * is read */
+    unsigned num_chunks=m_threads ? m_threads*2 : 1;
+    std::vector<chunk_t> chunks(num_chunks);
+    ham_size_t read_size=READ_SIZE-(READ_SIZE%m_pagesize);
+    if (!read_size)
+        read_size=m_pagesize;
+    m_free_chunks.clear();
+    for (unsigned i=0; i<num_chunks; i++) {
+        chunks[i].data.resize(read_size);
+        m_free_chunks.push_back(&chunks[i]);
+    }
+
+    for (unsigned i=0; i<m_threads; i++)
+        threads.push_back(new Thread(boost::bind(&BtreeVerifier::worker,
+                        this)));
+
+    /* read the file in physical order */
+    ham_offset_t filesize=m_filesize-(m_filesize%m_pagesize);
+    for (ham_offset_t address=0; address<filesize; address+=read_size) {
+        chunk_t *chunk;
+        {
+            ScopedLock lock(m_mutex);
+            while (m_free_chunks.empty())
+                m_cond.wait(lock);
+            chunk=m_free_chunks.back();
+            m_free_chunks.pop_back();
+        }
+
+        chunk->address=address;
+        chunk->size=read_size;
+        if (address+chunk->size>filesize)
+            chunk->size=(ham_size_t)(filesize-address);
+        st=read(address, &chunk->data[0], chunk->size);
+        if (st)
+            break;
+
+        if (address==0)
+            m_header.assign(chunk->data.begin(),
+                    chunk->data.begin()+m_pagesize);
+
+        if (!m_threads) {
+            process_chunk(chunk, nodes);
+            m_free_chunks.push_back(chunk);
+            continue;
+        }
+
+        ScopedLock lock(m_mutex);
+        m_queue.push_back(chunk);
+        m_cond.notify_all();
+    }
+
+    {
+        ScopedLock lock(m_mutex);
+        m_done=true;
+        m_cond.notify_all();
+    }
+    for (unsigned i=0; i<threads.size(); i++) {
+        threads[i]->join();
+        delete threads[i];
+    }
+    m_queue.clear();
+    m_free_chunks.clear();
+
+    if (st)
+        return (st);
+
+    if (m_header.empty()) {
+        ham_log(("integrity check failed: the file is too small"));
+        return (HAM_INTEGRITY_VIOLATED);
+    }
+
+    st=verify_links();
+    if (st)
+        return (st);
+
+    return (verify_freelist());
+}
+
+void
+BtreeVerifier::worker()
+{
+    std::vector<node_t *> nodes;
+
+    while (true) {
+        chunk_t *chunk;
+        {
+            ScopedLock lock(m_mutex);
+            while (m_queue.empty() && !m_done)
+                m_cond.wait(lock);
+            if (m_queue.empty())
+                return;
+            chunk=m_queue.back();
+            m_queue.pop_back();
+        }
+
+        process_chunk(chunk, nodes);
+
+        ScopedLock lock(m_mutex);
+        m_free_chunks.push_back(chunk);
+        m_cond.notify_all();
+    }
+}
+
+void
+BtreeVerifier::process_chunk(chunk_t *chunk, std::vector<node_t *> &nodes)
+{
+    PageCompressor compressor(m_pagesize);
+    std::vector<ham_u8_t> page;
+
+    nodes.clear();
+
+    for (ham_size_t offset=0; offset<chunk->size; offset+=m_pagesize) {
+        const ham_u8_t *data=&chunk->data[offset];
+        ham_offset_t address=chunk->address+offset;
+
+        /* the header page has no page header */
+        if (address==0)
+            continue;
+
+        /* compressed pages are decompressed to a temporary buffer */
+        if (offset+m_pagesize<=chunk->size
+                && PageCompressor::is_compressed(data)) {
+            page.resize(m_pagesize);
+            if (compressor.decompress(data, &page[0]))
+                continue;
+            data=&page[0];
+        }
+
+        ham_u32_t type=ham_db2h32(((page_data_t *)data)->_s._flags);
+        if (type==Page::TYPE_B_ROOT || type==Page::TYPE_B_INDEX) {
+            node_t *node=process_page(address, data);
+            if (node)
+                nodes.push_back(node);
+        }
+    }
+
+    /* merge the results */
+    ScopedLock lock(m_mutex, boost::defer_lock);
+    if (m_threads)
+        lock.lock();
+    for (ham_size_t i=0; i<nodes.size(); i++)
+        m_nodes[nodes[i]->address]=nodes[i];
+}
+
+BtreeVerifier::node_t *
+BtreeVerifier::process_page(ham_offset_t address, const ham_u8_t *data)
+{
+    btree_node_t *bn=(btree_node_t *)(data+Page::sizeof_persistent_header);
+    ham_size_t entry_size=db_get_int_key_header_size()+m_keysize
+                    +m_inline_size;
+    ham_size_t prefix=m_keysize-sizeof(ham_offset_t);
+    std::vector<ham_u8_t> key;
+    ham_status_t st;
+
+    node_t *node=new node_t(address);
+    node->count=btree_node_get_count(bn);
+    node->left=btree_node_get_left(bn);
+    node->right=btree_node_get_right(bn);
+    node->ptr_left=btree_node_get_ptr_left(bn);
+    node->is_leaf=btree_node_is_leaf(bn);
+
+#define FAIL(msg, i)    do { node->status=HAM_INTEGRITY_VIOLATED;             \
+                             node->error=msg; node->item=i;                   \
+                             return (node); } while (0)
+
+    if (node->count>m_maxkeys
+            || OFFSETOF(btree_node_t, _entries)+node->count*entry_size
+                    >m_pagesize-Page::sizeof_persistent_header)
+        FAIL("too many items", 0);
+
+    for (ham_size_t i=0; i<node->count; i++) {
+        btree_key_t *bte=(btree_key_t *)
+                    ((ham_u8_t *)bn->_entries+entry_size*i);
+        ham_u8_t flags=key_get_flags(bte);
+        ham_size_t size=key_get_size(bte);
+
+        std::vector<ham_u8_t> &k=
+            (!node->is_leaf || i==0)
+                ? (node->keys.push_back(std::vector<ham_u8_t>()),
+                   node->keys.back())
+                : key;
+
+        /* load the key; extended keys are read from the private
+         * file handle, bypassing the extended key cache */
+        if (flags&KEY_IS_EXTENDED) {
+            ham_offset_t blobid;
+            blob_t hdr;
+
+            if (size<=m_keysize)
+                FAIL("extended key is too small", i);
+            memcpy(&blobid, key_get_key(bte)+prefix, sizeof(blobid));
+            blobid=ham_db2h_offset(blobid);
+            if (!blobid)
+                FAIL("item is extended, but has no blob", i);
+            if (blobid+sizeof(hdr)+(size-prefix)>m_filesize)
+                FAIL("blob of extended key is out of bounds", i);
+            st=read(blobid, &hdr, sizeof(hdr));
+            if (st) {
+                node->status=st;
+                return (node);
+            }
+            if (blob_get_self(&hdr)!=blobid
+                    || blob_get_size(&hdr)!=size-prefix)
+                FAIL("blob of extended key is invalid", i);
+
+            k.resize(size);
+            memcpy(&k[0], key_get_key(bte), prefix);
+            st=read(blobid+sizeof(hdr), &k[prefix], size-prefix);
+            if (st) {
+                node->status=st;
+                return (node);
+            }
+            node->blobs.push_back(blobid);
+        }
+        else {
+            if (size>m_keysize)
+                FAIL("key is too large", i);
+            k.assign(key_get_key(bte), key_get_key(bte)+size);
+        }
+
+        if (node->is_leaf) {
+            /* the record is either stored in the key or in a blob */
+            if ((flags&KEY_BLOB_SIZE_INLINE)
+                    && (key_get_ptr(bte)<=sizeof(ham_offset_t)
+                        || key_get_ptr(bte)>m_inline_size))
+                FAIL("inline record has an invalid size", i);
+            if (!(flags&(KEY_BLOB_SIZE_TINY|KEY_BLOB_SIZE_SMALL
+                            |KEY_BLOB_SIZE_EMPTY|KEY_BLOB_SIZE_INLINE))) {
+                ham_offset_t rid=key_get_ptr(bte);
+                if (rid)
+                    node->blobs.push_back(rid);
+            }
+        }
+        else {
+            if (flags&~KEY_IS_EXTENDED)
+                FAIL("item has flags, but it's not a leaf page", i);
+            if (!key_get_ptr(bte))
+                FAIL("item has no child page", i);
+            node->children.push_back(key_get_ptr(bte));
+        }
+
+        /* compare with the previous key */
+        if (i>0) {
+            const std::vector<ham_u8_t> &prev=node->is_leaf
+                    ? (i==1 ? node->keys[0] : node->keys[1])
+                    : node->keys[i-1];
+            int cmp=compare(prev, k);
+            if (cmp<-1) {
+                node->status=(ham_status_t)cmp;
+                return (node);
+            }
+            if (cmp>=0)
+                FAIL("items are not sorted", i);
+        }
+
+        /* leaf nodes only keep the smallest and the largest key */
+        if (node->is_leaf && i>0) {
+            if (node->keys.size()==1)
+                node->keys.push_back(std::vector<ham_u8_t>());
+            node->keys[1].swap(k);
+        }
+    }
+
+#undef FAIL
+
+    return (node);
+}
+
+ham_status_t
+BtreeVerifier::verify_links()
+{
+    struct entry_t {
+        node_t *node;
+        const std::vector<ham_u8_t> *lower;
+        const std::vector<ham_u8_t> *upper;
+    };
+    std::vector<entry_t> level, next;
+    int cmp;
+
+    std::map<ham_offset_t, node_t *>::iterator it=m_nodes.find(m_rootpage);
+    if (it==m_nodes.end()) {
+        ham_log(("integrity check failed: root page 0x%llx is not a "
+                "btree node", (unsigned long long)m_rootpage));
+        return (HAM_INTEGRITY_VIOLATED);
+    }
+
+    entry_t root={it->second, 0, 0};
+    root.node->visited=true;
+    level.push_back(root);
+
+    while (!level.empty()) {
+        node_t *prev=0;
+        next.clear();
+
+        for (ham_size_t l=0; l<level.size(); l++) {
+            node_t *node=level[l].node;
+
+            if (node->status) {
+                if (node->error)
+                    ham_log(("integrity check failed in page 0x%llx: "
+                            "item #%u: %s", (unsigned long long)node->address,
+                            (unsigned)node->item, node->error));
+                return (node->status);
+            }
+
+            if (node->count==0 && node!=root.node) {
+                ham_log(("integrity check failed in page 0x%llx: empty page!",
+                        (unsigned long long)node->address));
+                return (HAM_INTEGRITY_VIOLATED);
+            }
+
+            if (node->is_leaf!=level[0].node->is_leaf) {
+                ham_log(("integrity check failed in page 0x%llx: the leaf "
+                        "pages are not on the same level",
+                        (unsigned long long)node->address));
+                return (HAM_INTEGRITY_VIOLATED);
+            }
+
+            /* verify the sibling pointers */
+            if (node->left!=(prev ? prev->address : 0)
+                    || (prev && prev->right!=node->address)) {
+                ham_log(("integrity check failed in page 0x%llx: invalid "
+                        "sibling pointers", (unsigned long long)node->address));
+                return (HAM_INTEGRITY_VIOLATED);
+            }
+
+            /* verify the keys against the parent and the left sibling */
+            if (node->count) {
+                const std::vector<ham_u8_t> &first=node->keys.front();
+                const std::vector<ham_u8_t> &last=node->keys.back();
+
+                if (level[l].lower) {
+                    cmp=compare(first, *level[l].lower);
+                    if (cmp<-1)
+                        return ((ham_status_t)cmp);
+                    if (cmp<0) {
+                        ham_log(("integrity check failed in page 0x%llx: "
+                                "item #0 < parent item",
+                                (unsigned long long)node->address));
+                        return (HAM_INTEGRITY_VIOLATED);
+                    }
+                }
+                if (level[l].upper) {
+                    cmp=compare(last, *level[l].upper);
+                    if (cmp<-1)
+                        return ((ham_status_t)cmp);
+                    if (cmp>=0) {
+                        ham_log(("integrity check failed in page 0x%llx: "
+                                "item #%d >= parent item",
+                                (unsigned long long)node->address,
+                                node->count-1));
+                        return (HAM_INTEGRITY_VIOLATED);
+                    }
+                }
+                if (prev && prev->count) {
+                    cmp=compare(prev->keys.back(), first);
+                    if (cmp<-1)
+                        return ((ham_status_t)cmp);
+                    if (cmp>=0) {
+                        ham_log(("integrity check failed in page 0x%llx: "
+                                "item #0 < left sibling item #%d",
+                                (unsigned long long)node->address,
+                                prev->count-1));
+                        return (HAM_INTEGRITY_VIOLATED);
+                    }
+                }
+            }
+
+            /* collect the children */
+            if (!node->is_leaf) {
+                for (ham_size_t i=0; i<=node->children.size(); i++) {
+                    ham_offset_t address=i ? node->children[i-1]
+                                           : node->ptr_left;
+                    entry_t e;
+                    e.lower=i ? &node->keys[i-1] : level[l].lower;
+                    e.upper=i<node->keys.size() ? &node->keys[i]
+                                                : level[l].upper;
+
+                    it=m_nodes.find(address);
+                    if (it==m_nodes.end()) {
+                        ham_log(("integrity check failed in page 0x%llx: "
+                                "child 0x%llx is not a btree node",
+                                (unsigned long long)node->address,
+                                (unsigned long long)address));
+                        return (HAM_INTEGRITY_VIOLATED);
+                    }
+                    e.node=it->second;
+                    if (e.node->visited) {
+                        ham_log(("integrity check failed in page 0x%llx: "
+                                "child 0x%llx is referenced twice",
+                                (unsigned long long)node->address,
+                                (unsigned long long)address));
+                        return (HAM_INTEGRITY_VIOLATED);
+                    }
+                    e.node->visited=true;
+                    next.push_back(e);
+                }
+            }
+
+            prev=node;
+        }
+
+        if (prev->right) {
+            ham_log(("integrity check failed in page 0x%llx: invalid "
+                    "sibling pointers", (unsigned long long)prev->address));
+            return (HAM_INTEGRITY_VIOLATED);
+        }
+
+        level.swap(next);
+    }
+
+    return (0);
+}
+
+ham_status_t
+BtreeVerifier::verify_freelist()
+{
+    ham_status_t st;
+    ham_offset_t overflow;
+    std::set<ham_offset_t> seen;
+    std::vector<ham_u8_t> page(m_pagesize);
+
+    /* the free extents are only known in memory; the freelist pages
+     * are linked like the pages of the bitmap freelist */
+    if (m_has_extents) {
+        std::map<ham_offset_t, ham_offset_t>::iterator it;
+        for (it=m_extents.begin(); it!=m_extents.end(); it++) {
+            if (it->first%DB_CHUNKSIZE || it->second%DB_CHUNKSIZE
+                    || it->first<m_pagesize) {
+                ham_log(("integrity check failed: invalid free extent "
+                        "0x%llx", (unsigned long long)it->first));
+                return (HAM_INTEGRITY_VIOLATED);
+            }
+            m_free[it->first]=it->first+it->second;
+        }
+        overflow=ham_db2h_offset(((freelist_extents_payload_t *)
+                    &m_header[m_freelist_offset])->_overflow);
+    }
+    /* the first part of the freelist is stored in the header page */
+    else {
+        st=read_freelist(0, &m_header[m_freelist_offset],
+                    m_pagesize-m_freelist_offset, &overflow);
+        if (st)
+            return (st);
+    }
+
+    /* the freelist pages are few and scattered over the file; they
+     * are read directly */
+    while (overflow) {
+        if (overflow%m_pagesize || overflow+m_pagesize>m_filesize
+                || seen.count(overflow)) {
+            ham_log(("integrity check failed: invalid freelist page 0x%llx",
+                    (unsigned long long)overflow));
+            return (HAM_INTEGRITY_VIOLATED);
+        }
+        seen.insert(overflow);
+
+        ham_offset_t address=overflow;
+        st=read(address, &page[0], m_pagesize);
+        if (st)
+            return (st);
+        if (PageCompressor::is_compressed(&page[0])) {
+            std::vector<ham_u8_t> image(page);
+            st=PageCompressor(m_pagesize).decompress(&image[0], &page[0]);
+            if (st)
+                return (st);
+        }
+        if (m_has_extents) {
+            overflow=ham_db2h_offset(((freelist_extents_payload_t *)
+                        &page[Page::sizeof_persistent_header])->_overflow);
+        }
+        else {
+            st=read_freelist(address, &page[Page::sizeof_persistent_header],
+                    m_pagesize-Page::sizeof_persistent_header, &overflow);
+            if (st)
+                return (st);
+        }
+        if (is_free(address, m_pagesize)) {
+            ham_log(("integrity check failed: freelist page 0x%llx is "
+                    "marked as free", (unsigned long long)address));
+            return (HAM_INTEGRITY_VIOLATED);
+        }
+    }
+
+    if (is_free(0, m_pagesize)) {
+        ham_log(("integrity check failed: the header page is marked "
+                "as free"));
+        return (HAM_INTEGRITY_VIOLATED);
+    }
+
+    /* all reachable pages and their blobs must not be free */
+    std::map<ham_offset_t, node_t *>::iterator it;
+    for (it=m_nodes.begin(); it!=m_nodes.end(); it++) {
+        node_t *node=it->second;
+        if (!node->visited)
+            continue;
+        if (is_free(node->address, m_pagesize)) {
+            ham_log(("integrity check failed in page 0x%llx: page is "
+                    "marked as free", (unsigned long long)node->address));
+            return (HAM_INTEGRITY_VIOLATED);
+        }
+        for (ham_size_t i=0; i<node->blobs.size(); i++) {
+            /* a record in a slab page: the page must not be free */
+            if (SlabAllocator::is_slab_rid(node->blobs[i])
+                    ? is_free(SlabAllocator::get_page_address(node->blobs[i],
+                            m_pagesize), m_pagesize)
+                    : is_free(node->blobs[i], sizeof(blob_t))) {
+                ham_log(("integrity check failed in page 0x%llx: blob "
+                        "0x%llx is marked as free",
+                        (unsigned long long)node->address,
+                        (unsigned long long)node->blobs[i]));
+                return (HAM_INTEGRITY_VIOLATED);
+            }
+        }
+    }
+
+    return (0);
+}
+
+ham_status_t
+BtreeVerifier::read_freelist(ham_offset_t address, const ham_u8_t *payload,
+                ham_size_t payload_size, ham_offset_t *overflow)
+{
+    freelist_payload_t *fp=(freelist_payload_t *)payload;
+    ham_offset_t start=freel_get_start_address(fp);
+    ham_size_t header_size, max_bits;
+    const ham_u8_t *bitmap;
+
+    if (m_is_legacy) {
+        header_size=db_get_freelist_header_size16();
+        max_bits=freel_get_max_bits16(fp);
+        bitmap=freel_get_bitmap16(fp);
+    }
+    else {
+        header_size=db_get_freelist_header_size32();
+        max_bits=freel_get_max_bits32(fp);
+        bitmap=freel_get_bitmap32(fp);
+    }
+
+    *overflow=freel_get_overflow(fp);
+
+    /* an empty freelist in the header page is not yet initialized */
+    if (!start && !max_bits && address==0)
+        return (0);
+
+    if (start%DB_CHUNKSIZE || header_size+max_bits/8>payload_size) {
+        ham_log(("integrity check failed: freelist page 0x%llx is invalid",
+                (unsigned long long)address));
+        return (HAM_INTEGRITY_VIOLATED);
+    }
+
+    /* collect the runs of set (= free) bits */
+    ham_size_t i=0;
+    while (i<max_bits) {
+        if (!(i&7) && !bitmap[i>>3] && i+8<=max_bits) {
+            i+=8;
+            continue;
+        }
+        if (!(bitmap[i>>3]&(1<<(i&7)))) {
+            i++;
+            continue;
+        }
+        ham_size_t j=i+1;
+        while (j<max_bits && (bitmap[j>>3]&(1<<(j&7))))
+            j++;
+
+        ham_offset_t from=start+(ham_offset_t)i*DB_CHUNKSIZE;
+        ham_offset_t to=start+(ham_offset_t)j*DB_CHUNKSIZE;
+        if (is_free(from, (ham_size_t)(to-from))) {
+            ham_log(("integrity check failed: freelist page 0x%llx overlaps "
+                    "with another freelist page", (unsigned long long)address));
+            return (HAM_INTEGRITY_VIOLATED);
+        }
+        m_free[from]=to;
+        i=j;
+    }
+
+    return (0);
+}
+
+bool
+BtreeVerifier::is_free(ham_offset_t address, ham_size_t size)
+{
+    if (m_free.empty())
+        return (false);
+
+    /* the range which starts before (or at) the address */
+    std::map<ham_offset_t, ham_offset_t>::iterator it;
+    it=m_free.upper_bound(address);
+    if (it!=m_free.begin()) {
+        std::map<ham_offset_t, ham_offset_t>::iterator prev=it;
+        --prev;
+        if (prev->second>address)
+            return (true);
+    }
+
+    /* the range which starts after the address */
+    return (it!=m_free.end() && it->first<address+size);
+}
+
+ham_status_t
+BtreeVerifier::read(ham_offset_t address, void *buffer, ham_size_t size)
+{
+#if HAVE_PREAD
+    return (m_device->read_raw(address, buffer, size));
+#else
+    ScopedLock lock(m_io_mutex);
+    return (m_device->read_raw(address, buffer, size));
+#endif
+}
+
+int
+BtreeVerifier::compare(const std::vector<ham_u8_t> &lhs,
+                const std::vector<ham_u8_t> &rhs)
+{
+    return (m_compare((ham_db_t *)m_db,
+                lhs.empty() ? 0 : &lhs[0], (ham_size_t)lhs.size(),
+                rhs.empty() ? 0 : &rhs[0], (ham_size_t)rhs.size()));
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief a parallel verifier for the btree and the freelist
+ *
+ * The BtreeVerifier does not use the page cache. It reads the Database
+ * file in physical order with large sequential reads, and checks every
+ * btree node on a pool of worker threads. The results of the workers
+ * are small summaries of each node (the boundary keys, the child
+ * pointers and the referenced blobs). Afterwards the summaries are linked, starting at the root page:
+ * this verifies the parent/child and sibling pointers and the key
+ * ordering across pages. Finally, all reachable pages and blobs are
+ * cross-checked against the freelist bitmaps (or against the free
+ * extents, see freelist_extents.h).
+ *
+ * Only prepare() and is_stale() require the Environment mutex; run()
+ * works on the snapshot which was taken by prepare() and can run
+ * while other threads modify the Database. If a verification fails and
+ * the file was modified in the meantime, the caller has to repeat
+ * the verification while holding the mutex.
+ */
+
+#ifndef HAM_BTREE_VERIFY_H__
+#define HAM_BTREE_VERIFY_H__
+
+#include "internal_fwd_decl.h"
+
+#include <map>
+#include <vector>
+
+#include <ham/hamsterdb.h>
+
+class BtreeVerifier
+{
+  public:
+    /** the size of a single read */
+    enum {
+        READ_SIZE=4*1024*1024
+    };
+
+    /** constructor */
+    BtreeVerifier(Database *db);
+
+    /** destructor */
+    ~BtreeVerifier();
+
+    /**
+     * returns true if the Database can be verified by this class; the
+     * file must not be filtered (i.e. encrypted) and in-memory and remote
+     * Databases are not supported
+     */
+    static bool is_supported(Database *db);
+
+    /**
+     * flushes the Environment, verifies the cache and takes a snapshot of
+     * the metadata; requires the Environment mutex
+     */
+    ham_status_t prepare();
+
+    /** verifies the snapshot; does not require the Environment mutex */
+    ham_status_t run();
+
+    /**
+     * returns true if the file was modified after prepare() was called;
+     * requires the Environment mutex
+     */
+    bool is_stale();
+
+  private:
+    struct node_t;
+    struct chunk_t;
+
+    /** the thread function of the workers */
+    void worker();
+
+    /** verifies all pages of a chunk */
+    void process_chunk(chunk_t *chunk, std::vector<node_t *> &nodes);
+
+    /** verifies a single btree node; returns NULL if the page is
+     * not a btree node */
+    node_t *process_page(ham_offset_t address, const ham_u8_t *data);
+
+    /** verifies the links between the nodes */
+    ham_status_t verify_links();
+
+    /** verifies the freelist and checks that all used pages and blobs
+     * are not marked as free */
+    ham_status_t verify_freelist();
+
+    /** reads the freelist bitmap of a single freelist page */
+    ham_status_t read_freelist(ham_offset_t address,
+                const ham_u8_t *payload, ham_size_t payload_size,
+                ham_offset_t *overflow);
+
+    /** returns true if an address range overlaps with a free range */
+    bool is_free(ham_offset_t address, ham_size_t size);
+
+    /** reads from the file */
+    ham_status_t read(ham_offset_t address, void *buffer, ham_size_t size);
+
+    /** compares two keys; returns an error code if the compare
+     * function failed */
+    int compare(const std::vector<ham_u8_t> &lhs,
+                const std::vector<ham_u8_t> &rhs);
+
+    /** the Database */
+    Database *m_db;
+
+    /** the Device of the Environment */
+    Device *m_device;
+
+    /** the compare function of the Database */
+    ham_compare_func_t m_compare;
+
+    /** the snapshot of the metadata */
+    ham_offset_t m_filesize;
+    ham_offset_t m_rootpage;
+    ham_size_t m_pagesize;
+    ham_u16_t m_keysize;
+    ham_u16_t m_inline_size;
+    ham_u16_t m_maxkeys;
+    bool m_is_legacy;
+    bool m_has_extents;
+    ham_size_t m_freelist_offset;
+    ham_u64_t m_modification_count;
+
+    /** the number of worker threads */
+    unsigned m_threads;
+
+    /** the worker pool, protected by m_mutex */
+    Mutex m_mutex;
+    Condition m_cond;
+    std::vector<chunk_t *> m_queue;
+    std::vector<chunk_t *> m_free_chunks;
+    bool m_done;
+
+    /** serializes the file access if pread is not available */
+    Mutex m_io_mutex;
+
+    /** the verified nodes, indexed by their address */
+    std::map<ham_offset_t, node_t *> m_nodes;
+
+    /** a copy of the header page */
+    std::vector<ham_u8_t> m_header;
+
+    /** the free ranges in the file (start address -> end address) */
+    std::map<ham_offset_t, ham_offset_t> m_free;
+
+    /** a copy of the free extents (start address -> size), if the
+     * extent freelist is used; they are not persisted while the
+     * Environment is open */
+    std::map<ham_offset_t, ham_offset_t> m_extents;
+};
+
+#endif /* HAM_BTREE_VERIFY_H__ */
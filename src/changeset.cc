@@ -117,6 +117,7 @@ Changeset::flush(ham_u64_t lsn)
     m_freelists_size=0;
     m_indices_size=0;
     m_others_size=0;
+    m_pages_size=0;
 
     // first step: remove all pages that are not dirty and sort all others
     // into the buckets
@@ -140,6 +141,10 @@ Changeset::flush(ham_u64_t lsn)
                 break;
               case Page::TYPE_B_ROOT:
               case Page::TYPE_B_INDEX:
+              case Page::TYPE_H_ROOT:
+              case Page::TYPE_H_DIRECTORY:
+              case Page::TYPE_H_BUCKET:
+              case Page::TYPE_SLAB:
               case Page::TYPE_HEADER:
                 append(m_indices, m_indices_size, m_indices_capacity, p);
                 break;
@@ -151,6 +156,7 @@ Changeset::flush(ham_u64_t lsn)
                 break;
             }
         }
+        append(m_pages, m_pages_size, m_pages_capacity, p);
         page_count++;
         p=n;
 
@@ -185,9 +191,7 @@ Changeset::flush(ham_u64_t lsn)
     induce(ErrorInducer::CHANGESET_FLUSH);
 
     // now flush all modified pages to disk
-    p=m_head;
-
-    Environment *env=p->get_device()->get_env();
+    Environment *env=m_head->get_device()->get_env();
     Log *log=env->get_log();
 
     ham_assert(log!=0, (""));
@@ -198,18 +202,18 @@ Changeset::flush(ham_u64_t lsn)
     if (g_CHANGESET_POST_LOG_HOOK)
         g_CHANGESET_POST_LOG_HOOK();
     
-    /* now write all the pages to the file; if any of these writes fail,
-     * we can still recover from the log */
-    while (p) {
-        if (p->is_dirty()) {
-            st=db_flush_page(env, p);
-            if (st)
-                return (st);
-        }
-        p=p->get_next(Page::LIST_CHANGESET);
+    /* now write all the pages to the file with a single call; the device
+     * sorts them by address and writes adjacent pages together, and the
+     * file filters can process several pages at once. If any of these
+     * writes fail, we can still recover from the log. The ErrorInducer
+     * can also fail the Device between two of its writes */
+    induce(ErrorInducer::CHANGESET_FLUSH);
 
-        induce(ErrorInducer::CHANGESET_FLUSH);
-    }
+    st=db_flush_pages(env, m_pages, m_pages_size);
+    if (st)
+        return (st);
+
+    induce(ErrorInducer::CHANGESET_FLUSH);
 
     /* done - we can now clear the changeset and the log */
     clear();
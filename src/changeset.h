@@ -38,7 +38,8 @@ class Changeset
     : m_head(0), m_blobs(0), m_blobs_size(0), m_blobs_capacity(0),
       m_freelists(0), m_freelists_size(0), m_freelists_capacity(0),
       m_indices(0), m_indices_size(0), m_indices_capacity(0),
-      m_others(0), m_others_size(0), m_others_capacity(0), m_inducer(0) {
+      m_others(0), m_others_size(0), m_others_capacity(0),
+      m_pages(0), m_pages_size(0), m_pages_capacity(0), m_inducer(0) {
     }
 
     ~Changeset() {
@@ -52,6 +53,8 @@ class Changeset
             ::free(m_indices);
         if (m_others)
             ::free(m_others);
+        if (m_pages)
+            ::free(m_pages);
     }
 
     /** is the changeset empty? */
@@ -114,6 +117,11 @@ class Changeset
     ham_size_t m_others_size;
     ham_size_t m_others_capacity;
 
+    /* all dirty pages; they are written with a single call */
+    Page **m_pages;
+    ham_size_t m_pages_size;
+    ham_size_t m_pages_capacity;
+
   public:
     /* an error inducer */
     ErrorInducer *m_inducer;
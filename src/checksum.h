@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief CRC32C checksums
+ *
+ * The checksums of pages and blobs (see @ref HAM_ENABLE_CRC32) use the
+ * CRC32C (Castagnoli) polynomial. If the CPU supports SSE4.2 then the
+ * crc32 instruction is used; otherwise a table driven implementation.
+ */
+
+#ifndef HAM_CHECKSUM_H__
+#define HAM_CHECKSUM_H__
+
+#include <ham/hamsterdb.h>
+
+/**
+ * calculates the CRC32C of @a size bytes; @a crc is the checksum of the
+ * preceding data (or 0), therefore the checksum of a buffer can be
+ * calculated in several steps
+ */
+extern ham_u32_t
+crc32c(ham_u32_t crc, const void *data, ham_size_t size);
+
+/** same as @ref crc32c, but never uses the SSE4.2 instructions */
+extern ham_u32_t
+crc32c_portable(ham_u32_t crc, const void *data, ham_size_t size);
+
+/** returns true if the CPU supports the SSE4.2 crc32 instruction */
+extern bool
+crc32c_has_sse42();
+
+#endif /* HAM_CHECKSUM_H__ */
@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief implementation of cipher.h
+ *
+ */
+
+#include "config.h"
+
+#ifndef HAM_DISABLE_ENCRYPTION
+
+#include <string.h>
+
+#include "cipher.h"
+#include "error.h"
+#include "../3rdparty/aes/aes.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  include <cpuid.h>
+#  include <wmmintrin.h>
+#  define HAM_HAVE_AESNI 1
+#  define AESNI_TARGET __attribute__((target("aes,sse2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  include <intrin.h>
+#  include <wmmintrin.h>
+#  define HAM_HAVE_AESNI 1
+#  define AESNI_TARGET
+#endif
+
+/** multiplies a tweak with the primitive element of GF(2^128) */
+static void
+__mul_alpha(ham_u8_t tweak[16])
+{
+    ham_u8_t carry=0;
+    for (int i=0; i<16; i++) {
+        ham_u8_t c=tweak[i]>>7;
+        tweak[i]=(ham_u8_t)((tweak[i]<<1)|carry);
+        carry=c;
+    }
+    if (carry)
+        tweak[0]^=0x87;
+}
+
+/** the portable implementation: en- or decrypts the blocks of one page,
+ * starting with the tweak of block @a first */
+static void
+__crypt_portable(ham_u8_t *schedule, const ham_u8_t initial[16],
+                ham_size_t first, ham_u8_t *data, ham_size_t blocks,
+                bool encrypt)
+{
+    ham_u8_t tweak[16], block[16];
+    ham_size_t i;
+
+    memcpy(tweak, initial, sizeof(tweak));
+    for (i=0; i<first; i++)
+        __mul_alpha(tweak);
+
+    for (i=0; i<blocks; i++, data+=16) {
+        for (int j=0; j<16; j++)
+            block[j]=data[j]^tweak[j];
+        if (encrypt)
+            aes_encrypt(block, schedule, block);
+        else
+            aes_decrypt(block, schedule, block);
+        for (int j=0; j<16; j++)
+            data[j]=block[j]^tweak[j];
+        __mul_alpha(tweak);
+    }
+}
+
+#ifdef HAM_HAVE_AESNI
+
+AESNI_TARGET static inline __m128i
+__mul_alpha_sse(__m128i t)
+{
+    /* shift every 32bit lane left by one and carry the top bit of each
+     * lane into the next one; the carry of the top lane is reduced
+     * with the polynomial x^128+x^7+x^2+x+1 */
+    __m128i carry=_mm_srai_epi32(t, 31);
+    carry=_mm_shuffle_epi32(carry, 0x93);
+    carry=_mm_and_si128(carry, _mm_set_epi32(1, 1, 1, 0x87));
+    return (_mm_xor_si128(_mm_add_epi32(t, t), carry));
+}
+
+AESNI_TARGET static inline __m128i
+__encrypt_block(const __m128i *rk, __m128i b)
+{
+    b=_mm_xor_si128(b, rk[0]);
+    for (int r=1; r<10; r++)
+        b=_mm_aesenc_si128(b, rk[r]);
+    return (_mm_aesenclast_si128(b, rk[10]));
+}
+
+/**
+ * the AES-NI implementation; four blocks are processed together to
+ * fill the pipeline of the AES unit
+ */
+AESNI_TARGET static void
+__crypt_aesni(const ham_u8_t *schedule, const ham_u8_t initial[16],
+                ham_size_t first, ham_u8_t *data, ham_size_t blocks,
+                bool encrypt)
+{
+    __m128i rk[11];
+    __m128i t=_mm_loadu_si128((const __m128i *)initial);
+    ham_size_t i;
+    int r;
+
+    for (r=0; r<11; r++)
+        rk[r]=_mm_loadu_si128((const __m128i *)&schedule[r*16]);
+
+    for (i=0; i<first; i++)
+        t=__mul_alpha_sse(t);
+
+    for (i=0; i+4<=blocks; i+=4, data+=64) {
+        __m128i t0=t;
+        __m128i t1=__mul_alpha_sse(t0);
+        __m128i t2=__mul_alpha_sse(t1);
+        __m128i t3=__mul_alpha_sse(t2);
+        t=__mul_alpha_sse(t3);
+
+        __m128i b0=_mm_xor_si128(_mm_loadu_si128((__m128i *)&data[0]), t0);
+        __m128i b1=_mm_xor_si128(_mm_loadu_si128((__m128i *)&data[16]), t1);
+        __m128i b2=_mm_xor_si128(_mm_loadu_si128((__m128i *)&data[32]), t2);
+        __m128i b3=_mm_xor_si128(_mm_loadu_si128((__m128i *)&data[48]), t3);
+
+        b0=_mm_xor_si128(b0, rk[0]);
+        b1=_mm_xor_si128(b1, rk[0]);
+        b2=_mm_xor_si128(b2, rk[0]);
+        b3=_mm_xor_si128(b3, rk[0]);
+        if (encrypt) {
+            for (r=1; r<10; r++) {
+                b0=_mm_aesenc_si128(b0, rk[r]);
+                b1=_mm_aesenc_si128(b1, rk[r]);
+                b2=_mm_aesenc_si128(b2, rk[r]);
+                b3=_mm_aesenc_si128(b3, rk[r]);
+            }
+            b0=_mm_aesenclast_si128(b0, rk[10]);
+            b1=_mm_aesenclast_si128(b1, rk[10]);
+            b2=_mm_aesenclast_si128(b2, rk[10]);
+            b3=_mm_aesenclast_si128(b3, rk[10]);
+        }
+        else {
+            for (r=1; r<10; r++) {
+                b0=_mm_aesdec_si128(b0, rk[r]);
+                b1=_mm_aesdec_si128(b1, rk[r]);
+                b2=_mm_aesdec_si128(b2, rk[r]);
+                b3=_mm_aesdec_si128(b3, rk[r]);
+            }
+            b0=_mm_aesdeclast_si128(b0, rk[10]);
+            b1=_mm_aesdeclast_si128(b1, rk[10]);
+            b2=_mm_aesdeclast_si128(b2, rk[10]);
+            b3=_mm_aesdeclast_si128(b3, rk[10]);
+        }
+
+        _mm_storeu_si128((__m128i *)&data[0], _mm_xor_si128(b0, t0));
+        _mm_storeu_si128((__m128i *)&data[16], _mm_xor_si128(b1, t1));
+        _mm_storeu_si128((__m128i *)&data[32], _mm_xor_si128(b2, t2));
+        _mm_storeu_si128((__m128i *)&data[48], _mm_xor_si128(b3, t3));
+    }
+
+    for (; i<blocks; i++, data+=16) {
+        __m128i b=_mm_xor_si128(_mm_loadu_si128((__m128i *)data), t);
+        b=_mm_xor_si128(b, rk[0]);
+        if (encrypt) {
+            for (r=1; r<10; r++)
+                b=_mm_aesenc_si128(b, rk[r]);
+            b=_mm_aesenclast_si128(b, rk[10]);
+        }
+        else {
+            for (r=1; r<10; r++)
+                b=_mm_aesdec_si128(b, rk[r]);
+            b=_mm_aesdeclast_si128(b, rk[10]);
+        }
+        _mm_storeu_si128((__m128i *)data, _mm_xor_si128(b, t));
+        t=__mul_alpha_sse(t);
+    }
+}
+
+/** derives the decryption key schedule for _mm_aesdec_si128 */
+AESNI_TARGET static void
+__invert_schedule(const ham_u8_t *enc, ham_u8_t *dec)
+{
+    _mm_storeu_si128((__m128i *)&dec[0],
+                _mm_loadu_si128((const __m128i *)&enc[10*16]));
+    for (int r=1; r<10; r++)
+        _mm_storeu_si128((__m128i *)&dec[r*16],
+                _mm_aesimc_si128(
+                    _mm_loadu_si128((const __m128i *)&enc[(10-r)*16])));
+    _mm_storeu_si128((__m128i *)&dec[10*16],
+                _mm_loadu_si128((const __m128i *)&enc[0]));
+}
+
+/** encrypts the initial tweaks of several pages */
+AESNI_TARGET static void
+__encrypt_tweaks_aesni(const ham_u8_t *schedule, ham_u8_t *tweaks,
+                ham_size_t count)
+{
+    __m128i rk[11];
+    ham_size_t i;
+
+    for (int r=0; r<11; r++)
+        rk[r]=_mm_loadu_si128((const __m128i *)&schedule[r*16]);
+    for (i=0; i<count; i++) {
+        __m128i b=_mm_loadu_si128((__m128i *)&tweaks[i*16]);
+        _mm_storeu_si128((__m128i *)&tweaks[i*16], __encrypt_block(rk, b));
+    }
+}
+
+#endif /* HAM_HAVE_AESNI */
+
+bool
+PageCipher::cpu_has_aesni()
+{
+#if defined(HAM_HAVE_AESNI) && defined(__GNUC__)
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return (false);
+    return ((ecx&bit_AES) && (edx&bit_SSE2));
+#elif defined(HAM_HAVE_AESNI)
+    int info[4];
+    __cpuid(info, 1);
+    return ((info[2]&(1<<25))!=0);
+#else
+    return (false);
+#endif
+}
+
+PageCipher::PageCipher(const ham_u8_t key[16], ham_size_t pagesize,
+                bool use_aesni)
+  : m_pagesize(pagesize), m_aesni(use_aesni && cpu_has_aesni())
+{
+    ham_u8_t k[16];
+
+    ham_assert(pagesize%BLOCK_SIZE==0, ("bogus pagesize"));
+
+    memcpy(k, key, sizeof(k));
+    aes_expand_key(k, m_enc_schedule);
+
+    /* XTS requires a second key for the tweaks; it is derived from the
+     * data key, because the API only accepts one 128bit key */
+    memset(k, 0x5c, sizeof(k));
+    aes_encrypt(k, m_enc_schedule, k);
+    aes_expand_key(k, m_tweak_schedule);
+    memset(k, 0, sizeof(k));
+
+    memset(m_dec_schedule, 0, sizeof(m_dec_schedule));
+#ifdef HAM_HAVE_AESNI
+    if (m_aesni)
+        __invert_schedule(m_enc_schedule, m_dec_schedule);
+#endif
+}
+
+PageCipher::~PageCipher()
+{
+    /* destroy the secret keys in RAM */
+    memset(m_enc_schedule, 0, sizeof(m_enc_schedule));
+    memset(m_dec_schedule, 0, sizeof(m_dec_schedule));
+    memset(m_tweak_schedule, 0, sizeof(m_tweak_schedule));
+}
+
+void
+PageCipher::get_tweak(ham_offset_t address, ham_u8_t tweak[16])
+{
+    /* the data unit number is the page address in little endian */
+    memset(tweak, 0, 16);
+    for (int i=0; i<8; i++)
+        tweak[i]=(ham_u8_t)(address>>(i*8));
+    aes_encrypt(tweak, m_tweak_schedule, tweak);
+}
+
+void
+PageCipher::crypt(ham_offset_t offset, ham_u8_t *data, ham_size_t size,
+                bool encrypt)
+{
+    ham_u8_t tweak[16];
+
+    ham_assert(offset%BLOCK_SIZE==0, ("unaligned offset"));
+    ham_assert(size%BLOCK_SIZE==0, ("unaligned size"));
+
+    while (size) {
+        ham_offset_t address=offset-(offset%m_pagesize);
+        ham_size_t first=(ham_size_t)(offset-address)/BLOCK_SIZE;
+        ham_size_t s=(ham_size_t)(address+m_pagesize-offset);
+        if (s>size)
+            s=size;
+
+        get_tweak(address, tweak);
+#ifdef HAM_HAVE_AESNI
+        if (m_aesni)
+            __crypt_aesni(encrypt ? m_enc_schedule : m_dec_schedule,
+                        tweak, first, data, s/BLOCK_SIZE, encrypt);
+        else
+#endif
+            __crypt_portable(m_enc_schedule, tweak, first, data,
+                        s/BLOCK_SIZE, encrypt);
+
+        offset+=s;
+        data+=s;
+        size-=s;
+    }
+}
+
+void
+PageCipher::crypt_pages(const ham_offset_t *addresses, ham_u8_t **pages,
+                ham_size_t count, bool encrypt)
+{
+    ham_u8_t tweaks[16*16];
+
+    while (count) {
+        ham_size_t n=count<16 ? count : 16;
+        ham_size_t i;
+
+#ifdef HAM_HAVE_AESNI
+        if (m_aesni) {
+            memset(tweaks, 0, n*16);
+            for (i=0; i<n; i++)
+                for (int j=0; j<8; j++)
+                    tweaks[i*16+j]=(ham_u8_t)(addresses[i]>>(j*8));
+            __encrypt_tweaks_aesni(m_tweak_schedule, tweaks, n);
+            for (i=0; i<n; i++)
+                __crypt_aesni(encrypt ? m_enc_schedule : m_dec_schedule,
+                        &tweaks[i*16], 0, pages[i], m_pagesize/BLOCK_SIZE,
+                        encrypt);
+        }
+        else
+#endif
+        {
+            for (i=0; i<n; i++) {
+                get_tweak(addresses[i], &tweaks[i*16]);
+                __crypt_portable(m_enc_schedule, &tweaks[i*16], 0, pages[i],
+                        m_pagesize/BLOCK_SIZE, encrypt);
+            }
+        }
+
+        addresses+=n;
+        pages+=n;
+        count-=n;
+    }
+}
+
+#endif /* !HAM_DISABLE_ENCRYPTION */
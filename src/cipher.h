@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief AES-XTS page encryption
+ *
+ * The PageCipher encrypts pages with AES-128 in XTS mode (IEEE 1619).
+ * Every page is a data unit, and the tweak of the data unit is derived
+ * from the page address. Every 16 byte block of a page is encrypted
+ * independently of the other blocks; therefore several blocks can be
+ * pipelined, and any 16 byte aligned part of a page can be decrypted
+ * on its own.
+ *
+ * If the CPU supports the AES-NI instructions then they are used;
+ * otherwise the portable implementation in 3rdparty/aes is used. Both
+ * produce identical results.
+ *
+ * The PageCipher is installed as a file filter by
+ * @ref ham_env_enable_encryption with @ref HAM_ENCRYPTION_XTS; the
+ * filter is marked with @ref PageCipher::FILTER_FLAG, and the Device
+ * calls the PageCipher directly because the file filter callbacks do
+ * not know the file offset.
+ */
+
+#ifndef HAM_CIPHER_H__
+#define HAM_CIPHER_H__
+
+#include <ham/hamsterdb.h>
+
+class PageCipher
+{
+  public:
+    enum {
+        /** the size of an AES block */
+        BLOCK_SIZE=16,
+
+        /** the size of the AES-128 key schedule (11 round keys) */
+        SCHEDULE_SIZE=11*16,
+
+        /** ham_file_filter_t::_flags of a PageCipher filter */
+        FILTER_FLAG=0x1000
+    };
+
+    /**
+     * constructor; @a key is a 128bit AES key. If @a use_aesni is false
+     * then the portable implementation is used even if the CPU supports
+     * AES-NI
+     */
+    PageCipher(const ham_u8_t key[16], ham_size_t pagesize,
+                bool use_aesni=true);
+
+    /** destructor; wipes the key schedules */
+    ~PageCipher();
+
+    /** returns true if the CPU supports the AES-NI instructions */
+    static bool cpu_has_aesni();
+
+    /** returns true if this cipher uses the AES-NI instructions */
+    bool uses_aesni() const {
+        return (m_aesni);
+    }
+
+    /**
+     * encrypts @a size bytes of the file at @a offset in place; offset
+     * and size must be multiples of @ref BLOCK_SIZE
+     */
+    void encrypt(ham_offset_t offset, ham_u8_t *data, ham_size_t size) {
+        crypt(offset, data, size, true);
+    }
+
+    /** decrypts @a size bytes of the file at @a offset in place */
+    void decrypt(ham_offset_t offset, ham_u8_t *data, ham_size_t size) {
+        crypt(offset, data, size, false);
+    }
+
+    /**
+     * encrypts @a count whole pages; the tweaks of the pages are
+     * computed together
+     */
+    void encrypt_pages(const ham_offset_t *addresses, ham_u8_t **pages,
+                ham_size_t count) {
+        crypt_pages(addresses, pages, count, true);
+    }
+
+    /** decrypts @a count whole pages */
+    void decrypt_pages(const ham_offset_t *addresses, ham_u8_t **pages,
+                ham_size_t count) {
+        crypt_pages(addresses, pages, count, false);
+    }
+
+  private:
+    /** en- or decrypts a region which can span several pages */
+    void crypt(ham_offset_t offset, ham_u8_t *data, ham_size_t size,
+                bool encrypt);
+
+    /** en- or decrypts whole pages */
+    void crypt_pages(const ham_offset_t *addresses, ham_u8_t **pages,
+                ham_size_t count, bool encrypt);
+
+    /** computes the initial tweak of the page at @a address */
+    void get_tweak(ham_offset_t address, ham_u8_t tweak[16]);
+
+    /** the size of a data unit */
+    ham_size_t m_pagesize;
+
+    /** true if AES-NI is used */
+    bool m_aesni;
+
+    /** the encryption key schedule of the data key */
+    ham_u8_t m_enc_schedule[SCHEDULE_SIZE];
+
+    /** the decryption key schedule of the data key (AES-NI only) */
+    ham_u8_t m_dec_schedule[SCHEDULE_SIZE];
+
+    /** the encryption key schedule of the tweak key */
+    ham_u8_t m_tweak_schedule[SCHEDULE_SIZE];
+};
+
+#endif /* HAM_CIPHER_H__ */
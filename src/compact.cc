@@ -0,0 +1,985 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief implementation of the online compaction
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <algorithm>
+#include <set>
+
+#include "blob.h"
+#include "bloom.h"
+#include "btree.h"
+#include "btree_cursor.h"
+#include "btree_key.h"
+#include "btree_stats.h"
+#include "cache.h"
+#include "compact.h"
+#include "cursor.h"
+#include "db.h"
+#include "device.h"
+#include "env.h"
+#include "error.h"
+#include "extkeys.h"
+#include "freelist.h"
+#include "page.h"
+#include "slab.h"
+
+/** the lsn of a changeset which is flushed without Transactions */
+#define DUMMY_LSN       1
+
+Compactor::Compactor(Environment *env)
+  : m_env(env), m_valid(false), m_modification_count(0)
+{
+    memset(&m_progress, 0, sizeof(m_progress));
+}
+
+Compactor::~Compactor()
+{
+}
+
+bool
+Compactor::is_supported(Environment *env)
+{
+    if (env->get_flags()&(HAM_IN_MEMORY_DB|DB_IS_REMOTE))
+        return (false);
+    return (true);
+}
+
+ham_status_t
+Compactor::run(ham_u32_t max_moves, ham_compact_progress_t *progress)
+{
+    ham_status_t st;
+    ham_u32_t moves=0;
+    bool done=false;
+    Device *device=m_env->get_device();
+
+    /* write all modified pages; the scan and the moves expect that
+     * the file is up-to-date */
+    st=m_env->_fun_flush(m_env, 0);
+    if (st)
+        return (st);
+
+    st=open_databases();
+
+    /* rebuild the map if the file was modified by someone else */
+    if (!st && (!m_valid
+                || device->get_modification_count()!=m_modification_count))
+        st=build_map();
+
+    while (!st && !done && moves<max_moves)
+        st=shrink(max_moves, &moves, &done);
+
+    /* the moved pages and blobs might have been cached by cursors
+     * which point to a duplicate */
+    if (!st && moves) {
+        std::map<ham_u16_t, Database *>::iterator it;
+        for (it=m_dbs.begin(); it!=m_dbs.end(); it++) {
+            for (Cursor *c=it->second->get_cursors(); c; c=c->get_next())
+                memset(btree_cursor_get_dupe_cache(c->get_btree_cursor()),
+                        0, sizeof(dupe_entry_t));
+        }
+    }
+
+    /* write the changes */
+    if (!st)
+        st=flush_changeset();
+    if (!st)
+        st=m_env->_fun_flush(m_env, 0);
+    if (st) {
+        m_env->get_changeset().clear();
+        m_valid=false;
+    }
+
+    close_databases();
+    m_modification_count=device->get_modification_count();
+
+    if (st)
+        return (st);
+
+    st=device->get_filesize(&m_progress.filesize);
+    if (st)
+        return (st);
+    m_progress.done=done ? HAM_TRUE : HAM_FALSE;
+    if (progress)
+        *progress=m_progress;
+    return (0);
+}
+
+ham_status_t
+Compactor::open_databases()
+{
+    ham_status_t st;
+
+    m_dbs.clear();
+    for (Database *db=m_env->get_databases(); db; db=db->get_next())
+        m_dbs[db->get_name()]=db;
+
+    /* temporarily open all other Databases */
+    for (ham_size_t i=0; i<m_env->get_max_databases(); i++) {
+        ham_u16_t name=index_get_dbname(m_env->get_indexdata_ptr(i));
+        if (name==0 || m_dbs.find(name)!=m_dbs.end())
+            continue;
+
+        Database *db;
+        st=ham_new((ham_db_t **)&db);
+        if (st)
+            return (st);
+        st=ham_env_open_db((ham_env_t *)m_env, (ham_db_t *)db, name,
+                    HAM_DONT_LOCK, 0);
+        if (st) {
+            delete db;
+            return (st);
+        }
+        m_temp_dbs.push_back(db);
+        m_dbs[name]=db;
+    }
+
+    return (0);
+}
+
+void
+Compactor::close_databases()
+{
+    for (ham_size_t i=0; i<m_temp_dbs.size(); i++) {
+        (void)ham_close((ham_db_t *)m_temp_dbs[i], HAM_DONT_LOCK);
+        delete m_temp_dbs[i];
+    }
+    m_temp_dbs.clear();
+    m_dbs.clear();
+}
+
+Database *
+Compactor::get_db(ham_u16_t dbname)
+{
+    std::map<ham_u16_t, Database *>::iterator it=m_dbs.find(dbname);
+    return (it==m_dbs.end() ? 0 : it->second);
+}
+
+ham_status_t
+Compactor::build_map()
+{
+    ham_status_t st;
+    Page *page;
+    ham_offset_t owner=0;
+
+    m_extents.clear();
+    m_children.clear();
+    m_valid=false;
+
+    /* the header page is never moved, but it's counted */
+    m_progress.live_size=m_env->get_pagesize();
+
+    /* the freelist pages are linked, starting in the header page */
+    ham_offset_t overflow=freel_get_overflow(m_env->get_freelist());
+    while (overflow) {
+        st=add_extent(overflow, TYPE_FREELIST, 0, m_env->get_pagesize(),
+                    owner);
+        if (st)
+            return (st);
+        st=env_fetch_page(&page, m_env, overflow, 0);
+        if (!page)
+            return (st ? st : HAM_INTERNAL_ERROR);
+        owner=overflow;
+        overflow=freel_get_overflow(page_get_freelist(page));
+        st=purge_cache();
+        if (st)
+            return (st);
+    }
+
+    /* the btrees and their blobs */
+    std::map<ham_u16_t, Database *>::iterator it;
+    for (it=m_dbs.begin(); it!=m_dbs.end(); it++) {
+        st=scan_tree(it->second);
+        if (st)
+            return (st);
+
+        BloomFilter *filter=it->second->get_bloom_filter();
+        if (filter && filter->get_blobid()) {
+            ham_offset_t size;
+            st=blob_get_allocated_size(m_env, filter->get_blobid(), &size);
+            if (!st)
+                st=add_extent(filter->get_blobid(), TYPE_BLOOM, it->first,
+                            size, 0);
+            if (st)
+                return (st);
+        }
+    }
+
+    m_valid=true;
+    return (0);
+}
+
+ham_status_t
+Compactor::scan_tree(Database *db)
+{
+    ham_status_t st;
+    ham_u16_t dbname=db->get_name();
+    std::vector<std::pair<ham_offset_t, ham_offset_t> > stack;
+    std::vector<ham_offset_t> blobs, tables;
+
+    /* the pages of a hash index are not tracked */
+    if (db->get_rt_flags()&HAM_USE_HASH) {
+        ham_trace(("hash Databases cannot be compacted"));
+        return (HAM_NOT_IMPLEMENTED);
+    }
+
+    BtreeBackend *be=(BtreeBackend *)db->get_backend();
+    if (!be || !be->is_active() || !be->get_rootpage())
+        return (0);
+
+    /* each entry is a page and its parent */
+    stack.push_back(std::make_pair(be->get_rootpage(), (ham_offset_t)0));
+
+    while (!stack.empty()) {
+        ham_offset_t address=stack.back().first;
+        Page *page;
+
+        st=add_extent(address, TYPE_NODE, dbname, m_env->get_pagesize(),
+                    stack.back().second);
+        stack.pop_back();
+        if (st)
+            return (st);
+
+        st=db_fetch_page(&page, db, address, 0);
+        if (!page)
+            return (st ? st : HAM_INTERNAL_ERROR);
+
+        /* collect the children and the blobs of this node */
+        btree_node_t *node=page_get_btree_node(page);
+        bool leaf=btree_node_is_leaf(node) ? true : false;
+        blobs.clear();
+        tables.clear();
+        if (!leaf)
+            stack.push_back(std::make_pair(
+                        (ham_offset_t)btree_node_get_ptr_left(node), address));
+        for (ham_size_t i=0; i<btree_node_get_count(node); i++) {
+            btree_key_t *bte=btree_node_get_key(db, node, i);
+            ham_u8_t flags=key_get_flags(bte);
+
+            if (flags&KEY_IS_EXTENDED)
+                blobs.push_back(key_get_extended_rid(db, bte));
+
+            if (!leaf)
+                stack.push_back(std::make_pair((ham_offset_t)key_get_ptr(bte),
+                            address));
+            else if (!(flags&(KEY_BLOB_SIZE_TINY|KEY_BLOB_SIZE_SMALL
+                            |KEY_BLOB_SIZE_EMPTY|KEY_BLOB_SIZE_INLINE))
+                    && key_get_ptr(bte)) {
+                if (flags&KEY_HAS_DUPLICATES)
+                    tables.push_back(key_get_ptr(bte));
+                else
+                    blobs.push_back(key_get_ptr(bte));
+            }
+        }
+
+        /* the node is no longer needed; the blob headers are read
+         * afterwards */
+        st=purge_cache();
+        if (st)
+            return (st);
+
+        for (ham_size_t i=0; i<blobs.size(); i++) {
+            ham_offset_t size;
+            if (SlabAllocator::is_slab_rid(blobs[i])) {
+                st=add_slab_page(dbname, blobs[i]);
+                if (st)
+                    return (st);
+                continue;
+            }
+            st=blob_get_allocated_size(m_env, blobs[i], &size);
+            if (!st)
+                st=add_extent(blobs[i], TYPE_BLOB, dbname, size, address);
+            if (!st)
+                st=purge_cache();
+            if (st)
+                return (st);
+        }
+
+        for (ham_size_t i=0; i<tables.size(); i++) {
+            ham_offset_t size;
+            st=blob_get_allocated_size(m_env, tables[i], &size);
+            if (!st)
+                st=add_extent(tables[i], TYPE_DUPE_TABLE, dbname, size,
+                        address);
+            if (!st)
+                st=scan_duplicates(dbname, tables[i]);
+            if (st)
+                return (st);
+        }
+    }
+
+    return (0);
+}
+
+ham_status_t
+Compactor::scan_duplicates(ham_u16_t dbname, ham_offset_t table_id)
+{
+    ham_status_t st;
+    std::vector<ham_offset_t> nodes;
+    std::vector<ham_offset_t> rids;
+
+    st=blob_duplicate_get_references(m_env, table_id, nodes, rids);
+    if (st)
+        return (st);
+
+    for (ham_size_t i=0; i<rids.size(); i++) {
+        ham_offset_t size;
+        if (SlabAllocator::is_slab_rid(rids[i])) {
+            st=add_slab_page(dbname, rids[i]);
+            if (st)
+                return (st);
+            continue;
+        }
+        st=blob_get_allocated_size(m_env, rids[i], &size);
+        if (!st)
+            st=add_extent(rids[i], TYPE_BLOB, dbname, size, table_id);
+        if (!st)
+            st=purge_cache();
+        if (st)
+            return (st);
+    }
+
+    /* the nodes of a duplicate tree are owned by their parent node */
+    for (ham_size_t i=0; i<nodes.size(); i++) {
+        ham_offset_t size;
+        st=blob_get_allocated_size(m_env, nodes[i], &size);
+        if (!st)
+            st=add_extent(nodes[i], TYPE_DUPE_TABLE, dbname, size, table_id);
+        if (!st)
+            st=scan_duplicates(dbname, nodes[i]);
+        if (st)
+            return (st);
+    }
+
+    return (purge_cache());
+}
+
+ham_status_t
+Compactor::add_slab_page(ham_u16_t dbname, ham_offset_t rid)
+{
+    ham_offset_t address=SlabAllocator::get_page_address(rid,
+                m_env->get_pagesize());
+
+    if (m_extents.find(address)!=m_extents.end())
+        return (0);
+    return (add_extent(address, TYPE_SLAB, dbname, m_env->get_pagesize(), 0));
+}
+
+ham_status_t
+Compactor::add_extent(ham_offset_t address, ham_u32_t type,
+                ham_u16_t dbname, ham_offset_t size, ham_offset_t owner)
+{
+    extent_t extent;
+    extent.type=type;
+    extent.dbname=dbname;
+    extent.size=size;
+    extent.owner=owner;
+
+    if (!m_extents.insert(std::make_pair(address, extent)).second) {
+        ham_log(("compaction failed: address 0x%llx is referenced twice",
+                (unsigned long long)address));
+        return (HAM_INTEGRITY_VIOLATED);
+    }
+    m_children.insert(std::make_pair(owner, address));
+    m_progress.live_size+=size;
+    return (0);
+}
+
+ham_status_t
+Compactor::purge_cache()
+{
+    /* the scan does not modify any page, therefore the pages which
+     * were added to the changeset can be discarded */
+    if (m_env->get_flags()&HAM_ENABLE_RECOVERY)
+        m_env->get_changeset().clear();
+
+    if (!m_env->get_cache()->is_too_big())
+        return (0);
+    return (env_purge_cache(m_env));
+}
+
+ham_status_t
+Compactor::shrink(ham_u32_t max_moves, ham_u32_t *moves, bool *done)
+{
+    ham_status_t st;
+    ham_offset_t filesize;
+    ham_size_t pagesize=m_env->get_pagesize();
+
+    st=m_env->get_device()->get_filesize(&filesize);
+    if (st)
+        return (st);
+
+    /* first truncate all unused pages at the end of the file; this
+     * does not require any moves */
+    ham_offset_t used=pagesize;
+    if (!m_extents.empty()) {
+        ExtentMap::reverse_iterator last=m_extents.rbegin();
+        if (last->first+last->second.size>used)
+            used=last->first+last->second.size;
+        used+=pagesize-1;
+        used-=used%pagesize;
+    }
+    if (used<filesize) {
+        st=freel_claim_area(m_env, 0, used, (ham_size_t)(filesize-used));
+        if (st)
+            return (st);
+        return (truncate(used));
+    }
+
+    /* the header page is never moved */
+    if (filesize<=pagesize || filesize%pagesize) {
+        *done=true;
+        return (0);
+    }
+
+    /* otherwise move everything away from the last page; its free
+     * chunks are taken from the freelist, therefore the new locations
+     * are always in front of the last page */
+    ham_offset_t address=filesize-pagesize;
+    st=freel_claim_area(m_env, 0, address, pagesize);
+    if (st)
+        return (st);
+
+    while (true) {
+        ExtentMap::iterator it=find_overlap(address);
+        if (it==m_extents.end())
+            break;
+        if (*moves>=max_moves)
+            return (release(address, filesize));
+
+        /* slab pages are never moved */
+        if (it->second.type==TYPE_SLAB) {
+            *done=true;
+            return (release(address, filesize));
+        }
+
+        ham_offset_t oldaddr=it->first;
+        extent_t extent=it->second;
+        ham_offset_t newaddr=0;
+        bool is_page=(extent.type==TYPE_NODE || extent.type==TYPE_FREELIST);
+
+        if (is_page) {
+            st=freel_alloc_page(&newaddr, m_env, get_db(extent.dbname));
+            if (!st && !newaddr)
+                st=evacuate_page(address, max_moves, moves, &newaddr);
+            if (!st && !newaddr && *moves>=max_moves)
+                return (release(address, filesize));
+        }
+        else {
+            st=freel_alloc_area(&newaddr, m_env, get_db(extent.dbname),
+                        (ham_size_t)extent.size);
+            /* a blob which fits into a page can be moved to the start
+             * of an evacuated page, like a newly allocated blob */
+            if (!st && !newaddr && extent.size<=pagesize) {
+                st=evacuate_page(address, max_moves, moves, &newaddr);
+                if (!st && newaddr && extent.size<pagesize)
+                    st=freel_mark_free(m_env, get_db(extent.dbname),
+                            newaddr+extent.size,
+                            (ham_size_t)(pagesize-extent.size), HAM_FALSE);
+                if (!st && !newaddr && *moves>=max_moves)
+                    return (release(address, filesize));
+            }
+        }
+        if (st)
+            return (st);
+
+        /* no more free space: the file cannot shrink any further */
+        if (!newaddr) {
+            *done=true;
+            return (release(address, filesize));
+        }
+        ham_assert(newaddr+extent.size<=address, (""));
+
+        st=move(oldaddr, &extent, newaddr);
+        if (st)
+            return (st);
+        (*moves)++;
+        if (is_page)
+            m_progress.pages_moved++;
+        else
+            m_progress.blobs_moved++;
+
+        /* a blob can start in front of the last page; this part is
+         * released */
+        if (oldaddr<address) {
+            st=freel_mark_free(m_env, get_db(extent.dbname), oldaddr,
+                    (ham_size_t)(address-oldaddr), HAM_FALSE);
+            if (st)
+                return (st);
+        }
+    }
+
+    return (truncate(address));
+}
+
+ham_status_t
+Compactor::evacuate_page(ham_offset_t limit, ham_u32_t max_moves,
+                ham_u32_t *moves, ham_offset_t *page)
+{
+    ham_status_t st;
+    ham_size_t pagesize=m_env->get_pagesize();
+    std::map<ham_offset_t, ham_offset_t> live;
+    std::set<ham_offset_t> excluded;
+
+    *page=0;
+
+    /* count the used bytes of all pages which only store blobs */
+    for (ExtentMap::iterator it=m_extents.begin();
+            it!=m_extents.end() && it->first<limit; it++) {
+        ham_offset_t end=it->first+it->second.size;
+        bool is_page=(it->second.type==TYPE_NODE
+                || it->second.type==TYPE_FREELIST
+                || it->second.type==TYPE_SLAB);
+        for (ham_offset_t p=it->first-it->first%pagesize; p<end;
+                p+=pagesize) {
+            if (is_page || end>limit)
+                excluded.insert(p);
+            else
+                live[p]+=std::min(p+pagesize, end)-std::max(p, it->first);
+        }
+    }
+
+    ham_offset_t victim=0, min=0;
+    std::map<ham_offset_t, ham_offset_t>::iterator it;
+    for (it=live.begin(); it!=live.end(); it++) {
+        if (it->first==0 || it->first+pagesize>limit
+                || excluded.find(it->first)!=excluded.end())
+            continue;
+        if (!victim || it->second<min) {
+            victim=it->first;
+            min=it->second;
+        }
+    }
+    if (!victim)
+        return (0);
+
+    /* take the free chunks of the page from the freelist, then move
+     * the blobs to other pages */
+    st=freel_claim_area(m_env, 0, victim, pagesize);
+    if (st)
+        return (st);
+
+    while (true) {
+        ExtentMap::iterator e=find_overlap(victim);
+        if (e==m_extents.end() || e->first>=victim+pagesize)
+            break;
+        if (*moves>=max_moves)
+            return (release(victim, victim+pagesize));
+
+        ham_offset_t oldaddr=e->first;
+        extent_t extent=e->second;
+        ham_offset_t newaddr=0;
+        st=freel_alloc_area(&newaddr, m_env, get_db(extent.dbname),
+                    (ham_size_t)extent.size);
+        if (st)
+            return (st);
+        if (!newaddr)
+            return (release(victim, victim+pagesize));
+
+        st=move(oldaddr, &extent, newaddr);
+        if (st)
+            return (st);
+        (*moves)++;
+        m_progress.blobs_moved++;
+
+        /* the blob can overlap with the neighbour pages */
+        if (oldaddr<victim) {
+            st=freel_mark_free(m_env, get_db(extent.dbname), oldaddr,
+                    (ham_size_t)(victim-oldaddr), HAM_FALSE);
+            if (st)
+                return (st);
+        }
+        if (oldaddr+extent.size>victim+pagesize) {
+            st=freel_mark_free(m_env, get_db(extent.dbname),
+                    victim+pagesize,
+                    (ham_size_t)(oldaddr+extent.size-victim-pagesize),
+                    HAM_FALSE);
+            if (st)
+                return (st);
+        }
+    }
+
+    *page=victim;
+    return (0);
+}
+
+Compactor::ExtentMap::iterator
+Compactor::find_overlap(ham_offset_t address)
+{
+    ExtentMap::iterator it=m_extents.lower_bound(address);
+    if (it!=m_extents.begin()) {
+        ExtentMap::iterator prev=it;
+        --prev;
+        if (prev->first+prev->second.size>address)
+            it=prev;
+    }
+    return (it);
+}
+
+ham_status_t
+Compactor::release(ham_offset_t start, ham_offset_t end)
+{
+    ham_status_t st;
+    std::vector<std::pair<ham_offset_t, ham_offset_t> > ranges;
+
+    get_unused(start, end, ranges);
+    for (ham_size_t i=0; i<ranges.size(); i++) {
+        st=freel_mark_free(m_env, 0, ranges[i].first,
+                (ham_size_t)(ranges[i].second-ranges[i].first), HAM_TRUE);
+        if (st)
+            return (st);
+    }
+    return (0);
+}
+
+ham_status_t
+Compactor::move(ham_offset_t address, extent_t *extent, ham_offset_t newaddr)
+{
+    ham_status_t st;
+
+    if (extent->type==TYPE_NODE || extent->type==TYPE_FREELIST)
+        st=move_page(address, extent, newaddr);
+    else
+        st=blob_move(m_env, address, newaddr);
+    if (st)
+        return (st);
+
+    st=update_owner(address, extent, newaddr);
+    if (st)
+        return (st);
+
+    update_map(address, newaddr);
+    return (0);
+}
+
+ham_status_t
+Compactor::move_page(ham_offset_t address, extent_t *extent,
+                ham_offset_t newaddr)
+{
+    ham_status_t st;
+    Page *page, *newpage;
+    Database *db=0;
+    Cache *cache=m_env->get_cache();
+
+    if (extent->type==TYPE_NODE) {
+        db=get_db(extent->dbname);
+        ham_assert(db, (""));
+        st=db_fetch_page(&page, db, address, 0);
+    }
+    else
+        st=env_fetch_page(&page, m_env, address, 0);
+    if (!page)
+        return (st ? st : HAM_INTERNAL_ERROR);
+
+    /* the old page is no longer used */
+    st=page->uncouple_all_cursors();
+    if (st)
+        return (st);
+    if (db)
+        btree_stats_page_is_nuked(db, page, HAM_FALSE);
+
+    /* get the new page; this is the same as in db_alloc_page_impl() */
+    newpage=cache->get_page(newaddr, 0);
+    if (newpage) {
+        newpage->set_db(db);
+    }
+    else {
+        /* the new page is unused; don't verify its checksum */
+        newpage=new Page(m_env, db);
+        newpage->set_flags(Page::NPERS_NO_HEADER);
+        st=newpage->fetch(newaddr);
+        if (st) {
+            delete newpage;
+            return (st);
+        }
+    }
+
+    newpage->set_flags(newpage->get_flags()&~Page::NPERS_NO_HEADER);
+    memcpy(newpage->get_pers(), page->get_pers(), m_env->get_pagesize());
+    newpage->set_dirty(true);
+    if (m_env->get_flags()&HAM_ENABLE_RECOVERY)
+        m_env->get_changeset().add_page(newpage);
+    cache->put_page(newpage);
+
+    if (db)
+        return (update_siblings(db, newpage));
+    return (0);
+}
+
+ham_status_t
+Compactor::update_siblings(Database *db, Page *page)
+{
+    ham_status_t st;
+    Page *sibling;
+    btree_node_t *node=page_get_btree_node(page);
+
+    if (btree_node_get_left(node)) {
+        st=db_fetch_page(&sibling, db, btree_node_get_left(node), 0);
+        if (!sibling)
+            return (st ? st : HAM_INTERNAL_ERROR);
+        btree_node_set_right(page_get_btree_node(sibling), page->get_self());
+        sibling->set_dirty(true);
+    }
+
+    if (btree_node_get_right(node)) {
+        st=db_fetch_page(&sibling, db, btree_node_get_right(node), 0);
+        if (!sibling)
+            return (st ? st : HAM_INTERNAL_ERROR);
+        btree_node_set_left(page_get_btree_node(sibling), page->get_self());
+        sibling->set_dirty(true);
+    }
+
+    return (0);
+}
+
+ham_status_t
+Compactor::update_owner(ham_offset_t address, extent_t *extent,
+                ham_offset_t newaddr)
+{
+    ham_status_t st;
+    Page *page;
+
+    /* a freelist page is referenced by the previous freelist page and
+     * by the freelist cache */
+    if (extent->type==TYPE_FREELIST) {
+        freelist_payload_t *fp;
+        if (!extent->owner) {
+            fp=m_env->get_freelist();
+            m_env->set_dirty(true);
+            if (m_env->get_flags()&HAM_ENABLE_RECOVERY)
+                m_env->get_changeset().add_page(m_env->get_header_page());
+        }
+        else {
+            st=env_fetch_page(&page, m_env, extent->owner, 0);
+            if (!page)
+                return (st ? st : HAM_INTERNAL_ERROR);
+            fp=page_get_freelist(page);
+            page->set_dirty(true);
+        }
+        freel_set_overflow(fp, newaddr);
+
+        freelist_cache_t *cache=m_env->get_device()->get_freelist_cache();
+        if (cache) {
+            for (ham_size_t i=0; i<freel_cache_get_count(cache); i++) {
+                freelist_entry_t *entry=freel_cache_get_entries(cache)+i;
+                if (freel_entry_get_page_id(entry)==address)
+                    freel_entry_set_page_id(entry, newaddr);
+            }
+            if (freel_cache_get_next_page(cache)==address)
+                freel_cache_set_next_page(cache, newaddr);
+        }
+        return (0);
+    }
+
+    /* the bloom filter is referenced by the open Database */
+    if (extent->type==TYPE_BLOOM) {
+        Database *db=get_db(extent->dbname);
+        ham_assert(db && db->get_bloom_filter(), (""));
+        db->get_bloom_filter()->set_blobid(newaddr);
+        return (0);
+    }
+
+    /* the root page is referenced by the Database header */
+    if (extent->type==TYPE_NODE && !extent->owner) {
+        Database *db=get_db(extent->dbname);
+        ham_assert(db, (""));
+        BtreeBackend *be=(BtreeBackend *)db->get_backend();
+        be->set_rootpage(newaddr);
+        be->set_dirty(true);
+        be->flush();
+        m_env->set_dirty(true);
+        if (m_env->get_flags()&HAM_ENABLE_RECOVERY)
+            m_env->get_changeset().add_page(m_env->get_header_page());
+        return (0);
+    }
+
+    ExtentMap::iterator it=m_extents.find(extent->owner);
+    ham_assert(it!=m_extents.end(), (""));
+    if (it==m_extents.end())
+        return (HAM_INTERNAL_ERROR);
+
+    /* a record which is referenced by a duplicate table */
+    if (it->second.type==TYPE_DUPE_TABLE)
+        return (blob_duplicate_replace_rid(m_env, extent->owner,
+                    address, newaddr));
+
+    /* otherwise the owner is a btree node */
+    Database *db=get_db(it->second.dbname);
+    ham_assert(db, (""));
+    st=db_fetch_page(&page, db, extent->owner, 0);
+    if (!page)
+        return (st ? st : HAM_INTERNAL_ERROR);
+
+    btree_node_t *node=page_get_btree_node(page);
+    bool leaf=btree_node_is_leaf(node) ? true : false;
+    bool found=false;
+
+    if (extent->type==TYPE_NODE && btree_node_get_ptr_left(node)==address) {
+        btree_node_set_ptr_left(node, newaddr);
+        found=true;
+    }
+
+    for (ham_size_t i=0; !found && i<btree_node_get_count(node); i++) {
+        btree_key_t *bte=btree_node_get_key(db, node, i);
+        ham_u8_t flags=key_get_flags(bte);
+
+        if (extent->type==TYPE_NODE) {
+            if (key_get_ptr(bte)==address) {
+                key_set_ptr(bte, newaddr);
+                found=true;
+            }
+            continue;
+        }
+
+        if ((flags&KEY_IS_EXTENDED)
+                && key_get_extended_rid(db, bte)==address) {
+            key_set_extended_rid(db, bte, newaddr);
+            if (db->get_extkey_cache())
+                db->get_extkey_cache()->remove(address);
+            found=true;
+        }
+        else if (leaf
+                && !(flags&(KEY_BLOB_SIZE_TINY|KEY_BLOB_SIZE_SMALL
+                            |KEY_BLOB_SIZE_EMPTY|KEY_BLOB_SIZE_INLINE))
+                && key_get_ptr(bte)==address) {
+            key_set_ptr(bte, newaddr);
+            found=true;
+        }
+    }
+
+    if (!found) {
+        ham_log(("compaction failed: page 0x%llx does not reference 0x%llx",
+                (unsigned long long)extent->owner,
+                (unsigned long long)address));
+        return (HAM_INTEGRITY_VIOLATED);
+    }
+
+    page->set_dirty(true);
+    return (0);
+}
+
+void
+Compactor::update_map(ham_offset_t address, ham_offset_t newaddr)
+{
+    ExtentMap::iterator it=m_extents.find(address);
+    ham_assert(it!=m_extents.end(), (""));
+    extent_t extent=it->second;
+    m_extents.erase(it);
+    m_extents[newaddr]=extent;
+
+    /* the reference of the owner */
+    std::pair<OwnerMap::iterator, OwnerMap::iterator> range;
+    range=m_children.equal_range(extent.owner);
+    for (OwnerMap::iterator c=range.first; c!=range.second; c++) {
+        if (c->second==address) {
+            c->second=newaddr;
+            break;
+        }
+    }
+
+    /* the areas which are referenced by the moved area */
+    std::vector<ham_offset_t> children;
+    range=m_children.equal_range(address);
+    for (OwnerMap::iterator c=range.first; c!=range.second; c++) {
+        children.push_back(c->second);
+        m_extents[c->second].owner=newaddr;
+    }
+    m_children.erase(range.first, range.second);
+    for (ham_size_t i=0; i<children.size(); i++)
+        m_children.insert(std::make_pair(newaddr, children[i]));
+}
+
+void
+Compactor::get_unused(ham_offset_t start, ham_offset_t end,
+                std::vector<std::pair<ham_offset_t, ham_offset_t> > &ranges)
+{
+    ExtentMap::iterator it=m_extents.lower_bound(start);
+    if (it!=m_extents.begin()) {
+        ExtentMap::iterator prev=it;
+        --prev;
+        if (prev->first+prev->second.size>start)
+            start=prev->first+prev->second.size;
+    }
+
+    for (; it!=m_extents.end() && it->first<end; it++) {
+        if (it->first>start)
+            ranges.push_back(std::make_pair(start, it->first));
+        start=it->first+it->second.size;
+    }
+    if (start<end)
+        ranges.push_back(std::make_pair(start, end));
+}
+
+ham_status_t
+Compactor::truncate(ham_offset_t address)
+{
+    ham_status_t st;
+    ham_offset_t filesize;
+    Cache *cache=m_env->get_cache();
+
+    st=m_env->get_device()->get_filesize(&filesize);
+    if (st)
+        return (st);
+
+    /* all modified pages are written before the file is truncated */
+    st=flush_changeset();
+    if (st)
+        return (st);
+    st=m_env->_fun_flush(m_env, 0);
+    if (st)
+        return (st);
+
+    /* the truncated pages are removed from the cache */
+    Page *n, *page=cache->get_totallist();
+    while (page) {
+        n=page->get_next(Page::LIST_CACHED);
+        if (page->get_self()>=address) {
+            st=page->uncouple_all_cursors();
+            if (st)
+                return (st);
+            cache->remove_page(page);
+            page->set_dirty(false);
+            (void)page->free();
+            delete page;
+        }
+        page=n;
+    }
+
+    st=m_env->get_device()->truncate(address);
+    if (st)
+        return (st);
+
+    m_progress.bytes_truncated+=filesize-address;
+    return (0);
+}
+
+ham_status_t
+Compactor::flush_changeset()
+{
+    ham_status_t st;
+    ham_u64_t lsn=DUMMY_LSN;
+
+    if (!(m_env->get_flags()&HAM_ENABLE_RECOVERY))
+        return (0);
+
+    if (m_env->get_flags()&HAM_ENABLE_TRANSACTIONS) {
+        st=env_get_incremented_lsn(m_env, &lsn);
+        if (st)
+            return (st);
+    }
+    return (m_env->get_changeset().flush(lsn));
+}
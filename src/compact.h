@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief the online compaction
+ *
+ * The Compactor shrinks the file from its end: all pages and blobs which
+ * overlap with the last page are moved to free space in the lower part
+ * of the file, then the last page is truncated. The free chunks of the
+ * last page are taken from the freelist before anything is moved, so
+ * that the freelist does not hand them out as the new location.
+ *
+ * If a btree node (or a blob which is too large for the free chunks)
+ * has to be moved but the freelist has no free page, the blobs of the
+ * page with the least used bytes are moved to other pages, and the page
+ * is then used for the node or the blob.
+ *
+ * To update the references of a moved page or blob, the Compactor keeps
+ * a map of all used areas of the file and their "owners" (the page or
+ * blob which points to them). The map is built by scanning all
+ * Databases, and it is updated by the Compactor itself. If the file
+ * was modified by other operations in the meantime, the map is rebuilt
+ * before the next step.
+ *
+ * Areas which are neither free nor used (i.e. pages which were leaked
+ * in the past) are reclaimed when the file is truncated.
+ *
+ * Slab pages (see slab.h) are never moved, because the record IDs of
+ * their slots store the address of the page; the file does not shrink
+ * beyond the last slab page.
+ */
+
+#ifndef HAM_COMPACT_H__
+#define HAM_COMPACT_H__
+
+#include "internal_fwd_decl.h"
+
+#include <map>
+#include <vector>
+
+#include <ham/hamsterdb_int.h>
+
+class Compactor
+{
+  public:
+    /** constructor */
+    Compactor(Environment *env);
+
+    /** destructor */
+    ~Compactor();
+
+    /**
+     * returns true if the Environment can be compacted; in-memory
+     * and remote Environments are not supported
+     */
+    static bool is_supported(Environment *env);
+
+    /**
+     * runs a single step and moves at most @a max_moves pages or blobs;
+     * requires the Environment mutex
+     */
+    ham_status_t run(ham_u32_t max_moves, ham_compact_progress_t *progress);
+
+  private:
+    /** the type of a used area */
+    enum {
+        /** a btree node; the owner is the parent node (or 0 if it is
+         * the root page) */
+        TYPE_NODE,
+        /** a freelist page; the owner is the previous freelist page
+         * (or 0 if it is the header page) */
+        TYPE_FREELIST,
+        /** a record or an extended key; the owner is a btree leaf or
+         * a duplicate table */
+        TYPE_BLOB,
+        /** a duplicate table or the node of a duplicate tree; the owner
+         * is a btree leaf or the parent node */
+        TYPE_DUPE_TABLE,
+        /** the bloom filter of an open Database; it has no owner */
+        TYPE_BLOOM,
+        /** a slab page with small records; it has no owner and is
+         * never moved */
+        TYPE_SLAB
+    };
+
+    /** a used area of the file */
+    struct extent_t {
+        /** the type of the area */
+        ham_u32_t type;
+
+        /** the name of the Database */
+        ham_u16_t dbname;
+
+        /** the size in bytes */
+        ham_offset_t size;
+
+        /** the address of the page or blob which references this area */
+        ham_offset_t owner;
+    };
+
+    typedef std::map<ham_offset_t, extent_t> ExtentMap;
+    typedef std::multimap<ham_offset_t, ham_offset_t> OwnerMap;
+
+    /** opens all Databases which are not yet open */
+    ham_status_t open_databases();
+
+    /** closes the Databases which were opened by open_databases() */
+    void close_databases();
+
+    /** scans all Databases and the freelist and builds the map */
+    ham_status_t build_map();
+
+    /** scans a btree */
+    ham_status_t scan_tree(Database *db);
+
+    /** scans the duplicates of a key (or a subtree of a duplicate tree) */
+    ham_status_t scan_duplicates(ham_u16_t dbname, ham_offset_t table_id);
+
+    /** adds the slab page of a record to the map, unless it was
+     * already added for another record */
+    ham_status_t add_slab_page(ham_u16_t dbname, ham_offset_t rid);
+
+    /** adds a used area to the map */
+    ham_status_t add_extent(ham_offset_t address, ham_u32_t type,
+                ham_u16_t dbname, ham_offset_t size, ham_offset_t owner);
+
+    /** removes the pages of the scan from the cache, if the cache
+     * is full */
+    ham_status_t purge_cache();
+
+    /** truncates the unused end of the file, or moves all areas which
+     * overlap with the last page and truncates the page */
+    ham_status_t shrink(ham_u32_t max_moves, ham_u32_t *moves, bool *done);
+
+    /** frees a page in front of @a limit by moving its blobs to
+     * other pages; returns the address of the page, or 0 if no page
+     * could be freed */
+    ham_status_t evacuate_page(ham_offset_t limit, ham_u32_t max_moves,
+                ham_u32_t *moves, ham_offset_t *page);
+
+    /** returns the first area which ends after @a address */
+    ExtentMap::iterator find_overlap(ham_offset_t address);
+
+    /** returns the unused chunks of [start, end) to the freelist */
+    ham_status_t release(ham_offset_t start, ham_offset_t end);
+
+    /** moves a single area */
+    ham_status_t move(ham_offset_t address, extent_t *extent,
+                ham_offset_t newaddr);
+
+    /** copies a page to a new address */
+    ham_status_t move_page(ham_offset_t address, extent_t *extent,
+                ham_offset_t newaddr);
+
+    /** updates the reference in the owner of a moved area */
+    ham_status_t update_owner(ham_offset_t address, extent_t *extent,
+                ham_offset_t newaddr);
+
+    /** updates the sibling pointers of a moved btree node */
+    ham_status_t update_siblings(Database *db, Page *page);
+
+    /** updates the map after an area was moved */
+    void update_map(ham_offset_t address, ham_offset_t newaddr);
+
+    /** returns the free ranges of [start, end) which are not used */
+    void get_unused(ham_offset_t start, ham_offset_t end,
+                std::vector<std::pair<ham_offset_t, ham_offset_t> > &ranges);
+
+    /** writes all changes, removes the truncated pages from the cache
+     * and truncates the file */
+    ham_status_t truncate(ham_offset_t address);
+
+    /** flushes the changeset, if recovery is enabled */
+    ham_status_t flush_changeset();
+
+    /** returns a Database by name */
+    Database *get_db(ham_u16_t dbname);
+
+    /** the Environment */
+    Environment *m_env;
+
+    /** the used areas of the file, indexed by their address */
+    ExtentMap m_extents;
+
+    /** the areas which are referenced by an owner */
+    OwnerMap m_children;
+
+    /** true if the map is valid */
+    bool m_valid;
+
+    /** the modification counter of the Device when the map was
+     * last updated */
+    ham_u64_t m_modification_count;
+
+    /** the open Databases of the current step */
+    std::map<ham_u16_t, Database *> m_dbs;
+
+    /** the Databases which were opened temporarily */
+    std::vector<Database *> m_temp_dbs;
+
+    /** the accumulated progress */
+    ham_compact_progress_t m_progress;
+};
+
+#endif /* HAM_COMPACT_H__ */
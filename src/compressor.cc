@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief implementation of compressor.h
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "compressor.h"
+#include "error.h"
+
+#ifndef HAM_DISABLE_COMPRESSION
+#  ifdef HAM_USE_SYSTEM_ZLIB
+#    include <zlib.h>
+#  else
+#    include "../3rdparty/zlib/zlib.h"
+#  endif
+#endif
+
+PageCompressor::PageCompressor(ham_size_t pagesize)
+  : m_pagesize(pagesize), m_deflate(0), m_level(0), m_inflate(0)
+{
+}
+
+PageCompressor::~PageCompressor()
+{
+#ifndef HAM_DISABLE_COMPRESSION
+    if (m_deflate) {
+        deflateEnd((z_stream *)m_deflate);
+        delete (z_stream *)m_deflate;
+    }
+    if (m_inflate) {
+        inflateEnd((z_stream *)m_inflate);
+        delete (z_stream *)m_inflate;
+    }
+#endif
+}
+
+ham_size_t
+PageCompressor::compress(const ham_u8_t *page, ham_u8_t *dest,
+                ham_u32_t level)
+{
+#ifndef HAM_DISABLE_COMPRESSION
+    z_stream *z=(z_stream *)m_deflate;
+    ham_size_t limit, size;
+
+    /* the stream is created once and then reset for every page; a raw
+     * deflate stream (negative window bits) has no header and no
+     * checksum */
+    if (!z) {
+        z=new z_stream;
+        memset(z, 0, sizeof(*z));
+        if (deflateInit2(z, level, Z_DEFLATED, -15, 8,
+                    Z_DEFAULT_STRATEGY)!=Z_OK) {
+            delete z;
+            return (0);
+        }
+        m_deflate=z;
+        m_level=level;
+    }
+    else {
+        deflateReset(z);
+        if (level!=m_level) {
+            if (deflateParams(z, level, Z_DEFAULT_STRATEGY)!=Z_OK)
+                return (0);
+            m_level=level;
+        }
+    }
+
+    /* the image must save at least one file system block; deflate stops
+     * as soon as the output does not fit */
+    if (m_pagesize>FS_BLOCK_SIZE)
+        limit=m_pagesize-FS_BLOCK_SIZE;
+    else
+        limit=m_pagesize/2;
+
+    z->next_in=(Bytef *)page+12;
+    z->avail_in=m_pagesize-12;
+    z->next_out=dest+HEADER_SIZE;
+    z->avail_out=limit-HEADER_SIZE;
+    if (deflate(z, Z_FINISH)!=Z_STREAM_END)
+        return (0);
+
+    /* copy the page header and store the image header */
+    memcpy(dest, page, 12);
+    *(ham_u32_t *)dest=ham_h2db32(ham_db2h32(*(ham_u32_t *)page)|IMAGE_FLAG);
+    *(ham_u32_t *)(dest+12)=ham_h2db32(MAGIC);
+    *(ham_u32_t *)(dest+16)=ham_h2db32((ham_u32_t)z->total_out);
+
+    /* pad the image to the alignment */
+    size=HEADER_SIZE+(ham_size_t)z->total_out;
+    if (size%ALIGNMENT) {
+        memset(dest+size, 0, ALIGNMENT-size%ALIGNMENT);
+        size+=ALIGNMENT-size%ALIGNMENT;
+    }
+    return (size);
+#else
+    (void)page;
+    (void)dest;
+    (void)level;
+    return (0);
+#endif
+}
+
+ham_status_t
+PageCompressor::decompress(const ham_u8_t *image, ham_u8_t *dest)
+{
+#ifndef HAM_DISABLE_COMPRESSION
+    z_stream *z=(z_stream *)m_inflate;
+    ham_u32_t size=ham_db2h32(*(ham_u32_t *)(image+16));
+    int zret;
+
+    if (size>m_pagesize-HEADER_SIZE) {
+        ham_log(("invalid size %u of a compressed page", size));
+        return (HAM_INTEGRITY_VIOLATED);
+    }
+
+    if (!z) {
+        z=new z_stream;
+        memset(z, 0, sizeof(*z));
+        if (inflateInit2(z, -15)!=Z_OK) {
+            delete z;
+            return (HAM_OUT_OF_MEMORY);
+        }
+        m_inflate=z;
+    }
+    else
+        inflateReset(z);
+
+    z->next_in=(Bytef *)image+HEADER_SIZE;
+    z->avail_in=size;
+    z->next_out=dest+12;
+    z->avail_out=m_pagesize-12;
+    zret=inflate(z, Z_FINISH);
+    if (zret!=Z_STREAM_END || z->total_out!=m_pagesize-12) {
+        ham_log(("failed to decompress a page (zlib error %d)", zret));
+        return (HAM_INTEGRITY_VIOLATED);
+    }
+
+    memcpy(dest, image, 12);
+    *(ham_u32_t *)dest=ham_h2db32(ham_db2h32(*(ham_u32_t *)image)&~IMAGE_FLAG);
+    return (0);
+#else
+    (void)image;
+    (void)dest;
+    ham_trace(("hamsterdb was compiled without support for zlib compression"));
+    return (HAM_NOT_IMPLEMENTED);
+#endif
+}
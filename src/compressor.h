@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief page compression
+ *
+ * The PageCompressor compresses the index pages of a Database (see
+ * @ref HAM_COMPRESS_PAGES) before the Device writes them to the file.
+ *
+ * A compressed page still occupies a whole page in the file, but only
+ * the compressed image at the beginning of the page is written; the
+ * remaining part of the page is released with os_punch_hole(), if the
+ * file system supports this. The image starts with the (uncompressed)
+ * page header, followed by a small header and the raw deflate stream
+ * of the page payload:
+ *
+ *   page_header_t (_flags | @ref PageCompressor::IMAGE_FLAG)
+ *   ham_u32_t     @ref PageCompressor::MAGIC
+ *   ham_u32_t     size of the deflate stream
+ *   ham_u8_t      deflate stream[]
+ *
+ * Compressed pages are recognized when they are read, therefore they
+ * are decompressed even if page compression is not enabled.
+ */
+
+#ifndef HAM_COMPRESSOR_H__
+#define HAM_COMPRESSOR_H__
+
+#include <ham/hamsterdb.h>
+
+#include "endianswap.h"
+
+class PageCompressor
+{
+  public:
+    enum {
+        /** set in page_header_t::_flags of a compressed image */
+        IMAGE_FLAG=0x00000001,
+
+        /** the marker which follows the page header ("ZPAG") */
+        MAGIC=0x4741505a,
+
+        /** the size of the page header and the image header */
+        HEADER_SIZE=12+8,
+
+        /** the size of a compressed image is a multiple of this value
+         * (the AES block size) */
+        ALIGNMENT=16,
+
+        /** the file system block size; a page is only stored compressed
+         * if this saves at least one block */
+        FS_BLOCK_SIZE=4096
+    };
+
+    /** constructor */
+    PageCompressor(ham_size_t pagesize);
+
+    /** destructor */
+    ~PageCompressor();
+
+    /** returns true if @a data is a compressed image */
+    static bool is_compressed(const ham_u8_t *data) {
+        return ((ham_db2h32(*(ham_u32_t *)data)&IMAGE_FLAG)
+                && ham_db2h32(*(ham_u32_t *)(data+12))==(ham_u32_t)MAGIC);
+    }
+
+    /**
+     * compresses the page @a page with the zlib compression @a level
+     * and stores the image in @a dest, which must be as large as a page;
+     * returns the size of the image, or 0 if the page is not compressible
+     * and must be stored uncompressed
+     */
+    ham_size_t compress(const ham_u8_t *page, ham_u8_t *dest,
+                ham_u32_t level);
+
+    /** decompresses the image @a image to the page @a dest */
+    ham_status_t decompress(const ham_u8_t *image, ham_u8_t *dest);
+
+  private:
+    /** the pagesize */
+    ham_size_t m_pagesize;
+
+    /** the zlib deflate stream, or NULL if it was not yet initialized */
+    void *m_deflate;
+
+    /** the compression level of the deflate stream */
+    ham_u32_t m_level;
+
+    /** the zlib inflate stream, or NULL if it was not yet initialized */
+    void *m_inflate;
+};
+
+#endif /* HAM_COMPRESSOR_H__ */
@@ -64,5 +64,11 @@
  */
 #define HAM_DEFAULT_CACHESIZE      (2*1024*1024)
 
+/*
+ * the default maximum size of a single write when dirty pages are
+ * flushed is 1 MB
+ */
+#define HAM_DEFAULT_MAX_WRITE_SIZE (1024*1024)
+
 
 #endif /* __HAM_CONFIG_H__ */
@@ -21,6 +21,8 @@
 #include "mem.h"
 #include "btree_cursor.h"
 #include "btree_key.h"
+#include "hashdb.h"
+#include "record_stream.h"
 
 
 static ham_bool_t
@@ -29,6 +31,146 @@ __btree_cursor_is_nil(btree_cursor_t *btc)
     return (!btree_cursor_is_coupled(btc) && !btree_cursor_is_uncoupled(btc));
 }
 
+/*
+ * compares the key of a coupled btree cursor with @a key; the key is
+ * compared in the page and not copied. Returns <0, 0 or >0 like
+ * Database::compare_keys; errors are returned in @a pst
+ */
+static int
+__compare_btree_key(Database *db, btree_cursor_t *btc, ham_key_t *key,
+                ham_status_t *pst)
+{
+    int cmp=btree_compare_keys(db, btree_cursor_get_coupled_page(btc), key,
+                btree_cursor_get_coupled_index(btc));
+    *pst=0;
+    if (cmp<-1) {
+        *pst=(ham_status_t)cmp;
+        return (0);
+    }
+    return (-cmp);
+}
+
+ham_size_t
+DupeCache::locate(ham_size_t idx, ham_size_t *offset)
+{
+    ham_size_t r=m_hint_run, pos=m_hint_pos;
+
+    ham_assert(idx<m_count, (""));
+
+    /* start at the run of the previous lookup; usually the cursor
+     * moves to a neighbouring duplicate */
+    if (r>=m_runs.size()) {
+        r=0;
+        pos=0;
+    }
+    while (idx<pos) {
+        r--;
+        pos-=m_runs[r].count;
+    }
+    while (idx>=pos+m_runs[r].count) {
+        pos+=m_runs[r].count;
+        r++;
+    }
+
+    m_hint_run=r;
+    m_hint_pos=pos;
+    *offset=idx-pos;
+    return (r);
+}
+
+ham_size_t
+DupeCache::split(ham_size_t idx)
+{
+    ham_size_t r, offset;
+
+    if (idx==m_count)
+        return ((ham_size_t)m_runs.size());
+
+    r=locate(idx, &offset);
+    if (offset==0)
+        return (r);
+
+    Run tail=m_runs[r];
+    tail.line.set_btree_dupe_idx(tail.line.get_btree_dupe_idx()+offset);
+    tail.count-=offset;
+    m_runs[r].count=offset;
+    m_runs.insert(m_runs.begin()+r+1, tail);
+    return (r+1);
+}
+
+DupeCacheLine
+DupeCache::get_element(ham_size_t idx)
+{
+    ham_size_t offset;
+    ham_size_t r=locate(idx, &offset);
+    DupeCacheLine line=m_runs[r].line;
+
+    if (offset)
+        line.set_btree_dupe_idx(line.get_btree_dupe_idx()+offset);
+    return (line);
+}
+
+ham_size_t
+DupeCache::find_txn_op(txn_op_t *op)
+{
+    ham_size_t pos=0;
+
+    for (ham_size_t r=0; r<m_runs.size(); r++) {
+        if (!m_runs[r].line.use_btree() && m_runs[r].line.get_txn_op()==op)
+            return (pos+1);
+        pos+=m_runs[r].count;
+    }
+    return (0);
+}
+
+void
+DupeCache::insert(ham_size_t position, const DupeCacheLine &dcl)
+{
+    ham_size_t r=split(position);
+
+    m_runs.insert(m_runs.begin()+r, Run(dcl, 1));
+    m_count++;
+    m_hint_run=0;
+    m_hint_pos=0;
+}
+
+void
+DupeCache::append(const DupeCacheLine &dcl)
+{
+    DupeCacheLine line=dcl;
+
+    /* extend the last run if the btree duplicate follows it */
+    if (m_runs.size() && line.use_btree()) {
+        Run &last=m_runs.back();
+        if (last.line.use_btree()
+                && last.line.get_btree_dupe_idx()+last.count
+                    ==line.get_btree_dupe_idx()) {
+            last.count++;
+            m_count++;
+            return;
+        }
+    }
+    m_runs.push_back(Run(dcl, 1));
+    m_count++;
+}
+
+void
+DupeCache::erase(ham_size_t position)
+{
+    ham_size_t r=split(position);
+    Run &run=m_runs[r];
+
+    if (run.count==1)
+        m_runs.erase(m_runs.begin()+r);
+    else {
+        run.line.set_btree_dupe_idx(run.line.get_btree_dupe_idx()+1);
+        run.count--;
+    }
+    m_count--;
+    m_hint_run=0;
+    m_hint_pos=0;
+}
+
 ham_status_t
 Cursor::update_dupecache(ham_u32_t what)
 {
@@ -56,22 +198,14 @@ Cursor::update_dupecache(ham_u32_t what)
     }
 
     /* first collect all duplicates from the btree. They're already sorted,
-     * therefore we can just append them to our duplicate-cache. */
+     * therefore a single run of the duplicate-cache covers all of them. */
     if ((what&CURSOR_BTREE) && !is_nil(CURSOR_BTREE)) {
-        ham_size_t i;
-        ham_bool_t needs_free=HAM_FALSE;
-        dupe_table_t *table=0;
-        st=btree_cursor_get_duplicate_table(btc, &table, &needs_free);
+        ham_size_t count=0;
+        st=btree_cursor_get_duplicate_count(btc, &count, 0);
         if (st && st!=HAM_CURSOR_IS_NIL)
             return (st);
         st=0;
-        if (table) {
-            for (i=0; i<dupe_table_get_count(table); i++) {
-                dc->append(DupeCacheLine(true, i));
-            }
-            if (needs_free)
-                env->get_allocator()->free(table);
-        }
+        dc->append_btree_duplicates(count);
         env->get_changeset().clear();
     }
 
@@ -103,8 +237,7 @@ Cursor::update_dupecache(ham_u32_t what)
                     ham_u32_t ref=txn_op_get_referenced_dupe(op);
                     if (ref) {
                         ham_assert(ref<=dc->get_count(), (""));
-                        DupeCacheLine *e=dc->get_first_element();
-                        (&e[ref-1])->set_txn_op(op);
+                        dc->set_element(ref-1, DupeCacheLine(false, op));
                     }
                     else {
                         /* all existing dupes are overwritten */
@@ -163,26 +296,71 @@ Cursor::couple_to_dupe(ham_u32_t dupe_id)
 {
     txn_cursor_t *txnc=get_txn_cursor();
     DupeCache *dc=get_dupecache();
-    DupeCacheLine *e=0;
 
     ham_assert(dc->get_count()>=dupe_id, (""));
     ham_assert(dupe_id>=1, (""));
 
     /* dupe-id is a 1-based index! */
-    e=dc->get_element(dupe_id-1);
-    if (e->use_btree()) {
+    DupeCacheLine e=dc->get_element(dupe_id-1);
+    if (e.use_btree()) {
         btree_cursor_t *btc=get_btree_cursor();
         couple_to_btree();
-        btree_cursor_set_dupe_id(btc, (ham_size_t)e->get_btree_dupe_idx());
+        btree_cursor_set_dupe_id(btc, (ham_size_t)e.get_btree_dupe_idx());
     }
     else {
-        ham_assert(e->get_txn_op()!=0, (""));
-        txn_cursor_couple(txnc, e->get_txn_op());
+        ham_assert(e.get_txn_op()!=0, (""));
+        txn_cursor_couple(txnc, e.get_txn_op());
         couple_to_txnop();
     }
     set_dupecache_index(dupe_id);
 }
 
+bool
+Cursor::is_btree_key_outside_txn_tree(void)
+{
+    btree_cursor_t *btc=get_btree_cursor();
+    txn_cursor_t *txnc=get_txn_cursor();
+    txn_opnode_t *node, *sibling;
+    ham_status_t st;
+    int cmp, cmp2;
+
+    if (!btree_cursor_is_coupled(btc))
+        return (false);
+
+    /* without a txn-op: compare with the smallest and the largest key
+     * of the tree */
+    if (txn_cursor_is_nil(txnc)) {
+        node=txn_tree_get_first(m_db->get_optree());
+        if (!node)
+            return (true);
+        cmp=__compare_btree_key(m_db, btc, txn_opnode_get_key(node), &st);
+        if (st)
+            return (false);
+        if (cmp<0)
+            return (true);
+        node=txn_tree_get_last(m_db->get_optree());
+        cmp=__compare_btree_key(m_db, btc, txn_opnode_get_key(node), &st);
+        return (!st && cmp>0);
+    }
+
+    /* otherwise the key is not in the tree if it lies between the node
+     * of the txn-cursor and its neighbour. While both cursors move in
+     * the same direction this is the common case */
+    node=txn_op_get_node(txn_cursor_get_coupled_op(txnc));
+    cmp=__compare_btree_key(m_db, btc, txn_opnode_get_key(node), &st);
+    if (st || cmp==0)
+        return (false);
+    sibling=(cmp<0)
+            ? txn_opnode_get_previous_sibling(node)
+            : txn_opnode_get_next_sibling(node);
+    if (!sibling)
+        return (true);
+    cmp2=__compare_btree_key(m_db, btc, txn_opnode_get_key(sibling), &st);
+    if (st)
+        return (false);
+    return ((cmp<0) ? (cmp2>0) : (cmp2<0));
+}
+
 ham_status_t
 Cursor::check_if_btree_key_is_erased_or_overwritten(void)
 {
@@ -190,6 +368,11 @@ Cursor::check_if_btree_key_is_erased_or_overwritten(void)
     Cursor *clone;
     txn_op_t *op;
     ham_status_t st;
+
+    /* avoid the lookup in the txn-tree if the key can't be there */
+    if (is_btree_key_outside_txn_tree())
+        return (HAM_KEY_NOT_FOUND);
+
     get_db()->clone_cursor(this, &clone);
     txn_cursor_t *txnc=clone->get_txn_cursor();
     st=btree_cursor_move(get_btree_cursor(), &key, 0, 0);
@@ -343,29 +526,12 @@ Cursor::compare(void)
     ham_assert(!txn_cursor_is_nil(txnc), (""));
 
     if (btree_cursor_is_coupled(btrc)) {
-        /* clone the cursor, then uncouple the clone; get the uncoupled key
-         * and discard the clone again */
-        
-        /*
-         * TODO TODO TODO
-         * this is all correct, but of course quite inefficient, because
-         *    a) new structures have to be allocated/released
-         *    b) uncoupling fetches the whole extended key, which is often
-         *      not necessary
-         *  -> fix it!
-         */
-        Cursor *clone;
-        get_db()->clone_cursor(this, &clone);
-        ham_status_t st=btree_cursor_uncouple(clone->get_btree_cursor(), 0);
-        if (st) {
-            get_db()->close_cursor(clone);
+        /* compare the key in the page; neither the cursor nor the key
+         * are copied */
+        ham_status_t st;
+        cmp=__compare_btree_key(get_db(), btrc, txnk, &st);
+        if (st)
             return (0); /* TODO throw */
-        }
-        /* TODO error codes are swallowed */
-        cmp=get_db()->compare_keys(
-                btree_cursor_get_uncoupled_key(clone->get_btree_cursor()),
-                txnk);
-        get_db()->close_cursor(clone);
 
         set_lastcmp(cmp);
         return (cmp);
@@ -1022,8 +1188,10 @@ bail:
 
 Cursor::Cursor(Database *db, Transaction *txn, ham_u32_t flags)
   : m_db(db), m_txn(txn), m_remote_handle(0), m_next(0), m_previous(0),
-    m_next_in_page(0), m_previous_in_page(0), m_dupecache_index(0),
-    m_lastop(0), m_lastcmp(0), m_flags(flags), m_is_first_use(true)
+    m_next_in_page(0), m_previous_in_page(0), m_streams(0),
+    m_dupecache_index(0),
+    m_lastop(0), m_lastcmp(0), m_flags(flags), m_is_first_use(true),
+    m_batch_arena(db->get_env()->get_allocator())
 {
     txn_cursor_create(db, txn, flags, get_txn_cursor(), this);
     btree_cursor_create(db, txn, flags, get_btree_cursor(), this);
@@ -1045,9 +1213,11 @@ Cursor::Cursor(Cursor &other)
     m_txn_cursor=other.m_txn_cursor;
     m_btree_cursor=other.m_btree_cursor;
     m_is_first_use=other.m_is_first_use;
+    m_batch_arena.set_allocator(m_db->get_env()->get_allocator());
 
     set_next_in_page(0);
     set_previous_in_page(0);
+    set_streams(0);
 
     btree_cursor_clone(other.get_btree_cursor(), get_btree_cursor(), this);
 
@@ -1112,6 +1282,9 @@ Cursor::erase(Transaction *txn, ham_u32_t flags)
             set_to_nil(CURSOR_TXN);
         st=txn_cursor_erase(get_txn_cursor());
     }
+    else if (m_db->get_rt_flags()&HAM_USE_HASH) {
+        st=hash_cursor_erase(this, flags);
+    }
     else {
         st=btree_cursor_erase(get_btree_cursor(), flags);
     }
@@ -1146,6 +1319,9 @@ Cursor::get_duplicate_count(Transaction *txn, ham_u32_t *pcount, ham_u32_t flags
             *pcount=1;
         }
     }
+    else if (m_db->get_rt_flags()&HAM_USE_HASH) {
+        st=hash_cursor_get_duplicate_count(this, pcount, flags);
+    }
     else {
         st=btree_cursor_get_duplicate_count(get_btree_cursor(), pcount, flags);
     }
@@ -1166,6 +1342,8 @@ Cursor::get_record_size(Transaction *txn, ham_offset_t *psize)
         else
             st=btree_cursor_get_record_size(get_btree_cursor(), psize);
     }
+    else if (m_db->get_rt_flags()&HAM_USE_HASH)
+        st=hash_cursor_get_record_size(this, psize);
     else
         st=btree_cursor_get_record_size(get_btree_cursor(), psize);
 
@@ -1204,7 +1382,10 @@ Cursor::overwrite(Transaction *txn, ham_record_t *record, ham_u32_t flags)
             couple_to_txnop();
     }
     else {
-        st=btree_cursor_overwrite(get_btree_cursor(), record, flags);
+        if (m_db->get_rt_flags()&HAM_USE_HASH)
+            st=hash_cursor_overwrite(this, record, flags);
+        else
+            st=btree_cursor_overwrite(get_btree_cursor(), record, flags);
         if (st==0)
             couple_to_btree();
     }
@@ -1215,6 +1396,10 @@ Cursor::overwrite(Transaction *txn, ham_record_t *record, ham_u32_t flags)
 void
 Cursor::close(void)
 {
+    /* the streams of this Cursor can no longer be used */
+    while (get_streams())
+        get_streams()->detach();
+
     btree_cursor_close(get_btree_cursor());
     txn_cursor_close(get_txn_cursor());
     get_dupecache()->clear();
@@ -148,62 +148,124 @@ class DupeCacheLine
 
 /**
  * The dupecache is a cache for duplicate keys
+ *
+ * The duplicates of the btree are not stored one by one; instead the
+ * cache stores "runs" of consecutive btree duplicates, and a run is split
+ * when a txn-op is inserted in the middle of it or replaces one of its
+ * duplicates. Building the cache therefore only costs O(txn-ops) of
+ * the key, and not O(duplicates).
+ *
+ * The positions are resolved when they are requested; the cache remembers
+ * the run of the last lookup, therefore moving the cursor to the next or
+ * previous duplicate is O(1).
  */
 class DupeCache {
   public:
     /* default constructor - creates an empty dupecache with room for 8
-     * duplicates */
-    DupeCache(void) {
-        m_elements.reserve(8);
+     * runs */
+    DupeCache(void)
+    : m_count(0), m_hint_run(0), m_hint_pos(0) {
+        m_runs.reserve(8);
     }
 
     /** retrieve number of elements in the cache */
     ham_size_t get_count(void) {
-        return ((ham_size_t)m_elements.size());
+        return (m_count);
     }
 
     /** get an element from the cache */
-    DupeCacheLine *get_element(unsigned idx) {
-        return (&m_elements[idx]);
-    }
+    DupeCacheLine get_element(ham_size_t idx);
 
-    /** get a pointer to the first element from the cache */
-    DupeCacheLine *get_first_element(void) {
-        return (&m_elements[0]);
-    }
+    /**
+     * Returns the 1-based position of the element which references the
+     * txn-op @a op, or 0 if there is no such element
+     */
+    ham_size_t find_txn_op(txn_op_t *op);
 
     /** Clones this dupe-cache into 'other' */
     void clone(DupeCache *other) {
-        other->m_elements=m_elements;
+        other->m_runs=m_runs;
+        other->m_count=m_count;
+        other->m_hint_run=m_hint_run;
+        other->m_hint_pos=m_hint_pos;
     }
 
     /**
      * Inserts a new item somewhere in the cache; resizes the
      * cache if necessary
      */
-    void insert(unsigned position, const DupeCacheLine &dcl) {
-        m_elements.insert(m_elements.begin()+position, dcl);
-    }
+    void insert(ham_size_t position, const DupeCacheLine &dcl);
 
     /** append an element to the dupecache */
-    void append(const DupeCacheLine &dcl) {
-        m_elements.push_back(dcl);
+    void append(const DupeCacheLine &dcl);
+
+    /**
+     * Appends the btree duplicates 0 to @a count-1 with a single run;
+     * this is how the cache is initialized from the btree
+     */
+    void append_btree_duplicates(ham_size_t count) {
+        if (count) {
+            m_runs.push_back(Run(DupeCacheLine(), count));
+            m_count+=count;
+        }
     }
 
-    /** Erases an item */
-    void erase(ham_u32_t position) {
-        m_elements.erase(m_elements.begin()+position);
+    /** Replaces an item */
+    void set_element(ham_size_t position, const DupeCacheLine &dcl) {
+        erase(position);
+        insert(position, dcl);
     }
 
+    /** Erases an item */
+    void erase(ham_size_t position);
+
     /** Clears the cache; frees all resources */
     void clear(void) {
-        m_elements.resize(0);
+        m_runs.clear();
+        m_count=0;
+        m_hint_run=0;
+        m_hint_pos=0;
     }
 
   private:
-    /** The cached elements */
-    std::vector<DupeCacheLine> m_elements;
+    /**
+     * A run of elements; a txn-op always has its own run, btree
+     * duplicates are consecutive
+     */
+    struct Run {
+        Run(const DupeCacheLine &l, ham_size_t c)
+        : line(l), count(c) {
+        }
 
+        /** the first element */
+        DupeCacheLine line;
+
+        /** the number of elements */
+        ham_size_t count;
+    };
+
+    /**
+     * Returns the run which contains the element at @a idx; @a offset
+     * receives the position of the element in this run
+     */
+    ham_size_t locate(ham_size_t idx, ham_size_t *offset);
+
+    /**
+     * Splits a run so that a run starts at @a idx; returns the index
+     * of this run
+     */
+    ham_size_t split(ham_size_t idx);
+
+    /** The runs */
+    std::vector<Run> m_runs;
+
+    /** The number of elements in all runs */
+    ham_size_t m_count;
+
+    /** The run of the last lookup, and the position of its first
+     * element */
+    ham_size_t m_hint_run;
+    ham_size_t m_hint_pos;
 };
 
 
@@ -356,6 +418,17 @@ class Cursor
      */
     ham_status_t check_if_btree_key_is_erased_or_overwritten(void);
 
+    /**
+     * Returns true if the key of the (coupled) btree cursor is definitely
+     * not stored in the txn-tree; then the lookup of
+     * @ref check_if_btree_key_is_erased_or_overwritten is not required.
+     *
+     * The key is compared with the neighbours of the txn-cursor (or with
+     * the smallest and largest key of the txn-tree, if the txn-cursor is
+     * nil); the key is not copied.
+     */
+    bool is_btree_key_outside_txn_tree(void);
+
     /**
      * Synchronizes txn- and btree-cursor
      *
@@ -446,6 +519,16 @@ class Cursor
         m_previous_in_page=previous;
     }
 
+    /** Get the first open RecordStream of this Cursor */
+    RecordStream *get_streams(void) {
+        return (m_streams);
+    }
+
+    /** Set the first open RecordStream of this Cursor */
+    void set_streams(RecordStream *streams) {
+        m_streams=streams;
+    }
+
     /** Get the Transaction handle */
     Transaction *get_txn() {
         return (m_txn);
@@ -481,6 +564,12 @@ class Cursor
         return (&m_dupecache);
     }
 
+    /** Get the arena which stores the keys and records returned by
+     * ham_cursor_move_many */
+    ByteArray &get_batch_arena(void) {
+        return (m_batch_arena);
+    }
+
     /** Get the current index in the dupe cache */
     ham_size_t get_dupecache_index(void) {
         return (m_dupecache_index);
@@ -590,6 +679,10 @@ class Cursor
     /** Linked list of Cursors which point to the same page */
     Cursor *m_next_in_page, *m_previous_in_page;
 
+    /** Linked list of the open RecordStreams of this Cursor; they are
+     * detached when the Cursor is closed */
+    RecordStream *m_streams;
+
     /** A cache for all duplicates of the current key. needed for
      * ham_cursor_move, ham_find and other functions. The cache is
      * used to consolidate all duplicates of btree and txn. */
@@ -612,6 +705,10 @@ class Cursor
 
     /** true if this cursor was never used */
     bool m_is_first_use;
+
+    /** The keys and records of ham_cursor_move_many; they are valid
+     * till the next call */
+    ByteArray m_batch_arena;
 };
 
 
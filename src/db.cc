@@ -17,6 +17,7 @@
 #include <float.h>
 
 #include "blob.h"
+#include "bloom.h"
 #include "btree.h"
 #include "cache.h"
 #include "cursor.h"
@@ -28,6 +29,7 @@
 #include "error.h"
 #include "extkeys.h"
 #include "freelist.h"
+#include "hashdb.h"
 #include "log.h"
 #include "journal.h"
 #include "mem.h"
@@ -163,7 +165,8 @@ __free_inmemory_blobs_cb(int event, void *param1, void *param2, void *context)
 
         if (key_get_flags(key)&(KEY_BLOB_SIZE_TINY
                             |KEY_BLOB_SIZE_SMALL
-                            |KEY_BLOB_SIZE_EMPTY))
+                            |KEY_BLOB_SIZE_EMPTY
+                            |KEY_BLOB_SIZE_INLINE))
             break;
 
         /*
@@ -273,8 +276,10 @@ __record_filters_after_find(Database *db, ham_record_t *record)
 Database::Database()
   : m_error(0), m_context(0), m_backend(0), m_cursors(0),
     m_prefix_func(0), m_cmp_func(0), m_duperec_func(0), 
+    m_key_type(HAM_TYPE_BINARY), m_typed_compare(false),
     m_rt_flags(0), m_env(0), m_next(0), m_extkey_cache(0), 
-    m_indexdata_offset(0), m_record_filters(0), m_data_access_mode(0), 
+    m_bloom_filter(0), m_indexdata_offset(0), m_record_filters(0),
+    m_page_compression(0), m_data_access_mode(0), 
     m_is_active(0), m_impl(0)
 {
     memset(&m_perf_data, 0, sizeof(m_perf_data));
@@ -297,6 +302,7 @@ Database::~Database()
     /* trash all DB performance data */
     btree_stats_trash_dbdata(this, get_perf_data());
 
+    delete m_bloom_filter;
     delete m_impl;
 }
 
@@ -620,10 +626,16 @@ db_alloc_page_impl(Page **page_ref, Environment *env, Database *db,
                     ("page id %llu is not aligned", tellpos));
             /* try to fetch the page from the cache */
             page=env->get_cache()->get_page(tellpos, 0);
-            if (page)
+            if (page) {
+                /* the page might have been fetched without a Database,
+                 * i.e. by the online compaction */
+                page->set_db(db);
                 goto done;
-            /* allocate a new page structure and read the page from disk */
+            }
+            /* allocate a new page structure and read the page from disk;
+             * the page was unused, therefore its checksum is not verified */
             page=new Page(env, db);
+            page->set_flags(Page::NPERS_NO_HEADER);
             st=page->fetch(tellpos);
             if (st) {
                 delete page;
@@ -656,6 +668,7 @@ db_alloc_page_impl(Page **page_ref, Environment *env, Database *db,
 
 done:
     /* initialize the page; also set the 'dirty' flag to force logging */
+    page->set_flags(page->get_flags()&~Page::NPERS_NO_HEADER);
     page->set_type(type);
     page->set_dirty(true);
 
@@ -685,6 +698,8 @@ db_alloc_page(Page **page_ref, Database *db,
 
     /* hack: prior to 2.0, the type of btree root pages was not set
      * correctly */
+    if (db->get_rt_flags()&HAM_USE_HASH)
+        return (0);
     BtreeBackend *be=(BtreeBackend *)db->get_backend();
     if ((*page_ref)->get_self()==be->get_rootpage() 
             && !(db->get_rt_flags()&HAM_READ_ONLY))
@@ -699,10 +714,22 @@ db_fetch_page_impl(Page **page_ref, Environment *env, Database *db,
     Page *page=0;
     ham_status_t st;
 
-    ham_assert(0 == (flags & ~(HAM_HINTS_MASK|DB_ONLY_FROM_CACHE)), (0));
+    ham_assert(0 == (flags & ~(HAM_HINTS_MASK|DB_ONLY_FROM_CACHE
+                    |DB_NO_HEADER)), (0));
 
     *page_ref = 0;
 
+    /* in-memory arenas store the Page in front of the page data; this
+     * avoids the lookup in the cache */
+    if (env->get_flags()&HAM_IN_MEMORY_ARENA) {
+        page=InMemoryDevice::get_arena_page(address);
+        ham_assert(page->get_self()==address, (""));
+        *page_ref = page;
+        if (Metrics *metrics=env->get_metrics())
+            metrics->inc_cache_hits();
+        return (HAM_SUCCESS);
+    }
+
     /* fetch the page from the cache */
     page=env->get_cache()->get_page(address, Cache::NOREMOVE);
     if (page) {
@@ -711,12 +738,17 @@ db_fetch_page_impl(Page **page_ref, Environment *env, Database *db,
         /* store the page in the changeset if recovery is enabled */
         if (env->get_flags()&HAM_ENABLE_RECOVERY)
             env->get_changeset().add_page(page);
+        if (Metrics *metrics=env->get_metrics())
+            metrics->inc_cache_hits();
         return (HAM_SUCCESS);
     }
 
     if (flags&DB_ONLY_FROM_CACHE)
         return (HAM_SUCCESS);
 
+    if (Metrics *metrics=env->get_metrics())
+        metrics->inc_cache_misses();
+
 #if HAM_DEBUG
     ham_assert(env->get_cache()->get_page(address)==0, (""));
 #endif
@@ -728,6 +760,8 @@ db_fetch_page_impl(Page **page_ref, Environment *env, Database *db,
     }
 
     page=new Page(env, db);
+    if (flags&DB_NO_HEADER)
+        page->set_flags(Page::NPERS_NO_HEADER);
     st=page->fetch(address);
     if (st) {
         delete page;
@@ -780,6 +814,22 @@ db_flush_page(Environment *env, Page *page)
     return (0);
 }
 
+ham_status_t
+db_flush_pages(Environment *env, Page **pages, ham_size_t count)
+{
+    ham_status_t st=env->get_device()->write_pages(pages, count);
+    if (st)
+        return (st);
+
+    for (ham_size_t i=0; i<count; i++) {
+        pages[i]->set_dirty(false);
+        if (!pages[i]->is_header())
+            env->get_cache()->put_page(pages[i]);
+    }
+
+    return (0);
+}
+
 ham_status_t
 db_flush_all(Cache *cache, ham_u32_t flags)
 {
@@ -790,6 +840,42 @@ db_flush_all(Cache *cache, ham_u32_t flags)
     if (!cache)
         return (0);
 
+    /* write all dirty pages with a single call before they are released;
+     * the device sorts them by address and writes adjacent pages
+     * together, and the file filters can process several pages at once */
+    head=cache->get_totallist();
+    if (head && !(head->get_device()->get_env()->get_flags()
+                &HAM_IN_MEMORY_DB)) {
+        Device *device=head->get_device();
+        Allocator *alloc=device->get_env()->get_allocator();
+        Page **pages=0;
+        ham_size_t count=0;
+
+        for (; head; head=head->get_next(Page::LIST_CACHED)) {
+            if (head->is_dirty())
+                count++;
+        }
+
+        /* if the array can not be allocated or the write fails then the
+         * pages are written by db_write_page_and_delete, one after the
+         * other */
+        if (count>1)
+            pages=(Page **)alloc->alloc(count*sizeof(Page *));
+        if (pages) {
+            count=0;
+            for (head=cache->get_totallist(); head;
+                    head=head->get_next(Page::LIST_CACHED)) {
+                if (head->is_dirty())
+                    pages[count++]=head;
+            }
+            if (!device->write_pages(pages, count)) {
+                for (ham_size_t i=0; i<count; i++)
+                    pages[i]->set_dirty(false);
+            }
+            alloc->free(pages);
+        }
+    }
+
     head=cache->get_totallist();
     while (head) {
         Page *next=head->get_next(Page::LIST_CACHED);
@@ -1634,6 +1720,12 @@ DatabaseImplementationLocal::get_parameters(ham_parameter_t *param)
             case HAM_PARAM_KEYSIZE:
                 p->value=m_db->get_backend() ? db_get_keysize(m_db) : 21;
                 break;
+            case HAM_PARAM_KEY_TYPE:
+                p->value=m_db->get_key_type();
+                break;
+            case HAM_PARAM_RECORD_INLINE_SIZE:
+                p->value=m_db->get_backend() ? db_get_inline_size(m_db) : 0;
+                break;
             case HAM_PARAM_MAX_ENV_DATABASES:
                 p->value=env->get_max_databases();
                 break;
@@ -1846,6 +1938,9 @@ DatabaseImplementationLocal::insert(Transaction *txn, ham_key_t *key,
             flags|=HAM_OVERWRITE;
     }
 
+    if (m_db->get_bloom_filter())
+        m_db->get_bloom_filter()->insert(key);
+
     /*
      * run the record-level filters on a temporary record structure - we
      * don't want to mess up the original structure
@@ -1964,6 +2059,9 @@ DatabaseImplementationLocal::erase(Transaction *txn, ham_key_t *key,
         return (st);
     }
 
+    if (m_db->get_bloom_filter())
+        m_db->get_bloom_filter()->erase();
+
     /* record number: re-translate the number to host endian */
     if (m_db->get_rt_flags()&HAM_RECORD_NUMBER)
         *(ham_offset_t *)key->data=ham_db2h64(recno);
@@ -1981,6 +2079,138 @@ DatabaseImplementationLocal::erase(Transaction *txn, ham_key_t *key,
         return (st);
 }
 
+ham_status_t 
+DatabaseImplementationLocal::erase_range(Transaction *txn, ham_key_t *begin,
+                ham_key_t *end, ham_u32_t flags)
+{
+    ham_status_t st;
+    Transaction *local_txn=0;
+    Environment *env=m_db->get_env();
+    Backend *be=m_db->get_backend();
+    ham_offset_t recno_begin=0, recno_end=0;
+    ham_key_t b, e;
+
+    if (m_db->get_rt_flags()&HAM_READ_ONLY) {
+        ham_trace(("cannot erase from a read-only database"));
+        return (HAM_DB_READ_ONLY);
+    }
+
+    /* record number: make sure that we have valid key structures */
+    if (m_db->get_rt_flags()&HAM_RECORD_NUMBER) {
+        if ((begin && (begin->size!=sizeof(ham_u64_t) || !begin->data))
+                || (end && (end->size!=sizeof(ham_u64_t) || !end->data))) {
+            ham_trace(("key->size must be 8, key->data must not be NULL"));
+            return (HAM_INV_PARAMETER);
+        }
+    }
+
+    /*
+     * without Transactions, the subtrees in the range are removed
+     * from the btree; the changeset covers all modified pages
+     */
+    if (!txn && !(m_db->get_rt_flags()&HAM_ENABLE_TRANSACTIONS)) {
+        if (m_db->get_rt_flags()&HAM_RECORD_NUMBER) {
+            if (begin) {
+                b=*begin;
+                recno_begin=ham_h2db64(*(ham_offset_t *)begin->data);
+                b.data=&recno_begin;
+                begin=&b;
+            }
+            if (end) {
+                e=*end;
+                recno_end=ham_h2db64(*(ham_offset_t *)end->data);
+                e.data=&recno_end;
+                end=&e;
+            }
+        }
+
+        st=be->erase_range(0, begin, end, flags);
+        if (st) {
+            env->get_changeset().clear();
+            return (st);
+        }
+
+        /* the number of erased keys is unknown */
+        if (m_db->get_bloom_filter())
+            m_db->get_bloom_filter()->set_stale();
+
+        if (env->get_flags()&HAM_ENABLE_RECOVERY)
+            return (env->get_changeset().flush(DUMMY_LSN));
+        return (0);
+    }
+
+    /*
+     * with Transactions, every key is erased in the Transaction, and
+     * therefore is covered by the journal and the conflict detection
+     */
+    if (!txn) {
+        if ((st=txn_begin(&local_txn, env, 0, 0)))
+            return (st);
+    }
+
+    Cursor *c;
+    st=ham_cursor_create((ham_db_t *)m_db,
+                (ham_txn_t *)(txn ? txn : local_txn), HAM_DONT_LOCK,
+                (ham_cursor_t **)&c);
+    if (st) {
+        if (local_txn)
+            (void)txn_abort(local_txn, 0);
+        return (st);
+    }
+
+    /* the cursor is always moved to the next key before the current key
+     * is erased; the current key is copied because the arena is
+     * overwritten by the move */
+    ham_key_t key;
+    memset(&key, 0, sizeof(key));
+    if (begin) {
+        key=*begin;
+        st=cursor_find(c, &key, 0, HAM_FIND_GEQ_MATCH);
+    }
+    else
+        st=cursor_move(c, &key, 0, HAM_CURSOR_FIRST);
+
+    ByteArray buffer(env->get_allocator());
+    while (!st) {
+        if (end && m_db->compare_keys(&key, end)>=0)
+            break;
+
+        buffer.resize(key.size);
+        if (key.size && !buffer.get_ptr()) {
+            st=HAM_OUT_OF_MEMORY;
+            break;
+        }
+        if (key.size)
+            memcpy(buffer.get_ptr(), key.data, key.size);
+
+        ham_key_t current;
+        memset(&current, 0, sizeof(current));
+        current.data=buffer.get_ptr();
+        current.size=key.size;
+
+        memset(&key, 0, sizeof(key));
+        ham_status_t move_st=cursor_move(c, &key, 0,
+                    HAM_CURSOR_NEXT|HAM_SKIP_DUPLICATES);
+
+        st=erase(txn ? txn : local_txn, &current, 0);
+        if (!st)
+            st=move_st;
+    }
+    if (st==HAM_KEY_NOT_FOUND)
+        st=0;
+
+    m_db->close_cursor(c);
+
+    if (local_txn) {
+        if (st) {
+            (void)txn_abort(local_txn, 0);
+            return (st);
+        }
+        return (txn_commit(local_txn, 0));
+    }
+    return (st);
+}
+
 ham_status_t 
 DatabaseImplementationLocal::find(Transaction *txn, ham_key_t *key, 
                 ham_record_t *record, ham_u32_t flags)
@@ -2005,6 +2235,17 @@ DatabaseImplementationLocal::find(Transaction *txn, ham_key_t *key,
         return (HAM_INV_KEYSIZE);
     }
 
+    /* the bloom filter rejects most of the missing keys without
+     * fetching a page */
+    if (m_db->get_bloom_filter() && BloomFilter::can_lookup(m_db, flags)) {
+        st=BloomFilter::check(m_db);
+        if (st)
+            return (st);
+        BloomFilter *filter=m_db->get_bloom_filter();
+        if (filter && !filter->may_contain(key))
+            return (HAM_KEY_NOT_FOUND);
+    }
+
     /* if this database has duplicates, then we use ham_cursor_find
      * because we have to build a duplicate list, and this is currently
      * only available in ham_cursor_find */
@@ -2165,6 +2406,9 @@ DatabaseImplementationLocal::cursor_insert(Cursor *cursor, ham_key_t *key,
             return (st);
     }
 
+    if (m_db->get_bloom_filter())
+        m_db->get_bloom_filter()->insert(key);
+
     /*
      * run the record-level filters on a temporary record structure - we
      * don't want to mess up the original structure
@@ -2206,19 +2450,18 @@ DatabaseImplementationLocal::cursor_insert(Cursor *cursor, ham_key_t *key,
                 txn_op_t *op=txn_cursor_get_coupled_op(txnc);
                 ham_assert(op!=0, (""));
 
-                for (i=0; i<dc->get_count(); i++) {
-                    DupeCacheLine *l=dc->get_element(i);
-                    if (!l->use_btree() && l->get_txn_op()==op) {
-                        cursor->set_dupecache_index(i+1);
-                        break;
-                    }
-                }
+                i=dc->find_txn_op(op);
+                if (i)
+                    cursor->set_dupecache_index(i);
             }
             env->get_changeset().clear();
         }
     }
     else {
-        st=btree_cursor_insert(cursor->get_btree_cursor(),
+        if (m_db->get_rt_flags()&HAM_USE_HASH)
+            st=hash_cursor_insert(cursor, key, &temprec, flags);
+        else
+            st=btree_cursor_insert(cursor->get_btree_cursor(),
                     key, &temprec, flags);
         if (st==0)
             cursor->couple_to_btree();
@@ -2318,6 +2561,8 @@ DatabaseImplementationLocal::cursor_erase(Cursor *cursor, ham_u32_t flags)
         ham_assert(txn_cursor_is_nil(cursor->get_txn_cursor()), (""));
         ham_assert(cursor->is_nil(0), (""));
         cursor->clear_dupecache();
+        if (m_db->get_bloom_filter())
+            m_db->get_bloom_filter()->erase();
     }
     else {
         if (local_txn)
@@ -2453,7 +2698,10 @@ DatabaseImplementationLocal::cursor_find(Cursor *cursor, ham_key_t *key,
     }
 
 btree:
-    st=btree_cursor_find(cursor->get_btree_cursor(), key, record, flags);
+    if (m_db->get_rt_flags()&HAM_USE_HASH)
+        st=hash_cursor_find(cursor, key, record, flags);
+    else
+        st=btree_cursor_find(cursor->get_btree_cursor(), key, record, flags);
     if (st==0) {
         cursor->couple_to_btree();
         /* if btree keys were found: reset the dupecache. The previous
@@ -2467,8 +2715,8 @@ check_dupes:
     /* if the key has duplicates: build a duplicate table, then
      * couple to the first/oldest duplicate */
     if (cursor->get_dupecache_count()) {
-        DupeCacheLine *e=cursor->get_dupecache()->get_first_element();
-        if (e->use_btree())
+        DupeCacheLine e=cursor->get_dupecache()->get_element(0);
+        if (e.use_btree())
             cursor->couple_to_btree();
         else
             cursor->couple_to_txnop();
@@ -2746,6 +2994,17 @@ DatabaseImplementationLocal::cursor_move(Cursor *cursor, ham_key_t *key,
             return (st);
     }
 
+    /* hash Databases have no order and no Transactions */
+    if (m_db->get_rt_flags()&HAM_USE_HASH) {
+        st=hash_cursor_move(cursor, key, record, flags);
+        env->get_changeset().clear();
+        if (st)
+            return (st);
+
+        /* run the record-level filters */
+        return (__record_filters_after_find(m_db, record));
+    }
+
     /*
      * if the cursor was never used before and the user requests a NEXT then
      * move the cursor to FIRST; if the user requests a PREVIOUS we set it
@@ -2835,6 +3094,138 @@ DatabaseImplementationLocal::cursor_move(Cursor *cursor, ham_key_t *key,
         return (st);
 }
 
+/**
+ * appends the data of a key or record to the batch arena of a Cursor;
+ * *data is replaced by the offset of the copy, because the arena can be
+ * reallocated while the batch is filled
+ */
+static void
+__batch_append(ByteArray &arena, ham_size_t *used, void **data,
+                ham_size_t size)
+{
+    ham_size_t offset=*used;
+
+    if (offset+size>arena.get_size()) {
+        ham_size_t newsize=arena.get_size()*2;
+        if (newsize<offset+size)
+            newsize=offset+size;
+        if (newsize<1024)
+            newsize=1024;
+        arena.resize(newsize);
+    }
+
+    if (size)
+        memcpy((char *)arena.get_ptr()+offset, *data, size);
+    *data=(void *)(size_t)offset;
+    *used=offset+size;
+}
+
+/**
+ * the loop of ham_cursor_move_many; the first item is retrieved with
+ * cursor_move(), which also handles nil Cursors and Transactions. If
+ * @a btree_only is true then the following items are read directly
+ * from the btree cursor, which usually only increments the slot in the
+ * current leaf page
+ */
+static ham_status_t
+__cursor_move_many(DatabaseImplementation *impl, Database *db,
+                Cursor *cursor, ham_key_t *keys, ham_record_t *records,
+                ham_u32_t *count, ham_u32_t flags, bool btree_only)
+{
+    ham_status_t st=0;
+    ByteArray &arena=cursor->get_batch_arena();
+    ham_size_t used=0;
+    ham_u32_t i, n=0;
+    ham_u32_t step=flags;
+    ham_u32_t direction=(flags&(HAM_CURSOR_FIRST|HAM_CURSOR_NEXT))
+                            ? HAM_CURSOR_NEXT
+                            : HAM_CURSOR_PREVIOUS;
+
+    for (n=0; n<*count; n++) {
+        ham_key_t *key=keys ? &keys[n] : 0;
+        ham_record_t *record=records ? &records[n] : 0;
+        bool copy_key=key && !(key->flags&HAM_KEY_USER_ALLOC);
+        bool copy_record=record && !(record->flags&HAM_RECORD_USER_ALLOC)
+                            && !(flags&HAM_DIRECT_ACCESS);
+
+        if (n==0 || !btree_only)
+            st=impl->cursor_move(cursor, key, record, step);
+        else {
+            st=btree_cursor_move(cursor->get_btree_cursor(),
+                            key, record, step);
+            db->get_env()->get_changeset().clear();
+            if (st==0 && record)
+                st=__record_filters_after_find(db, record);
+        }
+        if (st)
+            break;
+
+        if (copy_key)
+            __batch_append(arena, &used, &key->data, key->size);
+        if (copy_record)
+            __batch_append(arena, &used, &record->data, record->size);
+
+        step=(flags&~(HAM_CURSOR_FIRST|HAM_CURSOR_LAST|HAM_CURSOR_NEXT
+                        |HAM_CURSOR_PREVIOUS))|direction;
+    }
+
+    /* with Transactions, a Cursor which moved past the end is nil, and
+     * the next move would return the last item again; the Cursor is
+     * therefore coupled to the last returned item, which is the last
+     * (or first) item of the Database */
+    if (st==HAM_KEY_NOT_FOUND && n>0 && cursor->is_nil(0)
+            && !(flags&HAM_ONLY_DUPLICATES)) {
+        st=impl->cursor_move(cursor, 0, 0,
+                    (step&~direction)|(direction==HAM_CURSOR_NEXT
+                        ? HAM_CURSOR_LAST
+                        : HAM_CURSOR_FIRST));
+        if (st==0)
+            st=HAM_KEY_NOT_FOUND;
+    }
+
+    /* now that the arena is no longer resized, the offsets are
+     * converted back to pointers */
+    for (i=0; i<n; i++) {
+        if (keys && !(keys[i].flags&HAM_KEY_USER_ALLOC))
+            keys[i].data=keys[i].size
+                    ? (char *)arena.get_ptr()+(size_t)keys[i].data
+                    : 0;
+        if (records && !(records[i].flags&HAM_RECORD_USER_ALLOC)
+                && !(flags&HAM_DIRECT_ACCESS))
+            records[i].data=records[i].size
+                    ? (char *)arena.get_ptr()+(size_t)records[i].data
+                    : 0;
+    }
+
+    *count=n;
+
+    /* the end of the Database is only reported if no item was found */
+    if (st==HAM_KEY_NOT_FOUND && n>0)
+        return (0);
+    return (st);
+}
+
+ham_status_t
+DatabaseImplementation::cursor_move_many(Cursor *cursor, ham_key_t *keys,
+                ham_record_t *records, ham_u32_t *count, ham_u32_t flags)
+{
+    return (__cursor_move_many(this, m_db, cursor, keys, records,
+                count, flags, false));
+}
+
+ham_status_t
+DatabaseImplementationLocal::cursor_move_many(Cursor *cursor,
+                ham_key_t *keys, ham_record_t *records, ham_u32_t *count,
+                ham_u32_t flags)
+{
+    /* without Transactions, the btree cursor can be moved directly */
+    bool btree_only=!(m_db->get_rt_flags()
+                    &(HAM_ENABLE_TRANSACTIONS|HAM_USE_HASH));
+
+    return (__cursor_move_many(this, m_db, cursor, keys, records,
+                count, flags, btree_only));
+}
+
 void
 DatabaseImplementationLocal::cursor_close(Cursor *cursor)
 {
@@ -2878,6 +3269,13 @@ DatabaseImplementationLocal::close(ham_u32_t flags)
     
     btree_stats_flush_dbdata(m_db, m_db->get_perf_data(), has_other_db);
 
+    /* store the bloom filter */
+    if (m_db->get_bloom_filter()) {
+        st=BloomFilter::close(m_db);
+        if (st && st2==0)
+            st2=st;
+    }
+
     /*
      * if we're not in read-only mode, and not an in-memory-database,
      * and the dirty-flag is true: flush the page-header to disk
@@ -2990,6 +3388,7 @@ DatabaseImplementationLocal::close(ham_u32_t flags)
         record_head=next;
     }
     m_db->set_record_filter(0);
+    m_db->set_page_compression(0);
 
     /*
      * trash all DB performance data
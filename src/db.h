@@ -29,6 +29,7 @@
 #include "btree_key.h"
 #include "btree.h"
 #include "mem.h"
+#include "keytype.h"
 
 /**
  * a macro to cast pointers to u64 and vice versa to avoid compiler
@@ -57,6 +58,9 @@
 /** get the key size */
 #define db_get_keysize(db)              ((db)->get_backend()->get_keysize())
 
+/** get the size of the inline records */
+#define db_get_inline_size(db)          ((db)->get_backend()->get_inline_size())
+
 /** get the (non-persisted) flags of a key */
 #define ham_key_get_intflags(key)       (key)->_flags
 
@@ -86,8 +90,9 @@ HAM_PACK_0 struct HAM_PACK_1 db_indexdata_t
     /** key size in this page */
     ham_u16_t _keysize;
 
-    /* reserved */
-    ham_u16_t _reserved1;
+    /** address of the bloom filter (high 16 bits); the address is
+     * therefore limited to 48 bits (256 TB) */
+    ham_u16_t _bloom_hi;
 
     /** address of this page */
     ham_offset_t _self;
@@ -98,8 +103,8 @@ HAM_PACK_0 struct HAM_PACK_1 db_indexdata_t
     /** last used record number value */
     ham_offset_t _recno;
 
-    /* reserved */
-    ham_u32_t _reserved2;
+    /** address of the bloom filter (low 32 bits) */
+    ham_u32_t _bloom_lo;
 
 } HAM_PACK_2;
 
@@ -124,8 +129,15 @@ HAM_PACK_0 struct HAM_PACK_1 db_indexdata_t
 #define index_get_recno(p)                ham_db2h_offset((p)->_recno)
 #define index_set_recno(p, n)             (p)->_recno=ham_h2db_offset(n)
 
-#define index_clear_reserved(p)           { (p)->_reserved1=0;            \
-                                            (p)->_reserved2=0; }
+#define index_get_bloom_filter(p)                                           \
+            (((ham_offset_t)ham_db2h16((p)->_bloom_hi)<<32)                 \
+                |ham_db2h32((p)->_bloom_lo))
+#define index_set_bloom_filter(p, n)                                        \
+            { ham_offset_t __bf=(ham_offset_t)(n);                          \
+              ham_assert((__bf>>48)==0,                                     \
+                    ("bloom filter address exceeds 48 bits"));              \
+              (p)->_bloom_hi=ham_h2db16((ham_u16_t)(__bf>>32));             \
+              (p)->_bloom_lo=ham_h2db32((ham_u32_t)__bf); }
 
 /**
  * This helper class provides the actual implementation of the
@@ -159,6 +171,10 @@ class DatabaseImplementation
     virtual ham_status_t erase(Transaction *txn, ham_key_t *key, 
                     ham_u32_t flags) = 0;
 
+    /** erase a range of keys */
+    virtual ham_status_t erase_range(Transaction *txn, ham_key_t *begin,
+                    ham_key_t *end, ham_u32_t flags) = 0;
+
     /** lookup of a key/value pair */
     virtual ham_status_t find(Transaction *txn, ham_key_t *key, 
                     ham_record_t *record, ham_u32_t flags) = 0;
@@ -196,6 +212,12 @@ class DatabaseImplementation
     virtual ham_status_t cursor_move(Cursor *cursor,
                     ham_key_t *key, ham_record_t *record, ham_u32_t flags) = 0;
 
+    /** move a cursor over up to *count items, return their keys and/or
+     * records; the default implementation calls cursor_move() */
+    virtual ham_status_t cursor_move_many(Cursor *cursor,
+                    ham_key_t *keys, ham_record_t *records, ham_u32_t *count,
+                    ham_u32_t flags);
+
     /** close a cursor */
     virtual void cursor_close(Cursor *cursor) = 0;
 
@@ -233,6 +255,10 @@ class DatabaseImplementationLocal : public DatabaseImplementation
     /** erase a key/value pair */
     virtual ham_status_t erase(Transaction *txn, ham_key_t *key, ham_u32_t flags);
 
+    /** erase a range of keys */
+    virtual ham_status_t erase_range(Transaction *txn, ham_key_t *begin,
+                    ham_key_t *end, ham_u32_t flags);
+
     /** lookup of a key/value pair */
     virtual ham_status_t find(Transaction *txn, ham_key_t *key, 
                     ham_record_t *record, ham_u32_t flags);
@@ -270,6 +296,12 @@ class DatabaseImplementationLocal : public DatabaseImplementation
     virtual ham_status_t cursor_move(Cursor *cursor,
                     ham_key_t *key, ham_record_t *record, ham_u32_t flags);
 
+    /** move a cursor over up to *count items, return their keys and/or
+     * records */
+    virtual ham_status_t cursor_move_many(Cursor *cursor,
+                    ham_key_t *keys, ham_record_t *records, ham_u32_t *count,
+                    ham_u32_t flags);
+
     /** close a cursor */
     virtual void cursor_close(Cursor *cursor);
 
@@ -307,6 +339,10 @@ class DatabaseImplementationRemote : public DatabaseImplementation
     /** erase a key/value pair */
     virtual ham_status_t erase(Transaction *txn, ham_key_t *key, ham_u32_t flags);
 
+    /** erase a range of keys */
+    virtual ham_status_t erase_range(Transaction *txn, ham_key_t *begin,
+                    ham_key_t *end, ham_u32_t flags);
+
     /** lookup of a key/value pair */
     virtual ham_status_t find(Transaction *txn, ham_key_t *key, 
                     ham_record_t *record, ham_u32_t flags);
@@ -454,9 +490,40 @@ class Database
         return (m_cmp_func);
     }
 
-    /** set the default comparison function */
+    /** set the default comparison function; this disables the
+     * built-in comparator of a typed Database */
     void set_compare_func(ham_compare_func_t f) {
         m_cmp_func=f;
+        m_typed_compare=false;
+    }
+
+    /** get the key type (HAM_TYPE_*) */
+    ham_u16_t get_key_type() {
+        return (m_key_type);
+    }
+
+    /** set the key type; typed Databases install the compare function
+     * of the type, and compare keys without calling it */
+    void set_key_type(ham_u16_t type) {
+        m_key_type=type;
+        if (type!=HAM_TYPE_BINARY) {
+            m_cmp_func=keytype_get_compare_func(type);
+            m_prefix_func=0;
+            m_typed_compare=true;
+        }
+    }
+
+    /** returns true if keys are compared with the built-in comparator
+     * of the key type */
+    bool has_typed_compare() {
+        return (m_typed_compare);
+    }
+
+    /** returns the size of all keys of a typed Database, or 0 */
+    ham_u16_t get_key_type_size() {
+        if (m_key_type==HAM_TYPE_BINARY_FIXED)
+            return (db_get_keysize(this));
+        return (keytype_get_size(m_key_type));
     }
 
     /** get the duplicate record comparison function */
@@ -518,6 +585,16 @@ class Database
     void set_extkey_cache(ExtKeyCache *c) {
         m_extkey_cache=c;
     }
+
+    /** get the bloom filter */
+    BloomFilter *get_bloom_filter(void) {
+        return (m_bloom_filter);
+    }
+
+    /** set the bloom filter */
+    void set_bloom_filter(BloomFilter *filter) {
+        m_bloom_filter=filter;
+    }
  
     /** get the index of this database in the indexdata array */
     ham_u16_t get_indexdata_offset(void) {
@@ -539,6 +616,19 @@ class Database
         m_record_filters=f;
     }
 
+    /**
+     * get the zlib compression level of the index pages, or 0 if the
+     * pages are not compressed (see @ref HAM_COMPRESS_PAGES)
+     */
+    ham_u32_t get_page_compression(void) {
+        return (m_page_compression);
+    }
+
+    /** set the zlib compression level of the index pages */
+    void set_page_compression(ham_u32_t level) {
+        m_page_compression=level;
+    }
+
     /** get the expected data access mode for this database */
     ham_u16_t get_data_access_mode(void) {
         return (m_data_access_mode);
@@ -617,6 +707,11 @@ class Database
         ham_prefix_compare_func_t prefoo=get_prefix_compare_func();
     
         set_error(0);
+
+        /* typed keys are never extended */
+        if (m_typed_compare)
+            return (keytype_compare(m_key_type, lhs->data, lhs->size,
+                            rhs->data, rhs->size));
     
         /* need prefix compare? if no key is extended we can just call the
          * normal compare function */
@@ -748,6 +843,12 @@ class Database
     /** the duplicate keys record comparison function */
     ham_compare_func_t m_duperec_func;
 
+    /** the key type (HAM_TYPE_*) */
+    ham_u16_t m_key_type;
+
+    /** true if the built-in comparator of the key type is used */
+    bool m_typed_compare;
+
     /** the database flags - a combination of the persistent flags
      * and runtime flags */
     ham_u32_t m_rt_flags;
@@ -761,12 +862,18 @@ class Database
     /** the cache for extended keys */
     ExtKeyCache *m_extkey_cache;
 
+    /** the bloom filter, or NULL */
+    BloomFilter *m_bloom_filter;
+
     /** the offset of this database in the environment _indexdata */
     ham_u16_t m_indexdata_offset;
 
     /** linked list of all record-level filters */
     ham_record_filter_t *m_record_filters;
 
+    /** the compression level of the index pages, or 0 */
+    ham_u32_t m_page_compression;
+
     /** current data access mode (DAM) */
     ham_u16_t m_data_access_mode;
 
@@ -933,6 +1040,12 @@ db_fetch_page_impl(Page **page_ref, Environment *env, Database *db,
  */
 #define DB_ONLY_FROM_CACHE                0x0002
 
+/**
+ * The page does not have a page header (i.e. it's a blob page); its
+ * checksum is not verified when it is read from the device
+ */
+#define DB_NO_HEADER                      0x0004
+
 /**
  * @}
  */
@@ -944,6 +1057,13 @@ db_fetch_page_impl(Page **page_ref, Environment *env, Database *db,
 extern ham_status_t
 db_flush_page(Environment *env, Page *page);
 
+/**
+ * flush several dirty pages; the pages are written with
+ * @ref Device::write_pages, which can reorder the array
+ */
+extern ham_status_t
+db_flush_pages(Environment *env, Page **pages, ham_size_t count);
+
 /**
  * Flush all pages, and clear the cache.
  *
@@ -1028,6 +1148,29 @@ db_write_page_and_delete(Page *page, ham_u32_t flags);
 /** An internal database flag - env handle is remote */
 #define DB_IS_REMOTE                 0x00200000
 
+/** The persistent key type (HAM_TYPE_*) is stored in these flag bits */
+#define DB_KEY_TYPE_MASK             0x0e000000
+
+/** The shift of the key type in the persistent flags */
+#define DB_KEY_TYPE_SHIFT            25
+
+/**
+ * The size of the inline records (see @ref HAM_PARAM_RECORD_INLINE_SIZE),
+ * in units of @ref DB_INLINE_SIZE_UNIT, is stored in these persistent flag
+ * bits; the run-time flags at these positions are never persisted
+ */
+#define DB_INLINE_SIZE_MASK          0x000f8000
+
+/** The shift of the inline record size in the persistent flags */
+#define DB_INLINE_SIZE_SHIFT         15
+
+/** The granularity of the inline record size */
+#define DB_INLINE_SIZE_UNIT          8
+
+/** The maximum size of an inline record */
+#define DB_MAX_INLINE_SIZE                                                  \
+            ((DB_INLINE_SIZE_MASK>>DB_INLINE_SIZE_SHIFT)*DB_INLINE_SIZE_UNIT)
+
 /**
  * @}
  */
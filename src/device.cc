@@ -13,45 +13,219 @@
 #include "config.h"
 
 #include <string.h>
+#include <algorithm>
 
+#include "backup.h"
+#include "cipher.h"
+#include "compressor.h"
 #include "db.h"
 #include "device.h"
 #include "error.h"
+#include "errorinducer.h"
 #include "mem.h"
 #include "os.h"
 #include "page.h"
 #include "env.h"
 
 
+static bool
+__compare_address(Page *lhs, Page *rhs)
+{
+    return (lhs->get_self()<rhs->get_self());
+}
+
+static PageCipher *
+__get_cipher(ham_file_filter_t *filter)
+{
+#ifndef HAM_DISABLE_ENCRYPTION
+    if (filter->_flags&PageCipher::FILTER_FLAG)
+        return ((PageCipher *)filter->userdata);
+#endif
+    return (0);
+}
+
+void
+device_update_checksum(Environment *env, Page *page)
+{
+    if (page->is_header() || (page->get_flags()&Page::NPERS_NO_HEADER))
+        return;
+
+    if (env->get_flags()&HAM_ENABLE_CRC32)
+        page->set_checksum();
+    else if (page->has_checksum())
+        page->clear_checksum();
+}
+
+bool
+device_has_cipher(Environment *env)
+{
+    for (ham_file_filter_t *head=env->get_file_filter(); head;
+            head=head->_next) {
+        if (__get_cipher(head))
+            return (true);
+    }
+    return (false);
+}
+
+ham_status_t
+device_filters_before_write(Environment *env, ham_offset_t offset,
+            ham_u8_t *data, ham_size_t size)
+{
+    ham_status_t st;
+
+    for (ham_file_filter_t *head=env->get_file_filter(); head;
+            head=head->_next) {
+        if (PageCipher *cipher=__get_cipher(head))
+            cipher->encrypt(offset, data, size);
+        else if (head->before_write_cb) {
+            st=head->before_write_cb((ham_env_t *)env, head, data, size);
+            if (st)
+                return (st);
+        }
+    }
+
+    return (0);
+}
+
+ham_status_t
+device_filters_after_read(Environment *env, ham_offset_t offset,
+            ham_u8_t *data, ham_size_t size)
+{
+    ham_status_t st;
+
+    for (ham_file_filter_t *head=env->get_file_filter(); head;
+            head=head->_next) {
+        if (PageCipher *cipher=__get_cipher(head))
+            cipher->decrypt(offset, data, size);
+        else if (head->after_read_cb) {
+            st=head->after_read_cb((ham_env_t *)env, head, data, size);
+            if (st)
+                return (st);
+        }
+    }
+
+    return (0);
+}
+
 ham_status_t
 FileDevice::read(ham_offset_t offset, void *buffer, ham_offset_t size)
 {
-    ham_file_filter_t *head=0;
     ham_status_t st;
 
+    /*
+     * the PageCipher decrypts whole 16 byte blocks; unaligned reads (i.e.
+     * of blobs) read the enclosing blocks into a temporary buffer
+     */
+    if (offset!=0 && m_env->get_file_filter()
+            && ((offset|size)%PageCipher::BLOCK_SIZE)
+            && device_has_cipher(m_env)) {
+        ham_offset_t start=offset-offset%PageCipher::BLOCK_SIZE;
+        ham_offset_t end=offset+size;
+        if (end%PageCipher::BLOCK_SIZE)
+            end+=PageCipher::BLOCK_SIZE-end%PageCipher::BLOCK_SIZE;
+
+        ham_u8_t *tempdata=(ham_u8_t *)m_env->get_allocator()->alloc(
+                        (ham_size_t)(end-start));
+        if (!tempdata)
+            return (HAM_OUT_OF_MEMORY);
+        st=FileDevice::read(start, tempdata, end-start);
+        if (!st)
+            memcpy(buffer, tempdata+(offset-start), (size_t)size);
+        m_env->get_allocator()->free(tempdata);
+        return (st);
+    }
+
     st=os_pread(m_fd, offset, buffer, size);
     if (st)
         return (st);
 
+    if (Metrics *metrics=m_env->get_metrics())
+        metrics->add_bytes_read(size);
+
     /*
      * we're done unless there are file filters (or if we're reading the
      * header page - the header page is not filtered)
      */
-    head=m_env->get_file_filter();
-    if (!head || offset==0)
+    if (!m_env->get_file_filter() || offset==0)
         return (0);
 
-    /*
-     * otherwise run the filters
-     */
-    while (head) {
-        if (head->after_read_cb) {
-            st=head->after_read_cb((ham_env_t *)m_env, head,
-                        (ham_u8_t *)buffer, (ham_size_t)size);
-            if (st)
-                return (st);
+    /* otherwise run the filters */
+    return (device_filters_after_read(m_env, offset, (ham_u8_t *)buffer,
+                (ham_size_t)size));
+}
+
+FileDevice::~FileDevice()
+{
+    delete m_compressor;
+}
+
+ham_u32_t
+FileDevice::get_compression_level(Page *page)
+{
+    if (page->is_header() || (page->get_flags()&Page::NPERS_NO_HEADER))
+        return (0);
+
+    /* the file filters (except the PageCipher) expect whole pages */
+    for (ham_file_filter_t *head=m_env->get_file_filter(); head;
+            head=head->_next) {
+        if (!__get_cipher(head))
+            return (0);
+    }
+
+    switch (page->get_type()) {
+      case Page::TYPE_B_ROOT:
+      case Page::TYPE_B_INDEX:
+        return (page->get_db() ? page->get_db()->get_page_compression() : 0);
+      case Page::TYPE_FREELIST:
+        /* the freelist is shared by all Databases */
+        for (Database *db=m_env->get_databases(); db; db=db->get_next()) {
+            if (db->get_page_compression())
+                return (db->get_page_compression());
+        }
+        return (0);
+      default:
+        return (0);
+    }
+}
+
+PageCompressor *
+FileDevice::get_compressor()
+{
+    if (!m_compressor)
+        m_compressor=new PageCompressor(get_pagesize());
+    return (m_compressor);
+}
+
+ham_status_t
+FileDevice::decompress_page(Page *page, bool mapped)
+{
+    ham_size_t pagesize=get_pagesize();
+    ham_u8_t *buffer;
+    ham_status_t st;
+
+    buffer=(ham_u8_t *)m_env->get_allocator()->alloc(pagesize);
+    if (!buffer)
+        return (HAM_OUT_OF_MEMORY);
+
+    st=get_compressor()->decompress((ham_u8_t *)page->get_pers(), buffer);
+    if (st) {
+        m_env->get_allocator()->free(buffer);
+        return (st);
+    }
+
+    /* a mapped page is replaced by the decompressed copy */
+    if (mapped) {
+        st=free_page(page);
+        if (st) {
+            m_env->get_allocator()->free(buffer);
+            return (st);
         }
-        head=head->_next;
+        page->set_pers((page_data_t *)buffer);
+        page->set_flags(page->get_flags()|Page::NPERS_MALLOC);
+    }
+    else {
+        memcpy(page->get_pers(), buffer, pagesize);
+        m_env->get_allocator()->free(buffer);
     }
 
     return (0);
@@ -64,6 +238,7 @@ FileDevice::read_page(Page *page)
     ham_status_t st;
     ham_file_filter_t *head=0;
     ham_size_t size=get_pagesize();
+    bool mapped=false;
     
     head=m_env->get_file_filter();
 
@@ -84,6 +259,9 @@ FileDevice::read_page(Page *page)
             set_flags(get_flags()|HAM_DISABLE_MMAP);
             goto fallback_rw;
         }
+        mapped=true;
+        if (Metrics *metrics=m_env->get_metrics())
+            metrics->add_bytes_read(size);
     }
     else {
 fallback_rw:
@@ -97,31 +275,49 @@ fallback_rw:
         else
             ham_assert(!(page->get_flags()&Page::NPERS_MALLOC), (0));
 
-        st=FileDevice::read(page->get_self(), page->get_pers(), size);
+        /* don't call FileDevice::read - it would already run the
+         * file filters */
+        st=os_pread(m_fd, page->get_self(), page->get_pers(), size);
         if (st)
             return (st);
+        buffer=(ham_u8_t *)page->get_pers();
+        if (Metrics *metrics=m_env->get_metrics())
+            metrics->add_bytes_read(size);
     }
 
-    /*
-     * we're done unless there are file filters (or if we're reading the
-     * header page - the header page is not filtered)
-     */
-    if (!head || page->is_header()) {
-        page->set_pers((page_data_t *)buffer);
-        return (0);
+    if (Metrics *metrics=m_env->get_metrics())
+        metrics->inc_pages_read();
+
+    /* run the file filters, but not for the header page */
+    if (head && !page->is_header()) {
+        st=device_filters_after_read(m_env, page->get_self(), buffer, size);
+        if (st)
+            return (st);
     }
 
-    /* otherwise run the filters */
-    while (head) {
-        if (head->after_read_cb) {
-            st=head->after_read_cb((ham_env_t *)m_env, head, buffer, size);
-            if (st)
-                return (st);
+    page->set_pers((page_data_t *)buffer);
+
+    /* decompress the page if it was stored compressed */
+    if (!page->is_header() && !(page->get_flags()&Page::NPERS_NO_HEADER)
+            && PageCompressor::is_compressed(buffer)) {
+        st=decompress_page(page, mapped);
+        if (st) {
+            (void)free_page(page);
+            return (st);
         }
-        head=head->_next;
     }
 
-    page->set_pers((page_data_t *)buffer);
+    /* verify the checksum if the page has one */
+    if (!page->is_header() && !(page->get_flags()&Page::NPERS_NO_HEADER)
+            && page->has_checksum() && !page->verify_checksum()) {
+        ham_log(("checksum mismatch in page %llu",
+                    (unsigned long long)page->get_self()));
+        if (Metrics *metrics=m_env->get_metrics())
+            metrics->inc_checksum_failures();
+        (void)free_page(page);
+        return (HAM_CHECKSUM_MISMATCH);
+    }
+
     return (0);
 }
 
@@ -132,6 +328,15 @@ FileDevice::write(ham_offset_t offset, void *buffer, ham_offset_t size)
     ham_status_t st=0;
     ham_file_filter_t *head=0;
 
+    if (Metrics *metrics=m_env->get_metrics())
+        metrics->add_bytes_written(size);
+
+    m_modification_count++;
+
+    /* a running backup saves the old contents of the page */
+    if (Backup *backup=m_env->get_backup())
+        backup->before_write(offset, size);
+
     /*
      * run page through page-level filters, but not for the
      * root-page!
@@ -140,29 +345,305 @@ FileDevice::write(ham_offset_t offset, void *buffer, ham_offset_t size)
     if (!head || offset==0)
         return (os_pwrite(m_fd, offset, buffer, size));
 
+    ham_assert(((offset|size)%PageCipher::BLOCK_SIZE)==0
+            || !device_has_cipher(m_env), ("unaligned write"));
+
     /* don't modify the data in-place!  */
     tempdata=(ham_u8_t *)m_env->get_allocator()->alloc((ham_size_t)size);
     if (!tempdata)
         return (HAM_OUT_OF_MEMORY);
     memcpy(tempdata, buffer, size);
 
-    while (head) {
-        if (head->before_write_cb) {
-            st=head->before_write_cb((ham_env_t *)m_env, head, tempdata,
-                            (ham_size_t)size);
-            if (st)
+    st=device_filters_before_write(m_env, offset, tempdata, (ham_size_t)size);
+    if (!st)
+        st=os_pwrite(m_fd, offset, tempdata, size);
+
+    m_env->get_allocator()->free(tempdata);
+    return (st);
+}
+
+ham_status_t
+FileDevice::write_page(Page *page)
+{
+    /* compressed pages are written like a batch of one page */
+    if (get_compression_level(page))
+        return (write_filtered_pages(&page, 1));
+
+    if (Metrics *metrics=m_env->get_metrics()) {
+        metrics->inc_pages_written();
+        metrics->inc_page_writes();
+    }
+
+    device_update_checksum(m_env, page);
+
+    return (write(page->get_self(), page->get_pers(), get_pagesize()));
+}
+
+/*
+ * a unittest hook; the ErrorInducer of the Changeset (see
+ * unittests/recovery.cpp) can fail Changeset::flush() after any of the
+ * writes of a single write_pages() call
+ */
+static ham_status_t
+__induce_write_error(Environment *env)
+{
+    ErrorInducer *ei=env->get_changeset().m_inducer;
+    if (ei)
+        return (ei->induce(ErrorInducer::CHANGESET_FLUSH));
+    return (0);
+}
+
+ham_status_t
+FileDevice::write_pages(Page **pages, ham_size_t count)
+{
+    ham_size_t i;
+
+    if (count==1)
+        return (Device::write_pages(pages, count));
+
+    /* adjacent pages are written together */
+    std::sort(pages, pages+count, __compare_address);
+
+    if (!m_env->get_file_filter()) {
+        for (i=0; i<count; i++) {
+            if (get_compression_level(pages[i]))
                 break;
         }
-        head=head->_next;
+        if (i==count)
+            return (write_page_runs(pages, count));
     }
 
-    if (!st)
-        st=os_pwrite(m_fd, offset, tempdata, size);
+    return (write_filtered_pages(pages, count));
+}
 
+ham_status_t
+FileDevice::write_page_runs(Page **pages, ham_size_t count)
+{
+    ham_size_t pagesize=get_pagesize();
+    ham_offset_t addresses[MAX_WRITE_PAGES];
+    void *buffers[MAX_WRITE_PAGES];
+    ham_size_t sizes[MAX_WRITE_PAGES];
+    ham_size_t i, n;
+    ham_status_t st;
+
+    while (count) {
+        ham_size_t batch=count<MAX_WRITE_PAGES ? count : MAX_WRITE_PAGES;
+
+        for (i=0; i<batch; i++) {
+            device_update_checksum(m_env, pages[i]);
+            addresses[i]=pages[i]->get_self();
+            buffers[i]=pages[i]->get_pers();
+            sizes[i]=pagesize;
+        }
+
+        for (i=0; i<batch; i+=n) {
+            n=get_run_length(&addresses[i], &sizes[i], batch-i);
+            st=write_run(&addresses[i], &buffers[i], &sizes[i], n);
+            if (st)
+                return (st);
+            st=__induce_write_error(m_env);
+            if (st)
+                return (st);
+        }
+
+        pages+=batch;
+        count-=batch;
+    }
+
+    return (0);
+}
+
+ham_size_t
+FileDevice::get_run_length(const ham_offset_t *addresses,
+            const ham_size_t *sizes, ham_size_t count)
+{
+    ham_size_t pagesize=get_pagesize();
+    ham_size_t max=m_env->get_max_write_size()/pagesize;
+    ham_size_t n=1;
+
+    if (max>MAX_WRITE_PAGES)
+        max=MAX_WRITE_PAGES;
+
+    /* compressed images are shorter than a page and leave a gap */
+    if (sizes[0]!=pagesize)
+        return (1);
+
+    while (n<count && n<max && sizes[n]==pagesize
+            && addresses[n]==addresses[0]+(ham_offset_t)n*pagesize)
+        n++;
+    return (n);
+}
+
+ham_status_t
+FileDevice::write_run(const ham_offset_t *addresses, void **buffers,
+            const ham_size_t *sizes, ham_size_t count)
+{
+    for (ham_size_t i=0; i<count; i++) {
+        if (Metrics *metrics=m_env->get_metrics()) {
+            metrics->inc_pages_written();
+            metrics->add_bytes_written(sizes[i]);
+        }
+        m_modification_count++;
+        if (Backup *backup=m_env->get_backup())
+            backup->before_write(addresses[i], get_pagesize());
+    }
+    if (Metrics *metrics=m_env->get_metrics())
+        metrics->inc_page_writes();
+
+    if (count==1)
+        return (os_pwrite(m_fd, addresses[0], buffers[0], sizes[0]));
+    return (os_pwritev(m_fd, addresses[0], buffers, sizes, count));
+}
+
+ham_status_t
+FileDevice::write_filtered_pages(Page **pages, ham_size_t count)
+{
+    ham_size_t pagesize=get_pagesize();
+    ham_file_filter_t *head;
+    ham_offset_t addresses[WRITE_BATCH_SIZE];
+    ham_u8_t *buffers[WRITE_BATCH_SIZE];
+    ham_size_t sizes[WRITE_BATCH_SIZE];
+    ham_u8_t *tempdata;
+    ham_size_t i, n, run;
+    ham_status_t st=0;
+
+    /* the filters are applied to a copy of the pages, all pages of a
+     * batch share one buffer */
+    n=count<WRITE_BATCH_SIZE ? count : WRITE_BATCH_SIZE;
+    tempdata=(ham_u8_t *)m_env->get_allocator()->alloc(n*pagesize);
+    if (!tempdata)
+        return (HAM_OUT_OF_MEMORY);
+
+    while (count) {
+        ham_size_t batch=0;
+        bool compressed=false;
+
+        for (i=0; i<count && batch<WRITE_BATCH_SIZE; i++) {
+            Page *page=pages[i];
+            ham_u32_t level;
+
+            /* the header page is not filtered */
+            if (page->is_header()) {
+                st=write_page(page);
+                if (st)
+                    goto bail;
+                continue;
+            }
+            device_update_checksum(m_env, page);
+            addresses[batch]=page->get_self();
+            buffers[batch]=&tempdata[batch*pagesize];
+            sizes[batch]=0;
+
+            level=get_compression_level(page);
+            if (level) {
+                sizes[batch]=get_compressor()->compress(
+                            (ham_u8_t *)page->get_pers(), buffers[batch],
+                            level);
+                if (Metrics *metrics=m_env->get_metrics())
+                    metrics->add_compressed_page(pagesize,
+                            sizes[batch] ? sizes[batch] : pagesize);
+            }
+
+            if (sizes[batch]) {
+                compressed=true;
+                /*
+                 * the file is overwritten with the compressed image; the
+                 * parts of a (private) mapping which were not yet modified
+                 * would show the new file contents, therefore they're
+                 * copied now
+                 */
+                if (!(page->get_flags()&Page::NPERS_MALLOC)) {
+                    volatile ham_u8_t *p=(ham_u8_t *)page->get_pers();
+                    for (n=0; n<pagesize; n+=512)
+                        p[n]=p[n];
+                }
+            }
+            else {
+                sizes[batch]=pagesize;
+                memcpy(buffers[batch], page->get_pers(), pagesize);
+            }
+            batch++;
+        }
+        pages+=i;
+        count-=i;
+
+        /* the PageCipher encrypts the whole batch, unless the batch has
+         * compressed images; all other filters are called for each page */
+        for (head=m_env->get_file_filter(); head; head=head->_next) {
+            if (PageCipher *cipher=__get_cipher(head)) {
+                if (!compressed)
+                    cipher->encrypt_pages(addresses, buffers, batch);
+                else {
+                    for (n=0; n<batch; n++)
+                        cipher->encrypt(addresses[n], buffers[n], sizes[n]);
+                }
+                continue;
+            }
+            if (!head->before_write_cb)
+                continue;
+            for (n=0; n<batch; n++) {
+                st=head->before_write_cb((ham_env_t *)m_env, head,
+                            buffers[n], pagesize);
+                if (st)
+                    goto bail;
+            }
+        }
+
+        for (n=0; n<batch; n+=run) {
+            run=get_run_length(&addresses[n], &sizes[n], batch-n);
+            st=write_run(&addresses[n], (void **)&buffers[n], &sizes[n], run);
+            if (st)
+                goto bail;
+
+            /* release the file system blocks behind a compressed image */
+            if (sizes[n]<pagesize && m_punch_holes) {
+                ham_offset_t start=addresses[n]+sizes[n];
+                if (start%PageCompressor::FS_BLOCK_SIZE)
+                    start+=PageCompressor::FS_BLOCK_SIZE
+                            -start%PageCompressor::FS_BLOCK_SIZE;
+                if (start<addresses[n]+pagesize) {
+                    st=os_punch_hole(m_fd, start,
+                            addresses[n]+pagesize-start);
+                    if (st==HAM_NOT_IMPLEMENTED) {
+                        m_punch_holes=false;
+                        st=0;
+                    }
+                    else if (st)
+                        goto bail;
+                }
+            }
+
+            st=__induce_write_error(m_env);
+            if (st)
+                goto bail;
+        }
+    }
+
+bail:
     m_env->get_allocator()->free(tempdata);
     return (st);
 }
 
+ham_status_t
+FileDevice::truncate(ham_offset_t newsize)
+{
+    m_modification_count++;
+
+    if (Backup *backup=m_env->get_backup())
+        backup->before_truncate(newsize);
+
+    return (os_truncate(m_fd, newsize));
+}
+
+ham_status_t
+FileDevice::flush()
+{
+    if (Metrics *metrics=m_env->get_metrics())
+        metrics->inc_fsyncs();
+
+    return (os_flush(m_fd));
+}
+
 ham_status_t
 FileDevice::free_page(Page *page)
 {
@@ -19,17 +19,32 @@
 #define HAM_DEVICE_H__
 
 #include "internal_fwd_decl.h"
+
+#include <vector>
+
 #include "os.h"
 #include "mem.h"
 #include "db.h"
 
 class Page;
+class PageCompressor;
 
 class Device {
   public:
+    enum {
+        /** the maximum number of pages which are filtered together
+         * by @ref write_pages */
+        WRITE_BATCH_SIZE=32,
+
+        /** the maximum number of pages which are written with a single
+         * vectored write */
+        MAX_WRITE_PAGES=256
+    };
+
     /** constructor */
     Device(Environment *env, ham_u32_t flags)
-      : m_env(env), m_flags(flags), m_freelist_cache(0) {
+      : m_env(env), m_flags(flags), m_freelist_cache(0),
+        m_modification_count(0) {
         /*
          * initialize the pagesize with a default value - this will be
          * overwritten i.e. by ham_open, ham_create when the pagesize
@@ -74,6 +89,12 @@ class Device {
     virtual ham_status_t read(ham_offset_t offset, void *buffer,
                 ham_offset_t size) = 0;
 
+    /** reads from the device without running the file filters and
+     * without updating the metrics; can be called without holding the
+     * Environment mutex */
+    virtual ham_status_t read_raw(ham_offset_t offset, void *buffer,
+                ham_offset_t size) = 0;
+
     /** writes to the device; this function does not use mmap,
      * and is responsible for writing the data is run through the file
      * filters */
@@ -86,6 +107,17 @@ class Device {
     /** writes a page to the device */
     virtual ham_status_t write_page(Page *page) = 0;
 
+    /** writes several pages to the device; the default implementation
+     * writes one page after the other */
+    virtual ham_status_t write_pages(Page **pages, ham_size_t count) {
+        for (ham_size_t i=0; i<count; i++) {
+            ham_status_t st=write_page(pages[i]);
+            if (st)
+                return (st);
+        }
+        return (0);
+    }
+
     /** allocate storage from this device; this function
      * will *NOT* use mmap.  */
     virtual ham_status_t alloc(ham_size_t size, ham_offset_t *address) = 0;
@@ -138,6 +170,14 @@ class Device {
         return (m_freelist_cache);
     }
 
+    /**
+     * get a counter which is incremented whenever the file is modified
+     * or resized; used to detect if a snapshot of the file is stale
+     */
+    ham_u64_t get_modification_count() {
+        return (m_modification_count);
+    }
+
   protected:
     /** the environment which employs this device */
     Environment *m_env;
@@ -157,6 +197,9 @@ class Device {
 
     /** the freelist cache is managed by the device */
     freelist_cache_t *m_freelist_cache;
+
+    /** number of modifications of the file */
+    ham_u64_t m_modification_count;
 };
 
 /**
@@ -166,10 +209,14 @@ class FileDevice : public Device {
   public:
     /** constructor */
     FileDevice(Environment *env, ham_u32_t flags)
-      : Device(env, flags), m_fd(HAM_INVALID_FD) {
+      : Device(env, flags), m_fd(HAM_INVALID_FD), m_compressor(0),
+        m_punch_holes(true) {
         m_pagesize=os_get_pagesize();
     }
 
+    /** destructor */
+    virtual ~FileDevice();
+
     /** Create a new device */
     virtual ham_status_t create(const char *filename, ham_u32_t flags,
                 ham_u32_t mode) {
@@ -192,14 +239,10 @@ class FileDevice : public Device {
     }
 
     /** flushes the device */
-    virtual ham_status_t flush() {
-        return (os_flush(m_fd));
-    }
+    virtual ham_status_t flush();
 
     /** truncate/resize the device */
-    virtual ham_status_t truncate(ham_offset_t newsize) {
-        return (os_truncate(m_fd, newsize));
-    }
+    virtual ham_status_t truncate(ham_offset_t newsize);
 
     /** returns true if the device is open */
     virtual bool is_open() {
@@ -226,6 +269,14 @@ class FileDevice : public Device {
     virtual ham_status_t read(ham_offset_t offset, void *buffer,
                 ham_offset_t size);
 
+    /** reads from the device without running the file filters and
+     * without updating the metrics; can be called without holding the
+     * Environment mutex */
+    virtual ham_status_t read_raw(ham_offset_t offset, void *buffer,
+                ham_offset_t size) {
+        return (os_pread(m_fd, offset, buffer, size));
+    }
+
     /** writes to the device; this function does not use mmap,
      * and is responsible for writing the data is run through the file
      * filters */
@@ -236,9 +287,17 @@ class FileDevice : public Device {
     virtual ham_status_t read_page(Page *page);
 
     /** writes a page to the device */
-    virtual ham_status_t write_page(Page *page) {
-        return (write(page->get_self(), page->get_pers(), get_pagesize()));
-    }
+    virtual ham_status_t write_page(Page *page);
+
+    /**
+     * writes several pages to the device; the file filters process
+     * the pages in batches of up to @ref WRITE_BATCH_SIZE pages
+     *
+     * @a pages is sorted by address; adjacent pages are written with a
+     * single vectored write of up to @ref Environment::get_max_write_size
+     * bytes
+     */
+    virtual ham_status_t write_pages(Page **pages, ham_size_t count);
 
     /** allocate storage from this device; this function
      * will *NOT* use mmap.  */
@@ -246,6 +305,7 @@ class FileDevice : public Device {
         ham_status_t st=os_get_filesize(m_fd, address);
         if (st)
             return (st);
+        m_modification_count++;
         return (os_truncate(m_fd, (*address)+size));
     }
 
@@ -266,6 +326,7 @@ class FileDevice : public Device {
         if (st)
             return (st);
 
+        m_modification_count++;
         st=os_truncate(m_fd, pos+size);
         if (st)
             return (st);
@@ -279,20 +340,97 @@ class FileDevice : public Device {
     virtual ham_status_t free_page(Page *page);
 
   private:
+    /** returns the zlib compression level of a page, or 0 if the page
+     * is stored uncompressed (see @ref HAM_COMPRESS_PAGES) */
+    ham_u32_t get_compression_level(Page *page);
+
+    /** returns the PageCompressor; it's created when it's first used */
+    PageCompressor *get_compressor();
+
+    /** runs the pages through the page compression and the file
+     * filters, then writes them */
+    ham_status_t write_filtered_pages(Page **pages, ham_size_t count);
+
+    /** writes unfiltered and uncompressed pages, which are sorted
+     * by address */
+    ham_status_t write_page_runs(Page **pages, ham_size_t count);
+
+    /** returns the number of buffers at the beginning of @a addresses
+     * which are adjacent full pages and are written together */
+    ham_size_t get_run_length(const ham_offset_t *addresses,
+                const ham_size_t *sizes, ham_size_t count);
+
+    /** writes @a count buffers to adjacent addresses, starting at
+     * addresses[0] */
+    ham_status_t write_run(const ham_offset_t *addresses, void **buffers,
+                const ham_size_t *sizes, ham_size_t count);
+
+    /** decompresses a page after it was read */
+    ham_status_t decompress_page(Page *page, bool mapped);
+
     ham_fd_t m_fd;
+
+    /** the PageCompressor, or NULL */
+    PageCompressor *m_compressor;
+
+    /** false if the file system can not punch holes */
+    bool m_punch_holes;
 };
 
 /**
  * an In-Memory device
  */
+/**
+ * The device of an in-memory Database.
+ *
+ * By default every page is allocated with its own malloc() call. With
+ * HAM_IN_MEMORY_ARENA, pages are carved from large arenas instead. Every
+ * slot of an arena starts with a small header which stores the Page
+ * object, therefore the Page of an address is resolved with a single
+ * pointer dereference (see @ref get_arena_page) instead of a lookup in
+ * the Cache. Freed slots are reused, and all arenas are released in bulk
+ * when the device is closed.
+ */
 class InMemoryDevice : public Device {
   public:
+    enum {
+        /** the size of the slot header; keeps the page data 16-byte
+         * aligned */
+        ARENA_HEADER_SIZE=16,
+
+        /** the number of pages in the first arena */
+        ARENA_MIN_PAGES=16,
+
+        /** the maximum number of pages in an arena */
+        ARENA_MAX_PAGES=1024
+    };
+
     /** constructor */
     InMemoryDevice(Environment *env, ham_u32_t flags)
-      : Device(env, flags), m_is_open(false) {
+      : Device(env, flags), m_is_open(false), m_arena_free(0),
+        m_arena_top(0), m_arena_end(0), m_arena_pages(0) {
         m_pagesize=1024*4;
     }
 
+    /** destructor; releases the arenas if the device was not closed */
+    virtual ~InMemoryDevice() {
+        free_arenas();
+    }
+
+    /**
+     * returns the Page of an address which was allocated from an arena;
+     * only valid with HAM_IN_MEMORY_ARENA, and only for allocated pages
+     */
+    static Page *get_arena_page(ham_offset_t address) {
+        return (*(Page **)((ham_u8_t *)U64_TO_PTR(address)
+                    -ARENA_HEADER_SIZE));
+    }
+
+    /** returns the number of allocated arenas */
+    ham_size_t get_arena_count() {
+        return ((ham_size_t)m_arenas.size());
+    }
+
     /** Create a new device */
     virtual ham_status_t create(const char *filename, ham_u32_t flags,
                 ham_u32_t mode) {
@@ -306,9 +444,10 @@ class InMemoryDevice : public Device {
         return (HAM_NOT_IMPLEMENTED);
     }
 
-    /** closes the device */
+    /** closes the device; all arenas are released */
     virtual ham_status_t close() {
         ham_assert(m_is_open, (0));
+        free_arenas();
         m_is_open=false;
         return (HAM_SUCCESS);
     }
@@ -354,6 +493,13 @@ class InMemoryDevice : public Device {
         return (HAM_NOT_IMPLEMENTED);
     }
 
+    /** reads from the device without running the file filters */
+    virtual ham_status_t read_raw(ham_offset_t offset, void *buffer,
+                ham_offset_t size) {
+        ham_assert(!"operation is not possible for in-memory-databases", (0));
+        return (HAM_NOT_IMPLEMENTED);
+    }
+
     /** writes to the device; this function does not use mmap,
      * and is responsible for writing the data is run through the file
      * filters */
@@ -396,6 +542,17 @@ class InMemoryDevice : public Device {
 
         ham_assert(page->get_pers()==0, (0));
 
+        if (m_flags&HAM_IN_MEMORY_ARENA) {
+            ham_u8_t *slot=alloc_slot();
+            if (!slot)
+                return (HAM_OUT_OF_MEMORY);
+            *(Page **)slot=page;
+            buffer=slot+ARENA_HEADER_SIZE;
+            page->set_pers((page_data_t *)buffer);
+            page->set_self((ham_offset_t)PTR_TO_U64(buffer));
+            return (HAM_SUCCESS);
+        }
+
         buffer=(ham_u8_t *)m_env->get_allocator()->alloc(size);
         if (!buffer)
             return (HAM_OUT_OF_MEMORY);
@@ -410,6 +567,17 @@ class InMemoryDevice : public Device {
     /** frees a page on the device; plays counterpoint to @ref alloc_page */
     virtual ham_status_t free_page(Page *page) {
         ham_assert(page->get_pers()!=0, (0));
+
+        if (m_flags&HAM_IN_MEMORY_ARENA) {
+            /* the slot is pushed to the list of free slots; the header
+             * stores the next free slot */
+            ham_u8_t *slot=(ham_u8_t *)page->get_pers()-ARENA_HEADER_SIZE;
+            *(ham_u8_t **)slot=m_arena_free;
+            m_arena_free=slot;
+            page->set_pers(0);
+            return (HAM_SUCCESS);
+        }
+
         ham_assert(page->get_flags()|Page::NPERS_MALLOC, (0));
 
         m_env->get_allocator()->free(page->get_pers());
@@ -421,8 +589,93 @@ class InMemoryDevice : public Device {
 
 
   private:
+    /** returns a free slot; allocates a new arena if necessary. The
+     * arenas grow from ARENA_MIN_PAGES to ARENA_MAX_PAGES pages */
+    ham_u8_t *alloc_slot() {
+        ham_size_t slotsize=ARENA_HEADER_SIZE+get_pagesize();
+
+        if (m_arena_free) {
+            ham_u8_t *slot=m_arena_free;
+            m_arena_free=*(ham_u8_t **)slot;
+            return (slot);
+        }
+
+        if (m_arena_top==m_arena_end) {
+            m_arena_pages=m_arena_pages
+                    ? m_arena_pages*2
+                    : (ham_size_t)ARENA_MIN_PAGES;
+            if (m_arena_pages>ARENA_MAX_PAGES)
+                m_arena_pages=ARENA_MAX_PAGES;
+            ham_u8_t *arena=(ham_u8_t *)m_env->get_allocator()->alloc(
+                    m_arena_pages*slotsize);
+            if (!arena)
+                return (0);
+            m_arenas.push_back(arena);
+            m_arena_top=arena;
+            m_arena_end=arena+m_arena_pages*slotsize;
+        }
+
+        ham_u8_t *slot=m_arena_top;
+        m_arena_top+=slotsize;
+        return (slot);
+    }
+
+    /** releases all arenas */
+    void free_arenas() {
+        for (std::vector<ham_u8_t *>::iterator it=m_arenas.begin();
+                it!=m_arenas.end(); it++)
+            m_env->get_allocator()->free(*it);
+        m_arenas.clear();
+        m_arena_free=0;
+        m_arena_top=0;
+        m_arena_end=0;
+        m_arena_pages=0;
+    }
+
+    /** true if the device is open */
     bool m_is_open;
+
+    /** the arenas (only with HAM_IN_MEMORY_ARENA) */
+    std::vector<ham_u8_t *> m_arenas;
+
+    /** the list of free slots */
+    ham_u8_t *m_arena_free;
+
+    /** the next unused slot of the current arena */
+    ham_u8_t *m_arena_top;
+
+    /** the end of the current arena */
+    ham_u8_t *m_arena_end;
+
+    /** the number of pages of the current arena */
+    ham_size_t m_arena_pages;
 };
 
 
+/**
+ * stores the checksum in the header of a page which is about to be
+ * written, or removes a stale checksum if the Environment does not use
+ * @ref HAM_ENABLE_CRC32; pages without a header are not modified
+ */
+extern void
+device_update_checksum(Environment *env, Page *page);
+
+/** returns true if a @ref PageCipher is installed as a file filter */
+extern bool
+device_has_cipher(Environment *env);
+
+/**
+ * runs the before_write callbacks of the file filters on @a data, which
+ * is written to the file at @a offset
+ */
+extern ham_status_t
+device_filters_before_write(Environment *env, ham_offset_t offset,
+            ham_u8_t *data, ham_size_t size);
+
+/** runs the after_read callbacks of the file filters on @a data, which
+ * was read from the file at @a offset */
+extern ham_status_t
+device_filters_after_read(Environment *env, ham_offset_t offset,
+            ham_u8_t *data, ham_size_t size);
+
 #endif /* HAM_DEVICE_H__ */
@@ -20,9 +20,14 @@
 #include "device.h"
 #include "version.h"
 #include "serial.h"
+#include "trace.h"
+#include "compact.h"
+#include "backup.h"
+#include "bloom.h"
 #include "txn.h"
 #include "device.h"
 #include "btree.h"
+#include "hashdb.h"
 #include "mem.h"
 #include "freelist.h"
 #include "extkeys.h"
@@ -49,7 +54,9 @@ Environment::Environment()
     m_alloc(0), m_hdrpage(0), m_oldest_txn(0), m_newest_txn(0), m_log(0), 
     m_journal(0), m_flags(0), m_databases(0), m_pagesize(0), m_cachesize(0),
     m_max_databases_cached(0), m_is_active(false), m_is_legacy(false),
-    m_file_filters(0)
+    m_file_filters(0), m_max_write_size(HAM_DEFAULT_MAX_WRITE_SIZE),
+    m_tracer(0), m_compactor(0),
+    m_backup(0)
 {
 #if HAM_ENABLE_REMOTE
     m_curl=0;
@@ -75,6 +82,24 @@ Environment::Environment()
 
 Environment::~Environment()
 {
+    /* stop tracing */
+    if (m_tracer) {
+        delete m_tracer;
+        m_tracer=0;
+    }
+
+    /* discard the state of the online compaction */
+    if (m_compactor) {
+        delete m_compactor;
+        m_compactor=0;
+    }
+
+    /* stop tracking the modified pages */
+    if (m_backup) {
+        delete m_backup;
+        m_backup=0;
+    }
+
     /* delete all performance data */
     btree_stats_trash_globdata(this, get_global_perf_data());
 
@@ -130,10 +155,10 @@ Environment::get_freelist()
 extern ham_status_t 
 __check_create_parameters(Environment *env, Database *db, const char *filename, 
         ham_u32_t *pflags, const ham_parameter_t *param, 
-        ham_size_t *ppagesize, ham_u16_t *pkeysize, 
-        ham_u64_t *pcachesize, ham_u16_t *pdbname,
+        ham_size_t *ppagesize, ham_u16_t *pkeysize, ham_u16_t *pkeytype,
+        ham_u16_t *pinline_size, ham_u64_t *pcachesize, ham_u16_t *pdbname,
         ham_u16_t *pmaxdbs, ham_u16_t *pdata_access_mode, 
-        std::string &logdir, bool create);
+        ham_size_t *pmax_write_size, std::string &logdir, bool create);
 
 /*
  * callback function for freeing blobs of an in-memory-database, implemented 
@@ -221,6 +246,8 @@ _local_fun_create(Environment *env, const char *filename,
         env->set_persistent_pagesize(pagesize);
         env->set_max_databases(env->get_max_databases_cached());
         ham_assert(env->get_max_databases() > 0, (0));
+        if (flags&HAM_ENABLE_FREELIST_EXTENTS)
+            env->set_freelist_format(FREELIST_FORMAT_EXTENTS);
 
         page->set_dirty(true);
     }
@@ -524,6 +551,23 @@ fail_with_fake_cleansing:
         }
     }
 
+    /*
+     * the extent freelist is loaded (or migrated) right away, because
+     * it invalidates the persistent extents in the header page, and the
+     * header page must not yet contain modifications of other operations
+     */
+    if (env->get_freelist_format()==FREELIST_FORMAT_EXTENTS
+            || (flags&HAM_ENABLE_FREELIST_EXTENTS)) {
+        st=freel_initialize(env);
+        /* the freelist pages were fetched outside of an operation */
+        env->get_changeset().clear();
+        if (st) {
+            (void)ham_env_close((ham_env_t *)env, 
+                        HAM_DONT_CLEAR_LOG|HAM_DONT_LOCK);
+            return (st);
+        }
+    }
+
     return (HAM_SUCCESS);
 }
 
@@ -630,7 +674,9 @@ _local_fun_erase_db(Environment *env, ham_u16_t name, ham_u32_t flags)
     if (!be || !be->is_active())
         return (HAM_INTERNAL_ERROR);
 
-    st=be->enumerate(__free_inmemory_blobs_cb, &context);
+    st=BloomFilter::disable(db);
+    if (!st)
+        st=be->enumerate(__free_inmemory_blobs_cb, &context);
     if (st) {
         (void)ham_close((ham_db_t *)db, HAM_DONT_LOCK);
         delete db;
@@ -833,6 +879,9 @@ _local_fun_get_parameters(Environment *env, ham_parameter_t *param)
                 else
                     p->value=0;
                 break;
+            case HAM_PARAM_MAX_WRITE_SIZE:
+                p->value=env->get_max_write_size();
+                break;
             case HAM_PARAM_GET_STATISTICS:
                 if (!p->value) {
                     ham_trace(("the value for parameter "
@@ -915,6 +964,8 @@ _local_fun_create_db(Environment *env, Database *db,
 {
     ham_status_t st;
     ham_u16_t keysize = 0;
+    ham_u16_t keytype = HAM_TYPE_BINARY;
+    ham_u16_t inline_size = 0;
     ham_u64_t cachesize = 0;
     ham_u16_t dam = 0;
     ham_u16_t dbi;
@@ -927,7 +978,8 @@ _local_fun_create_db(Environment *env, Database *db,
 
     /* parse parameters */
     st=__check_create_parameters(env, db, 0, &flags, param, 
-            0, &keysize, &cachesize, &dbname, 0, &dam, logdir, true);
+            0, &keysize, &keytype, &inline_size, &cachesize, &dbname, 0,
+            &dam, 0, logdir, true);
     if (st)
         return (st);
 
@@ -957,6 +1009,11 @@ _local_fun_create_db(Environment *env, Database *db,
              |DB_USE_MMAP
              |DB_ENV_IS_PRIVATE);
 
+    /* the key type and the size of the inline records are stored in
+     * the persistent flags */
+    pflags|=(ham_u32_t)keytype<<DB_KEY_TYPE_SHIFT;
+    pflags|=(ham_u32_t)(inline_size/DB_INLINE_SIZE_UNIT)<<DB_INLINE_SIZE_SHIFT;
+
     /*
      * transfer the ownership of the header page to this Database
      */
@@ -1006,7 +1063,10 @@ _local_fun_create_db(Environment *env, Database *db,
     /* create the backend */
     be=db->get_backend();
     if (be==NULL) {
-        be=new BtreeBackend(db, flags);
+        if (flags&HAM_USE_HASH)
+            be=new HashBackend(db, flags);
+        else
+            be=new BtreeBackend(db, flags);
         if (!be) {
             st=HAM_OUT_OF_MEMORY;
             (void)ham_close((ham_db_t *)db, HAM_DONT_LOCK);
@@ -1072,6 +1132,7 @@ _local_fun_create_db(Environment *env, Database *db,
         db->set_prefix_compare_func(db_default_prefix_compare);
     }
     db->set_duplicate_compare_func(db_default_compare);
+    db->set_key_type(keytype);
 
     /*
      * on success: store the open database in the environment's list of
@@ -1102,6 +1163,7 @@ _local_fun_open_db(Environment *env, Database *db,
     ham_u16_t dam = 0;
     ham_u64_t cachesize = 0;
     Backend *be = 0;
+    ham_u32_t pflags;
     ham_u16_t dbi;
     std::string logdir;
 
@@ -1117,7 +1179,7 @@ _local_fun_open_db(Environment *env, Database *db,
 
     /* parse parameters */
     st=__check_create_parameters(env, db, 0, &flags, param, 
-            0, 0, &cachesize, &name, 0, &dam, logdir, false);
+            0, 0, 0, 0, &cachesize, &name, 0, &dam, 0, logdir, false);
     if (st)
         return (st);
 
@@ -1165,7 +1227,10 @@ _local_fun_open_db(Environment *env, Database *db,
     /* create the backend */
     be=db->get_backend();
     if (be==NULL) {
-        be=new BtreeBackend(db, flags);
+        if (index_get_flags(env->get_indexdata_ptr(dbi))&HAM_USE_HASH)
+            be=new HashBackend(db, flags);
+        else
+            be=new BtreeBackend(db, flags);
         if (!be) {
             (void)ham_close((ham_db_t *)db, HAM_DONT_LOCK);
             return (HAM_OUT_OF_MEMORY);
@@ -1210,29 +1275,40 @@ _local_fun_open_db(Environment *env, Database *db,
              |HAM_SORT_DUPLICATES
              |DB_USE_MMAP
              |DB_ENV_IS_PRIVATE);
-    db->set_rt_flags(flags|be->get_flags());
-    ham_assert(!(be->get_flags()&HAM_DISABLE_VAR_KEYLEN), 
-            ("invalid persistent database flags 0x%x", be->get_flags()));
-    ham_assert(!(be->get_flags()&HAM_CACHE_STRICT), 
-            ("invalid persistent database flags 0x%x", be->get_flags()));
-    ham_assert(!(be->get_flags()&HAM_CACHE_UNLIMITED), 
-            ("invalid persistent database flags 0x%x", be->get_flags()));
-    ham_assert(!(be->get_flags()&HAM_DISABLE_MMAP), 
-            ("invalid persistent database flags 0x%x", be->get_flags()));
-    ham_assert(!(be->get_flags()&HAM_WRITE_THROUGH), 
-            ("invalid persistent database flags 0x%x", be->get_flags()));
-    ham_assert(!(be->get_flags()&HAM_READ_ONLY), 
-            ("invalid persistent database flags 0x%x", be->get_flags()));
-    ham_assert(!(be->get_flags()&HAM_DISABLE_FREELIST_FLUSH), 
-            ("invalid persistent database flags 0x%x", be->get_flags()));
-    ham_assert(!(be->get_flags()&HAM_ENABLE_RECOVERY), 
-            ("invalid persistent database flags 0x%x", be->get_flags()));
-    ham_assert(!(be->get_flags()&HAM_AUTO_RECOVERY), 
-            ("invalid persistent database flags 0x%x", be->get_flags()));
-    ham_assert(!(be->get_flags()&HAM_ENABLE_TRANSACTIONS), 
-            ("invalid persistent database flags 0x%x", be->get_flags()));
-    ham_assert(!(be->get_flags()&DB_USE_MMAP), 
-            ("invalid persistent database flags 0x%x", be->get_flags()));
+    /* the key type and the inline record size share the flag bits */
+    pflags=be->get_flags()&~(DB_KEY_TYPE_MASK|DB_INLINE_SIZE_MASK);
+    db->set_rt_flags(flags|pflags);
+    ham_assert(!(pflags&HAM_DISABLE_VAR_KEYLEN), 
+            ("invalid persistent database flags 0x%x", pflags));
+    ham_assert(!(pflags&HAM_CACHE_STRICT), 
+            ("invalid persistent database flags 0x%x", pflags));
+    ham_assert(!(pflags&HAM_CACHE_UNLIMITED), 
+            ("invalid persistent database flags 0x%x", pflags));
+    ham_assert(!(pflags&HAM_DISABLE_MMAP), 
+            ("invalid persistent database flags 0x%x", pflags));
+    ham_assert(!(pflags&HAM_WRITE_THROUGH), 
+            ("invalid persistent database flags 0x%x", pflags));
+    ham_assert(!(pflags&HAM_READ_ONLY), 
+            ("invalid persistent database flags 0x%x", pflags));
+    ham_assert(!(pflags&HAM_DISABLE_FREELIST_FLUSH), 
+            ("invalid persistent database flags 0x%x", pflags));
+    ham_assert(!(pflags&HAM_ENABLE_RECOVERY), 
+            ("invalid persistent database flags 0x%x", pflags));
+    ham_assert(!(pflags&HAM_AUTO_RECOVERY), 
+            ("invalid persistent database flags 0x%x", pflags));
+    ham_assert(!(pflags&HAM_ENABLE_TRANSACTIONS), 
+            ("invalid persistent database flags 0x%x", pflags));
+    ham_assert(!(pflags&DB_USE_MMAP), 
+            ("invalid persistent database flags 0x%x", pflags));
+
+    /* hash Databases do not support Transactions */
+    if ((db->get_rt_flags()&HAM_USE_HASH)
+            && (db->get_rt_flags()&HAM_ENABLE_TRANSACTIONS)) {
+        ham_trace(("hash Databases cannot be opened with "
+                   "HAM_ENABLE_TRANSACTIONS"));
+        (void)ham_close((ham_db_t *)db, HAM_DONT_LOCK);
+        return (HAM_INV_PARAMETER);
+    }
 
     /*
      * SORT_DUPLICATES is only allowed if the Database was created
@@ -1271,6 +1347,15 @@ _local_fun_open_db(Environment *env, Database *db,
         db->set_prefix_compare_func(db_default_prefix_compare);
     }
     db->set_duplicate_compare_func(db_default_compare);
+    db->set_key_type((ham_u16_t)((be->get_flags()&DB_KEY_TYPE_MASK)
+                >>DB_KEY_TYPE_SHIFT));
+
+    /* load the bloom filter */
+    st=BloomFilter::open(db);
+    if (st) {
+        (void)ham_close((ham_db_t *)db, HAM_DONT_LOCK);
+        return (st);
+    }
 
     /*
      * on success: store the open database in the environment's list of
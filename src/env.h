@@ -27,6 +27,8 @@
 #include "error.h"
 #include "page.h"
 #include "changeset.h"
+#include "metrics.h"
+#include "slab.h"
 
 /**
  * This is the minimum chunk size; all chunks (pages and blobs) are aligned
@@ -80,8 +82,12 @@ typedef HAM_PACK_0 struct HAM_PACK_1
      */
     ham_u16_t _max_databases;
 
-    /** reserved */
-    ham_u16_t _reserved1;
+    /**
+     * the format of the freelist (see @ref FREELIST_FORMAT_BITMAP and
+     * @ref FREELIST_FORMAT_EXTENTS); formerly reserved and therefore
+     * zero in older files
+     */
+    ham_u16_t _freelist_format;
 
     /*
      * following here:
@@ -371,6 +377,12 @@ class Environment
         return (m_changeset);
     }
 
+    /** get the slab pages of the small records (see
+     * HAM_ENABLE_SLAB_RECORDS) */
+    SlabAllocator &get_slab_allocator() {
+        return (m_slabs);
+    }
+
     /** get the pagesize as specified in ham_env_create_ex */
     ham_size_t get_pagesize() {
         return (m_pagesize);
@@ -556,6 +568,16 @@ class Environment
     /** get the freelist object of the database */
     freelist_payload_t *get_freelist();
 
+    /** get the format of the freelist */
+    ham_u16_t get_freelist_format() {
+        return (ham_db2h16(get_header()->_freelist_format));
+    }
+
+    /** set the format of the freelist */
+    void set_freelist_format(ham_u16_t format) {
+        get_header()->_freelist_format=ham_h2db16(format);
+    }
+
     /** set the logfile directory */
     void set_log_directory(const std::string &dir) {
         m_log_directory=dir;
@@ -566,11 +588,64 @@ class Environment
         return (m_log_directory);
     }
 
+    /** get the maximum size of a single write when dirty pages are
+     * flushed (see @ref HAM_PARAM_MAX_WRITE_SIZE) */
+    ham_size_t get_max_write_size() {
+        return (m_max_write_size);
+    }
+
+    /** set the maximum size of a single write when dirty pages are
+     * flushed */
+    void set_max_write_size(ham_size_t size) {
+        m_max_write_size=size;
+    }
+
     /** get the mutex */
     Mutex &get_mutex() {
         return (m_mutex);
     }
 
+    /** get the trace recorder; returns NULL if tracing is disabled */
+    Tracer *get_tracer() {
+        return (m_tracer);
+    }
+
+    /** set the trace recorder */
+    void set_tracer(Tracer *tracer) {
+        m_tracer=tracer;
+    }
+
+    /** get the state of the online compaction; returns NULL if
+     * ham_env_compact was not yet called */
+    Compactor *get_compactor() {
+        return (m_compactor);
+    }
+
+    /** set the state of the online compaction */
+    void set_compactor(Compactor *compactor) {
+        m_compactor=compactor;
+    }
+
+    /** get the state of the hot backup; returns NULL if ham_env_backup
+     * was not yet called */
+    Backup *get_backup() {
+        return (m_backup);
+    }
+
+    /** set the state of the hot backup */
+    void set_backup(Backup *backup) {
+        m_backup=backup;
+    }
+
+    /** get the runtime metrics; returns NULL if metrics are disabled */
+    Metrics *get_metrics() {
+#ifdef HAM_DISABLE_METRICS
+        return (0);
+#else
+        return ((m_flags&HAM_ENABLE_METRICS) ? &m_metrics : 0);
+#endif
+    }
+
   private:
     /** a mutex for this Environment */
     Mutex m_mutex;
@@ -622,6 +697,9 @@ class Environment
      * one database operation */
     Changeset m_changeset;
 
+    /** the slab pages of the small records */
+    SlabAllocator m_slabs;
+
     /** the pagesize which was specified when the env was created */
     ham_size_t m_pagesize;
 
@@ -651,6 +729,21 @@ class Environment
 
     /** the directory of the log file and journal files */
     std::string m_log_directory;
+
+    /** the maximum size of a single write of adjacent dirty pages */
+    ham_size_t m_max_write_size;
+
+    /** the runtime metrics (see HAM_ENABLE_METRICS) */
+    Metrics m_metrics;
+
+    /** the trace recorder (see ham_env_enable_tracing) */
+    Tracer *m_tracer;
+
+    /** the state of the online compaction (see ham_env_compact) */
+    Compactor *m_compactor;
+
+    /** the state of the hot backup (see ham_env_backup) */
+    Backup *m_backup;
 };
 
 /**
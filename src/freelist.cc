@@ -20,6 +20,7 @@
 #include "env.h"
 #include "error.h"
 #include "freelist.h"
+#include "freelist_extents.h"
 #include "mem.h"
 #include "btree_stats.h"
 #include "txn.h"
@@ -71,6 +72,7 @@
 #define __freel_alloc_areaXX                __freel_alloc_area16
 #define __freel_mark_freeXX                 __freel_mark_free16
 #define __freel_check_area_is_allocatedXX   __freel_check_area_is_allocated16
+#define __freel_claim_areaXX                __freel_claim_area16
 #define __freel_init_perf_dataXX            __freel_init_perf_data16
 
 typedef ham_u16_t                           ham_uXX_t;
@@ -86,6 +88,13 @@ typedef ham_u16_t                           ham_uXX_t;
 #define __freel_cache_get_entry(eref, dev, env, cache, address)                \
             __freel_cache_get_entry16(eref, dev, env, cache, address)
 
+#define __freel_cache_load(dev, env, cache, address, min_free)                \
+            __freel_cache_load16(dev, env, cache, address, min_free)
+
+#define __freel_search_area(aref, dev, env, db, size, aligned, lower_bound)   \
+            __freel_search_area16(aref, dev, env, db, size, aligned,           \
+                                  lower_bound)
+
 #define __freel_set_bits(dev, env, entry, fp, overwrite, start_bit,            \
                          size_bits, set, hints)                                \
             __freel_set_bits16(dev, env, entry, fp, overwrite, start_bit,    \
@@ -113,6 +122,7 @@ typedef ham_u16_t                           ham_uXX_t;
 #define __freel_alloc_areaXX                __freel_alloc_area32
 #define __freel_mark_freeXX                    __freel_mark_free32
 #define __freel_check_area_is_allocatedXX    __freel_check_area_is_allocated32
+#define __freel_claim_areaXX                __freel_claim_area32
 #define __freel_init_perf_dataXX            __freel_init_perf_data32
 
 typedef ham_u32_t                            ham_uXX_t;
@@ -128,6 +138,13 @@ typedef ham_u32_t                            ham_uXX_t;
 #define __freel_cache_get_entry(eref, dev, env, cache, address)                \
             __freel_cache_get_entry32(eref, dev, env, cache, address)
 
+#define __freel_cache_load(dev, env, cache, address, min_free)                \
+            __freel_cache_load32(dev, env, cache, address, min_free)
+
+#define __freel_search_area(aref, dev, env, db, size, aligned, lower_bound)   \
+            __freel_search_area32(aref, dev, env, db, size, aligned,           \
+                                  lower_bound)
+
 #define __freel_set_bits(dev, env, entry, fp, overwrite, start_bit,            \
                          size_bits, set, hints)                                \
             __freel_set_bits32(dev, env, entry, fp, overwrite, start_bit,    \
@@ -154,6 +171,8 @@ __freel_mark_free16(Device *dev, Environment *env, Database *db, ham_offset_t ad
 extern ham_status_t
 __freel_check_area_is_allocated16(Device *dev, Environment *env, ham_offset_t address, ham_size_t size);
 extern ham_status_t
+__freel_claim_area16(Device *dev, Environment *env, ham_offset_t address, ham_size_t size);
+extern ham_status_t
 __freel_alloc_area16(ham_offset_t *addr_ref, Device *dev, Environment *env, Database *db, ham_size_t size, ham_bool_t aligned, ham_offset_t lower_bound_address);
 extern ham_status_t
 __freel_init_perf_data16(freelist_cache_t *cache, Device *dev, Environment *env, freelist_entry_t *entry, freelist_payload_t *fp);
@@ -169,6 +188,8 @@ __freel_mark_free32(Device *dev, Environment *env, Database *db, ham_offset_t ad
 extern ham_status_t
 __freel_check_area_is_allocated32(Device *dev, Environment *env, ham_offset_t address, ham_size_t size);
 extern ham_status_t
+__freel_claim_area32(Device *dev, Environment *env, ham_offset_t address, ham_size_t size);
+extern ham_status_t
 __freel_alloc_area32(ham_offset_t *addr_ref, Device *dev, Environment *env, Database *db, ham_size_t size, ham_bool_t aligned, ham_offset_t lower_bound_address);
 extern ham_status_t
 __freel_init_perf_data32(freelist_cache_t *cache, Device *dev, Environment *env, freelist_entry_t *entry, freelist_payload_t *fp);
@@ -268,6 +289,64 @@ __freel_cache_resize(Device *device, Environment *env, freelist_cache_t *cache,
 }
 
 
+/**
+ * Load the freelist pages which are not yet in the cache.
+ *
+ * The freelist pages are a linked list; they are loaded in this order
+ * when they are needed, and not when the freelist is created, because
+ * walking the whole list is expensive for large files.
+ *
+ * Loading stops as soon as the cache covers @a address (if not 0), or
+ * when a page with at least @a min_free free chunks was loaded (if not 0);
+ * otherwise all remaining pages are loaded.
+ */
+static ham_status_t
+__freel_cache_load(Device *device, Environment *env, freelist_cache_t *cache,
+        ham_offset_t address, ham_size_t min_free)
+{
+    ham_status_t st;
+
+    while (freel_cache_get_next_page(cache))
+    {
+        Page *page;
+        freelist_payload_t *fp;
+        freelist_entry_t *entry=freel_cache_get_entries(cache)
+                +freel_cache_get_count(cache)-1;
+
+        if (address && address<freel_entry_get_start_address(entry)+
+                    freel_entry_get_max_bits(entry)*DB_CHUNKSIZE)
+            return (0);
+
+        st=__freel_cache_resize(device, env, cache,
+                    freel_cache_get_count(cache)+1);
+        if (st)
+            return (st);
+
+        st=env_fetch_page(&page, env, freel_cache_get_next_page(cache), 0);
+        if (!page)
+            return (st ? st : HAM_INTERNAL_ERROR);
+
+        fp=page_get_freelist(page);
+        entry=freel_cache_get_entries(cache)+freel_cache_get_count(cache)-1;
+        ham_assert(freel_entry_get_start_address(entry)
+                    ==freel_get_start_address(fp), (0));
+        freel_entry_set_allocated_bits(entry, freel_get_allocated_bitsXX(fp));
+        freel_entry_set_page_id(entry, page->get_self());
+
+        ham_assert(cache->_init_perf_data, (0));
+        st=cache->_init_perf_data(cache, device, env, entry, fp);
+        if (st)
+            return (st);
+
+        freel_cache_set_next_page(cache, freel_get_overflow(fp));
+
+        if (min_free && freel_entry_get_allocated_bits(entry)>=min_free)
+            return (0);
+    }
+
+    return (0);
+}
+
 
 /**
 Produce the @ref freelist_entry_t record which stores the freelist bit for the
@@ -310,6 +389,14 @@ __freel_cache_get_entry(freelist_entry_t **entry_ref, Device *device, Environmen
     freelist_entry_t *entries;
     
     ham_assert(entry_ref != NULL, (0));
+
+    /* make sure that the freelist pages which cover the address are loaded */
+    st=__freel_cache_load(device, env, cache, address, 0);
+    if (st) {
+        *entry_ref = 0;
+        return st;
+    }
+
     for(;;)
     {
         ham_size_t add;
@@ -3163,8 +3250,12 @@ __freel_locate_sufficient_free_space(freelist_hints_t *dst,
 }
 
 
-ham_status_t
-__freel_alloc_areaXX(ham_offset_t *addr_ref, Device *device,
+/**
+ * Search the freelist pages in the cache for a free area; if the
+ * area is not found then @a addr_ref is set to 0.
+ */
+static ham_status_t
+__freel_search_area(ham_offset_t *addr_ref, Device *device,
                 Environment *env, Database *db, ham_size_t size,
                 ham_bool_t aligned, ham_offset_t lower_bound_address)
 {
@@ -3465,13 +3556,45 @@ __freel_alloc_areaXX(ham_offset_t *addr_ref, Device *device,
     return HAM_SUCCESS;
 }
 
+ham_status_t
+__freel_alloc_areaXX(ham_offset_t *addr_ref, Device *device,
+                Environment *env, Database *db, ham_size_t size,
+                ham_bool_t aligned, ham_offset_t lower_bound_address)
+{
+    ham_status_t st;
+    freelist_cache_t *cache=device->get_freelist_cache();
+    ham_size_t maxspan=__freel_get_freelist_entry_maxspan(device, env, cache);
+
+    for (;;)
+    {
+        ham_size_t min_free;
+
+        st=__freel_search_area(addr_ref, device, env, db, size, aligned,
+                    lower_bound_address);
+        if (st || *addr_ref || !freel_cache_get_next_page(cache))
+            return (st);
+
+        /*
+         * nothing was found in the loaded freelist pages; load pages
+         * till we find one which might have enough space, and search
+         * again. Requests which span several freelist pages need all
+         * pages.
+         */
+        min_free=size/DB_CHUNKSIZE;
+        if (min_free>maxspan)
+            min_free=0;
+        st=__freel_cache_load(device, env, cache, 0, min_free);
+        if (st)
+            return (st);
+    }
+}
+
 ham_status_t
 __freel_lazy_createXX(freelist_cache_t *cache, Device *device,
                 Environment *env)
 {
     ham_status_t st;
     ham_size_t size;
-    ham_size_t entry_pos;
     freelist_entry_t *entry;
     freelist_payload_t *fp=env->get_freelist();
     
@@ -3519,35 +3642,10 @@ __freel_lazy_createXX(freelist_cache_t *cache, Device *device,
     ham_assert(device->get_freelist_cache() != 0, (0));
 
     /*
-     * now load all other freelist pages
+     * all other freelist pages are loaded on demand (see
+     * __freel_cache_load())
      */
-    for (entry_pos = 1;; entry_pos++)
-    {
-        Page *page;
-        if (!freel_get_overflow(fp))
-            break;
-
-        st=__freel_cache_resize(device, env, cache, freel_cache_get_count(cache)+1);
-        if (st)
-            return st;
-
-        st=env_fetch_page(&page, env, freel_get_overflow(fp), 0);
-        if (!page)
-            return st ? st : HAM_INTERNAL_ERROR;
-
-        fp=page_get_freelist(page);
-        ham_assert(entry_pos<freel_cache_get_count(cache), (0));
-        entry=freel_cache_get_entries(cache)+entry_pos;
-        ham_assert(freel_entry_get_start_address(entry) == freel_get_start_address(fp), (0));
-        freel_entry_set_allocated_bits(entry, freel_get_allocated_bitsXX(fp));
-        freel_entry_set_page_id(entry, page->get_self());
-
-        ham_assert(cache->_init_perf_data, (0));
-        st = cache->_init_perf_data(cache, device, env, entry, fp);
-        if (st) {
-            return st;
-        }
-    }
+    freel_cache_set_next_page(cache, freel_get_overflow(fp));
 
     return (0);
 }
@@ -3810,6 +3908,124 @@ __freel_check_area_is_allocatedXX(Device *device, Environment *env, ham_offset_t
     return HAM_SUCCESS;
 }
 
+/**
+ * mark an area as allocated; other than __freel_set_bits(), this function
+ * does not require that all chunks of the area are free - the free chunks
+ * are collected from the bitmaps, and only those are cleared
+ */
+ham_status_t
+__freel_claim_areaXX(Device *device, Environment *env, ham_offset_t address,
+                ham_size_t size)
+{
+    ham_status_t st;
+    ham_size_t i;
+    freelist_cache_t *cache;
+    ham_offset_t end=address+size;
+    freelist_hints_t hints =
+    {
+    0,
+    0,
+    0,
+    0, /* mgt_mode */
+    HAM_FALSE,
+    0,
+    0,
+    0,
+    0,
+    0
+    };
+
+    ham_assert(!(env->get_flags()&HAM_IN_MEMORY_DB), (0));
+
+    ham_assert(size%DB_CHUNKSIZE==0, (0));
+    ham_assert(address%DB_CHUNKSIZE==0, (0));
+
+    cache = device->get_freelist_cache();
+    ham_assert(cache, (0));
+
+    st=__freel_cache_load(device, env, cache, end-1, 0);
+    if (st)
+        return st;
+
+    for (i=0; i<freel_cache_get_count(cache); i++)
+    {
+        freelist_entry_t *entry=freel_cache_get_entries(cache)+i;
+        freelist_payload_t *fp;
+        Page *page=0;
+        ham_offset_t start=freel_entry_get_start_address(entry);
+        ham_size_t first, last, bit, claimed=0;
+        ham_u8_t *bitmap;
+
+        if (start>=end
+                || start+(ham_offset_t)freel_entry_get_max_bits(entry)
+                        *DB_CHUNKSIZE<=address)
+            continue;
+
+        /*
+         * entries without free chunks can be skipped; this also applies
+         * to all entries which do not yet have a freelist page
+         */
+        if (!freel_entry_get_allocated_bits(entry))
+            continue;
+        if (i==0) {
+            fp=env->get_freelist();
+        }
+        else {
+            if (!freel_entry_get_page_id(entry))
+                continue;
+            st=env_fetch_page(&page, env, freel_entry_get_page_id(entry), 0);
+            if (!page)
+                return st ? st : HAM_INTERNAL_ERROR;
+            fp=page_get_freelist(page);
+        }
+
+        first=address>start
+                ? (ham_size_t)((address-start)/DB_CHUNKSIZE)
+                : 0;
+        last=(ham_size_t)freel_get_max_bitsXX(fp);
+        if (end<start+(ham_offset_t)last*DB_CHUNKSIZE)
+            last=(ham_size_t)((end-start)/DB_CHUNKSIZE);
+        bitmap=freel_get_bitmapXX(fp);
+
+        /*
+         * clear all runs of set (= free) bits
+         */
+        bit=first;
+        while (bit<last)
+        {
+            ham_size_t run;
+
+            if (!(bitmap[bit>>3]&(1<<(bit&7)))) {
+                bit++;
+                continue;
+            }
+            run=bit+1;
+            while (run<last && (bitmap[run>>3]&(1<<(run&7))))
+                run++;
+
+            __freel_set_bits(device, env, entry, fp, HAM_FALSE,
+                    bit, run-bit, HAM_FALSE, &hints);
+            claimed+=run-bit;
+            bit=run;
+        }
+
+        if (!claimed)
+            continue;
+
+        freel_set_allocated_bitsXX(fp,
+                (ham_uXX_t)(freel_get_allocated_bitsXX(fp)-claimed));
+        freel_entry_set_allocated_bits(entry,
+                freel_get_allocated_bitsXX(fp));
+
+        if (page)
+            __page_set_dirty(page);
+        else
+            __env_set_dirty(env);
+    }
+
+    return HAM_SUCCESS;
+}
+
 /**
  * setup / initialize the proper performance data for this freelist
  * page.
@@ -3896,7 +4112,13 @@ __freel_constructor(Device *device, Environment *env, Database *db)
     ham_assert(env->get_header(), (0));
     //ham_assert(env_get_data_access_mode(env) == 0, (0));
 
-    if (env->is_legacy())
+    if (env->get_freelist_format()==FREELIST_FORMAT_EXTENTS
+            || (env->get_flags()&HAM_ENABLE_FREELIST_EXTENTS))
+    {
+        /* a bitmap freelist is migrated by the constructor */
+        st = freel_constructor_prepare_extents(&cache, device, env);
+    }
+    else if (env->is_legacy())
     {
 /*
 TODO TODO TODO
@@ -3921,6 +4143,8 @@ the environment, but that wouldn't be nice...
         ham_assert(cache, (0));
         ham_assert(cache->_constructor != 0, (0));
         st = cache->_constructor(cache, device, env);
+        if (st && device->get_freelist_cache()!=cache)
+            env->get_allocator()->free(cache);
     }
 
     ham_assert(st ? 1 : device->get_freelist_cache()!=0, (0));
@@ -3955,6 +4179,7 @@ freel_constructor_prepare32(freelist_cache_t **cache_ref, Device *device,
     cache->_alloc_area = __freel_alloc_area32;
     cache->_mark_free = __freel_mark_free32;
     cache->_check_area_is_allocated = __freel_check_area_is_allocated32;
+    cache->_claim_area = __freel_claim_area32;
     cache->_init_perf_data = __freel_init_perf_data32;
 
     //st = cache->_constructor(cache, device, env, env_get_data_access_mode(env));
@@ -3969,6 +4194,24 @@ freel_constructor_prepare32(freelist_cache_t **cache_ref, Device *device,
 }
 
 
+ham_status_t
+freel_initialize(Environment *env)
+{
+    Device *device;
+
+    if (env->get_flags()&HAM_IN_MEMORY_DB)
+        return (0);
+
+    device=env->get_device();
+    if (!device)
+        return (HAM_INTERNAL_ERROR);
+
+    if (device->get_freelist_cache())
+        return (0);
+
+    return (__freel_constructor(device, env, 0));
+}
+
 ham_status_t
 freel_shutdown(Environment *env)
 {
@@ -4071,6 +4314,38 @@ freel_check_area_is_allocated(Environment *env, Database *db,
     return st;
 }
 
+ham_status_t
+freel_claim_area(Environment *env, Database *db,
+                ham_offset_t address, ham_size_t size)
+{
+    freelist_cache_t *cache;
+    Device *device;
+    ham_status_t st;
+
+    if (env->get_flags()&HAM_IN_MEMORY_DB)
+        return HAM_SUCCESS;
+
+    ham_assert(size%DB_CHUNKSIZE==0, (0));
+    ham_assert(address%DB_CHUNKSIZE==0, (0));
+
+    device=env->get_device();
+    if (!device)
+        return HAM_INTERNAL_ERROR;
+
+    if (!device->get_freelist_cache()) {
+        st = __freel_constructor(env->get_device(), env, db);
+        if (st)
+            return st;
+    }
+    cache=device->get_freelist_cache();
+
+    ham_assert(cache, (0));
+    ham_assert(cache->_claim_area, (0));
+    st = cache->_claim_area(device, env, address, size);
+
+    return st;
+}
+
 
 ham_status_t
 freel_alloc_area(ham_offset_t *addr_ref, Environment *env, Database *db,
@@ -4177,6 +4452,7 @@ freel_constructor_prepare16(freelist_cache_t **cache_ref, Device *device,
     cache->_alloc_area = __freel_alloc_area16;
     cache->_mark_free = __freel_mark_free16;
     cache->_check_area_is_allocated = __freel_check_area_is_allocated16;
+    cache->_claim_area = __freel_claim_area16;
     cache->_init_perf_data = __freel_init_perf_data16;
 
     *cache_ref = cache;
@@ -167,6 +167,17 @@ struct freelist_entry_t
     (*_check_area_is_allocated)(Device *dev, Environment *env,          \
                                 ham_offset_t address, ham_size_t size); \
                                                                         \
+    /**                                                                 \
+     * mark an area in the file as "allocated", regardless whether      \
+     * all, some or none of its chunks are free                         \
+     *                                                                  \
+     * @note                                                            \
+     * will assert that address and size are DB_CHUNKSIZE-aligned!      \
+     */                                                                 \
+    ham_status_t                                                        \
+    (*_claim_area)(Device *dev, Environment *env,                       \
+                                ham_offset_t address, ham_size_t size); \
+                                                                        \
     /**                                                                 \
      * setup / initialize the proper performance data for this          \
      * freelist page.                                                   \
@@ -194,6 +205,16 @@ struct freelist_cache_t
     /** the cached freelist entries */
     freelist_entry_t *_entries;
 
+    /**
+     * the address of the first freelist page which was not yet loaded;
+     * the freelist pages are loaded on demand, and this is 0 if all
+     * pages are in the cache
+     */
+    ham_offset_t _next_page;
+
+    /** the free extents, if the extent freelist is used (otherwise NULL) */
+    FreelistExtents *_extents;
+
     /** class methods which handle all things freelist */
     FREELIST_DECLARATIONS(struct freelist_cache_t);
 };
@@ -211,6 +232,24 @@ struct freelist_cache_t
 /** set the cached freelist entries */
 #define freel_cache_set_entries(f, e)                   (f)->_entries=(e)
 
+/** get the address of the first freelist page which was not yet loaded */
+#define freel_cache_get_next_page(f)                    (f)->_next_page
+
+/** set the address of the first freelist page which was not yet loaded */
+#define freel_cache_set_next_page(f, p)                 (f)->_next_page=(p)
+
+/** get the free extents of the extent freelist */
+#define freel_cache_get_extents(f)                      (f)->_extents
+
+/** set the free extents of the extent freelist */
+#define freel_cache_set_extents(f, e)                   (f)->_extents=(e)
+
+/** the freelist is stored as bitmaps (the default) */
+#define FREELIST_FORMAT_BITMAP          0
+
+/** the freelist is stored as a list of extents (see freelist_extents.h) */
+#define FREELIST_FORMAT_EXTENTS         1
+
 
 #include "packstart.h"
 
@@ -409,6 +448,14 @@ extern ham_status_t
 freel_constructor_prepare16(freelist_cache_t **cache_ref, Device *dev,
                 Environment *env);
 
+/**
+ * create the freelist management object, if it does not yet exist
+ *
+ * usually this is done when the freelist is accessed for the first time
+ */
+extern ham_status_t
+freel_initialize(Environment *env);
+
 /**
  * flush and release all freelist pages
  */
@@ -485,5 +532,19 @@ extern ham_status_t
 freel_check_area_is_allocated(Environment *env, Database *db,
                 ham_offset_t address, ham_size_t size);
 
+/**
+ * mark an area in the file as "allocated", regardless whether all, some
+ * or none of its chunks are free
+ *
+ * this is used before the file is truncated, to make sure that the
+ * truncated area is no longer handed out by the freelist
+ *
+ * @note
+ * will assert that address and size are DB_CHUNKSIZE-aligned!
+ */
+extern ham_status_t
+freel_claim_area(Environment *env, Database *db,
+                ham_offset_t address, ham_size_t size);
+
 
 #endif /* HAM_FREELIST_H__ */
@@ -0,0 +1,551 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief implementation of freelist_extents.h
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "db.h"
+#include "device.h"
+#include "endianswap.h"
+#include "env.h"
+#include "error.h"
+#include "freelist_extents.h"
+#include "mem.h"
+#include "page.h"
+
+void
+FreelistExtents::insert(ham_offset_t address, ham_offset_t size)
+{
+    m_by_address[address]=size;
+    m_by_size.insert(std::make_pair(size, address));
+}
+
+void
+FreelistExtents::remove(ExtentMap::iterator it)
+{
+    m_by_size.erase(std::make_pair(it->second, it->first));
+    m_by_address.erase(it);
+}
+
+void
+FreelistExtents::add(ham_offset_t address, ham_offset_t size)
+{
+    ham_offset_t end=address+size;
+    ExtentMap::iterator it=m_by_address.lower_bound(address);
+
+    /* merge with the previous extent if it ends at (or after) the
+     * start of the new extent */
+    if (it!=m_by_address.begin()) {
+        ExtentMap::iterator prev=it;
+        --prev;
+        if (prev->first+prev->second>=address) {
+            if (prev->first+prev->second>end)
+                end=prev->first+prev->second;
+            address=prev->first;
+            remove(prev);
+        }
+    }
+
+    /* merge with all following extents which start before (or at) the
+     * end of the new extent */
+    while (it!=m_by_address.end() && it->first<=end) {
+        ExtentMap::iterator next=it;
+        ++next;
+        if (it->first+it->second>end)
+            end=it->first+it->second;
+        remove(it);
+        it=next;
+    }
+
+    insert(address, end-address);
+}
+
+ham_offset_t
+FreelistExtents::alloc(ham_offset_t size, ham_size_t alignment,
+                ham_offset_t lower_bound)
+{
+    std::set<std::pair<ham_offset_t, ham_offset_t> >::iterator it;
+
+    /* the extents are visited from the smallest to the largest one;
+     * without alignment and lower bound the first extent always fits */
+    for (it=m_by_size.lower_bound(std::make_pair(size, (ham_offset_t)0));
+            it!=m_by_size.end(); ++it) {
+        ham_offset_t start=it->second;
+        ham_offset_t end=start+it->first;
+        ham_offset_t address=start<lower_bound ? lower_bound : start;
+
+        if (alignment && address%alignment)
+            address+=alignment-address%alignment;
+        if (address+size>end)
+            continue;
+
+        remove(m_by_address.find(start));
+        if (address>start)
+            insert(start, address-start);
+        if (address+size<end)
+            insert(address+size, end-(address+size));
+        return (address);
+    }
+
+    return (0);
+}
+
+void
+FreelistExtents::claim(ham_offset_t address, ham_offset_t size)
+{
+    ham_offset_t end=address+size;
+    ExtentMap::iterator it=m_by_address.lower_bound(address);
+
+    if (it!=m_by_address.begin()) {
+        ExtentMap::iterator prev=it;
+        --prev;
+        if (prev->first+prev->second>address)
+            it=prev;
+    }
+
+    while (it!=m_by_address.end() && it->first<end) {
+        ExtentMap::iterator next=it;
+        ++next;
+        ham_offset_t from=it->first;
+        ham_offset_t to=it->first+it->second;
+        remove(it);
+        if (from<address)
+            insert(from, address-from);
+        if (to>end)
+            insert(end, to-end);
+        it=next;
+    }
+}
+
+bool
+FreelistExtents::is_free(ham_offset_t address, ham_offset_t size) const
+{
+    ExtentMap::const_iterator it=m_by_address.upper_bound(address);
+
+    if (it!=m_by_address.begin()) {
+        ExtentMap::const_iterator prev=it;
+        --prev;
+        if (prev->first+prev->second>address)
+            return (true);
+    }
+    return (it!=m_by_address.end() && it->first<address+size);
+}
+
+static ham_size_t
+__encode_varint(ham_u8_t *p, ham_u64_t value)
+{
+    ham_size_t n=0;
+    while (value>=0x80) {
+        p[n++]=(ham_u8_t)(value|0x80);
+        value>>=7;
+    }
+    p[n++]=(ham_u8_t)value;
+    return (n);
+}
+
+static ham_size_t
+__decode_varint(const ham_u8_t *p, ham_size_t available, ham_u64_t *value)
+{
+    ham_size_t n=0;
+    unsigned shift=0;
+
+    *value=0;
+    while (n<available && shift<64) {
+        ham_u8_t b=p[n++];
+        *value|=(ham_u64_t)(b&0x7f)<<shift;
+        if (!(b&0x80))
+            return (n);
+        shift+=7;
+    }
+    return (0);
+}
+
+ham_size_t
+FreelistExtents::encode(ham_u8_t *p, ham_offset_t prev_end,
+                ham_offset_t address, ham_offset_t size)
+{
+    ham_size_t n;
+
+    ham_assert(address>=prev_end, (0));
+    n =__encode_varint(p, (address-prev_end)/DB_CHUNKSIZE);
+    n+=__encode_varint(p+n, size/DB_CHUNKSIZE);
+    return (n);
+}
+
+ham_size_t
+FreelistExtents::decode(const ham_u8_t *p, ham_size_t available,
+                ham_offset_t prev_end, ham_offset_t *address,
+                ham_offset_t *size)
+{
+    ham_u64_t gap, chunks;
+    ham_size_t n, m;
+
+    n=__decode_varint(p, available, &gap);
+    if (!n)
+        return (0);
+    m=__decode_varint(p+n, available-n, &chunks);
+    if (!m || !chunks)
+        return (0);
+
+    *address=prev_end+gap*DB_CHUNKSIZE;
+    *size=chunks*DB_CHUNKSIZE;
+    return (n+m);
+}
+
+/** returns the extent payload in the header page */
+static freelist_extents_payload_t *
+__get_header_payload(Environment *env)
+{
+    return ((freelist_extents_payload_t *)env->get_freelist());
+}
+
+/** returns the number of bytes for extents in the header page */
+static ham_size_t
+__get_header_capacity(Environment *env)
+{
+    return (env->get_usable_pagesize()-SIZEOF_FULL_HEADER(env)
+            -OFFSETOF(freelist_extents_payload_t, _data));
+}
+
+/** returns the number of bytes for extents in a freelist page */
+static ham_size_t
+__get_page_capacity(Environment *env)
+{
+    return (env->get_usable_pagesize()
+            -OFFSETOF(freelist_extents_payload_t, _data));
+}
+
+/**
+ * reads the free chunks of the bitmap freelist, starting with the
+ * header page; the freelist pages are kept for the extents
+ */
+static ham_status_t
+__freel_extents_migrate(FreelistExtents *extents, Environment *env)
+{
+    ham_status_t st;
+    freelist_payload_t *fp=env->get_freelist();
+
+    for (;;) {
+        ham_offset_t start=freel_get_start_address(fp);
+        ham_size_t max_bits;
+        const ham_u8_t *bitmap;
+
+        if (env->is_legacy()) {
+            max_bits=freel_get_max_bits16(fp);
+            bitmap=freel_get_bitmap16(fp);
+        }
+        else {
+            max_bits=freel_get_max_bits32(fp);
+            bitmap=freel_get_bitmap32(fp);
+        }
+
+        /* collect the runs of set (= free) bits */
+        ham_size_t i=0;
+        while (i<max_bits) {
+            if (!(i&7) && !bitmap[i>>3] && i+8<=max_bits) {
+                i+=8;
+                continue;
+            }
+            if (!(bitmap[i>>3]&(1<<(i&7)))) {
+                i++;
+                continue;
+            }
+            ham_size_t j=i+1;
+            while (j<max_bits && (bitmap[j>>3]&(1<<(j&7))))
+                j++;
+            extents->add(start+(ham_offset_t)i*DB_CHUNKSIZE,
+                    (ham_offset_t)(j-i)*DB_CHUNKSIZE);
+            i=j;
+        }
+
+        if (!freel_get_overflow(fp))
+            return (0);
+
+        Page *page;
+        st=env_fetch_page(&page, env, freel_get_overflow(fp), 0);
+        if (!page)
+            return (st ? st : HAM_INTERNAL_ERROR);
+        fp=page_get_freelist(page);
+    }
+}
+
+/** reads the persistent extents */
+static ham_status_t
+__freel_extents_load(FreelistExtents *extents, Environment *env)
+{
+    ham_status_t st;
+    freelist_extents_payload_t *fp=__get_header_payload(env);
+    ham_size_t capacity=__get_header_capacity(env);
+    ham_offset_t prev_end=0;
+
+    for (;;) {
+        ham_size_t size=ham_db2h32(fp->_size);
+        ham_size_t pos=0;
+
+        if (size>capacity) {
+            ham_log(("invalid size %u of the freelist extents", size));
+            return (HAM_INTEGRITY_VIOLATED);
+        }
+        if (!size)
+            return (0);
+
+        while (pos<size) {
+            ham_offset_t address, length;
+            ham_size_t n=FreelistExtents::decode(&fp->_data[pos], size-pos,
+                    prev_end, &address, &length);
+            if (!n) {
+                ham_log(("invalid freelist extent"));
+                return (HAM_INTEGRITY_VIOLATED);
+            }
+            extents->add(address, length);
+            prev_end=address+length;
+            pos+=n;
+        }
+
+        if (!fp->_overflow)
+            return (0);
+
+        Page *page;
+        st=env_fetch_page(&page, env, ham_db2h_offset(fp->_overflow), 0);
+        if (!page)
+            return (st ? st : HAM_INTERNAL_ERROR);
+        fp=(freelist_extents_payload_t *)page->get_payload();
+        capacity=__get_page_capacity(env);
+    }
+}
+
+static ham_status_t
+__freel_extents_constructor(freelist_cache_t *cache, Device *device,
+                Environment *env)
+{
+    ham_status_t st=0;
+    freelist_extents_payload_t *fp=__get_header_payload(env);
+    FreelistExtents *extents=new FreelistExtents();
+    bool invalidate=false;
+
+    ham_assert(device->get_freelist_cache()==0, (0));
+
+    if (env->get_freelist_format()!=FREELIST_FORMAT_EXTENTS) {
+        st=__freel_extents_migrate(extents, env);
+        env->set_freelist_format(FREELIST_FORMAT_EXTENTS);
+        invalidate=true;
+    }
+    else if (ham_db2h32(fp->_magic)==FreelistExtents::MAGIC) {
+        st=__freel_extents_load(extents, env);
+        invalidate=true;
+    }
+    if (st) {
+        delete extents;
+        return (st);
+    }
+
+    /*
+     * the extents in the file are no longer valid as soon as the first
+     * area is allocated; they are written again when the Environment
+     * is closed
+     */
+    if (invalidate && !(env->get_flags()&HAM_READ_ONLY)) {
+        fp->_magic=0;
+        fp->_size=0;
+        env->set_dirty(true);
+        st=env->get_header_page()->flush();
+        if (st) {
+            delete extents;
+            return (st);
+        }
+    }
+
+    freel_cache_set_extents(cache, extents);
+    device->set_freelist_cache(cache);
+    return (0);
+}
+
+static ham_status_t
+__freel_extents_destructor(Device *device, Environment *env)
+{
+    freelist_cache_t *cache=device->get_freelist_cache();
+    ham_assert(cache, (0));
+
+    delete freel_cache_get_extents(cache);
+    memset(cache, 0, sizeof(*cache));
+    return (0);
+}
+
+/**
+ * writes the extents to the header page and the freelist pages; the
+ * freelist pages are written first, then the header page is validated
+ */
+static ham_status_t
+__freel_extents_flush(Device *device, Environment *env)
+{
+    ham_status_t st;
+    freelist_cache_t *cache=device->get_freelist_cache();
+    const FreelistExtents::ExtentMap &extents
+                =freel_cache_get_extents(cache)->get_extents();
+    FreelistExtents::ExtentMap::const_iterator it=extents.begin();
+    freelist_extents_payload_t *header=__get_header_payload(env);
+    freelist_extents_payload_t *fp=header;
+    ham_size_t capacity=__get_header_capacity(env);
+    ham_offset_t prev_end=0;
+    Page *page=0;
+
+    if ((env->get_flags()&HAM_READ_ONLY) || !device->is_open())
+        return (0);
+
+    for (;;) {
+        ham_u8_t buffer[FreelistExtents::MAX_ENCODED_SIZE];
+        ham_size_t size=0;
+        ham_offset_t next;
+
+        while (it!=extents.end()) {
+            ham_size_t n=FreelistExtents::encode(buffer, prev_end,
+                    it->first, it->second);
+            if (size+n>capacity)
+                break;
+            memcpy(&fp->_data[size], buffer, n);
+            size+=n;
+            prev_end=it->first+it->second;
+            ++it;
+        }
+        fp->_magic=0;
+        fp->_size=ham_h2db32(size);
+
+        /* append a freelist page if the extents do not fit; superfluous
+         * pages are not released, but an empty page terminates the list */
+        next=ham_db2h_offset(fp->_overflow);
+        if (it!=extents.end() && !next) {
+            Page *newpage;
+            st=env_alloc_page(&newpage, env, Page::TYPE_FREELIST,
+                    PAGE_IGNORE_FREELIST|PAGE_CLEAR_WITH_ZERO);
+            if (!newpage)
+                return (st ? st : HAM_INTERNAL_ERROR);
+            next=newpage->get_self();
+            fp->_overflow=ham_h2db_offset(next);
+        }
+
+        if (page) {
+            page->set_dirty(true);
+            st=page->flush();
+            if (st)
+                return (st);
+        }
+
+        if (!next || !size)
+            break;
+
+        st=env_fetch_page(&page, env, next, 0);
+        if (!page)
+            return (st ? st : HAM_INTERNAL_ERROR);
+        fp=(freelist_extents_payload_t *)page->get_payload();
+        capacity=__get_page_capacity(env);
+    }
+
+    header->_magic=ham_h2db32(FreelistExtents::MAGIC);
+    env->set_dirty(true);
+    st=env->get_header_page()->flush();
+
+    /* the freelist pages were fetched after the last operation */
+    env->get_changeset().clear();
+    return (st);
+}
+
+static ham_status_t
+__freel_extents_mark_free(Device *device, Environment *env, Database *db,
+                ham_offset_t address, ham_size_t size, ham_bool_t overwrite)
+{
+    FreelistExtents *extents=freel_cache_get_extents(
+                device->get_freelist_cache());
+
+    ham_assert(size%DB_CHUNKSIZE==0, (0));
+    ham_assert(address%DB_CHUNKSIZE==0, (0));
+    ham_assert(overwrite || !extents->is_free(address, size),
+            ("area 0x%llx is already free", (unsigned long long)address));
+
+    extents->add(address, size);
+    return (0);
+}
+
+static ham_status_t
+__freel_extents_alloc_area(ham_offset_t *addr_ref, Device *device,
+                Environment *env, Database *db, ham_size_t size,
+                ham_bool_t aligned, ham_offset_t lower_bound_address)
+{
+    FreelistExtents *extents=freel_cache_get_extents(
+                device->get_freelist_cache());
+
+    ham_assert(size%DB_CHUNKSIZE==0, (0));
+
+    *addr_ref=extents->alloc(size, aligned ? env->get_pagesize() : 0,
+                lower_bound_address);
+    return (0);
+}
+
+static ham_status_t
+__freel_extents_check_area_is_allocated(Device *device, Environment *env,
+                ham_offset_t address, ham_size_t size)
+{
+    /* the extents cover the whole file */
+    return (0);
+}
+
+static ham_status_t
+__freel_extents_claim_area(Device *device, Environment *env,
+                ham_offset_t address, ham_size_t size)
+{
+    ham_assert(size%DB_CHUNKSIZE==0, (0));
+    ham_assert(address%DB_CHUNKSIZE==0, (0));
+
+    freel_cache_get_extents(device->get_freelist_cache())->claim(address,
+                size);
+    return (0);
+}
+
+static ham_status_t
+__freel_extents_init_perf_data(freelist_cache_t *cache, Device *device,
+                Environment *env, freelist_entry_t *entry,
+                freelist_payload_t *payload)
+{
+    /* the extents do not collect statistics */
+    return (0);
+}
+
+ham_status_t
+freel_constructor_prepare_extents(freelist_cache_t **cache_ref,
+                Device *device, Environment *env)
+{
+    freelist_cache_t *cache;
+
+    ham_assert(device->get_freelist_cache()==0, (0));
+
+    *cache_ref=0;
+
+    cache=(freelist_cache_t *)env->get_allocator()->calloc(sizeof(*cache));
+    if (!cache)
+        return (HAM_OUT_OF_MEMORY);
+
+    cache->_constructor=__freel_extents_constructor;
+    cache->_destructor=__freel_extents_destructor;
+    cache->_flush_stats=__freel_extents_flush;
+    cache->_alloc_area=__freel_extents_alloc_area;
+    cache->_mark_free=__freel_extents_mark_free;
+    cache->_check_area_is_allocated=__freel_extents_check_area_is_allocated;
+    cache->_claim_area=__freel_extents_claim_area;
+    cache->_init_perf_data=__freel_extents_init_perf_data;
+
+    *cache_ref=cache;
+    return (HAM_SUCCESS);
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief the extent freelist
+ *
+ * The extent freelist (see @ref HAM_ENABLE_FREELIST_EXTENTS) replaces
+ * the freelist bitmaps with a map of free extents, which is kept in
+ * memory. The extents are sorted by their address (to coalesce
+ * neighbouring extents when an area is freed) and by their size (for a
+ * best-fit allocation); both operations are O(log n).
+ *
+ * The extents are only written to disk when the Environment is closed.
+ * They are stored in the freelist area of the header page and in a
+ * linked list of freelist pages, which use the same link as the bitmap
+ * freelist (see freelist_payload_t::_overflow). Every extent is stored
+ * as two variable-length integers: the distance to the end of the
+ * previous extent, and its size, both in @ref DB_CHUNKSIZE units.
+ *
+ * When the Environment is opened, the extents are read and then
+ * invalidated on disk (the magic in the header page is cleared); if the
+ * Environment is not closed properly, the free space is lost, but
+ * nothing which is in use is ever handed out twice.
+ *
+ * A bitmap freelist is migrated when the Environment is opened with
+ * @ref HAM_ENABLE_FREELIST_EXTENTS; the freelist pages of the bitmap are
+ * re-used for the extents.
+ */
+
+#ifndef HAM_FREELIST_EXTENTS_H__
+#define HAM_FREELIST_EXTENTS_H__
+
+#include <map>
+#include <set>
+
+#include "internal_fwd_decl.h"
+
+#include "freelist.h"
+
+
+#include "packstart.h"
+
+/**
+ * the persistent extent list in the header page and in the freelist pages
+ */
+HAM_PACK_0 struct HAM_PACK_1 freelist_extents_payload_t
+{
+    /**
+     * @ref FreelistExtents::MAGIC if the extents are valid; only checked
+     * in the header page
+     */
+    ham_u32_t _magic;
+
+    /** the number of bytes in _data; 0 terminates the list */
+    ham_u32_t _size;
+
+    /**
+     * address of the next freelist page; this is at the same offset
+     * as freelist_payload_t::_overflow
+     */
+    ham_offset_t _overflow;
+
+    /** the encoded extents */
+    ham_u8_t _data[1];
+
+} HAM_PACK_2;
+
+#include "packstop.h"
+
+/**
+ * the in-memory map of the free extents
+ */
+class FreelistExtents
+{
+  public:
+    enum {
+        /** the magic of a valid extent list ("FEXT") */
+        MAGIC=0x54584546,
+
+        /** the maximum size of an encoded extent */
+        MAX_ENCODED_SIZE=2*10
+    };
+
+    /** a map of the extents; the key is the address, the value the size */
+    typedef std::map<ham_offset_t, ham_offset_t> ExtentMap;
+
+    /** adds a free area; neighbouring extents are coalesced */
+    void add(ham_offset_t address, ham_offset_t size);
+
+    /**
+     * allocates @a size bytes from the smallest extent which fits; if
+     * @a alignment is not 0 then the address is a multiple of
+     * @a alignment. The address is not lower than @a lower_bound.
+     * Returns 0 if no extent was found
+     */
+    ham_offset_t alloc(ham_offset_t size, ham_size_t alignment,
+                ham_offset_t lower_bound);
+
+    /** removes an area; parts of it can already be allocated */
+    void claim(ham_offset_t address, ham_offset_t size);
+
+    /** returns true if any part of an area is free */
+    bool is_free(ham_offset_t address, ham_offset_t size) const;
+
+    /** returns the extents, sorted by their address */
+    const ExtentMap &get_extents() const {
+        return (m_by_address);
+    }
+
+    /** removes all extents */
+    void clear() {
+        m_by_address.clear();
+        m_by_size.clear();
+    }
+
+    /**
+     * encodes an extent to @a p, relative to the end of the previous
+     * extent; returns the number of bytes
+     */
+    static ham_size_t encode(ham_u8_t *p, ham_offset_t prev_end,
+                ham_offset_t address, ham_offset_t size);
+
+    /**
+     * decodes an extent from @a p, which has @a available bytes;
+     * returns the number of bytes, or 0 if the data is invalid
+     */
+    static ham_size_t decode(const ham_u8_t *p, ham_size_t available,
+                ham_offset_t prev_end, ham_offset_t *address,
+                ham_offset_t *size);
+
+  private:
+    /** inserts an extent which does not overlap with another extent */
+    void insert(ham_offset_t address, ham_offset_t size);
+
+    /** removes an extent */
+    void remove(ExtentMap::iterator it);
+
+    /** the extents, sorted by their address */
+    ExtentMap m_by_address;
+
+    /** the extents, sorted by their size and their address */
+    std::set<std::pair<ham_offset_t, ham_offset_t> > m_by_size;
+};
+
+/**
+ * Initialize a freelist management object for the extent freelist
+ */
+extern ham_status_t
+freel_constructor_prepare_extents(freelist_cache_t **cache_ref, Device *dev,
+                Environment *env);
+
+#endif /* HAM_FREELIST_EXTENTS_H__ */
@@ -26,10 +26,14 @@
 #  include "protocol/protocol.h"
 #endif
 
+#include "backup.h"
 #include "blob.h"
+#include "bloom.h"
 #include "btree.h"
 #include "btree_cursor.h"
+#include "btree_verify.h"
 #include "cache.h"
+#include "compact.h"
 #include "cursor.h"
 #include "db.h"
 #include "device.h"
@@ -41,14 +45,17 @@
 #include "mem.h"
 #include "os.h"
 #include "page.h"
+#include "record_stream.h"
 #include "serial.h"
 #include "btree_stats.h"
+#include "trace.h"
 #include "txn.h"
 #include "util.h"
 #include "version.h"
 
 #ifndef HAM_DISABLE_ENCRYPTION
 #  include "../3rdparty/aes/aes.h"
+#  include "cipher.h"
 #endif
 #ifndef HAM_DISABLE_COMPRESSION
 #  ifdef HAM_USE_SYSTEM_ZLIB
@@ -112,6 +119,10 @@ ham_create_flags2str(char *buf, size_t buflen, ham_u32_t flags)
         flags &= ~HAM_USE_BTREE;
         buf = my_strncat_ex(buf, buflen, NULL, "HAM_USE_BTREE");
     }
+    if (flags & HAM_USE_HASH) {
+        flags &= ~HAM_USE_HASH;
+        buf = my_strncat_ex(buf, buflen, NULL, "HAM_USE_HASH");
+    }
     if (flags & HAM_DISABLE_VAR_KEYLEN) {
         flags &= ~HAM_DISABLE_VAR_KEYLEN;
         buf = my_strncat_ex(buf, buflen, NULL, "HAM_DISABLE_VAR_KEYLEN");
@@ -121,6 +132,10 @@ ham_create_flags2str(char *buf, size_t buflen, ham_u32_t flags)
         flags &= ~HAM_IN_MEMORY_DB;
         buf = my_strncat_ex(buf, buflen, NULL, "HAM_IN_MEMORY_DB");
     }
+    if (flags & HAM_IN_MEMORY_ARENA) {
+        flags &= ~HAM_IN_MEMORY_ARENA;
+        buf = my_strncat_ex(buf, buflen, NULL, "HAM_IN_MEMORY_ARENA");
+    }
     if (flags & HAM_DISABLE_MMAP)
     {
         flags &= ~HAM_DISABLE_MMAP;
@@ -166,6 +181,26 @@ ham_create_flags2str(char *buf, size_t buflen, ham_u32_t flags)
         flags &= ~HAM_CACHE_UNLIMITED;
         buf = my_strncat_ex(buf, buflen, NULL, "HAM_CACHE_UNLIMITED");
     }
+    if (flags & HAM_ENABLE_METRICS) {
+        flags &= ~HAM_ENABLE_METRICS;
+        buf = my_strncat_ex(buf, buflen, NULL, "HAM_ENABLE_METRICS");
+    }
+    if (flags & HAM_ENABLE_CRC32) {
+        flags &= ~HAM_ENABLE_CRC32;
+        buf = my_strncat_ex(buf, buflen, NULL, "HAM_ENABLE_CRC32");
+    }
+    if (flags & HAM_ENABLE_FREELIST_EXTENTS) {
+        flags &= ~HAM_ENABLE_FREELIST_EXTENTS;
+        buf = my_strncat_ex(buf, buflen, NULL, "HAM_ENABLE_FREELIST_EXTENTS");
+    }
+    if (flags & HAM_ENABLE_SLAB_RECORDS) {
+        flags &= ~HAM_ENABLE_SLAB_RECORDS;
+        buf = my_strncat_ex(buf, buflen, NULL, "HAM_ENABLE_SLAB_RECORDS");
+    }
+    if (flags & HAM_ENABLE_DUPLICATE_TREES) {
+        flags &= ~HAM_ENABLE_DUPLICATE_TREES;
+        buf = my_strncat_ex(buf, buflen, NULL, "HAM_ENABLE_DUPLICATE_TREES");
+    }
 
     if (flags) {
         if (buf && buflen > 13 && buflen > strlen(buf) + 13 + 1 + 9) {
@@ -194,9 +229,18 @@ ham_param2str(char *buf, size_t buflen, ham_u32_t name)
     case HAM_PARAM_KEYSIZE:
         return "HAM_PARAM_KEYSIZE";
 
+    case HAM_PARAM_KEY_TYPE:
+        return "HAM_PARAM_KEY_TYPE";
+
+    case HAM_PARAM_RECORD_INLINE_SIZE:
+        return "HAM_PARAM_RECORD_INLINE_SIZE";
+
     case HAM_PARAM_LOG_DIRECTORY:
         return "HAM_PARAM_LOG_DIRECTORY";
 
+    case HAM_PARAM_MAX_WRITE_SIZE:
+        return "HAM_PARAM_MAX_WRITE_SIZE";
+
     case HAM_PARAM_MAX_ENV_DATABASES:
         return "HAM_PARAM_MAX_ENV_DATABASES";
 
@@ -288,7 +332,11 @@ ham_txn_begin(ham_txn_t **htxn, ham_env_t *henv, const char *name,
     }
 
     /* initialize the txn structure */
-    return (env->_fun_txn_begin(env, txn, name, flags));
+    ham_status_t st=env->_fun_txn_begin(env, txn, name, flags);
+    if (Tracer *tracer=env->get_tracer())
+        tracer->trace_txn(Tracer::OP_TXN_BEGIN, *txn ? txn_get_id(*txn) : 0,
+                flags, st);
+    return (st);
 }
 
 HAM_EXPORT const char *
@@ -318,12 +366,18 @@ ham_txn_commit(ham_txn_t *htxn, ham_u32_t flags)
 
     ScopedLock lock;
     if (!(flags&HAM_DONT_LOCK))
-        lock=ScopedLock(env->get_mutex());
+        Metrics::lock(env, lock);
 
     /* mark this transaction as committed; will also call
      * env_flush_committed_txns() to write committed transactions
      * to disk */
-    return (env->_fun_txn_commit(env, txn, flags));
+    OperationTimer timer(env, HAM_METRICS_OP_TXN_COMMIT);
+    /* the Transaction may be deleted when it's committed */
+    ham_u64_t id=txn_get_id(txn);
+    ham_status_t st=env->_fun_txn_commit(env, txn, flags);
+    if (Tracer *tracer=env->get_tracer())
+        tracer->trace_txn(Tracer::OP_TXN_COMMIT, id, flags, st);
+    return (st);
 }
 
 ham_status_t
@@ -345,7 +399,12 @@ ham_txn_abort(ham_txn_t *htxn, ham_u32_t flags)
     if (!(flags&HAM_DONT_LOCK))
         lock=ScopedLock(env->get_mutex());
 
-    return (env->_fun_txn_abort(env, txn, flags));
+    /* the Transaction may be deleted when it's aborted */
+    ham_u64_t id=txn_get_id(txn);
+    ham_status_t st=env->_fun_txn_abort(env, txn, flags);
+    if (Tracer *tracer=env->get_tracer())
+        tracer->trace_txn(Tracer::OP_TXN_ABORT, id, flags, st);
+    return (st);
 }
 
 const char * HAM_CALLCONV
@@ -403,6 +462,8 @@ ham_strerror(ham_status_t result)
         case HAM_TXN_STILL_OPEN:
             return ("Database cannot be closed because it is modified in a "
                     "Transaction");
+        case HAM_CHECKSUM_MISMATCH:
+            return ("Checksum mismatch; the file is corrupt");
         case HAM_CURSOR_IS_NIL:
             return ("Cursor points to NIL");
         case HAM_DATABASE_NOT_FOUND:
@@ -489,21 +550,42 @@ __prepare_record(ham_record_t *record)
     return HAM_TRUE;
 }
 
+/**
+ * Checks the size of a key of a typed Database; the keys of a typed
+ * Database always have the size of the key type.
+ *
+ * @return HAM_FALSE when the size of the key is invalid
+ */
+static inline ham_bool_t
+__check_key_type(Database *db, ham_key_t *key)
+{
+    ham_u16_t size=db->get_key_type_size();
+    if (size && (key->size!=size || !key->data)) {
+        ham_trace(("key->size must be %u for the key type of this Database",
+                    (unsigned)size));
+        return HAM_FALSE;
+    }
+    return HAM_TRUE;
+}
+
 ham_status_t
 __check_create_parameters(Environment *env, Database *db, const char *filename,
         ham_u32_t *pflags, const ham_parameter_t *param,
-        ham_size_t *ppagesize, ham_u16_t *pkeysize,
-        ham_u64_t *pcachesize, ham_u16_t *pdbname,
+        ham_size_t *ppagesize, ham_u16_t *pkeysize, ham_u16_t *pkeytype,
+        ham_u16_t *pinline_size, ham_u64_t *pcachesize, ham_u16_t *pdbname,
         ham_u16_t *pmaxdbs, ham_u16_t *pdata_access_mode,
-        std::string &logdir, bool create)
+        ham_size_t *pmax_write_size, std::string &logdir, bool create)
 {
     ham_size_t pagesize=0;
     ham_u16_t keysize=0;
+    ham_u16_t keytype=HAM_TYPE_BINARY;
+    ham_u16_t inline_size=0;
     ham_u16_t dbname=HAM_DEFAULT_DATABASE_NAME;
     ham_u64_t cachesize=0;
     ham_bool_t no_mmap=HAM_FALSE;
     ham_u16_t dbs=0;
     ham_u16_t dam=0;
+    ham_size_t max_write_size=0;
     ham_u32_t flags = 0;
     ham_bool_t set_abs_max_dbs = HAM_FALSE;
     ham_status_t st = 0;
@@ -523,6 +605,10 @@ __check_create_parameters(Environment *env, Database *db, const char *filename,
         cachesize = *pcachesize;
     if (pkeysize)
         keysize = *pkeysize;
+    if (pkeytype)
+        keytype = *pkeytype;
+    if (pinline_size)
+        inline_size = *pinline_size;
     if (ppagesize)
         pagesize = *ppagesize;
     if (pdbname && *pdbname)
@@ -531,6 +617,8 @@ __check_create_parameters(Environment *env, Database *db, const char *filename,
         dam = *pdata_access_mode;
     if (pmaxdbs && *pmaxdbs)
         dbs = *pmaxdbs;
+    if (pmax_write_size)
+        max_write_size = *pmax_write_size;
 
     /*
      * cannot open an in-memory-db
@@ -540,6 +628,14 @@ __check_create_parameters(Environment *env, Database *db, const char *filename,
         return (HAM_INV_PARAMETER);
     }
 
+    /*
+     * the arenas are only used by in-memory-databases
+     */
+    if ((flags & HAM_IN_MEMORY_ARENA) && !(flags & HAM_IN_MEMORY_DB)) {
+        ham_trace(("flag HAM_IN_MEMORY_ARENA requires HAM_IN_MEMORY_DB"));
+        return (HAM_INV_PARAMETER);
+    }
+
     /*
      * creating a file in READ_ONLY mode? doesn't make sense
      */
@@ -583,7 +679,7 @@ __check_create_parameters(Environment *env, Database *db, const char *filename,
      * DB create: only a few flags are allowed
      */
     if (db && (flags & ~((!create ? HAM_READ_ONLY : 0)
-                        |(create ? HAM_IN_MEMORY_DB : 0)
+                        |(create ? (HAM_IN_MEMORY_DB|HAM_IN_MEMORY_ARENA) : 0)
                         |(!env ? (HAM_WRITE_THROUGH
                                 |HAM_DISABLE_MMAP
                                 |HAM_DISABLE_FREELIST_FLUSH
@@ -591,10 +687,16 @@ __check_create_parameters(Environment *env, Database *db, const char *filename,
                                 |HAM_DONT_LOCK
                                 |HAM_LOCK_EXCLUSIVE
                                 |HAM_ENABLE_TRANSACTIONS
-                                |HAM_ENABLE_RECOVERY) : 0)
+                                |HAM_ENABLE_RECOVERY
+                                |HAM_ENABLE_METRICS
+                                |HAM_ENABLE_CRC32
+                                |HAM_ENABLE_FREELIST_EXTENTS
+                                |HAM_ENABLE_SLAB_RECORDS
+                                |HAM_ENABLE_DUPLICATE_TREES) : 0)
                         |(!env && !create ? HAM_AUTO_RECOVERY : 0)
                         |HAM_CACHE_STRICT
                         |HAM_USE_BTREE
+                        |(create ? HAM_USE_HASH : 0)
                         |HAM_DONT_LOCK
                         |HAM_DISABLE_VAR_KEYLEN
                         |HAM_RECORD_NUMBER
@@ -605,17 +707,23 @@ __check_create_parameters(Environment *env, Database *db, const char *filename,
         ham_trace(("invalid flags specified: %s",
                 ham_create_flags2str(msgbuf, sizeof(msgbuf),
                 (flags & ~((!create ? HAM_READ_ONLY : 0)
-                        |(create ? HAM_IN_MEMORY_DB : 0)
+                        |(create ? (HAM_IN_MEMORY_DB|HAM_IN_MEMORY_ARENA) : 0)
                         |(!env ? (HAM_WRITE_THROUGH
                                 |HAM_DISABLE_MMAP
                                 |HAM_DISABLE_FREELIST_FLUSH
                                 |HAM_CACHE_UNLIMITED
                                 |HAM_LOCK_EXCLUSIVE
                                 |HAM_ENABLE_TRANSACTIONS
-                                |HAM_ENABLE_RECOVERY) : 0)
+                                |HAM_ENABLE_RECOVERY
+                                |HAM_ENABLE_METRICS
+                                |HAM_ENABLE_CRC32
+                                |HAM_ENABLE_FREELIST_EXTENTS
+                                |HAM_ENABLE_SLAB_RECORDS
+                                |HAM_ENABLE_DUPLICATE_TREES) : 0)
                         |(!env && !create ? HAM_AUTO_RECOVERY : 0)
                         |HAM_CACHE_STRICT
                         |HAM_USE_BTREE
+                        |(create ? HAM_USE_HASH : 0)
                         |HAM_DISABLE_VAR_KEYLEN
                         |HAM_RECORD_NUMBER
                         |(create ? HAM_ENABLE_DUPLICATES : 0))))));
@@ -625,6 +733,20 @@ __check_create_parameters(Environment *env, Database *db, const char *filename,
     if (env)
         flags |= env->get_flags();
 
+    /*
+     * a hash Database has no duplicates, no record numbers and no
+     * Transactions
+     */
+    if (create && db && (flags&HAM_USE_HASH)) {
+        if (flags&(HAM_USE_BTREE|HAM_ENABLE_DUPLICATES|HAM_RECORD_NUMBER
+                    |HAM_ENABLE_TRANSACTIONS)) {
+            ham_trace(("flag HAM_USE_HASH not allowed in combination with "
+                        "HAM_USE_BTREE, HAM_ENABLE_DUPLICATES, "
+                        "HAM_RECORD_NUMBER or HAM_ENABLE_TRANSACTIONS"));
+            return (HAM_INV_PARAMETER);
+        }
+    }
+
     /*
      * parse parameters
      */
@@ -640,6 +762,19 @@ __check_create_parameters(Environment *env, Database *db, const char *filename,
                 logdir=(const char *)param->value;
                 break;
 
+            case HAM_PARAM_MAX_WRITE_SIZE:
+                if (pmax_write_size) {
+                    if (param->value==0 || param->value>0xffffffffu) {
+                        ham_trace(("invalid value %llu for parameter "
+                                   "HAM_PARAM_MAX_WRITE_SIZE",
+                                   (unsigned long long)param->value));
+                        return (HAM_INV_PARAMETER);
+                    }
+                    max_write_size=(ham_size_t)param->value;
+                    break;
+                }
+                goto default_case;
+
             case HAM_PARAM_KEYSIZE:
                 if (!create) {
                     ham_trace(("invalid parameter HAM_PARAM_KEYSIZE"));
@@ -657,6 +792,56 @@ __check_create_parameters(Environment *env, Database *db, const char *filename,
                     }
                 }
                 break;
+            case HAM_PARAM_KEY_TYPE:
+                if (!create) {
+                    ham_trace(("invalid parameter HAM_PARAM_KEY_TYPE"));
+                    return (HAM_INV_PARAMETER);
+                }
+                if (pkeytype) {
+                    switch (param->value) {
+                    case HAM_TYPE_BINARY:
+                    case HAM_TYPE_BINARY_FIXED:
+                    case HAM_TYPE_UINT32:
+                    case HAM_TYPE_UINT64:
+                    case HAM_TYPE_INT64:
+                    case HAM_TYPE_REAL64:
+                        keytype=(ham_u16_t)param->value;
+                        break;
+                    default:
+                        ham_trace(("invalid value %u specified for "
+                                "parameter HAM_PARAM_KEY_TYPE",
+                                (unsigned)param->value));
+                        return (HAM_INV_PARAMETER);
+                    }
+                    break;
+                }
+                goto default_case;
+            case HAM_PARAM_RECORD_INLINE_SIZE:
+                if (!create) {
+                    ham_trace(("invalid parameter "
+                               "HAM_PARAM_RECORD_INLINE_SIZE"));
+                    return (HAM_INV_PARAMETER);
+                }
+                if (pinline_size) {
+                    if (param->value>DB_MAX_INLINE_SIZE) {
+                        ham_trace(("invalid value %u specified for "
+                                "parameter HAM_PARAM_RECORD_INLINE_SIZE; "
+                                "the maximum is %u",
+                                (unsigned)param->value,
+                                (unsigned)DB_MAX_INLINE_SIZE));
+                        return (HAM_INV_PARAMETER);
+                    }
+                    /* records up to 8 bytes are always stored in the
+                     * record ID */
+                    if (param->value<=sizeof(ham_offset_t))
+                        inline_size=0;
+                    else
+                        inline_size=(ham_u16_t)((param->value
+                                    +DB_INLINE_SIZE_UNIT-1)
+                                    &~(DB_INLINE_SIZE_UNIT-1));
+                    break;
+                }
+                goto default_case;
             case HAM_PARAM_PAGESIZE:
                 if (ppagesize) {
                     if (param->value!=1024 && param->value%2048!=0) {
@@ -814,6 +999,26 @@ default_case:
     if (!__check_recovery_flags(flags))
         return (HAM_INV_PARAMETER);
 
+    /*
+     * the extent freelist has to be written when the file is closed
+     */
+    if (flags&HAM_ENABLE_FREELIST_EXTENTS) {
+        if (flags&(HAM_IN_MEMORY_DB|HAM_READ_ONLY)) {
+            ham_trace(("combination of HAM_ENABLE_FREELIST_EXTENTS and "
+                       "HAM_IN_MEMORY_DB or HAM_READ_ONLY not allowed"));
+            return (HAM_INV_PARAMETER);
+        }
+    }
+
+    /*
+     * the records of an in-memory-db are never stored in pages
+     */
+    if ((flags&HAM_ENABLE_SLAB_RECORDS) && (flags&HAM_IN_MEMORY_DB)) {
+        ham_trace(("combination of HAM_ENABLE_SLAB_RECORDS and "
+                   "HAM_IN_MEMORY_DB not allowed"));
+        return (HAM_INV_PARAMETER);
+    }
+
     /*
      * in-memory-db? don't allow cache limits!
      */
@@ -905,6 +1110,35 @@ default_case:
         flags |= HAM_DISABLE_MMAP;
     }
 
+    /*
+     * typed keys: numeric types always have the size of the type
+     */
+    if (keytype!=HAM_TYPE_BINARY) {
+        ham_u16_t size=keytype_get_size(keytype);
+        if (flags&HAM_RECORD_NUMBER) {
+            ham_trace(("parameter HAM_PARAM_KEY_TYPE is not allowed in "
+                       "combination with HAM_RECORD_NUMBER"));
+            return (HAM_INV_PARAMETER);
+        }
+        if (size) {
+            if (keysize && keysize!=size) {
+                ham_trace(("invalid keysize %u - must be %u for this "
+                           "key type", (unsigned)keysize, (unsigned)size));
+                return (HAM_INV_KEYSIZE);
+            }
+            keysize=size;
+        }
+    }
+
+    /*
+     * inline records are stored in the btree leaves
+     */
+    if (inline_size && (flags&HAM_USE_HASH)) {
+        ham_trace(("parameter HAM_PARAM_RECORD_INLINE_SIZE is not allowed "
+                   "in combination with HAM_USE_HASH"));
+        return (HAM_INV_PARAMETER);
+    }
+
     /*
      * initialize the keysize with a good default value;
      * 32byte is the size of a first level cache line for most modern
@@ -983,6 +1217,10 @@ default_case:
         *pcachesize=cachesize;
     if (pkeysize)
         *pkeysize = keysize;
+    if (pkeytype)
+        *pkeytype = keytype;
+    if (pinline_size)
+        *pinline_size = inline_size;
     if (ppagesize)
         *ppagesize = pagesize;
     if (pdbname)
@@ -991,6 +1229,8 @@ default_case:
         *pdata_access_mode = dam;
     if (pmaxdbs)
         *pmaxdbs = dbs;
+    if (pmax_write_size)
+        *pmax_write_size = max_write_size;
 
     return st;
 }
@@ -1062,6 +1302,7 @@ ham_env_create_ex(ham_env_t *henv, const char *filename,
     ham_u16_t keysize = 0;
     ham_u64_t cachesize = 0;
     ham_u16_t maxdbs = 0;
+    ham_size_t max_write_size = 0;
     std::string logdir;
     Environment *env=(Environment *)henv;
 
@@ -1089,7 +1330,8 @@ ham_env_create_ex(ham_env_t *henv, const char *filename,
 
     /* check (and modify) the parameters */
     st=__check_create_parameters(env, 0, filename, &flags, param,
-            &pagesize, &keysize, &cachesize, 0, &maxdbs, 0, logdir, true);
+            &pagesize, &keysize, 0, 0, &cachesize, 0, &maxdbs, 0,
+            &max_write_size, logdir, true);
     if (st)
         return (st);
 
@@ -1097,6 +1339,9 @@ ham_env_create_ex(ham_env_t *henv, const char *filename,
         cachesize=HAM_DEFAULT_CACHESIZE;
     if (logdir.size())
         env->set_log_directory(logdir);
+    env->set_max_write_size(max_write_size
+                ? max_write_size
+                : HAM_DEFAULT_MAX_WRITE_SIZE);
 
     /*
      * if we do not yet have an allocator: create a new one
@@ -1177,6 +1422,8 @@ ham_env_create_db(ham_env_t *henv, ham_db_t *hdb,
      * the function handler will do the rest
      */
     st=env->_fun_create_db(env, db, dbname, flags, param);
+    if (Tracer *tracer=env->get_tracer())
+        tracer->trace_db(Tracer::OP_CREATE_DB, db, st);
     if (st)
         return (st);
 
@@ -1236,6 +1483,8 @@ ham_env_open_db(ham_env_t *henv, ham_db_t *hdb,
 
     /* the function handler will do the rest */
     st=env->_fun_open_db(env, db, dbname, flags, param);
+    if (Tracer *tracer=env->get_tracer())
+        tracer->trace_db(Tracer::OP_OPEN_DB, db, st);
     if (st)
         return (st);
 
@@ -1256,6 +1505,7 @@ ham_env_open_ex(ham_env_t *henv, const char *filename,
 {
     ham_status_t st;
     ham_u64_t cachesize=0;
+    ham_size_t max_write_size=0;
     std::string logdir;
     Environment *env=(Environment *)henv;
 
@@ -1290,12 +1540,15 @@ ham_env_open_ex(ham_env_t *henv, const char *filename,
 
     /* parse parameters */
     st=__check_create_parameters(env, 0, filename, &flags, param,
-            0, 0, &cachesize, 0, 0, 0, logdir, false);
+            0, 0, 0, 0, &cachesize, 0, 0, 0, &max_write_size, logdir, false);
     if (st)
         return (st);
 
     if (logdir.size())
         env->set_log_directory(logdir);
+    env->set_max_write_size(max_write_size
+                ? max_write_size
+                : HAM_DEFAULT_MAX_WRITE_SIZE);
 
     /*
      * if we do not yet have an allocator: create a new one
@@ -1581,6 +1834,280 @@ ham_env_get_parameters(ham_env_t *henv, ham_parameter_t *param)
     return (env->_fun_get_parameters(env, param));
 }
 
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_env_get_metrics(ham_env_t *henv, ham_env_metrics_t *metrics,
+            ham_u32_t flags)
+{
+    Environment *env=(Environment *)henv;
+    if (!env) {
+        ham_trace(("parameter 'env' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+    if (!metrics) {
+        ham_trace(("parameter 'metrics' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+
+#ifdef HAM_DISABLE_METRICS
+    (void)flags;
+    ham_trace(("hamsterdb was compiled without support for metrics"));
+    return (HAM_NOT_IMPLEMENTED);
+#else
+    ScopedLock lock(env->get_mutex());
+
+    Metrics *m=env->get_metrics();
+    if (!m) {
+        ham_trace(("Environment was not created/opened with "
+                   "HAM_ENABLE_METRICS"));
+        return (HAM_INV_PARAMETER);
+    }
+
+    *metrics=*m->get_data();
+    if (flags&HAM_METRICS_RESET)
+        m->reset();
+    return (0);
+#endif
+}
+
+HAM_EXPORT ham_u64_t HAM_CALLCONV
+ham_latency_histogram_get_percentile(const ham_latency_histogram_t *h,
+            double percentile)
+{
+    if (!h || !h->count)
+        return (0);
+    if (percentile>=100.0)
+        return (h->max_ns);
+
+    /* the rank of the requested sample, rounded up */
+    double rank=(double)h->count*percentile/100.0;
+    ham_u64_t threshold=(ham_u64_t)rank;
+    if (threshold<rank || threshold==0)
+        threshold++;
+
+    ham_u64_t sum=0;
+    for (int i=0; i<HAM_METRICS_HISTOGRAM_BUCKETS; i++) {
+        sum+=h->buckets[i];
+        if (sum>=threshold) {
+            ham_u64_t ns=Metrics::get_bucket_upper_bound(i);
+            if (ns>h->max_ns)
+                ns=h->max_ns;
+            if (ns<h->min_ns)
+                ns=h->min_ns;
+            return (ns);
+        }
+    }
+    return (h->max_ns);
+}
+
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_env_enable_tracing(ham_env_t *henv, const char *filename, ham_u32_t flags)
+{
+    Environment *env=(Environment *)henv;
+    if (!env) {
+        ham_trace(("parameter 'env' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+    if (!filename) {
+        ham_trace(("parameter 'filename' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+
+    ScopedLock lock(env->get_mutex());
+
+    if (!env->is_active()) {
+        ham_trace(("Environment was not initialized"));
+        return (HAM_NOT_INITIALIZED);
+    }
+    if (env->get_tracer()) {
+        ham_trace(("tracing is already enabled"));
+        return (HAM_ALREADY_INITIALIZED);
+    }
+
+    Tracer *tracer=new Tracer(env, flags);
+    ham_status_t st=tracer->open(filename);
+    if (st) {
+        delete tracer;
+        return (st);
+    }
+    env->set_tracer(tracer);
+    return (0);
+}
+
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_env_disable_tracing(ham_env_t *henv)
+{
+    Environment *env=(Environment *)henv;
+    if (!env) {
+        ham_trace(("parameter 'env' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+
+    ScopedLock lock(env->get_mutex());
+
+    Tracer *tracer=env->get_tracer();
+    if (!tracer) {
+        ham_trace(("tracing is not enabled"));
+        return (HAM_INV_PARAMETER);
+    }
+
+    ham_status_t st=tracer->close();
+    delete tracer;
+    env->set_tracer(0);
+    return (st);
+}
+
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_env_compact(ham_env_t *henv, ham_u32_t max_moves,
+                ham_compact_progress_t *progress)
+{
+    Environment *env=(Environment *)henv;
+    if (!env) {
+        ham_trace(("parameter 'env' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+    if (!max_moves) {
+        ham_trace(("parameter 'max_moves' must not be 0"));
+        return (HAM_INV_PARAMETER);
+    }
+
+    ScopedLock lock(env->get_mutex());
+
+    if (!env->is_active()) {
+        ham_trace(("Environment was not initialized"));
+        return (HAM_NOT_INITIALIZED);
+    }
+    if (!Compactor::is_supported(env)) {
+        ham_trace(("compaction is not supported for in-memory or "
+                    "remote Environments"));
+        return (HAM_NOT_IMPLEMENTED);
+    }
+    if (env->get_flags()&HAM_READ_ONLY) {
+        ham_trace(("cannot compact a read-only Environment"));
+        return (HAM_DB_READ_ONLY);
+    }
+
+    Compactor *compactor=env->get_compactor();
+    if (!compactor) {
+        compactor=new Compactor(env);
+        env->set_compactor(compactor);
+    }
+    return (compactor->run(max_moves, progress));
+}
+
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_env_backup(ham_env_t *henv, const char *path, ham_u32_t flags)
+{
+    Environment *env=(Environment *)henv;
+    if (!env) {
+        ham_trace(("parameter 'env' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+    if (!path) {
+        ham_trace(("parameter 'path' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+    if (flags&~HAM_BACKUP_INCREMENTAL) {
+        ham_trace(("unsupported flags"));
+        return (HAM_INV_PARAMETER);
+    }
+
+    ScopedLock lock(env->get_mutex());
+
+    if (!env->is_active()) {
+        ham_trace(("Environment was not initialized"));
+        return (HAM_NOT_INITIALIZED);
+    }
+    if (!Backup::is_supported(env)) {
+        ham_trace(("backups are not supported for in-memory or "
+                    "remote Environments"));
+        return (HAM_NOT_IMPLEMENTED);
+    }
+    if (env->get_filename()==path) {
+        ham_trace(("parameter 'path' must not be the Database file"));
+        return (HAM_INV_PARAMETER);
+    }
+
+    Backup *backup=env->get_backup();
+    if (!backup) {
+        backup=new Backup(env);
+        env->set_backup(backup);
+    }
+    if (backup->is_running()) {
+        ham_trace(("another backup is running"));
+        return (HAM_WOULD_BLOCK);
+    }
+
+    /* the file is copied without holding the lock */
+    ham_status_t st=backup->prepare(path, flags);
+    if (st)
+        return (st);
+
+    lock.unlock();
+    st=backup->run();
+    lock.lock();
+
+    return (backup->finish(st));
+}
+
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_enable_bloom_filter(ham_db_t *hdb, double false_positive_rate,
+            ham_size_t max_size)
+{
+    Database *db=(Database *)hdb;
+    if (!db) {
+        ham_trace(("parameter 'db' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+    if (!(false_positive_rate>0.0 && false_positive_rate<1.0)) {
+        ham_trace(("parameter 'false_positive_rate' must be between 0 "
+                    "and 1"));
+        return (db->set_error(HAM_INV_PARAMETER));
+    }
+    if (max_size && max_size<BloomFilter::BLOCK_SIZE) {
+        ham_trace(("parameter 'max_size' must be 0 or at least %u",
+                    (unsigned)BloomFilter::BLOCK_SIZE));
+        return (db->set_error(HAM_INV_PARAMETER));
+    }
+    if (!db->is_active() || !db->get_env()) {
+        ham_trace(("Database was not initialized"));
+        return (db->set_error(HAM_NOT_INITIALIZED));
+    }
+
+    ScopedLock lock(db->get_env()->get_mutex());
+
+    if (!BloomFilter::is_supported(db)) {
+        ham_trace(("bloom filters are not supported for record number "
+                    "or remote Databases"));
+        return (db->set_error(HAM_NOT_IMPLEMENTED));
+    }
+    return (db->set_error(BloomFilter::enable(db, false_positive_rate,
+                    max_size)));
+}
+
+HAM_EXPORT ham_status_t HAM_CALLCONV
+ham_disable_bloom_filter(ham_db_t *hdb)
+{
+    Database *db=(Database *)hdb;
+    if (!db) {
+        ham_trace(("parameter 'db' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+    if (!db->is_active() || !db->get_env()) {
+        ham_trace(("Database was not initialized"));
+        return (db->set_error(HAM_NOT_INITIALIZED));
+    }
+
+    ScopedLock lock(db->get_env()->get_mutex());
+
+    if (db->get_rt_flags()&HAM_READ_ONLY) {
+        ham_trace(("cannot remove the bloom filter of a read-only "
+                    "Database"));
+        return (db->set_error(HAM_DB_READ_ONLY));
+    }
+
+    return (db->set_error(BloomFilter::disable(db)));
+}
+
 ham_status_t HAM_CALLCONV
 ham_env_flush(ham_env_t *henv, ham_u32_t flags)
 {
@@ -1600,7 +2127,10 @@ ham_env_flush(ham_env_t *henv, ham_u32_t flags)
     }
 
     /* flush the Environment */
-    return (env->_fun_flush(env, flags));
+    ham_status_t st=env->_fun_flush(env, flags);
+    if (Tracer *tracer=env->get_tracer())
+        tracer->trace(Tracer::OP_FLUSH, 0, 0, 0, 0, 0, flags, st);
+    return (st);
 }
 
 ham_status_t HAM_CALLCONV
@@ -1681,6 +2211,30 @@ ham_env_close(ham_env_t *henv, ham_u32_t flags)
         return (HAM_INTERNAL_ERROR);
     }
 
+    /* stop tracing */
+    if (env->get_tracer()) {
+        st=env->get_tracer()->close();
+        delete env->get_tracer();
+        env->set_tracer(0);
+        if (st)
+            return (st);
+    }
+
+    /* discard the state of the online compaction */
+    if (env->get_compactor()) {
+        delete env->get_compactor();
+        env->set_compactor(0);
+    }
+
+    /* stop tracking the modified pages */
+    if (env->get_backup()) {
+        delete env->get_backup();
+        env->set_backup(0);
+    }
+
+    /* forget the slab pages with free slots */
+    env->get_slab_allocator().clear();
+
     /*
      * close the environment
      */
@@ -1747,9 +2301,11 @@ ham_open_ex(ham_db_t *hdb, const char *filename,
     ham_u16_t dam = 0;
     ham_env_t *env;
     ham_u32_t env_flags;
+    ham_size_t max_write_size=0;
     std::string logdir;
     ham_parameter_t env_param[8]={{0, 0}};
     ham_parameter_t db_param[8]={{0, 0}};
+    ham_size_t i=1;
     Database *db=(Database *)hdb;
 
     if (!db) {
@@ -1767,7 +2323,8 @@ ham_open_ex(ham_db_t *hdb, const char *filename,
 
     /* parse parameters */
     st=__check_create_parameters(db->get_env(), db, filename, &flags, param,
-            0, 0, &cachesize, &dbname, 0, &dam, logdir, false);
+            0, 0, 0, 0, &cachesize, &dbname, 0, &dam, &max_write_size,
+            logdir, false);
     if (st)
         return (st);
 
@@ -1780,8 +2337,13 @@ ham_open_ex(ham_db_t *hdb, const char *filename,
     env_param[0].name=HAM_PARAM_CACHESIZE;
     env_param[0].value=cachesize;
     if (logdir.size()) {
-        env_param[1].name=HAM_PARAM_LOG_DIRECTORY;
-        env_param[1].value=(ham_u64_t)logdir.c_str();
+        env_param[i].name=HAM_PARAM_LOG_DIRECTORY;
+        env_param[i].value=(ham_u64_t)logdir.c_str();
+        i++;
+    }
+    if (max_write_size) {
+        env_param[i].name=HAM_PARAM_MAX_WRITE_SIZE;
+        env_param[i].value=max_write_size;
     }
     env_flags=flags & ~(HAM_ENABLE_DUPLICATES|HAM_SORT_DUPLICATES);
 
@@ -1809,6 +2371,11 @@ ham_open_ex(ham_db_t *hdb, const char *filename,
             |HAM_ENABLE_TRANSACTIONS
             |HAM_ENABLE_RECOVERY
             |HAM_AUTO_RECOVERY
+            |HAM_ENABLE_METRICS
+            |HAM_ENABLE_CRC32
+            |HAM_ENABLE_FREELIST_EXTENTS
+            |HAM_ENABLE_SLAB_RECORDS
+            |HAM_ENABLE_DUPLICATE_TREES
             |DB_USE_MMAP
             |DB_ENV_IS_PRIVATE);
 
@@ -1862,13 +2429,17 @@ ham_create_ex(ham_db_t *hdb, const char *filename,
     ham_size_t pagesize = 0;
     ham_u16_t maxdbs = 0;
     ham_u16_t keysize = 0;
+    ham_u16_t keytype = HAM_TYPE_BINARY;
+    ham_u16_t inline_size = 0;
     ham_u16_t dbname = HAM_DEFAULT_DATABASE_NAME;
     ham_u64_t cachesize = 0;
     ham_env_t *env=0;
     ham_u32_t env_flags;
+    ham_size_t max_write_size = 0;
     std::string logdir;
     ham_parameter_t env_param[8]={{0, 0}};
     ham_parameter_t db_param[5]={{0, 0}};
+    ham_size_t i=3;
 
     if (!db) {
         ham_trace(("parameter 'db' must not be NULL"));
@@ -1887,8 +2458,8 @@ ham_create_ex(ham_db_t *hdb, const char *filename,
      * check (and modify) the parameters
      */
     st=__check_create_parameters(db->get_env(), db, filename, &flags, param,
-            &pagesize, &keysize, &cachesize, &dbname, &maxdbs, &dam,
-            logdir, true);
+            &pagesize, &keysize, &keytype, &inline_size, &cachesize, &dbname,
+            &maxdbs, &dam, &max_write_size, logdir, true);
     if (st)
         return (db->set_error(st));
 
@@ -1905,10 +2476,16 @@ ham_create_ex(ham_db_t *hdb, const char *filename,
     env_param[2].name=HAM_PARAM_MAX_ENV_DATABASES;
     env_param[2].value=maxdbs;
     if (logdir.size()) {
-        env_param[3].name=HAM_PARAM_LOG_DIRECTORY;
-        env_param[3].value=(ham_u64_t)logdir.c_str();
+        env_param[i].name=HAM_PARAM_LOG_DIRECTORY;
+        env_param[i].value=(ham_u64_t)logdir.c_str();
+        i++;
     }
-    env_flags=flags & ~(HAM_ENABLE_DUPLICATES|HAM_SORT_DUPLICATES);
+    if (max_write_size) {
+        env_param[i].name=HAM_PARAM_MAX_WRITE_SIZE;
+        env_param[i].value=max_write_size;
+    }
+    env_flags=flags & ~(HAM_ENABLE_DUPLICATES|HAM_SORT_DUPLICATES
+                |HAM_USE_HASH);
 
     /*
      * create a new Environment
@@ -1929,6 +2506,7 @@ ham_create_ex(ham_db_t *hdb, const char *filename,
      */
     flags &= ~(HAM_WRITE_THROUGH
             |HAM_IN_MEMORY_DB
+            |HAM_IN_MEMORY_ARENA
             |HAM_DISABLE_MMAP
             |HAM_DISABLE_FREELIST_FLUSH
             |HAM_CACHE_UNLIMITED
@@ -1937,6 +2515,11 @@ ham_create_ex(ham_db_t *hdb, const char *filename,
             |HAM_ENABLE_TRANSACTIONS
             |HAM_ENABLE_RECOVERY
             |HAM_AUTO_RECOVERY
+            |HAM_ENABLE_METRICS
+            |HAM_ENABLE_CRC32
+            |HAM_ENABLE_FREELIST_EXTENTS
+            |HAM_ENABLE_SLAB_RECORDS
+            |HAM_ENABLE_DUPLICATE_TREES
             |DB_USE_MMAP
             |DB_ENV_IS_PRIVATE);
 
@@ -1944,7 +2527,18 @@ ham_create_ex(ham_db_t *hdb, const char *filename,
     db_param[0].value=keysize;
     db_param[1].name=HAM_PARAM_DATA_ACCESS_MODE;
     db_param[1].value=dam;
-    db_param[2].name=0;
+    i=2;
+    /* the default key type is not sent, then remote servers which do
+     * not know the parameter still accept the Database */
+    if (keytype!=HAM_TYPE_BINARY) {
+        db_param[i].name=HAM_PARAM_KEY_TYPE;
+        db_param[i].value=keytype;
+        i++;
+    }
+    db_param[i].name=HAM_PARAM_RECORD_INLINE_SIZE;
+    db_param[i].value=inline_size;
+    i++;
+    db_param[i].name=0;
 
     /* now create the Database */
     st=ham_env_create_db(env, (ham_db_t *)db,
@@ -2039,7 +2633,11 @@ ham_set_compare_func(ham_db_t *hdb, ham_compare_func_t foo)
         lock=ScopedLock(db->get_env()->get_mutex());
 
     db->set_error(0);
-    db->set_compare_func(foo ? foo : db_default_compare);
+    /* typed Databases restore the comparator of the key type */
+    if (!foo && db->get_key_type()!=HAM_TYPE_BINARY)
+        db->set_key_type(db->get_key_type());
+    else
+        db->set_compare_func(foo ? foo : db_default_compare);
     return (db->set_error(HAM_SUCCESS));
 }
 
@@ -2112,6 +2710,18 @@ __aes_close_cb(ham_env_t *henv, ham_file_filter_t *filter)
         alloc->free(filter);
     }
 }
+
+static void
+__cipher_close_cb(ham_env_t *henv, ham_file_filter_t *filter)
+{
+    Environment *env=(Environment *)henv;
+
+    if (filter) {
+        /* the destructor wipes the keys */
+        delete (PageCipher *)filter->userdata;
+        env->get_allocator()->free(filter);
+    }
+}
 #endif /* !HAM_DISABLE_ENCRYPTION */
 
 ham_status_t HAM_CALLCONV
@@ -2130,6 +2740,10 @@ ham_env_enable_encryption(ham_env_t *henv, ham_u8_t key[16], ham_u32_t flags)
         ham_trace(("parameter 'env' must not be NULL"));
         return (HAM_INV_PARAMETER);
     }
+    if (flags&~HAM_ENCRYPTION_XTS) {
+        ham_trace(("unknown flag in 'flags'"));
+        return (HAM_INV_PARAMETER);
+    }
 
     {
     ScopedLock lock(env->get_mutex());
@@ -2160,7 +2774,8 @@ ham_env_enable_encryption(ham_env_t *henv, ham_u8_t key[16], ham_u32_t flags)
      */
     filter=env->get_file_filter();
     while (filter) {
-        if (filter->before_write_cb==__aes_before_write_cb)
+        if (filter->before_write_cb==__aes_before_write_cb
+                || (filter->_flags&PageCipher::FILTER_FLAG))
             return (HAM_ALREADY_INITIALIZED);
         filter=filter->_next;
     }
@@ -2170,10 +2785,22 @@ ham_env_enable_encryption(ham_env_t *henv, ham_u8_t key[16], ham_u32_t flags)
         return (HAM_OUT_OF_MEMORY);
     memset(filter, 0, sizeof(*filter));
 
-    filter->userdata=alloc->alloc(256);
-    if (!filter->userdata) {
-        alloc->free(filter);
-        return (HAM_OUT_OF_MEMORY);
+    if (flags&HAM_ENCRYPTION_XTS) {
+        /* the Device calls the PageCipher directly */
+        filter->userdata=new PageCipher(key, env->get_pagesize());
+        filter->_flags=PageCipher::FILTER_FLAG;
+        filter->close_cb=__cipher_close_cb;
+    }
+    else {
+        filter->userdata=alloc->alloc(256);
+        if (!filter->userdata) {
+            alloc->free(filter);
+            return (HAM_OUT_OF_MEMORY);
+        }
+        aes_expand_key(key, (ham_u8_t *)filter->userdata);
+        filter->before_write_cb=__aes_before_write_cb;
+        filter->after_read_cb=__aes_after_read_cb;
+        filter->close_cb=__aes_close_cb;
     }
 
     /*
@@ -2189,11 +2816,6 @@ ham_env_enable_encryption(ham_env_t *henv, ham_u8_t key[16], ham_u32_t flags)
         db=0;
     }
 
-    aes_expand_key(key, (ham_u8_t *)filter->userdata);
-    filter->before_write_cb=__aes_before_write_cb;
-    filter->after_read_cb=__aes_after_read_cb;
-    filter->close_cb=__aes_close_cb;
-
     /*
      * if the database file already exists (i.e. if it's larger than
      * one page): try to read the header of the next page and decrypt
@@ -2204,12 +2826,20 @@ ham_env_enable_encryption(ham_env_t *henv, ham_u8_t key[16], ham_u32_t flags)
 
         st=device->read(env->get_pagesize(), buffer, sizeof(buffer));
         if (st==0) {
-            st=__aes_after_read_cb((ham_env_t *)env, filter,
+            if (filter->_flags&PageCipher::FILTER_FLAG)
+                ((PageCipher *)filter->userdata)->decrypt(env->get_pagesize(),
+                                buffer, sizeof(buffer));
+            else
+                st=__aes_after_read_cb((ham_env_t *)env, filter,
                                 buffer, sizeof(buffer));
             if (st)
                 goto bail;
+            /* the reserved fields are zeroed, unless they store a
+             * checksum */
             ph=(page_header_t *)buffer;
-            if (ph->_reserved1 || ph->_reserved2) {
+            if (ham_db2h32(ph->_reserved2)==(ham_u32_t)Page::CHECKSUM_MAGIC)
+                ;
+            else if (ph->_reserved1 || ph->_reserved2) {
                 st=HAM_ACCESS_DENIED;
                 goto bail;
             }
@@ -2220,7 +2850,7 @@ ham_env_enable_encryption(ham_env_t *henv, ham_u8_t key[16], ham_u32_t flags)
 
 bail:
     if (st)
-        __aes_close_cb((ham_env_t *)env, filter);
+        filter->close_cb((ham_env_t *)env, filter);
 
     } // ScopedLock
 
@@ -2395,6 +3025,18 @@ ham_enable_compression(ham_db_t *hdb, ham_u32_t level, ham_u32_t flags)
         ham_trace(("parameter 'level' must be lower than or equal to 9"));
         return (db->set_error(HAM_INV_PARAMETER));
     }
+
+    /* page compression is performed by the Device */
+    if (flags&HAM_COMPRESS_PAGES) {
+        if (env->get_flags()&HAM_IN_MEMORY_DB) {
+            ham_trace(("HAM_COMPRESS_PAGES is not allowed for In-Memory "
+                    "Databases"));
+            return (db->set_error(HAM_INV_PARAMETER));
+        }
+        db->set_page_compression(level ? level : 1);
+        return (db->set_error(0));
+    }
+
     if (!level)
         level=6;
 
@@ -2445,7 +3087,8 @@ ham_find(ham_db_t *hdb, ham_txn_t *htxn, ham_key_t *key,
         return (db->set_error(HAM_INV_PARAMETER));
     }
 
-    ScopedLock lock(env->get_mutex());
+    ScopedLock lock;
+    Metrics::lock(env, lock);
 
     if (!key) {
         ham_trace(("parameter 'key' must not be NULL"));
@@ -2493,8 +3136,14 @@ ham_find(ham_db_t *hdb, ham_txn_t *htxn, ham_key_t *key,
 
     if (!__prepare_key(key) || !__prepare_record(record))
         return (db->set_error(HAM_INV_PARAMETER));
+    if (!__check_key_type(db, key))
+        return (db->set_error(HAM_INV_KEYSIZE));
 
-    return (db->set_error((*db)()->find(txn, key, record, flags)));
+    OperationTimer timer(env, HAM_METRICS_OP_FIND);
+    ham_status_t st=(*db)()->find(txn, key, record, flags);
+    if (Tracer *tracer=env->get_tracer())
+        tracer->trace(Tracer::OP_FIND, db, txn, 0, key, record, flags, st);
+    return (db->set_error(st));
 }
 
 int HAM_CALLCONV
@@ -2529,7 +3178,7 @@ ham_insert(ham_db_t *hdb, ham_txn_t *htxn, ham_key_t *key,
 
     ScopedLock lock;
     if (!(flags&HAM_DONT_LOCK))
-        lock=ScopedLock(env->get_mutex());
+        Metrics::lock(env, lock);
 
     if (!key) {
         ham_trace(("parameter 'key' must not be NULL"));
@@ -2604,6 +3253,8 @@ ham_insert(ham_db_t *hdb, ham_txn_t *htxn, ham_key_t *key,
 
     if (!__prepare_key(key) || !__prepare_record(record))
         return (db->set_error(HAM_INV_PARAMETER));
+    if (!__check_key_type(db, key))
+        return (db->set_error(HAM_INV_KEYSIZE));
 
     /* allocate temp. storage for a recno key */
     if (db->get_rt_flags()&HAM_RECORD_NUMBER) {
@@ -2630,7 +3281,11 @@ ham_insert(ham_db_t *hdb, ham_txn_t *htxn, ham_key_t *key,
         }
     }
 
-    return (db->set_error((*db)()->insert(txn, key, record, flags)));
+    OperationTimer timer(env, HAM_METRICS_OP_INSERT);
+    ham_status_t st=(*db)()->insert(txn, key, record, flags);
+    if (Tracer *tracer=env->get_tracer())
+        tracer->trace(Tracer::OP_INSERT, db, txn, 0, key, record, flags, st);
+    return (db->set_error(st));
 }
 
 ham_status_t HAM_CALLCONV
@@ -2653,7 +3308,7 @@ ham_erase(ham_db_t *hdb, ham_txn_t *htxn, ham_key_t *key, ham_u32_t flags)
 
     ScopedLock lock;
     if (!(flags&HAM_DONT_LOCK))
-        lock=ScopedLock(env->get_mutex());
+        Metrics::lock(env, lock);
 
     if (!key) {
         ham_trace(("parameter 'key' must not be NULL"));
@@ -2672,8 +3327,55 @@ ham_erase(ham_db_t *hdb, ham_txn_t *htxn, ham_key_t *key, ham_u32_t flags)
 
     if (!__prepare_key(key))
         return (db->set_error(HAM_INV_PARAMETER));
+    if (!__check_key_type(db, key))
+        return (db->set_error(HAM_INV_KEYSIZE));
+
+    OperationTimer timer(env, HAM_METRICS_OP_ERASE);
+    ham_status_t st=(*db)()->erase(txn, key, flags);
+    if (Tracer *tracer=env->get_tracer())
+        tracer->trace(Tracer::OP_ERASE, db, txn, 0, key, 0, flags, st);
+    return (db->set_error(st));
+}
+
+ham_status_t HAM_CALLCONV
+ham_erase_range(ham_db_t *hdb, ham_txn_t *htxn, ham_key_t *begin,
+            ham_key_t *end, ham_u32_t flags)
+{
+    Database *db=(Database *)hdb;
+    Transaction *txn=(Transaction *)htxn;
+    Environment *env;
+
+    if (!db) {
+        ham_trace(("parameter 'db' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+    env=db->get_env();
+    if (!env) {
+        ham_trace(("parameter 'db' must be linked to a valid (implicit "
+                   "or explicit) environment"));
+        return (db->set_error(HAM_INV_PARAMETER));
+    }
+
+    ScopedLock lock;
+    if (!(flags&HAM_DONT_LOCK))
+        Metrics::lock(env, lock);
+
+    if (flags&~HAM_DONT_LOCK) {
+        ham_trace(("unknown flags; set to 0"));
+        return (db->set_error(HAM_INV_PARAMETER));
+    }
+    if ((begin && !__prepare_key(begin)) || (end && !__prepare_key(end)))
+        return (db->set_error(HAM_INV_PARAMETER));
+    if ((begin && !__check_key_type(db, begin))
+            || (end && !__check_key_type(db, end)))
+        return (db->set_error(HAM_INV_KEYSIZE));
 
-    return (db->set_error((*db)()->erase(txn, key, flags)));
+    OperationTimer timer(env, HAM_METRICS_OP_ERASE);
+    ham_status_t st=(*db)()->erase_range(txn, begin, end,
+                    flags&~HAM_DONT_LOCK);
+    if (Tracer *tracer=env->get_tracer())
+        tracer->trace_erase_range(db, txn, begin, end, flags, st);
+    return (db->set_error(st));
 }
 
 ham_status_t HAM_CALLCONV
@@ -2689,7 +3391,31 @@ ham_check_integrity(ham_db_t *hdb, ham_txn_t *htxn)
 
     ScopedLock lock(db->get_env()->get_mutex());
 
-    return (db->set_error((*db)()->check_integrity(txn)));
+    if (!BtreeVerifier::is_supported(db))
+        return (db->set_error((*db)()->check_integrity(txn)));
+
+    /*
+     * the file is verified without holding the lock; if the verification
+     * fails because the file was modified in the meantime then it's
+     * repeated while holding the lock
+     */
+    BtreeVerifier verifier(db);
+    ham_status_t st=verifier.prepare();
+    if (st)
+        return (db->set_error(st));
+
+    lock.unlock();
+    st=verifier.run();
+    if (st) {
+        lock.lock();
+        if (verifier.is_stale()) {
+            st=verifier.prepare();
+            if (!st)
+                st=verifier.run();
+        }
+    }
+
+    return (db->set_error(st));
 }
 
 ham_status_t HAM_CALLCONV
@@ -2789,6 +3515,9 @@ ham_close(ham_db_t *hdb, ham_u32_t flags)
     if (!(flags&HAM_DONT_LOCK) && !(db->get_rt_flags(true)&DB_ENV_IS_PRIVATE))
         lock=ScopedLock(env->get_mutex());
 
+    if (Tracer *tracer=env->get_tracer())
+        tracer->trace_db(Tracer::OP_CLOSE_DB, db, 0);
+
     /* check if this database is modified by an active transaction */
     txn_optree_t *tree=db->get_optree();
     if (tree && !(db->get_rt_flags(true)&DB_ENV_IS_PRIVATE)) {
@@ -2928,6 +3657,9 @@ ham_cursor_create(ham_db_t *hdb, ham_txn_t *htxn, ham_u32_t flags,
         (*cursor)->set_txn(txn);
     }
 
+    if (Tracer *tracer=env->get_tracer())
+        tracer->trace_cursor_create(*cursor, 0, 0);
+
     return (0);
 }
 
@@ -2960,6 +3692,9 @@ ham_cursor_clone(ham_cursor_t *hsrc, ham_cursor_t **hdest)
 
     db->clone_cursor(src, dest);
 
+    if (Tracer *tracer=db->get_env()->get_tracer())
+        tracer->trace_cursor_create(*dest, src, 0);
+
     return (db->set_error(0));
 }
 
@@ -3006,7 +3741,11 @@ ham_cursor_overwrite(ham_cursor_t *hcursor, ham_record_t *record,
         return (db->set_error(HAM_INV_PARAMETER));
     }
 
-    return (db->set_error((*db)()->cursor_overwrite(cursor, record, flags)));
+    ham_status_t st=(*db)()->cursor_overwrite(cursor, record, flags);
+    if (Tracer *tracer=db->get_env()->get_tracer())
+        tracer->trace(Tracer::OP_CURSOR_OVERWRITE, db, cursor->get_txn(),
+                cursor, 0, record, flags, st);
+    return (db->set_error(st));
 }
 
 ham_status_t HAM_CALLCONV
@@ -3031,7 +3770,8 @@ ham_cursor_move(ham_cursor_t *hcursor, ham_key_t *key,
         return HAM_INV_PARAMETER;
     }
 
-    ScopedLock lock(db->get_env()->get_mutex());
+    ScopedLock lock;
+    Metrics::lock(db->get_env(), lock);
 
     if ((flags&HAM_ONLY_DUPLICATES) && (flags&HAM_SKIP_DUPLICATES)) {
         ham_trace(("combination of HAM_ONLY_DUPLICATES and "
@@ -3064,7 +3804,118 @@ ham_cursor_move(ham_cursor_t *hcursor, ham_key_t *key,
     if (record && !__prepare_record(record))
         return (db->set_error(HAM_INV_PARAMETER));
 
+    OperationTimer timer(env, HAM_METRICS_OP_CURSOR_MOVE);
     st=(*db)()->cursor_move(cursor, key, record, flags);
+    if (Tracer *tracer=env->get_tracer())
+        tracer->trace(Tracer::OP_CURSOR_MOVE, db, cursor->get_txn(),
+                cursor, key, record, flags, st);
+
+    /* make sure that the changeset is empty */
+    ham_assert(env->get_changeset().is_empty(), (""));
+
+    return (db->set_error(st));
+}
+
+ham_status_t HAM_CALLCONV
+ham_cursor_move_many(ham_cursor_t *hcursor, ham_key_t *keys,
+                ham_record_t *records, ham_u32_t *count, ham_u32_t flags)
+{
+    Database *db;
+    Environment *env;
+    ham_status_t st;
+    ham_u32_t i;
+
+    if (!hcursor) {
+        ham_trace(("parameter 'cursor' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+    if (!count) {
+        ham_trace(("parameter 'count' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+
+    Cursor *cursor=(Cursor *)hcursor;
+
+    db=cursor->get_db();
+
+    if (!db || !db->get_env()) {
+        ham_trace(("parameter 'cursor' must be linked to a valid database"));
+        return HAM_INV_PARAMETER;
+    }
+
+    ScopedLock lock;
+    Metrics::lock(db->get_env(), lock);
+
+    if (*count==0) {
+        ham_trace(("parameter '*count' must not be 0"));
+        return (db->set_error(HAM_INV_PARAMETER));
+    }
+    switch (flags&(HAM_CURSOR_FIRST|HAM_CURSOR_LAST
+                |HAM_CURSOR_NEXT|HAM_CURSOR_PREVIOUS)) {
+      case HAM_CURSOR_FIRST:
+      case HAM_CURSOR_LAST:
+      case HAM_CURSOR_NEXT:
+      case HAM_CURSOR_PREVIOUS:
+        break;
+      default:
+        ham_trace(("exactly one of HAM_CURSOR_FIRST, HAM_CURSOR_LAST, "
+                    "HAM_CURSOR_NEXT or HAM_CURSOR_PREVIOUS is required"));
+        return (db->set_error(HAM_INV_PARAMETER));
+    }
+    if ((flags&HAM_ONLY_DUPLICATES) && (flags&HAM_SKIP_DUPLICATES)) {
+        ham_trace(("combination of HAM_ONLY_DUPLICATES and "
+                    "HAM_SKIP_DUPLICATES not allowed"));
+        return (db->set_error(HAM_INV_PARAMETER));
+    }
+    if (flags&HAM_PARTIAL) {
+        ham_trace(("flag HAM_PARTIAL is not allowed in "
+                    "ham_cursor_move_many"));
+        return (db->set_error(HAM_INV_PARAMETER));
+    }
+
+    env=db->get_env();
+
+    if ((flags&HAM_DIRECT_ACCESS)
+            && !(env->get_flags()&HAM_IN_MEMORY_DB)) {
+        ham_trace(("flag HAM_DIRECT_ACCESS is only allowed in "
+                   "In-Memory Databases"));
+        return (db->set_error(HAM_INV_PARAMETER));
+    }
+    if ((flags&HAM_DIRECT_ACCESS)
+            && (env->get_flags()&HAM_ENABLE_TRANSACTIONS)) {
+        ham_trace(("flag HAM_DIRECT_ACCESS is not allowed in "
+                    "combination with Transactions"));
+        return (db->set_error(HAM_INV_PARAMETER));
+    }
+
+    for (i=0; i<*count; i++) {
+        if (keys && !__prepare_key(&keys[i]))
+            return (db->set_error(HAM_INV_PARAMETER));
+        if (records && !__prepare_record(&records[i]))
+            return (db->set_error(HAM_INV_PARAMETER));
+    }
+
+    OperationTimer timer(env, HAM_METRICS_OP_CURSOR_MOVE);
+    st=(*db)()->cursor_move_many(cursor, keys, records, count, flags);
+
+    /* every item is traced like a single ham_cursor_move */
+    if (Tracer *tracer=env->get_tracer()) {
+        for (i=0; i<*count; i++) {
+            ham_u32_t step=flags;
+            if (i>0)
+                step=(flags&~(HAM_CURSOR_FIRST|HAM_CURSOR_LAST
+                            |HAM_CURSOR_NEXT|HAM_CURSOR_PREVIOUS))
+                        |((flags&(HAM_CURSOR_FIRST|HAM_CURSOR_NEXT))
+                            ? HAM_CURSOR_NEXT
+                            : HAM_CURSOR_PREVIOUS);
+            tracer->trace(Tracer::OP_CURSOR_MOVE, db, cursor->get_txn(),
+                    cursor, keys ? &keys[i] : 0, records ? &records[i] : 0,
+                    step, 0);
+        }
+        if (st)
+            tracer->trace(Tracer::OP_CURSOR_MOVE, db, cursor->get_txn(),
+                    cursor, 0, 0, flags, st);
+    }
 
     /* make sure that the changeset is empty */
     ham_assert(env->get_changeset().is_empty(), (""));
@@ -3101,7 +3952,7 @@ ham_cursor_find_ex(ham_cursor_t *hcursor, ham_key_t *key,
     env=db->get_env();
     ScopedLock lock;
     if (!(flags&HAM_DONT_LOCK))
-        lock=ScopedLock(env->get_mutex());
+        Metrics::lock(env, lock);
 
     if (!key) {
         ham_trace(("parameter 'key' must not be NULL"));
@@ -3145,8 +3996,15 @@ ham_cursor_find_ex(ham_cursor_t *hcursor, ham_key_t *key,
         return (db->set_error(HAM_INV_PARAMETER));
     if (record &&  !__prepare_record(record))
         return (db->set_error(HAM_INV_PARAMETER));
+    if (key && !__check_key_type(db, key))
+        return (db->set_error(HAM_INV_KEYSIZE));
 
-    return (db->set_error((*db)()->cursor_find(cursor, key, record, flags)));
+    OperationTimer timer(env, HAM_METRICS_OP_FIND);
+    ham_status_t st=(*db)()->cursor_find(cursor, key, record, flags);
+    if (Tracer *tracer=env->get_tracer())
+        tracer->trace(Tracer::OP_CURSOR_FIND, db, cursor->get_txn(),
+                cursor, key, record, flags, st);
+    return (db->set_error(st));
 }
 
 ham_status_t HAM_CALLCONV
@@ -3163,7 +4021,8 @@ ham_cursor_insert(ham_cursor_t *hcursor, ham_key_t *key,
     Cursor *cursor=(Cursor *)hcursor;
 
     db=cursor->get_db();
-    ScopedLock lock(db->get_env()->get_mutex());
+    ScopedLock lock;
+    Metrics::lock(db->get_env(), lock);
 
     if (!key) {
         ham_trace(("parameter 'key' must not be NULL"));
@@ -3180,6 +4039,8 @@ ham_cursor_insert(ham_cursor_t *hcursor, ham_key_t *key,
     }
     if (!__prepare_key(key) || !__prepare_record(record))
         return (db->set_error(HAM_INV_PARAMETER));
+    if (!__check_key_type(db, key))
+        return (db->set_error(HAM_INV_KEYSIZE));
 
     if (!db || !db->get_env()) {
         ham_trace(("parameter 'cursor' must be linked to a valid database"));
@@ -3267,7 +4128,12 @@ ham_cursor_insert(ham_cursor_t *hcursor, ham_key_t *key,
         }
     }
 
-    return (db->set_error((*db)()->cursor_insert(cursor, key, record, flags)));
+    OperationTimer timer(db->get_env(), HAM_METRICS_OP_INSERT);
+    ham_status_t st=(*db)()->cursor_insert(cursor, key, record, flags);
+    if (Tracer *tracer=db->get_env()->get_tracer())
+        tracer->trace(Tracer::OP_CURSOR_INSERT, db, cursor->get_txn(),
+                cursor, key, record, flags, st);
+    return (db->set_error(st));
 }
 
 ham_status_t HAM_CALLCONV
@@ -3289,7 +4155,8 @@ ham_cursor_erase(ham_cursor_t *hcursor, ham_u32_t flags)
         return HAM_INV_PARAMETER;
     }
 
-    ScopedLock lock(db->get_env()->get_mutex());
+    ScopedLock lock;
+    Metrics::lock(db->get_env(), lock);
 
     if (db->get_rt_flags()&HAM_READ_ONLY) {
         ham_trace(("cannot erase from a read-only database"));
@@ -3306,7 +4173,12 @@ ham_cursor_erase(ham_cursor_t *hcursor, ham_u32_t flags)
         return (db->set_error(HAM_INV_PARAMETER));
     }
 
-    return (db->set_error((*db)()->cursor_erase(cursor, flags)));
+    OperationTimer timer(db->get_env(), HAM_METRICS_OP_ERASE);
+    ham_status_t st=(*db)()->cursor_erase(cursor, flags);
+    if (Tracer *tracer=db->get_env()->get_tracer())
+        tracer->trace(Tracer::OP_CURSOR_ERASE, db, cursor->get_txn(),
+                cursor, 0, 0, flags, st);
+    return (db->set_error(st));
 }
 
 ham_status_t HAM_CALLCONV
@@ -3392,11 +4264,168 @@ ham_cursor_close(ham_cursor_t *hcursor)
 
     ScopedLock lock(db->get_env()->get_mutex());
 
+    if (Tracer *tracer=db->get_env()->get_tracer())
+        tracer->trace_cursor_close(cursor);
+
     db->close_cursor(cursor);
 
     return (0);
 }
 
+ham_status_t HAM_CALLCONV
+ham_record_stream_open(ham_cursor_t *hcursor, ham_u32_t flags,
+            ham_record_stream_t **hstream)
+{
+    Database *db;
+    Environment *env;
+    ham_status_t st;
+
+    if (!hcursor) {
+        ham_trace(("parameter 'cursor' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+    if (!hstream) {
+        ham_trace(("parameter 'stream' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+
+    *hstream=0;
+
+    Cursor *cursor=(Cursor *)hcursor;
+
+    db=cursor->get_db();
+    if (!db || !db->get_env()) {
+        ham_trace(("parameter 'cursor' must be linked to a valid database"));
+        return (HAM_INV_PARAMETER);
+    }
+
+    env=db->get_env();
+
+    ScopedLock lock(env->get_mutex());
+
+    if (flags&~HAM_RECORD_STREAM_APPEND) {
+        ham_trace(("unknown flag"));
+        return (db->set_error(HAM_INV_PARAMETER));
+    }
+    if (env->get_flags()&DB_IS_REMOTE) {
+        ham_trace(("record streams are not supported by remote databases"));
+        return (db->set_error(HAM_NOT_IMPLEMENTED));
+    }
+    if (db->get_rt_flags()&(HAM_ENABLE_TRANSACTIONS|HAM_USE_HASH)) {
+        ham_trace(("record streams are not allowed in combination with "
+                    "HAM_ENABLE_TRANSACTIONS or HAM_USE_HASH"));
+        return (db->set_error(HAM_INV_PARAMETER));
+    }
+    if (db->get_record_filter()) {
+        ham_trace(("record streams are not allowed in combination with "
+                    "record filters"));
+        return (db->set_error(HAM_INV_PARAMETER));
+    }
+
+    RecordStream *stream=new RecordStream(cursor, flags);
+    if (!stream)
+        return (db->set_error(HAM_OUT_OF_MEMORY));
+
+    st=stream->open();
+    env->get_changeset().clear();
+    if (st) {
+        delete stream;
+        stream=0;
+    }
+    if (Tracer *tracer=env->get_tracer())
+        tracer->trace_stream_open(stream, cursor, flags, st);
+    if (st)
+        return (db->set_error(st));
+
+    *hstream=(ham_record_stream_t *)stream;
+    return (db->set_error(0));
+}
+
+ham_status_t HAM_CALLCONV
+ham_record_stream_read(ham_record_stream_t *hstream, void *data,
+            ham_size_t size, ham_size_t *bytes_read)
+{
+    if (!hstream) {
+        ham_trace(("parameter 'stream' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+    if (!data) {
+        ham_trace(("parameter 'data' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+    if (!bytes_read) {
+        ham_trace(("parameter 'bytes_read' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+
+    RecordStream *stream=(RecordStream *)hstream;
+    if (!stream->get_cursor()) {
+        ham_trace(("the Cursor of the stream was closed"));
+        return (HAM_CURSOR_IS_NIL);
+    }
+    Database *db=stream->get_cursor()->get_db();
+
+    ScopedLock lock(db->get_env()->get_mutex());
+
+    return (db->set_error(stream->read(data, size, bytes_read)));
+}
+
+ham_status_t HAM_CALLCONV
+ham_record_stream_write(ham_record_stream_t *hstream, const void *data,
+            ham_size_t size)
+{
+    if (!hstream) {
+        ham_trace(("parameter 'stream' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+    if (!data) {
+        ham_trace(("parameter 'data' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+
+    RecordStream *stream=(RecordStream *)hstream;
+    if (!stream->get_cursor()) {
+        ham_trace(("the Cursor of the stream was closed"));
+        return (HAM_CURSOR_IS_NIL);
+    }
+    Database *db=stream->get_cursor()->get_db();
+
+    ScopedLock lock(db->get_env()->get_mutex());
+
+    if (db->get_rt_flags()&HAM_READ_ONLY) {
+        ham_trace(("cannot write to a read-only database"));
+        return (db->set_error(HAM_DB_READ_ONLY));
+    }
+
+    ham_status_t st=stream->write(data, size);
+    if (Tracer *tracer=db->get_env()->get_tracer())
+        tracer->trace_stream_write(stream, data, size, st);
+    return (db->set_error(st));
+}
+
+ham_status_t HAM_CALLCONV
+ham_record_stream_close(ham_record_stream_t *hstream)
+{
+    if (!hstream) {
+        ham_trace(("parameter 'stream' must not be NULL"));
+        return (HAM_INV_PARAMETER);
+    }
+
+    RecordStream *stream=(RecordStream *)hstream;
+
+    /* the stream is removed from the list of its Cursor */
+    ScopedLock lock;
+    if (stream->get_cursor()) {
+        Environment *env=stream->get_cursor()->get_db()->get_env();
+        lock=ScopedLock(env->get_mutex());
+        if (Tracer *tracer=env->get_tracer())
+            tracer->trace_stream_close(stream);
+    }
+
+    delete stream;
+    return (0);
+}
+
 ham_status_t HAM_CALLCONV
 ham_add_record_filter(ham_db_t *hdb, ham_record_filter_t *filter)
 {
@@ -0,0 +1,1283 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief implementation of hashdb.h
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "blob.h"
+#include "btree.h"
+#include "btree_cursor.h"
+#include "cursor.h"
+#include "db.h"
+#include "env.h"
+#include "error.h"
+#include "extkeys.h"
+#include "freelist.h"
+#include "hashdb.h"
+#include "mem.h"
+#include "page.h"
+
+
+/** the number of directory entries per directory page */
+static ham_size_t
+__entries_per_dir(Database *db)
+{
+    return ((db->get_env()->get_pagesize()-Page::sizeof_persistent_header)
+                /sizeof(ham_offset_t));
+}
+
+/** the number of keys per bucket page */
+static ham_size_t
+__calc_maxkeys(ham_size_t pagesize, ham_u16_t keysize)
+{
+    ham_size_t p=pagesize;
+
+    p-=Page::sizeof_persistent_header;
+    p-=OFFSETOF(hash_bucket_t, _entries);
+
+    return (p/(keysize+db_get_int_key_header_size()));
+}
+
+ham_u64_t
+HashBackend::hash(const ham_u8_t *data, ham_size_t size)
+{
+    /* FNV-1a, followed by a finalizer; the buckets are selected with the
+     * lowest bits, therefore all bits of the key have to reach them */
+    ham_u64_t h=0xcbf29ce484222325ull;
+    for (ham_size_t i=0; i<size; i++) {
+        h^=data[i];
+        h*=0x100000001b3ull;
+    }
+    h^=h>>30;
+    h*=0xbf58476d1ce4e5b9ull;
+    h^=h>>27;
+    h*=0x94d049bb133111ebull;
+    h^=h>>31;
+    return (h);
+}
+
+ham_u64_t
+HashBackend::get_bucket(ham_u64_t h)
+{
+    ham_u64_t b=h&(((ham_u64_t)1<<m_level)-1);
+
+    /* buckets before the split pointer were already split */
+    if (b<m_split)
+        b=h&(((ham_u64_t)2<<m_level)-1);
+    return (b);
+}
+
+ham_u64_t
+HashBackend::get_max_buckets()
+{
+    Database *db=get_db();
+    ham_size_t payload=db->get_env()->get_pagesize()
+                -Page::sizeof_persistent_header;
+
+    return ((ham_u64_t)((payload-OFFSETOF(hash_root_t, _dirs))
+                /sizeof(ham_offset_t))*__entries_per_dir(db));
+}
+
+ham_status_t
+HashBackend::hash_entry(btree_key_t *entry, ham_u64_t *h)
+{
+    ham_status_t st;
+    ham_key_t key;
+    Database *db=get_db();
+
+    if (!(key_get_flags(entry)&KEY_IS_EXTENDED)) {
+        *h=hash(key_get_key(entry), key_get_size(entry));
+        return (0);
+    }
+
+    memset(&key, 0, sizeof(key));
+    st=db->get_extended_key(key_get_key(entry), key_get_size(entry),
+                key_get_flags(entry), &key);
+    if (st)
+        return (st);
+    *h=hash((ham_u8_t *)key.data, key_get_size(entry));
+    db->get_env()->get_allocator()->free(key.data);
+    return (0);
+}
+
+ham_status_t
+HashBackend::compare(btree_key_t *entry, ham_key_t *key, bool *equal)
+{
+    ham_status_t st;
+    ham_key_t full;
+    Database *db=get_db();
+
+    *equal=false;
+    if (key_get_size(entry)!=key->size)
+        return (0);
+
+    if (!(key_get_flags(entry)&KEY_IS_EXTENDED)) {
+        *equal=(key->size==0
+                || 0==memcmp(key_get_key(entry), key->data, key->size));
+        return (0);
+    }
+
+    /* compare the front part of the key before the blob is loaded */
+    if (memcmp(key_get_key(entry), key->data,
+                db_get_keysize(db)-sizeof(ham_offset_t)))
+        return (0);
+
+    memset(&full, 0, sizeof(full));
+    st=db->get_extended_key(key_get_key(entry), key_get_size(entry),
+                key_get_flags(entry), &full);
+    if (st)
+        return (st);
+    *equal=(0==memcmp(full.data, key->data, key->size));
+    db->get_env()->get_allocator()->free(full.data);
+    return (0);
+}
+
+ham_status_t
+HashBackend::alloc_bucket(Page **ppage)
+{
+    ham_status_t st;
+
+    st=db_alloc_page(ppage, get_db(), Page::TYPE_H_BUCKET, 0);
+    if (st)
+        return (st);
+    memset((*ppage)->get_payload(), 0, OFFSETOF(hash_bucket_t, _entries));
+    return (0);
+}
+
+ham_status_t
+HashBackend::add_bucket(ham_offset_t address)
+{
+    ham_status_t st;
+    Page *root, *dir;
+    Database *db=get_db();
+    ham_size_t per_dir=__entries_per_dir(db);
+    ham_u64_t bucket=m_buckets.size();
+    ham_size_t d=(ham_size_t)(bucket/per_dir);
+
+    /* the last directory page is full: allocate a new one */
+    if (d==m_dirs.size()) {
+        hash_root_t *r;
+
+        st=db_fetch_page(&root, db, m_root, 0);
+        if (st)
+            return (st);
+        st=db_alloc_page(&dir, db, Page::TYPE_H_DIRECTORY, 0);
+        if (st)
+            return (st);
+        memset(dir->get_payload(), 0, per_dir*sizeof(ham_offset_t));
+
+        r=page_get_hash_root(root);
+        hash_root_set_dir(r, d, dir->get_self());
+        hash_root_set_directories(r, d+1);
+        root->set_dirty(true);
+        m_dirs.push_back(dir->get_self());
+    }
+    else {
+        st=db_fetch_page(&dir, db, m_dirs[d], 0);
+        if (st)
+            return (st);
+    }
+
+    page_get_hash_directory(dir)[bucket%per_dir]=ham_h2db_offset(address);
+    dir->set_dirty(true);
+    m_buckets.push_back(address);
+    return (0);
+}
+
+ham_status_t
+HashBackend::write_root()
+{
+    ham_status_t st;
+    Page *root;
+
+    st=db_fetch_page(&root, get_db(), m_root, 0);
+    if (st)
+        return (st);
+    hash_root_set_level(page_get_hash_root(root), m_level);
+    hash_root_set_split(page_get_hash_root(root), m_split);
+    root->set_dirty(true);
+    return (0);
+}
+
+ham_status_t
+HashBackend::calc_keycount_per_page(ham_size_t *maxkeys, ham_u16_t keysize)
+{
+    if (keysize==0) {
+        *maxkeys=get_maxkeys();
+        return (0);
+    }
+
+    /* prevent overflow - the counter of a bucket page only has 16 bit! */
+    *maxkeys=__calc_maxkeys(get_db()->get_env()->get_pagesize(), keysize);
+    if (*maxkeys>0xffff) {
+        ham_trace(("keysize/pagesize ratio too high"));
+        return (HAM_INV_KEYSIZE);
+    }
+    else if (*maxkeys==0) {
+        ham_trace(("keysize too large for the current pagesize"));
+        return (HAM_INV_KEYSIZE);
+    }
+    return (0);
+}
+
+ham_status_t
+HashBackend::create(ham_u16_t keysize, ham_u32_t flags)
+{
+    ham_status_t st;
+    Page *root, *bucket;
+    ham_size_t maxkeys;
+    Database *db=get_db();
+    db_indexdata_t *indexdata=db->get_env()->get_indexdata_ptr(
+                                db->get_indexdata_offset());
+    if (is_active()) {
+        ham_trace(("backend has alread been initialized before!"));
+        return (HAM_ALREADY_INITIALIZED);
+    }
+
+    st=calc_keycount_per_page(&maxkeys, keysize);
+    if (st)
+        return (st);
+
+    m_maxkeys=(ham_u16_t)maxkeys;
+    set_keysize(keysize);
+    set_flags(flags);
+
+    /* allocate the root page; the level and the split pointer are 0 */
+    st=db_alloc_page(&root, db, Page::TYPE_H_ROOT, PAGE_IGNORE_FREELIST);
+    if (st)
+        return (st);
+    memset(root->get_payload(), 0,
+            db->get_env()->get_pagesize()-Page::sizeof_persistent_header);
+    root->set_dirty(true);
+
+    m_root=root->get_self();
+    m_level=0;
+    m_split=0;
+    m_dirs.clear();
+    m_buckets.clear();
+
+    /* and the first bucket */
+    st=alloc_bucket(&bucket);
+    if (st)
+        return (st);
+    st=add_bucket(bucket->get_self());
+    if (st)
+        return (st);
+
+    set_dirty(true);
+
+    index_set_max_keys(indexdata, m_maxkeys);
+    index_set_keysize(indexdata, keysize);
+    index_set_self(indexdata, m_root);
+    index_set_flags(indexdata, flags);
+    index_set_recno(indexdata, 0);
+    index_set_bloom_filter(indexdata, 0);
+
+    db->get_env()->set_dirty(true);
+    set_active(true);
+
+    return (0);
+}
+
+ham_status_t
+HashBackend::open(ham_u32_t flags)
+{
+    ham_status_t st;
+    Page *root, *dir;
+    hash_root_t *r;
+    Database *db=get_db();
+    Environment *env=db->get_env();
+    db_indexdata_t *indexdata=env->get_indexdata_ptr(
+                                db->get_indexdata_offset());
+    ham_size_t per_dir=__entries_per_dir(db);
+
+    m_maxkeys=index_get_max_keys(indexdata);
+    m_root=index_get_self(indexdata);
+    set_keysize(index_get_keysize(indexdata));
+    set_flags(index_get_flags(indexdata));
+    set_recno(index_get_recno(indexdata));
+    set_bloom_filter(index_get_bloom_filter(indexdata));
+
+    /* load the state of the table and the directory */
+    st=db_fetch_page(&root, db, m_root, 0);
+    if (st)
+        return (st);
+    r=page_get_hash_root(root);
+    m_level=hash_root_get_level(r);
+    m_split=hash_root_get_split(r);
+
+    m_dirs.clear();
+    m_buckets.clear();
+    for (ham_u32_t d=0; d<hash_root_get_directories(r); d++)
+        m_dirs.push_back(hash_root_get_dir(r, d));
+
+    for (ham_size_t d=0; d<m_dirs.size(); d++) {
+        st=db_fetch_page(&dir, db, m_dirs[d], 0);
+        if (st)
+            return (st);
+        for (ham_size_t i=0;
+                i<per_dir && m_buckets.size()<get_bucket_count(); i++)
+            m_buckets.push_back(
+                    ham_db2h_offset(page_get_hash_directory(dir)[i]));
+    }
+
+    /* the pages were only read */
+    if (env->get_flags()&HAM_ENABLE_RECOVERY)
+        env->get_changeset().clear();
+
+    if (m_buckets.size()!=get_bucket_count()) {
+        ham_log(("hash directory is truncated: %u of %llu buckets",
+                (unsigned)m_buckets.size(),
+                (unsigned long long)get_bucket_count()));
+        return (HAM_INTEGRITY_VIOLATED);
+    }
+
+    set_active(true);
+
+    return (0);
+}
+
+ham_status_t
+HashBackend::flush()
+{
+    Database *db=get_db();
+    db_indexdata_t *indexdata=db->get_env()->get_indexdata_ptr(
+                                db->get_indexdata_offset());
+
+    /* nothing to do if the backend was not touched */
+    if (!is_dirty())
+        return (0);
+
+    index_set_max_keys(indexdata, m_maxkeys);
+    index_set_keysize(indexdata, get_keysize());
+    index_set_self(indexdata, m_root);
+    index_set_flags(indexdata, get_flags());
+    index_set_recno(indexdata, get_recno());
+    index_set_bloom_filter(indexdata, get_bloom_filter());
+
+    db->get_env()->set_dirty(true);
+    set_dirty(false);
+
+    return (0);
+}
+
+ham_status_t
+HashBackend::close()
+{
+    ham_status_t st;
+
+    /* only flush the backend info if it's dirty */
+    st=flush();
+
+    /* even when an error occurred, the backend has now been de-activated */
+    set_active(false);
+
+    m_dirs.clear();
+    m_buckets.clear();
+
+    return (st);
+}
+
+ham_status_t
+HashBackend::close_cursors(ham_u32_t flags)
+{
+    return (btree_close_cursors(get_db(), flags));
+}
+
+ham_status_t
+HashBackend::search(ham_u64_t bucket, ham_key_t *key, Page **ppage,
+                ham_size_t *pslot, Page **pprevious)
+{
+    ham_status_t st;
+    Page *page, *previous=0;
+    Database *db=get_db();
+    ham_offset_t address=m_buckets[(size_t)bucket];
+
+    while (address) {
+        hash_bucket_t *b;
+
+        st=db_fetch_page(&page, db, address, 0);
+        if (st)
+            return (st);
+        b=page_get_hash_bucket(page);
+
+        for (ham_size_t i=0; i<hash_bucket_get_count(b); i++) {
+            bool equal;
+            st=compare(hash_bucket_get_key(db, b, i), key, &equal);
+            if (st)
+                return (st);
+            if (equal) {
+                *ppage=page;
+                *pslot=i;
+                if (pprevious)
+                    *pprevious=previous;
+                return (0);
+            }
+        }
+
+        previous=page;
+        address=hash_bucket_get_overflow(b);
+    }
+
+    return (HAM_KEY_NOT_FOUND);
+}
+
+ham_status_t
+HashBackend::lookup(ham_key_t *key, Page **ppage, ham_size_t *pslot)
+{
+    return (search(get_bucket(hash((ham_u8_t *)key->data, key->size)),
+                key, ppage, pslot, 0));
+}
+
+ham_status_t
+HashBackend::get_first(ham_u64_t bucket, Page **ppage, ham_size_t *pslot)
+{
+    ham_status_t st;
+    Page *page;
+    Database *db=get_db();
+
+    for (; bucket<m_buckets.size(); bucket++) {
+        ham_offset_t address=m_buckets[(size_t)bucket];
+        while (address) {
+            st=db_fetch_page(&page, db, address, 0);
+            if (st)
+                return (st);
+            if (hash_bucket_get_count(page_get_hash_bucket(page))) {
+                *ppage=page;
+                *pslot=0;
+                return (0);
+            }
+            address=hash_bucket_get_overflow(page_get_hash_bucket(page));
+        }
+    }
+
+    return (HAM_KEY_NOT_FOUND);
+}
+
+ham_status_t
+HashBackend::get_next(ham_key_t *key, Page **ppage, ham_size_t *pslot)
+{
+    ham_status_t st;
+    Page *page;
+    ham_size_t slot;
+    ham_offset_t address;
+    hash_bucket_t *b;
+    ham_u64_t bucket=get_bucket(hash((ham_u8_t *)key->data, key->size));
+
+    st=search(bucket, key, &page, &slot, 0);
+    if (st)
+        return (st);
+
+    b=page_get_hash_bucket(page);
+    if (slot+1<hash_bucket_get_count(b)) {
+        *ppage=page;
+        *pslot=slot+1;
+        return (0);
+    }
+
+    /* continue with the remaining pages of the chain */
+    address=hash_bucket_get_overflow(b);
+    while (address) {
+        st=db_fetch_page(&page, get_db(), address, 0);
+        if (st)
+            return (st);
+        b=page_get_hash_bucket(page);
+        if (hash_bucket_get_count(b)) {
+            *ppage=page;
+            *pslot=0;
+            return (0);
+        }
+        address=hash_bucket_get_overflow(b);
+    }
+
+    return (get_first(bucket+1, ppage, pslot));
+}
+
+ham_status_t
+HashBackend::find(Transaction *txn, ham_key_t *key,
+                ham_record_t *record, ham_u32_t flags)
+{
+    ham_status_t st;
+    Page *page;
+    ham_size_t slot;
+    btree_key_t *entry;
+    Database *db=get_db();
+
+    if (flags&(HAM_FIND_LT_MATCH|HAM_FIND_GT_MATCH)) {
+        ham_trace(("approximate matching is not supported by hash "
+                    "Databases"));
+        return (HAM_NOT_IMPLEMENTED);
+    }
+
+    st=lookup(key, &page, &slot);
+    if (st)
+        return (st);
+
+    if (record) {
+        entry=hash_bucket_get_key(db, page_get_hash_bucket(page), slot);
+        record->_intflags=key_get_flags(entry);
+        record->_rid=key_get_ptr(entry);
+        st=btree_read_record(db, txn, record,
+                        key_get_rawptr_address(entry), flags);
+        if (st)
+            return (st);
+    }
+
+    return (0);
+}
+
+ham_status_t
+HashBackend::insert(Transaction *txn, ham_key_t *key,
+                ham_record_t *record, ham_u32_t flags)
+{
+    ham_status_t st;
+    Page *page;
+    ham_size_t slot;
+    hash_bucket_t *b;
+    btree_key_t *entry;
+    bool overflow=false;
+    Database *db=get_db();
+    ham_u64_t bucket=get_bucket(hash((ham_u8_t *)key->data, key->size));
+
+    /* overwrite the record of an existing key */
+    st=search(bucket, key, &page, &slot, 0);
+    if (st==0) {
+        if (!(flags&HAM_OVERWRITE))
+            return (HAM_DUPLICATE_KEY);
+        entry=hash_bucket_get_key(db, page_get_hash_bucket(page), slot);
+        st=key_set_record(db, txn, entry, record, 0, flags, 0);
+        if (st)
+            return (st);
+        page->set_dirty(true);
+        return (0);
+    }
+    if (st!=HAM_KEY_NOT_FOUND)
+        return (st);
+
+    /* otherwise find a page of the chain with a free slot; if all pages
+     * are full then an overflow page is appended */
+    st=db_fetch_page(&page, db, m_buckets[(size_t)bucket], 0);
+    if (st)
+        return (st);
+    b=page_get_hash_bucket(page);
+    while (hash_bucket_get_count(b)>=m_maxkeys) {
+        Page *next;
+        if (hash_bucket_get_overflow(b)) {
+            st=db_fetch_page(&next, db, hash_bucket_get_overflow(b), 0);
+            if (st)
+                return (st);
+        }
+        else {
+            st=alloc_bucket(&next);
+            if (st)
+                return (st);
+            hash_bucket_set_overflow(b, next->get_self());
+            page->set_dirty(true);
+            overflow=true;
+        }
+        page=next;
+        b=page_get_hash_bucket(page);
+    }
+
+    /* initialize the new entry and store the record */
+    slot=hash_bucket_get_count(b);
+    entry=hash_bucket_get_key(db, b, slot);
+    memset(entry, 0, db_get_int_key_header_size()+db_get_keysize(db));
+
+    st=key_set_record(db, txn, entry, record, 0, flags, 0);
+    if (st)
+        return (st);
+    key_set_size(entry, key->size);
+
+    /*
+     * if we need an extended key, allocate a blob and store
+     * the blob-id in the key
+     */
+    if (key->size>db_get_keysize(db)) {
+        ham_offset_t blobid;
+
+        key_set_flags(entry, key_get_flags(entry)|KEY_IS_EXTENDED);
+        key_set_key(entry, key->data, db_get_keysize(db));
+
+        st=key_insert_extended(&blobid, db, page, key);
+        ham_assert(st ? blobid == 0 : 1, (0));
+        if (!blobid)
+            return st ? st : HAM_INTERNAL_ERROR;
+
+        key_set_extended_rid(db, entry, blobid);
+    }
+    else
+        key_set_key(entry, key->data, key->size);
+
+    hash_bucket_set_count(b, slot+1);
+    page->set_dirty(true);
+
+    /* the chain grew: split the next bucket */
+    if (overflow)
+        return (split());
+    return (0);
+}
+
+void
+HashBackend::remove_slot(Page *page, ham_size_t slot)
+{
+    Database *db=get_db();
+    hash_bucket_t *b=page_get_hash_bucket(page);
+    ham_size_t count=hash_bucket_get_count(b);
+
+    if (slot+1<count)
+        memmove(hash_bucket_get_key(db, b, slot),
+                hash_bucket_get_key(db, b, slot+1),
+                (db_get_int_key_header_size()+db_get_keysize(db))
+                    *(count-slot-1));
+    hash_bucket_set_count(b, count-1);
+    page->set_dirty(true);
+}
+
+ham_status_t
+HashBackend::erase_entry(Transaction *txn, Page *page, ham_size_t slot)
+{
+    ham_status_t st;
+    Database *db=get_db();
+    btree_key_t *entry=hash_bucket_get_key(db,
+                page_get_hash_bucket(page), slot);
+
+    st=key_erase_record(db, txn, entry, 0, HAM_ERASE_ALL_DUPLICATES);
+    if (st)
+        return (st);
+
+    if (key_get_flags(entry)&KEY_IS_EXTENDED) {
+        st=extkey_remove(db, key_get_extended_rid(db, entry));
+        if (st)
+            return (st);
+    }
+
+    remove_slot(page, slot);
+    return (0);
+}
+
+ham_status_t
+HashBackend::free_overflow(Page *page, Page *previous)
+{
+    ham_status_t st;
+    Environment *env=get_db()->get_env();
+
+    ham_assert(hash_bucket_get_count(page_get_hash_bucket(page))==0, (""));
+
+    hash_bucket_set_overflow(page_get_hash_bucket(previous),
+            hash_bucket_get_overflow(page_get_hash_bucket(page)));
+    previous->set_dirty(true);
+
+    /*
+     * if recovery is enabled then the page is part of the changeset and
+     * must not be deleted before the changeset is flushed; it's enough to
+     * move it to the freelist
+     */
+    if (!(env->get_flags()&HAM_ENABLE_RECOVERY))
+        return (db_free_page(page, DB_MOVE_TO_FREELIST));
+
+    st=page->uncouple_all_cursors();
+    if (st)
+        return (st);
+    return (freel_mark_free(env, get_db(), page->get_self(),
+                env->get_pagesize(), HAM_TRUE));
+}
+
+ham_status_t
+HashBackend::split()
+{
+    ham_status_t st;
+    Page *page, *target, *previous=0;
+    hash_bucket_t *tb;
+    Database *db=get_db();
+    ham_size_t entry_size=db_get_int_key_header_size()+db_get_keysize(db);
+
+    /* the directory is full: from now on, the chains grow */
+    if (get_bucket_count()>=get_max_buckets())
+        return (0);
+
+    ham_u64_t from=m_split;
+    ham_u64_t to=m_split+((ham_u64_t)1<<m_level);
+    ham_u64_t mask=((ham_u64_t)2<<m_level)-1;
+
+    st=alloc_bucket(&target);
+    if (st)
+        return (st);
+    st=add_bucket(target->get_self());
+    if (st)
+        return (st);
+    ham_assert(m_buckets.size()==to+1, (""));
+
+    if (++m_split==((ham_u64_t)1<<m_level)) {
+        m_level++;
+        m_split=0;
+    }
+    st=write_root();
+    if (st)
+        return (st);
+
+    /* move all keys which now belong to the new bucket */
+    tb=page_get_hash_bucket(target);
+    ham_offset_t address=m_buckets[(size_t)from];
+    while (address) {
+        hash_bucket_t *b;
+
+        st=db_fetch_page(&page, db, address, 0);
+        if (st)
+            return (st);
+        b=page_get_hash_bucket(page);
+
+        ham_size_t i=0;
+        while (i<hash_bucket_get_count(b)) {
+            ham_u64_t h;
+            btree_key_t *entry=hash_bucket_get_key(db, b, i);
+
+            st=hash_entry(entry, &h);
+            if (st)
+                return (st);
+            if ((h&mask)!=to) {
+                i++;
+                continue;
+            }
+
+            if (hash_bucket_get_count(tb)>=m_maxkeys) {
+                Page *next;
+                st=alloc_bucket(&next);
+                if (st)
+                    return (st);
+                hash_bucket_set_overflow(tb, next->get_self());
+                target->set_dirty(true);
+                target=next;
+                tb=page_get_hash_bucket(target);
+            }
+
+            memcpy(hash_bucket_get_key(db, tb, hash_bucket_get_count(tb)),
+                    entry, entry_size);
+            hash_bucket_set_count(tb, hash_bucket_get_count(tb)+1);
+            target->set_dirty(true);
+            remove_slot(page, i);
+        }
+
+        address=hash_bucket_get_overflow(b);
+
+        /* the first page of a bucket is never freed */
+        if (previous && hash_bucket_get_count(b)==0) {
+            st=free_overflow(page, previous);
+            if (st)
+                return (st);
+        }
+        else
+            previous=page;
+    }
+
+    return (0);
+}
+
+void
+HashBackend::nil_cursors(ham_key_t *key)
+{
+    std::vector<Cursor *> cursors;
+
+    /* collect the cursors first - @a key might belong to one of them */
+    for (Cursor *c=get_db()->get_cursors(); c; c=c->get_next()) {
+        btree_cursor_t *btc=c->get_btree_cursor();
+        if (!btree_cursor_is_uncoupled(btc))
+            continue;
+        ham_key_t *k=btree_cursor_get_uncoupled_key(btc);
+        if (k->size==key->size
+                && (!key->size || 0==memcmp(k->data, key->data, key->size)))
+            cursors.push_back(c);
+    }
+
+    for (size_t i=0; i<cursors.size(); i++)
+        cursors[i]->set_to_nil(Cursor::CURSOR_BTREE);
+}
+
+ham_status_t
+HashBackend::erase(Transaction *txn, ham_key_t *key, ham_u32_t flags)
+{
+    ham_status_t st;
+    Page *page, *previous;
+    ham_size_t slot;
+
+    st=search(get_bucket(hash((ham_u8_t *)key->data, key->size)),
+                key, &page, &slot, &previous);
+    if (st)
+        return (st);
+
+    st=erase_entry(txn, page, slot);
+    if (st)
+        return (st);
+
+    if (previous && hash_bucket_get_count(page_get_hash_bucket(page))==0) {
+        st=free_overflow(page, previous);
+        if (st)
+            return (st);
+    }
+
+    nil_cursors(key);
+    return (0);
+}
+
+ham_status_t
+HashBackend::erase_range(Transaction *txn, ham_key_t *begin,
+                ham_key_t *end, ham_u32_t flags)
+{
+    ham_status_t st;
+    Page *page;
+    Database *db=get_db();
+    Allocator *alloc=db->get_env()->get_allocator();
+
+    /* the keys are not sorted - every bucket has to be scanned */
+    for (size_t bucket=0; bucket<m_buckets.size(); bucket++) {
+        Page *previous=0;
+        ham_offset_t address=m_buckets[bucket];
+
+        while (address) {
+            hash_bucket_t *b;
+
+            st=db_fetch_page(&page, db, address, 0);
+            if (st)
+                return (st);
+            b=page_get_hash_bucket(page);
+
+            ham_size_t i=0;
+            while (i<hash_bucket_get_count(b)) {
+                ham_key_t key;
+                memset(&key, 0, sizeof(key));
+
+                st=btree_copy_key_int2pub(db, hash_bucket_get_key(db, b, i),
+                            &key);
+                if (st) {
+                    if (key.data)
+                        alloc->free(key.data);
+                    return (st);
+                }
+
+                /* the range includes @a begin, but not @a end */
+                bool in_range=true;
+                if (begin) {
+                    int cmp=db->compare_keys(&key, begin);
+                    if (cmp<-1)
+                        st=(ham_status_t)cmp;
+                    else if (cmp<0)
+                        in_range=false;
+                }
+                if (!st && in_range && end) {
+                    int cmp=db->compare_keys(&key, end);
+                    if (cmp<-1)
+                        st=(ham_status_t)cmp;
+                    else if (cmp>=0)
+                        in_range=false;
+                }
+
+                if (!st && in_range) {
+                    st=erase_entry(txn, page, i);
+                    if (!st)
+                        nil_cursors(&key);
+                }
+                else if (!st)
+                    i++;
+
+                if (key.data)
+                    alloc->free(key.data);
+                if (st)
+                    return (st);
+            }
+
+            address=hash_bucket_get_overflow(b);
+
+            if (previous && hash_bucket_get_count(b)==0) {
+                st=free_overflow(page, previous);
+                if (st)
+                    return (st);
+            }
+            else
+                previous=page;
+        }
+    }
+
+    return (0);
+}
+
+ham_status_t
+HashBackend::enumerate(ham_enumerate_cb_t cb, void *context)
+{
+    ham_status_t st;
+    Page *page;
+    ham_u32_t level=0;
+    ham_size_t buckets=(ham_size_t)m_buckets.size();
+    ham_bool_t is_leaf=HAM_TRUE;
+    Database *db=get_db();
+    ham_status_t cb_st=CB_CONTINUE;
+
+    /* all buckets are leaves of a single level */
+    st=cb(ENUM_EVENT_DESCEND, (void *)&level, (void *)&buckets, context);
+    if (st!=CB_CONTINUE)
+        return (st);
+
+    for (size_t bucket=0; bucket<m_buckets.size(); bucket++) {
+        ham_offset_t address=m_buckets[bucket];
+
+        while (address) {
+            hash_bucket_t *b;
+            ham_size_t count;
+
+            st=db_fetch_page(&page, db, address, 0);
+            if (st)
+                return (st);
+            b=page_get_hash_bucket(page);
+            count=hash_bucket_get_count(b);
+            address=hash_bucket_get_overflow(b);
+
+            cb_st=cb(ENUM_EVENT_PAGE_START, (void *)page, &is_leaf, context);
+            if (cb_st==CB_STOP || cb_st<0 /* error */)
+                return (cb_st<0 ? cb_st : HAM_SUCCESS);
+
+            for (ham_size_t i=0; i<count && cb_st!=CB_DO_NOT_DESCEND; i++) {
+                cb_st=cb(ENUM_EVENT_ITEM, (void *)hash_bucket_get_key(db, b, i),
+                            (void *)&count, context);
+                if (cb_st==CB_STOP || cb_st<0 /* error */)
+                    break;
+            }
+
+            st=cb(ENUM_EVENT_PAGE_STOP, (void *)page, &is_leaf, context);
+            if (cb_st==CB_STOP || cb_st<0 /* error */)
+                return (cb_st<0 ? cb_st : HAM_SUCCESS);
+            if (st<0)
+                return (st);
+        }
+    }
+
+    return (HAM_SUCCESS);
+}
+
+ham_status_t
+HashBackend::check_integrity()
+{
+    ham_status_t st;
+    Page *page, *root;
+    hash_root_t *r;
+    Database *db=get_db();
+
+    st=db_fetch_page(&root, db, m_root, 0);
+    if (st)
+        return (st);
+    r=page_get_hash_root(root);
+    if (hash_root_get_level(r)!=m_level
+            || hash_root_get_split(r)!=m_split
+            || hash_root_get_directories(r)!=m_dirs.size()
+            || m_buckets.size()!=get_bucket_count()
+            || m_split>=((ham_u64_t)1<<m_level)) {
+        ham_log(("integrity check failed in page 0x%llx: invalid hash "
+                "table state", (unsigned long long)m_root));
+        return (HAM_INTEGRITY_VIOLATED);
+    }
+
+    for (size_t bucket=0; bucket<m_buckets.size(); bucket++) {
+        ham_offset_t address=m_buckets[bucket];
+
+        if (!address) {
+            ham_log(("integrity check failed: bucket %llu is missing",
+                    (unsigned long long)bucket));
+            return (HAM_INTEGRITY_VIOLATED);
+        }
+
+        while (address) {
+            hash_bucket_t *b;
+
+            st=db_fetch_page(&page, db, address, 0);
+            if (st)
+                return (st);
+            b=page_get_hash_bucket(page);
+
+            if (page->get_type()!=Page::TYPE_H_BUCKET
+                    || hash_bucket_get_count(b)>m_maxkeys) {
+                ham_log(("integrity check failed in page 0x%llx: invalid "
+                        "bucket page", (unsigned long long)address));
+                return (HAM_INTEGRITY_VIOLATED);
+            }
+
+            for (ham_size_t i=0; i<hash_bucket_get_count(b); i++) {
+                ham_u64_t h;
+                st=hash_entry(hash_bucket_get_key(db, b, i), &h);
+                if (st)
+                    return (st);
+                if (get_bucket(h)!=bucket) {
+                    ham_log(("integrity check failed in page 0x%llx: item "
+                            "#%u belongs to bucket %llu, not %llu",
+                            (unsigned long long)address, (unsigned)i,
+                            (unsigned long long)get_bucket(h),
+                            (unsigned long long)bucket));
+                    return (HAM_INTEGRITY_VIOLATED);
+                }
+            }
+
+            address=hash_bucket_get_overflow(b);
+        }
+    }
+
+    return (0);
+}
+
+/* stores a copy of @a key in the (uncoupled) btree cursor */
+static ham_status_t
+__couple(Cursor *cursor, ham_key_t *key)
+{
+    ham_status_t st;
+    Database *db=cursor->get_db();
+    Allocator *alloc=db->get_env()->get_allocator();
+    btree_cursor_t *btc=cursor->get_btree_cursor();
+
+    ham_key_t *copy=(ham_key_t *)alloc->calloc(sizeof(*copy));
+    if (!copy)
+        return (HAM_OUT_OF_MEMORY);
+    st=db->copy_key(key, copy);
+    if (st) {
+        if (copy->data)
+            alloc->free(copy->data);
+        alloc->free(copy);
+        return (st);
+    }
+
+    btree_cursor_set_to_nil(btc);
+    btree_cursor_set_flags(btc,
+            btree_cursor_get_flags(btc)|BTREE_CURSOR_FLAG_UNCOUPLED);
+    btree_cursor_set_uncoupled_key(btc, copy);
+    return (0);
+}
+
+/* stores a copy of a stored key in the (uncoupled) btree cursor */
+static ham_status_t
+__couple_to_entry(Cursor *cursor, btree_key_t *entry)
+{
+    ham_status_t st;
+    Database *db=cursor->get_db();
+    Allocator *alloc=db->get_env()->get_allocator();
+    btree_cursor_t *btc=cursor->get_btree_cursor();
+
+    ham_key_t *copy=(ham_key_t *)alloc->calloc(sizeof(*copy));
+    if (!copy)
+        return (HAM_OUT_OF_MEMORY);
+    st=btree_copy_key_int2pub(db, entry, copy);
+    if (st) {
+        if (copy->data)
+            alloc->free(copy->data);
+        alloc->free(copy);
+        return (st);
+    }
+
+    btree_cursor_set_to_nil(btc);
+    btree_cursor_set_flags(btc,
+            btree_cursor_get_flags(btc)|BTREE_CURSOR_FLAG_UNCOUPLED);
+    btree_cursor_set_uncoupled_key(btc, copy);
+    return (0);
+}
+
+/* reads the record of an entry */
+static ham_status_t
+__read_record(Cursor *cursor, btree_key_t *entry, ham_record_t *record,
+                ham_u32_t flags)
+{
+    record->_intflags=key_get_flags(entry);
+    record->_rid=key_get_ptr(entry);
+    return (btree_read_record(cursor->get_db(), cursor->get_txn(), record,
+                key_get_rawptr_address(entry), flags));
+}
+
+ham_status_t
+hash_cursor_insert(Cursor *cursor, ham_key_t *key, ham_record_t *record,
+                ham_u32_t flags)
+{
+    ham_status_t st;
+    Backend *be=cursor->get_db()->get_backend();
+
+    st=be->insert(cursor->get_txn(), key, record, flags);
+    if (st)
+        return (st);
+    return (__couple(cursor, key));
+}
+
+ham_status_t
+hash_cursor_find(Cursor *cursor, ham_key_t *key, ham_record_t *record,
+                ham_u32_t flags)
+{
+    ham_status_t st;
+    Page *page;
+    ham_size_t slot;
+    Database *db=cursor->get_db();
+    HashBackend *be=(HashBackend *)db->get_backend();
+
+    if (flags&(HAM_FIND_LT_MATCH|HAM_FIND_GT_MATCH)) {
+        ham_trace(("approximate matching is not supported by hash "
+                    "Databases"));
+        return (HAM_NOT_IMPLEMENTED);
+    }
+
+    cursor->set_to_nil(Cursor::CURSOR_BTREE);
+
+    st=be->lookup(key, &page, &slot);
+    if (st)
+        return (st);
+    st=__couple(cursor, key);
+    if (st)
+        return (st);
+
+    if (record)
+        return (__read_record(cursor,
+                    hash_bucket_get_key(db, page_get_hash_bucket(page), slot),
+                    record, flags));
+    return (0);
+}
+
+ham_status_t
+hash_cursor_erase(Cursor *cursor, ham_u32_t flags)
+{
+    Backend *be=cursor->get_db()->get_backend();
+    btree_cursor_t *btc=cursor->get_btree_cursor();
+
+    if (!btree_cursor_is_uncoupled(btc))
+        return (HAM_CURSOR_IS_NIL);
+
+    /* the cursor is set to nil when the key is erased */
+    return (be->erase(cursor->get_txn(),
+                btree_cursor_get_uncoupled_key(btc), flags));
+}
+
+ham_status_t
+hash_cursor_move(Cursor *cursor, ham_key_t *key, ham_record_t *record,
+                ham_u32_t flags)
+{
+    ham_status_t st;
+    Page *page;
+    ham_size_t slot;
+    btree_key_t *entry;
+    Database *db=cursor->get_db();
+    HashBackend *be=(HashBackend *)db->get_backend();
+    btree_cursor_t *btc=cursor->get_btree_cursor();
+
+    if (flags&(HAM_CURSOR_LAST|HAM_CURSOR_PREVIOUS)) {
+        ham_trace(("hash Databases only support HAM_CURSOR_FIRST and "
+                    "HAM_CURSOR_NEXT"));
+        return (HAM_NOT_IMPLEMENTED);
+    }
+
+    /* there are no duplicates */
+    if ((flags&HAM_CURSOR_NEXT) && (flags&HAM_ONLY_DUPLICATES))
+        return (HAM_KEY_NOT_FOUND);
+
+    /* a nil cursor starts at the beginning */
+    if ((flags&HAM_CURSOR_NEXT) && !btree_cursor_is_uncoupled(btc)) {
+        flags&=~HAM_CURSOR_NEXT;
+        flags|=HAM_CURSOR_FIRST;
+    }
+
+    if (flags&HAM_CURSOR_FIRST)
+        st=be->get_first(0, &page, &slot);
+    else if (flags&HAM_CURSOR_NEXT)
+        st=be->get_next(btree_cursor_get_uncoupled_key(btc), &page, &slot);
+    else if (!btree_cursor_is_uncoupled(btc))
+        return (HAM_CURSOR_IS_NIL);
+    else
+        st=be->lookup(btree_cursor_get_uncoupled_key(btc), &page, &slot);
+    if (st)
+        return (st);
+
+    entry=hash_bucket_get_key(db, page_get_hash_bucket(page), slot);
+
+    if (flags&(HAM_CURSOR_FIRST|HAM_CURSOR_NEXT)) {
+        st=__couple_to_entry(cursor, entry);
+        if (st)
+            return (st);
+    }
+
+    if (key) {
+        st=btree_read_key(db, cursor->get_txn(), entry, key);
+        if (st)
+            return (st);
+    }
+
+    if (record)
+        return (__read_record(cursor, entry, record, flags));
+    return (0);
+}
+
+ham_status_t
+hash_cursor_overwrite(Cursor *cursor, ham_record_t *record, ham_u32_t flags)
+{
+    Backend *be=cursor->get_db()->get_backend();
+    btree_cursor_t *btc=cursor->get_btree_cursor();
+
+    if (!btree_cursor_is_uncoupled(btc))
+        return (HAM_CURSOR_IS_NIL);
+
+    return (be->insert(cursor->get_txn(),
+                btree_cursor_get_uncoupled_key(btc), record,
+                flags|HAM_OVERWRITE));
+}
+
+ham_status_t
+hash_cursor_get_record_size(Cursor *cursor, ham_offset_t *size)
+{
+    ham_status_t st;
+    Page *page;
+    ham_size_t slot;
+    btree_key_t *entry;
+    Database *db=cursor->get_db();
+    HashBackend *be=(HashBackend *)db->get_backend();
+    btree_cursor_t *btc=cursor->get_btree_cursor();
+
+    if (!btree_cursor_is_uncoupled(btc))
+        return (HAM_CURSOR_IS_NIL);
+
+    st=be->lookup(btree_cursor_get_uncoupled_key(btc), &page, &slot);
+    if (st)
+        return (st);
+    entry=hash_bucket_get_key(db, page_get_hash_bucket(page), slot);
+
+    if (key_get_flags(entry)&KEY_BLOB_SIZE_TINY) {
+        /* the highest byte of the record id is the size of the blob */
+        char *p=(char *)key_get_rawptr_address(entry);
+        *size=p[sizeof(ham_offset_t)-1];
+    }
+    else if (key_get_flags(entry)&KEY_BLOB_SIZE_SMALL) {
+        /* record size is sizeof(ham_offset_t) */
+        *size=sizeof(ham_offset_t);
+    }
+    else if (key_get_flags(entry)&KEY_BLOB_SIZE_EMPTY) {
+        /* record size is 0 */
+        *size=0;
+    }
+    else {
+        st=blob_get_datasize(db, key_get_ptr(entry), size);
+        if (st)
+            return (st);
+    }
+
+    return (0);
+}
+
+ham_status_t
+hash_cursor_get_duplicate_count(Cursor *cursor, ham_size_t *count,
+                ham_u32_t flags)
+{
+    if (!btree_cursor_is_uncoupled(cursor->get_btree_cursor()))
+        return (HAM_CURSOR_IS_NIL);
+
+    *count=1;
+    return (0);
+}
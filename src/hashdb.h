@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief the hash-backend
+ *
+ * The hash index uses linear hashing. The index data of the Database
+ * stores the address of the root page; the root page stores the state
+ * of the table (the level and the next bucket which is split) and the
+ * addresses of the directory pages, and the directory pages store the
+ * addresses of the buckets. The directory is also kept in memory,
+ * therefore a lookup only fetches the pages of a single bucket.
+ *
+ * A bucket is a chain of pages. The keys are stored in the same format
+ * as in a btree leaf (btree_key_t), therefore extended keys and records
+ * are managed by the same functions as in the btree. Whenever a bucket
+ * needs an overflow page, the next bucket of the table is split.
+ *
+ * The keys are not sorted; cursors only support HAM_CURSOR_FIRST and
+ * HAM_CURSOR_NEXT, and approximate matching is not supported. Keys are
+ * always compared byte-wise, the compare function of the Database is
+ * not used.
+ */
+
+#ifndef HAM_HASHDB_H__
+#define HAM_HASHDB_H__
+
+#include "internal_fwd_decl.h"
+
+#include <vector>
+
+#include "endianswap.h"
+
+#include "backend.h"
+#include "btree_key.h"
+
+/**
+ * the backend structure for a hash index
+ */
+class HashBackend : public Backend
+{
+  public:
+    /** constructor; creates and initializes a new Backend */
+    HashBackend(Database *db, ham_u32_t flags=0)
+      : Backend(db, flags), m_root(0), m_maxkeys(0), m_level(0),
+        m_split(0) {
+    }
+
+    virtual ~HashBackend() { }
+
+    /** creates a new backend */
+    virtual ham_status_t create(ham_u16_t keysize, ham_u32_t flags);
+
+    /** open and initialize a backend */
+    virtual ham_status_t open(ham_u32_t flags);
+
+    /** close the backend */
+    virtual ham_status_t close();
+
+    /** flush the backend */
+    virtual ham_status_t flush();
+
+    /** find a key in the index */
+    virtual ham_status_t find(Transaction *txn, ham_key_t *key,
+                    ham_record_t *record, ham_u32_t flags);
+
+    /** insert (or update) a key in the index */
+    virtual ham_status_t insert(Transaction *txn, ham_key_t *key,
+                    ham_record_t *record, ham_u32_t flags);
+
+    /** erase a key in the index */
+    virtual ham_status_t erase(Transaction *txn, ham_key_t *key,
+                    ham_u32_t flags);
+
+    /** erase a range of keys in the index; all buckets are scanned */
+    virtual ham_status_t erase_range(Transaction *txn, ham_key_t *begin,
+                    ham_key_t *end, ham_u32_t flags);
+
+    /** iterate all buckets and enumerate every item */
+    virtual ham_status_t enumerate(ham_enumerate_cb_t cb, void *context);
+
+    /** verify the whole table */
+    virtual ham_status_t check_integrity();
+
+    /** estimate the number of keys per page, given the keysize */
+    virtual ham_status_t calc_keycount_per_page(ham_size_t *keycount,
+                    ham_u16_t keysize);
+
+    /** Close (and free) all cursors related to this database table.  */
+    virtual ham_status_t close_cursors(ham_u32_t flags);
+
+    /** uncouple all cursors from a page; cursors are never coupled */
+    virtual ham_status_t uncouple_all_cursors(Page *page, ham_size_t start) {
+        return (0);
+    }
+
+    /** extended keys are removed when the key is erased */
+    virtual ham_status_t free_page_extkeys(Page *page, ham_u32_t flags) {
+        return (0);
+    }
+
+    /** get the address of the root page */
+    ham_offset_t get_rootpage() {
+        return (m_root);
+    }
+
+    /** get maximum number of keys per bucket page */
+    ham_u16_t get_maxkeys() {
+        return (m_maxkeys);
+    }
+
+    /** get the number of buckets */
+    ham_u64_t get_bucket_count() {
+        return (((ham_u64_t)1<<m_level)+m_split);
+    }
+
+    /**
+     * looks up a key; returns the page and the slot of the key, or
+     * HAM_KEY_NOT_FOUND
+     */
+    ham_status_t lookup(ham_key_t *key, Page **ppage, ham_size_t *pslot);
+
+    /**
+     * returns the first key in the bucket @a bucket or in one of the
+     * following buckets, or HAM_KEY_NOT_FOUND
+     */
+    ham_status_t get_first(ham_u64_t bucket, Page **ppage, ham_size_t *pslot);
+
+    /**
+     * returns the key following @a key (in the order of the buckets),
+     * or HAM_KEY_NOT_FOUND
+     */
+    ham_status_t get_next(ham_key_t *key, Page **ppage, ham_size_t *pslot);
+
+  private:
+    /** returns the hash of a key */
+    static ham_u64_t hash(const ham_u8_t *data, ham_size_t size);
+
+    /** returns the bucket of a hash */
+    ham_u64_t get_bucket(ham_u64_t h);
+
+    /** returns the maximum number of buckets */
+    ham_u64_t get_max_buckets();
+
+    /** returns the hash of a stored key; loads extended keys */
+    ham_status_t hash_entry(btree_key_t *entry, ham_u64_t *h);
+
+    /** compares a stored key with @a key */
+    ham_status_t compare(btree_key_t *entry, ham_key_t *key, bool *equal);
+
+    /**
+     * searches @a key in a bucket; returns the page and the slot of the
+     * key, and the previous page of the chain (or NULL)
+     */
+    ham_status_t search(ham_u64_t bucket, ham_key_t *key, Page **ppage,
+                    ham_size_t *pslot, Page **pprevious);
+
+    /** allocates a new (empty) bucket page */
+    ham_status_t alloc_bucket(Page **ppage);
+
+    /** appends the address of a new bucket to the directory */
+    ham_status_t add_bucket(ham_offset_t address);
+
+    /** writes the level and the split pointer to the root page */
+    ham_status_t write_root();
+
+    /** removes the entry in @a slot from a page */
+    void remove_slot(Page *page, ham_size_t slot);
+
+    /** frees the record and the extended key of an entry, and removes it */
+    ham_status_t erase_entry(Transaction *txn, Page *page, ham_size_t slot);
+
+    /** unlinks an empty overflow page from its chain, and frees it */
+    ham_status_t free_overflow(Page *page, Page *previous);
+
+    /** splits the next bucket */
+    ham_status_t split();
+
+    /** nils all cursors which point to @a key */
+    void nil_cursors(ham_key_t *key);
+
+    /** address of the root page */
+    ham_offset_t m_root;
+
+    /** maximum number of keys in a bucket page */
+    ham_u16_t m_maxkeys;
+
+    /** the table has 2^level buckets before the split pointer */
+    ham_u32_t m_level;
+
+    /** the next bucket which is split */
+    ham_u64_t m_split;
+
+    /** the addresses of the directory pages */
+    std::vector<ham_offset_t> m_dirs;
+
+    /** the addresses of the buckets */
+    std::vector<ham_offset_t> m_buckets;
+};
+
+
+#include "packstart.h"
+
+/**
+ * The root page of a hash index; it spans the persistent part of a Page
+ */
+typedef HAM_PACK_0 struct HAM_PACK_1 hash_root_t
+{
+    /** flags of this node; flags are always the first member */
+    ham_u16_t _flags;
+
+    /** reserved */
+    ham_u16_t _reserved1;
+
+    /** the level of the table */
+    ham_u32_t _level;
+
+    /** the next bucket which is split */
+    ham_u64_t _split;
+
+    /** the number of directory pages */
+    ham_u32_t _directories;
+
+    /** reserved */
+    ham_u32_t _reserved2;
+
+    /** the addresses of the directory pages */
+    ham_offset_t _dirs[1];
+
+} HAM_PACK_2 hash_root_t;
+
+/**
+ * A page of a bucket; it spans the persistent part of a Page
+ */
+typedef HAM_PACK_0 struct HAM_PACK_1 hash_bucket_t
+{
+    /** flags of this node; flags are always the first member */
+    ham_u16_t _flags;
+
+    /** number of used entries in the page */
+    ham_u16_t _count;
+
+    /** reserved */
+    ham_u32_t _reserved;
+
+    /** address of the next page of this bucket */
+    ham_offset_t _overflow;
+
+    /** the entries of this page */
+    btree_key_t _entries[1];
+
+} HAM_PACK_2 hash_bucket_t;
+
+#include "packstop.h"
+
+/** get the level of the root page */
+#define hash_root_get_level(r)          (ham_db2h32((r)->_level))
+
+/** set the level of the root page */
+#define hash_root_set_level(r, l)       (r)->_level=ham_h2db32(l)
+
+/** get the split pointer of the root page */
+#define hash_root_get_split(r)          (ham_db2h64((r)->_split))
+
+/** set the split pointer of the root page */
+#define hash_root_set_split(r, s)       (r)->_split=ham_h2db64(s)
+
+/** get the number of directory pages */
+#define hash_root_get_directories(r)    (ham_db2h32((r)->_directories))
+
+/** set the number of directory pages */
+#define hash_root_set_directories(r, d) (r)->_directories=ham_h2db32(d)
+
+/** get the address of a directory page */
+#define hash_root_get_dir(r, i)         (ham_db2h_offset((r)->_dirs[i]))
+
+/** set the address of a directory page */
+#define hash_root_set_dir(r, i, a)      (r)->_dirs[i]=ham_h2db_offset(a)
+
+/** get the number of entries of a bucket page */
+#define hash_bucket_get_count(b)        (ham_db2h16((b)->_count))
+
+/** set the number of entries of a bucket page */
+#define hash_bucket_set_count(b, c)     (b)->_count=ham_h2db16(c)
+
+/** get the address of the overflow page */
+#define hash_bucket_get_overflow(b)     (ham_db2h_offset((b)->_overflow))
+
+/** set the address of the overflow page */
+#define hash_bucket_set_overflow(b, o)  (b)->_overflow=ham_h2db_offset(o)
+
+/** get an entry of a bucket page */
+#define hash_bucket_get_key(db, b, i)                                   \
+        ((btree_key_t *)&((const char *)(b)->_entries)                  \
+                [(db_get_keysize(db)+db_get_int_key_header_size())*(i)])
+
+/** get a hash_root_t from a Page */
+#define page_get_hash_root(p)           ((hash_root_t *)p->get_payload())
+
+/** get a hash_bucket_t from a Page */
+#define page_get_hash_bucket(p)         ((hash_bucket_t *)p->get_payload())
+
+/** get the directory entries from a Page */
+#define page_get_hash_directory(p)      ((ham_offset_t *)p->get_payload())
+
+/**
+ * the cursor functions of a hash Database; the cursor stores a copy of
+ * the current key in the uncoupled state of its btree cursor
+ */
+
+/** inserts a key and positions the cursor on the key */
+extern ham_status_t
+hash_cursor_insert(Cursor *cursor, ham_key_t *key, ham_record_t *record,
+                ham_u32_t flags);
+
+/** positions the cursor on a key and returns the record */
+extern ham_status_t
+hash_cursor_find(Cursor *cursor, ham_key_t *key, ham_record_t *record,
+                ham_u32_t flags);
+
+/** erases the key of the cursor */
+extern ham_status_t
+hash_cursor_erase(Cursor *cursor, ham_u32_t flags);
+
+/** moves the cursor; only HAM_CURSOR_FIRST and HAM_CURSOR_NEXT are
+ * supported */
+extern ham_status_t
+hash_cursor_move(Cursor *cursor, ham_key_t *key, ham_record_t *record,
+                ham_u32_t flags);
+
+/** overwrites the record of the cursor */
+extern ham_status_t
+hash_cursor_overwrite(Cursor *cursor, ham_record_t *record, ham_u32_t flags);
+
+/** returns the record size of the current key */
+extern ham_status_t
+hash_cursor_get_record_size(Cursor *cursor, ham_offset_t *size);
+
+/** returns the number of duplicates; always 1 */
+extern ham_status_t
+hash_cursor_get_duplicate_count(Cursor *cursor, ham_size_t *count,
+                ham_u32_t flags);
+
+#endif /* HAM_HASHDB_H__ */
@@ -59,11 +59,25 @@ class Log;
 
 class Journal;
 
+class Metrics;
+
+class Tracer;
+
+class Compactor;
+
+class Backup;
+
 struct extkey_t;
 typedef struct extkey_t extkey_t;
 
 class ExtKeyCache;
 
+class BloomFilter;
+
+class FreelistExtents;
+
+class RecordStream;
+
 struct freelist_entry_t;
 typedef struct freelist_entry_t freelist_entry_t;
 
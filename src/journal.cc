@@ -235,6 +235,31 @@ Journal::append_txn_begin(Transaction *txn, Environment *env,
     return (0);
 }
 
+ham_status_t
+Journal::append_entry(int fdidx, void *ptr1, ham_size_t ptr1_size,
+                void *ptr2, ham_size_t ptr2_size,
+                void *ptr3, ham_size_t ptr3_size,
+                void *ptr4, ham_size_t ptr4_size,
+                void *ptr5, ham_size_t ptr5_size)
+{
+    if (Metrics *metrics=m_env->get_metrics())
+        metrics->add_journal_bytes((ham_u64_t)ptr1_size+ptr2_size+ptr3_size
+                    +ptr4_size+ptr5_size);
+
+    return (os_writev(m_fd[fdidx], ptr1, ptr1_size,
+                ptr2, ptr2_size, ptr3, ptr3_size,
+                ptr4, ptr4_size, ptr5, ptr5_size));
+}
+
+ham_status_t
+Journal::flush_file(int fdidx)
+{
+    if (Metrics *metrics=m_env->get_metrics())
+        metrics->inc_fsyncs();
+
+    return (os_flush(m_fd[fdidx]));
+}
+
 ham_status_t
 Journal::append_txn_abort(Transaction *txn, ham_u64_t lsn)
 {
@@ -256,7 +281,7 @@ Journal::append_txn_abort(Transaction *txn, ham_u64_t lsn)
     if (st)
         return (st);
     if (m_env->get_flags()&HAM_WRITE_THROUGH)
-        return (os_flush(m_fd[idx]));
+        return (flush_file(idx));
     return (0);
 }
 
@@ -281,7 +306,7 @@ Journal::append_txn_commit(Transaction *txn, ham_u64_t lsn)
     if (st)
         return (st);
     if (m_env->get_flags()&HAM_WRITE_THROUGH)
-        return (os_flush(m_fd[idx]));
+        return (flush_file(idx));
     return (0);
 }
 
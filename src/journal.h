@@ -165,11 +165,10 @@ class Journal
                 void *ptr2=0, ham_size_t ptr2_size=0,
                 void *ptr3=0, ham_size_t ptr3_size=0,
                 void *ptr4=0, ham_size_t ptr4_size=0,
-                void *ptr5=0, ham_size_t ptr5_size=0) {
-        return (os_writev(m_fd[fdidx], ptr1, ptr1_size,
-                    ptr2, ptr2_size, ptr3, ptr3_size,
-                    ptr4, ptr4_size, ptr5, ptr5_size));
-    }
+                void *ptr5=0, ham_size_t ptr5_size=0);
+
+    /** flushes a journal file to disk */
+    ham_status_t flush_file(int fdidx);
 
     /** clears a single file */
     ham_status_t clear_file(int idx);
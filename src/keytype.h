@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief the built-in key types
+ *
+ * A Database can be created with a key type (@ref HAM_PARAM_KEY_TYPE).
+ * Keys of a typed Database always have the same size, therefore they are
+ * never extended, and they are compared directly with the comparators in
+ * this file instead of calling a compare function through a pointer.
+ * Numeric keys are interpreted in host byte order.
+ *
+ * The comparators are templates; the btree search is instantiated for
+ * every type (see btree_get_slot), and @ref keytype_compare dispatches
+ * to the inlined comparator of a type.
+ */
+
+#ifndef HAM_KEYTYPE_H__
+#define HAM_KEYTYPE_H__
+
+#include <string.h>
+
+#include <ham/hamsterdb.h>
+
+/** compares two numeric keys of type T */
+template<typename T>
+struct NumericKeyCompare
+{
+    static int compare(const void *lhs, ham_size_t lhs_length,
+                    const void *rhs, ham_size_t rhs_length) {
+        T l, r;
+        (void)lhs_length;
+        (void)rhs_length;
+        memcpy(&l, lhs, sizeof(T));
+        memcpy(&r, rhs, sizeof(T));
+        if (l<r)
+            return (-1);
+        if (r<l)
+            return (+1);
+        return (0);
+    }
+};
+
+/** compares two binary keys of the same (fixed) length */
+struct FixedBinaryKeyCompare
+{
+    static int compare(const void *lhs, ham_size_t lhs_length,
+                    const void *rhs, ham_size_t rhs_length) {
+        int m;
+        (void)rhs_length;
+        m=memcmp(lhs, rhs, lhs_length);
+        if (m<0)
+            return (-1);
+        if (m>0)
+            return (+1);
+        return (0);
+    }
+};
+
+/** a @ref ham_compare_func_t which calls the comparator @a Compare */
+template<class Compare>
+int HAM_CALLCONV
+keytype_compare_func(ham_db_t *db,
+                const ham_u8_t *lhs, ham_size_t lhs_length,
+                const ham_u8_t *rhs, ham_size_t rhs_length)
+{
+    (void)db;
+    return (Compare::compare(lhs, lhs_length, rhs, rhs_length));
+}
+
+/** compares two keys of a typed Database */
+inline int
+keytype_compare(ham_u16_t type, const void *lhs, ham_size_t lhs_length,
+                const void *rhs, ham_size_t rhs_length)
+{
+    switch (type) {
+      case HAM_TYPE_UINT32:
+        return (NumericKeyCompare<ham_u32_t>::compare(lhs, lhs_length,
+                    rhs, rhs_length));
+      case HAM_TYPE_UINT64:
+        return (NumericKeyCompare<ham_u64_t>::compare(lhs, lhs_length,
+                    rhs, rhs_length));
+      case HAM_TYPE_INT64:
+        return (NumericKeyCompare<ham_s64_t>::compare(lhs, lhs_length,
+                    rhs, rhs_length));
+      case HAM_TYPE_REAL64:
+        return (NumericKeyCompare<double>::compare(lhs, lhs_length,
+                    rhs, rhs_length));
+      default:
+        return (FixedBinaryKeyCompare::compare(lhs, lhs_length,
+                    rhs, rhs_length));
+    }
+}
+
+/** returns the compare function of a key type */
+inline ham_compare_func_t
+keytype_get_compare_func(ham_u16_t type)
+{
+    switch (type) {
+      case HAM_TYPE_UINT32:
+        return (keytype_compare_func<NumericKeyCompare<ham_u32_t> >);
+      case HAM_TYPE_UINT64:
+        return (keytype_compare_func<NumericKeyCompare<ham_u64_t> >);
+      case HAM_TYPE_INT64:
+        return (keytype_compare_func<NumericKeyCompare<ham_s64_t> >);
+      case HAM_TYPE_REAL64:
+        return (keytype_compare_func<NumericKeyCompare<double> >);
+      case HAM_TYPE_BINARY_FIXED:
+        return (keytype_compare_func<FixedBinaryKeyCompare>);
+      default:
+        return (0);
+    }
+}
+
+/**
+ * returns the size of a numeric key type, or 0 for binary keys; the
+ * size of HAM_TYPE_BINARY_FIXED keys is the key size of the Database
+ */
+inline ham_u16_t
+keytype_get_size(ham_u16_t type)
+{
+    switch (type) {
+      case HAM_TYPE_UINT32:
+        return (sizeof(ham_u32_t));
+      case HAM_TYPE_UINT64:
+      case HAM_TYPE_INT64:
+      case HAM_TYPE_REAL64:
+        return (sizeof(ham_u64_t));
+      default:
+        return (0);
+    }
+}
+
+#endif /* HAM_KEYTYPE_H__ */
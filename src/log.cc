@@ -205,6 +205,9 @@ Log::append_page(Page *page, ham_u64_t lsn, ham_size_t page_count)
     ham_u8_t *p;
     ham_size_t size=m_env->get_pagesize();
 
+    /* the logged page already contains the checksum */
+    device_update_checksum(m_env, page);
+
     /*
      * run page through page-level filters, but not for the
      * root-page!
@@ -215,14 +218,7 @@ Log::append_page(Page *page, ham_u64_t lsn, ham_size_t page_count)
             return (HAM_OUT_OF_MEMORY);
         memcpy(p, page->get_raw_payload(), size);
 
-        while (head) {
-            if (head->before_write_cb) {
-                st=head->before_write_cb((ham_env_t *)m_env, head, p, size);
-                if (st)
-                    break;
-            }
-            head=head->_next;
-        }
+        st=device_filters_before_write(m_env, page->get_self(), p, size);
     }
     else
         p=(ham_u8_t *)page->get_raw_payload();
@@ -310,8 +306,10 @@ Log::recover()
                 goto bail;
         }
         else {
-            /* overwritten... */
+            /* overwritten... the current contents are irrelevant (and
+             * maybe corrupt), therefore the checksum is not verified */
             page=new Page(m_env);
+            page->set_flags(Page::NPERS_NO_HEADER);
             st=page->fetch(entry.offset);
             if (st)
                 goto bail;
@@ -367,6 +365,9 @@ bail:
 ham_status_t
 Log::flush(void)
 {
+    if (Metrics *metrics=m_env->get_metrics())
+        metrics->inc_fsyncs();
+
     return (os_flush(m_fd));
 }
 
@@ -385,6 +386,9 @@ Log::append_write(ham_u64_t lsn, ham_u32_t flags, ham_offset_t offset,
     entry.offset=offset;
     entry.data_size=size;
 
+    if (Metrics *metrics=m_env->get_metrics())
+        metrics->add_log_bytes(size+sizeof(entry));
+
     return (os_writev(m_fd, data, size, &entry, sizeof(entry)));
 }
 
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief implementation of the runtime metrics
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "env.h"
+#include "metrics.h"
+
+/*
+ * the histogram is log-linear: the values 0..3 have their own buckets;
+ * every following power of two is split into 4 equally sized sub-buckets.
+ */
+#define SUB_BUCKETS         4
+#define SUB_BUCKET_BITS     2
+
+void
+Metrics::reset()
+{
+    memset(&m_data, 0, sizeof(m_data));
+}
+
+int
+Metrics::get_bucket(ham_u64_t ns)
+{
+    if (ns<SUB_BUCKETS)
+        return ((int)ns);
+
+    int msb=63;
+    while (!(ns&(1ull<<msb)))
+        msb--;
+
+    int sub=(int)((ns>>(msb-SUB_BUCKET_BITS))&(SUB_BUCKETS-1));
+    int bucket=SUB_BUCKETS+(msb-SUB_BUCKET_BITS)*SUB_BUCKETS+sub;
+    if (bucket>=HAM_METRICS_HISTOGRAM_BUCKETS)
+        bucket=HAM_METRICS_HISTOGRAM_BUCKETS-1;
+    return (bucket);
+}
+
+ham_u64_t
+Metrics::get_bucket_upper_bound(int bucket)
+{
+    if (bucket<SUB_BUCKETS)
+        return ((ham_u64_t)bucket);
+
+    int shift=(bucket-SUB_BUCKETS)/SUB_BUCKETS;
+    int sub=(bucket-SUB_BUCKETS)%SUB_BUCKETS;
+    ham_u64_t low=((ham_u64_t)(SUB_BUCKETS+sub))<<shift;
+    return (low+(1ull<<shift)-1);
+}
+
+void
+Metrics::record_operation(int op, ham_u64_t ns)
+{
+    ham_latency_histogram_t *h=&m_data.operations[op];
+
+    if (h->count==0 || ns<h->min_ns)
+        h->min_ns=ns;
+    if (ns>h->max_ns)
+        h->max_ns=ns;
+    h->count++;
+    h->total_ns+=ns;
+    h->buckets[get_bucket(ns)]++;
+}
+
+void
+Metrics::lock(Environment *env, ScopedLock &lock)
+{
+    Metrics *metrics=env->get_metrics();
+    if (!metrics) {
+        lock=ScopedLock(env->get_mutex());
+        return;
+    }
+
+    /* only measure the time if the lock is contended */
+    ScopedLock l(env->get_mutex(), boost::try_to_lock);
+    if (!l.owns_lock()) {
+        ham_u64_t start=os_get_time_ns();
+        l.lock();
+        metrics->record_lock_wait(os_get_time_ns()-start);
+    }
+    lock.swap(l);
+}
+
+OperationTimer::OperationTimer(Environment *env, int op)
+  : m_metrics(env->get_metrics()), m_op(op), m_start(0)
+{
+    if (m_metrics)
+        m_start=os_get_time_ns();
+}
+
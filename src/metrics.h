@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief runtime metrics - latency histograms and I/O counters
+ *
+ */
+
+#ifndef HAM_METRICS_H__
+#define HAM_METRICS_H__
+
+#include "internal_fwd_decl.h"
+
+#include <ham/hamsterdb_int.h>
+
+#include "os.h"
+
+/**
+ * The runtime metrics of an Environment
+ *
+ * All methods are called while the Environment mutex is held, therefore
+ * no further synchronization is required.
+ */
+class Metrics
+{
+  public:
+    /** constructor */
+    Metrics() {
+        reset();
+    }
+
+    /** resets all counters and histograms */
+    void reset();
+
+    /** records the latency of an operation (in nanoseconds) */
+    void record_operation(int op, ham_u64_t ns);
+
+    /** records time spent waiting for the Environment lock */
+    void record_lock_wait(ham_u64_t ns) {
+        m_data.lock_waits++;
+        m_data.lock_wait_ns+=ns;
+    }
+
+    /** increments the number of cache hits */
+    void inc_cache_hits() {
+        m_data.cache_hits++;
+    }
+
+    /** increments the number of cache misses */
+    void inc_cache_misses() {
+        m_data.cache_misses++;
+    }
+
+    /** accounts a page which was read from the device */
+    void inc_pages_read() {
+        m_data.pages_read++;
+    }
+
+    /** accounts a page which was written to the device */
+    void inc_pages_written() {
+        m_data.pages_written++;
+    }
+
+    /** accounts a write of one or several adjacent pages */
+    void inc_page_writes() {
+        m_data.page_writes++;
+    }
+
+    /** accounts bytes which were read from the device */
+    void add_bytes_read(ham_u64_t bytes) {
+        m_data.bytes_read+=bytes;
+    }
+
+    /** accounts bytes which were written to the device */
+    void add_bytes_written(ham_u64_t bytes) {
+        m_data.bytes_written+=bytes;
+    }
+
+    /** accounts a single fsync/fdatasync */
+    void inc_fsyncs() {
+        m_data.fsyncs++;
+    }
+
+    /** accounts bytes appended to the log */
+    void add_log_bytes(ham_u64_t bytes) {
+        m_data.log_bytes+=bytes;
+    }
+
+    /** accounts bytes appended to the journal */
+    void add_journal_bytes(ham_u64_t bytes) {
+        m_data.journal_bytes+=bytes;
+    }
+
+    /** accounts a page or a record which did not match its checksum */
+    void inc_checksum_failures() {
+        m_data.checksum_failures++;
+    }
+
+    /** records a page which was passed to the page compression */
+    void add_compressed_page(ham_u64_t bytes_in, ham_u64_t bytes_out) {
+        m_data.compressed_pages++;
+        m_data.compression_bytes_in+=bytes_in;
+        m_data.compression_bytes_out+=bytes_out;
+    }
+
+    /** returns the collected data */
+    const ham_env_metrics_t *get_data() const {
+        return (&m_data);
+    }
+
+    /** returns the histogram bucket for a latency */
+    static int get_bucket(ham_u64_t ns);
+
+    /** returns the largest latency which falls into a bucket */
+    static ham_u64_t get_bucket_upper_bound(int bucket);
+
+    /**
+     * acquires the Environment mutex; if metrics are enabled, a contended
+     * lock is accounted in the lock-wait counters
+     */
+    static void lock(Environment *env, ScopedLock &lock);
+
+  private:
+    /** the collected data */
+    ham_env_metrics_t m_data;
+};
+
+/**
+ * A helper class which measures the latency of an operation
+ *
+ * Has to be declared AFTER the ScopedLock of the API function, so that it
+ * is destroyed while the lock is still held.
+ */
+class OperationTimer
+{
+  public:
+    /** constructor; starts the timer if metrics are enabled */
+    OperationTimer(Environment *env, int op);
+
+    /** destructor; records the elapsed time */
+    ~OperationTimer() {
+        if (m_metrics)
+            m_metrics->record_operation(m_op, os_get_time_ns()-m_start);
+    }
+
+  private:
+    /** the metrics object, or NULL if metrics are disabled */
+    Metrics *m_metrics;
+
+    /** the operation index */
+    int m_op;
+
+    /** the start time */
+    ham_u64_t m_start;
+};
+
+#endif /* HAM_METRICS_H__ */
@@ -57,6 +57,14 @@ extern ham_status_t
 os_pwrite(ham_fd_t fd, ham_offset_t addr, const void *buffer,
         ham_offset_t bufferlen);
 
+/**
+ * write data from several buffers to a file; the data of all buffers is
+ * written to consecutive addresses, starting at @a addr
+ */
+extern ham_status_t
+os_pwritev(ham_fd_t fd, ham_offset_t addr, void **buffers,
+        const ham_size_t *sizes, ham_size_t count);
+
 /**
  * append data to a file
  */
@@ -121,6 +129,16 @@ os_get_filesize(ham_fd_t fd, ham_offset_t *size);
 extern ham_status_t
 os_truncate(ham_fd_t fd, ham_offset_t newsize);
 
+/**
+ * deallocates the blocks of a range in the file without changing the
+ * file size; the range reads as zeroes afterwards
+ *
+ * returns HAM_NOT_IMPLEMENTED if the operating system or the file system
+ * does not support this
+ */
+extern ham_status_t
+os_punch_hole(ham_fd_t fd, ham_offset_t offset, ham_offset_t size);
+
 /**
  * create a new file
  */
@@ -145,5 +163,12 @@ os_flush(ham_fd_t fd);
 extern ham_status_t
 os_close(ham_fd_t fd, ham_u32_t flags);
 
+/**
+ * returns a monotonic timestamp in nanoseconds; only useful for
+ * measuring time differences
+ */
+extern ham_u64_t
+os_get_time_ns(void);
+
 
 #endif /* HAM_OS_H__ */
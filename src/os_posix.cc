@@ -20,12 +20,14 @@
 #if HAVE_MMAP
 #  include <sys/mman.h>
 #endif
-#if HAVE_WRITEV
+#if HAVE_WRITEV || HAVE_PWRITEV
 #  include <sys/uio.h>
 #endif
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/file.h>
+#include <sys/time.h>
+#include <time.h>
 #include <fcntl.h>
 #include <unistd.h>
 
@@ -243,6 +245,55 @@ os_pwrite(ham_fd_t fd, ham_offset_t addr, const void *buffer,
 #endif
 }
  
+ham_status_t
+os_pwritev(ham_fd_t fd, ham_offset_t addr, void **buffers,
+        const ham_size_t *sizes, ham_size_t count)
+{
+#if HAVE_PWRITEV
+    struct iovec vec[64];
+    ham_offset_t total=0;
+    ham_size_t i=0, skip=0;
+
+    while (i<count) {
+        int c=0;
+        for (ham_size_t j=i; j<count && c<64; j++, c++) {
+            vec[c].iov_base=(ham_u8_t *)buffers[j]+(j==i ? skip : 0);
+            vec[c].iov_len=sizes[j]-(j==i ? skip : 0);
+        }
+
+        ssize_t w=pwritev(fd, &vec[0], c, addr+total);
+        if (w<0) {
+            ham_log(("pwritev() failed with status %u (%s)",
+                    errno, strerror(errno)));
+            return (HAM_IO_ERROR);
+        }
+        if (w==0)
+            return (HAM_IO_ERROR);
+        total+=w;
+
+        /* a short write continues with the first incomplete buffer */
+        while (i<count && (ham_size_t)w>=sizes[i]-skip) {
+            w-=sizes[i]-skip;
+            skip=0;
+            i++;
+        }
+        skip+=(ham_size_t)w;
+    }
+
+    return (os_seek(fd, addr+total, HAM_OS_SEEK_SET));
+#else
+    ham_status_t st;
+
+    for (ham_size_t i=0; i<count; i++) {
+        st=os_pwrite(fd, addr, buffers[i], sizes[i]);
+        if (st)
+            return (st);
+        addr+=sizes[i];
+    }
+    return (0);
+#endif
+}
+
 ham_status_t
 os_writev(ham_fd_t fd, void *buffer1, ham_offset_t buffer1_len,
                 void *buffer2, ham_offset_t buffer2_len,
@@ -378,6 +429,25 @@ os_truncate(ham_fd_t fd, ham_offset_t newsize)
     return (HAM_SUCCESS);
 }
 
+ham_status_t
+os_punch_hole(ham_fd_t fd, ham_offset_t offset, ham_offset_t size)
+{
+#ifdef FALLOC_FL_PUNCH_HOLE
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
+                offset, size)==0)
+        return (HAM_SUCCESS);
+    if (errno==EOPNOTSUPP || errno==ENOSYS)
+        return (HAM_NOT_IMPLEMENTED);
+    ham_log(("fallocate failed with status %u (%s)", errno, strerror(errno)));
+    return (HAM_IO_ERROR);
+#else
+    (void)fd;
+    (void)offset;
+    (void)size;
+    return (HAM_NOT_IMPLEMENTED);
+#endif
+}
+
 ham_status_t
 os_create(const char *filename, ham_u32_t flags, ham_u32_t mode, ham_fd_t *fd)
 {
@@ -485,3 +555,16 @@ os_close(ham_fd_t fd, ham_u32_t flags)
 
     return (HAM_SUCCESS);
 }
+
+ham_u64_t
+os_get_time_ns(void)
+{
+#if HAVE_CLOCK_GETTIME
+    struct timespec ts;
+    if (0==clock_gettime(CLOCK_MONOTONIC, &ts))
+        return ((ham_u64_t)ts.tv_sec*1000000000ull+(ham_u64_t)ts.tv_nsec);
+#endif
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return ((ham_u64_t)tv.tv_sec*1000000000ull+(ham_u64_t)tv.tv_usec*1000ull);
+}
@@ -287,6 +287,23 @@ os_write(ham_fd_t fd, const void *buffer, ham_offset_t bufferlen)
     return (written==bufferlen ? HAM_SUCCESS : HAM_IO_ERROR);
 }
 
+ham_status_t
+os_pwritev(ham_fd_t fd, ham_offset_t addr, void **buffers,
+        const ham_size_t *sizes, ham_size_t count)
+{
+    /* see os_writev: WriteFileGather requires page-aligned buffers of
+     * exactly one memory page */
+    ham_status_t st;
+
+    for (ham_size_t i=0; i<count; i++) {
+        st=os_pwrite(fd, addr, buffers[i], sizes[i]);
+        if (st)
+            return (st);
+        addr+=sizes[i];
+    }
+    return (0);
+}
+
 ham_status_t
 os_writev(ham_fd_t fd, void *buffer1, ham_offset_t buffer1_len,
                 void *buffer2, ham_offset_t buffer2_len,
@@ -422,6 +439,16 @@ os_truncate(ham_fd_t fd, ham_offset_t newsize)
     return (HAM_SUCCESS);
 }
 
+ham_status_t
+os_punch_hole(ham_fd_t fd, ham_offset_t offset, ham_offset_t size)
+{
+    /* FSCTL_SET_ZERO_DATA requires sparse files, which are not used */
+    (void)fd;
+    (void)offset;
+    (void)size;
+    return (HAM_NOT_IMPLEMENTED);
+}
+
 ham_status_t
 os_create(const char *filename, ham_u32_t flags, ham_u32_t mode, ham_fd_t *fd)
 {
@@ -543,3 +570,19 @@ os_close(ham_fd_t fd, ham_u32_t flags)
 
     return (HAM_SUCCESS);
 }
+
+ham_u64_t
+os_get_time_ns(void)
+{
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
+
+    if (!frequency.QuadPart)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+
+    /* split the division to avoid an overflow of the multiplication */
+    return ((ham_u64_t)(now.QuadPart/frequency.QuadPart)*1000000000ull
+            +(ham_u64_t)(now.QuadPart%frequency.QuadPart)*1000000000ull
+                /frequency.QuadPart);
+}
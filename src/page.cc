@@ -15,6 +15,7 @@
 #include <string.h>
 
 #include "cache.h"
+#include "checksum.h"
 #include "cursor.h"
 #include "db.h"
 #include "device.h"
@@ -75,6 +76,30 @@ Page::flush()
     return (HAM_SUCCESS);
 }
 
+/** the checksum covers the whole page except the checksum itself */
+static ham_u32_t
+__calc_checksum(page_data_t *pers, ham_size_t pagesize)
+{
+    ham_size_t skip=OFFSETOF(page_data_t, _s._reserved2);
+    ham_u32_t crc=crc32c(0, pers->_p, OFFSETOF(page_data_t, _s._reserved1));
+    return (crc32c(crc, &pers->_p[skip], pagesize-skip));
+}
+
+void
+Page::set_checksum()
+{
+    m_pers->_s._reserved2=ham_h2db32(CHECKSUM_MAGIC);
+    m_pers->_s._reserved1=ham_h2db32(__calc_checksum(m_pers,
+                get_device()->get_pagesize()));
+}
+
+bool
+Page::verify_checksum()
+{
+    return (ham_db2h32(m_pers->_s._reserved1)
+            ==__calc_checksum(m_pers, get_device()->get_pagesize()));
+}
+
 ham_status_t
 Page::free()
 {
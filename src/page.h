@@ -45,7 +45,10 @@ HAM_PACK_0 struct HAM_PACK_1 page_header_t {
      */
     ham_u32_t _flags;
 
-    /** some reserved bytes */
+    /**
+     * some reserved bytes; if the page has a checksum then _reserved1
+     * stores the CRC32C and _reserved2 is @ref Page::CHECKSUM_MAGIC
+     */
     ham_u32_t _reserved1;
     ham_u32_t _reserved2;
 
@@ -120,6 +123,11 @@ class Page {
         NPERS_NO_HEADER         = 4
     };
 
+    enum {
+        /** the marker of a page header which stores a checksum ("CSUM") */
+        CHECKSUM_MAGIC          = 0x4d555343
+    };
+
     /**
      * Page types
      *
@@ -139,7 +147,15 @@ class Page {
         /** a freelist management page */
         TYPE_FREELIST           =  0x40000000,
         /** a page which stores (the front part of) a BLOB. */
-        TYPE_BLOB               =  0x50000000
+        TYPE_BLOB               =  0x50000000,
+        /** the root page of a hash index */
+        TYPE_H_ROOT             =  0x60000000,
+        /** a directory page of a hash index */
+        TYPE_H_DIRECTORY        =  0x70000000,
+        /** a bucket page of a hash index */
+        TYPE_H_BUCKET           =  0x80000000,
+        /** a page with slots for small records (see slab.h) */
+        TYPE_SLAB               =  0x90000000
     };
 
 
@@ -284,6 +300,23 @@ class Page {
     /** write a page to the device */
     ham_status_t flush();
 
+    /** calculates the checksum of the page and stores it in the header */
+    void set_checksum();
+
+    /** removes the checksum from the page header */
+    void clear_checksum() {
+        m_pers->_s._reserved1=0;
+        m_pers->_s._reserved2=0;
+    }
+
+    /** returns true if the page header stores a checksum */
+    bool has_checksum() {
+        return (ham_db2h32(m_pers->_s._reserved2)==(ham_u32_t)CHECKSUM_MAGIC);
+    }
+
+    /** returns false if the page does not match its checksum */
+    bool verify_checksum();
+
     /** frees a page - deletes the persistent part and moves the page to
      * the freelist (if a freelist is available) */
     ham_status_t free();
@@ -661,11 +661,11 @@ proto_env_create_db_request_get_param_names(proto_wrapper_t *wrapper)
     return ((ham_u32_t *)w->mutable_env_create_db_request()->mutable_param_names()->data());
 }
 
-ham_u32_t *
+ham_u64_t *
 proto_env_create_db_request_get_param_values(proto_wrapper_t *wrapper)
 {
     Wrapper *w=(Wrapper *)wrapper;
-    return ((ham_u32_t *)w->mutable_env_create_db_request()->mutable_param_values()->data());
+    return ((ham_u64_t *)w->mutable_env_create_db_request()->mutable_param_values()->mutable_data());
 }
 
 ham_u32_t
@@ -772,11 +772,11 @@ proto_env_open_db_request_get_param_names(proto_wrapper_t *wrapper)
     return ((ham_u32_t *)w->mutable_env_open_db_request()->mutable_param_names()->data());
 }
 
-ham_u32_t *
+ham_u64_t *
 proto_env_open_db_request_get_param_values(proto_wrapper_t *wrapper)
 {
     Wrapper *w=(Wrapper *)wrapper;
-    return ((ham_u32_t *)w->mutable_env_open_db_request()->mutable_param_values()->data());
+    return ((ham_u64_t *)w->mutable_env_open_db_request()->mutable_param_values()->mutable_data());
 }
 
 ham_u32_t
@@ -1421,6 +1421,50 @@ proto_db_get_parameters_reply_get_dam(proto_wrapper_t *wrapper)
     return (w->db_get_parameters_reply().dam());
 }
 
+void
+proto_db_get_parameters_reply_set_key_type(proto_wrapper_t *wrapper,
+                ham_u32_t key_type)
+{
+    Wrapper *w=(Wrapper *)wrapper;
+    w->mutable_db_get_parameters_reply()->set_key_type(key_type);
+}
+
+ham_bool_t
+proto_db_get_parameters_reply_has_key_type(proto_wrapper_t *wrapper)
+{
+    Wrapper *w=(Wrapper *)wrapper;
+    return (w->db_get_parameters_reply().has_key_type());
+}
+
+ham_u32_t
+proto_db_get_parameters_reply_get_key_type(proto_wrapper_t *wrapper)
+{
+    Wrapper *w=(Wrapper *)wrapper;
+    return (w->db_get_parameters_reply().key_type());
+}
+
+void
+proto_db_get_parameters_reply_set_record_inline_size(proto_wrapper_t *wrapper,
+                ham_u32_t record_inline_size)
+{
+    Wrapper *w=(Wrapper *)wrapper;
+    w->mutable_db_get_parameters_reply()->set_record_inline_size(record_inline_size);
+}
+
+ham_bool_t
+proto_db_get_parameters_reply_has_record_inline_size(proto_wrapper_t *wrapper)
+{
+    Wrapper *w=(Wrapper *)wrapper;
+    return (w->db_get_parameters_reply().has_record_inline_size());
+}
+
+ham_u32_t
+proto_db_get_parameters_reply_get_record_inline_size(proto_wrapper_t *wrapper)
+{
+    Wrapper *w=(Wrapper *)wrapper;
+    return (w->db_get_parameters_reply().record_inline_size());
+}
+
 proto_wrapper_t *
 proto_init_check_integrity_request(ham_u64_t dbhandle, ham_u64_t txnhandle)
 {
@@ -366,7 +366,7 @@ proto_env_create_db_request_get_num_params(proto_wrapper_t *wrapper);
 extern ham_u32_t *
 proto_env_create_db_request_get_param_names(proto_wrapper_t *wrapper);
 
-extern ham_u32_t *
+extern ham_u64_t *
 proto_env_create_db_request_get_param_values(proto_wrapper_t *wrapper);
 
 extern ham_u32_t
@@ -411,7 +411,7 @@ proto_env_open_db_request_get_num_params(proto_wrapper_t *wrapper);
 extern ham_u32_t *
 proto_env_open_db_request_get_param_names(proto_wrapper_t *wrapper);
 
-extern ham_u32_t *
+extern ham_u64_t *
 proto_env_open_db_request_get_param_values(proto_wrapper_t *wrapper);
 
 extern ham_u32_t
@@ -681,6 +681,26 @@ proto_db_get_parameters_reply_has_dam(proto_wrapper_t *wrapper);
 extern ham_u32_t
 proto_db_get_parameters_reply_get_dam(proto_wrapper_t *wrapper);
 
+extern void
+proto_db_get_parameters_reply_set_key_type(proto_wrapper_t *wrapper,
+                ham_u32_t key_type);
+
+extern ham_bool_t
+proto_db_get_parameters_reply_has_key_type(proto_wrapper_t *wrapper);
+
+extern ham_u32_t
+proto_db_get_parameters_reply_get_key_type(proto_wrapper_t *wrapper);
+
+extern void
+proto_db_get_parameters_reply_set_record_inline_size(proto_wrapper_t *wrapper,
+                ham_u32_t record_inline_size);
+
+extern ham_bool_t
+proto_db_get_parameters_reply_has_record_inline_size(proto_wrapper_t *wrapper);
+
+extern ham_u32_t
+proto_db_get_parameters_reply_get_record_inline_size(proto_wrapper_t *wrapper);
+
 /*
  * check_integrity request
  */
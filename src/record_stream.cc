@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief implementation of record_stream.h
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "blob.h"
+#include "btree.h"
+#include "btree_cursor.h"
+#include "btree_key.h"
+#include "cache.h"
+#include "cursor.h"
+#include "db.h"
+#include "env.h"
+#include "error.h"
+#include "page.h"
+#include "record_stream.h"
+#include "slab.h"
+
+#define DUMMY_LSN           1
+
+/** the flags of records which are not stored in a blob */
+#define SMALL_RECORD_FLAGS  (KEY_BLOB_SIZE_TINY|KEY_BLOB_SIZE_SMALL         \
+                            |KEY_BLOB_SIZE_EMPTY|KEY_BLOB_SIZE_INLINE)
+
+/** the largest record which is not stored in a blob */
+#define MAX_SMALL_RECORD    256
+
+/** the largest capacity of a blob */
+#define MAX_CAPACITY        (0xffffffffu-sizeof(blob_t)-DB_CHUNKSIZE)
+
+RecordStream::RecordStream(Cursor *cursor, ham_u32_t flags)
+  : m_cursor(cursor), m_next(cursor->get_streams()), m_previous(0),
+    m_flags(flags), m_blobid(0), m_size(0), m_capacity(0), m_position(0),
+    m_written(false)
+{
+    if (m_next)
+        m_next->m_previous=this;
+    cursor->set_streams(this);
+}
+
+RecordStream::~RecordStream()
+{
+    if (m_cursor)
+        detach();
+}
+
+void
+RecordStream::detach()
+{
+    if (m_previous)
+        m_previous->m_next=m_next;
+    else
+        m_cursor->set_streams(m_next);
+    if (m_next)
+        m_next->m_previous=m_previous;
+
+    m_next=0;
+    m_previous=0;
+    m_cursor=0;
+}
+
+ham_status_t
+RecordStream::open()
+{
+    ham_status_t st=refresh();
+    if (st)
+        return (st);
+
+    m_position=(m_flags&HAM_RECORD_STREAM_APPEND) ? m_size : 0;
+    return (0);
+}
+
+ham_status_t
+RecordStream::refresh()
+{
+    ham_status_t st;
+    Database *db=m_cursor->get_db();
+    btree_cursor_t *c=m_cursor->get_btree_cursor();
+    Page *page;
+    btree_key_t *entry;
+    ham_offset_t blobid=0;
+
+    st=btree_cursor_get_entry(c, &page, &entry);
+    if (st)
+        return (st);
+
+    if (key_get_flags(entry)&KEY_HAS_DUPLICATES) {
+        ham_trace(("records of duplicate keys can not be streamed"));
+        return (HAM_INV_PARAMETER);
+    }
+
+    /* small records are moved to a blob when they are written */
+    if (!(key_get_flags(entry)&SMALL_RECORD_FLAGS)
+            && !SlabAllocator::is_slab_rid(key_get_ptr(entry)))
+        blobid=key_get_ptr(entry);
+
+    /* the checksum of a different blob was not yet removed */
+    if (blobid!=m_blobid)
+        m_written=false;
+    m_blobid=blobid;
+
+    if (!m_blobid) {
+        m_capacity=0;
+        return (btree_cursor_get_record_size(c, &m_size));
+    }
+    return (blob_get_capacity(db->get_env(), db, m_blobid, &m_size,
+                &m_capacity));
+}
+
+ham_status_t
+RecordStream::read_small(ham_u8_t *buffer)
+{
+    ham_status_t st;
+    Database *db=m_cursor->get_db();
+    Page *page;
+    btree_key_t *entry;
+    ham_record_t record;
+
+    ham_assert(m_size<=MAX_SMALL_RECORD, (""));
+
+    st=btree_cursor_get_entry(m_cursor->get_btree_cursor(), &page, &entry);
+    if (st)
+        return (st);
+
+    memset(&record, 0, sizeof(record));
+    record.data=buffer;
+    record.flags=HAM_RECORD_USER_ALLOC;
+    record._intflags=key_get_flags(entry);
+    record._rid=key_get_ptr(entry);
+    return (btree_read_record(db, 0, &record,
+                key_get_rawptr_address(entry), 0));
+}
+
+ham_status_t
+RecordStream::read(void *data, ham_size_t size, ham_size_t *bytes_read)
+{
+    Environment *env=m_cursor->get_db()->get_env();
+    ham_status_t st=begin();
+
+    if (!st)
+        st=read_range(data, size, bytes_read);
+    env->get_changeset().clear();
+    return (st);
+}
+
+ham_status_t
+RecordStream::write(const void *data, ham_size_t size)
+{
+    Environment *env=m_cursor->get_db()->get_env();
+    ham_status_t st=begin();
+
+    if (!st)
+        st=write_range(data, size);
+    if (st || !(env->get_flags()&HAM_ENABLE_RECOVERY)) {
+        env->get_changeset().clear();
+        return (st);
+    }
+
+    /* without Transactions, the modified pages are flushed after
+     * every operation */
+    return (env->get_changeset().flush(DUMMY_LSN));
+}
+
+ham_status_t
+RecordStream::begin()
+{
+    Environment *env=m_cursor->get_db()->get_env();
+    Cache *cache=env->get_cache();
+
+    if (cache && !(env->get_flags()&HAM_IN_MEMORY_DB) && cache->is_too_big()) {
+        ham_status_t st=env_purge_cache(env);
+        if (st)
+            return (st);
+    }
+    return (refresh());
+}
+
+ham_status_t
+RecordStream::read_range(void *data, ham_size_t size, ham_size_t *bytes_read)
+{
+    ham_status_t st;
+    Database *db=m_cursor->get_db();
+
+    *bytes_read=0;
+
+    if (m_position>=m_size)
+        return (0);
+    if (size>m_size-m_position)
+        size=(ham_size_t)(m_size-m_position);
+
+    if (m_blobid) {
+        st=blob_read_range(db->get_env(), db, m_blobid, m_position,
+                data, size);
+        if (st)
+            return (st);
+    }
+    else {
+        ham_u8_t buffer[MAX_SMALL_RECORD];
+        st=read_small(buffer);
+        if (st)
+            return (st);
+        memcpy(data, buffer+m_position, size);
+    }
+
+    m_position+=size;
+    *bytes_read=size;
+    return (0);
+}
+
+ham_status_t
+RecordStream::reserve(ham_offset_t capacity)
+{
+    ham_status_t st;
+    Database *db=m_cursor->get_db();
+    Environment *env=db->get_env();
+    Page *page;
+    btree_key_t *entry;
+    ham_offset_t blobid, size, rid;
+    ham_u32_t flags;
+    ham_u8_t buffer[MAX_SMALL_RECORD];
+
+    /* leave room for further appends; records which are written
+     * in one piece are not padded */
+    if (m_size)
+        capacity+=capacity/2;
+    if (capacity>MAX_CAPACITY)
+        capacity=MAX_CAPACITY;
+
+    st=btree_cursor_get_entry(m_cursor->get_btree_cursor(), &page, &entry);
+    if (st)
+        return (st);
+    flags=key_get_flags(entry);
+    rid=key_get_ptr(entry);
+
+    if (m_blobid) {
+        st=blob_reserve(env, db, m_blobid, (ham_size_t)capacity, &blobid);
+        if (st)
+            return (st);
+    }
+    else {
+        /* a small record is copied to the new blob; a slot of a slab
+         * page is freed afterwards */
+        if (m_size) {
+            st=read_small(buffer);
+            if (st)
+                return (st);
+        }
+        st=blob_reserve(env, db, 0, (ham_size_t)capacity, &blobid);
+        if (st)
+            return (st);
+        if (m_size) {
+            st=blob_write_range(env, db, blobid, 0, buffer,
+                    (ham_size_t)m_size);
+            if (!st)
+                st=blob_set_datasize(env, db, blobid, m_size);
+            if (st) {
+                (void)blob_free(env, db, blobid, 0);
+                return (st);
+            }
+        }
+        if (!(flags&SMALL_RECORD_FLAGS) && SlabAllocator::is_slab_rid(rid)) {
+            st=blob_free(env, db, rid, 0);
+            if (st)
+                return (st);
+        }
+    }
+
+    /* the key now refers to the new blob; the allocations may have
+     * moved the page in the cache, therefore it's fetched again */
+    st=btree_cursor_get_entry(m_cursor->get_btree_cursor(), &page, &entry);
+    if (st)
+        return (st);
+    key_set_flags(entry, flags&~SMALL_RECORD_FLAGS);
+    key_set_ptr(entry, blobid);
+    page->set_dirty(true);
+    if (env->get_flags()&HAM_ENABLE_RECOVERY)
+        env->get_changeset().add_page(page);
+
+    m_blobid=blobid;
+    return (blob_get_capacity(env, db, m_blobid, &size, &m_capacity));
+}
+
+ham_status_t
+RecordStream::write_range(const void *data, ham_size_t size)
+{
+    ham_status_t st;
+    Database *db=m_cursor->get_db();
+    Environment *env=db->get_env();
+    ham_offset_t end=m_position+size;
+
+    if (!size)
+        return (0);
+    if (end>MAX_CAPACITY) {
+        ham_trace(("the record would exceed the maximum record size"));
+        return (HAM_LIMITS_REACHED);
+    }
+
+    if (!m_blobid || end>m_capacity) {
+        st=reserve(end);
+        if (st)
+            return (st);
+        m_written=true;
+    }
+
+    st=blob_write_range(env, db, m_blobid, m_position, data, size);
+    if (st)
+        return (st);
+
+    m_position=end;
+
+    /* the first write removes the checksum */
+    if (end>m_size || !m_written) {
+        if (end>m_size)
+            m_size=end;
+        st=blob_set_datasize(env, db, m_blobid, m_size);
+        if (st)
+            return (st);
+        m_written=true;
+    }
+
+    return (0);
+}
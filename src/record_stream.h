@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief streams for reading and writing large records in pieces
+ *
+ * A RecordStream (see @ref ham_record_stream_open) reads and writes the
+ * record of the current key of a Cursor. Every read and write directly
+ * accesses the requested range of the blob; the record is never loaded
+ * into memory as a whole. The blob ID is fetched from the btree key before
+ * every operation, because the blob can be moved while the stream is open
+ * (i.e. by ham_env_compact).
+ *
+ * The streams of a Cursor are stored in a linked list; if the Cursor is
+ * closed then its streams are detached and can only be closed.
+ *
+ * The blob is only moved if a write exceeds its capacity (the space which
+ * was allocated for the blob). The new blob is then allocated with some
+ * spare capacity, therefore appending to a record moves it only a few
+ * times. Small records (which are stored in the btree key or in a slab
+ * page) are moved to a blob when they are written.
+ *
+ * Records which are written through a stream have no checksum.
+ */
+
+#ifndef HAM_RECORD_STREAM_H__
+#define HAM_RECORD_STREAM_H__
+
+#include "internal_fwd_decl.h"
+
+
+/**
+ * a stream for the record of the current key of a Cursor
+ */
+class RecordStream
+{
+  public:
+    /** the constructor; @a flags are the flags of
+     * @ref ham_record_stream_open. Attaches the stream to the Cursor */
+    RecordStream(Cursor *cursor, ham_u32_t flags);
+
+    /** the destructor; detaches the stream from the Cursor */
+    ~RecordStream();
+
+    /** reads the size of the record and sets the position */
+    ham_status_t open();
+
+    /** reads up to @a size bytes from the current position */
+    ham_status_t read(void *data, ham_size_t size, ham_size_t *bytes_read);
+
+    /** writes @a size bytes at the current position */
+    ham_status_t write(const void *data, ham_size_t size);
+
+    /** returns the Cursor, or NULL if the Cursor was closed */
+    Cursor *get_cursor() {
+        return (m_cursor);
+    }
+
+    /** returns the next stream of the same Cursor */
+    RecordStream *get_next() {
+        return (m_next);
+    }
+
+    /** detaches the stream from its Cursor; called when the Cursor
+     * is closed */
+    void detach();
+
+  private:
+    /** purges the cache, if necessary, and fetches the current state
+     * of the record */
+    ham_status_t begin();
+
+    /** fetches the blob ID, the size and the capacity of the record */
+    ham_status_t refresh();
+
+    /** implementation of read() */
+    ham_status_t read_range(void *data, ham_size_t size,
+                ham_size_t *bytes_read);
+
+    /** implementation of write() */
+    ham_status_t write_range(const void *data, ham_size_t size);
+
+    /** reads a record which is not stored in a blob */
+    ham_status_t read_small(ham_u8_t *buffer);
+
+    /** moves the record to a blob with a capacity of at least
+     * @a capacity bytes */
+    ham_status_t reserve(ham_offset_t capacity);
+
+    /** the Cursor */
+    Cursor *m_cursor;
+
+    /** the linked list of the streams of the Cursor */
+    RecordStream *m_next, *m_previous;
+
+    /** the flags of @ref ham_record_stream_open */
+    ham_u32_t m_flags;
+
+    /** the blob ID of the record, or 0 if it's not stored in a blob */
+    ham_offset_t m_blobid;
+
+    /** the size of the record */
+    ham_offset_t m_size;
+
+    /** the capacity of the blob */
+    ham_offset_t m_capacity;
+
+    /** the current position */
+    ham_offset_t m_position;
+
+    /** true if the size and the checksum of the blob were updated */
+    bool m_written;
+};
+
+#endif /* HAM_RECORD_STREAM_H__ */
@@ -853,6 +853,14 @@ DatabaseImplementationRemote::get_parameters(ham_parameter_t *param)
             ham_assert(proto_db_get_parameters_reply_has_dam(reply), (""));
             p->value=proto_db_get_parameters_reply_get_dam(reply);
             break;
+        case HAM_PARAM_KEY_TYPE:
+            ham_assert(proto_db_get_parameters_reply_has_key_type(reply), (""));
+            p->value=proto_db_get_parameters_reply_get_key_type(reply);
+            break;
+        case HAM_PARAM_RECORD_INLINE_SIZE:
+            ham_assert(proto_db_get_parameters_reply_has_record_inline_size(reply), (""));
+            p->value=proto_db_get_parameters_reply_get_record_inline_size(reply);
+            break;
         default:
             ham_trace(("unknown parameter %d", (int)p->name));
             break;
@@ -1009,6 +1017,18 @@ DatabaseImplementationRemote::erase(Transaction *txn, ham_key_t *key,
     return (st);
 }
 
+ham_status_t 
+DatabaseImplementationRemote::erase_range(Transaction *txn, ham_key_t *begin,
+                ham_key_t *end, ham_u32_t flags)
+{
+    (void)txn;
+    (void)begin;
+    (void)end;
+    (void)flags;
+    /* need this? send me a mail and i will implement it */
+    return (HAM_NOT_IMPLEMENTED);
+}
+
 
 ham_status_t 
 DatabaseImplementationRemote::find(Transaction *txn, ham_key_t *key, 
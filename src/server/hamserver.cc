@@ -304,6 +304,14 @@ handle_db_get_parameters(struct env_t *envh, struct mg_connection *conn,
             proto_db_get_parameters_reply_set_dam(reply,
                             (int)params[i].value);
             break;
+        case HAM_PARAM_KEY_TYPE:
+            proto_db_get_parameters_reply_set_key_type(reply,
+                            (int)params[i].value);
+            break;
+        case HAM_PARAM_RECORD_INLINE_SIZE:
+            proto_db_get_parameters_reply_set_record_inline_size(reply,
+                            (int)params[i].value);
+            break;
         default:
             ham_trace(("unsupported parameter %u", (unsigned)params[i].name));
             break;
@@ -386,9 +394,11 @@ handle_env_create_db(struct env_t *envh, ham_env_t *env,
 
     /* convert parameters */
     ham_assert(proto_env_create_db_request_get_num_params(request)<100, (""));
+    ham_u32_t *names=proto_env_create_db_request_get_param_names(request);
+    ham_u64_t *values=proto_env_create_db_request_get_param_values(request);
     for (i=0; i<proto_env_create_db_request_get_num_params(request); i++) {
-        params[i].name =proto_env_create_db_request_get_param_names(request)[i];
-        params[i].value=proto_env_create_db_request_get_param_values(request)[i];
+        params[i].name =names[i];
+        params[i].value=values[i];
     }
 
     /* create the database */
@@ -429,9 +439,11 @@ handle_env_open_db(struct env_t *envh, ham_env_t *env,
 
     /* convert parameters */
     ham_assert(proto_env_open_db_request_get_num_params(request)<100, (""));
+    ham_u32_t *names=proto_env_open_db_request_get_param_names(request);
+    ham_u64_t *values=proto_env_open_db_request_get_param_values(request);
     for (i=0; i<proto_env_open_db_request_get_num_params(request); i++) {
-        params[i].name =proto_env_open_db_request_get_param_names(request)[i];
-        params[i].value=proto_env_open_db_request_get_param_values(request)[i];
+        params[i].name =names[i];
+        params[i].value=values[i];
     }
 
     /* check if the database is already open */
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief implementation of slab.h
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "blob.h"
+#include "db.h"
+#include "endianswap.h"
+#include "env.h"
+#include "error.h"
+#include "freelist.h"
+#include "page.h"
+#include "slab.h"
+
+/** the slot sizes of the size classes */
+static const ham_u16_t slot_sizes[SlabAllocator::MAX_CLASSES]={
+    32, 48, 64, 96, 128, 192, 256
+};
+
+/** returns the offset of the first slot, relative to the payload */
+static ham_size_t
+__get_slots_offset(ham_size_t capacity)
+{
+    ham_size_t offset=OFFSETOF(slab_header_t, _bitmap)+(capacity+7)/8;
+    return ((offset+7)&~7);
+}
+
+/** returns the number of slots of a page */
+static ham_size_t
+__get_capacity(Environment *env, ham_size_t slot_size)
+{
+    ham_size_t usable=env->get_usable_pagesize();
+    ham_size_t capacity=(usable-OFFSETOF(slab_header_t, _bitmap))*8
+                    /(8*slot_size+1);
+
+    while (capacity
+            && __get_slots_offset(capacity)+capacity*slot_size>usable)
+        capacity--;
+    return (capacity);
+}
+
+/** returns a pointer to a slot */
+static ham_u8_t *
+__get_slot(Page *page, ham_size_t slot)
+{
+    slab_header_t *hdr=(slab_header_t *)page->get_payload();
+    ham_size_t capacity=ham_db2h16(hdr->_capacity);
+
+    return (page->get_payload()+__get_slots_offset(capacity)
+            +slot*ham_db2h16(hdr->_slot_size));
+}
+
+bool
+SlabAllocator::is_supported(Environment *env, ham_size_t size,
+                ham_u32_t flags)
+{
+    if (!(env->get_flags()&HAM_ENABLE_SLAB_RECORDS))
+        return (false);
+    if (!(flags&BLOB_RECORD) || (flags&HAM_PARTIAL))
+        return (false);
+    return (get_class(size)>=0);
+}
+
+int
+SlabAllocator::get_class(ham_size_t size)
+{
+    for (int i=0; i<MAX_CLASSES; i++) {
+        if (size+sizeof(ham_u16_t)<=slot_sizes[i])
+            return (i);
+    }
+    return (-1);
+}
+
+ham_status_t
+SlabAllocator::alloc(Environment *env, Database *db, const void *data,
+                ham_size_t size, ham_offset_t *rid)
+{
+    ham_status_t st;
+    Page *page=0;
+    slab_header_t *hdr;
+    int c=get_class(size);
+
+    ham_assert(c>=0, ("record of %u bytes is too large for a slot", size));
+    *rid=0;
+
+    /* prefer the page with the lowest address; otherwise allocate a
+     * new page */
+    if (!m_partial[c].empty()) {
+        st=db_fetch_page_impl(&page, env, db, *m_partial[c].begin(), 0);
+        if (!page)
+            return (st ? st : HAM_INTERNAL_ERROR);
+        hdr=(slab_header_t *)page->get_payload();
+        ham_assert(page->get_type()==Page::TYPE_SLAB
+                && ham_db2h16(hdr->_slot_size)==slot_sizes[c], (""));
+    }
+    else {
+        ham_size_t capacity=__get_capacity(env, slot_sizes[c]);
+        if (!capacity)
+            return (HAM_LIMITS_REACHED);
+
+        st=db_alloc_page_impl(&page, env, db, Page::TYPE_SLAB, 0);
+        if (st)
+            return (st);
+        hdr=(slab_header_t *)page->get_payload();
+        memset(hdr, 0, __get_slots_offset(capacity));
+        hdr->_slot_size=ham_h2db16(slot_sizes[c]);
+        hdr->_capacity=ham_h2db16((ham_u16_t)capacity);
+        m_partial[c].insert(page->get_self());
+    }
+
+    /* pick the first free slot */
+    ham_size_t capacity=ham_db2h16(hdr->_capacity);
+    ham_size_t slot=0;
+    while (slot<capacity && (hdr->_bitmap[slot/8]&(1<<(slot%8))))
+        slot++;
+    ham_assert(slot<capacity, ("slab page without a free slot"));
+    if (slot==capacity)
+        return (HAM_INTERNAL_ERROR);
+
+    hdr->_bitmap[slot/8]|=(ham_u8_t)(1<<(slot%8));
+    hdr->_used=ham_h2db16(ham_db2h16(hdr->_used)+1);
+    if (ham_db2h16(hdr->_used)==capacity)
+        m_partial[c].erase(page->get_self());
+
+    ham_u8_t *p=__get_slot(page, slot);
+    *(ham_u16_t *)p=ham_h2db16((ham_u16_t)size);
+    if (size)
+        memcpy(p+sizeof(ham_u16_t), data, size);
+    page->set_dirty(true);
+
+    *rid=page->get_self()|(slot<<1)|RID_FLAG;
+    return (0);
+}
+
+ham_status_t
+SlabAllocator::fetch_slot(Environment *env, Database *db, ham_offset_t rid,
+                Page **page, ham_size_t *slot)
+{
+    ham_status_t st;
+    ham_offset_t address=get_page_address(rid, env->get_pagesize());
+    slab_header_t *hdr;
+
+    *slot=(ham_size_t)((rid-address)>>1);
+
+    st=db_fetch_page_impl(page, env, db, address, 0);
+    if (!*page)
+        return (st ? st : HAM_INTERNAL_ERROR);
+
+    hdr=(slab_header_t *)(*page)->get_payload();
+    if ((*page)->get_type()!=Page::TYPE_SLAB
+            || *slot>=ham_db2h16(hdr->_capacity)
+            || !(hdr->_bitmap[*slot/8]&(1<<(*slot%8)))) {
+        ham_log(("slot of record 0x%llx is not in use",
+                (unsigned long long)rid));
+        return (HAM_BLOB_NOT_FOUND);
+    }
+    return (0);
+}
+
+ham_status_t
+SlabAllocator::read(Environment *env, Database *db, ham_offset_t rid,
+                const ham_u8_t **data, ham_size_t *size)
+{
+    ham_status_t st;
+    Page *page;
+    ham_size_t slot;
+
+    st=fetch_slot(env, db, rid, &page, &slot);
+    if (st)
+        return (st);
+
+    ham_u8_t *p=__get_slot(page, slot);
+    *size=ham_db2h16(*(ham_u16_t *)p);
+    *data=p+sizeof(ham_u16_t);
+    return (0);
+}
+
+ham_status_t
+SlabAllocator::overwrite(Environment *env, Database *db, ham_offset_t rid,
+                const void *data, ham_size_t size)
+{
+    ham_status_t st;
+    Page *page;
+    ham_size_t slot;
+
+    st=fetch_slot(env, db, rid, &page, &slot);
+    if (st)
+        return (st);
+
+    slab_header_t *hdr=(slab_header_t *)page->get_payload();
+    if (size+sizeof(ham_u16_t)>ham_db2h16(hdr->_slot_size))
+        return (HAM_LIMITS_REACHED);
+
+    ham_u8_t *p=__get_slot(page, slot);
+    *(ham_u16_t *)p=ham_h2db16((ham_u16_t)size);
+    if (size)
+        memcpy(p+sizeof(ham_u16_t), data, size);
+    page->set_dirty(true);
+    return (0);
+}
+
+ham_status_t
+SlabAllocator::free(Environment *env, Database *db, ham_offset_t rid)
+{
+    ham_status_t st;
+    Page *page;
+    ham_size_t slot;
+
+    st=fetch_slot(env, db, rid, &page, &slot);
+    if (st)
+        return (st);
+
+    slab_header_t *hdr=(slab_header_t *)page->get_payload();
+    int c=get_class(ham_db2h16(hdr->_slot_size)-sizeof(ham_u16_t));
+    ham_assert(c>=0 && slot_sizes[c]==ham_db2h16(hdr->_slot_size), (""));
+
+    hdr->_bitmap[slot/8]&=(ham_u8_t)~(1<<(slot%8));
+    hdr->_used=ham_h2db16(ham_db2h16(hdr->_used)-1);
+    page->set_dirty(true);
+
+    /* the page has free slots again; this also finds the pages which
+     * were filled before the Environment was opened */
+    if (ham_db2h16(hdr->_used)) {
+        m_partial[c].insert(page->get_self());
+        return (0);
+    }
+
+    /* move the empty page to the freelist; if recovery is enabled then
+     * the page is part of the changeset and must not be deleted before
+     * the changeset is flushed */
+    m_partial[c].erase(page->get_self());
+    if (!(env->get_flags()&HAM_ENABLE_RECOVERY))
+        return (db_free_page(page, DB_MOVE_TO_FREELIST));
+    return (freel_mark_free(env, db, page->get_self(),
+                env->get_pagesize(), HAM_TRUE));
+}
+
+void
+SlabAllocator::clear()
+{
+    for (int i=0; i<MAX_CLASSES; i++)
+        m_partial[i].clear();
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief slab pages for small records
+ *
+ * If @ref HAM_ENABLE_SLAB_RECORDS is set, small records are not stored
+ * as blobs (with a blob_t header and a freelist allocation), but in the
+ * slots of slab pages (@ref Page::TYPE_SLAB). Every slab page is divided
+ * into slots of one size class; a slot stores the size of the record
+ * (16 bit) followed by the data. The slab header at the beginning of the
+ * payload stores the size class, the number of slots and a bitmap of
+ * the used slots.
+ *
+ * The record ID of a slot is the address of its page, combined with the
+ * slot index and @ref SlabAllocator::RID_FLAG:
+ *
+ *   rid = page | (slot << 1) | RID_FLAG
+ *
+ * Blobs are always aligned to @ref DB_CHUNKSIZE, therefore a record ID
+ * with RID_FLAG is never a blob ID. Since the record IDs describe
+ * themselves, existing slots can always be read, even if the flag is not
+ * set.
+ *
+ * The pages with free slots are tracked in memory. When the Environment
+ * is opened, these lists are empty; a page is added when one of its slots
+ * is freed, otherwise new records are stored in new pages. A page is moved
+ * to the freelist as soon as its last slot is freed.
+ */
+
+#ifndef HAM_SLAB_H__
+#define HAM_SLAB_H__
+
+#include <set>
+
+#include "internal_fwd_decl.h"
+
+
+#include "packstart.h"
+
+/**
+ * the header of a slab page; it follows the persistent page header
+ */
+HAM_PACK_0 struct HAM_PACK_1 slab_header_t
+{
+    /** the size of a slot in bytes (including the 16bit record size) */
+    ham_u16_t _slot_size;
+
+    /** the number of slots in this page */
+    ham_u16_t _capacity;
+
+    /** the number of used slots */
+    ham_u16_t _used;
+
+    /** reserved, for padding */
+    ham_u16_t _reserved;
+
+    /** a bitmap of the used slots; followed by the slots */
+    ham_u8_t _bitmap[1];
+
+} HAM_PACK_2;
+
+#include "packstop.h"
+
+/**
+ * allocates, reads and frees the slots of slab pages; there's one
+ * instance per Environment
+ */
+class SlabAllocator
+{
+  public:
+    enum {
+        /** set in the record ID of a slot */
+        RID_FLAG=1,
+
+        /** the largest record which is stored in a slot */
+        MAX_RECORD_SIZE=254,
+
+        /** the number of size classes */
+        MAX_CLASSES=7
+    };
+
+    /** returns true if @a rid is the record ID of a slot */
+    static bool is_slab_rid(ham_offset_t rid) {
+        return ((rid&RID_FLAG)!=0);
+    }
+
+    /** returns the address of the slab page of a slot */
+    static ham_offset_t get_page_address(ham_offset_t rid,
+                ham_size_t pagesize) {
+        return (rid-rid%pagesize);
+    }
+
+    /**
+     * returns true if a record of @a size bytes is stored in a slot;
+     * @a flags are the flags of @ref blob_allocate
+     */
+    static bool is_supported(Environment *env, ham_size_t size,
+                ham_u32_t flags);
+
+    /** stores a record in a free slot and returns its record ID */
+    ham_status_t alloc(Environment *env, Database *db, const void *data,
+                ham_size_t size, ham_offset_t *rid);
+
+    /**
+     * returns a pointer to the data of a slot and its size; the pointer
+     * is valid till the page is purged from the cache
+     */
+    ham_status_t read(Environment *env, Database *db, ham_offset_t rid,
+                const ham_u8_t **data, ham_size_t *size);
+
+    /**
+     * overwrites the record of a slot; returns HAM_LIMITS_REACHED if
+     * the new record does not fit into the slot
+     */
+    ham_status_t overwrite(Environment *env, Database *db, ham_offset_t rid,
+                const void *data, ham_size_t size);
+
+    /** frees a slot; the page is moved to the freelist if it's empty */
+    ham_status_t free(Environment *env, Database *db, ham_offset_t rid);
+
+    /** forgets all pages with free slots, i.e. when the Environment
+     * is closed */
+    void clear();
+
+  private:
+    /** returns the size class of a record, or -1 if it's too large */
+    static int get_class(ham_size_t size);
+
+    /** fetches the slab page of a slot and checks the slot */
+    ham_status_t fetch_slot(Environment *env, Database *db, ham_offset_t rid,
+                Page **page, ham_size_t *slot);
+
+    /** the addresses of the pages with free slots, per size class */
+    std::set<ham_offset_t> m_partial[MAX_CLASSES];
+};
+
+#endif /* HAM_SLAB_H__ */
@@ -0,0 +1,400 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief implementation of the operation trace recorder
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "cursor.h"
+#include "db.h"
+#include "env.h"
+#include "error.h"
+#include "record_stream.h"
+#include "trace.h"
+#include "txn.h"
+
+/** the size of the write buffer */
+#define TRACE_BUFFER_SIZE   (64*1024)
+
+Tracer::Tracer(Environment *env, ham_u32_t flags)
+  : m_env(env), m_flags(flags), m_fd(HAM_INVALID_FD), m_error(0),
+    m_start(0), m_next_cursor_id(1), m_next_stream_id(1)
+{
+    m_buffer.reserve(TRACE_BUFFER_SIZE);
+}
+
+Tracer::~Tracer()
+{
+    (void)close();
+}
+
+ham_status_t
+Tracer::open(const char *filename)
+{
+    trace_header_t header;
+    ham_status_t st;
+
+    st=os_create(filename, 0, 0644, &m_fd);
+    if (st)
+        return (st);
+
+    m_start=os_get_time_ns();
+
+    header.magic=HAM_TRACE_MAGIC;
+    header.version=HAM_TRACE_VERSION;
+    header.flags=m_flags;
+    header.env_flags=m_env->get_flags();
+    append(&header, sizeof(header));
+
+    /* record all open Databases, so that the trace is self-contained */
+    for (Database *db=m_env->get_databases(); db; db=db->get_next())
+        trace_db(OP_OPEN_DB, db, 0);
+
+    return (m_error);
+}
+
+ham_status_t
+Tracer::close()
+{
+    if (m_fd==HAM_INVALID_FD)
+        return (m_error);
+
+    ham_status_t st=flush_buffer();
+    if (st && !m_error)
+        m_error=st;
+    st=os_close(m_fd, 0);
+    if (st && !m_error)
+        m_error=st;
+    m_fd=HAM_INVALID_FD;
+    return (m_error);
+}
+
+ham_u64_t
+Tracer::hash(const void *data, ham_size_t size)
+{
+    /* 64bit FNV-1a */
+    const ham_u8_t *p=(const ham_u8_t *)data;
+    ham_u64_t h=0xcbf29ce484222325ull;
+    for (ham_size_t i=0; i<size; i++) {
+        h^=p[i];
+        h*=0x100000001b3ull;
+    }
+    return (h);
+}
+
+void
+Tracer::trace(ham_u8_t op, Database *db, Transaction *txn, Cursor *cursor,
+                ham_key_t *key, ham_record_t *record, ham_u32_t flags,
+                ham_status_t status)
+{
+    trace_entry_t entry;
+
+    if (m_error || m_fd==HAM_INVALID_FD)
+        return;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.op=op;
+    entry.dbname=db ? db->get_name() : 0;
+    entry.thread_id=get_thread_id();
+    entry.flags=flags&~HAM_DONT_LOCK;
+    entry.status=status;
+    entry.timestamp=os_get_time_ns()-m_start;
+    entry.txn_id=txn ? txn_get_id(txn) : 0;
+    if (cursor) {
+        std::map<Cursor *, ham_u64_t>::iterator it=m_cursors.find(cursor);
+        if (it!=m_cursors.end())
+            entry.cursor_id=it->second;
+    }
+    if (key && key->data) {
+        entry.key_size=key->size;
+        entry.key_hash=hash(key->data, key->size);
+    }
+    if (record && record->data)
+        entry.record_size=record->size;
+
+    /* the full data contains the key and - for write operations - the
+     * record; records which are returned by lookups are not stored */
+    ham_size_t key_payload=0, record_payload=0;
+    if (m_flags&HAM_TRACE_FULL_DATA) {
+        key_payload=entry.key_size;
+        if (op==OP_INSERT || op==OP_CURSOR_INSERT || op==OP_CURSOR_OVERWRITE)
+            record_payload=entry.record_size;
+    }
+    entry.payload_size=key_payload+record_payload;
+
+    append(&entry, sizeof(entry));
+    if (key_payload)
+        append(key->data, key_payload);
+    if (record_payload)
+        append(record->data, record_payload);
+}
+
+void
+Tracer::trace_txn(ham_u8_t op, ham_u64_t txn_id, ham_u32_t flags,
+                ham_status_t status)
+{
+    trace_entry_t entry;
+
+    if (m_error || m_fd==HAM_INVALID_FD)
+        return;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.op=op;
+    entry.thread_id=get_thread_id();
+    entry.flags=flags&~HAM_DONT_LOCK;
+    entry.status=status;
+    entry.timestamp=os_get_time_ns()-m_start;
+    entry.txn_id=txn_id;
+    append(&entry, sizeof(entry));
+}
+
+void
+Tracer::trace_db(ham_u8_t op, Database *db, ham_status_t status)
+{
+    trace_entry_t entry;
+
+    if (m_error || m_fd==HAM_INVALID_FD)
+        return;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.op=op;
+    entry.dbname=db->get_name();
+    entry.thread_id=get_thread_id();
+    entry.status=status;
+    entry.timestamp=os_get_time_ns()-m_start;
+    if (!status) {
+        entry.flags=db->get_rt_flags();
+        if (db->get_backend())
+            entry.key_size=db_get_keysize(db);
+    }
+    append(&entry, sizeof(entry));
+}
+
+void
+Tracer::trace_cursor_create(Cursor *cursor, Cursor *src, ham_status_t status)
+{
+    trace_entry_t entry;
+
+    if (m_error || m_fd==HAM_INVALID_FD)
+        return;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.op=src ? OP_CURSOR_CLONE : OP_CURSOR_CREATE;
+    entry.thread_id=get_thread_id();
+    entry.status=status;
+    entry.timestamp=os_get_time_ns()-m_start;
+
+    if (src) {
+        std::map<Cursor *, ham_u64_t>::iterator it=m_cursors.find(src);
+        if (it!=m_cursors.end())
+            entry.key_hash=it->second;
+    }
+
+    if (!status && cursor) {
+        entry.dbname=cursor->get_db()->get_name();
+        entry.txn_id=cursor->get_txn() ? txn_get_id(cursor->get_txn()) : 0;
+        entry.cursor_id=m_next_cursor_id++;
+        m_cursors[cursor]=entry.cursor_id;
+    }
+
+    append(&entry, sizeof(entry));
+}
+
+void
+Tracer::trace_cursor_close(Cursor *cursor)
+{
+    trace(OP_CURSOR_CLOSE, cursor->get_db(), 0, cursor, 0, 0, 0, 0);
+    m_cursors.erase(cursor);
+
+    /* the streams of the Cursor are detached and can no longer be used */
+    for (RecordStream *s=cursor->get_streams(); s; s=s->get_next())
+        m_streams.erase(s);
+}
+
+void
+Tracer::trace_stream_open(RecordStream *stream, Cursor *cursor,
+                ham_u32_t flags, ham_status_t status)
+{
+    trace_entry_t entry;
+
+    if (m_error || m_fd==HAM_INVALID_FD)
+        return;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.op=OP_RECORD_STREAM_OPEN;
+    entry.dbname=cursor->get_db()->get_name();
+    entry.thread_id=get_thread_id();
+    entry.flags=flags;
+    entry.status=status;
+    entry.timestamp=os_get_time_ns()-m_start;
+    std::map<Cursor *, ham_u64_t>::iterator it=m_cursors.find(cursor);
+    if (it!=m_cursors.end())
+        entry.cursor_id=it->second;
+
+    if (!status && stream) {
+        entry.key_hash=m_next_stream_id++;
+        m_streams[stream]=entry.key_hash;
+    }
+
+    append(&entry, sizeof(entry));
+}
+
+void
+Tracer::trace_stream_write(RecordStream *stream, const void *data,
+                ham_size_t size, ham_status_t status)
+{
+    trace_entry_t entry;
+
+    if (m_error || m_fd==HAM_INVALID_FD)
+        return;
+
+    std::map<RecordStream *, ham_u64_t>::iterator it=m_streams.find(stream);
+    if (it==m_streams.end())
+        return;
+
+    Cursor *cursor=stream->get_cursor();
+    memset(&entry, 0, sizeof(entry));
+    entry.op=OP_RECORD_STREAM_WRITE;
+    entry.dbname=cursor->get_db()->get_name();
+    entry.thread_id=get_thread_id();
+    entry.status=status;
+    entry.timestamp=os_get_time_ns()-m_start;
+    entry.key_hash=it->second;
+    std::map<Cursor *, ham_u64_t>::iterator cit=m_cursors.find(cursor);
+    if (cit!=m_cursors.end())
+        entry.cursor_id=cit->second;
+    entry.record_size=size;
+    if (m_flags&HAM_TRACE_FULL_DATA)
+        entry.payload_size=size;
+
+    append(&entry, sizeof(entry));
+    if (entry.payload_size)
+        append(data, size);
+}
+
+void
+Tracer::trace_stream_close(RecordStream *stream)
+{
+    trace_entry_t entry;
+
+    std::map<RecordStream *, ham_u64_t>::iterator it=m_streams.find(stream);
+    if (it==m_streams.end())
+        return;
+    ham_u64_t id=it->second;
+    m_streams.erase(it);
+
+    if (m_error || m_fd==HAM_INVALID_FD)
+        return;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.op=OP_RECORD_STREAM_CLOSE;
+    entry.thread_id=get_thread_id();
+    entry.timestamp=os_get_time_ns()-m_start;
+    entry.key_hash=id;
+    append(&entry, sizeof(entry));
+}
+
+void
+Tracer::trace_erase_range(Database *db, Transaction *txn, ham_key_t *begin,
+                ham_key_t *end, ham_u32_t flags, ham_status_t status)
+{
+    trace_entry_t entry;
+    trace_range_t range;
+
+    if (m_error || m_fd==HAM_INVALID_FD)
+        return;
+
+    memset(&entry, 0, sizeof(entry));
+    memset(&range, 0, sizeof(range));
+    entry.op=OP_ERASE_RANGE;
+    entry.dbname=db->get_name();
+    entry.thread_id=get_thread_id();
+    entry.flags=flags&~HAM_DONT_LOCK;
+    entry.status=status;
+    entry.timestamp=os_get_time_ns()-m_start;
+    entry.txn_id=txn ? txn_get_id(txn) : 0;
+    if (begin) {
+        range.bounds|=TRACE_RANGE_BEGIN;
+        entry.key_size=begin->size;
+        entry.key_hash=hash(begin->data, begin->size);
+    }
+    if (end) {
+        range.bounds|=TRACE_RANGE_END;
+        range.end_size=end->size;
+        range.end_hash=hash(end->data, end->size);
+    }
+
+    entry.payload_size=sizeof(range);
+    if (m_flags&HAM_TRACE_FULL_DATA)
+        entry.payload_size+=entry.key_size+range.end_size;
+
+    append(&entry, sizeof(entry));
+    append(&range, sizeof(range));
+    if (m_flags&HAM_TRACE_FULL_DATA) {
+        if (entry.key_size)
+            append(begin->data, entry.key_size);
+        if (range.end_size)
+            append(end->data, range.end_size);
+    }
+}
+
+void
+Tracer::append(const void *data, ham_size_t size)
+{
+    if (m_buffer.size()+size>TRACE_BUFFER_SIZE) {
+        ham_status_t st=flush_buffer();
+        if (st) {
+            m_error=st;
+            return;
+        }
+    }
+
+    /* huge payloads bypass the buffer */
+    if (size>TRACE_BUFFER_SIZE) {
+        ham_status_t st=os_write(m_fd, data, size);
+        if (st)
+            m_error=st;
+        return;
+    }
+
+    const ham_u8_t *p=(const ham_u8_t *)data;
+    m_buffer.insert(m_buffer.end(), p, p+size);
+}
+
+ham_status_t
+Tracer::flush_buffer()
+{
+    if (m_buffer.empty())
+        return (0);
+
+    ham_status_t st=os_write(m_fd, &m_buffer[0], m_buffer.size());
+    m_buffer.clear();
+    return (st);
+}
+
+ham_u32_t
+Tracer::get_thread_id()
+{
+    boost::thread::id id=boost::this_thread::get_id();
+    std::map<boost::thread::id, ham_u32_t>::iterator it=m_threads.find(id);
+    if (it!=m_threads.end())
+        return (it->second);
+
+    ham_u32_t seq=(ham_u32_t)m_threads.size();
+    m_threads[id]=seq;
+    return (seq);
+}
+
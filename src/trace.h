@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+/**
+ * @brief the operation trace recorder
+ *
+ * A trace file starts with a trace_header_t, followed by a sequence of
+ * trace_entry_t structures. Each entry is followed by entry.payload_size
+ * bytes: the key data and the record data, if the trace was started with
+ * HAM_TRACE_FULL_DATA. All values are stored in host byte order.
+ */
+
+#ifndef HAM_TRACE_H__
+#define HAM_TRACE_H__
+
+#include "internal_fwd_decl.h"
+
+#include <map>
+#include <vector>
+
+#include <ham/hamsterdb_int.h>
+
+#include "os.h"
+
+#define HAM_TRACE_MAGIC         0x43525448 /* "HTRC" */
+#define HAM_TRACE_VERSION       1
+
+#include "packstart.h"
+
+/**
+ * the header of a trace file
+ */
+typedef HAM_PACK_0 struct HAM_PACK_1
+{
+    /** always HAM_TRACE_MAGIC */
+    ham_u32_t magic;
+
+    /** always HAM_TRACE_VERSION */
+    ham_u32_t version;
+
+    /** the flags of ham_env_enable_tracing */
+    ham_u32_t flags;
+
+    /** the flags of the Environment */
+    ham_u32_t env_flags;
+
+} HAM_PACK_2 trace_header_t;
+
+/**
+ * a single traced operation
+ */
+typedef HAM_PACK_0 struct HAM_PACK_1
+{
+    /** the operation - one of Tracer::OP_* */
+    ham_u8_t op;
+
+    /** reserved */
+    ham_u8_t _reserved;
+
+    /** the name of the Database, or 0 */
+    ham_u16_t dbname;
+
+    /** the sequential id of the calling thread */
+    ham_u32_t thread_id;
+
+    /** the flags of the operation (for OP_CREATE_DB/OPEN_DB: the
+     * Database flags) */
+    ham_u32_t flags;
+
+    /** the return value of the operation */
+    ham_s32_t status;
+
+    /** nanoseconds since the trace was started, when the operation
+     * completed */
+    ham_u64_t timestamp;
+
+    /** the Transaction id, or 0 */
+    ham_u64_t txn_id;
+
+    /** the Cursor id, or 0 */
+    ham_u64_t cursor_id;
+
+    /** a hash of the key data - identical keys have identical hashes;
+     * for OP_CURSOR_CLONE: the id of the cloned Cursor; for
+     * OP_RECORD_STREAM_*: the id of the stream */
+    ham_u64_t key_hash;
+
+    /** size of the key; for OP_CREATE_DB/OPEN_DB: the key size of
+     * the Database */
+    ham_u32_t key_size;
+
+    /** size of the record; for OP_RECORD_STREAM_WRITE: the number of
+     * written bytes */
+    ham_u32_t record_size;
+
+    /** number of bytes following this entry */
+    ham_u32_t payload_size;
+
+} HAM_PACK_2 trace_entry_t;
+
+/** trace_range_t.bounds: the range has a lower bound */
+#define TRACE_RANGE_BEGIN       1
+
+/** trace_range_t.bounds: the range has an upper bound */
+#define TRACE_RANGE_END         2
+
+/**
+ * the upper bound of an OP_ERASE_RANGE operation
+ *
+ * The lower bound is stored in the key fields of the trace_entry_t; this
+ * structure is the first part of the payload and is followed by the data
+ * of the lower and the upper bound if the trace was started with
+ * HAM_TRACE_FULL_DATA.
+ */
+typedef HAM_PACK_0 struct HAM_PACK_1
+{
+    /** a hash of the key data of the upper bound */
+    ham_u64_t end_hash;
+
+    /** size of the upper bound */
+    ham_u32_t end_size;
+
+    /** a combination of TRACE_RANGE_BEGIN and TRACE_RANGE_END */
+    ham_u32_t bounds;
+
+} HAM_PACK_2 trace_range_t;
+
+#include "packstop.h"
+
+/**
+ * The trace recorder of an Environment
+ *
+ * All methods are called while the Environment mutex is held.
+ */
+class Tracer
+{
+  public:
+    /** the traced operations */
+    enum {
+        OP_CREATE_DB=1,
+        OP_OPEN_DB,
+        OP_CLOSE_DB,
+        OP_TXN_BEGIN,
+        OP_TXN_COMMIT,
+        OP_TXN_ABORT,
+        OP_INSERT,
+        OP_FIND,
+        OP_ERASE,
+        OP_CURSOR_CREATE,
+        OP_CURSOR_CLONE,
+        OP_CURSOR_CLOSE,
+        OP_CURSOR_INSERT,
+        OP_CURSOR_FIND,
+        OP_CURSOR_ERASE,
+        OP_CURSOR_MOVE,
+        OP_CURSOR_OVERWRITE,
+        OP_FLUSH,
+        OP_ERASE_RANGE,
+        OP_RECORD_STREAM_OPEN,
+        OP_RECORD_STREAM_WRITE,
+        OP_RECORD_STREAM_CLOSE,
+        OP_MAX
+    };
+
+    /** constructor */
+    Tracer(Environment *env, ham_u32_t flags);
+
+    /** destructor; flushes and closes the file */
+    ~Tracer();
+
+    /** creates the trace file and writes the header */
+    ham_status_t open(const char *filename);
+
+    /** flushes the buffered entries and closes the file; returns the
+     * first error which occurred while tracing */
+    ham_status_t close();
+
+    /** records an operation */
+    void trace(ham_u8_t op, Database *db, Transaction *txn, Cursor *cursor,
+                ham_key_t *key, ham_record_t *record, ham_u32_t flags,
+                ham_status_t status);
+
+    /** records the begin, commit or abort of a Transaction */
+    void trace_txn(ham_u8_t op, ham_u64_t txn_id, ham_u32_t flags,
+                ham_status_t status);
+
+    /** records that a Database was created, opened or closed */
+    void trace_db(ham_u8_t op, Database *db, ham_status_t status);
+
+    /** records the creation of a Cursor; @a src is the cloned Cursor
+     * (or NULL) */
+    void trace_cursor_create(Cursor *cursor, Cursor *src,
+                ham_status_t status);
+
+    /** records that a Cursor was closed; its streams are forgotten */
+    void trace_cursor_close(Cursor *cursor);
+
+    /** records that a RecordStream was opened */
+    void trace_stream_open(RecordStream *stream, Cursor *cursor,
+                ham_u32_t flags, ham_status_t status);
+
+    /** records a write to a RecordStream; @a data is stored if the
+     * trace was started with HAM_TRACE_FULL_DATA */
+    void trace_stream_write(RecordStream *stream, const void *data,
+                ham_size_t size, ham_status_t status);
+
+    /** records that a RecordStream was closed */
+    void trace_stream_close(RecordStream *stream);
+
+    /** records a range erase; @a begin and @a end can be NULL */
+    void trace_erase_range(Database *db, Transaction *txn, ham_key_t *begin,
+                ham_key_t *end, ham_u32_t flags, ham_status_t status);
+
+    /** returns the 64bit hash of a buffer */
+    static ham_u64_t hash(const void *data, ham_size_t size);
+
+  private:
+    /** appends data to the buffer; flushes the buffer if it is full */
+    void append(const void *data, ham_size_t size);
+
+    /** writes the buffer to the file */
+    ham_status_t flush_buffer();
+
+    /** returns the sequential id of the calling thread */
+    ham_u32_t get_thread_id();
+
+    /** the Environment */
+    Environment *m_env;
+
+    /** the flags of ham_env_enable_tracing */
+    ham_u32_t m_flags;
+
+    /** the trace file */
+    ham_fd_t m_fd;
+
+    /** the first I/O error; tracing stops after an error */
+    ham_status_t m_error;
+
+    /** the time when the trace was started */
+    ham_u64_t m_start;
+
+    /** the write buffer */
+    std::vector<ham_u8_t> m_buffer;
+
+    /** maps Cursor pointers to Cursor ids */
+    std::map<Cursor *, ham_u64_t> m_cursors;
+
+    /** the next Cursor id */
+    ham_u64_t m_next_cursor_id;
+
+    /** maps RecordStream pointers to stream ids */
+    std::map<RecordStream *, ham_u64_t> m_streams;
+
+    /** the next stream id */
+    ham_u64_t m_next_stream_id;
+
+    /** maps thread ids to sequential ids */
+    std::map<boost::thread::id, ham_u32_t> m_threads;
+};
+
+#endif /* HAM_TRACE_H__ */
@@ -49,6 +49,13 @@ __cmpfoo(void *vlhs, void *vrhs)
     if (lhs==rhs)
         return (0);
 
+    if (db->has_typed_compare())
+        return (keytype_compare(db->get_key_type(),
+                txn_opnode_get_key(lhs)->data,
+                txn_opnode_get_key(lhs)->size,
+                txn_opnode_get_key(rhs)->data,
+                txn_opnode_get_key(rhs)->size));
+
     foo=db->get_compare_func();
 
     return (foo((ham_db_t *)db,
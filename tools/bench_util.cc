@@ -0,0 +1,79 @@
+/**
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifndef WIN32
+#  include <sys/time.h>
+#  include <sys/resource.h>
+#endif
+
+#include "bench_util.h"
+
+void
+error(const char *foo, ham_status_t st)
+{
+    fprintf(stderr, "%s() returned error %d: %s\n", foo, st, ham_strerror(st));
+    exit(-1);
+}
+
+ham_u64_t
+get_max_rss_kb(void)
+{
+#ifndef WIN32
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru)==0) {
+#  ifdef __APPLE__
+        return ((ham_u64_t)ru.ru_maxrss/1024);
+#  else
+        return ((ham_u64_t)ru.ru_maxrss);
+#  endif
+    }
+#endif
+    return (0);
+}
+
+void
+print_histogram(FILE *f, const char *name, const ham_latency_histogram_t *h,
+            bool comma)
+{
+    fprintf(f, "    \"%s\": {\"count\": %llu, \"avg_ns\": %llu, "
+            "\"min_ns\": %llu, \"p50_ns\": %llu, \"p90_ns\": %llu, "
+            "\"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}%s\n",
+            name,
+            (unsigned long long)h->count,
+            (unsigned long long)(h->count ? h->total_ns/h->count : 0),
+            (unsigned long long)h->min_ns,
+            (unsigned long long)ham_latency_histogram_get_percentile(h, 50),
+            (unsigned long long)ham_latency_histogram_get_percentile(h, 90),
+            (unsigned long long)ham_latency_histogram_get_percentile(h, 99),
+            (unsigned long long)ham_latency_histogram_get_percentile(h, 99.9),
+            (unsigned long long)h->max_ns,
+            comma ? "," : "");
+}
+
+bool
+parse_number(const char *name, const char *param, ham_u64_t *value)
+{
+    char *endptr=0;
+    if (!param) {
+        fprintf(stderr, "Parameter `%s' is missing.\n", name);
+        return (false);
+    }
+    *value=strtoull(param, &endptr, 0);
+    if (endptr && *endptr) {
+        fprintf(stderr, "Invalid parameter `%s'; numerical value "
+                "expected.\n", name);
+        return (false);
+    }
+    return (true);
+}
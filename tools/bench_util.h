@@ -0,0 +1,44 @@
+/**
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ *
+ */
+
+/**
+ * helper functions which are shared by ham_bench and ham_replay
+ */
+
+#ifndef HAM_BENCH_UTIL_H__
+#define HAM_BENCH_UTIL_H__
+
+#include <stdio.h>
+
+#include <ham/hamsterdb.h>
+#include <ham/hamsterdb_int.h>
+
+/** prints an error message and terminates the process */
+extern void
+error(const char *foo, ham_status_t st);
+
+/** returns the peak resident set size in kb, or 0 if unknown */
+extern ham_u64_t
+get_max_rss_kb(void);
+
+/** prints a latency histogram as a JSON object; appends a comma
+ * if @a comma is true */
+extern void
+print_histogram(FILE *f, const char *name, const ham_latency_histogram_t *h,
+            bool comma);
+
+/** parses the numerical value of a command line parameter; prints an
+ * error and returns false if the value is missing or invalid */
+extern bool
+parse_number(const char *name, const char *param, ham_u64_t *value);
+
+#endif /* HAM_BENCH_UTIL_H__ */
@@ -0,0 +1,1016 @@
+/**
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ *
+ */
+
+/**
+ * ham_bench - a configurable workload generator
+ *
+ * Loads a key space into a Database and then runs a YCSB-style mix of
+ * lookups, inserts, erases and scans with one or more threads. The results
+ * (throughput, latency percentiles, file size, memory usage) are written
+ * as JSON.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <vector>
+
+#include <ham/hamsterdb.h>
+#include <ham/hamsterdb_int.h>
+#include "../src/internal_fwd_decl.h"
+#include "../src/metrics.h"
+#include "../src/os.h"
+
+#include "bench_util.h"
+#include "getopts.h"
+
+#define ARG_HELP            1
+#define ARG_OPS             2
+#define ARG_KEYS            3
+#define ARG_DISTRIBUTION    4
+#define ARG_ZIPF_THETA      5
+#define ARG_KEYSIZE         6
+#define ARG_KEYSIZE_MAX     7
+#define ARG_RECSIZE         8
+#define ARG_RECSIZE_MAX     9
+#define ARG_READ_PCT        10
+#define ARG_INSERT_PCT      11
+#define ARG_ERASE_PCT       12
+#define ARG_SCAN_PCT        13
+#define ARG_SCAN_LENGTH     14
+#define ARG_THREADS         15
+#define ARG_TXN_SIZE        16
+#define ARG_CACHESIZE       17
+#define ARG_PAGESIZE        18
+#define ARG_NO_MMAP         19
+#define ARG_RECOVERY        20
+#define ARG_TRANSACTIONS    21
+#define ARG_INMEMORY        22
+#define ARG_OPEN            23
+#define ARG_SEED            24
+#define ARG_OUTPUT          25
+#define ARG_METRICS         26
+#define ARG_ARENA           27
+#define ARG_ENCRYPTION      28
+#define ARG_COMPRESSION     29
+
+/*
+ * command line parameters
+ */
+static option_t opts[]={
+    {
+        ARG_HELP,               // symbolic name of this option
+        "h",                    // short option
+        "help",                 // long option
+        "this help screen",     // help string
+        0 },                    // no flags
+    { ARG_OPS, "n", "ops",
+        "number of operations in the run phase (default: 100000)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_KEYS, "k", "keys",
+        "number of keys loaded before the run phase (default: 100000)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_DISTRIBUTION, "d", "distribution",
+        "key distribution: uniform or zipfian (default: uniform)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_ZIPF_THETA, "zt", "zipf-theta",
+        "skew of the zipfian distribution (default: 0.99)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_KEYSIZE, "ks", "keysize",
+        "(minimum) key size in bytes, at least 8 (default: 16)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_KEYSIZE_MAX, "ksm", "keysize-max",
+        "maximum key size in bytes (default: keysize)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_RECSIZE, "rs", "recsize",
+        "(minimum) record size in bytes (default: 100)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_RECSIZE_MAX, "rsm", "recsize-max",
+        "maximum record size in bytes (default: recsize)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_READ_PCT, "rp", "read-pct",
+        "percentage of lookups (default: 50)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_INSERT_PCT, "ip", "insert-pct",
+        "percentage of inserts (default: 50)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_ERASE_PCT, "ep", "erase-pct",
+        "percentage of erases (default: 0)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_SCAN_PCT, "sp", "scan-pct",
+        "percentage of scans (default: 0)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_SCAN_LENGTH, "sl", "scan-length",
+        "number of keys per scan (default: 100)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_THREADS, "t", "threads",
+        "number of threads (default: 1)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_TXN_SIZE, "ts", "txn-size",
+        "operations per Transaction; implies --use-transactions "
+        "(default: 0)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_CACHESIZE, "c", "cachesize",
+        "cache size in bytes (default: hamsterdb default)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_PAGESIZE, "ps", "pagesize",
+        "page size in bytes (default: hamsterdb default)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_NO_MMAP, "nm", "no-mmap",
+        "disable mmap (HAM_DISABLE_MMAP)",
+        0 },
+    { ARG_RECOVERY, "r", "use-recovery",
+        "enable recovery (HAM_ENABLE_RECOVERY)",
+        0 },
+    { ARG_TRANSACTIONS, "tx", "use-transactions",
+        "enable Transactions (HAM_ENABLE_TRANSACTIONS)",
+        0 },
+    { ARG_INMEMORY, "im", "inmemorydb",
+        "use an In-Memory Database (HAM_IN_MEMORY_DB)",
+        0 },
+    { ARG_ARENA, "ar", "arena",
+        "use an In-Memory Database with arenas (HAM_IN_MEMORY_ARENA)",
+        0 },
+    { ARG_OPEN, "o", "open",
+        "open an existing file instead of creating and loading it",
+        0 },
+    { ARG_SEED, "s", "seed",
+        "seed of the random number generator (default: 1)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_OUTPUT, "out", "output",
+        "write the JSON results to this file (default: stdout)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_METRICS, "m", "metrics",
+        "enable and report the Environment metrics (HAM_ENABLE_METRICS)",
+        0 },
+    { ARG_ENCRYPTION, "e", "encryption",
+        "enable AES encryption; ARG is 'ecb' or 'xts' (HAM_ENCRYPTION_XTS)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_COMPRESSION, "z", "page-compression",
+        "compress the index pages with zlib level ARG (HAM_COMPRESS_PAGES)",
+        GETOPTS_NEED_ARGUMENT },
+    { 0, 0, 0, 0, 0 } /* terminating element */
+};
+
+/** the operations of the run phase */
+enum {
+    OP_READ=0,
+    OP_INSERT,
+    OP_ERASE,
+    OP_SCAN,
+    OP_COMMIT,
+    OP_MAX
+};
+
+static const char *op_names[OP_MAX]={
+    "read", "insert", "erase", "scan", "commit"
+};
+
+/** the benchmark configuration */
+struct config_t {
+    const char *filename;
+    const char *output;
+    ham_u64_t ops;
+    ham_u64_t keys;
+    bool zipfian;
+    double zipf_theta;
+    ham_size_t keysize;
+    ham_size_t keysize_max;
+    ham_size_t recsize;
+    ham_size_t recsize_max;
+    unsigned pct[OP_SCAN+1];
+    unsigned scan_length;
+    unsigned threads;
+    unsigned txn_size;
+    ham_u64_t cachesize;
+    ham_size_t pagesize;
+    ham_u32_t env_flags;
+    bool open;
+    ham_u64_t seed;
+    const char *encryption;
+    ham_u32_t page_compression;
+
+    config_t()
+      : filename("ham_bench.db"), output(0), ops(100000), keys(100000),
+        zipfian(false), zipf_theta(0.99), keysize(16), keysize_max(0),
+        recsize(100), recsize_max(0), scan_length(100), threads(1),
+        txn_size(0), cachesize(0), pagesize(0), env_flags(0), open(false),
+        seed(1), encryption(0), page_compression(0) {
+        pct[OP_READ]=50;
+        pct[OP_INSERT]=50;
+        pct[OP_ERASE]=0;
+        pct[OP_SCAN]=0;
+    }
+};
+
+/** the results of a single thread */
+struct result_t {
+    ham_latency_histogram_t latency[OP_MAX];
+    ham_u64_t not_found;
+    ham_u64_t duplicates;
+    ham_u64_t conflicts;
+    ham_u64_t errors;
+    ham_u64_t scanned;
+
+    result_t() {
+        memset(this, 0, sizeof(*this));
+    }
+
+    void record(int op, ham_u64_t ns) {
+        ham_latency_histogram_t *h=&latency[op];
+        if (h->count==0 || ns<h->min_ns)
+            h->min_ns=ns;
+        if (ns>h->max_ns)
+            h->max_ns=ns;
+        h->count++;
+        h->total_ns+=ns;
+        h->buckets[Metrics::get_bucket(ns)]++;
+    }
+
+    void merge(const result_t &other) {
+        for (int op=0; op<OP_MAX; op++) {
+            ham_latency_histogram_t *h=&latency[op];
+            const ham_latency_histogram_t *o=&other.latency[op];
+            if (!o->count)
+                continue;
+            if (h->count==0 || o->min_ns<h->min_ns)
+                h->min_ns=o->min_ns;
+            if (o->max_ns>h->max_ns)
+                h->max_ns=o->max_ns;
+            h->count+=o->count;
+            h->total_ns+=o->total_ns;
+            for (int i=0; i<HAM_METRICS_HISTOGRAM_BUCKETS; i++)
+                h->buckets[i]+=o->buckets[i];
+        }
+        not_found+=other.not_found;
+        duplicates+=other.duplicates;
+        conflicts+=other.conflicts;
+        errors+=other.errors;
+        scanned+=other.scanned;
+    }
+};
+
+/** a fast per-thread pseudo random number generator (xorshift64*) */
+class Random {
+  public:
+    Random(ham_u64_t seed) : m_state(seed ? seed : 0x9e3779b97f4a7c15ull) {
+    }
+
+    ham_u64_t next() {
+        m_state^=m_state>>12;
+        m_state^=m_state<<25;
+        m_state^=m_state>>27;
+        return (m_state*2685821657736338717ull);
+    }
+
+    /** returns a value in [0, 1) */
+    double next_double() {
+        return ((double)(next()>>11)/9007199254740992.0);
+    }
+
+    /** returns a value in [0, n) */
+    ham_u64_t next(ham_u64_t n) {
+        return (n ? next()%n : 0);
+    }
+
+  private:
+    ham_u64_t m_state;
+};
+
+/** 64bit FNV-1a hash, used to scramble zipfian ranks and derive sizes */
+static ham_u64_t
+hash64(ham_u64_t v)
+{
+    ham_u64_t h=0xcbf29ce484222325ull;
+    for (int i=0; i<8; i++) {
+        h^=(v&0xff);
+        h*=0x100000001b3ull;
+        v>>=8;
+    }
+    return (h);
+}
+
+/**
+ * The zipfian generator from YCSB (Gray et al., "Quickly Generating
+ * Billion-Record Synthetic Databases"); the popular items are scattered
+ * over the key space by hashing the rank
+ */
+class Zipfian {
+  public:
+    Zipfian(ham_u64_t items, double theta)
+      : m_items(items), m_theta(theta) {
+        m_zeta2=zeta(2);
+        m_zetan=zeta(items);
+        m_alpha=1.0/(1.0-theta);
+        m_eta=(1-pow(2.0/items, 1-theta))/(1-m_zeta2/m_zetan);
+    }
+
+    ham_u64_t next(Random &rnd) {
+        double u=rnd.next_double();
+        double uz=u*m_zetan;
+        ham_u64_t rank;
+        if (uz<1.0)
+            rank=0;
+        else if (uz<1.0+pow(0.5, m_theta))
+            rank=1;
+        else
+            rank=(ham_u64_t)(m_items*pow(m_eta*u-m_eta+1, m_alpha));
+        if (rank>=m_items)
+            rank=m_items-1;
+        return (hash64(rank)%m_items);
+    }
+
+  private:
+    double zeta(ham_u64_t n) {
+        double sum=0;
+        for (ham_u64_t i=0; i<n; i++)
+            sum+=1.0/pow((double)(i+1), m_theta);
+        return (sum);
+    }
+
+    ham_u64_t m_items;
+    double m_theta;
+    double m_zeta2;
+    double m_zetan;
+    double m_alpha;
+    double m_eta;
+};
+
+/** the state which is shared by all threads */
+struct shared_t {
+    config_t *cfg;
+    ham_env_t *env;
+    ham_db_t *db;
+    Zipfian *zipf;
+    Mutex mutex;
+    ham_u64_t next_key;
+    ham_u64_t ops_started;
+};
+
+/**
+ * generates the key for key id @a id; the first 8 bytes are the id in big
+ * endian byte order (therefore the keys are sorted by their id), the
+ * remaining bytes are filler
+ */
+static void
+make_key(config_t *cfg, ham_u64_t id, ham_key_t *key, ham_u8_t *buffer)
+{
+    ham_size_t size=cfg->keysize;
+    if (cfg->keysize_max>cfg->keysize)
+        size+=(ham_size_t)(hash64(id)%(cfg->keysize_max-cfg->keysize+1));
+
+    for (int i=0; i<8; i++)
+        buffer[i]=(ham_u8_t)(id>>(8*(7-i)));
+    for (ham_size_t i=8; i<size; i++)
+        buffer[i]=(ham_u8_t)('a'+(id+i)%26);
+
+    memset(key, 0, sizeof(*key));
+    key->data=buffer;
+    key->size=(ham_u16_t)size;
+}
+
+static void
+make_record(config_t *cfg, Random &rnd, ham_record_t *rec, ham_u8_t *buffer)
+{
+    ham_size_t size=cfg->recsize;
+    if (cfg->recsize_max>cfg->recsize)
+        size+=(ham_size_t)rnd.next(cfg->recsize_max-cfg->recsize+1);
+
+    memset(rec, 0, sizeof(*rec));
+    rec->data=buffer;
+    rec->size=size;
+}
+
+/** picks an existing key id */
+static ham_u64_t
+choose_key(shared_t *sh, Random &rnd)
+{
+    if (sh->zipf)
+        return (sh->zipf->next(rnd));
+
+    ham_u64_t n;
+    {
+        ScopedLock lock(sh->mutex);
+        n=sh->next_key;
+    }
+    return (rnd.next(n));
+}
+
+/** one worker thread of the run phase */
+class Worker {
+  public:
+    Worker(shared_t *sh, unsigned id, result_t *result)
+      : m_sh(sh), m_id(id), m_result(result) {
+    }
+
+    void operator()() {
+        config_t *cfg=m_sh->cfg;
+        Random rnd(cfg->seed*7919+m_id+1);
+        std::vector<ham_u8_t> keybuf(cfg->keysize_max>cfg->keysize
+                    ? cfg->keysize_max : cfg->keysize);
+        std::vector<ham_u8_t> recbuf((cfg->recsize_max>cfg->recsize
+                    ? cfg->recsize_max : cfg->recsize)+1, 'x');
+        ham_txn_t *txn=0;
+        unsigned txn_ops=0;
+        ham_status_t st;
+
+        while (true) {
+            {
+                ScopedLock lock(m_sh->mutex);
+                if (m_sh->ops_started>=cfg->ops)
+                    break;
+                m_sh->ops_started++;
+            }
+
+            if (cfg->txn_size && !txn) {
+                st=ham_txn_begin(&txn, m_sh->env, 0, 0, 0);
+                if (st)
+                    error("ham_txn_begin", st);
+                txn_ops=0;
+            }
+
+            /* choose the operation */
+            unsigned p=(unsigned)rnd.next(100);
+            int op=OP_READ;
+            for (op=OP_READ; op<OP_SCAN; op++) {
+                if (p<cfg->pct[op])
+                    break;
+                p-=cfg->pct[op];
+            }
+
+            ham_key_t key;
+            ham_record_t rec;
+            ham_u64_t start=os_get_time_ns();
+
+            switch (op) {
+              case OP_READ:
+                make_key(cfg, choose_key(m_sh, rnd), &key, &keybuf[0]);
+                memset(&rec, 0, sizeof(rec));
+                st=ham_find(m_sh->db, txn, &key, &rec, 0);
+                break;
+              case OP_INSERT: {
+                ham_u64_t id;
+                {
+                    ScopedLock lock(m_sh->mutex);
+                    id=m_sh->next_key++;
+                }
+                make_key(cfg, id, &key, &keybuf[0]);
+                make_record(cfg, rnd, &rec, &recbuf[0]);
+                st=ham_insert(m_sh->db, txn, &key, &rec, 0);
+                break;
+              }
+              case OP_ERASE:
+                make_key(cfg, choose_key(m_sh, rnd), &key, &keybuf[0]);
+                st=ham_erase(m_sh->db, txn, &key, 0);
+                break;
+              default: /* OP_SCAN */
+                make_key(cfg, choose_key(m_sh, rnd), &key, &keybuf[0]);
+                st=scan(txn, &key);
+                break;
+            }
+
+            m_result->record(op, os_get_time_ns()-start);
+
+            if (st==HAM_KEY_NOT_FOUND)
+                m_result->not_found++;
+            else if (st==HAM_DUPLICATE_KEY)
+                m_result->duplicates++;
+            else if (st==HAM_TXN_CONFLICT)
+                m_result->conflicts++;
+            else if (st)
+                m_result->errors++;
+
+            if (txn && (++txn_ops>=cfg->txn_size || st==HAM_TXN_CONFLICT))
+                end_txn(&txn, st==HAM_TXN_CONFLICT);
+        }
+
+        if (txn)
+            end_txn(&txn, false);
+    }
+
+  private:
+    ham_status_t scan(ham_txn_t *txn, ham_key_t *key) {
+        ham_cursor_t *cursor;
+        ham_status_t st=ham_cursor_create(m_sh->db, txn, 0, &cursor);
+        if (st)
+            return (st);
+
+        st=ham_cursor_find(cursor, key, HAM_FIND_GEQ_MATCH);
+        for (unsigned i=1; st==0 && i<m_sh->cfg->scan_length; i++) {
+            ham_key_t k;
+            ham_record_t r;
+            memset(&k, 0, sizeof(k));
+            memset(&r, 0, sizeof(r));
+            st=ham_cursor_move(cursor, &k, &r, HAM_CURSOR_NEXT);
+            if (st==0)
+                m_result->scanned++;
+        }
+        ham_cursor_close(cursor);
+        return (st==HAM_KEY_NOT_FOUND ? 0 : st);
+    }
+
+    void end_txn(ham_txn_t **txn, bool abort) {
+        ham_status_t st;
+        if (abort) {
+            st=ham_txn_abort(*txn, 0);
+            if (st)
+                error("ham_txn_abort", st);
+        }
+        else {
+            ham_u64_t start=os_get_time_ns();
+            st=ham_txn_commit(*txn, 0);
+            m_result->record(OP_COMMIT, os_get_time_ns()-start);
+            if (st)
+                error("ham_txn_commit", st);
+        }
+        *txn=0;
+    }
+
+    shared_t *m_sh;
+    unsigned m_id;
+    result_t *m_result;
+};
+
+/** enables the AES encryption if it was requested */
+static void
+enable_encryption(shared_t *sh)
+{
+    ham_u8_t key[16]={0x13, 0x14, 0x15, 0x16};
+
+    if (!sh->cfg->encryption)
+        return;
+
+    ham_status_t st=ham_env_enable_encryption(sh->env, key,
+                strcmp(sh->cfg->encryption, "xts") ? 0 : HAM_ENCRYPTION_XTS);
+    if (st)
+        error("ham_env_enable_encryption", st);
+}
+
+/** enables the page compression if it was requested */
+static void
+enable_page_compression(shared_t *sh)
+{
+    if (!sh->cfg->page_compression)
+        return;
+
+    ham_status_t st=ham_enable_compression(sh->db,
+                sh->cfg->page_compression, HAM_COMPRESS_PAGES);
+    if (st)
+        error("ham_enable_compression", st);
+}
+
+/** loads the initial key space with a single thread */
+static void
+load(shared_t *sh)
+{
+    config_t *cfg=sh->cfg;
+    Random rnd(cfg->seed);
+    std::vector<ham_u8_t> keybuf(cfg->keysize_max>cfg->keysize
+                ? cfg->keysize_max : cfg->keysize);
+    std::vector<ham_u8_t> recbuf((cfg->recsize_max>cfg->recsize
+                ? cfg->recsize_max : cfg->recsize)+1, 'x');
+    ham_txn_t *txn=0;
+    ham_status_t st;
+
+    for (ham_u64_t id=0; id<cfg->keys; id++) {
+        ham_key_t key;
+        ham_record_t rec;
+
+        if (cfg->txn_size && !txn) {
+            st=ham_txn_begin(&txn, sh->env, 0, 0, 0);
+            if (st)
+                error("ham_txn_begin", st);
+        }
+
+        make_key(cfg, id, &key, &keybuf[0]);
+        make_record(cfg, rnd, &rec, &recbuf[0]);
+        st=ham_insert(sh->db, txn, &key, &rec, 0);
+        if (st)
+            error("ham_insert", st);
+
+        if (txn && ((id+1)%cfg->txn_size==0 || id+1==cfg->keys)) {
+            st=ham_txn_commit(txn, 0);
+            if (st)
+                error("ham_txn_commit", st);
+            txn=0;
+        }
+    }
+}
+
+static void
+print_results(config_t *cfg, result_t *result, double load_secs,
+            double run_secs, ham_u64_t filesize,
+            ham_env_metrics_t *metrics)
+{
+    FILE *f=stdout;
+    if (cfg->output) {
+        f=fopen(cfg->output, "w");
+        if (!f) {
+            fprintf(stderr, "failed to open `%s'\n", cfg->output);
+            exit(-1);
+        }
+    }
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"config\": {\"filename\": \"%s\", \"ops\": %llu, "
+            "\"keys\": %llu, \"distribution\": \"%s\", \"zipf_theta\": %g, "
+            "\"keysize\": [%u, %u], \"recsize\": [%u, %u], "
+            "\"mix\": {\"read\": %u, \"insert\": %u, \"erase\": %u, "
+            "\"scan\": %u}, \"scan_length\": %u, \"threads\": %u, "
+            "\"txn_size\": %u, \"cachesize\": %llu, \"pagesize\": %u, "
+            "\"env_flags\": %u, \"seed\": %llu, \"encryption\": \"%s\", "
+            "\"page_compression\": %u},\n",
+            cfg->filename, (unsigned long long)cfg->ops,
+            (unsigned long long)cfg->keys,
+            cfg->zipfian ? "zipfian" : "uniform", cfg->zipf_theta,
+            cfg->keysize, cfg->keysize_max, cfg->recsize, cfg->recsize_max,
+            cfg->pct[OP_READ], cfg->pct[OP_INSERT], cfg->pct[OP_ERASE],
+            cfg->pct[OP_SCAN], cfg->scan_length, cfg->threads,
+            cfg->txn_size, (unsigned long long)cfg->cachesize,
+            cfg->pagesize, cfg->env_flags, (unsigned long long)cfg->seed,
+            cfg->encryption ? cfg->encryption : "none",
+            cfg->page_compression);
+    fprintf(f, "  \"load\": {\"records\": %llu, \"seconds\": %.6f, "
+            "\"ops_per_sec\": %.1f},\n",
+            (unsigned long long)(cfg->open ? 0 : cfg->keys), load_secs,
+            load_secs>0 ? (double)cfg->keys/load_secs : 0.0);
+    fprintf(f, "  \"run\": {\"operations\": %llu, \"seconds\": %.6f, "
+            "\"ops_per_sec\": %.1f, \"not_found\": %llu, "
+            "\"duplicates\": %llu, \"conflicts\": %llu, \"errors\": %llu, "
+            "\"scanned\": %llu},\n",
+            (unsigned long long)cfg->ops, run_secs,
+            run_secs>0 ? (double)cfg->ops/run_secs : 0.0,
+            (unsigned long long)result->not_found,
+            (unsigned long long)result->duplicates,
+            (unsigned long long)result->conflicts,
+            (unsigned long long)result->errors,
+            (unsigned long long)result->scanned);
+    fprintf(f, "  \"latency\": {\n");
+    for (int op=0; op<OP_MAX; op++)
+        print_histogram(f, op_names[op], &result->latency[op], op+1<OP_MAX);
+    fprintf(f, "  },\n");
+    if (metrics) {
+        fprintf(f, "  \"metrics\": {\"cache_hits\": %llu, "
+                "\"cache_misses\": %llu, \"pages_read\": %llu, "
+                "\"pages_written\": %llu, \"page_writes\": %llu, "
+                "\"bytes_read\": %llu, "
+                "\"bytes_written\": %llu, \"fsyncs\": %llu, "
+                "\"log_bytes\": %llu, \"journal_bytes\": %llu, "
+                "\"lock_waits\": %llu, \"lock_wait_ns\": %llu, "
+                "\"compressed_pages\": %llu, "
+                "\"compression_bytes_in\": %llu, "
+                "\"compression_bytes_out\": %llu},\n",
+                (unsigned long long)metrics->cache_hits,
+                (unsigned long long)metrics->cache_misses,
+                (unsigned long long)metrics->pages_read,
+                (unsigned long long)metrics->pages_written,
+                (unsigned long long)metrics->page_writes,
+                (unsigned long long)metrics->bytes_read,
+                (unsigned long long)metrics->bytes_written,
+                (unsigned long long)metrics->fsyncs,
+                (unsigned long long)metrics->log_bytes,
+                (unsigned long long)metrics->journal_bytes,
+                (unsigned long long)metrics->lock_waits,
+                (unsigned long long)metrics->lock_wait_ns,
+                (unsigned long long)metrics->compressed_pages,
+                (unsigned long long)metrics->compression_bytes_in,
+                (unsigned long long)metrics->compression_bytes_out);
+    }
+    fprintf(f, "  \"file_size\": %llu,\n", (unsigned long long)filesize);
+    fprintf(f, "  \"max_rss_kb\": %llu\n",
+            (unsigned long long)get_max_rss_kb());
+    fprintf(f, "}\n");
+
+    if (f!=stdout)
+        fclose(f);
+}
+
+int
+main(int argc, char **argv)
+{
+    unsigned opt;
+    char *param;
+    ham_u64_t v;
+    config_t cfg;
+    bool remote=false;
+    ham_status_t st;
+
+    ham_u32_t maj, min, rev;
+    const char *licensee, *product;
+    ham_get_license(&licensee, &product);
+    ham_get_version(&maj, &min, &rev);
+
+    getopts_init(argc, argv, "ham_bench");
+
+    while ((opt=getopts(&opts[0], &param))) {
+        switch (opt) {
+            case ARG_OPS:
+                if (!parse_number("ops", param, &cfg.ops))
+                    return (-1);
+                break;
+            case ARG_KEYS:
+                if (!parse_number("keys", param, &cfg.keys))
+                    return (-1);
+                break;
+            case ARG_DISTRIBUTION:
+                if (param && !strcmp(param, "zipfian"))
+                    cfg.zipfian=true;
+                else if (param && !strcmp(param, "uniform"))
+                    cfg.zipfian=false;
+                else {
+                    fprintf(stderr, "Invalid parameter `distribution'; "
+                            "expected `uniform' or `zipfian'.\n");
+                    return (-1);
+                }
+                break;
+            case ARG_ZIPF_THETA:
+                cfg.zipf_theta=param ? atof(param) : 0;
+                if (cfg.zipf_theta<=0 || cfg.zipf_theta>=1) {
+                    fprintf(stderr, "Invalid parameter `zipf-theta'; "
+                            "expected a value between 0 and 1.\n");
+                    return (-1);
+                }
+                break;
+            case ARG_KEYSIZE:
+                if (!parse_number("keysize", param, &v))
+                    return (-1);
+                cfg.keysize=(ham_size_t)v;
+                break;
+            case ARG_KEYSIZE_MAX:
+                if (!parse_number("keysize-max", param, &v))
+                    return (-1);
+                cfg.keysize_max=(ham_size_t)v;
+                break;
+            case ARG_RECSIZE:
+                if (!parse_number("recsize", param, &v))
+                    return (-1);
+                cfg.recsize=(ham_size_t)v;
+                break;
+            case ARG_RECSIZE_MAX:
+                if (!parse_number("recsize-max", param, &v))
+                    return (-1);
+                cfg.recsize_max=(ham_size_t)v;
+                break;
+            case ARG_READ_PCT:
+            case ARG_INSERT_PCT:
+            case ARG_ERASE_PCT:
+            case ARG_SCAN_PCT:
+                if (!parse_number("pct", param, &v))
+                    return (-1);
+                cfg.pct[opt-ARG_READ_PCT]=(unsigned)v;
+                break;
+            case ARG_SCAN_LENGTH:
+                if (!parse_number("scan-length", param, &v))
+                    return (-1);
+                cfg.scan_length=(unsigned)v;
+                break;
+            case ARG_THREADS:
+                if (!parse_number("threads", param, &v))
+                    return (-1);
+                cfg.threads=(unsigned)v;
+                break;
+            case ARG_TXN_SIZE:
+                if (!parse_number("txn-size", param, &v))
+                    return (-1);
+                cfg.txn_size=(unsigned)v;
+                break;
+            case ARG_CACHESIZE:
+                if (!parse_number("cachesize", param, &cfg.cachesize))
+                    return (-1);
+                break;
+            case ARG_PAGESIZE:
+                if (!parse_number("pagesize", param, &v))
+                    return (-1);
+                cfg.pagesize=(ham_size_t)v;
+                break;
+            case ARG_NO_MMAP:
+                cfg.env_flags|=HAM_DISABLE_MMAP;
+                break;
+            case ARG_RECOVERY:
+                cfg.env_flags|=HAM_ENABLE_RECOVERY;
+                break;
+            case ARG_TRANSACTIONS:
+                cfg.env_flags|=HAM_ENABLE_TRANSACTIONS;
+                break;
+            case ARG_INMEMORY:
+                cfg.env_flags|=HAM_IN_MEMORY_DB;
+                break;
+            case ARG_ARENA:
+                cfg.env_flags|=HAM_IN_MEMORY_DB|HAM_IN_MEMORY_ARENA;
+                break;
+            case ARG_OPEN:
+                cfg.open=true;
+                break;
+            case ARG_SEED:
+                if (!parse_number("seed", param, &cfg.seed))
+                    return (-1);
+                break;
+            case ARG_OUTPUT:
+                cfg.output=param;
+                break;
+            case ARG_METRICS:
+                cfg.env_flags|=HAM_ENABLE_METRICS;
+                break;
+            case ARG_ENCRYPTION:
+                if (strcmp(param, "ecb") && strcmp(param, "xts")) {
+                    fprintf(stderr, "encryption must be 'ecb' or 'xts'\n");
+                    return (-1);
+                }
+                cfg.encryption=param;
+                break;
+            case ARG_COMPRESSION:
+                if (!parse_number("page-compression", param, &v))
+                    return (-1);
+                if (v<1 || v>9) {
+                    fprintf(stderr, "page-compression must be 1..9\n");
+                    return (-1);
+                }
+                cfg.page_compression=(ham_u32_t)v;
+                break;
+            case GETOPTS_PARAMETER:
+                cfg.filename=param;
+                break;
+            case ARG_HELP:
+                printf("hamsterdb %d.%d.%d - Copyright (C) 2005-2012 "
+                       "Christoph Rupp (chris@crupp.de).\n\n",
+                       maj, min, rev);
+
+                if (licensee[0]=='\0')
+                    printf(
+                       "This program is free software; you can redistribute "
+                       "it and/or modify it\nunder the terms of the GNU "
+                       "General Public License as published by the Free\n"
+                       "Software Foundation; either version 2 of the License,\n"
+                       "or (at your option) any later version.\n\n"
+                       "See file COPYING.GPL2 and COPYING.GPL3 for License "
+                       "information.\n\n");
+                else
+                    printf("Commercial version; licensed for %s (%s)\n\n",
+                            licensee, product);
+
+                printf("usage: ham_bench [options] [file|url]\n");
+                printf("usage: ham_bench -h\n");
+                for (option_t *o=&opts[0]; o->name; o++)
+                    printf("       -%s%s: %s (alias: --%s)\n", o->shortopt,
+                            (o->flags&GETOPTS_NEED_ARGUMENT) ? " ARG" : "",
+                            o->helpdesc, o->longopt);
+                return (0);
+            default:
+                fprintf(stderr, "Invalid or unknown parameter `%s'. "
+                       "Enter `ham_bench --help' for usage.\n", param);
+                return (-1);
+        }
+    }
+
+    /* validate the configuration */
+    if (cfg.keysize<8) {
+        fprintf(stderr, "keysize must be at least 8\n");
+        return (-1);
+    }
+    if (cfg.keysize_max && cfg.keysize_max<cfg.keysize) {
+        fprintf(stderr, "keysize-max must be >= keysize\n");
+        return (-1);
+    }
+    if (cfg.recsize_max && cfg.recsize_max<cfg.recsize) {
+        fprintf(stderr, "recsize-max must be >= recsize\n");
+        return (-1);
+    }
+    if (cfg.pct[OP_READ]+cfg.pct[OP_INSERT]+cfg.pct[OP_ERASE]
+            +cfg.pct[OP_SCAN]!=100) {
+        fprintf(stderr, "the operation percentages must add up to 100\n");
+        return (-1);
+    }
+    if (!cfg.keysize_max)
+        cfg.keysize_max=cfg.keysize;
+    if (!cfg.recsize_max)
+        cfg.recsize_max=cfg.recsize;
+    if (!cfg.threads)
+        cfg.threads=1;
+    if (cfg.txn_size)
+        cfg.env_flags|=HAM_ENABLE_TRANSACTIONS;
+    if ((cfg.env_flags&HAM_IN_MEMORY_DB) && cfg.open) {
+        fprintf(stderr, "cannot open an In-Memory Database\n");
+        return (-1);
+    }
+    if (cfg.zipfian && cfg.keys==0) {
+        fprintf(stderr, "the zipfian distribution requires keys > 0\n");
+        return (-1);
+    }
+    remote=!strncmp(cfg.filename, "http://", 7);
+
+    /* create or open the Environment and the Database */
+    shared_t sh;
+    sh.cfg=&cfg;
+    sh.zipf=0;
+    sh.next_key=cfg.keys;
+    sh.ops_started=0;
+
+    ham_parameter_t params[4];
+    int p=0;
+    if (cfg.cachesize) {
+        params[p].name=HAM_PARAM_CACHESIZE;
+        params[p++].value=cfg.cachesize;
+    }
+    if (cfg.pagesize && !cfg.open) {
+        params[p].name=HAM_PARAM_PAGESIZE;
+        params[p++].value=cfg.pagesize;
+    }
+    params[p].name=0;
+    params[p].value=0;
+
+    ham_parameter_t dbparams[2];
+    dbparams[0].name=HAM_PARAM_KEYSIZE;
+    dbparams[0].value=cfg.keysize;
+    dbparams[1].name=0;
+    dbparams[1].value=0;
+
+    st=ham_env_new(&sh.env);
+    if (st)
+        error("ham_env_new", st);
+    st=ham_new(&sh.db);
+    if (st)
+        error("ham_new", st);
+
+    double load_secs=0;
+    if (cfg.open) {
+        st=ham_env_open_ex(sh.env, cfg.filename, cfg.env_flags, &params[0]);
+        if (st)
+            error("ham_env_open_ex", st);
+        enable_encryption(&sh);
+        st=ham_env_open_db(sh.env, sh.db, 1, 0, 0);
+        if (st)
+            error("ham_env_open_db", st);
+        enable_page_compression(&sh);
+    }
+    else {
+        st=ham_env_create_ex(sh.env, cfg.filename, cfg.env_flags, 0644,
+                    &params[0]);
+        if (st)
+            error("ham_env_create_ex", st);
+        enable_encryption(&sh);
+        st=ham_env_create_db(sh.env, sh.db, 1, 0, &dbparams[0]);
+        if (st)
+            error("ham_env_create_db", st);
+        enable_page_compression(&sh);
+
+        ham_u64_t start=os_get_time_ns();
+        load(&sh);
+        load_secs=(os_get_time_ns()-start)/1e9;
+    }
+
+    if (cfg.zipfian)
+        sh.zipf=new Zipfian(cfg.keys, cfg.zipf_theta);
+
+    /* the run phase */
+    std::vector<result_t> results(cfg.threads);
+    std::vector<Thread *> threads;
+    ham_u64_t start=os_get_time_ns();
+    for (unsigned i=0; i<cfg.threads; i++)
+        threads.push_back(new Thread(Worker(&sh, i, &results[i])));
+    for (unsigned i=0; i<cfg.threads; i++) {
+        threads[i]->join();
+        delete threads[i];
+    }
+    double run_secs=(os_get_time_ns()-start)/1e9;
+
+    result_t total;
+    for (unsigned i=0; i<cfg.threads; i++)
+        total.merge(results[i]);
+
+    ham_env_metrics_t metrics;
+    bool have_metrics=false;
+    if (cfg.env_flags&HAM_ENABLE_METRICS)
+        have_metrics=(0==ham_env_get_metrics(sh.env, &metrics, 0));
+
+    st=ham_env_close(sh.env, HAM_AUTO_CLEANUP);
+    if (st)
+        error("ham_env_close", st);
+    ham_delete(sh.db);
+    ham_env_delete(sh.env);
+    delete sh.zipf;
+
+    ham_u64_t filesize=0;
+    if (!remote && !(cfg.env_flags&HAM_IN_MEMORY_DB)) {
+        struct stat buf;
+        if (stat(cfg.filename, &buf)==0)
+            filesize=(ham_u64_t)buf.st_size;
+    }
+
+    print_results(&cfg, &total, load_secs, run_secs, filesize,
+            have_metrics ? &metrics : 0);
+
+    return (0);
+}
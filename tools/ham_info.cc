@@ -15,6 +15,7 @@
 #include <string.h>
 
 #include <ham/hamsterdb.h>
+#include <ham/hamsterdb_int.h>
 #include "../src/db.h"
 #include "../src/env.h"
 #include "../src/backend.h"
@@ -25,6 +26,7 @@
 #define ARG_HELP            1
 #define ARG_DBNAME          2
 #define ARG_FULL            3
+#define ARG_METRICS         4
 
 /*
  * command line parameters
@@ -48,6 +50,12 @@ static option_t opts[]={
         "full",
         "print full information",
         0 },
+    {
+        ARG_METRICS,
+        "m",
+        "metrics",
+        "print the runtime metrics collected while reading the file",
+        0 },
     { 0, 0, 0, 0, 0 } /* terminating element */
 };
 
@@ -172,6 +180,64 @@ print_database(ham_db_t *db, ham_u16_t dbname, int full)
     printf("        total records (bytes):  %u\n", total_rec_size);
 }
 
+static void
+print_metrics(ham_env_t *env)
+{
+    static const char *names[HAM_METRICS_OP_MAX]={
+        "find", "insert", "erase", "cursor move", "txn commit"
+    };
+    ham_env_metrics_t metrics;
+    ham_status_t st;
+
+    st=ham_env_get_metrics(env, &metrics, 0);
+    if (st)
+        error("ham_env_get_metrics", st);
+
+    printf("\n");
+    printf("metrics\n");
+    printf("    cache hits:                 %llu\n",
+            (long long unsigned int)metrics.cache_hits);
+    printf("    cache misses:               %llu\n",
+            (long long unsigned int)metrics.cache_misses);
+    printf("    pages read:                 %llu\n",
+            (long long unsigned int)metrics.pages_read);
+    printf("    pages written:              %llu (%llu writes)\n",
+            (long long unsigned int)metrics.pages_written,
+            (long long unsigned int)metrics.page_writes);
+    printf("    bytes read:                 %llu\n",
+            (long long unsigned int)metrics.bytes_read);
+    printf("    bytes written:              %llu\n",
+            (long long unsigned int)metrics.bytes_written);
+    printf("    fsyncs:                     %llu\n",
+            (long long unsigned int)metrics.fsyncs);
+    printf("    log bytes:                  %llu\n",
+            (long long unsigned int)metrics.log_bytes);
+    printf("    journal bytes:              %llu\n",
+            (long long unsigned int)metrics.journal_bytes);
+    printf("    lock waits:                 %llu (%llu ns)\n",
+            (long long unsigned int)metrics.lock_waits,
+            (long long unsigned int)metrics.lock_wait_ns);
+    if (metrics.compressed_pages)
+        printf("    compressed pages:           %llu (ratio %.2f)\n",
+            (long long unsigned int)metrics.compressed_pages,
+            (double)metrics.compression_bytes_in
+                /(double)metrics.compression_bytes_out);
+
+    for (int i=0; i<HAM_METRICS_OP_MAX; i++) {
+        ham_latency_histogram_t *h=&metrics.operations[i];
+        if (!h->count)
+            continue;
+        printf("    %-12s count %llu, avg %llu ns, min %llu ns, "
+                "p50 %llu ns, p99 %llu ns, max %llu ns\n", names[i],
+            (long long unsigned int)h->count,
+            (long long unsigned int)(h->total_ns/h->count),
+            (long long unsigned int)h->min_ns,
+            (long long unsigned int)ham_latency_histogram_get_percentile(h, 50),
+            (long long unsigned int)ham_latency_histogram_get_percentile(h, 99),
+            (long long unsigned int)h->max_ns);
+    }
+}
+
 int
 main(int argc, char **argv)
 {
@@ -179,6 +245,7 @@ main(int argc, char **argv)
     char *param, *filename=0, *endptr=0;
     unsigned short dbname=0xffff;
     int full=0;
+    int metrics=0;
 
     ham_u16_t names[1024];
     ham_size_t i, names_count=1024;
@@ -210,6 +277,9 @@ main(int argc, char **argv)
             case ARG_FULL:
                 full=1;
                 break;
+            case ARG_METRICS:
+                metrics=1;
+                break;
             case GETOPTS_PARAMETER:
                 if (filename) {
                     printf("Multiple files specified. Please specify "
@@ -236,13 +306,15 @@ main(int argc, char **argv)
                     printf("Commercial version; licensed for %s (%s)\n\n",
                             licensee, product);
 
-                printf("usage: ham_info [-db DBNAME] [-f] file\n");
+                printf("usage: ham_info [-db DBNAME] [-f] [-m] file\n");
                 printf("usage: ham_info -h\n");
                 printf("       -h:         this help screen (alias: --help)\n");
                 printf("       -db DBNAME: only print info about "
                         "this database (alias: --dbname=<arg>)\n");
                 printf("       -f:         print full information "
                         "(alias: --full)\n");
+                printf("       -m:         print runtime metrics "
+                        "(alias: --metrics)\n");
                 return (0);
             default:
                 printf("Invalid or unknown parameter `%s'. "
@@ -262,7 +334,8 @@ main(int argc, char **argv)
     st=ham_env_new(&env);
     if (st!=HAM_SUCCESS)
         error("ham_env_new", st);
-    st=ham_env_open(env, filename, HAM_READ_ONLY);
+    st=ham_env_open(env, filename,
+            HAM_READ_ONLY|(metrics ? HAM_ENABLE_METRICS : 0));
     if (st==HAM_FILE_NOT_FOUND) {
         printf("File `%s' not found or unable to open it\n", filename);
         return (-1);
@@ -326,6 +399,9 @@ main(int argc, char **argv)
             ham_delete(db);
         }
     }
+    if (metrics)
+        print_metrics(env);
+
     /*
      * clean up
      */
@@ -0,0 +1,931 @@
+/**
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ *
+ */
+
+/**
+ * ham_replay - replays an operation trace
+ *
+ * Reads a trace file which was recorded with ham_env_enable_tracing() and
+ * replays all operations against a freshly created Environment, either as
+ * fast as possible or with the recorded timing, and either with a single
+ * thread or with one thread per recorded thread. The results (throughput,
+ * latency percentiles per operation, file size, memory usage) are written
+ * as JSON.
+ *
+ * If the trace was recorded without HAM_TRACE_FULL_DATA then the keys are
+ * synthesized from the recorded key hash and size; identical keys in the
+ * trace are therefore identical keys in the replay.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <map>
+#include <vector>
+
+#include <ham/hamsterdb.h>
+#include <ham/hamsterdb_int.h>
+#include "../src/internal_fwd_decl.h"
+#include "../src/metrics.h"
+#include "../src/os.h"
+#include "../src/trace.h"
+
+#include "bench_util.h"
+#include "getopts.h"
+
+#define ARG_HELP            1
+#define ARG_DATABASE        2
+#define ARG_SPEED           3
+#define ARG_MULTI_THREADED  4
+#define ARG_CACHESIZE       5
+#define ARG_PAGESIZE        6
+#define ARG_NO_MMAP         7
+#define ARG_RECOVERY        8
+#define ARG_TRANSACTIONS    9
+#define ARG_INMEMORY        10
+#define ARG_IGNORE_FLAGS    11
+#define ARG_OUTPUT          12
+#define ARG_METRICS         13
+
+/*
+ * command line parameters
+ */
+static option_t opts[]={
+    {
+        ARG_HELP,               // symbolic name of this option
+        "h",                    // short option
+        "help",                 // long option
+        "this help screen",     // help string
+        0 },                    // no flags
+    { ARG_DATABASE, "db", "database",
+        "the Environment which is created for the replay "
+        "(default: ham_replay.db)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_SPEED, "sp", "speed",
+        "max: replay as fast as possible; recorded: replay with the "
+        "recorded timing (default: max)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_MULTI_THREADED, "mt", "multi-threaded",
+        "replay the operations of each recorded thread in its own thread",
+        0 },
+    { ARG_CACHESIZE, "c", "cachesize",
+        "cache size in bytes (default: hamsterdb default)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_PAGESIZE, "ps", "pagesize",
+        "page size in bytes (default: hamsterdb default)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_NO_MMAP, "nm", "no-mmap",
+        "disable mmap (HAM_DISABLE_MMAP)",
+        0 },
+    { ARG_RECOVERY, "r", "use-recovery",
+        "enable recovery (HAM_ENABLE_RECOVERY)",
+        0 },
+    { ARG_TRANSACTIONS, "tx", "use-transactions",
+        "enable Transactions (HAM_ENABLE_TRANSACTIONS)",
+        0 },
+    { ARG_INMEMORY, "im", "inmemorydb",
+        "use an In-Memory Database (HAM_IN_MEMORY_DB)",
+        0 },
+    { ARG_IGNORE_FLAGS, "if", "ignore-flags",
+        "ignore the recorded Environment flags; only use the flags "
+        "specified on the command line",
+        0 },
+    { ARG_OUTPUT, "out", "output",
+        "write the JSON results to this file (default: stdout)",
+        GETOPTS_NEED_ARGUMENT },
+    { ARG_METRICS, "m", "metrics",
+        "enable and report the Environment metrics (HAM_ENABLE_METRICS)",
+        0 },
+    { 0, 0, 0, 0, 0 } /* terminating element */
+};
+
+/** the names of the traced operations, indexed by Tracer::OP_* */
+static const char *op_names[Tracer::OP_MAX]={
+    "", "create_db", "open_db", "close_db", "txn_begin", "txn_commit",
+    "txn_abort", "insert", "find", "erase", "cursor_create", "cursor_clone",
+    "cursor_close", "cursor_insert", "cursor_find", "cursor_erase",
+    "cursor_move", "cursor_overwrite", "flush", "erase_range",
+    "record_stream_open", "record_stream_write", "record_stream_close"
+};
+
+/** the recorded Environment flags which are used for the replay */
+#define REPLAY_ENV_FLAGS    (HAM_WRITE_THROUGH|HAM_IN_MEMORY_DB            \
+                            |HAM_DISABLE_MMAP|HAM_CACHE_STRICT              \
+                            |HAM_ENABLE_RECOVERY|HAM_ENABLE_TRANSACTIONS    \
+                            |HAM_CACHE_UNLIMITED)
+
+/** the recorded Database flags which are used for the replay */
+#define REPLAY_DB_FLAGS     (HAM_DISABLE_VAR_KEYLEN|HAM_RECORD_NUMBER      \
+                            |HAM_ENABLE_DUPLICATES|HAM_SORT_DUPLICATES)
+
+/** the replay configuration */
+struct config_t {
+    const char *trace;
+    const char *filename;
+    const char *output;
+    bool recorded_speed;
+    bool multi_threaded;
+    bool ignore_flags;
+    ham_u64_t cachesize;
+    ham_size_t pagesize;
+    ham_u32_t env_flags;
+
+    config_t()
+      : trace(0), filename("ham_replay.db"), output(0),
+        recorded_speed(false), multi_threaded(false), ignore_flags(false),
+        cachesize(0), pagesize(0), env_flags(0) {
+    }
+};
+
+/** the results of a single thread */
+struct result_t {
+    ham_latency_histogram_t latency[Tracer::OP_MAX];
+    ham_u64_t operations;
+    ham_u64_t mismatches;
+    ham_u64_t skipped;
+
+    result_t() {
+        memset(this, 0, sizeof(*this));
+    }
+
+    void record(int op, ham_u64_t ns) {
+        ham_latency_histogram_t *h=&latency[op];
+        if (h->count==0 || ns<h->min_ns)
+            h->min_ns=ns;
+        if (ns>h->max_ns)
+            h->max_ns=ns;
+        h->count++;
+        h->total_ns+=ns;
+        h->buckets[Metrics::get_bucket(ns)]++;
+    }
+
+    void merge(const result_t &other) {
+        for (int op=0; op<Tracer::OP_MAX; op++) {
+            ham_latency_histogram_t *h=&latency[op];
+            const ham_latency_histogram_t *o=&other.latency[op];
+            if (!o->count)
+                continue;
+            if (h->count==0 || o->min_ns<h->min_ns)
+                h->min_ns=o->min_ns;
+            if (o->max_ns>h->max_ns)
+                h->max_ns=o->max_ns;
+            h->count+=o->count;
+            h->total_ns+=o->total_ns;
+            for (int i=0; i<HAM_METRICS_HISTOGRAM_BUCKETS; i++)
+                h->buckets[i]+=o->buckets[i];
+        }
+        operations+=other.operations;
+        mismatches+=other.mismatches;
+        skipped+=other.skipped;
+    }
+};
+
+/** the state which is shared by all replay threads */
+struct shared_t {
+    config_t *cfg;
+    ham_env_t *env;
+    ham_u32_t trace_flags;
+    ham_u64_t start;
+    Mutex mutex;
+    std::map<ham_u16_t, ham_db_t *> databases;
+    std::map<ham_u64_t, ham_txn_t *> txns;
+    std::map<ham_u64_t, ham_cursor_t *> cursors;
+    /** the open record streams and the ids of their Cursors */
+    std::map<ham_u64_t, std::pair<ham_u64_t, ham_record_stream_t *> > streams;
+};
+
+/** reads the whole trace file into memory */
+static void
+load_trace(const char *filename, std::vector<ham_u8_t> &buffer)
+{
+    FILE *f=fopen(filename, "rb");
+    if (!f) {
+        fprintf(stderr, "failed to open trace file `%s'\n", filename);
+        exit(-1);
+    }
+
+    ham_u8_t buf[64*1024];
+    size_t n;
+    while ((n=fread(buf, 1, sizeof(buf), f))>0)
+        buffer.insert(buffer.end(), buf, buf+n);
+    fclose(f);
+
+    if (buffer.size()<sizeof(trace_header_t)
+            || ((trace_header_t *)&buffer[0])->magic!=HAM_TRACE_MAGIC) {
+        fprintf(stderr, "`%s' is not a hamsterdb trace file\n", filename);
+        exit(-1);
+    }
+    const trace_header_t *h=(const trace_header_t *)&buffer[0];
+    if (h->version!=HAM_TRACE_VERSION) {
+        fprintf(stderr, "unsupported trace file version %u\n", h->version);
+        exit(-1);
+    }
+}
+
+/** splits the trace into entries; fails if the trace is truncated */
+static void
+parse_trace(std::vector<ham_u8_t> &buffer,
+            std::vector<const trace_entry_t *> &entries)
+{
+    size_t off=sizeof(trace_header_t);
+    while (off<buffer.size()) {
+        const trace_entry_t *e=(const trace_entry_t *)&buffer[off];
+        if (off+sizeof(trace_entry_t)>buffer.size()
+                || off+sizeof(trace_entry_t)+e->payload_size>buffer.size()) {
+            fprintf(stderr, "the trace file is truncated; ignoring the "
+                    "last entry\n");
+            break;
+        }
+        if (e->op==0 || e->op>=Tracer::OP_MAX) {
+            fprintf(stderr, "invalid operation %u in the trace file\n",
+                    (unsigned)e->op);
+            exit(-1);
+        }
+        if (e->op==Tracer::OP_ERASE_RANGE
+                && e->payload_size<sizeof(trace_range_t)) {
+            fprintf(stderr, "invalid range erase in the trace file\n");
+            exit(-1);
+        }
+        entries.push_back(e);
+        off+=sizeof(trace_entry_t)+e->payload_size;
+    }
+}
+
+/** creates all Databases which are used in the trace */
+static void
+create_databases(shared_t *sh,
+            const std::vector<const trace_entry_t *> &entries)
+{
+    for (size_t i=0; i<entries.size(); i++) {
+        const trace_entry_t *e=entries[i];
+        if ((e->op!=Tracer::OP_CREATE_DB && e->op!=Tracer::OP_OPEN_DB)
+                || e->status!=0
+                || sh->databases.find(e->dbname)!=sh->databases.end())
+            continue;
+
+        ham_u32_t flags=e->flags&REPLAY_DB_FLAGS;
+        if (sh->cfg->env_flags&HAM_ENABLE_TRANSACTIONS)
+            flags&=~HAM_SORT_DUPLICATES;
+
+        ham_parameter_t params[2];
+        int p=0;
+        if (e->key_size) {
+            params[p].name=HAM_PARAM_KEYSIZE;
+            params[p++].value=e->key_size;
+        }
+        params[p].name=0;
+        params[p].value=0;
+
+        ham_db_t *db;
+        ham_status_t st=ham_new(&db);
+        if (st)
+            error("ham_new", st);
+        st=ham_env_create_db(sh->env, db, e->dbname, flags, &params[0]);
+        if (st)
+            error("ham_env_create_db", st);
+        sh->databases[e->dbname]=db;
+    }
+}
+
+/** replays a sequence of trace entries */
+class Worker {
+  public:
+    Worker(shared_t *sh, const std::vector<const trace_entry_t *> *entries,
+            result_t *result)
+      : m_sh(sh), m_entries(entries), m_result(result) {
+    }
+
+    void operator()() {
+        for (size_t i=0; i<m_entries->size(); i++) {
+            const trace_entry_t *e=(*m_entries)[i];
+
+            /* Databases are created before the replay starts */
+            if (e->op==Tracer::OP_CREATE_DB || e->op==Tracer::OP_OPEN_DB
+                    || e->op==Tracer::OP_CLOSE_DB)
+                continue;
+
+            if (m_sh->cfg->recorded_speed)
+                wait_until(m_sh->start+e->timestamp);
+
+            ham_u64_t start=os_get_time_ns();
+            ham_status_t st;
+            if (!replay(e, &st)) {
+                m_result->skipped++;
+                continue;
+            }
+            m_result->record(e->op, os_get_time_ns()-start);
+            m_result->operations++;
+            if (st!=e->status)
+                m_result->mismatches++;
+        }
+    }
+
+  private:
+    /** replays a single operation; returns false if the operation
+     * cannot be replayed */
+    bool replay(const trace_entry_t *e, ham_status_t *pst) {
+        ham_u32_t flags=e->flags&~(HAM_PARTIAL|HAM_DIRECT_ACCESS);
+        ham_db_t *db=0;
+        ham_txn_t *txn=0;
+        ham_cursor_t *cursor=0;
+        ham_key_t key;
+        ham_record_t rec;
+        ham_status_t st=0;
+
+        /* if Transactions are disabled for the replay then all
+         * operations are replayed without Transactions */
+        bool use_txns=(m_sh->cfg->env_flags&HAM_ENABLE_TRANSACTIONS)!=0;
+        if (!use_txns && (e->op==Tracer::OP_TXN_BEGIN
+                    || e->op==Tracer::OP_TXN_COMMIT
+                    || e->op==Tracer::OP_TXN_ABORT))
+            return (false);
+
+        /* look up the handles of this operation */
+        {
+            ScopedLock lock(m_sh->mutex);
+            if (e->dbname) {
+                std::map<ham_u16_t, ham_db_t *>::iterator it
+                        =m_sh->databases.find(e->dbname);
+                if (it==m_sh->databases.end())
+                    return (false);
+                db=it->second;
+            }
+            if (use_txns && e->txn_id && e->op!=Tracer::OP_TXN_BEGIN) {
+                std::map<ham_u64_t, ham_txn_t *>::iterator it
+                        =m_sh->txns.find(e->txn_id);
+                if (it==m_sh->txns.end())
+                    return (false);
+                txn=it->second;
+            }
+            if (e->cursor_id && e->op!=Tracer::OP_CURSOR_CREATE
+                    && e->op!=Tracer::OP_CURSOR_CLONE) {
+                std::map<ham_u64_t, ham_cursor_t *>::iterator it
+                        =m_sh->cursors.find(e->cursor_id);
+                if (it==m_sh->cursors.end())
+                    return (false);
+                cursor=it->second;
+            }
+        }
+
+        make_key(e, &key);
+        make_record(e, &rec);
+
+        switch (e->op) {
+          case Tracer::OP_TXN_BEGIN:
+            if (e->status)
+                return (false);
+            st=ham_txn_begin(&txn, m_sh->env, 0, 0, flags);
+            if (!st) {
+                ScopedLock lock(m_sh->mutex);
+                m_sh->txns[e->txn_id]=txn;
+            }
+            break;
+          case Tracer::OP_TXN_COMMIT:
+          case Tracer::OP_TXN_ABORT:
+            if (!txn)
+                return (false);
+            if (e->op==Tracer::OP_TXN_COMMIT)
+                st=ham_txn_commit(txn, flags);
+            else
+                st=ham_txn_abort(txn, flags);
+            if (!st) {
+                ScopedLock lock(m_sh->mutex);
+                m_sh->txns.erase(e->txn_id);
+            }
+            break;
+          case Tracer::OP_INSERT:
+            st=ham_insert(db, txn, &key, &rec, flags);
+            break;
+          case Tracer::OP_FIND:
+            st=ham_find(db, txn, &key, &rec, flags);
+            break;
+          case Tracer::OP_ERASE:
+            st=ham_erase(db, txn, &key, flags);
+            break;
+          case Tracer::OP_CURSOR_CREATE:
+          case Tracer::OP_CURSOR_CLONE:
+            if (e->status)
+                return (false);
+            if (e->op==Tracer::OP_CURSOR_CREATE)
+                st=ham_cursor_create(db, txn, 0, &cursor);
+            else {
+                ScopedLock lock(m_sh->mutex);
+                std::map<ham_u64_t, ham_cursor_t *>::iterator it
+                        =m_sh->cursors.find(e->key_hash);
+                if (it==m_sh->cursors.end())
+                    return (false);
+                st=ham_cursor_clone(it->second, &cursor);
+            }
+            if (!st) {
+                ScopedLock lock(m_sh->mutex);
+                m_sh->cursors[e->cursor_id]=cursor;
+            }
+            break;
+          case Tracer::OP_CURSOR_CLOSE:
+            if (!cursor)
+                return (false);
+            st=ham_cursor_close(cursor);
+            {
+                ScopedLock lock(m_sh->mutex);
+                m_sh->cursors.erase(e->cursor_id);
+                close_streams(e->cursor_id);
+            }
+            break;
+          case Tracer::OP_CURSOR_INSERT:
+            if (!cursor)
+                return (false);
+            st=ham_cursor_insert(cursor, &key, &rec, flags);
+            break;
+          case Tracer::OP_CURSOR_FIND:
+            if (!cursor)
+                return (false);
+            st=ham_cursor_find_ex(cursor, &key, &rec, flags);
+            break;
+          case Tracer::OP_CURSOR_ERASE:
+            if (!cursor)
+                return (false);
+            st=ham_cursor_erase(cursor, flags);
+            break;
+          case Tracer::OP_CURSOR_MOVE:
+            if (!cursor)
+                return (false);
+            st=ham_cursor_move(cursor, 0, &rec, flags);
+            break;
+          case Tracer::OP_CURSOR_OVERWRITE:
+            if (!cursor)
+                return (false);
+            st=ham_cursor_overwrite(cursor, &rec, flags);
+            break;
+          case Tracer::OP_FLUSH:
+            st=ham_env_flush(m_sh->env, flags);
+            break;
+          case Tracer::OP_ERASE_RANGE: {
+            const trace_range_t *range=(const trace_range_t *)(e+1);
+            ham_key_t end;
+            make_end_key(e, &end);
+            st=ham_erase_range(db, txn,
+                    (range->bounds&TRACE_RANGE_BEGIN) ? &key : 0,
+                    (range->bounds&TRACE_RANGE_END) ? &end : 0, flags);
+            break;
+          }
+          case Tracer::OP_RECORD_STREAM_OPEN: {
+            if (e->status || !cursor)
+                return (false);
+            ham_record_stream_t *stream;
+            st=ham_record_stream_open(cursor, flags, &stream);
+            if (!st) {
+                ScopedLock lock(m_sh->mutex);
+                m_sh->streams[e->key_hash]=std::make_pair(e->cursor_id, stream);
+            }
+            break;
+          }
+          case Tracer::OP_RECORD_STREAM_WRITE:
+          case Tracer::OP_RECORD_STREAM_CLOSE: {
+            ham_record_stream_t *stream;
+            {
+                ScopedLock lock(m_sh->mutex);
+                std::map<ham_u64_t,
+                        std::pair<ham_u64_t, ham_record_stream_t *> >::iterator
+                        it=m_sh->streams.find(e->key_hash);
+                if (it==m_sh->streams.end())
+                    return (false);
+                stream=it->second.second;
+                if (e->op==Tracer::OP_RECORD_STREAM_CLOSE)
+                    m_sh->streams.erase(it);
+            }
+            if (e->op==Tracer::OP_RECORD_STREAM_CLOSE)
+                st=ham_record_stream_close(stream);
+            else
+                st=ham_record_stream_write(stream,
+                        rec.data ? rec.data : (void *)"", rec.size);
+            break;
+          }
+          default:
+            return (false);
+        }
+
+        *pst=st;
+        return (true);
+    }
+
+    /** creates the key of an operation; uses the recorded key data or
+     * synthesizes a key from the hash */
+    void make_key(const trace_entry_t *e, ham_key_t *key) {
+        memset(key, 0, sizeof(*key));
+        if (!e->key_size || e->op==Tracer::OP_CURSOR_MOVE)
+            return;
+
+        /* recno keys are assigned by hamsterdb */
+        if ((e->op==Tracer::OP_INSERT || e->op==Tracer::OP_CURSOR_INSERT)
+                && (e->flags&HAM_OVERWRITE)==0
+                && is_recno(e->dbname))
+            return;
+
+        key->size=e->key_size;
+        if (m_sh->trace_flags&HAM_TRACE_FULL_DATA) {
+            /* the key data of a range erase follows the trace_range_t */
+            key->data=(ham_u8_t *)(e+1)
+                    +(e->op==Tracer::OP_ERASE_RANGE ? sizeof(trace_range_t) : 0);
+            return;
+        }
+
+        key->data=synthesize(e->key_hash, e->key_size, m_keybuf);
+    }
+
+    /** creates the upper bound of a range erase */
+    void make_end_key(const trace_entry_t *e, ham_key_t *key) {
+        const trace_range_t *range=(const trace_range_t *)(e+1);
+        memset(key, 0, sizeof(*key));
+        if (!range->end_size)
+            return;
+
+        key->size=range->end_size;
+        if (m_sh->trace_flags&HAM_TRACE_FULL_DATA) {
+            key->data=(ham_u8_t *)(range+1)+e->key_size;
+            return;
+        }
+
+        key->data=synthesize(range->end_hash, range->end_size, m_endbuf);
+    }
+
+    /** fills @a buf with key data which is derived from a key hash */
+    static void *synthesize(ham_u64_t h, ham_u32_t size,
+                std::vector<ham_u8_t> &buf) {
+        if (buf.size()<size)
+            buf.resize(size);
+        for (ham_u32_t i=0; i<size; i++) {
+            buf[i]=(ham_u8_t)(h>>((i%8)*8));
+            /* vary the filler if the key is longer than the hash */
+            if (i%8==7)
+                h=h*0x100000001b3ull+1;
+        }
+        return (&buf[0]);
+    }
+
+    /** creates the record of an operation */
+    void make_record(const trace_entry_t *e, ham_record_t *rec) {
+        memset(rec, 0, sizeof(*rec));
+        if (e->op!=Tracer::OP_INSERT && e->op!=Tracer::OP_CURSOR_INSERT
+                && e->op!=Tracer::OP_CURSOR_OVERWRITE
+                && e->op!=Tracer::OP_RECORD_STREAM_WRITE)
+            return;
+
+        rec->size=e->record_size;
+        if (!rec->size)
+            return;
+        if (m_sh->trace_flags&HAM_TRACE_FULL_DATA) {
+            rec->data=(ham_u8_t *)(e+1)+e->payload_size-e->record_size;
+            return;
+        }
+        if (m_recbuf.size()<e->record_size)
+            m_recbuf.resize(e->record_size, 'x');
+        rec->data=&m_recbuf[0];
+    }
+
+    /** closes the streams of a closed Cursor; the caller holds the
+     * mutex */
+    void close_streams(ham_u64_t cursor_id) {
+        std::map<ham_u64_t,
+                std::pair<ham_u64_t, ham_record_stream_t *> >::iterator it
+                =m_sh->streams.begin();
+        while (it!=m_sh->streams.end()) {
+            if (it->second.first==cursor_id) {
+                (void)ham_record_stream_close(it->second.second);
+                m_sh->streams.erase(it++);
+            }
+            else
+                ++it;
+        }
+    }
+
+    /** returns true if a Database uses record numbers */
+    bool is_recno(ham_u16_t dbname) {
+        std::map<ham_u16_t, bool>::iterator it=m_recno.find(dbname);
+        if (it!=m_recno.end())
+            return (it->second);
+
+        ham_parameter_t params[2]={{HAM_PARAM_GET_FLAGS, 0}, {0, 0}};
+        ham_db_t *db;
+        {
+            ScopedLock lock(m_sh->mutex);
+            db=m_sh->databases[dbname];
+        }
+        bool recno=db && ham_get_parameters(db, &params[0])==0
+                && (params[0].value&HAM_RECORD_NUMBER);
+        m_recno[dbname]=recno;
+        return (recno);
+    }
+
+    /** waits until the recorded time of an operation */
+    void wait_until(ham_u64_t ns) {
+        ham_u64_t now=os_get_time_ns();
+        if (ns<=now)
+            return;
+        boost::this_thread::sleep(
+                boost::posix_time::microseconds((ns-now)/1000));
+    }
+
+    shared_t *m_sh;
+    const std::vector<const trace_entry_t *> *m_entries;
+    result_t *m_result;
+    std::vector<ham_u8_t> m_keybuf;
+    std::vector<ham_u8_t> m_endbuf;
+    std::vector<ham_u8_t> m_recbuf;
+    std::map<ham_u16_t, bool> m_recno;
+};
+
+static void
+print_results(config_t *cfg, result_t *result, size_t entries,
+            unsigned threads, double recorded_secs, double run_secs,
+            ham_u64_t filesize, ham_env_metrics_t *metrics)
+{
+    FILE *f=stdout;
+    if (cfg->output) {
+        f=fopen(cfg->output, "w");
+        if (!f) {
+            fprintf(stderr, "failed to open `%s'\n", cfg->output);
+            exit(-1);
+        }
+    }
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"config\": {\"trace\": \"%s\", \"filename\": \"%s\", "
+            "\"speed\": \"%s\", \"threads\": %u, \"cachesize\": %llu, "
+            "\"pagesize\": %u, \"env_flags\": %u},\n",
+            cfg->trace, cfg->filename,
+            cfg->recorded_speed ? "recorded" : "max", threads,
+            (unsigned long long)cfg->cachesize, cfg->pagesize,
+            cfg->env_flags);
+    fprintf(f, "  \"replay\": {\"entries\": %llu, \"operations\": %llu, "
+            "\"skipped\": %llu, \"mismatches\": %llu, "
+            "\"recorded_seconds\": %.6f, \"seconds\": %.6f, "
+            "\"ops_per_sec\": %.1f},\n",
+            (unsigned long long)entries,
+            (unsigned long long)result->operations,
+            (unsigned long long)result->skipped,
+            (unsigned long long)result->mismatches,
+            recorded_secs, run_secs,
+            run_secs>0 ? (double)result->operations/run_secs : 0.0);
+    fprintf(f, "  \"latency\": {\n");
+    int last=0;
+    for (int op=1; op<Tracer::OP_MAX; op++)
+        if (result->latency[op].count)
+            last=op;
+    for (int op=1; op<=last; op++)
+        if (result->latency[op].count)
+            print_histogram(f, op_names[op], &result->latency[op], op<last);
+    fprintf(f, "  },\n");
+    if (metrics) {
+        fprintf(f, "  \"metrics\": {\"cache_hits\": %llu, "
+                "\"cache_misses\": %llu, \"pages_read\": %llu, "
+                "\"pages_written\": %llu, \"bytes_read\": %llu, "
+                "\"bytes_written\": %llu, \"fsyncs\": %llu, "
+                "\"log_bytes\": %llu, \"journal_bytes\": %llu, "
+                "\"lock_waits\": %llu, \"lock_wait_ns\": %llu},\n",
+                (unsigned long long)metrics->cache_hits,
+                (unsigned long long)metrics->cache_misses,
+                (unsigned long long)metrics->pages_read,
+                (unsigned long long)metrics->pages_written,
+                (unsigned long long)metrics->bytes_read,
+                (unsigned long long)metrics->bytes_written,
+                (unsigned long long)metrics->fsyncs,
+                (unsigned long long)metrics->log_bytes,
+                (unsigned long long)metrics->journal_bytes,
+                (unsigned long long)metrics->lock_waits,
+                (unsigned long long)metrics->lock_wait_ns);
+    }
+    fprintf(f, "  \"file_size\": %llu,\n", (unsigned long long)filesize);
+    fprintf(f, "  \"max_rss_kb\": %llu\n",
+            (unsigned long long)get_max_rss_kb());
+    fprintf(f, "}\n");
+
+    if (f!=stdout)
+        fclose(f);
+}
+
+int
+main(int argc, char **argv)
+{
+    unsigned opt;
+    char *param;
+    ham_u64_t v;
+    config_t cfg;
+    ham_status_t st;
+
+    ham_u32_t maj, min, rev;
+    const char *licensee, *product;
+    ham_get_license(&licensee, &product);
+    ham_get_version(&maj, &min, &rev);
+
+    getopts_init(argc, argv, "ham_replay");
+
+    while ((opt=getopts(&opts[0], &param))) {
+        switch (opt) {
+            case ARG_DATABASE:
+                cfg.filename=param;
+                break;
+            case ARG_SPEED:
+                if (param && !strcmp(param, "recorded"))
+                    cfg.recorded_speed=true;
+                else if (param && !strcmp(param, "max"))
+                    cfg.recorded_speed=false;
+                else {
+                    fprintf(stderr, "Invalid parameter `speed'; "
+                            "expected `max' or `recorded'.\n");
+                    return (-1);
+                }
+                break;
+            case ARG_MULTI_THREADED:
+                cfg.multi_threaded=true;
+                break;
+            case ARG_CACHESIZE:
+                if (!parse_number("cachesize", param, &cfg.cachesize))
+                    return (-1);
+                break;
+            case ARG_PAGESIZE:
+                if (!parse_number("pagesize", param, &v))
+                    return (-1);
+                cfg.pagesize=(ham_size_t)v;
+                break;
+            case ARG_NO_MMAP:
+                cfg.env_flags|=HAM_DISABLE_MMAP;
+                break;
+            case ARG_RECOVERY:
+                cfg.env_flags|=HAM_ENABLE_RECOVERY;
+                break;
+            case ARG_TRANSACTIONS:
+                cfg.env_flags|=HAM_ENABLE_TRANSACTIONS;
+                break;
+            case ARG_INMEMORY:
+                cfg.env_flags|=HAM_IN_MEMORY_DB;
+                break;
+            case ARG_IGNORE_FLAGS:
+                cfg.ignore_flags=true;
+                break;
+            case ARG_OUTPUT:
+                cfg.output=param;
+                break;
+            case ARG_METRICS:
+                cfg.env_flags|=HAM_ENABLE_METRICS;
+                break;
+            case GETOPTS_PARAMETER:
+                if (cfg.trace) {
+                    fprintf(stderr, "Multiple files specified. Please "
+                            "specify only one trace file.\n");
+                    return (-1);
+                }
+                cfg.trace=param;
+                break;
+            case ARG_HELP:
+                printf("hamsterdb %d.%d.%d - Copyright (C) 2005-2012 "
+                       "Christoph Rupp (chris@crupp.de).\n\n",
+                       maj, min, rev);
+
+                if (licensee[0]=='\0')
+                    printf(
+                       "This program is free software; you can redistribute "
+                       "it and/or modify it\nunder the terms of the GNU "
+                       "General Public License as published by the Free\n"
+                       "Software Foundation; either version 2 of the License,\n"
+                       "or (at your option) any later version.\n\n"
+                       "See file COPYING.GPL2 and COPYING.GPL3 for License "
+                       "information.\n\n");
+                else
+                    printf("Commercial version; licensed for %s (%s)\n\n",
+                            licensee, product);
+
+                printf("usage: ham_replay [options] tracefile\n");
+                printf("usage: ham_replay -h\n");
+                for (option_t *o=&opts[0]; o->name; o++)
+                    printf("       -%s%s: %s (alias: --%s)\n", o->shortopt,
+                            (o->flags&GETOPTS_NEED_ARGUMENT) ? " ARG" : "",
+                            o->helpdesc, o->longopt);
+                return (0);
+            default:
+                fprintf(stderr, "Invalid or unknown parameter `%s'. "
+                       "Enter `ham_replay --help' for usage.\n", param);
+                return (-1);
+        }
+    }
+
+    if (!cfg.trace) {
+        fprintf(stderr, "Trace file is missing. Enter `ham_replay --help' "
+                "for usage.\n");
+        return (-1);
+    }
+
+    /* read the trace */
+    std::vector<ham_u8_t> buffer;
+    std::vector<const trace_entry_t *> entries;
+    load_trace(cfg.trace, buffer);
+    parse_trace(buffer, entries);
+
+    const trace_header_t *header=(const trace_header_t *)&buffer[0];
+    if (!cfg.ignore_flags)
+        cfg.env_flags|=header->env_flags&REPLAY_ENV_FLAGS;
+
+    /* split the trace by threads */
+    std::map<ham_u32_t, std::vector<const trace_entry_t *> > per_thread;
+    if (cfg.multi_threaded) {
+        for (size_t i=0; i<entries.size(); i++)
+            per_thread[entries[i]->thread_id].push_back(entries[i]);
+    }
+    else
+        per_thread[0]=entries;
+
+    /* create the Environment and all Databases */
+    shared_t sh;
+    sh.cfg=&cfg;
+    sh.trace_flags=header->flags;
+
+    ham_parameter_t params[3];
+    int p=0;
+    if (cfg.cachesize) {
+        params[p].name=HAM_PARAM_CACHESIZE;
+        params[p++].value=cfg.cachesize;
+    }
+    if (cfg.pagesize) {
+        params[p].name=HAM_PARAM_PAGESIZE;
+        params[p++].value=cfg.pagesize;
+    }
+    params[p].name=0;
+    params[p].value=0;
+
+    st=ham_env_new(&sh.env);
+    if (st)
+        error("ham_env_new", st);
+    st=ham_env_create_ex(sh.env, cfg.filename, cfg.env_flags, 0644,
+                &params[0]);
+    if (st)
+        error("ham_env_create_ex", st);
+    create_databases(&sh, entries);
+
+    /* replay */
+    std::vector<result_t> results(per_thread.size());
+    std::vector<Thread *> threads;
+    sh.start=os_get_time_ns();
+    if (per_thread.size()==1)
+        Worker(&sh, &per_thread.begin()->second, &results[0])();
+    else {
+        int i=0;
+        std::map<ham_u32_t, std::vector<const trace_entry_t *> >::iterator it;
+        for (it=per_thread.begin(); it!=per_thread.end(); it++, i++)
+            threads.push_back(new Thread(Worker(&sh, &it->second,
+                            &results[i])));
+        for (size_t j=0; j<threads.size(); j++) {
+            threads[j]->join();
+            delete threads[j];
+        }
+    }
+    double run_secs=(os_get_time_ns()-sh.start)/1e9;
+    double recorded_secs=entries.empty()
+                ? 0.0
+                : entries[entries.size()-1]->timestamp/1e9;
+
+    result_t total;
+    for (size_t i=0; i<results.size(); i++)
+        total.merge(results[i]);
+
+    ham_env_metrics_t metrics;
+    bool have_metrics=false;
+    if (cfg.env_flags&HAM_ENABLE_METRICS)
+        have_metrics=(0==ham_env_get_metrics(sh.env, &metrics, 0));
+
+    /* closes all Cursors and aborts all pending Transactions; the
+     * streams of the closed Cursors can be closed afterwards */
+    st=ham_env_close(sh.env, HAM_AUTO_CLEANUP|HAM_TXN_AUTO_ABORT);
+    if (st)
+        error("ham_env_close", st);
+    std::map<ham_u64_t,
+            std::pair<ham_u64_t, ham_record_stream_t *> >::iterator sit;
+    for (sit=sh.streams.begin(); sit!=sh.streams.end(); sit++)
+        (void)ham_record_stream_close(sit->second.second);
+    std::map<ham_u16_t, ham_db_t *>::iterator it;
+    for (it=sh.databases.begin(); it!=sh.databases.end(); it++)
+        ham_delete(it->second);
+    ham_env_delete(sh.env);
+
+    ham_u64_t filesize=0;
+    if (!(cfg.env_flags&HAM_IN_MEMORY_DB)) {
+        struct stat buf;
+        if (stat(cfg.filename, &buf)==0)
+            filesize=(ham_u64_t)buf.st_size;
+    }
+
+    print_results(&cfg, &total, entries.size(), (unsigned)per_thread.size(),
+            recorded_secs, run_secs, filesize,
+            have_metrics ? &metrics : 0);
+
+    return (0);
+}
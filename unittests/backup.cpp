@@ -0,0 +1,338 @@
+/**
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+#include "../src/config.h"
+
+#include <string.h>
+#include <boost/bind.hpp>
+#include <ham/hamsterdb.h>
+#include <ham/hamsterdb_int.h>
+#include "../src/env.h"
+#include "../src/backup.h"
+
+#include "bfc-testsuite.hpp"
+#include "hamster_fixture.hpp"
+#include "os.hpp"
+
+using namespace bfc;
+
+#define RECORDS     2000
+
+class BackupTest : public hamsterDB_fixture
+{
+    define_super(hamsterDB_fixture);
+
+public:
+    BackupTest(ham_u32_t flags=0, const char *name="BackupTest")
+    :   hamsterDB_fixture(name), m_db(0), m_env(0), m_flags(flags)
+    {
+        testrunner::get_instance()->register_fixture(this);
+        BFC_REGISTER_TEST(BackupTest, negativeTest);
+        BFC_REGISTER_TEST(BackupTest, fullTest);
+        BFC_REGISTER_TEST(BackupTest, snapshotTest);
+        BFC_REGISTER_TEST(BackupTest, truncateTest);
+        BFC_REGISTER_TEST(BackupTest, incrementalTest);
+        BFC_REGISTER_TEST(BackupTest, concurrentTest);
+    }
+
+protected:
+    ham_db_t *m_db;
+    ham_env_t *m_env;
+    ham_u32_t m_flags;
+
+public:
+    virtual void setup()
+    {
+        __super::setup();
+
+        os::unlink(BFC_OPATH(".test"));
+        os::unlink(BFC_OPATH(".backup"));
+        BFC_ASSERT_EQUAL(0, ham_new(&m_db));
+        BFC_ASSERT_EQUAL(0, ham_env_new(&m_env));
+    }
+
+    virtual void teardown()
+    {
+        __super::teardown();
+
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+        ham_delete(m_db);
+        ham_env_delete(m_env);
+        m_db=0;
+        m_env=0;
+        os::unlink(BFC_OPATH(".backup"));
+    }
+
+    void create()
+    {
+        ham_parameter_t params[]={
+            { HAM_PARAM_PAGESIZE, 1024 },
+            { 0, 0 }
+        };
+
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create_ex(m_env, BFC_OPATH(".test"), m_flags,
+                    0644, &params[0]));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create_db(m_env, m_db, 1, 0, 0));
+    }
+
+    static void insert(ham_db_t *db, int from, int to, int value)
+    {
+        ham_key_t key;
+        ham_record_t rec;
+        char buffer[64];
+
+        for (int i=from; i<to; i++) {
+            memset(&key, 0, sizeof(key));
+            memset(&rec, 0, sizeof(rec));
+            memset(buffer, (char)(i+value), sizeof(buffer));
+            key.data=&i;
+            key.size=sizeof(i);
+            rec.data=buffer;
+            rec.size=sizeof(buffer);
+            if (ham_insert(db, 0, &key, &rec, HAM_OVERWRITE))
+                break;
+        }
+    }
+
+    void erase(int from, int to)
+    {
+        ham_key_t key;
+
+        for (int i=from; i<to; i++) {
+            memset(&key, 0, sizeof(key));
+            key.data=&i;
+            key.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0,
+                    ham_erase(m_db, 0, &key, 0));
+        }
+    }
+
+    /* opens the copy and verifies that keys [from, to) exist with the
+     * given value, and that no other keys exist */
+    void verify(int from, int to, int value)
+    {
+        ham_env_t *env;
+        ham_db_t *db;
+        ham_key_t key;
+        ham_record_t rec;
+        ham_offset_t count;
+
+        BFC_ASSERT_EQUAL(0, ham_env_new(&env));
+        BFC_ASSERT_EQUAL(0, ham_new(&db));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_open(env, BFC_OPATH(".backup"), 0));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(env, db, 1, 0, 0));
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(db, 0));
+
+        BFC_ASSERT_EQUAL(0, ham_get_key_count(db, 0, 0, &count));
+        BFC_ASSERT_EQUAL((ham_offset_t)(to-from), count);
+        for (int i=from; i<to; i++) {
+            memset(&key, 0, sizeof(key));
+            memset(&rec, 0, sizeof(rec));
+            key.data=&i;
+            key.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0, ham_find(db, 0, &key, &rec, 0));
+            BFC_ASSERT_EQUAL((ham_size_t)64, rec.size);
+            BFC_ASSERT_EQUAL((char)(i+value), *(char *)rec.data);
+        }
+
+        BFC_ASSERT_EQUAL(0, ham_env_close(env, HAM_AUTO_CLEANUP));
+        ham_delete(db);
+        ham_env_delete(env);
+    }
+
+    void negativeTest()
+    {
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_backup(0, BFC_OPATH(".backup"), 0));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_backup(m_env, 0, 0));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_backup(m_env, BFC_OPATH(".backup"), 0x100));
+        BFC_ASSERT_EQUAL(HAM_NOT_INITIALIZED,
+                ham_env_backup(m_env, BFC_OPATH(".backup"), 0));
+
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create(m_env, 0, HAM_IN_MEMORY_DB, 0644));
+        BFC_ASSERT_EQUAL(HAM_NOT_IMPLEMENTED,
+                ham_env_backup(m_env, BFC_OPATH(".backup"), 0));
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, 0));
+
+        create();
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_backup(m_env, BFC_OPATH(".test"), 0));
+    }
+
+    void fullTest()
+    {
+        create();
+        insert(m_db, 0, RECORDS, 0);
+        BFC_ASSERT_EQUAL(0,
+                ham_env_backup(m_env, BFC_OPATH(".backup"), 0));
+        verify(0, RECORDS, 0);
+
+        /* the copy is overwritten by the next backup */
+        erase(RECORDS/2, RECORDS);
+        BFC_ASSERT_EQUAL(0,
+                ham_env_backup(m_env, BFC_OPATH(".backup"), 0));
+        verify(0, RECORDS/2, 0);
+    }
+
+    void snapshotTest()
+    {
+        Environment *env=(Environment *)m_env;
+
+        create();
+        insert(m_db, 0, RECORDS, 0);
+
+        /* the Database is modified after the snapshot was taken */
+        Backup *backup=new Backup(env);
+        env->set_backup(backup);
+        BFC_ASSERT_EQUAL(0, backup->prepare(BFC_OPATH(".backup"), 0));
+        insert(m_db, 0, RECORDS*2, 1);
+        BFC_ASSERT_EQUAL(0, ham_env_flush(m_env, 0));
+        BFC_ASSERT_EQUAL(0, backup->finish(backup->run()));
+
+        verify(0, RECORDS, 0);
+    }
+
+    void truncateTest()
+    {
+        Environment *env=(Environment *)m_env;
+        ham_compact_progress_t progress;
+
+        create();
+        insert(m_db, 0, RECORDS, 0);
+        erase(0, RECORDS/2);
+
+        /* the file is truncated after the snapshot was taken */
+        Backup *backup=new Backup(env);
+        env->set_backup(backup);
+        BFC_ASSERT_EQUAL(0, backup->prepare(BFC_OPATH(".backup"), 0));
+        do {
+            BFC_ASSERT_EQUAL(0, ham_env_compact(m_env, 100, &progress));
+        } while (!progress.done);
+        BFC_ASSERT(progress.bytes_truncated>0);
+        BFC_ASSERT_EQUAL(0, backup->finish(backup->run()));
+
+        verify(RECORDS/2, RECORDS, 0);
+    }
+
+    void incrementalTest()
+    {
+        Environment *env=(Environment *)m_env;
+
+        create();
+        insert(m_db, 0, RECORDS, 0);
+
+        /* without a previous backup, a full backup is made */
+        BFC_ASSERT_EQUAL(0,
+                ham_env_backup(m_env, BFC_OPATH(".backup"),
+                    HAM_BACKUP_INCREMENTAL));
+        ham_u64_t full=env->get_backup()->get_pages_copied();
+        verify(0, RECORDS, 0);
+
+        /* only the modified pages are copied */
+        insert(m_db, 0, 10, 1);
+        BFC_ASSERT_EQUAL(0,
+                ham_env_backup(m_env, BFC_OPATH(".backup"),
+                    HAM_BACKUP_INCREMENTAL));
+        BFC_ASSERT(env->get_backup()->get_pages_copied()>0);
+        BFC_ASSERT(env->get_backup()->get_pages_copied()<full/4);
+
+        /* nothing was modified */
+        BFC_ASSERT_EQUAL(0,
+                ham_env_backup(m_env, BFC_OPATH(".backup"),
+                    HAM_BACKUP_INCREMENTAL));
+        BFC_ASSERT_EQUAL((ham_u64_t)0,
+                env->get_backup()->get_pages_copied());
+
+        /* the file grows */
+        insert(m_db, RECORDS, RECORDS*2, 0);
+        BFC_ASSERT_EQUAL(0,
+                ham_env_backup(m_env, BFC_OPATH(".backup"),
+                    HAM_BACKUP_INCREMENTAL));
+        BFC_ASSERT(env->get_backup()->get_pages_copied()<full*2);
+
+        ham_env_t *copy;
+        ham_db_t *db;
+        ham_key_t key;
+        ham_record_t rec;
+        BFC_ASSERT_EQUAL(0, ham_env_new(&copy));
+        BFC_ASSERT_EQUAL(0, ham_new(&db));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_open(copy, BFC_OPATH(".backup"), 0));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(copy, db, 1, 0, 0));
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(db, 0));
+        for (int i=0; i<RECORDS*2; i++) {
+            memset(&key, 0, sizeof(key));
+            memset(&rec, 0, sizeof(rec));
+            key.data=&i;
+            key.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0, ham_find(db, 0, &key, &rec, 0));
+            BFC_ASSERT_EQUAL((char)(i<10 ? i+1 : i), *(char *)rec.data);
+        }
+        BFC_ASSERT_EQUAL(0, ham_env_close(copy, HAM_AUTO_CLEANUP));
+        ham_delete(db);
+        ham_env_delete(copy);
+    }
+
+    void concurrentTest()
+    {
+        create();
+        insert(m_db, 0, RECORDS, 0);
+
+        /* the copy is consistent while another thread inserts keys */
+        Thread thread(boost::bind(&BackupTest::insert, m_db,
+                    RECORDS, RECORDS*10, 0));
+        for (int i=0; i<5; i++) {
+            BFC_ASSERT_EQUAL(0,
+                    ham_env_backup(m_env, BFC_OPATH(".backup"),
+                        i ? HAM_BACKUP_INCREMENTAL : 0));
+
+            ham_env_t *env;
+            ham_db_t *db;
+            ham_key_t key;
+            ham_record_t rec;
+            BFC_ASSERT_EQUAL(0, ham_env_new(&env));
+            BFC_ASSERT_EQUAL(0, ham_new(&db));
+            BFC_ASSERT_EQUAL(0,
+                    ham_env_open(env, BFC_OPATH(".backup"), 0));
+            BFC_ASSERT_EQUAL(0, ham_env_open_db(env, db, 1, 0, 0));
+            BFC_ASSERT_EQUAL(0, ham_check_integrity(db, 0));
+            for (int j=0; j<RECORDS; j++) {
+                memset(&key, 0, sizeof(key));
+                memset(&rec, 0, sizeof(rec));
+                key.data=&j;
+                key.size=sizeof(j);
+                BFC_ASSERT_EQUAL(0, ham_find(db, 0, &key, &rec, 0));
+            }
+            BFC_ASSERT_EQUAL(0, ham_env_close(env, HAM_AUTO_CLEANUP));
+            ham_delete(db);
+            ham_env_delete(env);
+        }
+        thread.join();
+    }
+};
+
+class RecoveryBackupTest : public BackupTest
+{
+public:
+    RecoveryBackupTest()
+    :   BackupTest(HAM_ENABLE_RECOVERY, "RecoveryBackupTest")
+    {
+    }
+};
+
+BFC_REGISTER_FIXTURE(BackupTest);
+BFC_REGISTER_FIXTURE(RecoveryBackupTest);
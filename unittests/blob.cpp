@@ -20,6 +20,7 @@
 #include "../src/page.h"
 #include "../src/btree_key.h"
 #include "../src/freelist.h"
+#include "../src/slab.h"
 #include "os.hpp"
 
 #include "bfc-testsuite.hpp"
@@ -117,8 +118,8 @@ public:
         blob_set_size(&b, 0x123ull);
         BFC_ASSERT_EQUAL((ham_u64_t)0x123ull, blob_get_size(&b));
 
-        blob_set_flags(&b, 0x13);
-        BFC_ASSERT_EQUAL((ham_u32_t)0x13, blob_get_flags(&b));
+        blob_set_checksum(&b, 0x13);
+        BFC_ASSERT_EQUAL((ham_u32_t)0x13, blob_get_checksum(&b));
     }
 
     void dupeStructureTest(void)
@@ -492,12 +493,757 @@ public:
     }
 };
 
+class SlabBlobTest : public hamsterDB_fixture
+{
+    define_super(hamsterDB_fixture);
+
+public:
+    SlabBlobTest()
+    :   hamsterDB_fixture("SlabBlobTest"), m_db(0), m_env(0)
+    {
+        testrunner::get_instance()->register_fixture(this);
+        BFC_REGISTER_TEST(SlabBlobTest, invalidFlagsTest);
+        BFC_REGISTER_TEST(SlabBlobTest, allocReadFreeTest);
+        BFC_REGISTER_TEST(SlabBlobTest, sharedPageTest);
+        BFC_REGISTER_TEST(SlabBlobTest, overwriteTest);
+        BFC_REGISTER_TEST(SlabBlobTest, partialOverwriteTest);
+        BFC_REGISTER_TEST(SlabBlobTest, reopenTest);
+    }
+
+protected:
+    ham_db_t *m_db;
+    ham_env_t *m_env;
+
+public:
+    virtual void setup()
+    {
+        __super::setup();
+
+        ham_parameter_t params[2]=
+        {
+            { HAM_PARAM_PAGESIZE, 4096 },
+            { 0, 0 }
+        };
+
+        os::unlink(BFC_OPATH(".test"));
+
+        BFC_ASSERT_EQUAL(0, ham_new(&m_db));
+        BFC_ASSERT_EQUAL(0,
+                ham_create_ex(m_db, BFC_OPATH(".test"),
+                    HAM_ENABLE_SLAB_RECORDS, 0644, &params[0]));
+        m_env=ham_get_env(m_db);
+    }
+
+    virtual void teardown()
+    {
+        __super::teardown();
+
+        /* clear the changeset, otherwise ham_close will complain */
+        ((Environment *)m_env)->get_changeset().clear();
+
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        ham_delete(m_db);
+    }
+
+    ham_offset_t alloc(ham_size_t size, ham_u8_t fill,
+                ham_u32_t flags=BLOB_RECORD)
+    {
+        ham_u8_t buffer[1024];
+        ham_offset_t rid=0;
+        ham_record_t record;
+        ::memset(&record, 0, sizeof(record));
+        ::memset(buffer, fill, sizeof(buffer));
+        record.size=size;
+        record.data=buffer;
+        BFC_ASSERT_EQUAL(0,
+                blob_allocate((Environment *)m_env, (Database *)m_db,
+                                &record, flags, &rid));
+        BFC_ASSERT(rid!=0);
+        return (rid);
+    }
+
+    void check(ham_offset_t rid, ham_size_t size, ham_u8_t fill)
+    {
+        ham_record_t record;
+        ::memset(&record, 0, sizeof(record));
+        BFC_ASSERT_EQUAL(0, blob_read((Database *)m_db, 0, rid, &record, 0));
+        BFC_ASSERT_EQUAL(size, record.size);
+        for (ham_size_t i=0; i<size; i++)
+            BFC_ASSERT_EQUAL(fill, ((ham_u8_t *)record.data)[i]);
+    }
+
+    void invalidFlagsTest(void)
+    {
+        ham_db_t *db;
+        BFC_ASSERT_EQUAL(0, ham_new(&db));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_create_ex(db, BFC_OPATH(".test2"),
+                    HAM_IN_MEMORY_DB|HAM_ENABLE_SLAB_RECORDS, 0644, 0));
+        ham_delete(db);
+    }
+
+    void allocReadFreeTest(void)
+    {
+        std::vector<ham_offset_t> rids;
+        ham_offset_t size;
+
+        for (ham_size_t i=9; i<=SlabAllocator::MAX_RECORD_SIZE; i+=5) {
+            ham_offset_t rid=alloc(i, (ham_u8_t)i);
+            BFC_ASSERT(SlabAllocator::is_slab_rid(rid));
+            rids.push_back(rid);
+        }
+        for (ham_size_t i=0; i<rids.size(); i++) {
+            check(rids[i], 9+i*5, (ham_u8_t)(9+i*5));
+            BFC_ASSERT_EQUAL(0, blob_get_datasize((Database *)m_db,
+                        rids[i], &size));
+            BFC_ASSERT_EQUAL((ham_offset_t)(9+i*5), size);
+        }
+
+        /* large records, extended keys and duplicate tables are blobs */
+        BFC_ASSERT(!SlabAllocator::is_slab_rid(
+                    alloc(SlabAllocator::MAX_RECORD_SIZE+1, 1)));
+        BFC_ASSERT(!SlabAllocator::is_slab_rid(alloc(20, 2, 0)));
+
+        for (ham_size_t i=0; i<rids.size(); i++)
+            BFC_ASSERT_EQUAL(0, blob_free((Environment *)m_env,
+                        (Database *)m_db, rids[i], 0));
+    }
+
+    void sharedPageTest(void)
+    {
+        ham_size_t ps=((Environment *)m_env)->get_pagesize();
+        ham_offset_t rid1=alloc(20, 1);
+        ham_offset_t rid2=alloc(25, 2);
+        ham_offset_t rid3=alloc(200, 3);
+
+        /* records of the same size class share a page */
+        BFC_ASSERT(rid1!=rid2);
+        BFC_ASSERT_EQUAL(SlabAllocator::get_page_address(rid1, ps),
+                SlabAllocator::get_page_address(rid2, ps));
+        BFC_ASSERT(SlabAllocator::get_page_address(rid1, ps)
+                != SlabAllocator::get_page_address(rid3, ps));
+
+        /* a freed slot is re-used */
+        BFC_ASSERT_EQUAL(0, blob_free((Environment *)m_env,
+                    (Database *)m_db, rid1, 0));
+        BFC_ASSERT_EQUAL(rid1, alloc(30, 4));
+        check(rid1, 30, 4);
+        check(rid2, 25, 2);
+        check(rid3, 200, 3);
+    }
+
+    void overwriteTest(void)
+    {
+        ham_u8_t buffer[512];
+        ham_offset_t rid=alloc(20, 1), newrid;
+        ham_record_t record;
+        ::memset(&record, 0, sizeof(record));
+        ::memset(buffer, 5, sizeof(buffer));
+        record.data=buffer;
+
+        /* the new record fits into the slot */
+        record.size=28;
+        BFC_ASSERT_EQUAL(0, blob_overwrite((Environment *)m_env,
+                    (Database *)m_db, rid, &record, BLOB_RECORD, &newrid));
+        BFC_ASSERT_EQUAL(rid, newrid);
+        check(rid, 28, 5);
+
+        /* the new record is moved to a larger slot */
+        record.size=100;
+        BFC_ASSERT_EQUAL(0, blob_overwrite((Environment *)m_env,
+                    (Database *)m_db, rid, &record, BLOB_RECORD, &newrid));
+        BFC_ASSERT(rid!=newrid);
+        BFC_ASSERT(SlabAllocator::is_slab_rid(newrid));
+        check(newrid, 100, 5);
+
+        /* ... and then to a blob */
+        rid=newrid;
+        record.size=sizeof(buffer);
+        BFC_ASSERT_EQUAL(0, blob_overwrite((Environment *)m_env,
+                    (Database *)m_db, rid, &record, BLOB_RECORD, &newrid));
+        BFC_ASSERT(!SlabAllocator::is_slab_rid(newrid));
+        check(newrid, sizeof(buffer), 5);
+    }
+
+    void partialOverwriteTest(void)
+    {
+        ham_u8_t buffer[4]={9, 9, 9, 9};
+        ham_offset_t rid=alloc(20, 1), newrid;
+        ham_record_t record;
+        ::memset(&record, 0, sizeof(record));
+        record.data=buffer;
+        record.size=30;
+        record.partial_offset=24;
+        record.partial_size=sizeof(buffer);
+
+        BFC_ASSERT_EQUAL(0, blob_overwrite((Environment *)m_env,
+                    (Database *)m_db, rid, &record,
+                    BLOB_RECORD|HAM_PARTIAL, &newrid));
+        BFC_ASSERT_EQUAL(rid, newrid);
+
+        ::memset(&record, 0, sizeof(record));
+        BFC_ASSERT_EQUAL(0, blob_read((Database *)m_db, 0, rid, &record, 0));
+        BFC_ASSERT_EQUAL((ham_size_t)30, record.size);
+        for (ham_size_t i=0; i<30; i++) {
+            ham_u8_t expected=i<20 ? 1 : (i>=24 && i<28 ? 9 : 0);
+            BFC_ASSERT_EQUAL(expected, ((ham_u8_t *)record.data)[i]);
+        }
+
+        /* partial read */
+        record.partial_offset=22;
+        record.partial_size=4;
+        BFC_ASSERT_EQUAL(0, blob_read((Database *)m_db, 0, rid, &record,
+                    HAM_PARTIAL));
+        BFC_ASSERT_EQUAL((ham_size_t)4, record.size);
+        BFC_ASSERT_EQUAL(0, ((ham_u8_t *)record.data)[1]);
+        BFC_ASSERT_EQUAL(9, ((ham_u8_t *)record.data)[2]);
+    }
+
+    void insert(ham_db_t *db, int i, ham_size_t size)
+    {
+        ham_u8_t buffer[256];
+        ham_key_t key;
+        ham_record_t record;
+        ::memset(&key, 0, sizeof(key));
+        ::memset(&record, 0, sizeof(record));
+        ::memset(buffer, (ham_u8_t)i, sizeof(buffer));
+        key.data=&i;
+        key.size=sizeof(i);
+        record.data=buffer;
+        record.size=size;
+        BFC_ASSERT_EQUAL(0, ham_insert(db, 0, &key, &record, HAM_OVERWRITE));
+    }
+
+    void find(ham_db_t *db, int i, ham_size_t size)
+    {
+        ham_key_t key;
+        ham_record_t record;
+        ::memset(&key, 0, sizeof(key));
+        ::memset(&record, 0, sizeof(record));
+        key.data=&i;
+        key.size=sizeof(i);
+        BFC_ASSERT_EQUAL(0, ham_find(db, 0, &key, &record, 0));
+        BFC_ASSERT_EQUAL(size, record.size);
+        for (ham_size_t j=0; j<size; j++)
+            BFC_ASSERT_EQUAL((ham_u8_t)i, ((ham_u8_t *)record.data)[j]);
+    }
+
+    void reopenTest(void)
+    {
+        ham_key_t key;
+        ::memset(&key, 0, sizeof(key));
+
+        for (int i=0; i<500; i++)
+            insert(m_db, i, 9+i%240);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+
+        /* existing records are read without the flag */
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        BFC_ASSERT_EQUAL(0, ham_open(m_db, BFC_OPATH(".test"), 0));
+        m_env=ham_get_env(m_db);
+        for (int i=0; i<500; i++)
+            find(m_db, i, 9+i%240);
+
+        /* free some slots, then re-use them */
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        BFC_ASSERT_EQUAL(0, ham_open(m_db, BFC_OPATH(".test"),
+                    HAM_ENABLE_SLAB_RECORDS));
+        m_env=ham_get_env(m_db);
+        for (int i=0; i<500; i+=2) {
+            key.data=&i;
+            key.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0, ham_erase(m_db, 0, &key, 0));
+        }
+        for (int i=1; i<500; i+=4)
+            insert(m_db, i, 9+(i+100)%240);
+        for (int i=500; i<600; i++)
+            insert(m_db, i, 9+i%240);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+
+        for (int i=1; i<600; i++) {
+            if (i<500 && i%2==0)
+                continue;
+            if (i<500 && i%4==1)
+                find(m_db, i, 9+(i+100)%240);
+            else
+                find(m_db, i, 9+i%240);
+        }
+    }
+};
+
+class RecordStreamTest : public hamsterDB_fixture
+{
+    define_super(hamsterDB_fixture);
+
+public:
+    RecordStreamTest(ham_bool_t inmemory=HAM_FALSE,
+                const char *name="RecordStreamTest")
+    :   hamsterDB_fixture(name), m_db(0), m_inmemory(inmemory)
+    {
+        testrunner::get_instance()->register_fixture(this);
+        BFC_REGISTER_TEST(RecordStreamTest, invalidParametersTest);
+        BFC_REGISTER_TEST(RecordStreamTest, writeReadTest);
+        BFC_REGISTER_TEST(RecordStreamTest, appendTest);
+        BFC_REGISTER_TEST(RecordStreamTest, overwriteTest);
+        BFC_REGISTER_TEST(RecordStreamTest, smallRecordTest);
+        BFC_REGISTER_TEST(RecordStreamTest, duplicateTest);
+        BFC_REGISTER_TEST(RecordStreamTest, reopenTest);
+        BFC_REGISTER_TEST(RecordStreamTest, compactTest);
+        BFC_REGISTER_TEST(RecordStreamTest, closeCursorTest);
+    }
+
+protected:
+    ham_db_t *m_db;
+    ham_bool_t m_inmemory;
+
+public:
+    virtual void setup()
+    {
+        __super::setup();
+
+        ham_parameter_t params[3]=
+        {
+            { HAM_PARAM_PAGESIZE, 1024 },
+            { HAM_PARAM_CACHESIZE, 1024*16 },
+            { 0, 0 }
+        };
+
+        os::unlink(BFC_OPATH(".test"));
+
+        BFC_ASSERT_EQUAL(0, ham_new(&m_db));
+        BFC_ASSERT_EQUAL(0,
+                ham_create_ex(m_db, BFC_OPATH(".test"),
+                    m_inmemory
+                        ? HAM_IN_MEMORY_DB
+                        : HAM_ENABLE_RECOVERY|HAM_ENABLE_SLAB_RECORDS,
+                    0644, m_inmemory ? &params[2] : &params[0]));
+    }
+
+    virtual void teardown()
+    {
+        __super::teardown();
+
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        ham_delete(m_db);
+    }
+
+    static ham_u8_t pattern(ham_size_t offset)
+    {
+        return ((ham_u8_t)(offset%251));
+    }
+
+    void insert(int i, ham_size_t size)
+    {
+        std::vector<ham_u8_t> buffer(size+1);
+        ham_key_t key;
+        ham_record_t record;
+        ::memset(&key, 0, sizeof(key));
+        ::memset(&record, 0, sizeof(record));
+        for (ham_size_t j=0; j<size; j++)
+            buffer[j]=pattern(j);
+        key.data=&i;
+        key.size=sizeof(i);
+        record.data=&buffer[0];
+        record.size=size;
+        BFC_ASSERT_EQUAL(0, ham_insert(m_db, 0, &key, &record, 0));
+    }
+
+    /** checks the record with ham_find */
+    void check(int i, ham_size_t size)
+    {
+        ham_key_t key;
+        ham_record_t record;
+        ::memset(&key, 0, sizeof(key));
+        ::memset(&record, 0, sizeof(record));
+        key.data=&i;
+        key.size=sizeof(i);
+        BFC_ASSERT_EQUAL(0, ham_find(m_db, 0, &key, &record, 0));
+        BFC_ASSERT_EQUAL(size, record.size);
+        for (ham_size_t j=0; j<size; j++)
+            BFC_ASSERT_EQUAL(pattern(j), ((ham_u8_t *)record.data)[j]);
+    }
+
+    ham_cursor_t *find(int i)
+    {
+        ham_cursor_t *cursor;
+        ham_key_t key;
+        ::memset(&key, 0, sizeof(key));
+        key.data=&i;
+        key.size=sizeof(i);
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &cursor));
+        BFC_ASSERT_EQUAL(0, ham_cursor_find(cursor, &key, 0));
+        return (cursor);
+    }
+
+    /** writes the pattern from @a offset to @a end in chunks */
+    void write(ham_record_stream_t *stream, ham_size_t offset,
+                ham_size_t end, ham_size_t chunk)
+    {
+        std::vector<ham_u8_t> buffer(chunk);
+        while (offset<end) {
+            ham_size_t size=end-offset<chunk ? end-offset : chunk;
+            for (ham_size_t j=0; j<size; j++)
+                buffer[j]=pattern(offset+j);
+            BFC_ASSERT_EQUAL(0,
+                    ham_record_stream_write(stream, &buffer[0], size));
+            offset+=size;
+        }
+    }
+
+    /** reads the stream in chunks and compares the pattern */
+    void read(ham_record_stream_t *stream, ham_size_t offset,
+                ham_size_t end, ham_size_t chunk)
+    {
+        std::vector<ham_u8_t> buffer(chunk);
+        ham_size_t bytes_read;
+        while (offset<end) {
+            BFC_ASSERT_EQUAL(0,
+                    ham_record_stream_read(stream, &buffer[0], chunk,
+                        &bytes_read));
+            BFC_ASSERT(bytes_read>0);
+            BFC_ASSERT(bytes_read<=chunk);
+            for (ham_size_t j=0; j<bytes_read; j++)
+                BFC_ASSERT_EQUAL(pattern(offset+j), buffer[j]);
+            offset+=bytes_read;
+        }
+        BFC_ASSERT_EQUAL(end, offset);
+
+        /* the end of the record was reached */
+        BFC_ASSERT_EQUAL(0,
+                ham_record_stream_read(stream, &buffer[0], chunk,
+                    &bytes_read));
+        BFC_ASSERT_EQUAL((ham_size_t)0, bytes_read);
+    }
+
+    void invalidParametersTest(void)
+    {
+        ham_cursor_t *cursor;
+        ham_record_stream_t *stream;
+        ham_u8_t buffer[16];
+        ham_size_t bytes_read;
+
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_record_stream_open(0, 0, &stream));
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &cursor));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_record_stream_open(cursor, 0, 0));
+        BFC_ASSERT_EQUAL(HAM_CURSOR_IS_NIL,
+                ham_record_stream_open(cursor, 0, &stream));
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+
+        insert(1, 10);
+        cursor=find(1);
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_record_stream_open(cursor, 0x100, &stream));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor, 0, &stream));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_record_stream_read(0, buffer, sizeof(buffer),
+                    &bytes_read));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_record_stream_read(stream, 0, sizeof(buffer),
+                    &bytes_read));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_record_stream_read(stream, buffer, sizeof(buffer), 0));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_record_stream_write(0, buffer, sizeof(buffer)));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_record_stream_write(stream, 0, sizeof(buffer)));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER, ham_record_stream_close(0));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_close(stream));
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+    }
+
+    void writeReadTest(void)
+    {
+        ham_record_stream_t *stream;
+        ham_size_t size=1024*100+17;
+
+        /* an empty record grows to a large blob */
+        insert(1, 0);
+        ham_cursor_t *cursor=find(1);
+        BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor, 0, &stream));
+        write(stream, 0, size, 1000);
+        BFC_ASSERT_EQUAL(0, ham_record_stream_close(stream));
+        check(1, size);
+
+        /* read in small and in large chunks */
+        BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor, 0, &stream));
+        read(stream, 0, size, 333);
+        BFC_ASSERT_EQUAL(0, ham_record_stream_close(stream));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor, 0, &stream));
+        read(stream, 0, size, 1024*30);
+        BFC_ASSERT_EQUAL(0, ham_record_stream_close(stream));
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+
+    void appendTest(void)
+    {
+        ham_record_stream_t *stream;
+        ham_size_t size=5000;
+
+        insert(1, 3000);
+        insert(2, 3000);
+        ham_cursor_t *cursor=find(1);
+
+        /* every append is a separate stream */
+        for (int i=0; i<20; i++) {
+            BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor,
+                        HAM_RECORD_STREAM_APPEND, &stream));
+            write(stream, size-2000, size, 512);
+            BFC_ASSERT_EQUAL(0, ham_record_stream_close(stream));
+            size+=2000;
+        }
+        size-=2000;
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+
+        check(1, size);
+        check(2, 3000);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+
+    void overwriteTest(void)
+    {
+        ham_record_stream_t *stream;
+        ham_size_t size=10000;
+        ham_size_t bytes_read;
+        ham_u8_t buffer[100];
+
+        insert(1, size);
+        ham_cursor_t *cursor=find(1);
+
+        /* overwrite a range in the middle; the size does not change */
+        BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor, 0, &stream));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_read(stream, buffer, 50,
+                    &bytes_read));
+        BFC_ASSERT_EQUAL((ham_size_t)50, bytes_read);
+        ::memset(buffer, 0xff, sizeof(buffer));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_write(stream, buffer,
+                    sizeof(buffer)));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_close(stream));
+
+        ham_key_t key;
+        ham_record_t record;
+        int i=1;
+        ::memset(&key, 0, sizeof(key));
+        ::memset(&record, 0, sizeof(record));
+        key.data=&i;
+        key.size=sizeof(i);
+        BFC_ASSERT_EQUAL(0, ham_find(m_db, 0, &key, &record, 0));
+        BFC_ASSERT_EQUAL(size, record.size);
+        for (ham_size_t j=0; j<size; j++) {
+            ham_u8_t expected=j>=50 && j<150 ? 0xff : pattern(j);
+            BFC_ASSERT_EQUAL(expected, ((ham_u8_t *)record.data)[j]);
+        }
+
+        /* the record is replaced with a smaller record */
+        record.data=buffer;
+        record.size=sizeof(buffer);
+        BFC_ASSERT_EQUAL(0, ham_cursor_overwrite(cursor, &record, 0));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor,
+                    HAM_RECORD_STREAM_APPEND, &stream));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_write(stream, buffer,
+                    sizeof(buffer)));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_close(stream));
+        BFC_ASSERT_EQUAL(0, ham_find(m_db, 0, &key, &record, 0));
+        BFC_ASSERT_EQUAL((ham_size_t)sizeof(buffer)*2, record.size);
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+    }
+
+    void smallRecordTest(void)
+    {
+        ham_record_stream_t *stream;
+
+        /* tiny, small and (without HAM_IN_MEMORY_DB) slab records are
+         * moved to a blob */
+        insert(1, 5);
+        insert(2, 8);
+        insert(3, 100);
+
+        for (int i=1; i<=3; i++) {
+            ham_cursor_t *cursor=find(i);
+            BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor, 0, &stream));
+            read(stream, 0, i==1 ? 5 : (i==2 ? 8 : 100), 3);
+            BFC_ASSERT_EQUAL(0, ham_record_stream_close(stream));
+            BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor,
+                        HAM_RECORD_STREAM_APPEND, &stream));
+            write(stream, i==1 ? 5 : (i==2 ? 8 : 100), 3000, 700);
+            BFC_ASSERT_EQUAL(0, ham_record_stream_close(stream));
+            BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+        }
+
+        for (int i=1; i<=3; i++)
+            check(i, 3000);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+
+    void duplicateTest(void)
+    {
+        ham_db_t *db;
+        ham_env_t *env;
+        ham_cursor_t *cursor;
+        ham_record_stream_t *stream;
+        ham_key_t key;
+        ham_record_t record;
+        ::memset(&key, 0, sizeof(key));
+        ::memset(&record, 0, sizeof(record));
+
+        BFC_ASSERT_EQUAL(0, ham_env_new(&env));
+        BFC_ASSERT_EQUAL(0, ham_new(&db));
+        BFC_ASSERT_EQUAL(0, ham_env_create_ex(env, BFC_OPATH(".test2"),
+                    m_inmemory ? HAM_IN_MEMORY_DB : 0, 0644, 0));
+        BFC_ASSERT_EQUAL(0, ham_env_create_db(env, db, 1,
+                    HAM_ENABLE_DUPLICATES, 0));
+        BFC_ASSERT_EQUAL(0, ham_insert(db, 0, &key, &record, 0));
+        BFC_ASSERT_EQUAL(0, ham_insert(db, 0, &key, &record, HAM_DUPLICATE));
+
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(db, 0, 0, &cursor));
+        BFC_ASSERT_EQUAL(0, ham_cursor_find(cursor, &key, 0));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_record_stream_open(cursor, 0, &stream));
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+
+        BFC_ASSERT_EQUAL(0, ham_env_close(env, HAM_AUTO_CLEANUP));
+        ham_delete(db);
+        ham_env_delete(env);
+    }
+
+    void reopenTest(void)
+    {
+        ham_record_stream_t *stream;
+        ham_size_t size=1024*20;
+
+        if (m_inmemory)
+            return;
+
+        insert(1, 0);
+        ham_cursor_t *cursor=find(1);
+        BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor, 0, &stream));
+        write(stream, 0, size/2, 1024);
+        BFC_ASSERT_EQUAL(0, ham_record_stream_close(stream));
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        BFC_ASSERT_EQUAL(0, ham_open(m_db, BFC_OPATH(".test"),
+                    HAM_ENABLE_RECOVERY));
+        check(1, size/2);
+
+        /* the spare capacity of the blob is still available */
+        cursor=find(1);
+        BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor,
+                    HAM_RECORD_STREAM_APPEND, &stream));
+        write(stream, size/2, size, 1024);
+        BFC_ASSERT_EQUAL(0, ham_record_stream_close(stream));
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        BFC_ASSERT_EQUAL(0, ham_open(m_db, BFC_OPATH(".test"), 0));
+        check(1, size);
+    }
+
+    void compactTest(void)
+    {
+        ham_record_stream_t *stream;
+        ham_compact_progress_t progress;
+        ham_key_t key;
+        ham_size_t size=1024*20;
+        int i=1;
+
+        if (m_inmemory)
+            return;
+
+        /* the blob of key 2 is moved to the space of key 1 */
+        insert(1, size);
+        insert(2, 0);
+        ham_cursor_t *cursor=find(2);
+        BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor, 0, &stream));
+        write(stream, 0, size/2, 1024);
+        ::memset(&key, 0, sizeof(key));
+        key.data=&i;
+        key.size=sizeof(i);
+        BFC_ASSERT_EQUAL(0, ham_erase(m_db, 0, &key, 0));
+
+        ham_env_t *env=ham_get_env(m_db);
+        ::memset(&progress, 0, sizeof(progress));
+        while (!progress.done)
+            BFC_ASSERT_EQUAL(0, ham_env_compact(env, 16, &progress));
+        BFC_ASSERT(progress.blobs_moved>0);
+
+        /* the stream continues with the moved blob */
+        write(stream, size/2, size, 1024);
+        BFC_ASSERT_EQUAL(0, ham_record_stream_close(stream));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor, 0, &stream));
+        read(stream, 0, size, 4000);
+        BFC_ASSERT_EQUAL(0, ham_record_stream_close(stream));
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+
+        check(2, size);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+
+    void closeCursorTest(void)
+    {
+        ham_record_stream_t *s1, *s2, *s3;
+        ham_u8_t buffer[16]={0};
+        ham_size_t bytes_read;
+
+        insert(1, 100);
+        ham_cursor_t *cursor=find(1);
+        BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor, 0, &s1));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor, 0, &s2));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor, 0, &s3));
+
+        /* a stream which is closed before the Cursor is removed
+         * from the Cursor */
+        BFC_ASSERT_EQUAL(0, ham_record_stream_close(s2));
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+
+        /* the other streams can only be closed */
+        BFC_ASSERT_EQUAL(HAM_CURSOR_IS_NIL,
+                ham_record_stream_read(s1, buffer, sizeof(buffer),
+                    &bytes_read));
+        BFC_ASSERT_EQUAL(HAM_CURSOR_IS_NIL,
+                ham_record_stream_write(s3, buffer, sizeof(buffer)));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_close(s1));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_close(s3));
+
+        if (m_inmemory)
+            return;
+
+        /* the Cursors are closed together with the Database */
+        cursor=find(1);
+        BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor, 0, &s1));
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, HAM_AUTO_CLEANUP));
+        BFC_ASSERT_EQUAL(HAM_CURSOR_IS_NIL,
+                ham_record_stream_write(s1, buffer, sizeof(buffer)));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_close(s1));
+        BFC_ASSERT_EQUAL(0, ham_open(m_db, BFC_OPATH(".test"), 0));
+        check(1, 100);
+    }
+};
+
+class InMemoryRecordStreamTest : public RecordStreamTest
+{
+public:
+    InMemoryRecordStreamTest()
+    : RecordStreamTest(HAM_TRUE, "InMemoryRecordStreamTest")
+    {
+    }
+};
+
+
+
 
 BFC_REGISTER_FIXTURE(FileBlobTest);
 BFC_REGISTER_FIXTURE(FileBlobNoTxnTest);
 BFC_REGISTER_FIXTURE(NoCacheBlobTest);
 BFC_REGISTER_FIXTURE(NoCacheBlobNoTxnTest);
 BFC_REGISTER_FIXTURE(InMemoryBlobTest);
+BFC_REGISTER_FIXTURE(SlabBlobTest);
+BFC_REGISTER_FIXTURE(RecordStreamTest);
+BFC_REGISTER_FIXTURE(InMemoryRecordStreamTest);
 
 /* re-run these tests with the Win32/Win64 pagesize setting as well! */
 BFC_REGISTER_FIXTURE(FileBlobTest64Kpage);
@@ -0,0 +1,366 @@
+/**
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+#include "../src/config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ham/hamsterdb.h>
+#include <ham/hamsterdb_int.h>
+#include "../src/backend.h"
+#include "../src/bloom.h"
+#include "../src/db.h"
+
+#include "bfc-testsuite.hpp"
+#include "hamster_fixture.hpp"
+#include "os.hpp"
+
+using namespace bfc;
+
+#define KEYS        3000
+
+class BloomTest : public hamsterDB_fixture
+{
+    define_super(hamsterDB_fixture);
+
+public:
+    BloomTest(ham_u32_t flags=0, const char *name="BloomTest")
+    :   hamsterDB_fixture(name), m_db(0), m_env(0), m_flags(flags)
+    {
+        testrunner::get_instance()->register_fixture(this);
+        BFC_REGISTER_TEST(BloomTest, negativeTest);
+        BFC_REGISTER_TEST(BloomTest, findTest);
+        BFC_REGISTER_TEST(BloomTest, falsePositiveTest);
+        BFC_REGISTER_TEST(BloomTest, eraseTest);
+        BFC_REGISTER_TEST(BloomTest, reopenTest);
+        BFC_REGISTER_TEST(BloomTest, crashTest);
+        BFC_REGISTER_TEST(BloomTest, disableTest);
+    }
+
+protected:
+    ham_db_t *m_db;
+    ham_env_t *m_env;
+    ham_u32_t m_flags;
+
+public:
+    virtual void setup()
+    {
+        __super::setup();
+
+        os::unlink(BFC_OPATH(".test"));
+        os::unlink(BFC_OPATH(".test.copy"));
+        BFC_ASSERT_EQUAL(0, ham_new(&m_db));
+        BFC_ASSERT_EQUAL(0, ham_env_new(&m_env));
+    }
+
+    virtual void teardown()
+    {
+        __super::teardown();
+
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+        ham_delete(m_db);
+        ham_env_delete(m_env);
+        m_db=0;
+        m_env=0;
+    }
+
+    void create()
+    {
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create(m_env, (m_flags&HAM_IN_MEMORY_DB)
+                        ? 0
+                        : BFC_OPATH(".test"), m_flags, 0644));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create_db(m_env, m_db, 1, 0, 0));
+    }
+
+    void reopen()
+    {
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_open(m_env, BFC_OPATH(".test"), m_flags));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(m_env, m_db, 1, 0, 0));
+    }
+
+    BloomFilter *filter()
+    {
+        return (((Database *)m_db)->get_bloom_filter());
+    }
+
+    /* even numbers are inserted, odd numbers are never inserted */
+    void make_key(int i, char *buffer, ham_key_t *key)
+    {
+        memset(key, 0, sizeof(*key));
+        sprintf(buffer, "key%08d", i);
+        key->data=buffer;
+        key->size=(ham_size_t)strlen(buffer)+1;
+    }
+
+    void insert(int from, int to)
+    {
+        char buffer[32];
+        ham_key_t key;
+        ham_record_t rec;
+
+        for (int i=from; i<to; i+=2) {
+            make_key(i, buffer, &key);
+            memset(&rec, 0, sizeof(rec));
+            rec.data=&i;
+            rec.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0, ham_insert(m_db, 0, &key, &rec, 0));
+        }
+    }
+
+    void erase(int from, int to)
+    {
+        char buffer[32];
+        ham_key_t key;
+
+        for (int i=from; i<to; i+=2) {
+            make_key(i, buffer, &key);
+            BFC_ASSERT_EQUAL(0, ham_erase(m_db, 0, &key, 0));
+        }
+    }
+
+    /* all even keys in [from, to) exist if @a exist is true */
+    void verify(int from, int to, bool exist)
+    {
+        char buffer[32];
+        ham_key_t key;
+        ham_record_t rec;
+
+        for (int i=from; i<to; i++) {
+            make_key(i, buffer, &key);
+            memset(&rec, 0, sizeof(rec));
+            if ((i&1) || !exist) {
+                BFC_ASSERT_EQUAL(HAM_KEY_NOT_FOUND,
+                        ham_find(m_db, 0, &key, &rec, 0));
+                continue;
+            }
+            BFC_ASSERT_EQUAL(0, ham_find(m_db, 0, &key, &rec, 0));
+            BFC_ASSERT_EQUAL((ham_size_t)sizeof(i), rec.size);
+            BFC_ASSERT_EQUAL(i, *(int *)rec.data);
+        }
+    }
+
+    void negativeTest()
+    {
+        ham_db_t *db;
+        ham_txn_t *txn;
+
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_enable_bloom_filter(0, 0.01, 0));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_disable_bloom_filter(0));
+        BFC_ASSERT_EQUAL(HAM_NOT_INITIALIZED,
+                ham_enable_bloom_filter(m_db, 0.01, 0));
+        BFC_ASSERT_EQUAL(HAM_NOT_INITIALIZED,
+                ham_disable_bloom_filter(m_db));
+
+        create();
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_enable_bloom_filter(m_db, 0.0, 0));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_enable_bloom_filter(m_db, 1.0, 0));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_enable_bloom_filter(m_db, 0.01, 10));
+
+        /* record number Databases are not supported */
+        BFC_ASSERT_EQUAL(0, ham_new(&db));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create_db(m_env, db, 2, HAM_RECORD_NUMBER, 0));
+        BFC_ASSERT_EQUAL(HAM_NOT_IMPLEMENTED,
+                ham_enable_bloom_filter(db, 0.01, 0));
+        BFC_ASSERT_EQUAL(0, ham_close(db, 0));
+        ham_delete(db);
+
+        if (m_flags&HAM_ENABLE_TRANSACTIONS) {
+            BFC_ASSERT_EQUAL(0, ham_txn_begin(&txn, m_env, 0, 0, 0));
+            BFC_ASSERT_EQUAL(HAM_TXN_STILL_OPEN,
+                    ham_enable_bloom_filter(m_db, 0.01, 0));
+            BFC_ASSERT_EQUAL(0, ham_txn_abort(txn, 0));
+        }
+
+        /* disabling a Database without filter is allowed */
+        BFC_ASSERT_EQUAL(0, ham_disable_bloom_filter(m_db));
+    }
+
+    void findTest()
+    {
+        char buffer[32];
+        ham_key_t key;
+        ham_record_t rec;
+
+        create();
+        insert(0, KEYS);
+        BFC_ASSERT_EQUAL(0, ham_enable_bloom_filter(m_db, 0.01, 0));
+        BFC_ASSERT(filter()!=0);
+        verify(0, KEYS, true);
+
+        /* the keys inserted afterwards are added to the filter */
+        insert(KEYS, KEYS*2);
+        verify(0, KEYS*2, true);
+
+        /* approximate matches are not answered by the filter */
+        make_key(1, buffer, &key);
+        memset(&rec, 0, sizeof(rec));
+        BFC_ASSERT_EQUAL(0,
+                ham_find(m_db, 0, &key, &rec, HAM_FIND_GT_MATCH));
+        BFC_ASSERT_EQUAL(2, *(int *)rec.data);
+
+        /* enabling the same configuration again keeps the filter */
+        BloomFilter *f=filter();
+        BFC_ASSERT_EQUAL(0, ham_enable_bloom_filter(m_db, 0.01, 0));
+        BFC_ASSERT(f==filter());
+    }
+
+    void falsePositiveTest()
+    {
+        char buffer[32];
+        ham_key_t key;
+        int positives=0;
+
+        create();
+        insert(0, KEYS*2);
+        BFC_ASSERT_EQUAL(0, ham_enable_bloom_filter(m_db, 0.01, 0));
+
+        for (int i=1; i<KEYS*2; i+=2) {
+            make_key(i, buffer, &key);
+            if (filter()->may_contain(&key))
+                positives++;
+        }
+        BFC_ASSERT(positives<KEYS*3/100);
+
+        /* a tiny budget increases the rate, but all keys are found */
+        BFC_ASSERT_EQUAL(0, ham_enable_bloom_filter(m_db, 0.01, 64));
+        BFC_ASSERT_EQUAL((ham_size_t)64, filter()->get_size());
+        verify(0, KEYS*2, true);
+    }
+
+    void eraseTest()
+    {
+        create();
+        insert(0, KEYS*2);
+        BFC_ASSERT_EQUAL(0, ham_enable_bloom_filter(m_db, 0.01, 0));
+
+        /* erasing most of the keys causes a rebuild */
+        erase(0, KEYS*3/2);
+        BFC_ASSERT(filter()->needs_rebuild());
+        verify(0, KEYS*3/2, false);
+        BFC_ASSERT(!filter()->needs_rebuild());
+        verify(KEYS*3/2, KEYS*2, true);
+
+        /* the erased keys can be inserted again */
+        insert(0, KEYS);
+        verify(0, KEYS, true);
+    }
+
+    void reopenTest()
+    {
+        create();
+        insert(0, KEYS);
+        BFC_ASSERT_EQUAL(0, ham_enable_bloom_filter(m_db, 0.01, 0));
+        ham_size_t size=filter()->get_size();
+
+        /* the filter is loaded, and no longer referenced by the header */
+        reopen();
+        BFC_ASSERT(filter()!=0);
+        BFC_ASSERT_EQUAL(size, filter()->get_size());
+        BFC_ASSERT(filter()->get_blobid()!=0);
+        BFC_ASSERT_EQUAL((ham_offset_t)0,
+                ((Database *)m_db)->get_backend()->get_bloom_filter());
+        verify(0, KEYS, true);
+
+        insert(KEYS, KEYS*2);
+        reopen();
+        BFC_ASSERT(filter()!=0);
+        verify(0, KEYS*2, true);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+
+    void crashTest()
+    {
+        ham_env_t *env;
+        ham_db_t *db;
+
+        create();
+        insert(0, KEYS);
+        BFC_ASSERT_EQUAL(0, ham_enable_bloom_filter(m_db, 0.01, 0));
+        reopen();
+        insert(KEYS, KEYS*2);
+
+        /* the copy is a snapshot of the file which was not closed */
+        BFC_ASSERT_EQUAL(0, ham_env_backup(m_env, BFC_OPATH(".test.copy"), 0));
+
+        BFC_ASSERT_EQUAL(0, ham_env_new(&env));
+        BFC_ASSERT_EQUAL(0, ham_new(&db));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_open(env, BFC_OPATH(".test.copy"), 0));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(env, db, 1, 0, 0));
+        BFC_ASSERT(((Database *)db)->get_bloom_filter()==0);
+        BFC_ASSERT_EQUAL(0, ham_env_close(env, HAM_AUTO_CLEANUP));
+        ham_delete(db);
+        ham_env_delete(env);
+    }
+
+    void disableTest()
+    {
+        create();
+        insert(0, KEYS);
+        BFC_ASSERT_EQUAL(0, ham_enable_bloom_filter(m_db, 0.01, 0));
+        reopen();
+        BFC_ASSERT(filter()!=0);
+
+        BFC_ASSERT_EQUAL(0, ham_disable_bloom_filter(m_db));
+        BFC_ASSERT(filter()==0);
+        verify(0, KEYS, true);
+
+        reopen();
+        BFC_ASSERT(filter()==0);
+        verify(0, KEYS, true);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+};
+
+class InMemoryBloomTest : public BloomTest
+{
+public:
+    InMemoryBloomTest()
+    :   BloomTest(HAM_IN_MEMORY_DB, "InMemoryBloomTest")
+    {
+        clear_tests();
+        BFC_REGISTER_TEST(InMemoryBloomTest, findTest);
+        BFC_REGISTER_TEST(InMemoryBloomTest, eraseTest);
+    }
+};
+
+class RecoveryBloomTest : public BloomTest
+{
+public:
+    RecoveryBloomTest()
+    :   BloomTest(HAM_ENABLE_RECOVERY, "RecoveryBloomTest")
+    {
+    }
+};
+
+class TransactionBloomTest : public BloomTest
+{
+public:
+    TransactionBloomTest()
+    :   BloomTest(HAM_ENABLE_TRANSACTIONS, "TransactionBloomTest")
+    {
+    }
+};
+
+BFC_REGISTER_FIXTURE(BloomTest);
+BFC_REGISTER_FIXTURE(InMemoryBloomTest);
+BFC_REGISTER_FIXTURE(RecoveryBloomTest);
+BFC_REGISTER_FIXTURE(TransactionBloomTest);
@@ -13,6 +13,8 @@
 
 #include <stdexcept>
 #include <cstring>
+#include <cstdio>
+#include <set>
 #include <ham/hamsterdb.h>
 #include "../src/db.h"
 #include "../src/version.h"
@@ -37,6 +39,12 @@ public:
         BFC_REGISTER_TEST(EraseTest, shiftFromRightTest);
         BFC_REGISTER_TEST(EraseTest, shiftFromLeftTest);
         BFC_REGISTER_TEST(EraseTest, mergeWithLeftTest);
+        BFC_REGISTER_TEST(EraseTest, eraseRangeTest);
+        BFC_REGISTER_TEST(EraseTest, eraseRangeRandomTest);
+        BFC_REGISTER_TEST(EraseTest, eraseRangeExtendedKeyTest);
+        BFC_REGISTER_TEST(EraseTest, eraseRangeCursorTest);
+        BFC_REGISTER_TEST(EraseTest, eraseRangeTxnTest);
+        BFC_REGISTER_TEST(EraseTest, eraseRangeRecoveryTest);
     }
 
 protected:
@@ -179,6 +187,227 @@ public:
             BFC_ASSERT_EQUAL(0, ham_erase(m_db, 0, &key, 0));
         }
     }
+
+    /* creates sortable keys; the padding makes them extended keys */
+    void make_key(ham_key_t *key, char *buffer, int i, bool padded=false)
+    {
+        sprintf(buffer, padded ? "%08d........................" : "%08d", i);
+        memset(key, 0, sizeof(*key));
+        key->data=buffer;
+        key->size=(ham_u16_t)strlen(buffer)+1;
+    }
+
+    void prepare_range(int count, bool padded=false, ham_u32_t flags=0)
+    {
+        ham_key_t key;
+        ham_record_t rec;
+        char buffer[64];
+
+        ham_parameter_t ps[]={
+            {HAM_PARAM_PAGESIZE,   1024},
+            {HAM_PARAM_KEYSIZE,   16},
+            {0, 0}
+        };
+
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        BFC_ASSERT_EQUAL(0, ham_create_ex(m_db, BFC_OPATH(".test"),
+                    m_flags|flags, 0644, &ps[0]));
+
+        for (int i=0; i<count; i++) {
+            make_key(&key, buffer, i, padded);
+            memset(&rec, 0, sizeof(rec));
+            rec.data=buffer;
+            rec.size=i%2 ? key.size : 0;
+            BFC_ASSERT_EQUAL(0, ham_insert(m_db, 0, &key, &rec, 0));
+        }
+    }
+
+    /* erases [begin, end) in the Database and in the model; -1 is
+     * unbounded */
+    void erase_range(std::set<int> &model, int begin, int end,
+            bool padded=false, ham_txn_t *txn=0)
+    {
+        ham_key_t b, e;
+        char bbuf[64], ebuf[64];
+
+        make_key(&b, bbuf, begin, padded);
+        make_key(&e, ebuf, end, padded);
+        BFC_ASSERT_EQUAL(0, ham_erase_range(m_db, txn,
+                    begin>=0 ? &b : 0, end>=0 ? &e : 0, 0));
+
+        std::set<int>::iterator lo=begin>=0
+                ? model.lower_bound(begin)
+                : model.begin();
+        std::set<int>::iterator hi=end>=0
+                ? model.lower_bound(end)
+                : model.end();
+        if (begin<0 || end<0 || begin<end)
+            model.erase(lo, hi);
+    }
+
+    /* compares the Database with the model */
+    void verify(std::set<int> &model, bool padded=false)
+    {
+        ham_cursor_t *cursor;
+        ham_key_t key, expected;
+        char buffer[64];
+        std::set<int>::iterator it=model.begin();
+
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &cursor));
+        memset(&key, 0, sizeof(key));
+        while (ham_cursor_move(cursor, &key, 0, HAM_CURSOR_NEXT)==0) {
+            BFC_ASSERT(it!=model.end());
+            make_key(&expected, buffer, *it, padded);
+            BFC_ASSERT_EQUAL(expected.size, key.size);
+            BFC_ASSERT_EQUAL(0, memcmp(expected.data, key.data, key.size));
+            ++it;
+        }
+        BFC_ASSERT(it==model.end());
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+
+        ham_offset_t count;
+        BFC_ASSERT_EQUAL(0, ham_get_key_count(m_db, 0, 0, &count));
+        BFC_ASSERT_EQUAL((ham_offset_t)model.size(), count);
+    }
+
+    void eraseRangeTest() {
+        std::set<int> model;
+        prepare_range(3000);
+        for (int i=0; i<3000; i++)
+            model.insert(i);
+
+        erase_range(model, 700, 700);
+        verify(model);
+        erase_range(model, 500, 501);
+        verify(model);
+        erase_range(model, 100, 1500);
+        verify(model);
+        erase_range(model, -1, 50);
+        verify(model);
+        erase_range(model, 2900, -1);
+        verify(model);
+        erase_range(model, 2000, 1000);
+        verify(model);
+        erase_range(model, -1, -1);
+        verify(model);
+
+        /* the Database is still usable */
+        ham_key_t key;
+        ham_record_t rec;
+        char buffer[64];
+        for (int i=0; i<500; i++) {
+            make_key(&key, buffer, i, false);
+            memset(&rec, 0, sizeof(rec));
+            BFC_ASSERT_EQUAL(0, ham_insert(m_db, 0, &key, &rec, 0));
+            model.insert(i);
+        }
+        verify(model);
+    }
+
+    void eraseRangeRandomTest() {
+        std::set<int> model;
+        prepare_range(10000);
+        for (int i=0; i<10000; i++)
+            model.insert(i);
+
+        srand(42);
+        for (int i=0; i<40; i++) {
+            int begin=rand()%10000;
+            int end=begin+rand()%(i%2 ? 50 : 1500);
+            erase_range(model, begin, end);
+            verify(model);
+        }
+    }
+
+    void eraseRangeExtendedKeyTest() {
+        std::set<int> model;
+        prepare_range(1000, true);
+        for (int i=0; i<1000; i++)
+            model.insert(i);
+
+        erase_range(model, 10, 900, true);
+        verify(model, true);
+        erase_range(model, -1, 950, true);
+        verify(model, true);
+    }
+
+    void eraseRangeCursorTest() {
+        ham_cursor_t *inside, *outside;
+        ham_key_t key;
+        char buffer[64];
+        std::set<int> model;
+
+        prepare_range(1000);
+        for (int i=0; i<1000; i++)
+            model.insert(i);
+
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &inside));
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &outside));
+        make_key(&key, buffer, 500, false);
+        BFC_ASSERT_EQUAL(0, ham_cursor_find(inside, &key, 0));
+        make_key(&key, buffer, 950, false);
+        BFC_ASSERT_EQUAL(0, ham_cursor_find(outside, &key, 0));
+
+        erase_range(model, 100, 900);
+        verify(model);
+
+        memset(&key, 0, sizeof(key));
+        BFC_ASSERT_EQUAL(HAM_CURSOR_IS_NIL,
+                ham_cursor_move(inside, &key, 0, 0));
+        BFC_ASSERT_EQUAL(0, ham_cursor_move(outside, &key, 0, 0));
+        BFC_ASSERT_EQUAL(0, strcmp("00000950", (char *)key.data));
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(inside));
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(outside));
+    }
+
+    void eraseRangeTxnTest() {
+        ham_txn_t *txn;
+        std::set<int> model, aborted;
+
+        if (m_flags&HAM_IN_MEMORY_DB)
+            return;
+
+        prepare_range(1000, false, HAM_ENABLE_TRANSACTIONS);
+        for (int i=0; i<1000; i++)
+            model.insert(i);
+        aborted=model;
+
+        BFC_ASSERT_EQUAL(0,
+                ham_txn_begin(&txn, ham_get_env(m_db), 0, 0, 0));
+        erase_range(aborted, 100, 900, false, txn);
+        BFC_ASSERT_EQUAL(0, ham_txn_abort(txn, 0));
+        verify(model);
+
+        BFC_ASSERT_EQUAL(0,
+                ham_txn_begin(&txn, ham_get_env(m_db), 0, 0, 0));
+        erase_range(model, 100, 900, false, txn);
+        BFC_ASSERT_EQUAL(0, ham_txn_commit(txn, 0));
+        verify(model);
+
+        erase_range(model, -1, 50);
+        verify(model);
+    }
+
+    void eraseRangeRecoveryTest() {
+        std::set<int> model;
+
+        if (m_flags&HAM_IN_MEMORY_DB)
+            return;
+
+        prepare_range(5000, false, HAM_ENABLE_RECOVERY);
+        for (int i=0; i<5000; i++)
+            model.insert(i);
+
+        erase_range(model, 10, 4000);
+        erase_range(model, 4500, -1);
+        verify(model);
+
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        BFC_ASSERT_EQUAL(0, ham_open(m_db, BFC_OPATH(".test"),
+                    HAM_ENABLE_RECOVERY));
+        verify(model);
+    }
 };
 
 class InMemoryEraseTest : public EraseTest
@@ -646,5 +646,316 @@ public:
 
 };
 
+class InlineRecordTest : public hamsterDB_fixture
+{
+    define_super(hamsterDB_fixture);
+
+public:
+    InlineRecordTest(ham_u32_t flags=0, const char *name="InlineRecordTest")
+    :   hamsterDB_fixture(name), m_db(0), m_flags(flags)
+    {
+        testrunner::get_instance()->register_fixture(this);
+        BFC_REGISTER_TEST(InlineRecordTest, invalidParameterTest);
+        BFC_REGISTER_TEST(InlineRecordTest, structureTest);
+        BFC_REGISTER_TEST(InlineRecordTest, insertFindTest);
+        BFC_REGISTER_TEST(InlineRecordTest, overwriteTest);
+        BFC_REGISTER_TEST(InlineRecordTest, partialTest);
+        BFC_REGISTER_TEST(InlineRecordTest, duplicateTest);
+        BFC_REGISTER_TEST(InlineRecordTest, eraseTest);
+    }
+
+protected:
+    ham_db_t *m_db;
+    ham_u32_t m_flags;
+
+public:
+    virtual void setup()
+    {
+        __super::setup();
+
+        os::unlink(BFC_OPATH(".test"));
+        BFC_ASSERT_EQUAL(0, ham_new(&m_db));
+        create(0);
+    }
+
+    void create(ham_u32_t flags)
+    {
+        ham_parameter_t params[]={
+            {HAM_PARAM_PAGESIZE, 1024},
+            {HAM_PARAM_RECORD_INLINE_SIZE, 30},
+            {0, 0}
+        };
+
+        BFC_ASSERT_EQUAL(0,
+                ham_create_ex(m_db, BFC_OPATH(".test"),
+                        m_flags|flags, 0644, &params[0]));
+    }
+
+    virtual void teardown()
+    {
+        __super::teardown();
+
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        ham_delete(m_db);
+        m_db=0;
+    }
+
+    /* fills a record with a pattern which depends on the key */
+    void fill(ham_u8_t *buffer, ham_size_t size, ham_u32_t k)
+    {
+        for (ham_size_t i=0; i<size; i++)
+            buffer[i]=(ham_u8_t)(k+i);
+    }
+
+    void insert(ham_u32_t k, ham_size_t size, ham_u32_t flags=0)
+    {
+        ham_u8_t buffer[128];
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        fill(buffer, size, k);
+        key.data=&k;
+        key.size=sizeof(k);
+        rec.data=buffer;
+        rec.size=size;
+        BFC_ASSERT_EQUAL(0, ham_insert(m_db, 0, &key, &rec, flags));
+    }
+
+    void find(ham_u32_t k, ham_size_t size)
+    {
+        ham_u8_t buffer[128];
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        fill(buffer, size, k);
+        key.data=&k;
+        key.size=sizeof(k);
+        BFC_ASSERT_EQUAL(0, ham_find(m_db, 0, &key, &rec, 0));
+        BFC_ASSERT_EQUAL(size, rec.size);
+        BFC_ASSERT_EQUAL(0, ::memcmp(buffer, rec.data, size));
+    }
+
+    /* returns the flags of the first key in the root page */
+    ham_u8_t get_first_key_flags(ham_offset_t *ptr)
+    {
+        Database *db=(Database *)m_db;
+        BtreeBackend *be=(BtreeBackend *)db->get_backend();
+        Page *page;
+        BFC_ASSERT_EQUAL(0, db_fetch_page(&page, db, be->get_rootpage(), 0));
+        btree_key_t *bte=btree_node_get_key(db, page_get_btree_node(page), 0);
+        *ptr=key_get_ptr(bte);
+        return (key_get_flags(bte));
+    }
+
+    void invalidParameterTest(void)
+    {
+        ham_db_t *db;
+        ham_env_t *env;
+        ham_parameter_t params[]={
+            {HAM_PARAM_RECORD_INLINE_SIZE, 249},
+            {0, 0}
+        };
+
+        BFC_ASSERT_EQUAL(0, ham_new(&db));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_create_ex(db, BFC_OPATH(".test2"), m_flags, 0644,
+                        &params[0]));
+        ham_delete(db);
+
+        BFC_ASSERT_EQUAL(0, ham_env_new(&env));
+        params[0].value=32;
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_create_ex(env, BFC_OPATH(".test2"), m_flags, 0644,
+                        &params[0]));
+        ham_env_delete(env);
+
+        /* the size is rounded up to a multiple of 8 */
+        ham_parameter_t query[]={
+            {HAM_PARAM_RECORD_INLINE_SIZE, 0},
+            {0, 0}
+        };
+        BFC_ASSERT_EQUAL(0, ham_get_parameters(m_db, &query[0]));
+        BFC_ASSERT_EQUAL((ham_u64_t)32, query[0].value);
+    }
+
+    void structureTest(void)
+    {
+        ham_offset_t ptr;
+
+        insert(1, 20);
+        BFC_ASSERT_EQUAL((ham_u8_t)KEY_BLOB_SIZE_INLINE,
+                get_first_key_flags(&ptr));
+        BFC_ASSERT_EQUAL((ham_offset_t)20, ptr);
+
+        insert(1, 33, HAM_OVERWRITE);
+        BFC_ASSERT_EQUAL((ham_u8_t)0, get_first_key_flags(&ptr));
+
+        insert(1, 8, HAM_OVERWRITE);
+        BFC_ASSERT_EQUAL((ham_u8_t)KEY_BLOB_SIZE_SMALL,
+                get_first_key_flags(&ptr));
+    }
+
+    void insertFindTest(void)
+    {
+        /* records of 0 to 39 bytes are stored in the key, inline or
+         * in blobs; the small pagesize causes many page splits */
+        for (ham_u32_t i=0; i<2000; i++)
+            insert(i, i%40);
+        for (ham_u32_t i=0; i<2000; i++)
+            find(i, i%40);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+
+        if (m_flags&HAM_IN_MEMORY_DB)
+            return;
+
+        /* the inline size is persistent */
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        BFC_ASSERT_EQUAL(0, ham_open(m_db, BFC_OPATH(".test"), 0));
+        ham_parameter_t query[]={
+            {HAM_PARAM_RECORD_INLINE_SIZE, 0},
+            {0, 0}
+        };
+        BFC_ASSERT_EQUAL(0, ham_get_parameters(m_db, &query[0]));
+        BFC_ASSERT_EQUAL((ham_u64_t)32, query[0].value);
+        for (ham_u32_t i=0; i<2000; i++)
+            find(i, i%40);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+
+    void overwriteTest(void)
+    {
+        static const ham_size_t sizes[]={
+            4, 20, 100, 32, 8, 24, 0, 33, 9, 12, 64, 0
+        };
+
+        for (ham_size_t i=0; sizes[i] || i==0; i++) {
+            insert(7, sizes[i], HAM_OVERWRITE);
+            find(7, sizes[i]);
+        }
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+
+    void partialTest(void)
+    {
+        ham_u32_t k=3;
+        ham_u8_t buffer[64], expected[64];
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        key.data=&k;
+        key.size=sizeof(k);
+
+        insert(k, 24);
+        fill(expected, 24, k);
+
+        /* partial read */
+        rec.partial_offset=10;
+        rec.partial_size=5;
+        BFC_ASSERT_EQUAL(0, ham_find(m_db, 0, &key, &rec, HAM_PARTIAL));
+        BFC_ASSERT_EQUAL((ham_size_t)5, rec.size);
+        BFC_ASSERT_EQUAL(0, ::memcmp(&expected[10], rec.data, 5));
+
+        /* partial write; the record grows, but is still inline */
+        ::memset(buffer, 0x77, sizeof(buffer));
+        ::memset(&rec, 0, sizeof(rec));
+        rec.data=buffer;
+        rec.size=28;
+        rec.partial_offset=26;
+        rec.partial_size=2;
+        BFC_ASSERT_EQUAL(0,
+                ham_insert(m_db, 0, &key, &rec, HAM_OVERWRITE|HAM_PARTIAL));
+        ::memset(&expected[24], 0, 2);
+        ::memset(&expected[26], 0x77, 2);
+        ::memset(&rec, 0, sizeof(rec));
+        BFC_ASSERT_EQUAL(0, ham_find(m_db, 0, &key, &rec, 0));
+        BFC_ASSERT_EQUAL((ham_size_t)28, rec.size);
+        BFC_ASSERT_EQUAL(0, ::memcmp(expected, rec.data, 28));
+
+        /* partial write; the record is moved to a blob */
+        ::memset(buffer, 0x55, sizeof(buffer));
+        ::memset(&rec, 0, sizeof(rec));
+        rec.data=buffer;
+        rec.size=48;
+        rec.partial_offset=40;
+        rec.partial_size=8;
+        BFC_ASSERT_EQUAL(0,
+                ham_insert(m_db, 0, &key, &rec, HAM_OVERWRITE|HAM_PARTIAL));
+        ::memset(&expected[28], 0, 12);
+        ::memset(&expected[40], 0x55, 8);
+        ::memset(&rec, 0, sizeof(rec));
+        BFC_ASSERT_EQUAL(0, ham_find(m_db, 0, &key, &rec, 0));
+        BFC_ASSERT_EQUAL((ham_size_t)48, rec.size);
+        BFC_ASSERT_EQUAL(0, ::memcmp(expected, rec.data, 48));
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+
+    void duplicateTest(void)
+    {
+        ham_u32_t k=5;
+        ham_u8_t expected[32];
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        ham_cursor_t *cursor;
+        ham_size_t count;
+        key.data=&k;
+        key.size=sizeof(k);
+
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        create(HAM_ENABLE_DUPLICATES);
+
+        /* the inline record is moved to a blob when the first duplicate
+         * is inserted */
+        insert(k, 20);
+        insert(k, 30, HAM_DUPLICATE);
+        insert(k, 12, HAM_DUPLICATE);
+
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &cursor));
+        BFC_ASSERT_EQUAL(0, ham_cursor_find(cursor, &key, 0));
+        BFC_ASSERT_EQUAL(0, ham_cursor_get_duplicate_count(cursor, &count, 0));
+        BFC_ASSERT_EQUAL((ham_size_t)3, count);
+
+        static const ham_size_t sizes[]={20, 30, 12};
+        for (int i=0; i<3; i++) {
+            BFC_ASSERT_EQUAL(0, ham_cursor_move(cursor, 0, &rec,
+                        i ? HAM_CURSOR_NEXT : 0));
+            fill(expected, sizes[i], k);
+            BFC_ASSERT_EQUAL(sizes[i], rec.size);
+            BFC_ASSERT_EQUAL(0, ::memcmp(expected, rec.data, sizes[i]));
+        }
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+
+        BFC_ASSERT_EQUAL(0, ham_erase(m_db, 0, &key, 0));
+        BFC_ASSERT_EQUAL(HAM_KEY_NOT_FOUND, ham_find(m_db, 0, &key, &rec, 0));
+    }
+
+    void eraseTest(void)
+    {
+        /* erasing keys merges and shifts the nodes; the inline records
+         * must move with their keys */
+        for (ham_u32_t i=0; i<2000; i++)
+            insert(i, 9+i%24);
+        for (ham_u32_t i=0; i<2000; i+=3) {
+            ham_key_t key={0};
+            key.data=&i;
+            key.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0, ham_erase(m_db, 0, &key, 0));
+        }
+        for (ham_u32_t i=0; i<2000; i++) {
+            if (i%3)
+                find(i, 9+i%24);
+        }
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+};
+
+class InMemoryInlineRecordTest : public InlineRecordTest
+{
+public:
+    InMemoryInlineRecordTest()
+    :   InlineRecordTest(HAM_IN_MEMORY_DB, "InMemoryInlineRecordTest")
+    {
+    }
+};
+
 BFC_REGISTER_FIXTURE(KeyTest);
+BFC_REGISTER_FIXTURE(InlineRecordTest);
+BFC_REGISTER_FIXTURE(InMemoryInlineRecordTest);
 
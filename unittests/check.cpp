@@ -13,8 +13,13 @@
 
 #include <stdexcept>
 #include <string.h>
+#include <stdio.h>
+#include <boost/bind.hpp>
 #include <ham/hamsterdb.h>
+#include "../src/internal_fwd_decl.h"
+#include "../src/btree.h"
 #include "../src/db.h"
+#include "../src/page.h"
 #include "os.hpp"
 
 #include "bfc-testsuite.hpp"
@@ -35,6 +40,10 @@ public:
         BFC_REGISTER_TEST(CheckIntegrityTest, emptyDatabaseTest);
         BFC_REGISTER_TEST(CheckIntegrityTest, smallDatabaseTest);
         BFC_REGISTER_TEST(CheckIntegrityTest, levelledDatabaseTest);
+        BFC_REGISTER_TEST(CheckIntegrityTest, largeDatabaseTest);
+        BFC_REGISTER_TEST(CheckIntegrityTest, extendedKeyTest);
+        BFC_REGISTER_TEST(CheckIntegrityTest, corruptedPageTest);
+        BFC_REGISTER_TEST(CheckIntegrityTest, concurrentInsertTest);
     }
 
 protected:
@@ -115,6 +124,148 @@ public:
         BFC_ASSERT_EQUAL(0,
                 ham_check_integrity(m_db, 0));
     }
+
+    void largeDatabaseTest()
+    {
+        ham_key_t key;
+        ham_record_t rec;
+        char buffer[100]={0};
+        ham_parameter_t params[]={
+            { HAM_PARAM_PAGESIZE, 1024 },
+            { HAM_PARAM_KEYSIZE, 16 },
+            { 0, 0 }
+        };
+        memset(&key, 0, sizeof(key));
+        memset(&rec, 0, sizeof(rec));
+
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        BFC_ASSERT_EQUAL(0, ham_create_ex(m_db, BFC_OPATH(".test"),
+                    m_inmemory ? HAM_IN_MEMORY_DB : 0,
+                    0644, &params[0]));
+
+        /* the file is larger than a single read of the verifier */
+        rec.data=buffer;
+        rec.size=sizeof(buffer);
+        for (int i=0; i<30000; i++) {
+            int k=(i*7919)%30000;
+            key.size=sizeof(k);
+            key.data=&k;
+            BFC_ASSERT_EQUAL(0,
+                    ham_insert(m_db, 0, &key, &rec, 0));
+        }
+        BFC_ASSERT_EQUAL(0,
+                ham_check_integrity(m_db, 0));
+
+        /* erase every other key; this frees pages and blobs */
+        for (int i=0; i<30000; i+=2) {
+            key.size=sizeof(i);
+            key.data=&i;
+            BFC_ASSERT_EQUAL(0,
+                    ham_erase(m_db, 0, &key, 0));
+        }
+        BFC_ASSERT_EQUAL(0,
+                ham_check_integrity(m_db, 0));
+    }
+
+    void extendedKeyTest()
+    {
+        ham_key_t key;
+        ham_record_t rec;
+        char buffer[64];
+        ham_parameter_t params[]={
+            { HAM_PARAM_PAGESIZE, 1024 },
+            { HAM_PARAM_KEYSIZE, 16 },
+            { 0, 0 }
+        };
+        memset(&key, 0, sizeof(key));
+        memset(&rec, 0, sizeof(rec));
+
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        BFC_ASSERT_EQUAL(0, ham_create_ex(m_db, BFC_OPATH(".test"),
+                    m_inmemory ? HAM_IN_MEMORY_DB : 0,
+                    0644, &params[0]));
+
+        /* the keys only differ in the part which is stored in the blob */
+        for (int i=0; i<500; i++) {
+            memset(buffer, 'x', sizeof(buffer));
+            sprintf(buffer+40, "%05d", i);
+            key.size=sizeof(buffer);
+            key.data=buffer;
+            BFC_ASSERT_EQUAL(0,
+                    ham_insert(m_db, 0, &key, &rec, 0));
+        }
+
+        BFC_ASSERT_EQUAL(0,
+                ham_check_integrity(m_db, 0));
+    }
+
+    void corruptedPageTest()
+    {
+        ham_key_t key;
+        ham_record_t rec;
+        ::memset(&key, 0, sizeof(key));
+        ::memset(&rec, 0, sizeof(rec));
+
+        if (m_inmemory)
+            return;
+
+        for (int i=0; i<5; i++) {
+            key.size=sizeof(i);
+            key.data=&i;
+            BFC_ASSERT_EQUAL(0,
+                    ham_insert(m_db, 0, &key, &rec, 0));
+        }
+        BFC_ASSERT_EQUAL(0,
+                ham_check_integrity(m_db, 0));
+
+        /* overwrite the first key in the root page; the keys are
+         * no longer sorted */
+        BtreeBackend *be=(BtreeBackend *)((Database *)m_db)->get_backend();
+        ham_offset_t address=be->get_rootpage()
+                +Page::sizeof_persistent_header
+                +OFFSETOF(btree_node_t, _entries)
+                +db_get_int_key_header_size();
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+
+        ham_u8_t garbage[4]={0xff, 0xff, 0xff, 0xff};
+        FILE *f=fopen(BFC_OPATH(".test"), "r+b");
+        BFC_ASSERT(f!=0);
+        BFC_ASSERT_EQUAL(0, fseek(f, (long)address, SEEK_SET));
+        BFC_ASSERT_EQUAL((size_t)1, fwrite(garbage, sizeof(garbage), 1, f));
+        fclose(f);
+
+        BFC_ASSERT_EQUAL(0, ham_open(m_db, BFC_OPATH(".test"), 0));
+        BFC_ASSERT_EQUAL(HAM_INTEGRITY_VIOLATED,
+                ham_check_integrity(m_db, 0));
+    }
+
+    static void insertThread(ham_db_t *db)
+    {
+        ham_key_t key;
+        ham_record_t rec;
+        memset(&key, 0, sizeof(key));
+        memset(&rec, 0, sizeof(rec));
+
+        for (int i=0; i<20000; i++) {
+            key.size=sizeof(i);
+            key.data=&i;
+            if (ham_insert(db, 0, &key, &rec, 0))
+                break;
+        }
+    }
+
+    void concurrentInsertTest()
+    {
+        Thread thread(boost::bind(&CheckIntegrityTest::insertThread, m_db));
+
+        for (int i=0; i<10; i++)
+            BFC_ASSERT_EQUAL(0,
+                    ham_check_integrity(m_db, 0));
+
+        thread.join();
+        BFC_ASSERT_EQUAL(0,
+                ham_check_integrity(m_db, 0));
+    }
 };
 
 class InMemoryCheckIntegrityTest : public CheckIntegrityTest
@@ -0,0 +1,441 @@
+/**
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+#include "../src/config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ham/hamsterdb.h>
+#include <ham/hamsterdb_int.h>
+#include "../src/bloom.h"
+#include "../src/db.h"
+
+#include "bfc-testsuite.hpp"
+#include "hamster_fixture.hpp"
+#include "os.hpp"
+
+using namespace bfc;
+
+#define RECORDS     3000
+
+class CompactTest : public hamsterDB_fixture
+{
+    define_super(hamsterDB_fixture);
+
+public:
+    CompactTest(ham_u32_t flags=0, const char *name="CompactTest")
+    :   hamsterDB_fixture(name), m_db(0), m_db2(0), m_env(0), m_flags(flags)
+    {
+        testrunner::get_instance()->register_fixture(this);
+        BFC_REGISTER_TEST(CompactTest, negativeTest);
+        BFC_REGISTER_TEST(CompactTest, emptyTest);
+        BFC_REGISTER_TEST(CompactTest, shrinkTest);
+        BFC_REGISTER_TEST(CompactTest, modifyTest);
+        BFC_REGISTER_TEST(CompactTest, bloomTest);
+        BFC_REGISTER_TEST(CompactTest, duplicateTreeTest);
+    }
+
+protected:
+    ham_db_t *m_db;
+    ham_db_t *m_db2;
+    ham_env_t *m_env;
+    ham_u32_t m_flags;
+
+public:
+    virtual void setup()
+    {
+        __super::setup();
+
+        os::unlink(BFC_OPATH(".test"));
+        BFC_ASSERT_EQUAL(0, ham_new(&m_db));
+        BFC_ASSERT_EQUAL(0, ham_new(&m_db2));
+        BFC_ASSERT_EQUAL(0, ham_env_new(&m_env));
+    }
+
+    virtual void teardown()
+    {
+        __super::teardown();
+
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+        ham_delete(m_db);
+        ham_delete(m_db2);
+        ham_env_delete(m_env);
+        m_db=0;
+        m_db2=0;
+        m_env=0;
+    }
+
+    void create(ham_u32_t flags=0)
+    {
+        ham_parameter_t params[]={
+            { HAM_PARAM_PAGESIZE, 1024 },
+            { 0, 0 }
+        };
+        ham_parameter_t dbparams[]={
+            { HAM_PARAM_KEYSIZE, 16 },
+            { 0, 0 }
+        };
+
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create_ex(m_env, BFC_OPATH(".test"), m_flags|flags,
+                    0644, &params[0]));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create_db(m_env, m_db, 1, 0, &dbparams[0]));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create_db(m_env, m_db2, 2,
+                    HAM_ENABLE_DUPLICATES, &dbparams[0]));
+    }
+
+    /* the keys of the first Database are extended if i is odd */
+    void make_key(int i, char *buffer, ham_key_t *key)
+    {
+        memset(key, 0, sizeof(*key));
+        memset(buffer, 'k', 32);
+        sprintf(buffer, "%08d", i);
+        buffer[8]='k';
+        key->data=buffer;
+        key->size=(i&1) ? 32 : 12;
+    }
+
+    void make_record(int i, int dupe, char *buffer, ham_record_t *rec)
+    {
+        memset(rec, 0, sizeof(*rec));
+        memset(buffer, (char)(i+dupe), 100);
+        rec->data=buffer;
+        rec->size=(i%3==0) ? 4 : 100;
+    }
+
+    void insert(int from, int to)
+    {
+        char kbuf[32], rbuf[100];
+        ham_key_t key;
+        ham_record_t rec;
+
+        for (int i=from; i<to; i++) {
+            make_key(i, kbuf, &key);
+            make_record(i, 0, rbuf, &rec);
+            BFC_ASSERT_EQUAL(0,
+                    ham_insert(m_db, 0, &key, &rec, 0));
+
+            key.data=&i;
+            key.size=sizeof(i);
+            for (int d=0; d<3; d++) {
+                make_record(i, d, rbuf, &rec);
+                BFC_ASSERT_EQUAL(0,
+                        ham_insert(m_db2, 0, &key, &rec, HAM_DUPLICATE));
+            }
+        }
+    }
+
+    /* erases all keys which are not a multiple of 10 */
+    void erase(int from, int to)
+    {
+        char kbuf[32];
+        ham_key_t key;
+
+        for (int i=from; i<to; i++) {
+            if (i%10==0)
+                continue;
+            make_key(i, kbuf, &key);
+            BFC_ASSERT_EQUAL(0,
+                    ham_erase(m_db, 0, &key, 0));
+            key.data=&i;
+            key.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0,
+                    ham_erase(m_db2, 0, &key, 0));
+        }
+    }
+
+    void verify(int from, int to)
+    {
+        char kbuf[32], rbuf[100];
+        ham_key_t key;
+        ham_record_t rec, expected;
+        ham_cursor_t *cursor;
+
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db2, 0));
+
+        for (int i=from; i<to; i++) {
+            make_key(i, kbuf, &key);
+            make_record(i, 0, rbuf, &expected);
+            memset(&rec, 0, sizeof(rec));
+            if (i%10) {
+                BFC_ASSERT_EQUAL(HAM_KEY_NOT_FOUND,
+                        ham_find(m_db, 0, &key, &rec, 0));
+                continue;
+            }
+            BFC_ASSERT_EQUAL(0,
+                    ham_find(m_db, 0, &key, &rec, 0));
+            BFC_ASSERT_EQUAL(expected.size, rec.size);
+            BFC_ASSERT_EQUAL(0, memcmp(expected.data, rec.data, rec.size));
+
+            BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db2, 0, 0, &cursor));
+            key.data=&i;
+            key.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0, ham_cursor_find(cursor, &key, 0));
+            for (int d=0; d<3; d++) {
+                make_record(i, d, rbuf, &expected);
+                BFC_ASSERT_EQUAL(0,
+                        ham_cursor_move(cursor, 0, &rec,
+                            d ? HAM_CURSOR_NEXT|HAM_ONLY_DUPLICATES : 0));
+                BFC_ASSERT_EQUAL(expected.size, rec.size);
+                BFC_ASSERT_EQUAL(0,
+                        memcmp(expected.data, rec.data, rec.size));
+            }
+            BFC_ASSERT_EQUAL(HAM_KEY_NOT_FOUND,
+                    ham_cursor_move(cursor, 0, 0,
+                        HAM_CURSOR_NEXT|HAM_ONLY_DUPLICATES));
+            BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+        }
+    }
+
+    /* runs the compaction until it is finished */
+    void compact(ham_compact_progress_t *progress)
+    {
+        int steps=0;
+        do {
+            BFC_ASSERT_EQUAL(0,
+                    ham_env_compact(m_env, 16, progress));
+            BFC_ASSERT(++steps<100000);
+        } while (!progress->done);
+    }
+
+    /* a key with so many duplicates that they are stored in a tree */
+    void insert_tree(int count)
+    {
+        char rbuf[100];
+        ham_key_t key;
+        ham_record_t rec;
+        int k=-1;
+
+        memset(&key, 0, sizeof(key));
+        key.data=&k;
+        key.size=sizeof(k);
+        for (int d=0; d<count; d++) {
+            make_record(d, 0, rbuf, &rec);
+            *(int *)rbuf=d;
+            BFC_ASSERT_EQUAL(0,
+                    ham_insert(m_db2, 0, &key, &rec, HAM_DUPLICATE));
+        }
+    }
+
+    void verify_tree(int count)
+    {
+        ham_key_t key;
+        ham_record_t rec;
+        ham_cursor_t *cursor;
+        int k=-1;
+
+        memset(&key, 0, sizeof(key));
+        key.data=&k;
+        key.size=sizeof(k);
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db2, 0, 0, &cursor));
+        BFC_ASSERT_EQUAL(0, ham_cursor_find(cursor, &key, 0));
+        for (int d=0; d<count; d++) {
+            memset(&rec, 0, sizeof(rec));
+            BFC_ASSERT_EQUAL(0,
+                    ham_cursor_move(cursor, 0, &rec,
+                        d ? HAM_CURSOR_NEXT|HAM_ONLY_DUPLICATES : 0));
+            BFC_ASSERT_EQUAL((ham_size_t)((d%3==0) ? 4 : 100), rec.size);
+            BFC_ASSERT_EQUAL(d, *(int *)rec.data);
+        }
+        BFC_ASSERT_EQUAL(HAM_KEY_NOT_FOUND,
+                ham_cursor_move(cursor, 0, 0,
+                    HAM_CURSOR_NEXT|HAM_ONLY_DUPLICATES));
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+    }
+
+    ham_u64_t filesize()
+    {
+        FILE *f=fopen(BFC_OPATH(".test"), "rb");
+        BFC_ASSERT(f!=0);
+        fseek(f, 0, SEEK_END);
+        long size=ftell(f);
+        fclose(f);
+        return ((ham_u64_t)size);
+    }
+
+    void negativeTest()
+    {
+        ham_compact_progress_t progress;
+
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_compact(0, 1, &progress));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_compact(m_env, 0, &progress));
+        BFC_ASSERT_EQUAL(HAM_NOT_INITIALIZED,
+                ham_env_compact(m_env, 1, &progress));
+
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create(m_env, 0, HAM_IN_MEMORY_DB, 0644));
+        BFC_ASSERT_EQUAL(HAM_NOT_IMPLEMENTED,
+                ham_env_compact(m_env, 1, &progress));
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, 0));
+
+        create();
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_open(m_env, BFC_OPATH(".test"), HAM_READ_ONLY));
+        BFC_ASSERT_EQUAL(HAM_DB_READ_ONLY,
+                ham_env_compact(m_env, 1, &progress));
+    }
+
+    void emptyTest()
+    {
+        ham_compact_progress_t progress;
+
+        create();
+        compact(&progress);
+        BFC_ASSERT_EQUAL((ham_u64_t)0, progress.pages_moved);
+        BFC_ASSERT_EQUAL((ham_u64_t)0, progress.blobs_moved);
+        BFC_ASSERT(progress.filesize>=progress.live_size);
+
+        /* the next call returns immediately */
+        BFC_ASSERT_EQUAL(0, ham_env_compact(m_env, 1, &progress));
+        BFC_ASSERT_EQUAL((ham_bool_t)HAM_TRUE, progress.done);
+    }
+
+    void shrinkTest()
+    {
+        ham_compact_progress_t progress;
+
+        create();
+        insert(0, RECORDS);
+        erase(0, RECORDS);
+
+        /* the second Database is opened by the compaction */
+        BFC_ASSERT_EQUAL(0, ham_close(m_db2, 0));
+        BFC_ASSERT_EQUAL(0, ham_env_flush(m_env, 0));
+        ham_u64_t before=filesize();
+
+        compact(&progress);
+        BFC_ASSERT(progress.pages_moved+progress.blobs_moved>0);
+        BFC_ASSERT(progress.bytes_truncated>0);
+        BFC_ASSERT(progress.filesize<before);
+        BFC_ASSERT(progress.filesize>=progress.live_size);
+        BFC_ASSERT_EQUAL(progress.filesize, filesize());
+
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(m_env, m_db2, 2, 0, 0));
+        verify(0, RECORDS);
+
+        /* the file is still usable */
+        insert(RECORDS, RECORDS*2);
+        erase(RECORDS, RECORDS*2);
+        verify(0, RECORDS*2);
+
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_open(m_env, BFC_OPATH(".test"), m_flags));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(m_env, m_db, 1, 0, 0));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(m_env, m_db2, 2, 0, 0));
+        verify(0, RECORDS*2);
+    }
+
+    void modifyTest()
+    {
+        ham_compact_progress_t progress;
+
+        create();
+        insert(0, RECORDS);
+        erase(0, RECORDS);
+
+        /* the Database is modified between two steps */
+        BFC_ASSERT_EQUAL(0, ham_env_compact(m_env, 16, &progress));
+        BFC_ASSERT_EQUAL((ham_bool_t)HAM_FALSE, progress.done);
+        insert(RECORDS, RECORDS+500);
+        BFC_ASSERT_EQUAL(0, ham_env_compact(m_env, 16, &progress));
+        erase(RECORDS, RECORDS+500);
+        compact(&progress);
+        verify(0, RECORDS+500);
+    }
+
+    void bloomTest()
+    {
+        ham_compact_progress_t progress;
+
+        /* the blob of the bloom filter is written in the middle of
+         * the file, and it's moved like any other blob */
+        create();
+        insert(0, RECORDS/2);
+        BFC_ASSERT_EQUAL(0, ham_enable_bloom_filter(m_db, 0.01, 512));
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(m_env, m_db, 1, 0, 0));
+        BloomFilter *filter=((Database *)m_db)->get_bloom_filter();
+        BFC_ASSERT(filter!=0);
+        ham_offset_t blobid=filter->get_blobid();
+        insert(RECORDS/2, RECORDS);
+        erase(0, RECORDS);
+
+        BFC_ASSERT_EQUAL(0, ham_close(m_db2, 0));
+        compact(&progress);
+        BFC_ASSERT(progress.bytes_truncated>0);
+        BFC_ASSERT(filter->get_blobid()<blobid);
+
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_open(m_env, BFC_OPATH(".test"), m_flags));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(m_env, m_db, 1, 0, 0));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(m_env, m_db2, 2, 0, 0));
+        BFC_ASSERT(((Database *)m_db)->get_bloom_filter()!=0);
+        verify(0, RECORDS);
+    }
+
+    void duplicateTreeTest()
+    {
+        ham_compact_progress_t progress;
+
+        /* the nodes of the duplicate tree and the blobs of the
+         * duplicates are moved */
+        create(HAM_ENABLE_DUPLICATE_TREES);
+        insert(0, RECORDS);
+        insert_tree(2000);
+        erase(0, RECORDS);
+
+        BFC_ASSERT_EQUAL(0, ham_env_flush(m_env, 0));
+        ham_u64_t before=filesize();
+        compact(&progress);
+        BFC_ASSERT(progress.blobs_moved>0);
+        BFC_ASSERT(progress.filesize<before);
+        verify(0, RECORDS);
+        verify_tree(2000);
+
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_open(m_env, BFC_OPATH(".test"), m_flags));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(m_env, m_db, 1, 0, 0));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(m_env, m_db2, 2, 0, 0));
+        verify(0, RECORDS);
+        verify_tree(2000);
+    }
+};
+
+class RecoveryCompactTest : public CompactTest
+{
+public:
+    RecoveryCompactTest()
+    :   CompactTest(HAM_ENABLE_RECOVERY, "RecoveryCompactTest")
+    {
+    }
+};
+
+class TransactionCompactTest : public CompactTest
+{
+public:
+    TransactionCompactTest()
+    :   CompactTest(HAM_ENABLE_TRANSACTIONS, "TransactionCompactTest")
+    {
+    }
+};
+
+BFC_REGISTER_FIXTURE(CompactTest);
+BFC_REGISTER_FIXTURE(RecoveryCompactTest);
+BFC_REGISTER_FIXTURE(TransactionCompactTest);
@@ -15,6 +15,9 @@
 #include <cstdlib>
 #include <cstring>
 #include <vector>
+#include <map>
+#include <string>
+#include <stdio.h>
 #include <ham/hamsterdb.h>
 #include "../src/env.h"
 #include "../src/cursor.h"
@@ -244,6 +247,150 @@ public:
         BFC_ASSERT_EQUAL(true, cursor_is_nil((Cursor *)clone, 0));
         BFC_ASSERT_EQUAL(0, ham_cursor_close(clone));
     }
+
+    void moveManyTest(void)
+    {
+        const int MAX=500;
+        const int BATCH=64;
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        ham_key_t keys[BATCH];
+        ham_record_t recs[BATCH];
+        ham_u32_t count;
+        ham_cursor_t *c;
+        char buffer[32], data[32];
+        int i, total=0;
+
+        for (i=0; i<MAX; i++) {
+            sprintf(buffer, "key%05d", i);
+            ::memset(data, 'a'+i%26, sizeof(data));
+            key.data=buffer;
+            key.size=(ham_size_t)strlen(buffer)+1;
+            rec.data=data;
+            rec.size=i%(sizeof(data)+1);
+            BFC_ASSERT_EQUAL(0, ham_cursor_insert(m_cursor, &key, &rec, 0));
+        }
+
+        BFC_ASSERT_EQUAL(0, createCursor(&c));
+
+        /* forward */
+        for (;;) {
+            ::memset(keys, 0, sizeof(keys));
+            ::memset(recs, 0, sizeof(recs));
+            count=BATCH;
+            ham_status_t st=ham_cursor_move_many(c, keys, recs, &count,
+                        HAM_CURSOR_NEXT);
+            if (st==HAM_KEY_NOT_FOUND) {
+                BFC_ASSERT_EQUAL(0u, count);
+                break;
+            }
+            BFC_ASSERT_EQUAL(0, st);
+            BFC_ASSERT(count>0 && count<=(ham_u32_t)BATCH);
+            for (ham_u32_t j=0; j<count; j++, total++) {
+                sprintf(buffer, "key%05d", total);
+                BFC_ASSERT_EQUAL(0, strcmp(buffer, (char *)keys[j].data));
+                BFC_ASSERT_EQUAL((ham_size_t)(total%(sizeof(data)+1)),
+                        recs[j].size);
+                ::memset(data, 'a'+total%26, sizeof(data));
+                BFC_ASSERT_EQUAL(0, ::memcmp(data, recs[j].data,
+                            recs[j].size));
+            }
+        }
+        BFC_ASSERT_EQUAL(MAX, total);
+
+        /* backward, keys only and with a user-allocated key */
+        ::memset(keys, 0, sizeof(keys));
+        keys[0].data=buffer;
+        keys[0].flags=HAM_KEY_USER_ALLOC;
+        count=BATCH;
+        BFC_ASSERT_EQUAL(0,
+                ham_cursor_move_many(c, keys, 0, &count, HAM_CURSOR_LAST));
+        BFC_ASSERT_EQUAL((ham_u32_t)BATCH, count);
+        BFC_ASSERT(keys[0].data==buffer);
+        for (ham_u32_t j=0; j<count; j++) {
+            sprintf(data, "key%05d", MAX-1-j);
+            BFC_ASSERT_EQUAL(0, strcmp(data, (char *)keys[j].data));
+        }
+
+        /* the Cursor points to the last returned item */
+        BFC_ASSERT_EQUAL(0, ham_cursor_move(c, &key, 0, 0));
+        sprintf(data, "key%05d", MAX-BATCH);
+        BFC_ASSERT_EQUAL(0, strcmp(data, (char *)key.data));
+
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(c));
+    }
+
+    void moveManyDuplicatesTest(void)
+    {
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        ham_key_t keys[20];
+        ham_record_t recs[20];
+        ham_u32_t count;
+        int i;
+
+        key.data=(void *)"a";
+        key.size=2;
+        for (i=0; i<10; i++) {
+            rec.data=&i;
+            rec.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0,
+                    ham_cursor_insert(m_cursor, &key, &rec, HAM_DUPLICATE));
+        }
+        key.data=(void *)"b";
+        BFC_ASSERT_EQUAL(0, ham_cursor_insert(m_cursor, &key, &rec, 0));
+
+        ::memset(keys, 0, sizeof(keys));
+        ::memset(recs, 0, sizeof(recs));
+        count=20;
+        BFC_ASSERT_EQUAL(0, ham_cursor_move_many(m_cursor, keys, recs,
+                    &count, HAM_CURSOR_FIRST));
+        BFC_ASSERT_EQUAL(11u, count);
+        for (i=0; i<10; i++) {
+            BFC_ASSERT_EQUAL(0, strcmp("a", (char *)keys[i].data));
+            BFC_ASSERT_EQUAL(i, *(int *)recs[i].data);
+        }
+        BFC_ASSERT_EQUAL(0, strcmp("b", (char *)keys[10].data));
+
+        ::memset(keys, 0, sizeof(keys));
+        count=20;
+        BFC_ASSERT_EQUAL(0, ham_cursor_move_many(m_cursor, keys, 0,
+                    &count, HAM_CURSOR_FIRST|HAM_SKIP_DUPLICATES));
+        BFC_ASSERT_EQUAL(2u, count);
+        BFC_ASSERT_EQUAL(0, strcmp("a", (char *)keys[0].data));
+        BFC_ASSERT_EQUAL(0, strcmp("b", (char *)keys[1].data));
+    }
+
+    void moveManyParameterTest(void)
+    {
+        ham_key_t keys[4];
+        ham_u32_t count=4;
+
+        ::memset(keys, 0, sizeof(keys));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_cursor_move_many(0, keys, 0, &count, HAM_CURSOR_NEXT));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_cursor_move_many(m_cursor, keys, 0, 0, HAM_CURSOR_NEXT));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_cursor_move_many(m_cursor, keys, 0, &count, 0));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_cursor_move_many(m_cursor, keys, 0, &count,
+                    HAM_CURSOR_FIRST|HAM_CURSOR_NEXT));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_cursor_move_many(m_cursor, keys, 0, &count,
+                    HAM_CURSOR_NEXT|HAM_PARTIAL));
+        count=0;
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_cursor_move_many(m_cursor, keys, 0, &count,
+                    HAM_CURSOR_NEXT));
+
+        /* empty Database */
+        count=4;
+        BFC_ASSERT_EQUAL(HAM_KEY_NOT_FOUND,
+                ham_cursor_move_many(m_cursor, keys, 0, &count,
+                    HAM_CURSOR_FIRST));
+        BFC_ASSERT_EQUAL(0u, count);
+    }
 };
 
 class TempTxnCursorTest : public BaseCursorTest
@@ -263,6 +410,9 @@ public:
         BFC_REGISTER_TEST(TempTxnCursorTest, cloneUncoupledBtreeCursorTest);
         BFC_REGISTER_TEST(TempTxnCursorTest, closeCoupledBtreeCursorTest);
         BFC_REGISTER_TEST(TempTxnCursorTest, closeUncoupledBtreeCursorTest);
+        BFC_REGISTER_TEST(TempTxnCursorTest, moveManyTest);
+        BFC_REGISTER_TEST(TempTxnCursorTest, moveManyDuplicatesTest);
+        BFC_REGISTER_TEST(TempTxnCursorTest, moveManyParameterTest);
     }
 
     void cloneCoupledBtreeCursorTest(void)
@@ -368,6 +518,9 @@ public:
         BFC_REGISTER_TEST(NoTxnCursorTest, moveFirstInEmptyDatabaseTest);
         BFC_REGISTER_TEST(NoTxnCursorTest, getDuplicateRecordSizeTest);
         BFC_REGISTER_TEST(NoTxnCursorTest, getRecordSizeTest);
+        BFC_REGISTER_TEST(NoTxnCursorTest, moveManyTest);
+        BFC_REGISTER_TEST(NoTxnCursorTest, moveManyDuplicatesTest);
+        BFC_REGISTER_TEST(NoTxnCursorTest, moveManyParameterTest);
     }
 
     virtual void setup()
@@ -451,6 +604,9 @@ public:
         BFC_REGISTER_TEST(LongTxnCursorTest, insertFindTest);
         BFC_REGISTER_TEST(LongTxnCursorTest, insertFindMultipleCursorsTest);
         BFC_REGISTER_TEST(LongTxnCursorTest, findInEmptyDatabaseTest);
+        BFC_REGISTER_TEST(LongTxnCursorTest, moveManyTest);
+        BFC_REGISTER_TEST(LongTxnCursorTest, moveManyDuplicatesTest);
+        BFC_REGISTER_TEST(LongTxnCursorTest, moveManyParameterTest);
         BFC_REGISTER_TEST(LongTxnCursorTest, findInEmptyTransactionTest);
         BFC_REGISTER_TEST(LongTxnCursorTest, findInBtreeOverwrittenInTxnTest);
         BFC_REGISTER_TEST(LongTxnCursorTest, findInTxnOverwrittenInTxnTest);
@@ -649,6 +805,8 @@ public:
                     moveLastThenInsertNewLastTest);
         BFC_REGISTER_TEST(LongTxnCursorTest,
                     moveFirstThenInsertNewFirstTest);
+        BFC_REGISTER_TEST(LongTxnCursorTest,
+                    moveManyBtreeAndTxnKeysTest);
     }
 
     void findInEmptyTransactionTest(void)
@@ -3775,6 +3933,67 @@ public:
         BFC_ASSERT_EQUAL(HAM_KEY_NOT_FOUND, move(0, 0, HAM_CURSOR_NEXT));
     }
 
+    void moveManyBtreeAndTxnKeysTest(void)
+    {
+        std::map<std::string, std::string> model;
+        std::map<std::string, std::string>::iterator it;
+        std::map<std::string, std::string>::reverse_iterator rit;
+        ham_txn_t *txn2;
+        char buffer[32];
+
+        /* the btree stores the even keys; the Transaction inserts a few
+         * odd keys, and erases and overwrites a few even keys. Most of
+         * the btree keys lie between two keys of the txn-tree */
+        for (int i=0; i<2000; i+=2) {
+            sprintf(buffer, "k%05d", i);
+            BFC_ASSERT_EQUAL(0, insertBtree(buffer, "btree"));
+            model[buffer]="btree";
+        }
+        for (int i=1; i<2000; i+=14) {
+            sprintf(buffer, "k%05d", i);
+            BFC_ASSERT_EQUAL(0, insertTxn(buffer, "txn"));
+            model[buffer]="txn";
+        }
+        for (int i=10; i<2000; i+=50) {
+            sprintf(buffer, "k%05d", i);
+            BFC_ASSERT_EQUAL(0, eraseTxn(buffer));
+            model.erase(buffer);
+        }
+        for (int i=4; i<2000; i+=66) {
+            sprintf(buffer, "k%05d", i);
+            BFC_ASSERT_EQUAL(0,
+                    insertTxn(buffer, "overwritten", HAM_OVERWRITE));
+            model[buffer]="overwritten";
+        }
+
+        /* a new key of another Transaction is skipped, although it's
+         * a neighbour of the btree keys in the txn-tree */
+        BFC_ASSERT_EQUAL(0, ham_txn_begin(&txn2, m_env, 0, 0, 0));
+        ham_key_t k={0};
+        ham_record_t r={0};
+        k.data=(void *)"k00103";
+        k.size=7;
+        BFC_ASSERT_EQUAL(0, ham_insert(m_db, txn2, &k, &r, 0));
+
+        it=model.begin();
+        BFC_ASSERT_EQUAL(0, move(it->first.c_str(), it->second.c_str(),
+                    HAM_CURSOR_FIRST));
+        for (it++; it!=model.end(); it++)
+            BFC_ASSERT_EQUAL(0, move(it->first.c_str(), it->second.c_str(),
+                        HAM_CURSOR_NEXT));
+        BFC_ASSERT_EQUAL(HAM_KEY_NOT_FOUND, move(0, 0, HAM_CURSOR_NEXT));
+
+        rit=model.rbegin();
+        BFC_ASSERT_EQUAL(0, move(rit->first.c_str(), rit->second.c_str(),
+                    HAM_CURSOR_LAST));
+        for (rit++; rit!=model.rend(); rit++)
+            BFC_ASSERT_EQUAL(0, move(rit->first.c_str(), rit->second.c_str(),
+                        HAM_CURSOR_PREVIOUS));
+        BFC_ASSERT_EQUAL(HAM_KEY_NOT_FOUND, move(0, 0, HAM_CURSOR_PREVIOUS));
+
+        BFC_ASSERT_EQUAL(0, ham_txn_abort(txn2, 0));
+    }
+
 };
 
 class DupeCacheTest : public hamsterDB_fixture
@@ -3799,6 +4018,7 @@ public:
         BFC_REGISTER_TEST(DupeCacheTest, eraseAtBeginningTest);
         BFC_REGISTER_TEST(DupeCacheTest, eraseAtEndTest);
         BFC_REGISTER_TEST(DupeCacheTest, eraseMixedTest);
+        BFC_REGISTER_TEST(DupeCacheTest, runTest);
     }
 
     virtual void setup()
@@ -3840,11 +4060,9 @@ public:
             c.append(entries[i]);
         BFC_ASSERT_EQUAL(20u, c.get_count());
 
-        DupeCacheLine *e=c.get_first_element();
-        for (int i=0; i<20; i++) {
-            BFC_ASSERT_EQUAL((ham_u64_t)i, e->get_btree_dupe_idx());
-            e++;
-        }
+        for (int i=0; i<20; i++)
+            BFC_ASSERT_EQUAL((ham_u64_t)i,
+                    c.get_element(i).get_btree_dupe_idx());
     }
 
     void insertAtBeginningTest(void)
@@ -3859,11 +4077,9 @@ public:
             c.insert(0, entries[i]);
         BFC_ASSERT_EQUAL(20u, c.get_count());
 
-        DupeCacheLine *e=c.get_first_element();
-        for (int i=19, j=0; i>=0; i--, j++) {
-            BFC_ASSERT_EQUAL((ham_u64_t)i, e->get_btree_dupe_idx());
-            e++;
-        }
+        for (int i=19, j=0; i>=0; i--, j++)
+            BFC_ASSERT_EQUAL((ham_u64_t)i,
+                    c.get_element(j).get_btree_dupe_idx());
     }
 
     void insertAtEndTest(void)
@@ -3878,11 +4094,9 @@ public:
             c.insert(i, entries[i]);
         BFC_ASSERT_EQUAL(20u, c.get_count());
 
-        DupeCacheLine *e=c.get_first_element();
-        for (int i=0; i<20; i++) {
-            BFC_ASSERT_EQUAL((ham_u64_t)i, e->get_btree_dupe_idx());
-            e++;
-        }
+        for (int i=0; i<20; i++)
+            BFC_ASSERT_EQUAL((ham_u64_t)i,
+                    c.get_element(i).get_btree_dupe_idx());
     }
 
     void insertMixedTest(void)
@@ -3901,27 +4115,26 @@ public:
         }
         BFC_ASSERT_EQUAL(20u, c.get_count());
 
-        DupeCacheLine *e=c.get_first_element();
-        BFC_ASSERT_EQUAL((ham_u64_t)3,  e[ 0].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)7,  e[ 1].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)11, e[ 2].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)15, e[ 3].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)19, e[ 4].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)18, e[ 5].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)17, e[ 6].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)16, e[ 7].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)14, e[ 8].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)13, e[ 9].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)12, e[10].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)10, e[11].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)9,  e[12].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)8,  e[13].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)6,  e[14].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)5,  e[15].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)4,  e[16].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)2,  e[17].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)1,  e[18].get_btree_dupe_idx());
-        BFC_ASSERT_EQUAL((ham_u64_t)0,  e[19].get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)3,  c.get_element(0).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)7,  c.get_element(1).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)11, c.get_element(2).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)15, c.get_element(3).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)19, c.get_element(4).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)18, c.get_element(5).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)17, c.get_element(6).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)16, c.get_element(7).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)14, c.get_element(8).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)13, c.get_element(9).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)12, c.get_element(10).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)10, c.get_element(11).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)9,  c.get_element(12).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)8,  c.get_element(13).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)6,  c.get_element(14).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)5,  c.get_element(15).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)4,  c.get_element(16).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)2,  c.get_element(17).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)1,  c.get_element(18).get_btree_dupe_idx());
+        BFC_ASSERT_EQUAL((ham_u64_t)0,  c.get_element(19).get_btree_dupe_idx());
     }
 
     void eraseAtBeginningTest(void)
@@ -3938,13 +4151,11 @@ public:
 
         int s=1;
         for (int i=19; i>=0; i--) {
-            DupeCacheLine *e=c.get_first_element();
             c.erase(0);
             BFC_ASSERT_EQUAL((unsigned)i, c.get_count());
-            for (int j=0; j<i; j++) {
-                BFC_ASSERT_EQUAL((ham_u64_t)s+j, e->get_btree_dupe_idx());
-                e++;
-            }
+            for (int j=0; j<i; j++)
+                BFC_ASSERT_EQUAL((ham_u64_t)s+j,
+                        c.get_element(j).get_btree_dupe_idx());
             s++;
         }
 
@@ -3964,12 +4175,10 @@ public:
         BFC_ASSERT_EQUAL(20u, c.get_count());
 
         for (int i=0; i<20; i++) {
-            DupeCacheLine *e=c.get_first_element();
             c.erase(c.get_count()-1);
-            for (int j=0; j<20-i; j++) {
-                BFC_ASSERT_EQUAL((ham_u64_t)j, e->get_btree_dupe_idx());
-                e++;
-            }
+            for (int j=0; j<19-i; j++)
+                BFC_ASSERT_EQUAL((ham_u64_t)j,
+                        c.get_element(j).get_btree_dupe_idx());
         }
 
         BFC_ASSERT_EQUAL(0u, c.get_count());
@@ -3990,14 +4199,61 @@ public:
         for (int i=0; i<10; i++)
             c.erase(i);
 
-        DupeCacheLine *e=c.get_first_element();
-        for (int i=0; i<10; i++) {
-            BFC_ASSERT_EQUAL((unsigned)i*2+1, e->get_btree_dupe_idx());
-            e++;
-        }
+        for (int i=0; i<10; i++)
+            BFC_ASSERT_EQUAL((unsigned)i*2+1,
+                    c.get_element(i).get_btree_dupe_idx());
 
         BFC_ASSERT_EQUAL(10u, c.get_count());
     }
+
+    void runTest(void)
+    {
+        DupeCache c;
+        txn_op_t ops[4];
+
+        /* 1000 btree duplicates are stored in a single run, which is
+         * split by the txn-ops */
+        c.append_btree_duplicates(1000);
+        BFC_ASSERT_EQUAL(1000u, c.get_count());
+        BFC_ASSERT_EQUAL((ham_u64_t)999,
+                c.get_element(999).get_btree_dupe_idx());
+
+        c.insert(500, DupeCacheLine(false, &ops[0]));
+        c.set_element(10, DupeCacheLine(false, &ops[1]));
+        c.erase(20);
+        c.append(DupeCacheLine(false, &ops[2]));
+        BFC_ASSERT_EQUAL(1001u, c.get_count());
+        BFC_ASSERT_EQUAL(500u, c.find_txn_op(&ops[0]));
+        BFC_ASSERT_EQUAL(11u, c.find_txn_op(&ops[1]));
+        BFC_ASSERT_EQUAL(1001u, c.find_txn_op(&ops[2]));
+
+        /* walk forward and backward through the runs */
+        for (int pass=0; pass<2; pass++) {
+            for (int k=0; k<1001; k++) {
+                int i=pass ? 1000-k : k;
+                DupeCacheLine l=c.get_element(i);
+                if (i==10)
+                    BFC_ASSERT(l.get_txn_op()==&ops[1]);
+                else if (i==499)
+                    BFC_ASSERT(l.get_txn_op()==&ops[0]);
+                else if (i==1000)
+                    BFC_ASSERT(l.get_txn_op()==&ops[2]);
+                else {
+                    ham_u64_t expected=i;
+                    if (i>=20 && i<499)
+                        expected++;
+                    BFC_ASSERT_EQUAL(expected, l.get_btree_dupe_idx());
+                }
+            }
+        }
+
+        DupeCache clone;
+        c.clone(&clone);
+        c.clear();
+        BFC_ASSERT_EQUAL(0u, c.get_count());
+        BFC_ASSERT_EQUAL(1001u, clone.get_count());
+        BFC_ASSERT_EQUAL(0u, clone.find_txn_op(&ops[3]));
+    }
 };
 
 class DupeCursorTest : public hamsterDB_fixture
@@ -14,9 +14,11 @@
 #include <stdexcept>
 #include <cstring>
 #include <ham/hamsterdb.h>
+#include <ham/hamsterdb_int.h>
 #include "../src/db.h"
 #include "../src/device.h"
 #include "../src/env.h"
+#include "../src/page.h"
 #include "os.hpp"
 
 #include "bfc-testsuite.hpp"
@@ -29,9 +31,10 @@ class DeviceTest : public hamsterDB_fixture
     define_super(hamsterDB_fixture);
 
 public:
-    DeviceTest(bool inmemory=false, const char *name="DeviceTest")
+    DeviceTest(ham_u32_t flags=0, const char *name="DeviceTest")
     : hamsterDB_fixture(name),
-        m_db(0), m_inmemory(inmemory), m_dev(0)
+        m_db(0), m_flags(flags),
+        m_inmemory((flags&HAM_IN_MEMORY_DB) ? HAM_TRUE : HAM_FALSE), m_dev(0)
     {
         testrunner::get_instance()->register_fixture(this);
         BFC_REGISTER_TEST(DeviceTest, newDeleteTest);
@@ -44,11 +47,14 @@ public:
         BFC_REGISTER_TEST(DeviceTest, mmapUnmapTest);
         BFC_REGISTER_TEST(DeviceTest, readWriteTest);
         BFC_REGISTER_TEST(DeviceTest, readWritePageTest);
+        BFC_REGISTER_TEST(DeviceTest, writePagesTest);
+        BFC_REGISTER_TEST(DeviceTest, maxWriteSizeTest);
     }
 
 protected:
     ham_db_t *m_db;
     ham_env_t *m_env;
+    ham_u32_t m_flags;
     ham_bool_t m_inmemory;
     Device *m_dev;
 
@@ -61,8 +67,7 @@ public:
 
         BFC_ASSERT_EQUAL(0, ham_new(&m_db));
         BFC_ASSERT_EQUAL(0,
-                ham_create(m_db, BFC_OPATH(".test"),
-                        m_inmemory ? HAM_IN_MEMORY_DB : 0, 0644));
+                ham_create(m_db, BFC_OPATH(".test"), m_flags, 0644));
         m_env=ham_get_env(m_db);
         m_dev=((Environment *)m_env)->get_device();
     }
@@ -251,13 +256,134 @@ public:
         }
     }
 
+    void writePagesTest()
+    {
+        /* unsorted, with gaps at page 14 and 18 */
+        int ids[8]={17, 10, 11, 12, 15, 16, 13, 19};
+        Page *pages[8];
+        ham_size_t ps=m_dev->get_pagesize();
+        int i;
+
+        m_dev->set_flags(HAM_DISABLE_MMAP);
+        BFC_ASSERT_EQUAL(0, m_dev->truncate(ps*20));
+
+        for (i=0; i<8; i++) {
+            BFC_ASSERT((pages[i]=new Page((Environment *)m_env)));
+            pages[i]->set_self(ps*ids[i]);
+            BFC_ASSERT_EQUAL(0, m_dev->read_page(pages[i]));
+            pages[i]->set_flags(pages[i]->get_flags()|Page::NPERS_NO_HEADER);
+            memset(pages[i]->get_pers(), ids[i], ps);
+        }
+
+        /* the pages are sorted by their address */
+        BFC_ASSERT_EQUAL(0, m_dev->write_pages(pages, 8));
+        for (i=1; i<8; i++)
+            BFC_ASSERT(pages[i-1]->get_self()<pages[i]->get_self());
+        for (i=0; i<8; i++) {
+            BFC_ASSERT_EQUAL(0, pages[i]->free());
+            delete pages[i];
+        }
+
+        for (i=0; i<8; i++) {
+            ham_u8_t *buffer=(ham_u8_t *)malloc(ps);
+            ham_u8_t *temp=(ham_u8_t *)malloc(ps);
+            memset(temp, ids[i], ps);
+            BFC_ASSERT_EQUAL(0, m_dev->read(ps*ids[i], buffer, ps));
+            BFC_ASSERT_EQUAL(0, memcmp(buffer, temp, ps));
+            free(buffer);
+            free(temp);
+        }
+    }
+
+    ham_u64_t count_page_writes(ham_env_t *env, ham_size_t first,
+                ham_size_t count)
+    {
+        Environment *e=(Environment *)env;
+        Device *device=e->get_device();
+        ham_size_t ps=device->get_pagesize();
+        ham_env_metrics_t metrics;
+        std::vector<Page *> pages(count);
+
+        for (ham_size_t i=0; i<count; i++) {
+            BFC_ASSERT((pages[i]=new Page(e)));
+            pages[i]->set_self(ps*(first+i));
+            BFC_ASSERT_EQUAL(0, device->read_page(pages[i]));
+            pages[i]->set_flags(pages[i]->get_flags()|Page::NPERS_NO_HEADER);
+        }
+
+        BFC_ASSERT_EQUAL(0, ham_env_get_metrics(env, &metrics,
+                    HAM_METRICS_RESET));
+        BFC_ASSERT_EQUAL(0, device->write_pages(&pages[0], count));
+        BFC_ASSERT_EQUAL(0, ham_env_get_metrics(env, &metrics, 0));
+        BFC_ASSERT_EQUAL((ham_u64_t)count, metrics.pages_written);
+
+        for (ham_size_t i=0; i<count; i++) {
+            BFC_ASSERT_EQUAL(0, pages[i]->free());
+            delete pages[i];
+        }
+        return (metrics.page_writes);
+    }
+
+    void maxWriteSizeTest()
+    {
+        ham_env_t *env;
+        ham_parameter_t params[3]=
+        {
+            { HAM_PARAM_PAGESIZE, 1024 },
+            { HAM_PARAM_MAX_WRITE_SIZE, 1024*2 },
+            { 0, 0 }
+        };
+        ham_parameter_t query[2]=
+        {
+            { HAM_PARAM_MAX_WRITE_SIZE, 0 },
+            { 0, 0 }
+        };
+
+        BFC_ASSERT_EQUAL(0, ham_env_new(&env));
+        params[1].value=0;
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_create_ex(env, BFC_OPATH(".test2"),
+                    HAM_ENABLE_METRICS|HAM_DISABLE_MMAP, 0644, &params[0]));
+        params[1].value=1024*2;
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create_ex(env, BFC_OPATH(".test2"),
+                    HAM_ENABLE_METRICS|HAM_DISABLE_MMAP, 0644, &params[0]));
+        BFC_ASSERT_EQUAL(0, ham_env_get_parameters(env, &query[0]));
+        BFC_ASSERT_EQUAL((ham_u64_t)1024*2, query[0].value);
+
+        Device *device=((Environment *)env)->get_device();
+        BFC_ASSERT_EQUAL(0, device->truncate(1024*20));
+
+        /* adjacent pages are written in pairs */
+        BFC_ASSERT_EQUAL((ham_u64_t)3, count_page_writes(env, 10, 6));
+
+        /* ... or all at once */
+        ((Environment *)env)->set_max_write_size(1024*8);
+        BFC_ASSERT_EQUAL((ham_u64_t)1, count_page_writes(env, 10, 6));
+
+        /* a write size smaller than a page writes one page at a time */
+        ((Environment *)env)->set_max_write_size(100);
+        BFC_ASSERT_EQUAL((ham_u64_t)6, count_page_writes(env, 10, 6));
+
+        BFC_ASSERT_EQUAL(0, ham_env_close(env, 0));
+
+        /* the parameter is not persistent */
+        BFC_ASSERT_EQUAL(0, ham_env_open_ex(env, BFC_OPATH(".test2"),
+                    0, 0));
+        BFC_ASSERT_EQUAL(0, ham_env_get_parameters(env, &query[0]));
+        BFC_ASSERT_EQUAL((ham_u64_t)HAM_DEFAULT_MAX_WRITE_SIZE,
+                query[0].value);
+        BFC_ASSERT_EQUAL(0, ham_env_close(env, 0));
+        ham_env_delete(env);
+    }
+
 };
 
 class InMemoryDeviceTest : public DeviceTest
 {
 public:
     InMemoryDeviceTest()
-    :   DeviceTest(true, "InMemoryDeviceTest")
+    :   DeviceTest(HAM_IN_MEMORY_DB, "InMemoryDeviceTest")
     {
         clear_tests(); // don't inherit tests
         testrunner::get_instance()->register_fixture(this);
@@ -271,6 +397,94 @@ public:
 
 };
 
+class ArenaDeviceTest : public DeviceTest
+{
+public:
+    ArenaDeviceTest()
+    :   DeviceTest(HAM_IN_MEMORY_DB|HAM_IN_MEMORY_ARENA, "ArenaDeviceTest")
+    {
+        clear_tests(); // don't inherit tests
+        testrunner::get_instance()->register_fixture(this);
+        BFC_REGISTER_TEST(ArenaDeviceTest, allocFreeTest);
+        BFC_REGISTER_TEST(ArenaDeviceTest, arenaTest);
+        BFC_REGISTER_TEST(ArenaDeviceTest, databaseTest);
+        BFC_REGISTER_TEST(ArenaDeviceTest, flagsTest);
+    }
+
+    void arenaTest()
+    {
+        int i;
+        Page *pages[100];
+        InMemoryDevice *dev=(InMemoryDevice *)m_dev;
+        ham_size_t arenas=dev->get_arena_count();
+
+        for (i=0; i<100; i++) {
+            pages[i]=new Page((Environment *)m_env);
+            BFC_ASSERT_EQUAL(0, pages[i]->allocate());
+            BFC_ASSERT_EQUAL(pages[i],
+                    InMemoryDevice::get_arena_page(pages[i]->get_self()));
+        }
+        BFC_ASSERT(dev->get_arena_count()>arenas);
+        arenas=dev->get_arena_count();
+
+        /* freed slots are reused */
+        ham_offset_t address=pages[50]->get_self();
+        BFC_ASSERT_EQUAL(0, pages[50]->free());
+        BFC_ASSERT_EQUAL(0, pages[50]->allocate());
+        BFC_ASSERT_EQUAL(address, pages[50]->get_self());
+        BFC_ASSERT_EQUAL(arenas, dev->get_arena_count());
+
+        for (i=0; i<100; i++) {
+            BFC_ASSERT_EQUAL(0, pages[i]->free());
+            delete pages[i];
+        }
+    }
+
+    void databaseTest()
+    {
+        ham_key_t key;
+        ham_record_t rec;
+        ham_cursor_t *c;
+        int i, count=0;
+
+        for (i=0; i<20000; i++) {
+            memset(&key, 0, sizeof(key));
+            memset(&rec, 0, sizeof(rec));
+            key.data=&i;
+            key.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0, ham_insert(m_db, 0, &key, &rec, 0));
+        }
+        for (i=0; i<20000; i+=2) {
+            key.data=&i;
+            key.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0, ham_erase(m_db, 0, &key, 0));
+        }
+        for (i=0; i<20000; i++) {
+            key.data=&i;
+            key.size=sizeof(i);
+            BFC_ASSERT_EQUAL((i&1) ? 0 : HAM_KEY_NOT_FOUND,
+                    ham_find(m_db, 0, &key, &rec, 0));
+        }
+
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &c));
+        while (!ham_cursor_move(c, 0, 0, HAM_CURSOR_NEXT))
+            count++;
+        BFC_ASSERT_EQUAL(10000, count);
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(c));
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+
+    void flagsTest()
+    {
+        ham_db_t *db;
+        BFC_ASSERT_EQUAL(0, ham_new(&db));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_create(db, BFC_OPATH(".test2"), HAM_IN_MEMORY_ARENA, 0644));
+        BFC_ASSERT_EQUAL(0, ham_delete(db));
+    }
+};
+
 BFC_REGISTER_FIXTURE(DeviceTest);
 BFC_REGISTER_FIXTURE(InMemoryDeviceTest);
+BFC_REGISTER_FIXTURE(ArenaDeviceTest);
 
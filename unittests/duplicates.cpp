@@ -201,6 +201,19 @@ public:
          */
         BFC_REGISTER_TEST(DupeTest, insertManyManyTest);
 
+        /*
+         * insert so many duplicates that the duplicate table is converted
+         * to a duplicate tree; then insert, overwrite and erase duplicates
+         * in the middle of the tree
+         */
+        BFC_REGISTER_TEST(DupeTest, duplicateTreeTest);
+
+        /*
+         * without HAM_ENABLE_DUPLICATE_TREES, a large duplicate table
+         * is not converted
+         */
+        BFC_REGISTER_TEST(DupeTest, duplicateTableTest);
+
         /*
          * insert several duplicates; then set a cursor to the 2nd duplicate.
          * clone the cursor, move it to the next element. then erase the
@@ -1885,6 +1898,192 @@ public:
         BFC_ASSERT_EQUAL(0, ham_cursor_close(c));
     }
 
+    void makeTreeRecord(int i, ham_record_t *rec, char *buffer)
+    {
+        /* every 3rd record is stored in a blob */
+        memset(rec, 0, sizeof(*rec));
+        memset(buffer, 0, 100);
+        *(int *)buffer=i;
+        rec->data=buffer;
+        rec->size=(i%3) ? sizeof(int) : 100;
+    }
+
+    void checkTree(std::vector<int> &model)
+    {
+        ham_key_t key;
+        ham_record_t rec;
+        ham_cursor_t *c;
+        ham_size_t count=0;
+
+        memset(&key, 0, sizeof(key));
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &c));
+        BFC_ASSERT_EQUAL(0, ham_cursor_find(c, &key, 0));
+        BFC_ASSERT_EQUAL(0, ham_cursor_get_duplicate_count(c, &count, 0));
+        BFC_ASSERT_EQUAL((ham_size_t)model.size(), count);
+
+        for (ham_size_t i=0; i<model.size(); i++) {
+            memset(&rec, 0, sizeof(rec));
+            BFC_ASSERT_EQUAL(0,
+                    ham_cursor_move(c, 0, &rec,
+                        i ? HAM_CURSOR_NEXT|HAM_ONLY_DUPLICATES : 0));
+            BFC_ASSERT_EQUAL((ham_size_t)((model[i]%3) ? sizeof(int) : 100),
+                    rec.size);
+            BFC_ASSERT_EQUAL(model[i], *(int *)rec.data);
+        }
+        BFC_ASSERT_EQUAL(HAM_KEY_NOT_FOUND,
+                ham_cursor_move(c, 0, 0, HAM_CURSOR_NEXT|HAM_ONLY_DUPLICATES));
+
+        /* and backwards */
+        for (ham_size_t i=model.size(); i>0; i--) {
+            memset(&rec, 0, sizeof(rec));
+            BFC_ASSERT_EQUAL(0,
+                    ham_cursor_move(c, 0, &rec,
+                        i==model.size()
+                            ? HAM_CURSOR_LAST
+                            : HAM_CURSOR_PREVIOUS|HAM_ONLY_DUPLICATES));
+            BFC_ASSERT_EQUAL(model[i-1], *(int *)rec.data);
+        }
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(c));
+    }
+
+    /* returns true if the duplicates of the (empty) key are stored in
+     * a duplicate tree */
+    bool isDuplicateTree()
+    {
+        ham_key_t key;
+        ham_cursor_t *c;
+        std::vector<ham_offset_t> nodes, rids;
+
+        memset(&key, 0, sizeof(key));
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &c));
+        BFC_ASSERT_EQUAL(0, ham_cursor_find(c, &key, 0));
+        btree_cursor_t *btc=((Cursor *)c)->get_btree_cursor();
+        Page *page=btree_cursor_get_coupled_page(btc);
+        btree_key_t *k=btree_node_get_key((Database *)m_db,
+                page_get_btree_node(page), btree_cursor_get_coupled_index(btc));
+        BFC_ASSERT_EQUAL(0, blob_duplicate_get_references(
+                ((Database *)m_db)->get_env(), key_get_ptr(k), nodes, rids));
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(c));
+
+        /* only the root node of a tree refers to other nodes */
+        return (!nodes.empty());
+    }
+
+    /* moves the cursor to the duplicate at @a position */
+    void moveToDuplicate(ham_cursor_t *c, ham_size_t position)
+    {
+        ham_key_t key;
+        memset(&key, 0, sizeof(key));
+        BFC_ASSERT_EQUAL(0, ham_cursor_find(c, &key, 0));
+        for (ham_size_t i=0; i<position; i++)
+            BFC_ASSERT_EQUAL(0, ham_cursor_move(c, 0, 0,
+                        HAM_CURSOR_NEXT|HAM_ONLY_DUPLICATES));
+    }
+
+    void duplicateTreeTest(void)
+    {
+        ham_key_t key;
+        ham_record_t rec;
+        ham_cursor_t *c;
+        char buffer[100];
+        std::vector<int> model;
+        const int count=3000;
+        int value=count;
+
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        BFC_ASSERT_EQUAL(0, ham_create(m_db, BFC_OPATH(".test"),
+                    m_flags|HAM_ENABLE_DUPLICATES|HAM_ENABLE_DUPLICATE_TREES,
+                    0664));
+
+        memset(&key, 0, sizeof(key));
+        for (int i=0; i<count; i++) {
+            makeTreeRecord(i, &rec, buffer);
+            BFC_ASSERT_EQUAL(0,
+                    ham_insert(m_db, 0, &key, &rec, HAM_DUPLICATE));
+            model.push_back(i);
+        }
+        checkTree(model);
+        BFC_ASSERT_EQUAL(true, isDuplicateTree());
+
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &c));
+
+        /* insert in front of, behind and at the start of the tree */
+        for (ham_size_t pos=7; pos<model.size(); pos+=397) {
+            moveToDuplicate(c, pos);
+            makeTreeRecord(value, &rec, buffer);
+            BFC_ASSERT_EQUAL(0, ham_cursor_insert(c, &key, &rec,
+                        HAM_DUPLICATE_INSERT_BEFORE));
+            model.insert(model.begin()+pos, value++);
+
+            moveToDuplicate(c, pos+1);
+            makeTreeRecord(value, &rec, buffer);
+            BFC_ASSERT_EQUAL(0, ham_cursor_insert(c, &key, &rec,
+                        HAM_DUPLICATE_INSERT_AFTER));
+            model.insert(model.begin()+pos+2, value++);
+        }
+        makeTreeRecord(value, &rec, buffer);
+        BFC_ASSERT_EQUAL(0, ham_cursor_insert(c, &key, &rec,
+                    HAM_DUPLICATE_INSERT_FIRST));
+        model.insert(model.begin(), value++);
+        checkTree(model);
+
+        /* overwrite a few duplicates */
+        for (ham_size_t pos=3; pos<model.size(); pos+=511) {
+            moveToDuplicate(c, pos);
+            makeTreeRecord(value, &rec, buffer);
+            BFC_ASSERT_EQUAL(0, ham_cursor_overwrite(c, &rec, 0));
+            model[pos]=value++;
+        }
+        checkTree(model);
+
+        /* erase a range in the middle, which removes whole leaf nodes */
+        moveToDuplicate(c, 1000);
+        for (int i=0; i<700; i++) {
+            BFC_ASSERT_EQUAL(0, ham_cursor_erase(c, 0));
+            model.erase(model.begin()+1000);
+            moveToDuplicate(c, 1000);
+        }
+        checkTree(model);
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(c));
+
+        /* the tree is also modified if it's opened without
+         * HAM_ENABLE_DUPLICATE_TREES */
+        if (!(m_flags&HAM_IN_MEMORY_DB)) {
+            BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+            BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+            BFC_ASSERT_EQUAL(0, ham_open(m_db, BFC_OPATH(".test"), m_flags));
+            checkTree(model);
+            makeTreeRecord(value, &rec, buffer);
+            BFC_ASSERT_EQUAL(0,
+                    ham_insert(m_db, 0, &key, &rec, HAM_DUPLICATE));
+            model.push_back(value++);
+            checkTree(model);
+            BFC_ASSERT_EQUAL(true, isDuplicateTree());
+        }
+
+        BFC_ASSERT_EQUAL(0, ham_erase(m_db, 0, &key, 0));
+        memset(&rec, 0, sizeof(rec));
+        BFC_ASSERT_EQUAL(HAM_KEY_NOT_FOUND, ham_find(m_db, 0, &key, &rec, 0));
+    }
+
+    void duplicateTableTest(void)
+    {
+        ham_key_t key;
+        ham_record_t rec;
+        char buffer[100];
+        std::vector<int> model;
+
+        memset(&key, 0, sizeof(key));
+        for (int i=0; i<600; i++) {
+            makeTreeRecord(i, &rec, buffer);
+            BFC_ASSERT_EQUAL(0,
+                    ham_insert(m_db, 0, &key, &rec, HAM_DUPLICATE));
+            model.push_back(i);
+        }
+        checkTree(model);
+        BFC_ASSERT_EQUAL(false, isDuplicateTree());
+    }
+
     void cloneTest(void)
     {
         ham_cursor_t *c1, *c2;
@@ -1967,6 +2166,7 @@ public:
         BFC_REGISTER_TEST(SortedDupeTest, anotherSimpleInsertTest);
         BFC_REGISTER_TEST(SortedDupeTest, andAnotherSimpleInsertTest);
         BFC_REGISTER_TEST(SortedDupeTest, identicalRecordsTest);
+        BFC_REGISTER_TEST(SortedDupeTest, duplicateTreeTest);
     }
 
 protected:
@@ -2238,6 +2438,35 @@ public:
         }
     }
 
+    /*
+     * inserts enough duplicates to convert the table to a duplicate
+     * tree; the tree keeps the duplicates sorted
+     */
+    void duplicateTreeTest(void)
+    {
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        BFC_ASSERT_EQUAL(0, ham_create(m_db, BFC_OPATH(".test"),
+                    m_flags|HAM_ENABLE_DUPLICATES|HAM_SORT_DUPLICATES
+                        |HAM_ENABLE_DUPLICATE_TREES, 0664));
+        BFC_ASSERT_EQUAL(0,
+            ham_set_duplicate_compare_func(m_db, __compare_numbers));
+
+        srand(0);
+        for (int i=0; i<1500; i++)
+            insertDuplicate((ham_u32_t)(rand()%1000));
+        checkDuplicates();
+
+        ham_key_t key;
+        ham_cursor_t *c;
+        ham_size_t count=0;
+        ::memset(&key, 0, sizeof(key));
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &c));
+        BFC_ASSERT_EQUAL(0, ham_cursor_find(c, &key, 0));
+        BFC_ASSERT_EQUAL(0, ham_cursor_get_duplicate_count(c, &count, 0));
+        BFC_ASSERT_EQUAL((ham_size_t)1500, count);
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(c));
+    }
+
 };
 
 class InMemorySortedDupeTest : public SortedDupeTest
@@ -2252,6 +2481,7 @@ public:
         BFC_REGISTER_TEST(InMemorySortedDupeTest, anotherSimpleInsertTest);
         BFC_REGISTER_TEST(InMemorySortedDupeTest, andAnotherSimpleInsertTest);
         BFC_REGISTER_TEST(InMemorySortedDupeTest, identicalRecordsTest);
+        BFC_REGISTER_TEST(InMemorySortedDupeTest, duplicateTreeTest);
     }
 };
 
@@ -13,9 +13,14 @@
 
 #include <stdexcept>
 #include <cstring>
+#include <cstdio>
+#include <vector>
 #include <ham/hamsterdb_int.h>
 #include "../src/db.h"
 #include "../src/env.h"
+#include "../src/cipher.h"
+#include "../src/compressor.h"
+#include "../src/page.h"
 #include "os.hpp"
 
 #include "bfc-testsuite.hpp"
@@ -166,9 +171,19 @@ public:
         BFC_REGISTER_TEST(FilterTest, aesFilterInMemoryTest);
         BFC_REGISTER_TEST(FilterTest, aesTwiceFilterTest);
         BFC_REGISTER_TEST(FilterTest, negativeAesFilterTest);
+        BFC_REGISTER_TEST(FilterTest, xtsCipherTest);
+        BFC_REGISTER_TEST(FilterTest, xtsFilterTest);
+        BFC_REGISTER_TEST(FilterTest, xtsFilterNoMmapTest);
+        BFC_REGISTER_TEST(FilterTest, xtsChecksumFilterTest);
+        BFC_REGISTER_TEST(FilterTest, xtsTwiceFilterTest);
         BFC_REGISTER_TEST(FilterTest, zlibFilterTest);
         BFC_REGISTER_TEST(FilterTest, zlibFilterEmptyRecordTest);
         BFC_REGISTER_TEST(FilterTest, zlibEnvFilterTest);
+        BFC_REGISTER_TEST(FilterTest, pageCompressorTest);
+        BFC_REGISTER_TEST(FilterTest, pageCompressionTest);
+        BFC_REGISTER_TEST(FilterTest, pageCompressionNoMmapTest);
+        BFC_REGISTER_TEST(FilterTest, pageCompressionXtsTest);
+        BFC_REGISTER_TEST(FilterTest, pageCompressionInMemoryTest);
     }
 
 protected:
@@ -604,6 +619,183 @@ public:
 #endif
     }
 
+    void xtsCipherTest()
+    {
+#ifndef HAM_DISABLE_ENCRYPTION
+        ham_u8_t key[16]={0x13, 0x14, 0x15};
+        const ham_size_t pagesize=1024;
+        ham_u8_t plain[pagesize*3], data[pagesize*3], copy[pagesize*3];
+        ham_u8_t *pages[3];
+        ham_offset_t addresses[3]={pagesize*7, pagesize*8, pagesize*9};
+
+        for (ham_size_t i=0; i<sizeof(plain); i++)
+            plain[i]=(ham_u8_t)(i%7);
+
+        PageCipher portable(key, pagesize, false);
+        BFC_ASSERT_EQUAL(false, portable.uses_aesni());
+
+        /* roundtrip */
+        memcpy(data, plain, sizeof(data));
+        portable.encrypt(addresses[0], data, sizeof(data));
+        BFC_ASSERT(0!=memcmp(data, plain, sizeof(data)));
+        /* equal plaintext produces different ciphertext in every block
+         * and on every page */
+        BFC_ASSERT(0!=memcmp(&data[0], &data[112], 16));
+        BFC_ASSERT(0!=memcmp(&data[0], &data[pagesize], pagesize));
+        memcpy(copy, data, sizeof(copy));
+        portable.decrypt(addresses[0], data, sizeof(data));
+        BFC_ASSERT_EQUAL(0, memcmp(data, plain, sizeof(data)));
+
+        /* the batched interface produces the same result */
+        memcpy(data, plain, sizeof(data));
+        for (int i=0; i<3; i++)
+            pages[i]=&data[i*pagesize];
+        portable.encrypt_pages(addresses, pages, 3);
+        BFC_ASSERT_EQUAL(0, memcmp(data, copy, sizeof(data)));
+
+        /* a part of a page can be decrypted on its own */
+        memcpy(data, copy, sizeof(data));
+        portable.decrypt(addresses[0]+pagesize+48, &data[pagesize+48], 80);
+        BFC_ASSERT_EQUAL(0, memcmp(&data[pagesize+48],
+                    &plain[pagesize+48], 80));
+
+        /* AES-NI (if available) and the portable code are identical */
+        PageCipher accel(key, pagesize);
+        memcpy(data, plain, sizeof(data));
+        accel.encrypt(addresses[0], data, sizeof(data));
+        BFC_ASSERT_EQUAL(0, memcmp(data, copy, sizeof(data)));
+        accel.decrypt_pages(addresses, pages, 3);
+        BFC_ASSERT_EQUAL(0, memcmp(data, plain, sizeof(data)));
+        memcpy(data, copy, sizeof(data));
+        accel.decrypt(addresses[0]+16, &data[16], 5*16);
+        BFC_ASSERT_EQUAL(0, memcmp(&data[16], &plain[16], 5*16));
+
+        /* a known answer, computed with OpenSSL's EVP_aes_128_xts(); the
+         * XTS key is the data key followed by the tweak key
+         * (AES(key, 0x5c...)), the IV is the page address in little
+         * endian */
+        static const ham_u8_t expected[32]={
+            0xf2, 0x8c, 0x4b, 0x21, 0x90, 0x17, 0x57, 0x2d,
+            0x2b, 0xf3, 0x07, 0xd4, 0xaa, 0x72, 0x69, 0xd6,
+            0x18, 0x3b, 0x0f, 0x70, 0x1c, 0xff, 0x7e, 0xc4,
+            0xaf, 0xc9, 0x50, 0x6d, 0xe3, 0x12, 0x11, 0xf4
+        };
+        ham_u8_t block[32];
+        for (int i=0; i<32; i++)
+            block[i]=(ham_u8_t)i;
+        portable.encrypt(addresses[0], block, sizeof(block));
+        BFC_ASSERT_EQUAL(0, memcmp(block, expected, sizeof(block)));
+        for (int i=0; i<32; i++)
+            block[i]=(ham_u8_t)i;
+        accel.encrypt(addresses[0], block, sizeof(block));
+        BFC_ASSERT_EQUAL(0, memcmp(block, expected, sizeof(block)));
+
+        /* a different key produces a different ciphertext */
+        key[0]++;
+        PageCipher other(key, pagesize);
+        memcpy(data, plain, sizeof(data));
+        other.encrypt(addresses[0], data, sizeof(data));
+        BFC_ASSERT(0!=memcmp(data, copy, sizeof(data)));
+#endif
+    }
+
+    void xtsFilter(ham_u32_t flags)
+    {
+#ifndef HAM_DISABLE_ENCRYPTION
+        ham_db_t *db;
+        ham_key_t key;
+        ham_record_t rec;
+        ham_u8_t aeskey[16] ={0x13};
+        ham_u8_t aeskey2[16]={0x14};
+        char buffer[1024*20];
+        int i;
+
+        BFC_ASSERT_EQUAL(0, ham_new(&db));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create(m_env, BFC_OPATH(".test"), flags, 0664));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_enable_encryption(m_env, aeskey, 0x100));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_enable_encryption(m_env, aeskey, HAM_ENCRYPTION_XTS));
+
+        /* small and large records; the large blobs are read with
+         * unaligned offsets */
+        BFC_ASSERT_EQUAL(0, ham_env_create_db(m_env, db, 333, 0, 0));
+        for (i=0; i<200; i++) {
+            memset(&key, 0, sizeof(key));
+            memset(&rec, 0, sizeof(rec));
+            memset(buffer, (char)i, sizeof(buffer));
+            key.data=&i;
+            key.size=sizeof(i);
+            rec.data=buffer;
+            rec.size=(i%10==0) ? sizeof(buffer)-i : i+1;
+            BFC_ASSERT_EQUAL(0, ham_insert(db, 0, &key, &rec, 0));
+        }
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+
+        BFC_ASSERT_EQUAL(0, ham_env_open(m_env, BFC_OPATH(".test"), flags));
+        BFC_ASSERT_EQUAL(HAM_ACCESS_DENIED,
+                ham_env_enable_encryption(m_env, aeskey2,
+                    HAM_ENCRYPTION_XTS));
+        /* the ECB mode can not decrypt the file */
+        BFC_ASSERT_EQUAL(HAM_ACCESS_DENIED,
+                ham_env_enable_encryption(m_env, aeskey, 0));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_enable_encryption(m_env, aeskey, HAM_ENCRYPTION_XTS));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(m_env, db, 333, 0, 0));
+        for (i=0; i<200; i++) {
+            memset(&key, 0, sizeof(key));
+            memset(&rec, 0, sizeof(rec));
+            key.data=&i;
+            key.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0, ham_find(db, 0, &key, &rec, 0));
+            BFC_ASSERT_EQUAL((ham_size_t)((i%10==0) ? sizeof(buffer)-i : i+1),
+                    rec.size);
+            memset(buffer, (char)i, rec.size);
+            BFC_ASSERT_EQUAL(0, memcmp(buffer, rec.data, rec.size));
+        }
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+
+        BFC_ASSERT_EQUAL(0, ham_env_delete(m_env));
+        BFC_ASSERT_EQUAL(0, ham_delete(db));
+        m_env=0;
+#endif
+    }
+
+    void xtsFilterTest()
+    {
+        xtsFilter(0);
+    }
+
+    void xtsFilterNoMmapTest()
+    {
+        xtsFilter(HAM_DISABLE_MMAP);
+    }
+
+    void xtsChecksumFilterTest()
+    {
+        xtsFilter(HAM_ENABLE_CRC32);
+    }
+
+    void xtsTwiceFilterTest()
+    {
+#ifndef HAM_DISABLE_ENCRYPTION
+        ham_u8_t aeskey[16]={0x13};
+
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create(m_env, BFC_OPATH(".test"), 0, 0664));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_enable_encryption(m_env, aeskey, HAM_ENCRYPTION_XTS));
+        BFC_ASSERT_EQUAL(HAM_ALREADY_INITIALIZED,
+                ham_env_enable_encryption(m_env, aeskey, HAM_ENCRYPTION_XTS));
+        BFC_ASSERT_EQUAL(HAM_ALREADY_INITIALIZED,
+                ham_env_enable_encryption(m_env, aeskey, 0));
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, 0));
+        BFC_ASSERT_EQUAL(0, ham_env_delete(m_env));
+        m_env=0;
+#endif
+    }
+
     void zlibFilterTest()
     {
 #ifndef HAM_DISABLE_COMPRESSION
@@ -705,6 +897,158 @@ public:
 #endif
     }
 
+    void pageCompressorTest()
+    {
+#ifndef HAM_DISABLE_COMPRESSION
+        const ham_size_t pagesize=1024*16;
+        std::vector<ham_u8_t> page(pagesize), image(pagesize), copy(pagesize);
+        PageCompressor compressor(pagesize);
+
+        for (ham_size_t i=0; i<pagesize; i++)
+            page[i]=(ham_u8_t)((i/64)%7);
+        *(ham_u32_t *)&page[0]=ham_h2db32(Page::TYPE_B_INDEX);
+        BFC_ASSERT(!PageCompressor::is_compressed(&page[0]));
+
+        ham_size_t size=compressor.compress(&page[0], &image[0], 1);
+        BFC_ASSERT(size>0);
+        BFC_ASSERT(size<pagesize/2);
+        BFC_ASSERT_EQUAL(0u, size%PageCompressor::ALIGNMENT);
+        BFC_ASSERT(PageCompressor::is_compressed(&image[0]));
+        BFC_ASSERT_EQUAL(0, compressor.decompress(&image[0], &copy[0]));
+        BFC_ASSERT_EQUAL(0, memcmp(&page[0], &copy[0], pagesize));
+
+        /* a different level produces the same page */
+        size=compressor.compress(&page[0], &image[0], 9);
+        BFC_ASSERT(size>0);
+        BFC_ASSERT_EQUAL(0, compressor.decompress(&image[0], &copy[0]));
+        BFC_ASSERT_EQUAL(0, memcmp(&page[0], &copy[0], pagesize));
+
+        /* a corrupt image is detected */
+        image[PageCompressor::HEADER_SIZE]^=0xff;
+        image[PageCompressor::HEADER_SIZE+1]^=0xff;
+        BFC_ASSERT_EQUAL(HAM_INTEGRITY_VIOLATED,
+                compressor.decompress(&image[0], &copy[0]));
+
+        /* random data is not compressible */
+        for (ham_size_t i=12; i<pagesize; i++)
+            page[i]=(ham_u8_t)(rand()>>7);
+        BFC_ASSERT_EQUAL(0u, compressor.compress(&page[0], &image[0], 6));
+#endif
+    }
+
+    void pageCompression(ham_u32_t flags, bool xts)
+    {
+#ifndef HAM_DISABLE_COMPRESSION
+        ham_db_t *db;
+        ham_key_t key;
+        ham_record_t rec;
+        ham_u8_t aeskey[16]={0x13};
+        ham_env_metrics_t metrics;
+        char buffer[32];
+        int i;
+
+        (void)aeskey;
+        BFC_ASSERT_EQUAL(0, ham_new(&db));
+        BFC_ASSERT_EQUAL(0, ham_env_create(m_env, BFC_OPATH(".test"),
+                    flags|HAM_ENABLE_METRICS, 0664));
+        if (xts)
+            BFC_ASSERT_EQUAL(0, ham_env_enable_encryption(m_env, aeskey,
+                        HAM_ENCRYPTION_XTS));
+        BFC_ASSERT_EQUAL(0, ham_env_create_db(m_env, db, 333, 0, 0));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_enable_compression(db, 10, HAM_COMPRESS_PAGES));
+        BFC_ASSERT_EQUAL(0, ham_enable_compression(db, 0, HAM_COMPRESS_PAGES));
+        for (i=0; i<5000; i++) {
+            memset(&key, 0, sizeof(key));
+            memset(&rec, 0, sizeof(rec));
+            sprintf(buffer, "key%08d", i);
+            key.data=buffer;
+            key.size=(ham_u16_t)strlen(buffer)+1;
+            rec.data=&i;
+            rec.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0, ham_insert(db, 0, &key, &rec, 0));
+        }
+        if (!xts)
+            BFC_ASSERT_EQUAL(0, ham_check_integrity(db, 0));
+        BFC_ASSERT_EQUAL(0, ham_env_flush(m_env, 0));
+        BFC_ASSERT_EQUAL(0, ham_env_get_metrics(m_env, &metrics, 0));
+        BFC_ASSERT(metrics.compressed_pages>0);
+        BFC_ASSERT(metrics.compression_bytes_in>metrics.compression_bytes_out);
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+
+        /* compressed pages are read even if the compression is disabled */
+        BFC_ASSERT_EQUAL(0, ham_env_open(m_env, BFC_OPATH(".test"), flags));
+        if (xts)
+            BFC_ASSERT_EQUAL(0, ham_env_enable_encryption(m_env, aeskey,
+                        HAM_ENCRYPTION_XTS));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(m_env, db, 333, 0, 0));
+        for (i=0; i<5000; i++) {
+            memset(&key, 0, sizeof(key));
+            memset(&rec, 0, sizeof(rec));
+            sprintf(buffer, "key%08d", i);
+            key.data=buffer;
+            key.size=(ham_u16_t)strlen(buffer)+1;
+            BFC_ASSERT_EQUAL(0, ham_find(db, 0, &key, &rec, 0));
+            BFC_ASSERT_EQUAL((ham_size_t)sizeof(i), rec.size);
+            BFC_ASSERT_EQUAL(i, *(int *)rec.data);
+            /* erase some keys; the modified pages are now written
+             * uncompressed */
+            if (i%3==0)
+                BFC_ASSERT_EQUAL(0, ham_erase(db, 0, &key, 0));
+        }
+        if (!xts)
+            BFC_ASSERT_EQUAL(0, ham_check_integrity(db, 0));
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+
+        BFC_ASSERT_EQUAL(0, ham_env_open(m_env, BFC_OPATH(".test"), flags));
+        if (xts)
+            BFC_ASSERT_EQUAL(0, ham_env_enable_encryption(m_env, aeskey,
+                        HAM_ENCRYPTION_XTS));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(m_env, db, 333, 0, 0));
+        for (i=0; i<5000; i++) {
+            memset(&key, 0, sizeof(key));
+            memset(&rec, 0, sizeof(rec));
+            sprintf(buffer, "key%08d", i);
+            key.data=buffer;
+            key.size=(ham_u16_t)strlen(buffer)+1;
+            BFC_ASSERT_EQUAL(i%3==0 ? HAM_KEY_NOT_FOUND : 0,
+                    ham_find(db, 0, &key, &rec, 0));
+        }
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+
+        BFC_ASSERT_EQUAL(0, ham_env_delete(m_env));
+        BFC_ASSERT_EQUAL(0, ham_delete(db));
+        m_env=0;
+#endif
+    }
+
+    void pageCompressionTest()
+    {
+        pageCompression(0, false);
+    }
+
+    void pageCompressionNoMmapTest()
+    {
+        pageCompression(HAM_DISABLE_MMAP|HAM_ENABLE_CRC32, false);
+    }
+
+    void pageCompressionXtsTest()
+    {
+#ifndef HAM_DISABLE_ENCRYPTION
+        pageCompression(HAM_ENABLE_CRC32, true);
+#endif
+    }
+
+    void pageCompressionInMemoryTest()
+    {
+#ifndef HAM_DISABLE_COMPRESSION
+        BFC_ASSERT_EQUAL(0, ham_create(m_db, 0, HAM_IN_MEMORY_DB, 0));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_enable_compression(m_db, 0, HAM_COMPRESS_PAGES));
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+#endif
+    }
+
 };
 
 BFC_REGISTER_FIXTURE(FilterTest);
@@ -14,10 +14,13 @@
 #include <stdexcept>
 
 #include <ham/hamsterdb.h>
+#include <ham/hamsterdb_int.h>
 
 #include "../src/db.h"
+#include "../src/device.h"
 #include "../src/page.h"
 #include "../src/freelist.h"
+#include "../src/freelist_extents.h"
 #include "../src/env.h"
 
 #include "bfc-testsuite.hpp"
@@ -30,16 +33,19 @@ class FreelistBaseTest : public hamsterDB_fixture
     define_super(hamsterDB_fixture);
 
 public:
-    FreelistBaseTest(const char *name, unsigned pagesize=4096)
+    FreelistBaseTest(const char *name, unsigned pagesize=4096,
+            ham_u32_t flags=0)
     :   hamsterDB_fixture(name)
     {
         m_pagesize=pagesize;
+        m_flags=flags;
     }
 
 protected:
     ham_db_t *m_db;
     ham_env_t *m_env;
     ham_u32_t m_pagesize;
+    ham_u32_t m_flags;
 
 public:
 
@@ -62,7 +68,7 @@ public:
         BFC_ASSERT_EQUAL(0, ham_new(&m_db));
         BFC_ASSERT_EQUAL(0,
                 ham_create_ex(m_db, BFC_OPATH(".test"),
-                    HAM_ENABLE_TRANSACTIONS, 0644, &p[0]));
+                    HAM_ENABLE_TRANSACTIONS|m_flags, 0644, &p[0]));
         m_env=ham_get_env(m_db);
     }
     
@@ -451,6 +457,57 @@ public:
         BFC_ASSERT_EQUAL(0, ham_txn_commit(txn, 0));
     }
 
+    void lazyLoadTest(void)
+    {
+        ham_offset_t addr;
+        Environment *env=(Environment *)m_env;
+        ham_size_t ps=env->get_pagesize();
+        /* these addresses are covered by the 4th and the 8th freelist page */
+        ham_offset_t high1=(ham_offset_t)ps*DB_CHUNKSIZE*8*3;
+        ham_offset_t high2=(ham_offset_t)ps*DB_CHUNKSIZE*8*7;
+
+        BFC_ASSERT_EQUAL(0,
+                freel_mark_free(env, (Database *)m_db, high1, ps, HAM_FALSE));
+        BFC_ASSERT_EQUAL(0,
+                freel_mark_free(env, (Database *)m_db, high2, ps, HAM_FALSE));
+        env->get_changeset().clear();
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        BFC_ASSERT_EQUAL(0, open(HAM_ENABLE_TRANSACTIONS));
+        env=(Environment *)m_env;
+
+        /* only the header page is loaded */
+        BFC_ASSERT_EQUAL(0,
+                freel_check_area_is_allocated(env, (Database *)m_db,
+                    ps*3, DB_CHUNKSIZE));
+        freelist_cache_t *cache=env->get_device()->get_freelist_cache();
+        BFC_ASSERT(cache!=0);
+        BFC_ASSERT_EQUAL(1u, freel_cache_get_count(cache));
+        BFC_ASSERT(freel_cache_get_next_page(cache)!=0);
+
+        /* the pages are loaded till a page with free space is found */
+        BFC_ASSERT_EQUAL(0,
+                freel_alloc_page(&addr, env, (Database *)m_db));
+        BFC_ASSERT_EQUAL(high1, addr);
+        BFC_ASSERT(freel_cache_get_count(cache)<8u);
+        BFC_ASSERT(freel_cache_get_next_page(cache)!=0);
+
+        /* the last page is loaded if the search fails, or if it has
+         * enough free space */
+        BFC_ASSERT_EQUAL(0,
+                freel_alloc_page(&addr, env, (Database *)m_db));
+        BFC_ASSERT_EQUAL((ham_offset_t)0, freel_cache_get_next_page(cache));
+
+        /* freeing an area loads the pages which cover it */
+        env->get_changeset().clear();
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        BFC_ASSERT_EQUAL(0, open(HAM_ENABLE_TRANSACTIONS));
+        env=(Environment *)m_env;
+        BFC_ASSERT_EQUAL(0,
+                freel_mark_free(env, (Database *)m_db, high2, ps, HAM_FALSE));
+        cache=env->get_device()->get_freelist_cache();
+        BFC_ASSERT(freel_cache_get_count(cache)>=8u);
+    }
+
     // using a function to compare the constants is easier for debugging
     bool compare_sizes(size_t a, size_t b)
     {
@@ -500,6 +557,7 @@ public:
         BFC_REGISTER_TEST(FreelistV1Test, markAllocOverflow4Test);
         BFC_REGISTER_TEST(FreelistV1Test, markAllocAlignTest);
         BFC_REGISTER_TEST(FreelistV1Test, markAllocAlignMultipleTest);
+        BFC_REGISTER_TEST(FreelistV1Test, lazyLoadTest);
     }
 
     virtual void setup()
@@ -544,9 +602,308 @@ public:
         BFC_REGISTER_TEST(FreelistV2Test, markAllocOverflow4Test);
         BFC_REGISTER_TEST(FreelistV2Test, markAllocAlignTest);
         BFC_REGISTER_TEST(FreelistV2Test, markAllocAlignMultipleTest);
+        BFC_REGISTER_TEST(FreelistV2Test, lazyLoadTest);
+    }
+};
+
+class FreelistExtentsTest : public FreelistBaseTest
+{
+    define_super(FreelistBaseTest);
+
+public:
+    FreelistExtentsTest()
+    :   FreelistBaseTest("FreelistExtentsTest", 4096,
+                HAM_ENABLE_FREELIST_EXTENTS)
+    {
+        testrunner::get_instance()->register_fixture(this);
+        BFC_REGISTER_TEST(FreelistExtentsTest, markAllocAlignedTest);
+        BFC_REGISTER_TEST(FreelistExtentsTest, markAllocOverflow3Test);
+        BFC_REGISTER_TEST(FreelistExtentsTest, markAllocAlignTest);
+        BFC_REGISTER_TEST(FreelistExtentsTest, markAllocAlignMultipleTest);
+        BFC_REGISTER_TEST(FreelistExtentsTest, extentMapTest);
+        BFC_REGISTER_TEST(FreelistExtentsTest, encodeTest);
+        BFC_REGISTER_TEST(FreelistExtentsTest, bestFitTest);
+        BFC_REGISTER_TEST(FreelistExtentsTest, claimTest);
+        BFC_REGISTER_TEST(FreelistExtentsTest, persistTest);
+        BFC_REGISTER_TEST(FreelistExtentsTest, migrateTest);
+        BFC_REGISTER_TEST(FreelistExtentsTest, invalidFlagsTest);
+        BFC_REGISTER_TEST(FreelistExtentsTest, reuseTest);
+    }
+
+    Environment *env() {
+        return ((Environment *)m_env);
+    }
+
+    void reopen(ham_u32_t flags) {
+        env()->get_changeset().clear();
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        BFC_ASSERT_EQUAL(0, open(HAM_ENABLE_TRANSACTIONS|flags));
+    }
+
+    ham_offset_t alloc(ham_size_t size) {
+        ham_offset_t o;
+        BFC_ASSERT_EQUAL(0, freel_alloc_area(&o, env(), (Database *)m_db,
+                    size));
+        return (o);
+    }
+
+    void extentMapTest(void)
+    {
+        FreelistExtents e;
+
+        /* neighbours are coalesced */
+        e.add(1000, 100);
+        e.add(1200, 100);
+        BFC_ASSERT_EQUAL((size_t)2, e.get_extents().size());
+        e.add(1100, 100);
+        BFC_ASSERT_EQUAL((size_t)1, e.get_extents().size());
+        BFC_ASSERT_EQUAL((ham_offset_t)300, e.get_extents().find(1000)->second);
+
+        /* overlapping areas are merged */
+        e.add(1250, 200);
+        e.add(900, 150);
+        BFC_ASSERT_EQUAL((size_t)1, e.get_extents().size());
+        BFC_ASSERT_EQUAL((ham_offset_t)550, e.get_extents().find(900)->second);
+        BFC_ASSERT(e.is_free(1449, 1));
+        BFC_ASSERT(!e.is_free(1450, 10));
+        BFC_ASSERT(!e.is_free(800, 100));
+        BFC_ASSERT(e.is_free(800, 101));
+
+        /* an allocation splits the extent */
+        BFC_ASSERT_EQUAL((ham_offset_t)900, e.alloc(50, 0, 0));
+        BFC_ASSERT_EQUAL((ham_offset_t)1024, e.alloc(100, 512, 0));
+        BFC_ASSERT_EQUAL((size_t)2, e.get_extents().size());
+        BFC_ASSERT_EQUAL((ham_offset_t)74, e.get_extents().find(950)->second);
+        BFC_ASSERT_EQUAL((ham_offset_t)326, e.get_extents().find(1124)->second);
+        BFC_ASSERT_EQUAL((ham_offset_t)1300, e.alloc(10, 0, 1300));
+        BFC_ASSERT_EQUAL((ham_offset_t)0, e.alloc(1000, 0, 0));
+        BFC_ASSERT_EQUAL((ham_offset_t)0, e.alloc(10, 0, 2000));
+
+        e.clear();
+        BFC_ASSERT(e.get_extents().empty());
+        BFC_ASSERT_EQUAL((ham_offset_t)0, e.alloc(10, 0, 0));
+    }
+
+    void encodeTest(void)
+    {
+        ham_u8_t buffer[FreelistExtents::MAX_ENCODED_SIZE];
+        ham_offset_t a, s;
+        ham_offset_t big=(ham_offset_t)1024*1024*1024*1024;
+
+        ham_size_t n=FreelistExtents::encode(buffer, 0, 4096, 32);
+        BFC_ASSERT_EQUAL((ham_size_t)3, n);
+        BFC_ASSERT_EQUAL(n, FreelistExtents::decode(buffer, n, 0, &a, &s));
+        BFC_ASSERT_EQUAL((ham_offset_t)4096, a);
+        BFC_ASSERT_EQUAL((ham_offset_t)32, s);
+
+        n=FreelistExtents::encode(buffer, 4096, big, big*3);
+        BFC_ASSERT(n<=(ham_size_t)FreelistExtents::MAX_ENCODED_SIZE);
+        BFC_ASSERT_EQUAL(n, FreelistExtents::decode(buffer, n, 4096, &a, &s));
+        BFC_ASSERT_EQUAL(big, a);
+        BFC_ASSERT_EQUAL(big*3, s);
+
+        /* truncated data is rejected */
+        BFC_ASSERT_EQUAL((ham_size_t)0,
+                FreelistExtents::decode(buffer, n-1, 4096, &a, &s));
+    }
+
+    void bestFitTest(void)
+    {
+        ham_size_t ps=env()->get_pagesize();
+
+        BFC_ASSERT_EQUAL(0, freel_mark_free(env(), (Database *)m_db,
+                    ps, DB_CHUNKSIZE*10, HAM_FALSE));
+        BFC_ASSERT_EQUAL(0, freel_mark_free(env(), (Database *)m_db,
+                    ps*2, DB_CHUNKSIZE*3, HAM_FALSE));
+        BFC_ASSERT_EQUAL(0, freel_mark_free(env(), (Database *)m_db,
+                    ps*3, DB_CHUNKSIZE*5, HAM_FALSE));
+
+        /* the smallest extent which fits is used */
+        BFC_ASSERT_EQUAL((ham_offset_t)ps*2, alloc(DB_CHUNKSIZE*3));
+        BFC_ASSERT_EQUAL((ham_offset_t)ps*3, alloc(DB_CHUNKSIZE*4));
+        BFC_ASSERT_EQUAL((ham_offset_t)ps*3+DB_CHUNKSIZE*4,
+                alloc(DB_CHUNKSIZE));
+        BFC_ASSERT_EQUAL((ham_offset_t)ps, alloc(DB_CHUNKSIZE*2));
+
+        /* freed neighbours are coalesced */
+        BFC_ASSERT_EQUAL(0, freel_mark_free(env(), (Database *)m_db,
+                    ps, DB_CHUNKSIZE*2, HAM_FALSE));
+        BFC_ASSERT_EQUAL((ham_offset_t)ps, alloc(DB_CHUNKSIZE*10));
+        BFC_ASSERT_EQUAL((ham_offset_t)0, alloc(DB_CHUNKSIZE));
+    }
+
+    void claimTest(void)
+    {
+        ham_size_t ps=env()->get_pagesize();
+
+        BFC_ASSERT_EQUAL(0, freel_mark_free(env(), (Database *)m_db,
+                    ps, ps*4, HAM_FALSE));
+        BFC_ASSERT_EQUAL(0, freel_claim_area(env(), (Database *)m_db,
+                    ps*2, ps));
+        BFC_ASSERT_EQUAL(0, freel_claim_area(env(), (Database *)m_db,
+                    ps*4, ps*10));
+
+        ham_offset_t o;
+        BFC_ASSERT_EQUAL(0, freel_alloc_page(&o, env(), (Database *)m_db));
+        BFC_ASSERT_EQUAL((ham_offset_t)ps, o);
+        BFC_ASSERT_EQUAL(0, freel_alloc_page(&o, env(), (Database *)m_db));
+        BFC_ASSERT_EQUAL((ham_offset_t)ps*3, o);
+        BFC_ASSERT_EQUAL(0, freel_alloc_page(&o, env(), (Database *)m_db));
+        BFC_ASSERT_EQUAL((ham_offset_t)0, o);
+    }
+
+    void persistTest(void)
+    {
+        ham_size_t ps=env()->get_pagesize();
+        ham_offset_t base=(ham_offset_t)ps*10;
+        const int count=3000;
+
+        /* every other chunk is free; the extents do not fit into the
+         * header page */
+        for (int i=0; i<count; i++) {
+            BFC_ASSERT_EQUAL(0, freel_mark_free(env(), (Database *)m_db,
+                    base+(ham_offset_t)i*DB_CHUNKSIZE*2, DB_CHUNKSIZE,
+                    HAM_FALSE));
+        }
+
+        reopen(0);
+        BFC_ASSERT_EQUAL((ham_u16_t)FREELIST_FORMAT_EXTENTS,
+                env()->get_freelist_format());
+        BFC_ASSERT(freel_get_overflow(env()->get_freelist())!=0);
+        /* the extents were invalidated when the file was opened */
+        BFC_ASSERT_EQUAL((ham_u32_t)0,
+                ((freelist_extents_payload_t *)env()->get_freelist())->_magic);
+
+        for (int i=0; i<count/2; i++)
+            BFC_ASSERT_EQUAL(base+(ham_offset_t)i*DB_CHUNKSIZE*2,
+                    alloc(DB_CHUNKSIZE));
+
+        /* the list becomes shorter */
+        reopen(0);
+        for (int i=count/2; i<count; i++)
+            BFC_ASSERT_EQUAL(base+(ham_offset_t)i*DB_CHUNKSIZE*2,
+                    alloc(DB_CHUNKSIZE));
+        BFC_ASSERT_EQUAL((ham_offset_t)0, alloc(DB_CHUNKSIZE));
+
+        reopen(0);
+        BFC_ASSERT_EQUAL((ham_offset_t)0, alloc(DB_CHUNKSIZE));
+    }
+
+    void migrateTest(void)
+    {
+        ham_parameter_t p[]={
+            {HAM_PARAM_PAGESIZE, m_pagesize},
+            {0, 0}};
+        ham_size_t ps=env()->get_pagesize();
+        /* an address which is not covered by the first freelist page */
+        ham_offset_t high=(env()->get_usable_pagesize()*8*DB_CHUNKSIZE*2
+                /ps+1)*ps;
+
+        /* create a file with a bitmap freelist */
+        env()->get_changeset().clear();
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        BFC_ASSERT_EQUAL(0, ham_create_ex(m_db, BFC_OPATH(".test"),
+                    HAM_ENABLE_TRANSACTIONS, 0644, &p[0]));
+        m_env=ham_get_env(m_db);
+        BFC_ASSERT_EQUAL((ham_u16_t)FREELIST_FORMAT_BITMAP,
+                env()->get_freelist_format());
+
+        BFC_ASSERT_EQUAL(0, freel_mark_free(env(), (Database *)m_db,
+                    ps, DB_CHUNKSIZE*3, HAM_FALSE));
+        BFC_ASSERT_EQUAL(0, freel_mark_free(env(), (Database *)m_db,
+                    high, ps*2, HAM_FALSE));
+        reopen(0);
+        BFC_ASSERT_EQUAL((ham_u16_t)FREELIST_FORMAT_BITMAP,
+                env()->get_freelist_format());
+
+        /* migrate the bitmaps */
+        reopen(HAM_ENABLE_FREELIST_EXTENTS);
+        BFC_ASSERT_EQUAL((ham_u16_t)FREELIST_FORMAT_EXTENTS,
+                env()->get_freelist_format());
+        BFC_ASSERT_EQUAL((ham_offset_t)ps, alloc(DB_CHUNKSIZE*2));
+
+        /* the format is persistent */
+        reopen(0);
+        BFC_ASSERT_EQUAL((ham_u16_t)FREELIST_FORMAT_EXTENTS,
+                env()->get_freelist_format());
+        BFC_ASSERT_EQUAL((ham_offset_t)ps+DB_CHUNKSIZE*2,
+                alloc(DB_CHUNKSIZE));
+        ham_offset_t o;
+        BFC_ASSERT_EQUAL(0, freel_alloc_page(&o, env(), (Database *)m_db));
+        BFC_ASSERT_EQUAL(high, o);
+        BFC_ASSERT_EQUAL(0, freel_alloc_page(&o, env(), (Database *)m_db));
+        BFC_ASSERT_EQUAL(high+ps, o);
+        BFC_ASSERT_EQUAL((ham_offset_t)0, alloc(DB_CHUNKSIZE));
+    }
+
+    void invalidFlagsTest(void)
+    {
+        ham_db_t *db;
+        BFC_ASSERT_EQUAL(0, ham_new(&db));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_create_ex(db, 0,
+                    HAM_IN_MEMORY_DB|HAM_ENABLE_FREELIST_EXTENTS, 0644, 0));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_open_ex(db, BFC_OPATH(".test"),
+                    HAM_READ_ONLY|HAM_ENABLE_FREELIST_EXTENTS, 0));
+        ham_delete(db);
+    }
+
+    void reuseTest(void)
+    {
+        ham_key_t key;
+        ham_record_t rec;
+        char buffer[1000];
+        ham_offset_t filesize1, filesize2;
+
+        memset(buffer, 0, sizeof(buffer));
+        memset(&key, 0, sizeof(key));
+        memset(&rec, 0, sizeof(rec));
+
+        /* the keys fit into the root page, therefore the btree does not
+         * allocate pages */
+        for (int i=0; i<50; i++) {
+            key.data=&i;
+            key.size=sizeof(i);
+            rec.data=buffer;
+            rec.size=500+i;
+            BFC_ASSERT_EQUAL(0, ham_insert(m_db, 0, &key, &rec, 0));
+        }
+        for (int i=0; i<50; i+=2) {
+            key.data=&i;
+            key.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0, ham_erase(m_db, 0, &key, 0));
+        }
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+        reopen(0);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+        BFC_ASSERT_EQUAL(0, env()->get_device()->get_filesize(&filesize1));
+
+        /* the erased records are replaced with smaller records, which
+         * fit into the free extents */
+        for (int i=0; i<50; i+=2) {
+            key.data=&i;
+            key.size=sizeof(i);
+            rec.data=buffer;
+            rec.size=500;
+            BFC_ASSERT_EQUAL(0, ham_insert(m_db, 0, &key, &rec, 0));
+        }
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+        BFC_ASSERT_EQUAL(0, env()->get_device()->get_filesize(&filesize2));
+        BFC_ASSERT_EQUAL(filesize1, filesize2);
+
+        reopen(0);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+        for (int i=0; i<50; i++) {
+            key.data=&i;
+            key.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0, ham_find(m_db, 0, &key, &rec, 0));
+            BFC_ASSERT_EQUAL((ham_size_t)(i&1 ? 500+i : 500), rec.size);
+        }
     }
 };
 
 BFC_REGISTER_FIXTURE(FreelistV1Test);
 BFC_REGISTER_FIXTURE(FreelistV2Test);
+BFC_REGISTER_FIXTURE(FreelistExtentsTest);
 
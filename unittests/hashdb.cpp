@@ -0,0 +1,462 @@
+/**
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+#include "../src/config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <ham/hamsterdb.h>
+#include <ham/hamsterdb_int.h>
+#include "../src/backend.h"
+#include "../src/db.h"
+#include "../src/hashdb.h"
+
+#include "bfc-testsuite.hpp"
+#include "hamster_fixture.hpp"
+#include "os.hpp"
+
+using namespace bfc;
+
+#define KEYS        3000
+
+class HashTest : public hamsterDB_fixture
+{
+    define_super(hamsterDB_fixture);
+
+public:
+    HashTest(ham_u32_t flags=0, const char *name="HashTest")
+    :   hamsterDB_fixture(name), m_db(0), m_env(0), m_flags(flags)
+    {
+        testrunner::get_instance()->register_fixture(this);
+        BFC_REGISTER_TEST(HashTest, invalidFlagsTest);
+        BFC_REGISTER_TEST(HashTest, insertFindTest);
+        BFC_REGISTER_TEST(HashTest, overwriteTest);
+        BFC_REGISTER_TEST(HashTest, eraseTest);
+        BFC_REGISTER_TEST(HashTest, extendedKeyTest);
+        BFC_REGISTER_TEST(HashTest, reopenTest);
+        BFC_REGISTER_TEST(HashTest, cursorTest);
+        BFC_REGISTER_TEST(HashTest, eraseRangeTest);
+    }
+
+protected:
+    ham_db_t *m_db;
+    ham_env_t *m_env;
+    ham_u32_t m_flags;
+
+public:
+    virtual void setup()
+    {
+        __super::setup();
+
+        os::unlink(BFC_OPATH(".test"));
+        BFC_ASSERT_EQUAL(0, ham_new(&m_db));
+        BFC_ASSERT_EQUAL(0, ham_env_new(&m_env));
+    }
+
+    virtual void teardown()
+    {
+        __super::teardown();
+
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+        ham_delete(m_db);
+        ham_env_delete(m_env);
+        m_db=0;
+        m_env=0;
+    }
+
+    /* a small pagesize creates many buckets and overflow pages */
+    void create(ham_u16_t keysize=16)
+    {
+        ham_parameter_t env_params[]={
+            { HAM_PARAM_PAGESIZE, 1024 },
+            { 0, 0 }
+        };
+        ham_parameter_t db_params[]={
+            { HAM_PARAM_KEYSIZE, keysize },
+            { 0, 0 }
+        };
+
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create_ex(m_env, (m_flags&HAM_IN_MEMORY_DB)
+                        ? 0
+                        : BFC_OPATH(".test"), m_flags, 0644, env_params));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create_db(m_env, m_db, 1, HAM_USE_HASH, db_params));
+    }
+
+    void reopen()
+    {
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_open(m_env, BFC_OPATH(".test"), m_flags));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(m_env, m_db, 1, 0, 0));
+    }
+
+    HashBackend *backend()
+    {
+        return ((HashBackend *)((Database *)m_db)->get_backend());
+    }
+
+    void make_key(int i, char *buffer, ham_key_t *key, int size=0)
+    {
+        memset(key, 0, sizeof(*key));
+        memset(buffer, 'x', size);
+        sprintf(buffer+(size ? size-12 : 0), "key%08d", i);
+        key->data=buffer;
+        key->size=size ? size : (ham_size_t)strlen(buffer)+1;
+    }
+
+    void insert(int from, int to, int size=0)
+    {
+        char buffer[256];
+        ham_key_t key;
+        ham_record_t rec;
+
+        for (int i=from; i<to; i++) {
+            make_key(i, buffer, &key, size);
+            memset(&rec, 0, sizeof(rec));
+            rec.data=&i;
+            rec.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0, ham_insert(m_db, 0, &key, &rec, 0));
+        }
+    }
+
+    void verify(int from, int to, bool exists, int size=0)
+    {
+        char buffer[256];
+        ham_key_t key;
+        ham_record_t rec;
+
+        for (int i=from; i<to; i++) {
+            make_key(i, buffer, &key, size);
+            memset(&rec, 0, sizeof(rec));
+            if (exists) {
+                BFC_ASSERT_EQUAL(0, ham_find(m_db, 0, &key, &rec, 0));
+                BFC_ASSERT_EQUAL((ham_size_t)sizeof(i), rec.size);
+                BFC_ASSERT_EQUAL(i, *(int *)rec.data);
+            }
+            else
+                BFC_ASSERT_EQUAL(HAM_KEY_NOT_FOUND,
+                        ham_find(m_db, 0, &key, &rec, 0));
+        }
+    }
+
+    void invalidFlagsTest()
+    {
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create(m_env, (m_flags&HAM_IN_MEMORY_DB)
+                        ? 0
+                        : BFC_OPATH(".test"), m_flags, 0644));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_create_db(m_env, m_db, 1,
+                        HAM_USE_HASH|HAM_ENABLE_DUPLICATES, 0));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_create_db(m_env, m_db, 1,
+                        HAM_USE_HASH|HAM_RECORD_NUMBER, 0));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_create_db(m_env, m_db, 1,
+                        HAM_USE_HASH|HAM_USE_BTREE, 0));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create_db(m_env, m_db, 1, HAM_USE_HASH, 0));
+        BFC_ASSERT(((Database *)m_db)->get_rt_flags()&HAM_USE_HASH);
+        if (m_flags&HAM_IN_MEMORY_DB)
+            return;
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_open_db(m_env, m_db, 1, HAM_USE_HASH, 0));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(m_env, m_db, 1, 0, 0));
+        BFC_ASSERT(((Database *)m_db)->get_rt_flags()&HAM_USE_HASH);
+    }
+
+    void insertFindTest()
+    {
+        ham_u64_t count;
+        char buffer[32];
+        ham_key_t key;
+        ham_record_t rec;
+
+        create();
+        insert(0, KEYS*4);
+        verify(0, KEYS*4, true);
+        verify(KEYS*4, KEYS*5, false);
+
+        /* the table was split; the directory spans more than one page */
+        BFC_ASSERT(backend()->get_bucket_count()>128);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+        BFC_ASSERT_EQUAL(0, ham_get_key_count(m_db, 0, 0, &count));
+        BFC_ASSERT_EQUAL((ham_u64_t)KEYS*4, count);
+
+        /* approximate matching is not supported */
+        make_key(1, buffer, &key);
+        memset(&rec, 0, sizeof(rec));
+        BFC_ASSERT_EQUAL(HAM_NOT_IMPLEMENTED,
+                ham_find(m_db, 0, &key, &rec, HAM_FIND_LT_MATCH));
+    }
+
+    void overwriteTest()
+    {
+        char buffer[32];
+        ham_key_t key;
+        ham_record_t rec;
+        char data[100];
+
+        create();
+        insert(0, 100);
+
+        make_key(7, buffer, &key);
+        memset(&rec, 0, sizeof(rec));
+        BFC_ASSERT_EQUAL(HAM_DUPLICATE_KEY,
+                ham_insert(m_db, 0, &key, &rec, 0));
+
+        memset(data, 'a', sizeof(data));
+        rec.data=data;
+        rec.size=sizeof(data);
+        BFC_ASSERT_EQUAL(0, ham_insert(m_db, 0, &key, &rec, HAM_OVERWRITE));
+
+        memset(&rec, 0, sizeof(rec));
+        BFC_ASSERT_EQUAL(0, ham_find(m_db, 0, &key, &rec, 0));
+        BFC_ASSERT_EQUAL((ham_size_t)sizeof(data), rec.size);
+        BFC_ASSERT_EQUAL(0, memcmp(data, rec.data, sizeof(data)));
+
+        verify(0, 7, true);
+        verify(8, 100, true);
+    }
+
+    void eraseTest()
+    {
+        ham_u64_t count;
+        char buffer[32];
+        ham_key_t key;
+        ham_record_t rec;
+
+        create();
+        insert(0, KEYS);
+        for (int i=0; i<KEYS; i+=2) {
+            make_key(i, buffer, &key);
+            BFC_ASSERT_EQUAL(0, ham_erase(m_db, 0, &key, 0));
+        }
+        make_key(0, buffer, &key);
+        BFC_ASSERT_EQUAL(HAM_KEY_NOT_FOUND, ham_erase(m_db, 0, &key, 0));
+
+        for (int i=0; i<KEYS; i++) {
+            make_key(i, buffer, &key);
+            memset(&rec, 0, sizeof(rec));
+            BFC_ASSERT_EQUAL((i&1) ? 0 : HAM_KEY_NOT_FOUND,
+                    ham_find(m_db, 0, &key, &rec, 0));
+        }
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+        BFC_ASSERT_EQUAL(0, ham_get_key_count(m_db, 0, 0, &count));
+        BFC_ASSERT_EQUAL((ham_u64_t)KEYS/2, count);
+
+        /* the erased keys can be inserted again */
+        for (int i=0; i<KEYS; i+=2) {
+            make_key(i, buffer, &key);
+            memset(&rec, 0, sizeof(rec));
+            rec.data=&i;
+            rec.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0, ham_insert(m_db, 0, &key, &rec, 0));
+        }
+        verify(0, KEYS, true);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+
+    void extendedKeyTest()
+    {
+        char buffer[256];
+        ham_key_t key;
+        ham_record_t rec;
+
+        create(16);
+        insert(0, 500, 100);
+        verify(0, 500, true, 100);
+        verify(500, 600, false, 100);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+
+        for (int i=0; i<500; i+=3) {
+            make_key(i, buffer, &key, 100);
+            BFC_ASSERT_EQUAL(0, ham_erase(m_db, 0, &key, 0));
+        }
+        for (int i=0; i<500; i++) {
+            make_key(i, buffer, &key, 100);
+            memset(&rec, 0, sizeof(rec));
+            BFC_ASSERT_EQUAL((i%3) ? 0 : HAM_KEY_NOT_FOUND,
+                    ham_find(m_db, 0, &key, &rec, 0));
+        }
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+
+    void reopenTest()
+    {
+        if (m_flags&HAM_IN_MEMORY_DB)
+            return;
+
+        create();
+        insert(0, KEYS/2);
+        ham_u64_t buckets=backend()->get_bucket_count();
+
+        reopen();
+        BFC_ASSERT_EQUAL(buckets, backend()->get_bucket_count());
+        verify(0, KEYS/2, true);
+        insert(KEYS/2, KEYS);
+
+        reopen();
+        verify(0, KEYS, true);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+
+    void cursorTest()
+    {
+        ham_cursor_t *c;
+        ham_key_t key;
+        ham_record_t rec;
+        char buffer[32];
+        std::vector<bool> seen(KEYS, false);
+        int count=0;
+        ham_offset_t size;
+        ham_u32_t dupes;
+
+        create();
+        insert(0, KEYS);
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &c));
+
+        BFC_ASSERT_EQUAL(HAM_NOT_IMPLEMENTED,
+                ham_cursor_move(c, 0, 0, HAM_CURSOR_LAST));
+        BFC_ASSERT_EQUAL(HAM_CURSOR_IS_NIL,
+                ham_cursor_move(c, 0, 0, 0));
+
+        /* every key is visited exactly once */
+        memset(&key, 0, sizeof(key));
+        memset(&rec, 0, sizeof(rec));
+        ham_status_t st=ham_cursor_move(c, &key, &rec, HAM_CURSOR_NEXT);
+        while (st==0) {
+            int i=*(int *)rec.data;
+            BFC_ASSERT(i>=0 && i<KEYS);
+            BFC_ASSERT(!seen[i]);
+            make_key(i, buffer, &key);
+            BFC_ASSERT_EQUAL(0, strcmp(buffer, (const char *)key.data));
+            seen[i]=true;
+            count++;
+            memset(&key, 0, sizeof(key));
+            st=ham_cursor_move(c, &key, &rec, HAM_CURSOR_NEXT);
+        }
+        BFC_ASSERT_EQUAL(HAM_KEY_NOT_FOUND, st);
+        BFC_ASSERT_EQUAL(KEYS, count);
+        BFC_ASSERT_EQUAL(HAM_NOT_IMPLEMENTED,
+                ham_cursor_move(c, 0, 0, HAM_CURSOR_PREVIOUS));
+
+        /* find, overwrite and erase */
+        make_key(42, buffer, &key);
+        BFC_ASSERT_EQUAL(0, ham_cursor_find(c, &key, 0));
+        BFC_ASSERT_EQUAL(0, ham_cursor_get_duplicate_count(c, &dupes, 0));
+        BFC_ASSERT_EQUAL((ham_u32_t)1, dupes);
+        memset(&rec, 0, sizeof(rec));
+        rec.data=buffer;
+        rec.size=20;
+        BFC_ASSERT_EQUAL(0, ham_cursor_overwrite(c, &rec, 0));
+        BFC_ASSERT_EQUAL(0, ham_cursor_get_record_size(c, &size));
+        BFC_ASSERT_EQUAL((ham_offset_t)20, size);
+        memset(&key, 0, sizeof(key));
+        memset(&rec, 0, sizeof(rec));
+        BFC_ASSERT_EQUAL(0, ham_cursor_move(c, &key, &rec, 0));
+        BFC_ASSERT_EQUAL((ham_size_t)20, rec.size);
+        BFC_ASSERT_EQUAL(0, strcmp("key00000042", (const char *)key.data));
+
+        BFC_ASSERT_EQUAL(0, ham_cursor_erase(c, 0));
+        BFC_ASSERT_EQUAL(HAM_CURSOR_IS_NIL, ham_cursor_move(c, 0, 0, 0));
+        make_key(42, buffer, &key);
+        BFC_ASSERT_EQUAL(HAM_KEY_NOT_FOUND, ham_find(m_db, 0, &key, &rec, 0));
+
+        /* a cursor on an erased key is set to nil */
+        make_key(43, buffer, &key);
+        BFC_ASSERT_EQUAL(0, ham_cursor_find(c, &key, 0));
+        BFC_ASSERT_EQUAL(0, ham_erase(m_db, 0, &key, 0));
+        BFC_ASSERT_EQUAL(HAM_CURSOR_IS_NIL, ham_cursor_move(c, 0, 0, 0));
+
+        /* insert through the cursor */
+        make_key(KEYS, buffer, &key);
+        memset(&rec, 0, sizeof(rec));
+        BFC_ASSERT_EQUAL(0, ham_cursor_insert(c, &key, &rec, 0));
+        memset(&key, 0, sizeof(key));
+        BFC_ASSERT_EQUAL(0, ham_cursor_move(c, &key, 0, 0));
+        sprintf(buffer, "key%08d", KEYS);
+        BFC_ASSERT_EQUAL(0, strcmp(buffer, (const char *)key.data));
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(c));
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+
+    void eraseRangeTest()
+    {
+        ham_u64_t count;
+        char buffer1[32], buffer2[32];
+        ham_key_t begin, end;
+
+        create();
+        insert(0, KEYS);
+        make_key(1000, buffer1, &begin);
+        make_key(2000, buffer2, &end);
+        BFC_ASSERT_EQUAL(0, ham_erase_range(m_db, 0, &begin, &end, 0));
+
+        verify(0, 1000, true);
+        verify(1000, 2000, false);
+        verify(2000, KEYS, true);
+        BFC_ASSERT_EQUAL(0, ham_get_key_count(m_db, 0, 0, &count));
+        BFC_ASSERT_EQUAL((ham_u64_t)KEYS-1000, count);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+};
+
+class InMemoryHashTest : public HashTest
+{
+public:
+    InMemoryHashTest()
+    :   HashTest(HAM_IN_MEMORY_DB, "InMemoryHashTest")
+    {
+    }
+};
+
+class RecoveryHashTest : public HashTest
+{
+public:
+    RecoveryHashTest()
+    :   HashTest(HAM_ENABLE_RECOVERY, "RecoveryHashTest")
+    {
+        clear_tests();
+        BFC_REGISTER_TEST(RecoveryHashTest, insertFindTest);
+        BFC_REGISTER_TEST(RecoveryHashTest, eraseTest);
+        BFC_REGISTER_TEST(RecoveryHashTest, reopenTest);
+        BFC_REGISTER_TEST(RecoveryHashTest, eraseRangeTest);
+    }
+};
+
+class TransactionHashTest : public HashTest
+{
+public:
+    TransactionHashTest()
+    :   HashTest(HAM_ENABLE_TRANSACTIONS, "TransactionHashTest")
+    {
+        clear_tests();
+        BFC_REGISTER_TEST(TransactionHashTest, rejectTest);
+    }
+
+    void rejectTest()
+    {
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create(m_env, BFC_OPATH(".test"), m_flags, 0644));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_create_db(m_env, m_db, 1, HAM_USE_HASH, 0));
+    }
+};
+
+BFC_REGISTER_FIXTURE(HashTest);
+BFC_REGISTER_FIXTURE(InMemoryHashTest);
+BFC_REGISTER_FIXTURE(RecoveryHashTest);
+BFC_REGISTER_FIXTURE(TransactionHashTest);
@@ -0,0 +1,374 @@
+/**
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+#include "../src/config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ham/hamsterdb.h>
+#include "../src/db.h"
+#include "../src/keytype.h"
+
+#include "bfc-testsuite.hpp"
+#include "hamster_fixture.hpp"
+#include "os.hpp"
+
+using namespace bfc;
+
+#define KEYS        2000
+
+static int HAM_CALLCONV
+my_reverse_compare(ham_db_t *db,
+        const ham_u8_t *lhs, ham_size_t lsize,
+        const ham_u8_t *rhs, ham_size_t rsize)
+{
+    (void)db;
+    return (-keytype_compare(HAM_TYPE_UINT32, lhs, lsize, rhs, rsize));
+}
+
+class KeyTypeTest : public hamsterDB_fixture
+{
+    define_super(hamsterDB_fixture);
+
+public:
+    KeyTypeTest(ham_u32_t flags=0, const char *name="KeyTypeTest")
+    :   hamsterDB_fixture(name), m_db(0), m_env(0), m_flags(flags)
+    {
+        testrunner::get_instance()->register_fixture(this);
+        BFC_REGISTER_TEST(KeyTypeTest, compareTest);
+        BFC_REGISTER_TEST(KeyTypeTest, uint32Test);
+        BFC_REGISTER_TEST(KeyTypeTest, int64Test);
+        BFC_REGISTER_TEST(KeyTypeTest, real64Test);
+        BFC_REGISTER_TEST(KeyTypeTest, binaryFixedTest);
+        BFC_REGISTER_TEST(KeyTypeTest, invalidKeySizeTest);
+        BFC_REGISTER_TEST(KeyTypeTest, invalidParameterTest);
+        BFC_REGISTER_TEST(KeyTypeTest, reopenTest);
+        BFC_REGISTER_TEST(KeyTypeTest, compareFuncTest);
+    }
+
+protected:
+    ham_db_t *m_db;
+    ham_env_t *m_env;
+    ham_u32_t m_flags;
+
+public:
+    virtual void setup()
+    {
+        __super::setup();
+
+        os::unlink(BFC_OPATH(".test"));
+        BFC_ASSERT_EQUAL(0, ham_new(&m_db));
+        BFC_ASSERT_EQUAL(0, ham_env_new(&m_env));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create(m_env, (m_flags&HAM_IN_MEMORY_DB)
+                        ? 0
+                        : BFC_OPATH(".test"), m_flags, 0644));
+    }
+
+    virtual void teardown()
+    {
+        __super::teardown();
+
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+        ham_delete(m_db);
+        ham_env_delete(m_env);
+        m_db=0;
+        m_env=0;
+    }
+
+    ham_status_t create(ham_u64_t type, ham_u64_t keysize=0)
+    {
+        ham_parameter_t params[]={
+            {HAM_PARAM_KEY_TYPE, type},
+            {(ham_u32_t)(keysize ? HAM_PARAM_KEYSIZE : 0), keysize},
+            {0, 0}
+        };
+        return (ham_env_create_db(m_env, m_db, 1, 0, &params[0]));
+    }
+
+    void reopen()
+    {
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_open(m_env, BFC_OPATH(".test"), m_flags));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(m_env, m_db, 1, 0, 0));
+    }
+
+    void insert(void *data, ham_size_t size)
+    {
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        key.data=data;
+        key.size=size;
+        rec.data=data;
+        rec.size=size;
+        BFC_ASSERT_EQUAL(0, ham_insert(m_db, 0, &key, &rec, 0));
+    }
+
+    /* walks the Database with a cursor and verifies that the records
+     * (which are copies of the keys) are sorted */
+    template<typename T>
+    void verify_ascending(ham_size_t count)
+    {
+        ham_cursor_t *cursor;
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        ham_size_t n=0;
+        T last=0, current;
+
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &cursor));
+        while (0==ham_cursor_move(cursor, &key, &rec, HAM_CURSOR_NEXT)) {
+            BFC_ASSERT_EQUAL((ham_u16_t)sizeof(T), key.size);
+            BFC_ASSERT_EQUAL(0, memcmp(key.data, rec.data, sizeof(T)));
+            memcpy(&current, key.data, sizeof(T));
+            if (n)
+                BFC_ASSERT(last<current);
+            last=current;
+            n++;
+        }
+        BFC_ASSERT_EQUAL(count, n);
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+    }
+
+    void compareTest()
+    {
+        ham_u32_t a=1, b=0x100;
+        ham_s64_t c=-5, d=3;
+        double e=-0.0, f=0.0, g=1.5;
+        char h[4]="abc", i[4]="abd";
+
+        /* with memcmp, 1 > 0x100 on little endian machines */
+        BFC_ASSERT_EQUAL(-1, keytype_compare(HAM_TYPE_UINT32, &a, 4, &b, 4));
+        BFC_ASSERT_EQUAL(+1, keytype_compare(HAM_TYPE_UINT32, &b, 4, &a, 4));
+        BFC_ASSERT_EQUAL(0, keytype_compare(HAM_TYPE_UINT32, &a, 4, &a, 4));
+        BFC_ASSERT_EQUAL(-1, keytype_compare(HAM_TYPE_INT64, &c, 8, &d, 8));
+        BFC_ASSERT_EQUAL(0, keytype_compare(HAM_TYPE_REAL64, &e, 8, &f, 8));
+        BFC_ASSERT_EQUAL(-1, keytype_compare(HAM_TYPE_REAL64, &f, 8, &g, 8));
+        BFC_ASSERT_EQUAL(-1,
+                keytype_compare(HAM_TYPE_BINARY_FIXED, h, 4, i, 4));
+        BFC_ASSERT_EQUAL(+1,
+                keytype_get_compare_func(HAM_TYPE_INT64)(0,
+                    (ham_u8_t *)&d, 8, (ham_u8_t *)&c, 8));
+        BFC_ASSERT(keytype_get_compare_func(HAM_TYPE_BINARY)==0);
+        BFC_ASSERT_EQUAL(4, keytype_get_size(HAM_TYPE_UINT32));
+        BFC_ASSERT_EQUAL(8, keytype_get_size(HAM_TYPE_REAL64));
+        BFC_ASSERT_EQUAL(0, keytype_get_size(HAM_TYPE_BINARY_FIXED));
+    }
+
+    void uint32Test()
+    {
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        ham_u32_t k;
+
+        BFC_ASSERT_EQUAL(0, create(HAM_TYPE_UINT32));
+        BFC_ASSERT(((Database *)m_db)->has_typed_compare());
+        BFC_ASSERT_EQUAL(4, db_get_keysize((Database *)m_db));
+
+        /* insert in a scrambled order to split the pages */
+        for (int i=0; i<KEYS; i++) {
+            k=(ham_u32_t)((i*7919)%KEYS)*257;
+            insert(&k, sizeof(k));
+        }
+        verify_ascending<ham_u32_t>(KEYS);
+
+        k=257*10;
+        key.data=&k;
+        key.size=sizeof(k);
+        BFC_ASSERT_EQUAL(0, ham_find(m_db, 0, &key, &rec, 0));
+        BFC_ASSERT_EQUAL(0, memcmp(rec.data, &k, sizeof(k)));
+        k=257*10+1;
+        BFC_ASSERT_EQUAL(HAM_KEY_NOT_FOUND, ham_find(m_db, 0, &key, &rec, 0));
+        BFC_ASSERT_EQUAL(HAM_KEY_NOT_FOUND, ham_erase(m_db, 0, &key, 0));
+        k=257*10;
+        BFC_ASSERT_EQUAL(0, ham_erase(m_db, 0, &key, 0));
+        verify_ascending<ham_u32_t>(KEYS-1);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+
+    void int64Test()
+    {
+        ham_s64_t k;
+
+        BFC_ASSERT_EQUAL(0, create(HAM_TYPE_INT64));
+        for (int i=0; i<KEYS; i++) {
+            k=((ham_s64_t)((i*7919)%KEYS)-KEYS/2)*1000003;
+            insert(&k, sizeof(k));
+        }
+        verify_ascending<ham_s64_t>(KEYS);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+
+    void real64Test()
+    {
+        ham_cursor_t *cursor;
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        double k;
+
+        BFC_ASSERT_EQUAL(0, create(HAM_TYPE_REAL64));
+        for (int i=0; i<KEYS; i++) {
+            k=((double)((i*7919)%KEYS)-KEYS/2)/4.0;
+            insert(&k, sizeof(k));
+        }
+        verify_ascending<double>(KEYS);
+
+        /* approximate matching uses the typed comparator as well */
+        k=0.1;
+        key.data=&k;
+        key.size=sizeof(k);
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &cursor));
+        BFC_ASSERT_EQUAL(0,
+                ham_cursor_find_ex(cursor, &key, &rec, HAM_FIND_GT_MATCH));
+        memcpy(&k, key.data, sizeof(k));
+        BFC_ASSERT(k==0.25);
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+    }
+
+    void binaryFixedTest()
+    {
+        /* "key%08d" and the terminating zero */
+        const ham_u16_t keysize=12;
+        char buffer[16];
+
+        BFC_ASSERT_EQUAL(0, create(HAM_TYPE_BINARY_FIXED, keysize));
+        BFC_ASSERT_EQUAL(keysize, db_get_keysize((Database *)m_db));
+        for (int i=0; i<KEYS; i++) {
+            snprintf(buffer, sizeof(buffer), "key%08d", (i*7919)%KEYS);
+            insert(buffer, keysize);
+        }
+
+        ham_cursor_t *cursor;
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        int n=0;
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &cursor));
+        while (0==ham_cursor_move(cursor, &key, &rec, HAM_CURSOR_NEXT)) {
+            snprintf(buffer, sizeof(buffer), "key%08d", n++);
+            BFC_ASSERT_EQUAL(keysize, key.size);
+            BFC_ASSERT_EQUAL(0, memcmp(key.data, buffer, key.size));
+        }
+        BFC_ASSERT_EQUAL(KEYS, n);
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+    }
+
+    void invalidKeySizeTest()
+    {
+        ham_cursor_t *cursor;
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        ham_u64_t k=1;
+
+        BFC_ASSERT_EQUAL(0, create(HAM_TYPE_UINT32));
+        key.data=&k;
+        key.size=sizeof(k);
+        BFC_ASSERT_EQUAL(HAM_INV_KEYSIZE, ham_insert(m_db, 0, &key, &rec, 0));
+        BFC_ASSERT_EQUAL(HAM_INV_KEYSIZE, ham_find(m_db, 0, &key, &rec, 0));
+        BFC_ASSERT_EQUAL(HAM_INV_KEYSIZE, ham_erase(m_db, 0, &key, 0));
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &cursor));
+        BFC_ASSERT_EQUAL(HAM_INV_KEYSIZE,
+                ham_cursor_insert(cursor, &key, &rec, 0));
+        BFC_ASSERT_EQUAL(HAM_INV_KEYSIZE,
+                ham_cursor_find(cursor, &key, 0));
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+
+        key.size=0;
+        key.data=0;
+        BFC_ASSERT_EQUAL(HAM_INV_KEYSIZE, ham_insert(m_db, 0, &key, &rec, 0));
+    }
+
+    void invalidParameterTest()
+    {
+        ham_parameter_t params[]={
+            {HAM_PARAM_KEY_TYPE, HAM_TYPE_UINT32},
+            {0, 0}
+        };
+
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER, create(99));
+        BFC_ASSERT_EQUAL(HAM_INV_KEYSIZE, create(HAM_TYPE_UINT64, 16));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_create_db(m_env, m_db, 1, HAM_RECORD_NUMBER,
+                    &params[0]));
+        BFC_ASSERT_EQUAL(0, create(HAM_TYPE_UINT64, 8));
+    }
+
+    void reopenTest()
+    {
+        ham_parameter_t query[]={
+            {HAM_PARAM_KEY_TYPE, 0},
+            {0, 0}
+        };
+        ham_u32_t k;
+
+        BFC_ASSERT_EQUAL(0, create(HAM_TYPE_UINT32));
+        for (int i=KEYS; i>0; i--) {
+            k=(ham_u32_t)i*300;
+            insert(&k, sizeof(k));
+        }
+        BFC_ASSERT_EQUAL(0, ham_get_parameters(m_db, &query[0]));
+        BFC_ASSERT_EQUAL((ham_u64_t)HAM_TYPE_UINT32, query[0].value);
+
+        if (m_flags&HAM_IN_MEMORY_DB)
+            return;
+
+        reopen();
+        query[0].value=0;
+        BFC_ASSERT_EQUAL(0, ham_get_parameters(m_db, &query[0]));
+        BFC_ASSERT_EQUAL((ham_u64_t)HAM_TYPE_UINT32, query[0].value);
+        BFC_ASSERT(((Database *)m_db)->has_typed_compare());
+        k=0x12345;
+        insert(&k, sizeof(k));
+        verify_ascending<ham_u32_t>(KEYS+1);
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+    }
+
+    void compareFuncTest()
+    {
+        BFC_ASSERT_EQUAL(0, create(HAM_TYPE_UINT32));
+
+        /* a custom compare function replaces the typed comparator */
+        BFC_ASSERT_EQUAL(0, ham_set_compare_func(m_db, my_reverse_compare));
+        BFC_ASSERT(!((Database *)m_db)->has_typed_compare());
+        BFC_ASSERT_EQUAL(-1, ((Database *)m_db)->get_compare_func()(m_db,
+                    (ham_u8_t *)"\2\0\0\0", 4, (ham_u8_t *)"\1\0\0\0", 4));
+
+        /* and resetting it restores the comparator of the key type */
+        BFC_ASSERT_EQUAL(0, ham_set_compare_func(m_db, 0));
+        BFC_ASSERT(((Database *)m_db)->has_typed_compare());
+        BFC_ASSERT_EQUAL(HAM_TYPE_UINT32, ((Database *)m_db)->get_key_type());
+    }
+};
+
+class InMemoryKeyTypeTest : public KeyTypeTest
+{
+public:
+    InMemoryKeyTypeTest()
+    :   KeyTypeTest(HAM_IN_MEMORY_DB, "InMemoryKeyTypeTest")
+    {
+    }
+};
+
+class TransactionKeyTypeTest : public KeyTypeTest
+{
+public:
+    TransactionKeyTypeTest()
+    :   KeyTypeTest(HAM_ENABLE_TRANSACTIONS, "TransactionKeyTypeTest")
+    {
+        clear_tests();
+        BFC_REGISTER_TEST(TransactionKeyTypeTest, uint32Test);
+        BFC_REGISTER_TEST(TransactionKeyTypeTest, int64Test);
+        BFC_REGISTER_TEST(TransactionKeyTypeTest, reopenTest);
+    }
+};
+
+BFC_REGISTER_FIXTURE(KeyTypeTest);
+BFC_REGISTER_FIXTURE(InMemoryKeyTypeTest);
+BFC_REGISTER_FIXTURE(TransactionKeyTypeTest);
@@ -0,0 +1,262 @@
+/**
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+#include "../src/config.h"
+
+#include <string.h>
+#include <ham/hamsterdb.h>
+#include <ham/hamsterdb_int.h>
+#include "../src/env.h"
+#include "../src/metrics.h"
+
+#include "bfc-testsuite.hpp"
+#include "hamster_fixture.hpp"
+#include "os.hpp"
+
+using namespace bfc;
+
+
+class MetricsTest : public hamsterDB_fixture
+{
+    define_super(hamsterDB_fixture);
+
+public:
+    MetricsTest()
+    :   hamsterDB_fixture("MetricsTest")
+    {
+        testrunner::get_instance()->register_fixture(this);
+        BFC_REGISTER_TEST(MetricsTest, bucketTest);
+        BFC_REGISTER_TEST(MetricsTest, percentileTest);
+        BFC_REGISTER_TEST(MetricsTest, disabledTest);
+        BFC_REGISTER_TEST(MetricsTest, negativeTest);
+        BFC_REGISTER_TEST(MetricsTest, operationsTest);
+        BFC_REGISTER_TEST(MetricsTest, ioCountersTest);
+        BFC_REGISTER_TEST(MetricsTest, resetTest);
+    }
+
+protected:
+    ham_db_t *m_db;
+    ham_env_t *m_env;
+
+public:
+    virtual void setup()
+    {
+        __super::setup();
+
+        os::unlink(BFC_OPATH(".test"));
+        BFC_ASSERT_EQUAL(0, ham_new(&m_db));
+        BFC_ASSERT_EQUAL(0, ham_env_new(&m_env));
+    }
+
+    virtual void teardown()
+    {
+        __super::teardown();
+
+        ham_delete(m_db);
+        ham_env_delete(m_env);
+        m_db=0;
+        m_env=0;
+    }
+
+    void create(ham_u32_t flags)
+    {
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create(m_env, BFC_OPATH(".test"), flags, 0644));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create_db(m_env, m_db, 1, 0, 0));
+    }
+
+    void close()
+    {
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+    }
+
+    void insert(int i, ham_txn_t *txn=0)
+    {
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        key.data=&i;
+        key.size=sizeof(i);
+        rec.data=&i;
+        rec.size=sizeof(i);
+        BFC_ASSERT_EQUAL(0, ham_insert(m_db, txn, &key, &rec, 0));
+    }
+
+    void bucketTest()
+    {
+        for (int i=0; i<4; i++)
+            BFC_ASSERT_EQUAL(i, Metrics::get_bucket(i));
+        BFC_ASSERT_EQUAL(4, Metrics::get_bucket(4));
+        BFC_ASSERT_EQUAL(7, Metrics::get_bucket(7));
+        BFC_ASSERT_EQUAL(8, Metrics::get_bucket(8));
+        BFC_ASSERT_EQUAL(8, Metrics::get_bucket(9));
+        BFC_ASSERT(HAM_METRICS_HISTOGRAM_BUCKETS
+                > Metrics::get_bucket(0xffffffffffffffffull));
+
+        /* every value must be <= the upper bound of its bucket, and
+         * greater than the upper bound of the previous bucket */
+        for (ham_u64_t v=1; v<1000000; v=v*3+1) {
+            int b=Metrics::get_bucket(v);
+            BFC_ASSERT(v<=Metrics::get_bucket_upper_bound(b));
+            BFC_ASSERT(v>Metrics::get_bucket_upper_bound(b-1));
+        }
+    }
+
+    void percentileTest()
+    {
+        Metrics m;
+        for (int i=1; i<=100; i++)
+            m.record_operation(HAM_METRICS_OP_FIND, i*1000);
+
+        const ham_latency_histogram_t *h=
+                &m.get_data()->operations[HAM_METRICS_OP_FIND];
+        BFC_ASSERT_EQUAL((ham_u64_t)100, h->count);
+        BFC_ASSERT_EQUAL((ham_u64_t)1000, h->min_ns);
+        BFC_ASSERT_EQUAL((ham_u64_t)100000, h->max_ns);
+        BFC_ASSERT_EQUAL((ham_u64_t)5050000, h->total_ns);
+
+        /* the error of a percentile is at most 25% */
+        ham_u64_t p50=ham_latency_histogram_get_percentile(h, 50);
+        BFC_ASSERT(p50>=50000 && p50<=62500);
+        ham_u64_t p99=ham_latency_histogram_get_percentile(h, 99);
+        BFC_ASSERT(p99>=99000 && p99<=100000);
+        BFC_ASSERT_EQUAL((ham_u64_t)100000,
+                ham_latency_histogram_get_percentile(h, 100));
+        BFC_ASSERT_EQUAL((ham_u64_t)0,
+                ham_latency_histogram_get_percentile(
+                    &m.get_data()->operations[HAM_METRICS_OP_ERASE], 50));
+    }
+
+    void disabledTest()
+    {
+        ham_env_metrics_t metrics;
+
+        create(0);
+        BFC_ASSERT_EQUAL((Metrics *)0, ((Environment *)m_env)->get_metrics());
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_get_metrics(m_env, &metrics, 0));
+        close();
+    }
+
+    void negativeTest()
+    {
+        ham_env_metrics_t metrics;
+
+        create(HAM_ENABLE_METRICS);
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_get_metrics(0, &metrics, 0));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_get_metrics(m_env, 0, 0));
+        close();
+    }
+
+    void operationsTest()
+    {
+        ham_env_metrics_t metrics;
+        ham_cursor_t *cursor;
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        int i=1;
+
+        create(HAM_ENABLE_METRICS);
+        insert(1);
+        insert(2);
+        key.data=&i;
+        key.size=sizeof(i);
+        BFC_ASSERT_EQUAL(0, ham_find(m_db, 0, &key, &rec, 0));
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &cursor));
+        BFC_ASSERT_EQUAL(0,
+                ham_cursor_move(cursor, 0, 0, HAM_CURSOR_FIRST));
+        BFC_ASSERT_EQUAL(0, ham_cursor_find(cursor, &key, 0));
+        BFC_ASSERT_EQUAL(0, ham_cursor_erase(cursor, 0));
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+        i=2;
+        BFC_ASSERT_EQUAL(0, ham_erase(m_db, 0, &key, 0));
+
+        BFC_ASSERT_EQUAL(0, ham_env_get_metrics(m_env, &metrics, 0));
+        BFC_ASSERT_EQUAL((ham_u64_t)2,
+                metrics.operations[HAM_METRICS_OP_INSERT].count);
+        BFC_ASSERT_EQUAL((ham_u64_t)2,
+                metrics.operations[HAM_METRICS_OP_FIND].count);
+        BFC_ASSERT_EQUAL((ham_u64_t)2,
+                metrics.operations[HAM_METRICS_OP_ERASE].count);
+        BFC_ASSERT_EQUAL((ham_u64_t)1,
+                metrics.operations[HAM_METRICS_OP_CURSOR_MOVE].count);
+        BFC_ASSERT_EQUAL((ham_u64_t)0,
+                metrics.operations[HAM_METRICS_OP_TXN_COMMIT].count);
+        BFC_ASSERT(metrics.operations[HAM_METRICS_OP_INSERT].max_ns
+                >= metrics.operations[HAM_METRICS_OP_INSERT].min_ns);
+        BFC_ASSERT(metrics.cache_hits>0);
+        close();
+    }
+
+    void ioCountersTest()
+    {
+        ham_env_metrics_t metrics;
+
+        create(HAM_ENABLE_METRICS|HAM_ENABLE_TRANSACTIONS);
+        for (int i=0; i<100; i++) {
+            ham_txn_t *txn;
+            BFC_ASSERT_EQUAL(0, ham_txn_begin(&txn, m_env, 0, 0, 0));
+            insert(i, txn);
+            BFC_ASSERT_EQUAL(0, ham_txn_commit(txn, 0));
+        }
+        BFC_ASSERT_EQUAL(0, ham_env_flush(m_env, 0));
+        BFC_ASSERT_EQUAL(0, ham_env_get_metrics(m_env, &metrics, 0));
+        BFC_ASSERT_EQUAL((ham_u64_t)100,
+                metrics.operations[HAM_METRICS_OP_INSERT].count);
+        BFC_ASSERT_EQUAL((ham_u64_t)100,
+                metrics.operations[HAM_METRICS_OP_TXN_COMMIT].count);
+        BFC_ASSERT(metrics.pages_written>0);
+        BFC_ASSERT(metrics.bytes_written>0);
+        BFC_ASSERT(metrics.journal_bytes>0);
+        BFC_ASSERT(metrics.log_bytes>0);
+        close();
+
+        /* reopen and read the keys; pages are read from disk */
+        BFC_ASSERT_EQUAL(0, ham_env_open(m_env, BFC_OPATH(".test"),
+                    HAM_ENABLE_METRICS|HAM_DISABLE_MMAP));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(m_env, m_db, 1, 0, 0));
+        for (int i=0; i<100; i++) {
+            ham_key_t key={0};
+            ham_record_t rec={0};
+            key.data=&i;
+            key.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0, ham_find(m_db, 0, &key, &rec, 0));
+        }
+        BFC_ASSERT_EQUAL(0, ham_env_get_metrics(m_env, &metrics, 0));
+        BFC_ASSERT(metrics.cache_misses>0);
+        BFC_ASSERT(metrics.pages_read>0);
+        BFC_ASSERT(metrics.bytes_read>=metrics.pages_read*
+                ((Environment *)m_env)->get_pagesize());
+        close();
+    }
+
+    void resetTest()
+    {
+        ham_env_metrics_t metrics;
+
+        create(HAM_ENABLE_METRICS);
+        insert(1);
+        BFC_ASSERT_EQUAL(0,
+                ham_env_get_metrics(m_env, &metrics, HAM_METRICS_RESET));
+        BFC_ASSERT_EQUAL((ham_u64_t)1,
+                metrics.operations[HAM_METRICS_OP_INSERT].count);
+        BFC_ASSERT_EQUAL(0, ham_env_get_metrics(m_env, &metrics, 0));
+        BFC_ASSERT_EQUAL((ham_u64_t)0,
+                metrics.operations[HAM_METRICS_OP_INSERT].count);
+        close();
+    }
+
+};
+
+BFC_REGISTER_FIXTURE(MetricsTest);
+
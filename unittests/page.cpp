@@ -14,14 +14,18 @@
 #include <stdexcept>
 #include <string.h>
 #include <ham/hamsterdb.h>
+#include "../src/blob.h"
+#include "../src/checksum.h"
 #include "../src/db.h"
 #include "../src/page.h"
 #include "../src/device.h"
 #include "../src/env.h"
+#include "../src/os.h"
 #include "../src/txn.h"
 
 #include "bfc-testsuite.hpp"
 #include "hamster_fixture.hpp"
+#include "os.hpp"
 
 using namespace bfc;
 
@@ -165,7 +169,266 @@ public:
     }
 };
 
+class ChecksumTest : public hamsterDB_fixture
+{
+    define_super(hamsterDB_fixture);
+
+public:
+    ChecksumTest()
+    :   hamsterDB_fixture("ChecksumTest"), m_env(0), m_db(0)
+    {
+        testrunner::get_instance()->register_fixture(this);
+        BFC_REGISTER_TEST(ChecksumTest, crc32cTest);
+        BFC_REGISTER_TEST(ChecksumTest, pageChecksumTest);
+        BFC_REGISTER_TEST(ChecksumTest, corruptPageTest);
+        BFC_REGISTER_TEST(ChecksumTest, corruptPageNoMmapTest);
+        BFC_REGISTER_TEST(ChecksumTest, corruptBlobTest);
+        BFC_REGISTER_TEST(ChecksumTest, disabledChecksumTest);
+        BFC_REGISTER_TEST(ChecksumTest, duplicateTest);
+    }
+
+protected:
+    ham_env_t *m_env;
+    ham_db_t *m_db;
+
+public:
+    virtual void setup()
+    {
+        __super::setup();
+
+        os::unlink(BFC_OPATH(".test"));
+        BFC_ASSERT_EQUAL(0, ham_env_new(&m_env));
+        BFC_ASSERT_EQUAL(0, ham_new(&m_db));
+    }
+
+    virtual void teardown()
+    {
+        __super::teardown();
+
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+        ham_env_delete(m_env);
+        ham_delete(m_db);
+    }
+
+    void create(ham_u32_t flags, ham_u32_t dbflags=0)
+    {
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create(m_env, BFC_OPATH(".test"), flags, 0644));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create_db(m_env, m_db, 1, dbflags, 0));
+    }
+
+    void reopen(ham_u32_t flags)
+    {
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_open(m_env, BFC_OPATH(".test"), flags));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(m_env, m_db, 1, 0, 0));
+    }
+
+    void insert(int i, ham_size_t size, ham_u32_t flags=0)
+    {
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        ham_u8_t buffer[1024*16];
+
+        ham_assert(size<=sizeof(buffer), (""));
+        memset(buffer, i, size);
+        key.data=&i;
+        key.size=sizeof(i);
+        rec.data=buffer;
+        rec.size=size;
+        BFC_ASSERT_EQUAL(0, ham_insert(m_db, 0, &key, &rec, flags));
+    }
+
+    ham_status_t find(int i)
+    {
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        key.data=&i;
+        key.size=sizeof(i);
+        return (ham_find(m_db, 0, &key, &rec, 0));
+    }
+
+    /* flips a byte in the file */
+    void corrupt(ham_offset_t offset)
+    {
+        ham_fd_t fd;
+        ham_u8_t b;
+
+        BFC_ASSERT_EQUAL(0, os_open(BFC_OPATH(".test"), 0, &fd));
+        BFC_ASSERT_EQUAL(0, os_pread(fd, offset, &b, 1));
+        b^=0x55;
+        BFC_ASSERT_EQUAL(0, os_pwrite(fd, offset, &b, 1));
+        BFC_ASSERT_EQUAL(0, os_close(fd, 0));
+    }
+
+    void crc32cTest()
+    {
+        const char *s="123456789";
+        ham_u8_t buffer[1000];
+
+        BFC_ASSERT_EQUAL(0xe3069283u, crc32c(0, s, 9));
+        BFC_ASSERT_EQUAL(0xe3069283u, crc32c_portable(0, s, 9));
+        BFC_ASSERT_EQUAL(0u, crc32c(0, s, 0));
+
+        /* the checksum can be computed in several steps */
+        BFC_ASSERT_EQUAL(0xe3069283u, crc32c(crc32c(0, s, 4), s+4, 5));
+
+        /* all alignments and lengths produce the same result */
+        for (int i=0; i<(int)sizeof(buffer); i++)
+            buffer[i]=(ham_u8_t)(i*7);
+        for (int i=0; i<16; i++) {
+            for (int j=0; j<64; j++) {
+                BFC_ASSERT_EQUAL(crc32c_portable(0, &buffer[i], 900+j),
+                        crc32c(0, &buffer[i], 900+j));
+            }
+        }
+    }
+
+    void pageChecksumTest()
+    {
+        create(HAM_ENABLE_CRC32);
+        Environment *env=(Environment *)m_env;
+        ham_size_t ps=env->get_pagesize();
+        Page *page=new Page(env);
+
+        BFC_ASSERT_EQUAL(0, page->allocate());
+        memset(page->get_pers(), 0x13, ps);
+        BFC_ASSERT_EQUAL(false, page->has_checksum());
+
+        page->set_checksum();
+        BFC_ASSERT_EQUAL(true, page->has_checksum());
+        BFC_ASSERT_EQUAL(true, page->verify_checksum());
+
+        page->get_raw_payload()[ps/2]^=1;
+        BFC_ASSERT_EQUAL(false, page->verify_checksum());
+
+        page->clear_checksum();
+        BFC_ASSERT_EQUAL(false, page->has_checksum());
+
+        BFC_ASSERT_EQUAL(0, page->free());
+        delete page;
+    }
+
+    void corruptPage(ham_u32_t flags)
+    {
+        ham_env_metrics_t metrics;
+        ham_size_t ps;
+
+        create(HAM_ENABLE_CRC32|flags);
+        ps=((Environment *)m_env)->get_pagesize();
+        for (int i=0; i<10; i++)
+            insert(i, 16);
+
+        /* the file is intact */
+        reopen(flags|HAM_ENABLE_METRICS);
+        BFC_ASSERT_EQUAL(0, find(3));
+
+        /* corrupt the root page of the Database */
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+        corrupt(ps+ps/2);
+        reopen(flags|HAM_ENABLE_METRICS);
+        BFC_ASSERT_EQUAL(HAM_CHECKSUM_MISMATCH, find(3));
+
+        BFC_ASSERT_EQUAL(0, ham_env_get_metrics(m_env, &metrics, 0));
+        BFC_ASSERT_EQUAL((ham_u64_t)1, metrics.checksum_failures);
+    }
+
+    void corruptPageTest()
+    {
+        corruptPage(0);
+    }
+
+    void corruptPageNoMmapTest()
+    {
+        corruptPage(HAM_DISABLE_MMAP);
+    }
+
+    void corruptBlobTest()
+    {
+        ham_env_metrics_t metrics;
+        ham_offset_t rid;
+        ham_size_t ps;
+
+        create(HAM_ENABLE_CRC32);
+        ps=((Environment *)m_env)->get_pagesize();
+        insert(1, 10000);
+        insert(2, 100);
+
+        /* partial reads are not verified, but complete reads are */
+        reopen(HAM_ENABLE_METRICS);
+        BFC_ASSERT_EQUAL(0, find(1));
+        BFC_ASSERT_EQUAL(0, find(2));
+
+        /* the large blob starts in the first page after the root page */
+        rid=ps*2;
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+        corrupt(rid+sizeof(blob_t)+5000);
+        reopen(HAM_ENABLE_METRICS);
+        BFC_ASSERT_EQUAL(HAM_CHECKSUM_MISMATCH, find(1));
+        BFC_ASSERT_EQUAL(0, find(2));
+
+        BFC_ASSERT_EQUAL(0, ham_env_get_metrics(m_env, &metrics, 0));
+        BFC_ASSERT_EQUAL((ham_u64_t)1, metrics.checksum_failures);
+
+        /* overwriting the blob stores a new checksum */
+        insert(1, 10000, HAM_OVERWRITE);
+        BFC_ASSERT_EQUAL(0, find(1));
+    }
+
+    void disabledChecksumTest()
+    {
+        Page *page;
+        ham_size_t ps;
+
+        /* pages which are written without HAM_ENABLE_CRC32 don't have a
+         * checksum; existing checksums are removed when the page is
+         * written */
+        create(0);
+        insert(1, 16);
+        reopen(HAM_ENABLE_CRC32);
+        BFC_ASSERT_EQUAL(0, find(1));
+        insert(2, 16);
+        BFC_ASSERT_EQUAL(0, ham_flush(m_db, 0));
+        ps=((Environment *)m_env)->get_pagesize();
+        BFC_ASSERT_EQUAL(0, db_fetch_page(&page, (Database *)m_db, ps, 0));
+        BFC_ASSERT_EQUAL(true, page->has_checksum());
+
+        reopen(0);
+        BFC_ASSERT_EQUAL(0, find(1));
+        insert(3, 16);
+        BFC_ASSERT_EQUAL(0, ham_flush(m_db, 0));
+        BFC_ASSERT_EQUAL(0, db_fetch_page(&page, (Database *)m_db, ps, 0));
+        BFC_ASSERT_EQUAL(false, page->has_checksum());
+
+        reopen(0);
+        BFC_ASSERT_EQUAL(0, find(1));
+        BFC_ASSERT_EQUAL(0, find(2));
+        BFC_ASSERT_EQUAL(0, find(3));
+    }
+
+    void duplicateTest()
+    {
+        ham_cursor_t *cursor;
+
+        /* duplicate tables are modified in place and therefore don't have
+         * a checksum */
+        create(HAM_ENABLE_CRC32, HAM_ENABLE_DUPLICATES);
+        for (int i=0; i<20; i++)
+            insert(1, 200, HAM_DUPLICATE);
+        reopen(HAM_ENABLE_CRC32);
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &cursor));
+        BFC_ASSERT_EQUAL(0,
+                ham_cursor_move(cursor, 0, 0, HAM_CURSOR_FIRST));
+        BFC_ASSERT_EQUAL(0, ham_cursor_erase(cursor, 0));
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+        BFC_ASSERT_EQUAL(0, find(1));
+    }
+};
+
 BFC_REGISTER_FIXTURE(PageTest);
 BFC_REGISTER_FIXTURE(RwPageTest);
 BFC_REGISTER_FIXTURE(InMemoryPageTest);
+BFC_REGISTER_FIXTURE(ChecksumTest);
 
@@ -51,6 +51,7 @@ public:
         BFC_REGISTER_TEST(RecNoTest, overwriteCursorTest);
         BFC_REGISTER_TEST(RecNoTest, eraseLastReopenTest);
         BFC_REGISTER_TEST(RecNoTest, uncoupleTest);
+        BFC_REGISTER_TEST(RecNoTest, findWithGapsTest);
     }
 
 protected:
@@ -753,6 +754,59 @@ public:
 
         BFC_ASSERT_EQUAL(0, ham_close(m_db, HAM_AUTO_CLEANUP));
     }
+
+    bool isErased(ham_u64_t recno)
+    {
+        return (recno%7==0 || (recno>=100 && recno<400) || recno==2999);
+    }
+
+    void findWithGapsTest(void)
+    {
+        ham_key_t key;
+        ham_record_t rec;
+        ham_u64_t recno;
+        ham_parameter_t p[]={
+            {HAM_PARAM_PAGESIZE, 1024},
+            {0, 0}
+        };
+
+        memset(&key, 0, sizeof(key));
+        memset(&rec, 0, sizeof(rec));
+        key.flags=HAM_KEY_USER_ALLOC;
+        key.data=&recno;
+        key.size=sizeof(recno);
+
+        /* the small pagesize creates a tree with several levels */
+        BFC_ASSERT_EQUAL(0,
+                ham_create_ex(m_db, BFC_OPATH(".test"),
+                        m_flags|HAM_RECORD_NUMBER, 0664, &p[0]));
+        for (int i=0; i<3000; i++) {
+            rec.data=&i;
+            rec.size=sizeof(i);
+            BFC_ASSERT_EQUAL(0, ham_insert(m_db, 0, &key, &rec, 0));
+        }
+
+        /* the erased records leave gaps in the nodes */
+        for (recno=1; recno<=3000; recno++) {
+            if (isErased(recno))
+                BFC_ASSERT_EQUAL(0, ham_erase(m_db, 0, &key, 0));
+        }
+        BFC_ASSERT_EQUAL(0, ham_check_integrity(m_db, 0));
+
+        for (ham_u64_t i=1; i<=3001; i++) {
+            memset(&rec, 0, sizeof(rec));
+            recno=i;
+            if (i==3001 || isErased(i)) {
+                BFC_ASSERT_EQUAL(HAM_KEY_NOT_FOUND,
+                        ham_find(m_db, 0, &key, &rec, 0));
+                continue;
+            }
+            BFC_ASSERT_EQUAL(0, ham_find(m_db, 0, &key, &rec, 0));
+            BFC_ASSERT_EQUAL((int)i-1, *(int *)rec.data);
+        }
+
+        BFC_ASSERT_EQUAL(0, ham_close(m_db, 0));
+    }
 };
 
 class InMemoryRecNoTest : public RecNoTest
@@ -774,6 +828,7 @@ public:
         BFC_REGISTER_TEST(InMemoryRecNoTest, overwriteTest);
         BFC_REGISTER_TEST(InMemoryRecNoTest, overwriteCursorTest);
         BFC_REGISTER_TEST(InMemoryRecNoTest, uncoupleTest);
+        BFC_REGISTER_TEST(InMemoryRecNoTest, findWithGapsTest);
     }
 
 };
@@ -34,18 +34,42 @@ void
 usage(void)
 {
     printf("usage: ./recovery insert <keysize> <recsize> <i> <dupes> "
-           "<use_txn> <inducer>\n");
+           "<use_txn> <inducer> [<xts>]\n");
     printf("usage: ./recovery erase <keysize> <i> <dupes> "
-           "<use_txn> <inducer>\n");
+           "<use_txn> <inducer> [<xts>]\n");
     printf("usage: ./recovery recover <use_txn>\n");
     printf("usage: ./recovery verify <keysize> <recsize> <i> <dupes> "
-           "<use_txn> <exist>\n");
+           "<use_txn> <exist> [<xts>]\n");
+}
+
+// <exist> is 0 if the keys must not exist, 1 if they must exist and 2 if
+// they may exist (i.e. if an operation without Transactions crashed
+// before it was logged); then the Database is also checked.
+//
+// the pages are encrypted with HAM_ENCRYPTION_XTS if <xts> is not 0;
+// the log stores the encrypted pages, therefore the recovery does not
+// need the key
+void
+enable_xts(ham_env_t *env, int xts)
+{
+    static ham_u8_t aeskey[16]={
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+    };
+
+    if (!xts)
+        return;
+    ham_status_t st=ham_env_enable_encryption(env, aeskey, HAM_ENCRYPTION_XTS);
+    if (st) {
+        printf("ham_env_enable_encryption failed: %d\n", (int)st);
+        exit(-1);
+    }
 }
 
 void
 insert(int argc, char **argv)
 {
-    if (argc!=8) {
+    if (argc!=8 && argc!=9) {
         usage();
         exit(-1);
     }
@@ -63,8 +87,10 @@ insert(int argc, char **argv)
     int dupes  =(int)strtol(argv[5], 0, 0);
     int use_txn=(int)strtol(argv[6], 0, 0);
     int inducer=(int)strtol(argv[7], 0, 0);
+    int xts    =argc==9 ? (int)strtol(argv[8], 0, 0) : 0;
     printf("insert: keysize=%d, recsize=%d, i=%d, dupes=%d, use_txn=%d, "
-           "inducer=%d\n", keysize, recsize, i, dupes, use_txn, inducer);
+           "inducer=%d, xts=%d\n", keysize, recsize, i, dupes, use_txn,
+           inducer, xts);
 
     ham_key_t key={0};
     key.data=malloc(keysize);
@@ -95,6 +121,7 @@ insert(int argc, char **argv)
             printf("ham_env_create_ex failed: %d\n", (int)st);
             exit(-1);
         }
+        enable_xts(env, xts);
         st=ham_env_create_db(env, db, 1, 0, 0);
         if (st) {
             printf("ham_env_create_db failed: %d\n", (int)st);
@@ -106,6 +133,7 @@ insert(int argc, char **argv)
         exit(-1);
     }
     else {
+        enable_xts(env, xts);
         st=ham_env_open_db(env, db, 1, 0, 0);
         if (st) {
             printf("ham_env_open_db failed: %d\n", (int)st);
@@ -161,7 +189,7 @@ insert(int argc, char **argv)
 void
 erase(int argc, char **argv)
 {
-    if (argc!=7) {
+    if (argc!=7 && argc!=8) {
         usage();
         exit(-1);
     }
@@ -178,8 +206,9 @@ erase(int argc, char **argv)
     int dupes  =(int)strtol(argv[4], 0, 0);
     int use_txn=(int)strtol(argv[5], 0, 0);
     int inducer=(int)strtol(argv[6], 0, 0);
-    printf("erase: keysize=%d, i=%d, dupes=%d, use_txn=%d, inducer=%d\n",
-            keysize, i, dupes, use_txn, inducer);
+    int xts    =argc==8 ? (int)strtol(argv[7], 0, 0) : 0;
+    printf("erase: keysize=%d, i=%d, dupes=%d, use_txn=%d, inducer=%d, "
+            "xts=%d\n", keysize, i, dupes, use_txn, inducer, xts);
 
     ham_key_t key={0};
     key.data=malloc(keysize);
@@ -193,6 +222,7 @@ erase(int argc, char **argv)
         printf("ham_env_open failed: %d\n", (int)st);
         exit(-1);
     }
+    enable_xts(env, xts);
     st=ham_env_open_db(env, db, 1, 0, 0);
     if (st) {
         printf("ham_env_open_db failed: %d\n", (int)st);
@@ -221,6 +251,11 @@ erase(int argc, char **argv)
         if (dupes) {
             *(int *)&p[key.size-sizeof(int)]=i*NUM_STEPS;
             st=ham_erase(db, txn, &key, 0);
+            // without Transactions, a crashed insert can lose the key
+            if (st==HAM_KEY_NOT_FOUND && !use_txn) {
+                st=0;
+                break;
+            }
             if (st) {
                 if (st==HAM_INTERNAL_ERROR && !use_txn)
                     break;
@@ -232,6 +267,11 @@ erase(int argc, char **argv)
         else {
             *(int *)&p[key.size-sizeof(int)]=(i*NUM_STEPS)+j;
             st=ham_erase(db, txn, &key, 0);
+            // without Transactions, a crashed insert can lose the key
+            if (st==HAM_KEY_NOT_FOUND && !use_txn) {
+                st=0;
+                break;
+            }
             if (st) {
                 if (st==HAM_INTERNAL_ERROR && !use_txn)
                     break;
@@ -299,7 +339,7 @@ recover(int argc, char **argv)
 void
 verify(int argc, char **argv)
 {
-    if (argc!=8) {
+    if (argc!=8 && argc!=9) {
         usage();
         exit(-1);
     }
@@ -310,8 +350,10 @@ verify(int argc, char **argv)
     int dupes  =(int)strtol(argv[5], 0, 0);
     int use_txn=(int)strtol(argv[6], 0, 0);
     int exist  =(int)strtol(argv[7], 0, 0);
+    int xts    =argc==9 ? (int)strtol(argv[8], 0, 0) : 0;
     printf("verify: keysize=%d, recsize=%d, i=%d, dupes=%d, use_txn=%d, "
-           "exist=%d\n", keysize, recsize, i, dupes, use_txn, exist);
+           "exist=%d, xts=%d\n", keysize, recsize, i, dupes, use_txn, exist,
+           xts);
 
     ham_status_t st;
     ham_db_t *db;
@@ -337,6 +379,7 @@ verify(int argc, char **argv)
         printf("ham_env_open failed: %d\n", (int)st);
         exit(-1);
     }
+    enable_xts(env, xts);
     st=ham_env_open_db(env, db, 1, 0, 0);
     if (st) {
         printf("ham_env_open_db failed: %d\n", (int)st);
@@ -353,6 +396,8 @@ verify(int argc, char **argv)
             *(int *)&p[key.size-sizeof(int)]=(i*NUM_STEPS)+j;
 
         st=ham_find(db, 0, &key, &rec2, 0);
+        if (exist==2 && st==HAM_KEY_NOT_FOUND)
+            break;
         if (exist && st!=0) {
             printf("ham_find failed but shouldn't: %d\n", (int)st);
             exit(-1);
@@ -373,6 +418,14 @@ verify(int argc, char **argv)
         if (!use_txn)
             break;
     }
+
+    if (exist==2) {
+        st=ham_check_integrity(db, 0);
+        if (st) {
+            printf("ham_check_integrity failed: %d\n", (int)st);
+            exit(-1);
+        }
+    }
 }
 
 int
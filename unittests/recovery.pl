@@ -121,6 +121,36 @@ sub extended_duplicate_test {
     }
 }
 
+# the pages are written in runs of adjacent pages (and encrypted in
+# batches if $xts is set); the inducer also crashes between two of these
+# writes. The Journal needs the key for the recovery, therefore
+# Transactions are disabled, and an operation which crashes before it was
+# logged is lost (verify with <exist>=2)
+sub flush_test {
+    $xts=shift;
+    for ($i=1; $i<=20; $i++) {
+        unlink("recovery.db");
+        unlink("recovery.db.log0");
+        unlink("recovery.db.jrn0");
+        unlink("recovery.db.jrn1");
+
+        print "============================================================\n";
+        print "inserting $max keys...\n";
+        for ($k=0; $k<$max; $k++) {
+            check(system("./recovery insert 1024 1024 $k 0 0 $i $xts"));
+            check(system("./recovery recover 0"));
+            check(system("./recovery verify 1024 1024 $k 0 0 2 $xts"));
+        }
+
+        print "erasing $max keys...\n";
+        for ($k=$max-1; $k>=0; $k--) {
+            check(system("./recovery erase 1024 $k 0 0 $i $xts"));
+            check(system("./recovery recover 0"));
+            check(system("./recovery verify 1024 1024 $k 0 0 2 $xts"));
+        }
+    }
+}
+
 print "----------------------------\nsimple_test\n";
 simple_test(1);
 
@@ -133,4 +163,10 @@ duplicate_test(1);
 print "----------------------------\nextended_duplicate_test\n";
 extended_duplicate_test(1);
 
+print "----------------------------\nflush_test\n";
+flush_test(0);
+
+print "----------------------------\nxts_flush_test\n";
+flush_test(1);
+
 exit(0);
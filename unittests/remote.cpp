@@ -49,6 +49,7 @@ public:
         BFC_REGISTER_TEST(RemoteTest, enableEncryptionTest);
         BFC_REGISTER_TEST(RemoteTest, createDbTest);
         BFC_REGISTER_TEST(RemoteTest, createDbExtendedTest);
+        BFC_REGISTER_TEST(RemoteTest, createTypedDbTest);
         BFC_REGISTER_TEST(RemoteTest, openDbTest);
         BFC_REGISTER_TEST(RemoteTest, eraseDbTest);
         BFC_REGISTER_TEST(RemoteTest, getDbParamsTest);
@@ -365,6 +366,73 @@ protected:
         ham_delete(db);
     }
 
+    void checkTypedDb(ham_db_t *db)
+    {
+        ham_key_t key;
+        ham_record_t rec, rec2;
+        ham_u64_t k=0x1234567890ull;
+        char buffer[32]="hello world";
+        ham_parameter_t params[] =
+        {
+            {HAM_PARAM_KEY_TYPE, 0},
+            {HAM_PARAM_KEYSIZE, 0},
+            {HAM_PARAM_RECORD_INLINE_SIZE, 0},
+            {0,0}
+        };
+
+        BFC_ASSERT_EQUAL(0, ham_get_parameters(db, &params[0]));
+        BFC_ASSERT_EQUAL((ham_u64_t)HAM_TYPE_UINT64, params[0].value);
+        BFC_ASSERT_EQUAL((ham_u64_t)sizeof(k), params[1].value);
+        BFC_ASSERT_EQUAL((ham_u64_t)sizeof(buffer), params[2].value);
+
+        memset(&key, 0, sizeof(key));
+        key.data=&k;
+        key.size=sizeof(k);
+        memset(&rec, 0, sizeof(rec));
+        rec.data=buffer;
+        rec.size=sizeof(buffer);
+        memset(&rec2, 0, sizeof(rec2));
+        BFC_ASSERT_EQUAL(0, ham_insert(db, 0, &key, &rec, HAM_OVERWRITE));
+        BFC_ASSERT_EQUAL(0, ham_find(db, 0, &key, &rec2, 0));
+        BFC_ASSERT_EQUAL(rec.size, rec2.size);
+        BFC_ASSERT_EQUAL(0, memcmp(rec.data, rec2.data, rec2.size));
+    }
+
+    void createTypedDbTest(void)
+    {
+        ham_env_t *env;
+        ham_db_t *db;
+        ham_parameter_t params[] =
+        {
+            {HAM_PARAM_KEY_TYPE, HAM_TYPE_UINT64},
+            {HAM_PARAM_RECORD_INLINE_SIZE, 32},
+            {0,0}
+        };
+
+        /* the default Database */
+        BFC_ASSERT_EQUAL(0, ham_new(&db));
+        BFC_ASSERT_EQUAL(0,
+                ham_create_ex(db, SERVER_URL, 0, 0664, &params[0]));
+        checkTypedDb(db);
+        BFC_ASSERT_EQUAL(0, ham_close(db, 0));
+
+        /* a Database of an Environment; the type is persistent */
+        BFC_ASSERT_EQUAL(0, ham_env_new(&env));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create(env, SERVER_URL, 0, 0664));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create_db(env, db, 22, 0, &params[0]));
+        checkTypedDb(db);
+        BFC_ASSERT_EQUAL(0, ham_close(db, 0));
+        BFC_ASSERT_EQUAL(0, ham_env_open_db(env, db, 22, 0, 0));
+        checkTypedDb(db);
+
+        BFC_ASSERT_EQUAL(0, ham_close(db, 0));
+        BFC_ASSERT_EQUAL(0, ham_env_close(env, 0));
+        ham_env_delete(env);
+        ham_delete(db);
+    }
+
     void openDbTest(void)
     {
         ham_env_t *env;
@@ -0,0 +1,422 @@
+/**
+ * Copyright (C) 2005-2012 Christoph Rupp (chris@crupp.de).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See files COPYING.* for License information.
+ */
+
+#include "../src/config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <ham/hamsterdb.h>
+#include <ham/hamsterdb_int.h>
+#include "../src/env.h"
+#include "../src/trace.h"
+
+#include "bfc-testsuite.hpp"
+#include "hamster_fixture.hpp"
+#include "os.hpp"
+
+using namespace bfc;
+
+
+class TraceTest : public hamsterDB_fixture
+{
+    define_super(hamsterDB_fixture);
+
+public:
+    TraceTest()
+    :   hamsterDB_fixture("TraceTest")
+    {
+        testrunner::get_instance()->register_fixture(this);
+        BFC_REGISTER_TEST(TraceTest, negativeTest);
+        BFC_REGISTER_TEST(TraceTest, headerTest);
+        BFC_REGISTER_TEST(TraceTest, operationsTest);
+        BFC_REGISTER_TEST(TraceTest, transactionTest);
+        BFC_REGISTER_TEST(TraceTest, fullDataTest);
+        BFC_REGISTER_TEST(TraceTest, disableTest);
+        BFC_REGISTER_TEST(TraceTest, eraseRangeTest);
+        BFC_REGISTER_TEST(TraceTest, recordStreamTest);
+    }
+
+protected:
+    ham_db_t *m_db;
+    ham_env_t *m_env;
+    std::vector<ham_u8_t> m_trace;
+
+public:
+    virtual void setup()
+    {
+        __super::setup();
+
+        os::unlink(BFC_OPATH(".test"));
+        os::unlink(BFC_OPATH(".trace"));
+        BFC_ASSERT_EQUAL(0, ham_new(&m_db));
+        BFC_ASSERT_EQUAL(0, ham_env_new(&m_env));
+    }
+
+    virtual void teardown()
+    {
+        __super::teardown();
+
+        ham_delete(m_db);
+        ham_env_delete(m_env);
+        m_db=0;
+        m_env=0;
+        os::unlink(BFC_OPATH(".trace"));
+    }
+
+    void create(ham_u32_t flags)
+    {
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create(m_env, BFC_OPATH(".test"), flags, 0644));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_create_db(m_env, m_db, 1, 0, 0));
+    }
+
+    void close()
+    {
+        BFC_ASSERT_EQUAL(0, ham_env_close(m_env, HAM_AUTO_CLEANUP));
+    }
+
+    /* reads the trace file and returns the header */
+    trace_header_t *load()
+    {
+        FILE *f=fopen(BFC_OPATH(".trace"), "rb");
+        BFC_ASSERT(f!=0);
+        m_trace.clear();
+        ham_u8_t buf[1024];
+        size_t n;
+        while ((n=fread(buf, 1, sizeof(buf), f))>0)
+            m_trace.insert(m_trace.end(), buf, buf+n);
+        fclose(f);
+        BFC_ASSERT(m_trace.size()>=sizeof(trace_header_t));
+        return ((trace_header_t *)&m_trace[0]);
+    }
+
+    /* returns all entries of the loaded trace */
+    std::vector<trace_entry_t *> get_entries()
+    {
+        std::vector<trace_entry_t *> v;
+        size_t off=sizeof(trace_header_t);
+        while (off<m_trace.size()) {
+            BFC_ASSERT(off+sizeof(trace_entry_t)<=m_trace.size());
+            trace_entry_t *e=(trace_entry_t *)&m_trace[off];
+            v.push_back(e);
+            off+=sizeof(trace_entry_t)+e->payload_size;
+        }
+        BFC_ASSERT_EQUAL(m_trace.size(), off);
+        return (v);
+    }
+
+    void negativeTest()
+    {
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_enable_tracing(0, BFC_OPATH(".trace"), 0));
+        BFC_ASSERT_EQUAL(HAM_NOT_INITIALIZED,
+                ham_env_enable_tracing(m_env, BFC_OPATH(".trace"), 0));
+        create(0);
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_enable_tracing(m_env, 0, 0));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_disable_tracing(m_env));
+        BFC_ASSERT_EQUAL(HAM_INV_PARAMETER,
+                ham_env_disable_tracing(0));
+        BFC_ASSERT_EQUAL(0,
+                ham_env_enable_tracing(m_env, BFC_OPATH(".trace"), 0));
+        BFC_ASSERT_EQUAL(HAM_ALREADY_INITIALIZED,
+                ham_env_enable_tracing(m_env, BFC_OPATH(".trace"), 0));
+        close();
+    }
+
+    void headerTest()
+    {
+        create(0);
+        BFC_ASSERT_EQUAL((Tracer *)0, ((Environment *)m_env)->get_tracer());
+        BFC_ASSERT_EQUAL(0, ham_env_enable_tracing(m_env,
+                    BFC_OPATH(".trace"), HAM_TRACE_FULL_DATA));
+        BFC_ASSERT(((Environment *)m_env)->get_tracer()!=0);
+        close();
+
+        trace_header_t *h=load();
+        BFC_ASSERT_EQUAL((ham_u32_t)HAM_TRACE_MAGIC, h->magic);
+        BFC_ASSERT_EQUAL((ham_u32_t)HAM_TRACE_VERSION, h->version);
+        BFC_ASSERT_EQUAL((ham_u32_t)HAM_TRACE_FULL_DATA, h->flags);
+
+        /* the open Database is recorded when tracing starts, and
+         * closed when the Environment is closed */
+        std::vector<trace_entry_t *> v=get_entries();
+        BFC_ASSERT_EQUAL(2u, v.size());
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_OPEN_DB, v[0]->op);
+        BFC_ASSERT_EQUAL((ham_u16_t)1, v[0]->dbname);
+        BFC_ASSERT(v[0]->key_size>0);
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_CLOSE_DB, v[1]->op);
+        BFC_ASSERT_EQUAL((ham_u16_t)1, v[1]->dbname);
+    }
+
+    void operationsTest()
+    {
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        ham_cursor_t *c1, *c2;
+        int i=1;
+
+        create(0);
+        BFC_ASSERT_EQUAL(0,
+                ham_env_enable_tracing(m_env, BFC_OPATH(".trace"), 0));
+        key.data=&i;
+        key.size=sizeof(i);
+        rec.data=&i;
+        rec.size=sizeof(i);
+        BFC_ASSERT_EQUAL(0, ham_insert(m_db, 0, &key, &rec, 0));
+        BFC_ASSERT_EQUAL(HAM_DUPLICATE_KEY,
+                ham_insert(m_db, 0, &key, &rec, 0));
+        BFC_ASSERT_EQUAL(0, ham_find(m_db, 0, &key, &rec, 0));
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &c1));
+        BFC_ASSERT_EQUAL(0, ham_cursor_clone(c1, &c2));
+        BFC_ASSERT_EQUAL(0, ham_cursor_move(c2, 0, 0, HAM_CURSOR_FIRST));
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(c2));
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(c1));
+        BFC_ASSERT_EQUAL(0, ham_erase(m_db, 0, &key, 0));
+        BFC_ASSERT_EQUAL(0, ham_env_flush(m_env, 0));
+        close();
+
+        load();
+        std::vector<trace_entry_t *> v=get_entries();
+        BFC_ASSERT_EQUAL(12u, v.size());
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_OPEN_DB, v[0]->op);
+
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_INSERT, v[1]->op);
+        BFC_ASSERT_EQUAL(0, v[1]->status);
+        BFC_ASSERT_EQUAL((ham_u32_t)sizeof(i), v[1]->key_size);
+        BFC_ASSERT_EQUAL((ham_u32_t)sizeof(i), v[1]->record_size);
+        BFC_ASSERT_EQUAL(Tracer::hash(&i, sizeof(i)), v[1]->key_hash);
+        BFC_ASSERT_EQUAL((ham_u32_t)0, v[1]->payload_size);
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_INSERT, v[2]->op);
+        BFC_ASSERT_EQUAL(HAM_DUPLICATE_KEY, v[2]->status);
+        BFC_ASSERT(v[2]->timestamp>=v[1]->timestamp);
+
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_FIND, v[3]->op);
+        BFC_ASSERT_EQUAL(v[1]->key_hash, v[3]->key_hash);
+
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_CURSOR_CREATE, v[4]->op);
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_CURSOR_CLONE, v[5]->op);
+        BFC_ASSERT(v[4]->cursor_id!=0);
+        BFC_ASSERT(v[5]->cursor_id!=v[4]->cursor_id);
+        BFC_ASSERT_EQUAL(v[4]->cursor_id, v[5]->key_hash);
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_CURSOR_MOVE, v[6]->op);
+        BFC_ASSERT_EQUAL(v[5]->cursor_id, v[6]->cursor_id);
+        BFC_ASSERT_EQUAL((ham_u32_t)HAM_CURSOR_FIRST, v[6]->flags);
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_CURSOR_CLOSE, v[7]->op);
+        BFC_ASSERT_EQUAL(v[5]->cursor_id, v[7]->cursor_id);
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_CURSOR_CLOSE, v[8]->op);
+        BFC_ASSERT_EQUAL(v[4]->cursor_id, v[8]->cursor_id);
+
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_ERASE, v[9]->op);
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_FLUSH, v[10]->op);
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_CLOSE_DB, v[11]->op);
+
+        for (size_t j=0; j<v.size(); j++)
+            BFC_ASSERT_EQUAL((ham_u32_t)0, v[j]->thread_id);
+    }
+
+    void transactionTest()
+    {
+        ham_txn_t *txn;
+        int i=1;
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        key.data=&i;
+        key.size=sizeof(i);
+
+        create(HAM_ENABLE_TRANSACTIONS);
+        BFC_ASSERT_EQUAL(0,
+                ham_env_enable_tracing(m_env, BFC_OPATH(".trace"), 0));
+        BFC_ASSERT_EQUAL(0, ham_txn_begin(&txn, m_env, 0, 0, 0));
+        BFC_ASSERT_EQUAL(0, ham_insert(m_db, txn, &key, &rec, 0));
+        BFC_ASSERT_EQUAL(0, ham_txn_commit(txn, 0));
+        BFC_ASSERT_EQUAL(0, ham_txn_begin(&txn, m_env, 0, 0, 0));
+        BFC_ASSERT_EQUAL(0, ham_erase(m_db, txn, &key, 0));
+        BFC_ASSERT_EQUAL(0, ham_txn_abort(txn, 0));
+        close();
+
+        load();
+        std::vector<trace_entry_t *> v=get_entries();
+        BFC_ASSERT_EQUAL(8u, v.size());
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_TXN_BEGIN, v[1]->op);
+        BFC_ASSERT(v[1]->txn_id!=0);
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_INSERT, v[2]->op);
+        BFC_ASSERT_EQUAL(v[1]->txn_id, v[2]->txn_id);
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_TXN_COMMIT, v[3]->op);
+        BFC_ASSERT_EQUAL(v[1]->txn_id, v[3]->txn_id);
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_TXN_BEGIN, v[4]->op);
+        BFC_ASSERT(v[4]->txn_id!=v[1]->txn_id);
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_ERASE, v[5]->op);
+        BFC_ASSERT_EQUAL(v[4]->txn_id, v[5]->txn_id);
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_TXN_ABORT, v[6]->op);
+        BFC_ASSERT_EQUAL(v[4]->txn_id, v[6]->txn_id);
+    }
+
+    void fullDataTest()
+    {
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        char k[]="hello", r[]="world!";
+        key.data=k;
+        key.size=sizeof(k);
+        rec.data=r;
+        rec.size=sizeof(r);
+
+        create(0);
+        BFC_ASSERT_EQUAL(0, ham_env_enable_tracing(m_env,
+                    BFC_OPATH(".trace"), HAM_TRACE_FULL_DATA));
+        BFC_ASSERT_EQUAL(0, ham_insert(m_db, 0, &key, &rec, 0));
+        memset(&rec, 0, sizeof(rec));
+        BFC_ASSERT_EQUAL(0, ham_find(m_db, 0, &key, &rec, 0));
+        close();
+
+        load();
+        std::vector<trace_entry_t *> v=get_entries();
+        BFC_ASSERT_EQUAL(4u, v.size());
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_INSERT, v[1]->op);
+        BFC_ASSERT_EQUAL((ham_u32_t)(sizeof(k)+sizeof(r)),
+                v[1]->payload_size);
+        const char *p=(const char *)(v[1]+1);
+        BFC_ASSERT_EQUAL(0, memcmp(p, k, sizeof(k)));
+        BFC_ASSERT_EQUAL(0, memcmp(p+sizeof(k), r, sizeof(r)));
+
+        /* lookups only store the key */
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_FIND, v[2]->op);
+        BFC_ASSERT_EQUAL((ham_u32_t)sizeof(k), v[2]->payload_size);
+        BFC_ASSERT_EQUAL((ham_u32_t)sizeof(r), v[2]->record_size);
+    }
+
+    void disableTest()
+    {
+        ham_key_t key={0};
+        ham_record_t rec={0};
+
+        create(0);
+        BFC_ASSERT_EQUAL(0,
+                ham_env_enable_tracing(m_env, BFC_OPATH(".trace"), 0));
+        BFC_ASSERT_EQUAL(0, ham_insert(m_db, 0, &key, &rec, 0));
+        BFC_ASSERT_EQUAL(0, ham_env_disable_tracing(m_env));
+        BFC_ASSERT_EQUAL((Tracer *)0, ((Environment *)m_env)->get_tracer());
+        BFC_ASSERT_EQUAL(0, ham_find(m_db, 0, &key, &rec, 0));
+        close();
+
+        load();
+        std::vector<trace_entry_t *> v=get_entries();
+        BFC_ASSERT_EQUAL(2u, v.size());
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_INSERT, v[1]->op);
+    }
+
+    void eraseRangeTest()
+    {
+        ham_key_t begin={0}, end={0};
+        char b[]="aaa", e[]="zzzzz";
+        begin.data=b;
+        begin.size=sizeof(b);
+        end.data=e;
+        end.size=sizeof(e);
+
+        create(0);
+        BFC_ASSERT_EQUAL(0, ham_env_enable_tracing(m_env,
+                    BFC_OPATH(".trace"), HAM_TRACE_FULL_DATA));
+        BFC_ASSERT_EQUAL(0, ham_erase_range(m_db, 0, &begin, &end, 0));
+        BFC_ASSERT_EQUAL(0, ham_erase_range(m_db, 0, 0, &end, 0));
+        close();
+
+        load();
+        std::vector<trace_entry_t *> v=get_entries();
+        BFC_ASSERT_EQUAL(4u, v.size());
+
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_ERASE_RANGE, v[1]->op);
+        BFC_ASSERT_EQUAL((ham_u32_t)sizeof(b), v[1]->key_size);
+        BFC_ASSERT_EQUAL(Tracer::hash(b, sizeof(b)), v[1]->key_hash);
+        BFC_ASSERT_EQUAL((ham_u32_t)(sizeof(trace_range_t)+sizeof(b)
+                    +sizeof(e)), v[1]->payload_size);
+        trace_range_t *range=(trace_range_t *)(v[1]+1);
+        BFC_ASSERT_EQUAL((ham_u32_t)(TRACE_RANGE_BEGIN|TRACE_RANGE_END),
+                range->bounds);
+        BFC_ASSERT_EQUAL((ham_u32_t)sizeof(e), range->end_size);
+        BFC_ASSERT_EQUAL(Tracer::hash(e, sizeof(e)), range->end_hash);
+        const char *p=(const char *)(range+1);
+        BFC_ASSERT_EQUAL(0, memcmp(p, b, sizeof(b)));
+        BFC_ASSERT_EQUAL(0, memcmp(p+sizeof(b), e, sizeof(e)));
+
+        /* an open lower bound */
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_ERASE_RANGE, v[2]->op);
+        BFC_ASSERT_EQUAL((ham_u32_t)0, v[2]->key_size);
+        range=(trace_range_t *)(v[2]+1);
+        BFC_ASSERT_EQUAL((ham_u32_t)TRACE_RANGE_END, range->bounds);
+        BFC_ASSERT_EQUAL((ham_u32_t)(sizeof(trace_range_t)+sizeof(e)),
+                v[2]->payload_size);
+    }
+
+    void recordStreamTest()
+    {
+        ham_cursor_t *cursor;
+        ham_record_stream_t *s1, *s2;
+        ham_key_t key={0};
+        ham_record_t rec={0};
+        char k[]="key", d1[]="hello", d2[]=" world";
+        key.data=k;
+        key.size=sizeof(k);
+
+        create(0);
+        BFC_ASSERT_EQUAL(0, ham_env_enable_tracing(m_env,
+                    BFC_OPATH(".trace"), HAM_TRACE_FULL_DATA));
+        BFC_ASSERT_EQUAL(0, ham_cursor_create(m_db, 0, 0, &cursor));
+        BFC_ASSERT_EQUAL(0, ham_cursor_insert(cursor, &key, &rec, 0));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor, 0, &s1));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_write(s1, d1, sizeof(d1)-1));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_write(s1, d2, sizeof(d2)));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_close(s1));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_open(cursor,
+                    HAM_RECORD_STREAM_APPEND, &s2));
+        /* the stream is detached; closing it is not traced */
+        BFC_ASSERT_EQUAL(0, ham_cursor_close(cursor));
+        BFC_ASSERT_EQUAL(0, ham_record_stream_close(s2));
+        close();
+
+        load();
+        std::vector<trace_entry_t *> v=get_entries();
+        BFC_ASSERT_EQUAL(10u, v.size());
+
+        ham_u64_t cursor_id=v[1]->cursor_id;
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_RECORD_STREAM_OPEN, v[3]->op);
+        BFC_ASSERT_EQUAL(cursor_id, v[3]->cursor_id);
+        BFC_ASSERT_EQUAL((ham_u32_t)0, v[3]->flags);
+        ham_u64_t id=v[3]->key_hash;
+        BFC_ASSERT(id!=0);
+
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_RECORD_STREAM_WRITE, v[4]->op);
+        BFC_ASSERT_EQUAL(id, v[4]->key_hash);
+        BFC_ASSERT_EQUAL(cursor_id, v[4]->cursor_id);
+        BFC_ASSERT_EQUAL((ham_u32_t)sizeof(d1)-1, v[4]->record_size);
+        BFC_ASSERT_EQUAL((ham_u32_t)sizeof(d1)-1, v[4]->payload_size);
+        BFC_ASSERT_EQUAL(0, memcmp(v[4]+1, d1, sizeof(d1)-1));
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_RECORD_STREAM_WRITE, v[5]->op);
+        BFC_ASSERT_EQUAL((ham_u32_t)sizeof(d2), v[5]->record_size);
+        BFC_ASSERT_EQUAL(0, memcmp(v[5]+1, d2, sizeof(d2)));
+
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_RECORD_STREAM_CLOSE, v[6]->op);
+        BFC_ASSERT_EQUAL(id, v[6]->key_hash);
+
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_RECORD_STREAM_OPEN, v[7]->op);
+        BFC_ASSERT_EQUAL((ham_u32_t)HAM_RECORD_STREAM_APPEND, v[7]->flags);
+        BFC_ASSERT(v[7]->key_hash!=id);
+        BFC_ASSERT_EQUAL((ham_u8_t)Tracer::OP_CURSOR_CLOSE, v[8]->op);
+    }
+
+};
+
+BFC_REGISTER_FIXTURE(TraceTest);
+